@@ -47,8 +47,19 @@ bindgen -o "tracy-client-sys/src/generated_fibers.rs" \
   ${COMMON_BINDGEN_PARAMS[@]} \
   -DTRACY_FIBERS
 
+bindgen -o "tracy-client-sys/src/generated_zone_categories.rs" \
+  --rust-target 1.70.0 \
+  --allowlist-function='___tracy_zone_category_setup' \
+  --allowlist-function='___tracy_zone_category_enable' \
+  ${COMMON_BINDGEN_PARAMS[@]} \
+  -DTRACY_ZONE_CATEGORIES
+
 # The space after type avoids hitting members called "type".
 sed -i 's/pub type /type /g' 'tracy-client-sys/src/generated.rs'
+# The source locations only have a category with TRACY_ZONE_CATEGORIES.
+sed -i -e 's/^    pub color: u32,$/&\n    #[cfg(feature = "zone-categories")]\n    pub category: u32,/' \
+    -e 's/^fn bindgen_test_layout____tracy_source_location_data/#[cfg(not(feature = "zone-categories"))]\n&/' \
+    'tracy-client-sys/src/generated.rs'
 
 rm -rf "${DESTINATION}"
 
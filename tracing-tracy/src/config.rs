@@ -68,6 +68,73 @@ pub trait Config {
         true
     }
 
+    /// Specify whether span fields are only formatted when the span is entered while a profiler
+    /// is connected.
+    ///
+    /// By default the fields are formatted as soon as they're recorded, which a process pays for
+    /// even when no profiler ever connects to it. When this returns `true`, the field values are
+    /// kept as recorded instead, and only formatted upon entering the span if
+    /// [`Client::is_connected`]. Spans entered without a connected profiler show no fields, even
+    /// if their zones are sent to a profiler connecting later.
+    ///
+    /// Note that values recorded with `Debug` or `Display`, which `tracing` only lends out for
+    /// the duration of the recording, are still formatted right away.
+    ///
+    /// Default implementation returns `false`.
+    fn lazy_field_formatting(&self) -> bool {
+        false
+    }
+
+    /// Specify whether spans entered while no other span is entered on the thread, such as the
+    /// spans of asynchronous tasks, are recorded as Tracy fibers.
+    ///
+    /// Such a span gets a fiber of its own, which the thread is switched to whenever the span
+    /// is entered, so a task which moves between threads is still shown on a single timeline.
+    /// The zone of the span starts when it is first entered and ends when it is closed, which
+    /// makes the lifetime of the task visible, with the zones of the spans entered while it is
+    /// being polled nested within it. Fiber names are reused once their span is closed.
+    ///
+    /// A span must not be entered by two threads at once with this enabled. Requires the
+    /// `fibers` feature, and has no effect without it.
+    ///
+    /// Default implementation returns `false`.
+    fn fibers_for_tasks(&self) -> bool {
+        false
+    }
+
+    /// Specify whether the spans and events of a callsite are recorded at all.
+    ///
+    /// This is asked once for each callsite, when `tracing` registers it, and the answer is
+    /// cached by `tracing` itself, so the instrumentation at callsites which are filtered out costs
+    /// no more than a check of their cached interest. As with [`Layer::enabled`], filtering out
+    /// a callsite disables it for the whole subscriber, not only for the `TracyLayer`.
+    ///
+    /// The answer must only depend on the metadata, e.g. its `target()` and `level()`. Note that
+    /// events filtered out do not emit their `tracy.frame_mark` either.
+    ///
+    /// Default implementation returns `true`.
+    ///
+    /// [`Layer::enabled`]: tracing_subscriber::Layer::enabled
+    fn callsite_enabled(&self, metadata: &tracing_core::Metadata<'_>) -> bool {
+        let _ = metadata;
+        true
+    }
+
+    /// Specify that only every n-th span or event of a callsite is recorded.
+    ///
+    /// This samples instrumentation which is too frequent to be recorded in full, such as the
+    /// spans of a hot loop. The count is kept for each thread separately, and the spans which are
+    /// not sampled are not created at all, so the spans entered within them are recorded as if
+    /// they were entered in the parent. Like [`Config::callsite_enabled`], this is asked once for
+    /// each callsite (and thread) and applies to the whole subscriber.
+    ///
+    /// Default implementation returns `1`, which records every span and event. `0` is taken to
+    /// mean `1` as well.
+    fn callsite_sample_interval(&self, metadata: &tracing_core::Metadata<'_>) -> u32 {
+        let _ = metadata;
+        1
+    }
+
     /// Apply handling for errors detected by the [`TracyLayer`](super::TracyLayer).
     ///
     /// Fundamentally the way the tracing crate and the Tracy profiler work are somewhat
@@ -47,21 +47,28 @@
 //!
 #![doc = include_str!("../FEATURES.mkd")]
 
+#[cfg(feature = "fibers")]
+use client::FiberName;
 use client::{Client, Span};
 pub use config::{Config, DefaultConfig};
+#[cfg(feature = "fibers")]
+use std::cell::Cell;
 use std::sync::atomic::{AtomicUsize, Ordering};
-use std::{fmt::Write, mem};
+use std::{fmt::Write, mem, ops::Range};
 use tracing_core::{
-    field::{Field, Visit},
+    field::{display, DisplayValue, Field, Value, Visit},
     span::{Attributes, Id, Record},
-    Event, Subscriber,
+    subscriber::Interest,
+    Event, Metadata, Subscriber,
 };
-use tracing_subscriber::fmt::format::FormatFields;
+use tracing_subscriber::fmt::{format::FormatFields, FormattedFields};
 use tracing_subscriber::{
     layer::{Context, Layer},
     registry,
 };
-use utils::{StrCache, StrCacheGuard, VecCell};
+#[cfg(feature = "fibers")]
+use utils::{acquire_fiber, release_fiber};
+use utils::{intern_location, sample_callsite, StrCache, StrCacheGuard, VecCell};
 
 pub use client;
 mod config;
@@ -70,7 +77,13 @@ type TracyFields<C> = tracing_subscriber::fmt::FormattedFields<<C as Config>::Fo
 
 thread_local! {
     /// A stack of spans currently active on the current thread.
-    static TRACY_SPAN_STACK: VecCell<(Span, u64)> = const { VecCell::new() };
+    static TRACY_SPAN_STACK: VecCell<StackFrame> = const { VecCell::new() };
+}
+
+#[cfg(feature = "fibers")]
+thread_local! {
+    /// The fiber the current thread is in.
+    static CURRENT_FIBER: Cell<Option<FiberName>> = const { Cell::new(None) };
 }
 
 /// A tracing layer that collects data in Tracy profiling format.
@@ -103,6 +116,44 @@ impl<C> TracyLayer<C> {
 }
 
 impl<C: Config> TracyLayer<C> {
+    fn enter_span(&self, metadata: &'static Metadata<'static>, fields: Option<&str>) -> Span {
+        let file = metadata.file().unwrap_or("<not available>");
+        let line = metadata.line().unwrap_or(0);
+        let span = |name: &str| {
+            let name = self.truncate_span_to_length(
+                name,
+                file,
+                "",
+                "span information is too long and was truncated",
+            );
+            let stack_depth = self.config.stack_depth(metadata);
+            let client = self.client.clone();
+            match intern_location(metadata.callsite(), name, file, line) {
+                Some(location) => client.span(location, stack_depth),
+                None => client.span_alloc(Some(name), "", file, line, stack_depth),
+            }
+        };
+
+        match fields {
+            None => span(metadata.name()),
+            Some("") => span(metadata.name()),
+            Some(fields) if self.config.format_fields_in_zone_name() => CACHE.with(|cache| {
+                let mut buf = cache.acquire();
+                let _ = write!(buf, "{}{{{}}}", metadata.name(), fields);
+                span(&buf)
+            }),
+            Some(fields) => {
+                let span = span(metadata.name());
+                span.emit_text(self.truncate_to_length(
+                    (u16::MAX - 1).into(),
+                    fields,
+                    "span field values are too long and were truncated",
+                ));
+                span
+            }
+        }
+    }
+
     fn truncate_span_to_length<'a>(
         &self,
         data: &'a str,
@@ -160,6 +211,24 @@ pub fn set_max_cache_size(max_bytes_used_per_thread: usize) {
 
 thread_local! {
     static CACHE: StrCache = const { StrCache::new() };
+    static LAZY_VALUES: VecCell<Vec<(Field, LazyValue)>> = const { VecCell::new() };
+}
+
+static MAX_INTERNED_LOCATIONS: AtomicUsize = AtomicUsize::new(4096);
+
+/// Specify the maximum number of span locations interned by the layer.
+///
+/// Every span entry needs a source location, which includes the zone name, and thus also the
+/// span fields when [`Config::format_fields_in_zone_name`] is enabled. Locations are interned by
+/// the span callsite and the zone name, so that each of them is allocated, and sent to the
+/// profiler, only once. Interned locations are never freed.
+///
+/// Once the limit is reached, spans which need a location the current thread has not seen yet
+/// allocate it every time they are entered instead. A value of zero disables interning.
+///
+/// Defaults to `4096`, shared by all threads.
+pub fn set_max_interned_locations(max_locations: usize) {
+    MAX_INTERNED_LOCATIONS.store(max_locations, Ordering::Relaxed);
 }
 
 impl<S, C> Layer<S> for TracyLayer<C>
@@ -167,11 +236,42 @@ where
     S: Subscriber + for<'a> registry::LookupSpan<'a>,
     C: Config + 'static,
 {
+    fn register_callsite(&self, metadata: &'static Metadata<'static>) -> Interest {
+        if !self.config.callsite_enabled(metadata) {
+            Interest::never()
+        } else if self.config.callsite_sample_interval(metadata) > 1 {
+            // Sampled callsites are only decided upon in `enabled`.
+            Interest::sometimes()
+        } else {
+            Interest::always()
+        }
+    }
+
+    fn enabled(&self, metadata: &Metadata<'_>, _: Context<'_, S>) -> bool {
+        // This is also asked for callsites which are always enabled as far as this layer is
+        // concerned, if another layer or dispatcher needs to be asked.
+        sample_callsite(metadata.callsite(), || {
+            if self.config.callsite_enabled(metadata) {
+                self.config.callsite_sample_interval(metadata).max(1)
+            } else {
+                0
+            }
+        })
+    }
+
     fn on_new_span(&self, attrs: &Attributes<'_>, id: &Id, ctx: Context<'_, S>) {
         let Some(span) = ctx.span(id) else { return };
 
         let mut extensions = span.extensions_mut();
-        if extensions.get_mut::<TracyFields<C>>().is_none() {
+        if self.config.lazy_field_formatting() {
+            if extensions.get_mut::<LazyFields>().is_none() {
+                let mut fields = LazyFields::new(span.metadata());
+                attrs.record(&mut fields);
+                if !fields.values.is_empty() {
+                    extensions.insert(fields);
+                }
+            }
+        } else if extensions.get_mut::<TracyFields<C>>().is_none() {
             let mut fields =
                 TracyFields::<C>::new(CACHE.with(|cache| cache.acquire().into_inner()));
             if self
@@ -189,7 +289,15 @@ where
         let Some(span) = ctx.span(id) else { return };
 
         let mut extensions = span.extensions_mut();
-        if let Some(fields) = extensions.get_mut::<TracyFields<C>>() {
+        if self.config.lazy_field_formatting() {
+            if let Some(fields) = extensions.get_mut::<LazyFields>() {
+                values.record(fields);
+            } else {
+                let mut fields = LazyFields::new(span.metadata());
+                values.record(&mut fields);
+                extensions.insert(fields);
+            }
+        } else if let Some(fields) = extensions.get_mut::<TracyFields<C>>() {
             let _ = self.config.formatter().add_fields(fields, values);
         } else {
             let mut fields =
@@ -234,67 +342,39 @@ where
     fn on_enter(&self, id: &Id, ctx: Context<S>) {
         let Some(span) = ctx.span(id) else { return };
 
-        let extensions = span.extensions();
-        let fields = extensions.get::<TracyFields<C>>();
-        let stack_frame = {
-            let metadata = span.metadata();
-            let file = metadata.file().unwrap_or("<not available>");
-            let line = metadata.line().unwrap_or(0);
-            let span = |name: &str| {
-                (
-                    self.client.clone().span_alloc(
-                        Some(self.truncate_span_to_length(
-                            name,
-                            file,
-                            "",
-                            "span information is too long and was truncated",
-                        )),
-                        "",
-                        file,
-                        line,
-                        self.config.stack_depth(metadata),
-                    ),
-                    id.into_u64(),
-                )
-            };
-
-            match fields {
-                None => span(metadata.name()),
-                Some(fields) if fields.is_empty() => span(metadata.name()),
-                Some(fields) if self.config.format_fields_in_zone_name() => CACHE.with(|cache| {
-                    let mut buf = cache.acquire();
-                    let _ = write!(buf, "{}{{{}}}", metadata.name(), fields.fields);
-                    span(&buf)
-                }),
-                Some(fields) => {
-                    let span = span(metadata.name());
-                    span.0.emit_text(self.truncate_to_length(
-                        (u16::MAX - 1).into(),
-                        &fields.fields,
-                        "span field values are too long and were truncated",
-                    ));
-                    span
-                }
-            }
-        };
+        #[cfg(feature = "fibers")]
+        if self.config.fibers_for_tasks() && TRACY_SPAN_STACK.with(VecCell::is_empty) {
+            self.enter_fiber(id, &span);
+            return;
+        }
 
+        let zone = self.enter_zone(&span);
         TRACY_SPAN_STACK.with(|s| {
-            s.push(stack_frame);
+            s.push(StackFrame {
+                zone: Some(zone),
+                id: id.into_u64(),
+                #[cfg(feature = "fibers")]
+                previous_fiber: None,
+            });
         });
     }
 
     fn on_exit(&self, id: &Id, _: Context<S>) {
         let stack_frame = TRACY_SPAN_STACK.with(VecCell::pop);
 
-        if let Some((span, span_id)) = stack_frame {
-            if id.into_u64() != span_id {
+        if let Some(stack_frame) = stack_frame {
+            if id.into_u64() != stack_frame.id {
                 self.config.on_error(
                     &self.client,
                     "Tracing spans exited out of order! \
                         Trace might not be accurate for this span stack.",
                 );
             }
-            drop(span);
+            drop(stack_frame.zone);
+            #[cfg(feature = "fibers")]
+            if let Some(previous) = stack_frame.previous_fiber {
+                self.switch_fiber(previous);
+            }
         } else {
             self.config.on_error(
                 &self.client,
@@ -306,10 +386,253 @@ where
     fn on_close(&self, id: Id, ctx: Context<'_, S>) {
         let Some(span) = ctx.span(&id) else { return };
 
-        if let Some(fields) = span.extensions_mut().get_mut::<TracyFields<C>>() {
+        let mut extensions = span.extensions_mut();
+        if let Some(fields) = extensions.get_mut::<TracyFields<C>>() {
             let buf = mem::take(&mut fields.fields);
             CACHE.with(|cache| drop(StrCacheGuard::new(cache, buf)));
         };
+        #[cfg(feature = "fibers")]
+        if let Some(fiber) = extensions.remove::<FiberSpan>() {
+            // The zone has to end in the fiber it was started in.
+            if let Some(zone) = fiber.zone {
+                let previous = CURRENT_FIBER.with(|c| c.get());
+                self.switch_fiber(Some(fiber.name));
+                drop(zone);
+                self.switch_fiber(previous);
+            }
+            release_fiber(span.metadata().name(), fiber.name);
+        }
+    }
+}
+
+impl<C: Config> TracyLayer<C> {
+    fn enter_zone<S>(&self, span: &registry::SpanRef<'_, S>) -> Span
+    where
+        S: Subscriber + for<'a> registry::LookupSpan<'a>,
+    {
+        let extensions = span.extensions();
+        let metadata = span.metadata();
+        if self.config.lazy_field_formatting() {
+            match extensions.get::<LazyFields>() {
+                Some(lazy) if Client::is_connected() => CACHE.with(|cache| {
+                    let mut fields = TracyFields::<C>::new(cache.acquire().into_inner());
+                    lazy.format(self.config.formatter(), metadata, &mut fields);
+                    let zone = self.enter_span(metadata, Some(&fields.fields));
+                    drop(StrCacheGuard::new(cache, mem::take(&mut fields.fields)));
+                    zone
+                }),
+                _ => self.enter_span(metadata, None),
+            }
+        } else {
+            let fields = extensions.get::<TracyFields<C>>();
+            self.enter_span(metadata, fields.map(|f| f.fields.as_str()))
+        }
+    }
+
+    /// Switches the thread to the fiber of a span entered at the top of the span stack. The zone
+    /// of the span is started the first time, and is kept open until the span is closed.
+    #[cfg(feature = "fibers")]
+    fn enter_fiber<S>(&self, id: &Id, span: &registry::SpanRef<'_, S>)
+    where
+        S: Subscriber + for<'a> registry::LookupSpan<'a>,
+    {
+        let name = {
+            let mut extensions = span.extensions_mut();
+            if let Some(fiber) = extensions.get_mut::<FiberSpan>() {
+                fiber.name
+            } else {
+                let name = acquire_fiber(span.metadata().name());
+                extensions.insert(FiberSpan { name, zone: None });
+                name
+            }
+        };
+        let previous = CURRENT_FIBER.with(|c| c.get());
+        self.switch_fiber(Some(name));
+
+        let started = span
+            .extensions()
+            .get::<FiberSpan>()
+            .map_or(true, |f| f.zone.is_some());
+        if !started {
+            let zone = FiberZone(self.enter_zone(span));
+            if let Some(fiber) = span.extensions_mut().get_mut::<FiberSpan>() {
+                fiber.zone = Some(zone);
+            }
+        }
+
+        TRACY_SPAN_STACK.with(|s| {
+            s.push(StackFrame {
+                zone: None,
+                id: id.into_u64(),
+                previous_fiber: Some(previous),
+            });
+        });
+    }
+
+    #[cfg(feature = "fibers")]
+    fn switch_fiber(&self, fiber: Option<FiberName>) {
+        CURRENT_FIBER.with(|c| c.set(fiber));
+        match fiber {
+            Some(fiber) => self.client.fiber_enter(fiber),
+            None => self.client.fiber_leave(),
+        }
+    }
+}
+
+/// An entry of `TRACY_SPAN_STACK`.
+struct StackFrame {
+    /// `None` for the spans of fibers, whose zones stay open until the span is closed.
+    zone: Option<Span>,
+    id: u64,
+    /// The fiber to switch back to once the span is exited, if entering it switched fibers.
+    #[cfg(feature = "fibers")]
+    previous_fiber: Option<Option<FiberName>>,
+}
+
+/// The fiber of a span, for [`Config::fibers_for_tasks`].
+#[cfg(feature = "fibers")]
+struct FiberSpan {
+    name: FiberName,
+    zone: Option<FiberZone>,
+}
+
+#[cfg(feature = "fibers")]
+struct FiberZone(#[allow(dead_code)] Span);
+
+// SAFETY: Tracy allows a zone started in a fiber to end on any thread, as long as the thread is in
+// that fiber at the time. The zone is only dropped in `on_close`, which enters the fiber first.
+#[cfg(feature = "fibers")]
+unsafe impl Send for FiberZone {}
+#[cfg(feature = "fibers")]
+unsafe impl Sync for FiberZone {}
+
+/// Field values of a span as they were recorded, for [`Config::lazy_field_formatting`].
+struct LazyFields {
+    values: Vec<(Field, LazyValue)>,
+    /// The text of the string and `Debug` values, taken from the thread local string cache.
+    text: String,
+}
+
+enum LazyValue {
+    F64(f64),
+    I64(i64),
+    U64(u64),
+    I128(i128),
+    U128(u128),
+    Bool(bool),
+    Str(Range<usize>),
+    Debug(Range<usize>),
+}
+
+impl LazyFields {
+    /// The number of value buffers kept for reuse by each thread.
+    const MAX_CACHED: usize = 64;
+
+    fn new(metadata: &Metadata<'_>) -> Self {
+        let values = LAZY_VALUES
+            .with(VecCell::pop)
+            .unwrap_or_else(|| Vec::with_capacity(metadata.fields().len()));
+        Self {
+            values,
+            text: CACHE.with(|cache| cache.acquire().into_inner()),
+        }
+    }
+
+    /// Replays the values to `formatter`, as a span with these fields recorded one after the
+    /// other would have been formatted.
+    fn format<F>(
+        &self,
+        formatter: &F,
+        metadata: &'static Metadata<'static>,
+        dest: &mut FormattedFields<F>,
+    ) where
+        F: for<'writer> FormatFields<'writer> + 'static,
+    {
+        // A value set is limited to the size of an array, but the values of a span can also
+        // repeat fields recorded more than once.
+        const CHUNK: usize = 32;
+        for (i, chunk) in self.values.chunks(CHUNK).enumerate() {
+            let strs: [&str; CHUNK] = std::array::from_fn(|j| match chunk.get(j) {
+                Some((_, LazyValue::Str(r) | LazyValue::Debug(r))) => &self.text[r.clone()],
+                _ => "",
+            });
+            let debugs: [DisplayValue<&str>; CHUNK] = std::array::from_fn(|j| display(strs[j]));
+            let mut values: [(&Field, Option<&dyn Value>); CHUNK] = [(&chunk[0].0, None); CHUNK];
+            for (j, (field, value)) in chunk.iter().enumerate() {
+                let value: &dyn Value = match value {
+                    LazyValue::F64(v) => v,
+                    LazyValue::I64(v) => v,
+                    LazyValue::U64(v) => v,
+                    LazyValue::I128(v) => v,
+                    LazyValue::U128(v) => v,
+                    LazyValue::Bool(v) => v,
+                    LazyValue::Str(_) => &strs[j],
+                    LazyValue::Debug(_) => &debugs[j],
+                };
+                values[j] = (field, Some(value));
+            }
+            let values = metadata.fields().value_set(&values);
+            let record = Record::new(&values);
+            let _ = if i == 0 {
+                formatter.format_fields(dest.as_writer(), &record)
+            } else {
+                formatter.add_fields(dest, &record)
+            };
+        }
+    }
+}
+
+impl Drop for LazyFields {
+    fn drop(&mut self) {
+        let text = mem::take(&mut self.text);
+        CACHE.with(|cache| drop(StrCacheGuard::new(cache, text)));
+        let mut values = mem::take(&mut self.values);
+        values.clear();
+        let _ = LAZY_VALUES.try_with(|cache| {
+            if cache.len() < Self::MAX_CACHED {
+                cache.push(values);
+            }
+        });
+    }
+}
+
+impl Visit for LazyFields {
+    fn record_f64(&mut self, field: &Field, value: f64) {
+        self.values.push((field.clone(), LazyValue::F64(value)));
+    }
+
+    fn record_i64(&mut self, field: &Field, value: i64) {
+        self.values.push((field.clone(), LazyValue::I64(value)));
+    }
+
+    fn record_u64(&mut self, field: &Field, value: u64) {
+        self.values.push((field.clone(), LazyValue::U64(value)));
+    }
+
+    fn record_i128(&mut self, field: &Field, value: i128) {
+        self.values.push((field.clone(), LazyValue::I128(value)));
+    }
+
+    fn record_u128(&mut self, field: &Field, value: u128) {
+        self.values.push((field.clone(), LazyValue::U128(value)));
+    }
+
+    fn record_bool(&mut self, field: &Field, value: bool) {
+        self.values.push((field.clone(), LazyValue::Bool(value)));
+    }
+
+    fn record_str(&mut self, field: &Field, value: &str) {
+        let start = self.text.len();
+        self.text.push_str(value);
+        let range = start..self.text.len();
+        self.values.push((field.clone(), LazyValue::Str(range)));
+    }
+
+    fn record_debug(&mut self, field: &Field, value: &dyn std::fmt::Debug) {
+        let start = self.text.len();
+        let _ = write!(self.text, "{value:?}");
+        let range = start..self.text.len();
+        self.values.push((field.clone(), LazyValue::Debug(range)));
     }
 }
 
@@ -368,12 +691,20 @@ fn main() {
 }
 
 mod utils {
-    use crate::MAX_CACHE_SIZE;
-    use std::cell::{Cell, UnsafeCell};
+    use crate::{MAX_CACHE_SIZE, MAX_INTERNED_LOCATIONS};
+    #[cfg(feature = "fibers")]
+    use client::FiberName;
+    use client::SpanLocation;
+    use std::cell::{Cell, RefCell, UnsafeCell};
+    use std::collections::hash_map::DefaultHasher;
+    use std::collections::HashMap;
+    use std::hash::{Hash, Hasher};
     use std::mem;
     use std::mem::ManuallyDrop;
     use std::ops::{Deref, DerefMut};
-    use std::sync::atomic::Ordering;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use std::sync::Mutex;
+    use tracing_core::callsite::Identifier;
 
     pub struct VecCell<T>(UnsafeCell<Vec<T>>);
 
@@ -395,6 +726,17 @@ mod utils {
             // In addition, this method is not re-entrant.
             unsafe { &mut *self.0.get() }.pop()
         }
+
+        pub fn len(&self) -> usize {
+            // SAFETY:
+            // The reference to the contents of the UnsafeCell remain strictly within this method.
+            unsafe { &*self.0.get() }.len()
+        }
+
+        #[cfg(feature = "fibers")]
+        pub fn is_empty(&self) -> bool {
+            self.len() == 0
+        }
     }
 
     pub struct StrCache {
@@ -488,4 +830,144 @@ mod utils {
             self.cache.release(mem::take(&mut self.buf));
         }
     }
+
+    struct InternedLocation {
+        callsite: Identifier,
+        name: Box<str>,
+        location: SpanLocation,
+    }
+
+    /// Interned locations by the hash of their callsite and name.
+    type LocationMap = HashMap<u64, Vec<&'static InternedLocation>>;
+
+    thread_local! {
+        static THREAD_LOCATIONS: RefCell<LocationMap> = RefCell::new(HashMap::new());
+    }
+
+    /// All the interned locations. Each thread keeps the ones it has used in `THREAD_LOCATIONS`,
+    /// so that this is only locked the first time a thread enters a span with a given location.
+    static LOCATIONS: Mutex<Option<LocationMap>> = Mutex::new(None);
+    static LOCATION_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+    fn find(
+        map: &LocationMap,
+        hash: u64,
+        callsite: &Identifier,
+        name: &str,
+    ) -> Option<&'static InternedLocation> {
+        map.get(&hash)?
+            .iter()
+            .copied()
+            .find(|l| l.callsite == *callsite && &*l.name == name)
+    }
+
+    /// Returns the location of spans at `callsite` named `name`, creating it if it doesn't exist
+    /// yet, or `None` if the limit on interned locations has been reached.
+    pub fn intern_location(
+        callsite: Identifier,
+        name: &str,
+        file: &'static str,
+        line: u32,
+    ) -> Option<&'static SpanLocation> {
+        let mut hasher = DefaultHasher::new();
+        callsite.hash(&mut hasher);
+        name.hash(&mut hasher);
+        let hash = hasher.finish();
+
+        THREAD_LOCATIONS.with(|thread_locations| {
+            let mut thread_locations = thread_locations.borrow_mut();
+            if let Some(interned) = find(&thread_locations, hash, &callsite, name) {
+                return Some(&interned.location);
+            }
+            // Checked before taking the lock, as this is the common case for spans with
+            // unique names once the limit has been reached.
+            let max = MAX_INTERNED_LOCATIONS.load(Ordering::Relaxed);
+            if LOCATION_COUNT.load(Ordering::Relaxed) >= max {
+                return None;
+            }
+
+            let mut locations = LOCATIONS.lock().unwrap_or_else(|e| e.into_inner());
+            let locations = locations.get_or_insert_with(HashMap::new);
+            let interned = match find(locations, hash, &callsite, name) {
+                Some(interned) => interned,
+                None => {
+                    if LOCATION_COUNT.load(Ordering::Relaxed) >= max {
+                        return None;
+                    }
+                    let location = SpanLocation::new(Some(name), "", file, line).ok()?;
+                    let interned: &'static InternedLocation =
+                        Box::leak(Box::new(InternedLocation {
+                            callsite: callsite.clone(),
+                            name: name.into(),
+                            location,
+                        }));
+                    locations.entry(hash).or_default().push(interned);
+                    LOCATION_COUNT.fetch_add(1, Ordering::Relaxed);
+                    interned
+                }
+            };
+            thread_locations.entry(hash).or_default().push(interned);
+            Some(&interned.location)
+        })
+    }
+
+    /// The sampling interval of each callsite (with `0` for those filtered out), and the number of
+    /// its spans and events seen since the last one sampled.
+    type SamplingMap = HashMap<Identifier, (u32, u32)>;
+
+    thread_local! {
+        static THREAD_SAMPLING: RefCell<SamplingMap> = RefCell::new(HashMap::new());
+    }
+
+    /// Returns whether the span or event at `callsite` is to be recorded, with `interval` asked
+    /// for the sampling interval of the callsite the first time the thread sees it.
+    pub fn sample_callsite(callsite: Identifier, interval: impl FnOnce() -> u32) -> bool {
+        THREAD_SAMPLING.with(|sampling| {
+            let mut sampling = sampling.borrow_mut();
+            let (interval, count) = sampling.entry(callsite).or_insert_with(|| (interval(), 0));
+            match *interval {
+                0 => false,
+                1 => true,
+                _ => {
+                    let sampled = *count == 0;
+                    *count += 1;
+                    if *count == *interval {
+                        *count = 0;
+                    }
+                    sampled
+                }
+            }
+        })
+    }
+
+    /// Free fiber names, and the number of names created, by the name of the spans they were
+    /// created for.
+    #[cfg(feature = "fibers")]
+    type FiberPools = HashMap<&'static str, (Vec<FiberName>, usize)>;
+
+    #[cfg(feature = "fibers")]
+    static FIBERS: Mutex<Option<FiberPools>> = Mutex::new(None);
+
+    /// Returns a fiber name which is not in use by another span. Names are reused once their span
+    /// is closed, so that there are only as many of them as spans open at once.
+    #[cfg(feature = "fibers")]
+    pub fn acquire_fiber(span_name: &'static str) -> FiberName {
+        let mut fibers = FIBERS.lock().unwrap_or_else(|e| e.into_inner());
+        let (free, count) = fibers
+            .get_or_insert_with(HashMap::new)
+            .entry(span_name)
+            .or_default();
+        free.pop().unwrap_or_else(|| {
+            *count += 1;
+            FiberName::new_leak(format!("{span_name} #{count}"))
+        })
+    }
+
+    #[cfg(feature = "fibers")]
+    pub fn release_fiber(span_name: &'static str, fiber: FiberName) {
+        let mut fibers = FIBERS.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some((free, _)) = fibers.as_mut().and_then(|f| f.get_mut(span_name)) {
+            free.push(fiber);
+        }
+    }
 }
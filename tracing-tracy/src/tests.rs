@@ -104,6 +104,66 @@ fn span_with_fields() {
     let _enter = span.enter();
 }
 
+fn repeated_span_locations() {
+    for i in 0..1000 {
+        span!(Level::TRACE, "repeated").in_scope(|| {});
+        span!(Level::TRACE, "repeated with fields", parity = i % 2).in_scope(|| {});
+    }
+}
+
+#[derive(Default)]
+struct FilterConfig(DefaultConfig);
+impl Config for FilterConfig {
+    type Formatter = <DefaultConfig as Config>::Formatter;
+    fn formatter(&self) -> &Self::Formatter {
+        self.0.formatter()
+    }
+    fn callsite_enabled(&self, metadata: &tracing_core::Metadata<'_>) -> bool {
+        *metadata.level() <= Level::DEBUG
+    }
+    fn callsite_sample_interval(&self, metadata: &tracing_core::Metadata<'_>) -> u32 {
+        if metadata.name() == "sampled" {
+            10
+        } else {
+            1
+        }
+    }
+}
+
+fn filtered_callsites() {
+    let layer = tracing_subscriber::registry().with(TracyLayer::new(FilterConfig::default()));
+    tracing::subscriber::with_default(layer, || {
+        assert!(span!(Level::TRACE, "filtered").is_disabled());
+        assert!(!span!(Level::DEBUG, "not filtered").is_disabled());
+        let sampled = (0..100)
+            .filter(|_| !span!(Level::INFO, "sampled").is_disabled())
+            .count();
+        assert_eq!(sampled, 10);
+    });
+}
+
+#[cfg(feature = "fibers")]
+#[derive(Default)]
+struct FibersConfig(DefaultConfig);
+#[cfg(feature = "fibers")]
+impl Config for FibersConfig {
+    type Formatter = <DefaultConfig as Config>::Formatter;
+    fn formatter(&self) -> &Self::Formatter {
+        self.0.formatter()
+    }
+    fn fibers_for_tasks(&self) -> bool {
+        true
+    }
+}
+
+#[cfg(feature = "fibers")]
+fn async_futures_in_fibers(runtime: &tokio::runtime::Runtime) {
+    let layer = tracing_subscriber::registry().with(TracyLayer::new(FibersConfig::default()));
+    tracing::subscriber::with_default(layer, || {
+        runtime.block_on(async_futures());
+    });
+}
+
 pub(crate) fn test() {
     tracing::subscriber::set_global_default(
         tracing_subscriber::registry().with(TracyLayer::default()),
@@ -117,11 +177,15 @@ pub(crate) fn test() {
     message_too_long();
     long_span_data();
     span_with_fields();
+    repeated_span_locations();
+    filtered_callsites();
     let runtime = tokio::runtime::Builder::new_current_thread()
         .enable_all()
         .build()
         .expect("tokio runtime");
     runtime.block_on(async_futures());
+    #[cfg(feature = "fibers")]
+    async_futures_in_fibers(&runtime);
 }
 
 #[derive(Default)]
@@ -136,6 +200,18 @@ impl Config for CallstackConfig {
     }
 }
 
+#[derive(Default)]
+struct LazyFieldsConfig(DefaultConfig);
+impl Config for LazyFieldsConfig {
+    type Formatter = <DefaultConfig as Config>::Formatter;
+    fn formatter(&self) -> &Self::Formatter {
+        self.0.formatter()
+    }
+    fn lazy_field_formatting(&self) -> bool {
+        true
+    }
+}
+
 fn benchmark_span(c: &mut Criterion) {
     c.bench_function("span/callstack", |bencher| {
         let layer =
@@ -157,6 +233,16 @@ fn benchmark_span(c: &mut Criterion) {
             });
         });
     });
+
+    c.bench_function("span/lazy_fields", |bencher| {
+        let layer =
+            tracing_subscriber::registry().with(TracyLayer::new(LazyFieldsConfig::default()));
+        tracing::subscriber::with_default(layer, || {
+            bencher.iter(|| {
+                let _span = tracing::error_span!("message", field1 = "first", field2 = 2).entered();
+            });
+        });
+    });
 }
 
 fn benchmark_message(c: &mut Criterion) {
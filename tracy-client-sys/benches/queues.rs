@@ -0,0 +1,298 @@
+//! Throughput of the event queues of the client and of the profiler thread draining them.
+//!
+//! Producer threads emit a fixed number of events each through the C API, while a sink in this
+//! process takes the role of the profiler: it connects to the client, decompresses the frames it
+//! is sent and throws them away. Every producer ends with a marker, sent as a message through the
+//! event queue of its thread and as a lock name through its serial queue, so that the sink knows
+//! when everything emitted before has been sent out.
+//!
+//! For each kind of event this prints:
+//!
+//! * the time the producers take to queue an event;
+//! * the rate at which the events are sent out, from the start of the producers until the sink
+//!   has seen all the markers, which is the rate of the profiler thread when the producers are
+//!   faster than it;
+//! * the rate of the data sent out, before and after compression.
+//!
+//! The number of producer threads and of events per thread are taken from the
+//! `TRACY_BENCH_THREADS` (1,4 by default) and `TRACY_BENCH_EVENTS` (1000000 by default)
+//! environment variables, and the port of the client from `TRACY_PORT` (8086 by default). The sink
+//! runs on a thread of its own and may itself be the bottleneck on machines with few cores.
+#[cfg(feature = "enable")]
+mod bench {
+    use std::io::Read;
+    use std::net::TcpStream;
+    use std::sync::atomic::{AtomicU64, Ordering};
+    use std::sync::{Arc, Barrier};
+    use std::time::{Duration, Instant};
+    use tracy_client_sys::*;
+    /// Frames are decompressed with the previous 64 KiB of data as the dictionary.
+    const LZ4_WINDOW: usize = 64 * 1024;
+    const MARKER: &[u8] = b"tracy-client-sys queue benchmark marker";
+
+    /// `WelcomeMessage` in `tracy/common/TracyProtocol.hpp`, only its size is needed.
+    #[allow(dead_code)]
+    #[repr(C, packed)]
+    struct WelcomeMessage {
+        init_begin: i64,
+        init_end: i64,
+        resolution: u64,
+        epoch: u64,
+        exectime: u64,
+        pid: u64,
+        sampling_period: i64,
+        flags: u8,
+        cpu_arch: u8,
+        cpu_manufacturer: [u8; 12],
+        cpu_id: u32,
+        program_name: [u8; 64],
+        host_info: [u8; 1024],
+    }
+
+    /// `OnDemandPayloadMessage` in `tracy/common/TracyProtocol.hpp`.
+    const ON_DEMAND_PAYLOAD_SIZE: usize = 16;
+
+    struct SourceLocation(___tracy_source_location_data);
+    // SAFE: The pointers are to static strings.
+    unsafe impl Sync for SourceLocation {}
+
+    static ZONE: SourceLocation = SourceLocation(___tracy_source_location_data {
+        name: b"zone\0".as_ptr().cast(),
+        function: b"bench\0".as_ptr().cast(),
+        file: b"queues.rs\0".as_ptr().cast(),
+        line: 1,
+        color: 0,
+        #[cfg(feature = "zone-categories")]
+        category: 0,
+    });
+    static LOCK: SourceLocation = SourceLocation(___tracy_source_location_data {
+        name: b"marker\0".as_ptr().cast(),
+        function: b"bench\0".as_ptr().cast(),
+        file: b"queues.rs\0".as_ptr().cast(),
+        line: 2,
+        color: 0,
+        #[cfg(feature = "zone-categories")]
+        category: 0,
+    });
+
+    #[derive(Default)]
+    struct SinkStats {
+        compressed: AtomicU64,
+        raw: AtomicU64,
+        markers: AtomicU64,
+    }
+
+    /// Decompresses an LZ4 block, appending it to `out`, which holds the previous output.
+    fn lz4_decompress(mut src: &[u8], out: &mut Vec<u8>) {
+        fn length(src: &mut &[u8], mut len: usize) -> usize {
+            if len == 15 {
+                loop {
+                    let b = src[0];
+                    *src = &src[1..];
+                    len += usize::from(b);
+                    if b != 255 {
+                        break;
+                    }
+                }
+            }
+            len
+        }
+        while !src.is_empty() {
+            let token = src[0];
+            src = &src[1..];
+            let literals = length(&mut src, usize::from(token >> 4));
+            out.extend_from_slice(&src[..literals]);
+            src = &src[literals..];
+            if src.is_empty() {
+                break;
+            }
+            let offset = usize::from(u16::from_le_bytes([src[0], src[1]]));
+            src = &src[2..];
+            let len = length(&mut src, usize::from(token & 15)) + 4;
+            let start = out.len() - offset;
+            for i in 0..len {
+                out.push(out[start + i]);
+            }
+        }
+    }
+
+    fn connect() -> TcpStream {
+        let mut stream = protocol::connect();
+        let mut welcome = vec![0u8; std::mem::size_of::<WelcomeMessage>()];
+        if cfg!(feature = "ondemand") {
+            welcome.resize(welcome.len() + ON_DEMAND_PAYLOAD_SIZE, 0);
+        }
+        stream.read_exact(&mut welcome).unwrap();
+        stream
+    }
+
+    fn sink(mut stream: TcpStream, stats: &SinkStats) {
+        let mut frame = Vec::new();
+        let mut out = Vec::new();
+        loop {
+            let mut size = [0u8; 4];
+            if stream.read_exact(&mut size).is_err() {
+                return;
+            }
+            frame.resize(u32::from_le_bytes(size) as usize, 0);
+            if stream.read_exact(&mut frame).is_err() {
+                return;
+            }
+            let start = out.len();
+            lz4_decompress(&frame, &mut out);
+            let markers = out[start..]
+                .windows(MARKER.len())
+                .filter(|w| *w == MARKER)
+                .count();
+            stats
+                .compressed
+                .fetch_add(frame.len() as u64 + 4, Ordering::Relaxed);
+            stats
+                .raw
+                .fetch_add((out.len() - start) as u64, Ordering::Relaxed);
+            stats.markers.fetch_add(markers as u64, Ordering::Release);
+            if out.len() > 4 * LZ4_WINDOW {
+                out.drain(..out.len() - LZ4_WINDOW);
+            }
+        }
+    }
+
+    /// Events queued by one call of the producer.
+    struct Kind {
+        name: &'static str,
+        events: u64,
+        produce: fn(u64, u64),
+    }
+
+    const KINDS: [Kind; 4] = [
+        Kind {
+            name: "zone",
+            events: 2,
+            produce: |_, _| unsafe {
+                let ctx = ___tracy_emit_zone_begin(&ZONE.0, 1);
+                ___tracy_emit_zone_end(ctx);
+            },
+        },
+        Kind {
+            name: "message",
+            events: 1,
+            produce: |_, _| message(b"a message of 32 bytes for bench"),
+        },
+        Kind {
+            name: "plot",
+            events: 1,
+            produce: |_, i| unsafe {
+                ___tracy_emit_plot(b"plot\0".as_ptr().cast(), i as f64);
+            },
+        },
+        Kind {
+            name: "memory",
+            events: 2,
+            produce: |thread, i| unsafe {
+                let ptr = (((thread + 1) << 40) | (i << 4)) as *const std::ffi::c_void;
+                ___tracy_emit_memory_alloc(ptr, 16, 0);
+                ___tracy_emit_memory_free(ptr, 0);
+            },
+        },
+    ];
+
+    fn message(text: &[u8]) {
+        let severity = TracyMessageSeverity_TracyMessageSeverityInfo as i8;
+        unsafe { ___tracy_emit_logString(severity, 0, 0, text.len(), text.as_ptr().cast()) };
+    }
+
+    fn marker() {
+        unsafe {
+            message(MARKER);
+            let lock = ___tracy_announce_lockable_ctx(&LOCK.0);
+            ___tracy_custom_name_lockable_ctx(lock, MARKER.as_ptr().cast(), MARKER.len());
+            ___tracy_terminate_lockable_ctx(lock);
+        }
+    }
+
+    fn env_list(name: &str, default: &str) -> Vec<u64> {
+        std::env::var(name)
+            .unwrap_or_else(|_| default.into())
+            .split(',')
+            .map(|v| v.trim().parse().expect(name))
+            .collect()
+    }
+
+    pub fn main() {
+        #[cfg(feature = "manual-lifetime")]
+        unsafe {
+            ___tracy_startup_profiler();
+        }
+        let threads = env_list("TRACY_BENCH_THREADS", "1,4");
+        let calls = env_list("TRACY_BENCH_EVENTS", "1000000")[0];
+
+        let stats = Arc::new(SinkStats::default());
+        let stream = connect();
+        // The client waits for the profiler to disconnect before the process may exit.
+        let connection = stream.try_clone().unwrap();
+        std::thread::spawn({
+            let stats = Arc::clone(&stats);
+            move || sink(stream, &stats)
+        });
+
+        let mut markers = 0;
+        for kind in &KINDS {
+            for &threads in &threads {
+                let compressed = stats.compressed.load(Ordering::Relaxed);
+                let raw = stats.raw.load(Ordering::Relaxed);
+                let barrier = Barrier::new(threads as usize + 1);
+                let (start, enqueue) = std::thread::scope(|s| {
+                    let handles: Vec<_> = (0..threads)
+                        .map(|thread| {
+                            let barrier = &barrier;
+                            s.spawn(move || {
+                                (kind.produce)(thread, 0);
+                                barrier.wait();
+                                let start = Instant::now();
+                                for i in 1..=calls {
+                                    (kind.produce)(thread, i);
+                                }
+                                let elapsed = start.elapsed();
+                                marker();
+                                elapsed
+                            })
+                        })
+                        .collect();
+                    barrier.wait();
+                    let start = Instant::now();
+                    let enqueue: Duration = handles.into_iter().map(|h| h.join().unwrap()).sum();
+                    (start, enqueue)
+                });
+                markers += 2 * threads;
+                while stats.markers.load(Ordering::Acquire) < markers {
+                    std::thread::sleep(Duration::from_micros(100));
+                }
+                let elapsed = start.elapsed().as_secs_f64();
+                let events = (threads * calls * kind.events) as f64;
+                let compressed = stats.compressed.load(Ordering::Relaxed) - compressed;
+                let raw = stats.raw.load(Ordering::Relaxed) - raw;
+                println!(
+                    "{:>8} threads {:>3}  enqueue {:>7.1} ns/event  sent {:>7.2} Mevents/s  \
+                     raw {:>8.1} MB/s  compressed {:>8.1} MB/s",
+                    kind.name,
+                    threads,
+                    enqueue.as_secs_f64() * 1e9 / events,
+                    events / elapsed / 1e6,
+                    raw as f64 / elapsed / 1e6,
+                    compressed as f64 / elapsed / 1e6,
+                );
+            }
+        }
+
+        connection.shutdown(std::net::Shutdown::Both).unwrap();
+        #[cfg(feature = "manual-lifetime")]
+        unsafe {
+            ___tracy_shutdown_profiler();
+        }
+    }
+}
+
+fn main() {
+    #[cfg(feature = "enable")]
+    bench::main();
+}
@@ -21,6 +21,12 @@ fn link_dependencies() {
     if std::env::var_os("CARGO_FEATURE_DEBUGINFOD").is_some() && !docs_rs!() {
         println!("cargo:rustc-link-lib=debuginfod");
     }
+    // `shm_open` is only part of libc itself since glibc 2.34.
+    if std::env::var_os("CARGO_FEATURE_SHM_TRANSPORT").is_some()
+        && std::env::var("CARGO_CFG_TARGET_OS").as_deref() == Ok("linux")
+    {
+        println!("cargo:rustc-link-lib=rt");
+    }
 }
 
 fn set_feature_defines(mut c: cc::Build) -> cc::Build {
@@ -57,6 +63,72 @@ fn set_feature_defines(mut c: cc::Build) -> cc::Build {
     if std::env::var_os("CARGO_FEATURE_DEBUGINFOD").is_some() && !docs_rs!() {
         c.define("TRACY_DEBUGINFOD", None);
     }
+    if std::env::var_os("CARGO_FEATURE_OFFLINE_CAPTURE").is_some() {
+        c.define("TRACY_OFFLINE_CAPTURE", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_THREAD_QUEUES").is_some() {
+        c.define("TRACY_THREAD_QUEUES", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_NUMA").is_some() {
+        c.define("TRACY_NUMA", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_COMPACT_ZONES").is_some() {
+        c.define("TRACY_COMPACT_ZONES", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_ZONE_SAMPLING").is_some() {
+        c.define("TRACY_ZONE_SAMPLING", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_FRAME_POINTER_UNWIND").is_some() {
+        c.define("TRACY_FRAME_POINTER_UNWIND", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_CALLSTACK_INTERNING").is_some() {
+        c.define("TRACY_CALLSTACK_INTERNING", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_MEMORY_AGGREGATION").is_some() {
+        c.define("TRACY_MEMORY_AGGREGATION", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_LOCK_CONTENTION_ONLY").is_some() {
+        c.define("TRACY_LOCK_CONTENTION_ONLY", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_LOCK_SHARED_AGGREGATION").is_some() {
+        c.define("TRACY_LOCK_SHARED_AGGREGATION", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_THREAD_SERIAL_QUEUES").is_some() {
+        c.define("TRACY_THREAD_SERIAL_QUEUES", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_ZONE_COUNTERS").is_some() {
+        c.define("TRACY_ZONE_COUNTERS", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_BPF_OFFCPU").is_some() {
+        c.define("TRACY_BPF_OFFCPU", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_TSC_TIMER").is_some() {
+        c.define("TRACY_TSC_TIMER", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_MEMORY_BATCHING").is_some() {
+        c.define("TRACY_MEMORY_BATCHING", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_SAMPLING_STACK_UNWIND").is_some() {
+        c.define("TRACY_SAMPLING_STACK_UNWIND", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_WORKER_WAKEUP").is_some() {
+        c.define("TRACY_WORKER_WAKEUP", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_FAN_OUT").is_some() {
+        c.define("TRACY_FAN_OUT", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_SHM_TRANSPORT").is_some() {
+        c.define("TRACY_SHM_TRANSPORT", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_ZONE_STATS").is_some() {
+        c.define("TRACY_ZONE_STATS", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_ZONE_COALESCE").is_some() {
+        c.define("TRACY_ZONE_COALESCE", None);
+    }
+    if std::env::var_os("CARGO_FEATURE_ZONE_CATEGORIES").is_some() {
+        c.define("TRACY_ZONE_CATEGORIES", None);
+    }
 
     // Note: these are inversed and check for `is_none`!
     if std::env::var_os("CARGO_FEATURE_SYSTEM_TRACING").is_none() {
@@ -112,12 +184,37 @@ fn build_tracy_client() {
     }
 }
 
+/// Writes the protocol version of the client to `$OUT_DIR/protocol.rs`, so that the code taking
+/// the place of the profiler in the benchmarks doesn't have to be updated along with it.
+fn generate_protocol() {
+    let header = "tracy/common/TracyProtocol.hpp";
+    println!("cargo:rerun-if-changed={header}");
+    let source = std::fs::read_to_string(header).expect("could not read TracyProtocol.hpp");
+    let version = source
+        .lines()
+        .find_map(|line| {
+            line.trim()
+                .strip_prefix("constexpr uint32_t ProtocolVersion = ")?
+                .strip_suffix(';')
+        })
+        .expect("ProtocolVersion not found in TracyProtocol.hpp");
+    let out = std::path::Path::new(&std::env::var_os("OUT_DIR").unwrap()).join("protocol.rs");
+    std::fs::write(
+        out,
+        format!(
+            "/// `ProtocolVersion` in `{header}`.\npub const PROTOCOL_VERSION: u32 = {version};\n"
+        ),
+    )
+    .expect("could not write protocol.rs");
+}
+
 fn read_env_and_rerun_if_changed(var: &str) -> Result<String, VarError> {
     println!("cargo:rerun-if-env-changed={}", var);
     std::env::var(var)
 }
 
 fn main() {
+    generate_protocol();
     let client_lib = read_env_and_rerun_if_changed("TRACY_CLIENT_LIB");
     let client_lib_path = read_env_and_rerun_if_changed("TRACY_CLIENT_LIB_PATH");
     let kind = read_env_and_rerun_if_changed("TRACY_CLIENT_STATIC");
@@ -3,6 +3,12 @@ pub const TracyPlotFormatEnum_TracyPlotFormatMemory: TracyPlotFormatEnum = 1;
 pub const TracyPlotFormatEnum_TracyPlotFormatPercentage: TracyPlotFormatEnum = 2;
 pub const TracyPlotFormatEnum_TracyPlotFormatWatt: TracyPlotFormatEnum = 3;
 type TracyPlotFormatEnum = ::std::os::raw::c_uint;
+pub const TracyPlotAggregateEnum_TracyPlotAggregateLast: TracyPlotAggregateEnum = 0;
+pub const TracyPlotAggregateEnum_TracyPlotAggregateMin: TracyPlotAggregateEnum = 1;
+pub const TracyPlotAggregateEnum_TracyPlotAggregateMax: TracyPlotAggregateEnum = 2;
+pub const TracyPlotAggregateEnum_TracyPlotAggregateMean: TracyPlotAggregateEnum = 3;
+pub const TracyPlotAggregateEnum_TracyPlotAggregateSum: TracyPlotAggregateEnum = 4;
+type TracyPlotAggregateEnum = ::std::os::raw::c_uint;
 pub const TracyMessageSeverity_TracyMessageSeverityTrace: TracyMessageSeverity = 0;
 pub const TracyMessageSeverity_TracyMessageSeverityDebug: TracyMessageSeverity = 1;
 pub const TracyMessageSeverity_TracyMessageSeverityInfo: TracyMessageSeverity = 2;
@@ -10,6 +16,10 @@ pub const TracyMessageSeverity_TracyMessageSeverityWarning: TracyMessageSeverity
 pub const TracyMessageSeverity_TracyMessageSeverityError: TracyMessageSeverity = 4;
 pub const TracyMessageSeverity_TracyMessageSeverityFatal: TracyMessageSeverity = 5;
 type TracyMessageSeverity = ::std::os::raw::c_uint;
+pub const TracyZoneBatchType_TracyZoneBatchBegin: TracyZoneBatchType = 0;
+pub const TracyZoneBatchType_TracyZoneBatchEnd: TracyZoneBatchType = 1;
+pub const TracyZoneBatchType_TracyZoneBatchValue: TracyZoneBatchType = 2;
+type TracyZoneBatchType = ::std::os::raw::c_uint;
 extern "C" {
     pub fn ___tracy_set_thread_name(name: *const ::std::os::raw::c_char);
 }
@@ -21,8 +31,11 @@ pub struct ___tracy_source_location_data {
     pub file: *const ::std::os::raw::c_char,
     pub line: u32,
     pub color: u32,
+    #[cfg(feature = "zone-categories")]
+    pub category: u32,
 }
 #[test]
+#[cfg(not(feature = "zone-categories"))]
 fn bindgen_test_layout____tracy_source_location_data() {
     const UNINIT: ::std::mem::MaybeUninit<___tracy_source_location_data> =
         ::std::mem::MaybeUninit::uninit();
@@ -97,6 +110,50 @@ fn bindgen_test_layout____tracy_c_zone_context() {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct ___tracy_zone_batch_event {
+    pub srcloc: *const ___tracy_source_location_data,
+    pub time: i64,
+    pub value: u64,
+    pub type_: u8,
+}
+#[test]
+fn bindgen_test_layout____tracy_zone_batch_event() {
+    const UNINIT: ::std::mem::MaybeUninit<___tracy_zone_batch_event> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<___tracy_zone_batch_event>(),
+        32usize,
+        "Size of ___tracy_zone_batch_event"
+    );
+    assert_eq!(
+        ::std::mem::align_of::<___tracy_zone_batch_event>(),
+        8usize,
+        "Alignment of ___tracy_zone_batch_event"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).srcloc) as usize - ptr as usize },
+        0usize,
+        "Offset of field: ___tracy_zone_batch_event::srcloc"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).time) as usize - ptr as usize },
+        8usize,
+        "Offset of field: ___tracy_zone_batch_event::time"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).value) as usize - ptr as usize },
+        16usize,
+        "Offset of field: ___tracy_zone_batch_event::value"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).type_) as usize - ptr as usize },
+        24usize,
+        "Offset of field: ___tracy_zone_batch_event::type_"
+    );
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct ___tracy_gpu_time_data {
     pub gpuTime: i64,
     pub queryId: u16,
@@ -407,6 +464,98 @@ fn bindgen_test_layout____tracy_gpu_time_sync_data() {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct ___tracy_client_stats {
+    pub queueDepth: u64,
+    pub serialDepth: u64,
+    pub symbolQueueDepth: u64,
+    pub frameImageBacklog: u64,
+    pub workerBusyNs: u64,
+    pub workerIdleNs: u64,
+    pub rawBytes: u64,
+    pub compressedBytes: u64,
+    pub sendNs: u64,
+    pub symbolsResolved: u64,
+    pub samplesLost: u64,
+    pub frameImagesDropped: u64,
+}
+#[test]
+fn bindgen_test_layout____tracy_client_stats() {
+    const UNINIT: ::std::mem::MaybeUninit<___tracy_client_stats> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<___tracy_client_stats>(),
+        96usize,
+        "Size of ___tracy_client_stats"
+    );
+    assert_eq!(
+        ::std::mem::align_of::<___tracy_client_stats>(),
+        8usize,
+        "Alignment of ___tracy_client_stats"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).queueDepth) as usize - ptr as usize },
+        0usize,
+        "Offset of field: ___tracy_client_stats::queueDepth"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).serialDepth) as usize - ptr as usize },
+        8usize,
+        "Offset of field: ___tracy_client_stats::serialDepth"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).symbolQueueDepth) as usize - ptr as usize },
+        16usize,
+        "Offset of field: ___tracy_client_stats::symbolQueueDepth"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).frameImageBacklog) as usize - ptr as usize },
+        24usize,
+        "Offset of field: ___tracy_client_stats::frameImageBacklog"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).workerBusyNs) as usize - ptr as usize },
+        32usize,
+        "Offset of field: ___tracy_client_stats::workerBusyNs"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).workerIdleNs) as usize - ptr as usize },
+        40usize,
+        "Offset of field: ___tracy_client_stats::workerIdleNs"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).rawBytes) as usize - ptr as usize },
+        48usize,
+        "Offset of field: ___tracy_client_stats::rawBytes"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).compressedBytes) as usize - ptr as usize },
+        56usize,
+        "Offset of field: ___tracy_client_stats::compressedBytes"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).sendNs) as usize - ptr as usize },
+        64usize,
+        "Offset of field: ___tracy_client_stats::sendNs"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).symbolsResolved) as usize - ptr as usize },
+        72usize,
+        "Offset of field: ___tracy_client_stats::symbolsResolved"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).samplesLost) as usize - ptr as usize },
+        80usize,
+        "Offset of field: ___tracy_client_stats::samplesLost"
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).frameImagesDropped) as usize - ptr as usize },
+        88usize,
+        "Offset of field: ___tracy_client_stats::frameImagesDropped"
+    );
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct __tracy_lockable_context_data {
     _unused: [u8; 0],
 }
@@ -479,6 +628,12 @@ extern "C" {
 extern "C" {
     pub fn ___tracy_emit_zone_value(ctx: TracyCZoneCtx, value: u64);
 }
+extern "C" {
+    pub fn ___tracy_get_time() -> i64;
+}
+extern "C" {
+    pub fn ___tracy_emit_zone_batch(events: *const ___tracy_zone_batch_event, count: usize);
+}
 extern "C" {
     pub fn ___tracy_emit_gpu_zone_begin(arg1: ___tracy_gpu_zone_begin_data);
 }
@@ -548,6 +703,18 @@ extern "C" {
 extern "C" {
     pub fn ___tracy_connected() -> i32;
 }
+extern "C" {
+    pub fn ___tracy_connected_flag() -> *const ::std::os::raw::c_void;
+}
+extern "C" {
+    pub fn ___tracy_get_client_stats(stats: *mut ___tracy_client_stats);
+}
+extern "C" {
+    pub fn ___tracy_set_thread_affinity(cpus: *const ::std::os::raw::c_char) -> i32;
+}
+extern "C" {
+    pub fn ___tracy_set_thread_priority(nice: i32, sched: i32) -> i32;
+}
 extern "C" {
     pub fn ___tracy_emit_memory_alloc(ptr: *const ::std::os::raw::c_void, size: usize, secure: i32);
 }
@@ -646,6 +813,15 @@ extern "C" {
         flip: i32,
     );
 }
+extern "C" {
+    pub fn ___tracy_emit_frame_image_compressed(
+        image: *const ::std::os::raw::c_void,
+        w: u16,
+        h: u16,
+        offset: u8,
+        flip: i32,
+    );
+}
 extern "C" {
     pub fn ___tracy_emit_plot(name: *const ::std::os::raw::c_char, val: f64);
 }
@@ -664,6 +840,13 @@ extern "C" {
         color: u32,
     );
 }
+extern "C" {
+    pub fn ___tracy_emit_plot_downsample(
+        name: *const ::std::os::raw::c_char,
+        window: i64,
+        aggregate: i32,
+    );
+}
 extern "C" {
     pub fn ___tracy_emit_message_appinfo(txt: *const ::std::os::raw::c_char, size: usize);
 }
@@ -703,6 +886,28 @@ extern "C" {
         nameSz: usize,
     );
 }
+extern "C" {
+    pub fn ___tracy_announce_shared_lockable_ctx(
+        srcloc: *const ___tracy_source_location_data,
+    ) -> *mut __tracy_lockable_context_data;
+}
+extern "C" {
+    pub fn ___tracy_before_lock_shared_lockable_ctx(
+        lockdata: *mut __tracy_lockable_context_data,
+    ) -> i32;
+}
+extern "C" {
+    pub fn ___tracy_after_lock_shared_lockable_ctx(lockdata: *mut __tracy_lockable_context_data);
+}
+extern "C" {
+    pub fn ___tracy_after_unlock_shared_lockable_ctx(lockdata: *mut __tracy_lockable_context_data);
+}
+extern "C" {
+    pub fn ___tracy_after_try_lock_shared_lockable_ctx(
+        lockdata: *mut __tracy_lockable_context_data,
+        acquired: i32,
+    );
+}
 extern "C" {
     pub fn ___tracy_begin_sampling_profiler() -> ::std::os::raw::c_int;
 }
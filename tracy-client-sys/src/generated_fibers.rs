@@ -4,3 +4,9 @@ extern "C" {
 extern "C" {
     pub fn ___tracy_fiber_leave();
 }
+extern "C" {
+    pub fn ___tracy_fiber_register(name: *const ::std::os::raw::c_char) -> u32;
+}
+extern "C" {
+    pub fn ___tracy_fiber_enter_id(id: u32);
+}
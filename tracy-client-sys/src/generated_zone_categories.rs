@@ -0,0 +1,10 @@
+extern "C" {
+    pub fn ___tracy_zone_category_setup(
+        category: u32,
+        name: *const ::std::os::raw::c_char,
+        enabled: i32,
+    );
+}
+extern "C" {
+    pub fn ___tracy_zone_category_enable(category: u32, enabled: i32);
+}
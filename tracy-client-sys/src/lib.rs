@@ -48,7 +48,17 @@ pub use generated_manual_lifetime::*;
 #[cfg(all(feature = "enable", feature = "fibers"))]
 mod generated_fibers;
 #[cfg(all(feature = "enable", feature = "fibers"))]
-pub use generated_fibers::{___tracy_fiber_enter, ___tracy_fiber_leave};
+pub use generated_fibers::{
+    ___tracy_fiber_enter, ___tracy_fiber_enter_id, ___tracy_fiber_leave, ___tracy_fiber_register,
+};
+
+#[cfg(all(feature = "enable", feature = "zone-categories"))]
+mod generated_zone_categories;
+#[cfg(all(feature = "enable", feature = "zone-categories"))]
+pub use generated_zone_categories::{___tracy_zone_category_enable, ___tracy_zone_category_setup};
 
 #[cfg(all(feature = "enable", target_os = "windows"))]
 mod dbghelp;
+
+#[doc(hidden)]
+pub mod protocol;
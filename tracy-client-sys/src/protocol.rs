@@ -0,0 +1,39 @@
+//! The handshake of the network protocol of the client, for the benchmarks which connect to it in
+//! place of the profiler. Not part of the stable API.
+use std::io::{Read, Write};
+use std::net::TcpStream;
+use std::time::{Duration, Instant};
+
+include!(concat!(env!("OUT_DIR"), "/protocol.rs"));
+
+/// `HandshakeShibboleth` in `tracy/common/TracyProtocol.hpp`.
+pub const HANDSHAKE_SHIBBOLETH: &[u8; 8] = b"TracyPrf";
+/// `HandshakeWelcome` in `tracy/common/TracyProtocol.hpp`.
+pub const HANDSHAKE_WELCOME: u8 = 1;
+
+/// Connects to the client on the port from `TRACY_PORT` (8086 by default), retrying for up to ten
+/// seconds while it starts listening, and goes through the handshake. The welcome message is left
+/// to be read from the returned stream.
+pub fn connect() -> TcpStream {
+    let port = std::env::var("TRACY_PORT")
+        .ok()
+        .and_then(|p| p.parse().ok())
+        .unwrap_or(8086u16);
+    let deadline = Instant::now() + Duration::from_secs(10);
+    let mut stream = loop {
+        match TcpStream::connect(("127.0.0.1", port)) {
+            Ok(stream) => break stream,
+            Err(e) if Instant::now() > deadline => panic!("cannot connect to the client: {e}"),
+            Err(_) => std::thread::sleep(Duration::from_millis(50)),
+        }
+    };
+    stream.write_all(HANDSHAKE_SHIBBOLETH).unwrap();
+    stream.write_all(&PROTOCOL_VERSION.to_le_bytes()).unwrap();
+    let mut status = [0u8];
+    stream.read_exact(&mut status).unwrap();
+    assert_eq!(
+        status[0], HANDSHAKE_WELCOME,
+        "the client refused the connection"
+    );
+    stream
+}
@@ -20,18 +20,39 @@
 #endif
 
 #include "common/tracy_lz4.cpp"
+#include "common/tracy_lz4hc.cpp"
 #include "client/TracyProfiler.cpp"
 #include "client/TracyCallstack.cpp"
+#include "client/TracyCallstackTable.cpp"
+#include "client/TracySymbolCache.cpp"
+#include "client/TracySymbolStore.cpp"
+#include "client/TracySourceCache.cpp"
 #include "client/TracySysPower.cpp"
+#include "client/TracySysSampler.cpp"
+#include "client/TracyMemAggregate.cpp"
+#include "client/TracyPlotDownsample.cpp"
 #include "client/TracySysTime.cpp"
 #include "client/TracySysTrace.cpp"
+#include "client/TracySysTraceBpf.cpp"
+#include "client/TracyDwarfUnwind.cpp"
 #include "common/TracySocket.cpp"
+#include "common/TracyShmRing.cpp"
 #include "client/TracyTimer.cpp"
 #include "client/tracy_rpmalloc.cpp"
 #include "client/TracyDxt1.cpp"
 #include "client/TracyAlloc.cpp"
 #include "client/TracyOverride.cpp"
 #include "client/TracyKCore.cpp"
+#include "client/TracyCapture.cpp"
+#include "client/TracyFlightRecorder.cpp"
+#include "client/TracyNuma.cpp"
+#include "client/TracyZoneSampling.cpp"
+#include "client/TracyZoneCategory.cpp"
+#include "client/TracyZoneStats.cpp"
+#include "client/TracyZoneCounters.cpp"
+#include "client/TracyStringArena.cpp"
+#include "client/TracyWakeup.cpp"
+#include "client/TracyThreadPolicy.cpp"
 
 #ifdef TRACY_ROCPROF
 #  include "client/TracyRocprof.cpp"
@@ -3,8 +3,10 @@
 #ifdef TRACY_USE_RPMALLOC
 
 #include <atomic>
+#include <string.h>
 
 #include "../common/TracyForceInline.hpp"
+#include "../common/TracySystem.hpp"
 #include "../common/TracyYield.hpp"
 
 namespace tracy
@@ -24,7 +26,18 @@ tracy_no_inline static void InitRpmallocPlumbing()
         const auto done = RpInitDone.load( std::memory_order_acquire );
         if( !done )
         {
-            rpmalloc_initialize();
+            // TRACY_HUGE_PAGES=1 backs the heap, which holds the event queue blocks and the
+            // send buffers, with huge pages, or with transparent huge pages if none are
+            // reserved, to take the TLB misses out of the hot paths at high event rates.
+            // TRACY_HEAP_PREFAULT=1 faults the memory in as soon as it is mapped, so that new
+            // queue blocks don't stall on page faults when they are first filled.
+            rpmalloc_config_t config;
+            memset( &config, 0, sizeof( config ) );
+            const char* hugePages = GetEnvVar( "TRACY_HUGE_PAGES" );
+            if( hugePages && hugePages[0] == '1' ) config.enable_huge_pages = 1;
+            const char* prefault = GetEnvVar( "TRACY_HEAP_PREFAULT" );
+            if( prefault && prefault[0] == '1' ) config.populate_pages = 1;
+            rpmalloc_initialize_config( &config );
             RpInitDone.store( 1, std::memory_order_release );
         }
         RpInitLock.store( 0, std::memory_order_release );
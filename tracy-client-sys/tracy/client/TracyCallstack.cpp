@@ -1,4 +1,5 @@
 #include <limits>
+#include <mutex>
 #include <new>
 #include <stdio.h>
 #include <string.h>
@@ -6,7 +7,9 @@
 #include "TracyDebug.hpp"
 #include "TracyFastVector.hpp"
 #include "TracyStringHelpers.hpp"
+#include "TracySymbolStore.hpp"
 #include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
 #include "../common/TracySystem.hpp"
 
 
@@ -35,6 +38,12 @@
 #  include <dlfcn.h>
 #  include <cxxabi.h>
 #  include <stdlib.h>
+#  ifdef __linux
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#  endif
 
 // Implementation files
 #  include "../libbacktrace/alloc.cpp"
@@ -87,6 +96,8 @@ extern "C" const char* ___tracy_demangle( const char* mangled );
 #ifndef TRACY_DEMANGLE
 constexpr size_t ___tracy_demangle_buffer_len = 1024*1024;
 char* ___tracy_demangle_buffer;
+// Additional symbol resolution threads have buffers of their own.
+thread_local char* ___tracy_demangle_thread_buffer;
 
 void ___tracy_init_demangle_buffer()
 {
@@ -104,11 +115,25 @@ extern "C" const char* ___tracy_demangle( const char* mangled )
     if( strlen( mangled ) > ___tracy_demangle_buffer_len ) return nullptr;
     int status;
     size_t len = ___tracy_demangle_buffer_len;
-    return abi::__cxa_demangle( mangled, ___tracy_demangle_buffer, &len, &status );
+    auto buffer = ___tracy_demangle_thread_buffer ? ___tracy_demangle_thread_buffer : ___tracy_demangle_buffer;
+    return abi::__cxa_demangle( mangled, buffer, &len, &status );
 }
+
+#  define TracyDemangleLock
+#else
+// A custom demangler may reuse a single buffer, so symbol resolution threads take turns with it.
+static tracy::TracyMutex s_demangleLock;
+#  define TracyDemangleLock std::lock_guard<tracy::TracyMutex> demangleLock( s_demangleLock );
 #endif
 #endif
 
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+#  include <pthread.h>
+#  if TRACY_HAS_CALLSTACK == 6
+#    include <pthread_np.h>
+#  endif
+#endif
+
 #if defined(TRACY_USE_LIBBACKTRACE) && TRACY_HAS_CALLSTACK != 4 // dl_iterate_phdr is required for the current image cache. Need to move it to libbacktrace?
 #   define TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
 #   include <link.h>
@@ -125,6 +150,7 @@ void DestroyImageEntry( ImageEntry& entry )
 {
     tracy_free( entry.m_path );
     tracy_free( entry.m_name );
+    tracy_free( entry.m_buildId );
 }
 
 class ImageCache
@@ -183,30 +209,45 @@ public:
         m_images.clear();
     }
 
-    bool ContainsImage( uint64_t startAddress ) const
-    {
-        return std::any_of( m_images.begin(), m_images.end(), [startAddress]( const ImageEntry& entry ) { return startAddress == entry.m_startAddress; } );
-    }
 protected:
     tracy::FastVector<ImageEntry> m_images;
     bool m_sorted = true;
 };
 
 #ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
+// "TRACY_SYMBOL_OFFLINE_RESOLVE=2" additionally puts the build id of the image in place of the
+// file of the unresolved frames, so that the debug information can be looked up by a process
+// which doesn't see the same file system, such as a symbol server or debuginfod.
+static bool s_shouldSendBuildIds = false;
+static bool ShouldSendBuildIds()
+{
+    const char* symbolOfflineResolve = GetEnvVar( "TRACY_SYMBOL_OFFLINE_RESOLVE" );
+    return symbolOfflineResolve && symbolOfflineResolve[0] == '2';
+}
+
 // when we have access to dl_iterate_phdr(), we can build a cache of address ranges to image paths
 // so we can quickly determine which image an address falls into.
 // We refresh this cache only when we hit an address that doesn't fall into any known range.
+//
+// The loader counts the images it has loaded and unloaded, and passes the counters to the first
+// dl_iterate_phdr() callback. A refresh stops right there if they didn't change since the previous
+// one, so that the addresses outside of any image don't cost a walk each. Otherwise the images
+// which are already known are found by binary search, and the images which were unloaded are only
+// looked for when the unload counter moved.
 class ImageCacheDlIteratePhdr : public ImageCache
 {
 public:
 
     ImageCacheDlIteratePhdr()
+        : m_live( 512 )
+        , m_retired( 64 )
     {
         Refresh();
     }
 
     ~ImageCacheDlIteratePhdr()
     {
+        for( auto name : m_retired ) tracy_free( name );
     }
 
     const ImageEntry* GetImageForAddress( uint64_t address )
@@ -223,18 +264,94 @@ public:
 private:
     bool m_updated = false;
     bool m_haveMainImageName = false;
+    bool m_haveCounters = false;
+    bool m_first = false;
+    bool m_walked = false;
+    bool m_sweep = false;
+    uint64_t m_adds = 0;
+    uint64_t m_subs = 0;
+    size_t m_knownCount = 0;
+    tracy::FastVector<uint64_t> m_live;
+    // Names of the images which went away. The symbol resolution may still hold on to them, as
+    // does the symbol store, which tells images apart by name, so that an image loaded again gets
+    // a name of its own.
+    tracy::FastVector<char*> m_retired;
+
+    static bool SameImage( const ImageEntry& entry, uint64_t endAddress, const char* name )
+    {
+        if( entry.m_endAddress != endAddress ) return false;
+        // The name of the main executable is only known after the walk.
+        if( !name ) return true;
+        return entry.m_name && strcmp( entry.m_name, name ) == 0;
+    }
+
+    void RetireEntry( ImageEntry& entry )
+    {
+        if( entry.m_name ) *m_retired.push_next() = entry.m_name;
+        if( entry.m_path ) *m_retired.push_next() = entry.m_path;
+        if( entry.m_buildId ) *m_retired.push_next() = entry.m_buildId;
+        entry.m_name = nullptr;
+        entry.m_path = nullptr;
+        entry.m_buildId = nullptr;
+    }
+
+    static char* CopyBuildId( const struct dl_phdr_info* info )
+    {
+        char id[129];
+        if( !ReadImageBuildId( info, id ) ) return nullptr;
+        return CopyStringFast( id );
+    }
 
     static int Callback( struct dl_phdr_info* info, size_t size, void* data )
     {
         ImageCacheDlIteratePhdr* cache = reinterpret_cast<ImageCacheDlIteratePhdr*>( data );
 
-        const auto startAddress = static_cast<uint64_t>( info->dlpi_addr );
-        if( cache->ContainsImage( startAddress ) ) return 0;
+        if( cache->m_first )
+        {
+            cache->m_first = false;
+            if( size >= offsetof( struct dl_phdr_info, dlpi_subs ) + sizeof( info->dlpi_subs ) )
+            {
+                const uint64_t adds = info->dlpi_adds;
+                const uint64_t subs = info->dlpi_subs;
+                if( cache->m_haveCounters && adds == cache->m_adds && subs == cache->m_subs ) return 1;
+                cache->m_sweep = cache->m_haveCounters && subs != cache->m_subs;
+                cache->m_adds = adds;
+                cache->m_subs = subs;
+                cache->m_haveCounters = true;
+            }
+            else
+            {
+                cache->m_sweep = true;
+            }
+            cache->m_walked = true;
+        }
 
+        const auto startAddress = static_cast<uint64_t>( info->dlpi_addr );
         const uint32_t headerCount = info->dlpi_phnum;
         assert( headerCount > 0);
         const auto endAddress = static_cast<uint64_t>( info->dlpi_addr +
             info->dlpi_phdr[info->dlpi_phnum - 1].p_vaddr + info->dlpi_phdr[info->dlpi_phnum - 1].p_memsz);
+        const char* name = info->dlpi_name && info->dlpi_name[0] != '\0' ? info->dlpi_name : nullptr;
+
+        if( cache->m_sweep ) *cache->m_live.push_next() = startAddress;
+
+        // The images known before the walk are sorted by descending start address.
+        const auto known = cache->m_images.begin() + cache->m_knownCount;
+        auto it = std::lower_bound( cache->m_images.begin(), known, startAddress,
+            []( const ImageEntry& lhs, const uint64_t rhs ) { return lhs.m_startAddress > rhs; } );
+        if( it != known && it->m_startAddress == startAddress )
+        {
+            if( SameImage( *it, endAddress, name ) ) return 0;
+
+            // Another image was loaded in the place of an unloaded one.
+            cache->RetireEntry( *it );
+            it->m_endAddress = endAddress;
+            it->m_name = name ? CopyStringFast( name ) : nullptr;
+            it->m_buildId = s_shouldSendBuildIds ? CopyBuildId( info ) : nullptr;
+            if( !name ) cache->m_haveMainImageName = false;
+            cache->m_updated = true;
+            return 0;
+        }
 
         ImageEntry image{};
         image.m_startAddress = startAddress;
@@ -242,7 +359,8 @@ private:
 
         // the base executable name isn't provided when iterating with dl_iterate_phdr,
         // we will have to patch the executable image name outside this callback
-        image.m_name = info->dlpi_name && info->dlpi_name[0] != '\0' ? CopyStringFast( info->dlpi_name ) : nullptr;
+        image.m_name = name ? CopyStringFast( name ) : nullptr;
+        image.m_buildId = s_shouldSendBuildIds ? CopyBuildId( info ) : nullptr;
 
         cache->AddEntry( image );
         cache->m_updated = true;
@@ -252,9 +370,17 @@ private:
 
     void Refresh()
     {
+        Sort();
         m_updated = false;
+        m_first = true;
+        m_walked = false;
+        m_sweep = false;
+        m_knownCount = m_images.size();
+        m_live.clear();
         dl_iterate_phdr( Callback, this );
+        if( !m_walked ) return;
 
+        if( m_sweep ) RemoveUnloaded();
         if( m_updated )
         {
             Sort();
@@ -263,6 +389,26 @@ private:
         }
     }
 
+    // Drops the images known before the walk which the walk didn't come across.
+    void RemoveUnloaded()
+    {
+        std::sort( m_live.begin(), m_live.end() );
+        auto dst = m_images.begin();
+        for( size_t i=0; i<m_images.size(); i++ )
+        {
+            auto& entry = m_images[i];
+            if( i < m_knownCount && !std::binary_search( m_live.begin(), m_live.end(), entry.m_startAddress ) )
+            {
+                RetireEntry( entry );
+                continue;
+            }
+            *dst++ = entry;
+        }
+        if( dst == m_images.end() ) return;
+        m_images.truncate( dst - m_images.begin() );
+        m_updated = true;
+    }
+
     void UpdateMainImageName()
     {
         if( m_haveMainImageName )
@@ -341,7 +487,7 @@ static bool s_shouldResolveSymbolsOffline = false;
 bool ShouldResolveSymbolsOffline()
 {
     const char* symbolOfflineResolve = GetEnvVar( "TRACY_SYMBOL_OFFLINE_RESOLVE" );
-    return (symbolOfflineResolve && symbolOfflineResolve[0] == '1');
+    return (symbolOfflineResolve && ( symbolOfflineResolve[0] == '1' || symbolOfflineResolve[0] == '2' ));
 }
 #endif // #ifdef TRACY_SYMBOL_OFFLINE_RESOLVE
 
@@ -567,7 +713,7 @@ static void CacheProcessModules()
     }
 }
 
-void InitCallstack()
+void InitCallstack( bool )
 {
 #ifndef TRACY_SYMBOL_OFFLINE_RESOLVE
     s_shouldResolveSymbolsOffline = ShouldResolveSymbolsOffline();
@@ -875,10 +1021,12 @@ constexpr size_t MaxCbTrace = 64;
 
 struct backtrace_state* cb_bts = nullptr;
 
-int cb_num;
-CallstackEntry cb_data[MaxCbTrace];
+thread_local int cb_num;
+thread_local CallstackEntry cb_data[MaxCbTrace];
 int cb_fixup;
 
+static TracyMutex s_imageCacheLock;
+
 #ifdef TRACY_DEBUGINFOD
 debuginfod_client* s_debuginfod;
 
@@ -894,22 +1042,222 @@ static FastVector<DebugInfo>* s_di_known;
 #endif
 
 #ifdef __linux
+// The code symbols of the kernel, sorted by address. Names and modules are offsets into the string
+// pool, a module offset of zero meaning the kernel itself.
 struct KernelSymbol
 {
     uint64_t addr;
     uint32_t size;
-    const char* name;
-    const char* mod;
+    uint32_t name;
+    uint32_t mod;
 };
 
-KernelSymbol* s_kernelSym = nullptr;
+const KernelSymbol* s_kernelSym = nullptr;
 size_t s_kernelSymCnt;
+const char* s_kernelSymStr;
+
+// When TRACY_SYMBOL_CACHE_DIR is set, the index is kept in a file named after the build id of the
+// kernel, and only rebuilt from /proc/kallsyms after a reboot, which moves the kernel around, or
+// when the loaded modules change. The file is laid out as:
+//   KernelSymbolIndexHeader
+//   KernelSymbol sym[count]
+//   char         strings[stringsSize]
+struct KernelSymbolIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t stringsSize;
+    uint64_t modulesHash;
+    char bootId[40];
+};
+
+constexpr char KernelSymbolIndexMagic[8] = { 'T', 'r', 'a', 'c', 'y', 'K', 's', 'y' };
+constexpr uint32_t KernelSymbolIndexVersion = 1;
+
+static size_t ReadSmallFile( const char* path, char* buf, size_t size )
+{
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return 0;
+    size_t len = 0;
+    ssize_t rd;
+    while( len < size && ( rd = read( fd, buf + len, size - len ) ) > 0 ) len += rd;
+    close( fd );
+    return len;
+}
+
+// Only the names and load addresses of the modules are hashed. The other fields, such as the
+// reference counts, change all the time without moving any symbols.
+static uint64_t HashKernelModules()
+{
+    FILE* f = fopen( "/proc/modules", "rb" );
+    if( !f ) return 0;
+    uint64_t hash = 0xcbf29ce484222325;
+    auto hashBytes = [&hash]( const char* ptr, size_t len ) {
+        for( size_t i=0; i<len; i++ ) hash = ( hash ^ uint8_t( ptr[i] ) ) * 0x100000001b3;
+    };
+    size_t linelen = 1024;
+    auto linebuf = (char*)tracy_malloc( linelen );
+    while( getline( &linebuf, &linelen, f ) != -1 )
+    {
+        // name size refcount dependencies state address [taint]
+        auto ptr = linebuf;
+        for( int field=0; field<6 && *ptr && *ptr != '\n'; field++ )
+        {
+            const auto start = ptr;
+            while( *ptr && *ptr != ' ' && *ptr != '\n' ) ptr++;
+            if( field == 0 || field == 5 ) hashBytes( start, size_t( ptr - start + 1 ) );
+            while( *ptr == ' ' ) ptr++;
+        }
+    }
+    tracy_free( linebuf );
+    fclose( f );
+    return hash;
+}
+
+static char* GetKernelSymbolIndexPath()
+{
+    const char* dir = GetEnvVar( "TRACY_SYMBOL_CACHE_DIR" );
+    if( !dir || !*dir ) return nullptr;
+
+    // The build id is the first GNU note of the kernel image.
+    char notes[4096];
+    const auto size = ReadSmallFile( "/sys/kernel/notes", notes, sizeof( notes ) );
+    char id[129] = {};
+    size_t pos = 0;
+    while( pos + 12 <= size )
+    {
+        uint32_t namesz, descsz, type;
+        memcpy( &namesz, notes + pos, 4 );
+        memcpy( &descsz, notes + pos + 4, 4 );
+        memcpy( &type, notes + pos + 8, 4 );
+        const auto desc = pos + 12 + ( ( namesz + 3 ) & ~3u );
+        const auto next = desc + ( ( descsz + 3 ) & ~3u );
+        if( next > size ) break;
+        if( type == 3 && namesz == 4 && memcmp( notes + pos + 12, "GNU", 4 ) == 0 && descsz > 0 && descsz <= 64 )
+        {
+            for( uint32_t i=0; i<descsz; i++ ) sprintf( id + i*2, "%02x", uint8_t( notes[desc+i] ) );
+            break;
+        }
+        pos = next;
+    }
+    if( !id[0] ) return nullptr;
+
+    auto path = (char*)tracy_malloc( strlen( dir ) + sizeof( id ) + 16 );
+    sprintf( path, "%s/kernel-%s.tksym", dir, id );
+    return path;
+}
+
+static void GetBootId( char* bootId )
+{
+    memset( bootId, 0, 40 );
+    const auto len = ReadSmallFile( "/proc/sys/kernel/random/boot_id", bootId, 39 );
+    if( len > 0 && bootId[len-1] == '\n' ) bootId[len-1] = '\0';
+}
+
+static bool LoadKernelSymbolIndex( const char* path, const KernelSymbolIndexHeader& expect )
+{
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return false;
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || size_t( st.st_size ) < sizeof( KernelSymbolIndexHeader ) )
+    {
+        close( fd );
+        return false;
+    }
+    const auto size = size_t( st.st_size );
+    auto data = (const char*)mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( data == MAP_FAILED ) return false;
+
+    KernelSymbolIndexHeader hdr;
+    memcpy( &hdr, data, sizeof( hdr ) );
+    if( memcmp( hdr.magic, expect.magic, sizeof( hdr.magic ) ) != 0 || hdr.version != expect.version ||
+        hdr.modulesHash != expect.modulesHash || memcmp( hdr.bootId, expect.bootId, sizeof( hdr.bootId ) ) != 0 ||
+        hdr.count == 0 || hdr.stringsSize == 0 || size != sizeof( hdr ) + sizeof( KernelSymbol ) * hdr.count + hdr.stringsSize )
+    {
+        munmap( (void*)data, size );
+        return false;
+    }
+
+    // The file may be damaged, or written by something else. Every string has to end within the
+    // pool.
+    const auto sym = (const KernelSymbol*)( data + sizeof( hdr ) );
+    const auto str = data + sizeof( hdr ) + sizeof( KernelSymbol ) * hdr.count;
+    bool valid = str[hdr.stringsSize-1] == '\0';
+    for( uint32_t i=0; valid && i<hdr.count; i++ )
+    {
+        valid = sym[i].name < hdr.stringsSize && sym[i].mod < hdr.stringsSize;
+    }
+    if( !valid )
+    {
+        munmap( (void*)data, size );
+        return false;
+    }
+
+    s_kernelSym = sym;
+    s_kernelSymCnt = hdr.count;
+    s_kernelSymStr = str;
+    return true;
+}
+
+static void StoreKernelSymbolIndex( const char* path, KernelSymbolIndexHeader& hdr )
+{
+    hdr.count = uint32_t( s_kernelSymCnt );
+    auto tmp = (char*)tracy_malloc( strlen( path ) + 16 );
+    sprintf( tmp, "%s.%u", path, uint32_t( getpid() ) );
+    int fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( fd >= 0 )
+    {
+        const bool ok =
+            write( fd, &hdr, sizeof( hdr ) ) == sizeof( hdr ) &&
+            write( fd, s_kernelSym, sizeof( KernelSymbol ) * s_kernelSymCnt ) == ssize_t( sizeof( KernelSymbol ) * s_kernelSymCnt ) &&
+            write( fd, s_kernelSymStr, hdr.stringsSize ) == ssize_t( hdr.stringsSize );
+        close( fd );
+        // Renaming keeps other processes from seeing a partly written index.
+        if( !ok || rename( tmp, path ) != 0 ) unlink( tmp );
+    }
+    tracy_free( tmp );
+}
 
 static void InitKernelSymbols()
 {
+    KernelSymbolIndexHeader hdr = {};
+    memcpy( hdr.magic, KernelSymbolIndexMagic, sizeof( hdr.magic ) );
+    hdr.version = KernelSymbolIndexVersion;
+    auto indexPath = GetKernelSymbolIndexPath();
+    if( indexPath )
+    {
+        hdr.modulesHash = HashKernelModules();
+        GetBootId( hdr.bootId );
+        if( LoadKernelSymbolIndex( indexPath, hdr ) )
+        {
+            TracyDebug( "Loaded %zu kernel symbols from %s", s_kernelSymCnt, indexPath );
+            tracy_free( indexPath );
+            return;
+        }
+    }
+
     FILE* f = fopen( "/proc/kallsyms", "rb" );
-    if( !f ) return;
+    if( !f )
+    {
+        tracy_free( indexPath );
+        return;
+    }
     tracy::FastVector<KernelSymbol> tmpSym( 512 * 1024 );
+    // Offset zero is the empty string, which marks the symbols other than code, and the symbols of
+    // the kernel itself in place of a module name. The symbols of a module are listed together, so
+    // that most module names are only stored once.
+    tracy::FastVector<char> strings( 4 * 1024 * 1024 );
+    *strings.push_next() = '\0';
+    auto addString = [&strings]( const char* str, size_t len ) {
+        const auto pos = uint32_t( strings.size() );
+        for( size_t i=0; i<len; i++ ) *strings.push_next() = str[i];
+        *strings.push_next() = '\0';
+        return pos;
+    };
+    uint32_t lastMod = 0;
+    size_t lastModLen = 0;
     size_t linelen = 16 * 1024;     // linelen must be big enough to prevent reallocs in getline()
     auto linebuf = (char*)tracy_malloc( linelen );
     ssize_t sz;
@@ -961,22 +1309,24 @@ static void InitKernelSymbols()
             modend = ptr;
         }
 
-        char* strname = nullptr;
-        char* strmod = nullptr;
+        uint32_t strname = 0;
+        uint32_t strmod = 0;
 
         if( valid )
         {
             validCnt++;
 
-            strname = (char*)tracy_malloc_fast( nameend - namestart + 1 );
-            memcpy( strname, namestart, nameend - namestart );
-            strname[nameend-namestart] = '\0';
+            strname = addString( namestart, nameend - namestart );
 
             if( modstart )
             {
-                strmod = (char*)tracy_malloc_fast( modend - modstart + 1 );
-                memcpy( strmod, modstart, modend - modstart );
-                strmod[modend-modstart] = '\0';
+                const auto modlen = size_t( modend - modstart );
+                if( lastMod == 0 || modlen != lastModLen || memcmp( strings.data() + lastMod, modstart, modlen ) != 0 )
+                {
+                    lastMod = addString( modstart, modlen );
+                    lastModLen = modlen;
+                }
+                strmod = lastMod;
             }
         }
 
@@ -988,7 +1338,11 @@ static void InitKernelSymbols()
     }
     tracy_free_fast( linebuf );
     fclose( f );
-    if( tmpSym.empty() ) return;
+    if( tmpSym.empty() || validCnt == 0 )
+    {
+        tracy_free( indexPath );
+        return;
+    }
 
     std::sort( tmpSym.begin(), tmpSym.end(), []( const KernelSymbol& lhs, const KernelSymbol& rhs ) { return lhs.addr < rhs.addr; } );
     for( size_t i=0; i<tmpSym.size()-1; i++ )
@@ -996,16 +1350,29 @@ static void InitKernelSymbols()
         if( tmpSym[i].name ) tmpSym[i].size = tmpSym[i+1].addr - tmpSym[i].addr;
     }
 
-    s_kernelSymCnt = validCnt;
-    s_kernelSym = (KernelSymbol*)tracy_malloc_fast( sizeof( KernelSymbol ) * validCnt );
-    auto dst = s_kernelSym;
+    // The symbols and the strings go in a single block, as in the index file.
+    const auto stringsSize = strings.size();
+    auto block = (char*)tracy_malloc_fast( sizeof( KernelSymbol ) * validCnt + stringsSize );
+    auto dst = (KernelSymbol*)block;
     for( auto& v : tmpSym )
     {
         if( v.name ) *dst++ = v;
     }
-    assert( dst == s_kernelSym + validCnt );
+    assert( dst == (KernelSymbol*)block + validCnt );
+    memcpy( dst, strings.data(), stringsSize );
+
+    s_kernelSym = (const KernelSymbol*)block;
+    s_kernelSymCnt = validCnt;
+    s_kernelSymStr = (const char*)dst;
 
     TracyDebug( "Loaded %zu kernel symbols (%zu code sections)", tmpSym.size(), validCnt );
+
+    if( indexPath )
+    {
+        hdr.stringsSize = stringsSize;
+        StoreKernelSymbolIndex( indexPath, hdr );
+        tracy_free( indexPath );
+    }
 }
 #endif
 
@@ -1068,25 +1435,45 @@ void InitCallstackCritical()
 {
 }
 
-void InitCallstack()
+static int WarmupDataCb( void*, uintptr_t, uintptr_t, const char*, int, const char* ) { return 1; }
+static void WarmupErrorCb( void*, const char*, int ) {}
+
+static bool s_backtraceThreaded;
+static std::once_flag s_backtraceWarmup;
+
+// Racing threads would each load the debug information of all images, so have one of them do it
+// first. This waits for the first lookup, which may never come if the symbol store has everything.
+static void WarmupBacktrace()
+{
+    if( !s_backtraceThreaded ) return;
+    std::call_once( s_backtraceWarmup, [] { backtrace_pcinfo( cb_bts, (uintptr_t)&InitCallstack, WarmupDataCb, WarmupErrorCb, nullptr ); } );
+}
+
+void InitCallstack( bool threaded )
 {
     InitRpmalloc();
 
+#ifndef TRACY_SYMBOL_OFFLINE_RESOLVE
+    s_shouldResolveSymbolsOffline = ShouldResolveSymbolsOffline();
+#endif //#ifndef TRACY_SYMBOL_OFFLINE_RESOLVE
 #ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
+    // The build ids are read as the images are added to the cache.
+    s_shouldSendBuildIds = s_shouldResolveSymbolsOffline && ShouldSendBuildIds();
     CreateImageCaches();
 #endif //#ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
 
-#ifndef TRACY_SYMBOL_OFFLINE_RESOLVE
-    s_shouldResolveSymbolsOffline = ShouldResolveSymbolsOffline();
-#endif //#ifndef TRACY_SYMBOL_OFFLINE_RESOLVE
     if( s_shouldResolveSymbolsOffline )
     {
         cb_bts = nullptr; // disable use of libbacktrace calls
-        TracyDebug( "TRACY: enabling offline symbol resolving!" );
+        TracyDebug( "TRACY: enabling offline symbol resolving%s!", s_shouldSendBuildIds ? " with build ids" : "" );
     }
     else
     {
-        cb_bts = backtrace_create_state( nullptr, 0, nullptr, nullptr );
+        cb_bts = backtrace_create_state( nullptr, threaded ? 1 : 0, nullptr, nullptr );
+        s_backtraceThreaded = threaded;
+#ifdef TRACY_HAS_SYMBOL_STORE
+        InitSymbolStore();
+#endif
     }
 
 #ifndef TRACY_DEMANGLE
@@ -1168,6 +1555,9 @@ debuginfod_client* GetDebuginfodClient()
 
 void EndCallstack()
 {
+#ifdef TRACY_HAS_SYMBOL_STORE
+    EndSymbolStore();
+#endif
 #ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
     DestroyImageCaches();
 #endif //#ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
@@ -1183,6 +1573,22 @@ void EndCallstack()
 #endif
 }
 
+void InitCallstackThread()
+{
+    InitRpmalloc();
+#ifndef TRACY_DEMANGLE
+    ___tracy_demangle_thread_buffer = (char*)tracy_malloc( ___tracy_demangle_buffer_len );
+#endif
+}
+
+void EndCallstackThread()
+{
+#ifndef TRACY_DEMANGLE
+    tracy_free( ___tracy_demangle_thread_buffer );
+    ___tracy_demangle_thread_buffer = nullptr;
+#endif
+}
+
 const char* DecodeCallstackPtrFast( uint64_t ptr )
 {
     static char ret[1024];
@@ -1237,6 +1643,7 @@ CallstackSymbolData DecodeSymbolAddress( uint64_t ptr )
     CallstackSymbolData sym;
     if( cb_bts )
     {
+        WarmupBacktrace();
         backtrace_pcinfo( cb_bts, ptr, SymbolAddressDataCb, SymbolAddressErrorCb, &sym );
     }
     else
@@ -1254,6 +1661,7 @@ static int CallstackDataCb( void* /*data*/, uintptr_t pc, uintptr_t lowaddr, con
 
     if( !fn && !function )
     {
+        TracyDemangleLock;
         const char* symname = nullptr;
         auto vptr = (void*)pc;
         ptrdiff_t symoff = 0;
@@ -1291,6 +1699,7 @@ static int CallstackDataCb( void* /*data*/, uintptr_t pc, uintptr_t lowaddr, con
     }
     else
     {
+        TracyDemangleLock;
         if( !fn ) fn = "[unknown]";
         if( !function )
         {
@@ -1346,14 +1755,14 @@ void SymInfoError( void* /*data*/, const char* /*msg*/, int /*errnum*/ )
     cb_data[cb_num-1].symAddr = 0;
 }
 
-void GetSymbolForOfflineResolve(void* address, uint64_t imageBaseAddress, CallstackEntry& cbEntry)
+void GetSymbolForOfflineResolve(void* address, uint64_t imageBaseAddress, const char* buildId, CallstackEntry& cbEntry)
 {
     // tagged with a string that we can identify as an unresolved symbol
     cbEntry.name = CopyStringFast( "[unresolved]" );
     // set .so relative offset so it can be resolved offline
     cbEntry.symAddr = (uint64_t)address - imageBaseAddress;
     cbEntry.symLen = 0x0;
-    cbEntry.file = CopyStringFast( "[unknown]" );
+    cbEntry.file = CopyStringFast( buildId ? buildId : "[unknown]" );
     cbEntry.line = 0;
 }
 
@@ -1363,14 +1772,20 @@ CallstackEntryData DecodeCallstackPtr( uint64_t ptr )
     if ( !IsKernelAddress( ptr ) )
     {
         const char* imageName = nullptr;
+        const char* buildId = nullptr;
         uint64_t imageBaseAddress = 0x0;
 
 #ifdef TRACY_HAS_DL_ITERATE_PHDR_TO_REFRESH_IMAGE_CACHE
-        const auto* image = s_imageCache->GetImageForAddress( ptr );
-        if( image )
         {
-            imageName = image->m_name;
-            imageBaseAddress = uint64_t( image->m_startAddress );
+            // The cache is refreshed on misses, which moves entries around.
+            std::lock_guard<TracyMutex> lock( s_imageCacheLock );
+            const auto* image = s_imageCache->GetImageForAddress( ptr );
+            if( image )
+            {
+                imageName = image->m_name;
+                buildId = image->m_buildId;
+                imageBaseAddress = uint64_t( image->m_startAddress );
+            }
         }
 #else
         Dl_info dlinfo;
@@ -1384,15 +1799,25 @@ CallstackEntryData DecodeCallstackPtr( uint64_t ptr )
         if( s_shouldResolveSymbolsOffline )
         {
             cb_num = 1;
-            GetSymbolForOfflineResolve( (void*)ptr, imageBaseAddress, cb_data[0] );
+            GetSymbolForOfflineResolve( (void*)ptr, imageBaseAddress, buildId, cb_data[0] );
         }
         else
         {
             cb_num = 0;
-            backtrace_pcinfo( cb_bts, ptr, CallstackDataCb, CallstackErrorCb, nullptr );
-            assert( cb_num > 0 );
+#ifdef TRACY_HAS_SYMBOL_STORE
+            cb_num = SymbolStoreGet( imageName, imageBaseAddress, ptr, cb_data, MaxCbTrace );
+#endif
+            if( cb_num == 0 )
+            {
+                WarmupBacktrace();
+                backtrace_pcinfo( cb_bts, ptr, CallstackDataCb, CallstackErrorCb, nullptr );
+                assert( cb_num > 0 );
 
-            backtrace_syminfo( cb_bts, ptr, SymInfoCallback, SymInfoError, nullptr );
+                backtrace_syminfo( cb_bts, ptr, SymInfoCallback, SymInfoError, nullptr );
+#ifdef TRACY_HAS_SYMBOL_STORE
+                SymbolStorePut( imageName, imageBaseAddress, ptr, cb_data, cb_num );
+#endif
+            }
         }
 
         return { cb_data, uint8_t( cb_num ), imageName ? imageName : "[unknown]" };
@@ -1403,12 +1828,12 @@ CallstackEntryData DecodeCallstackPtr( uint64_t ptr )
         auto it = std::lower_bound( s_kernelSym, s_kernelSym + s_kernelSymCnt, ptr, []( const KernelSymbol& lhs, const uint64_t& rhs ) { return lhs.addr + lhs.size < rhs; } );
         if( it != s_kernelSym + s_kernelSymCnt )
         {
-            cb_data[0].name = CopyStringFast( it->name );
+            cb_data[0].name = CopyStringFast( s_kernelSymStr + it->name );
             cb_data[0].file = CopyStringFast( "<kernel>" );
             cb_data[0].line = 0;
             cb_data[0].symLen = it->size;
             cb_data[0].symAddr = it->addr;
-            return { cb_data, 1, it->mod ? it->mod : "<kernel>" };
+            return { cb_data, 1, it->mod ? s_kernelSymStr + it->mod : "<kernel>" };
         }
     }
 #endif
@@ -1427,7 +1852,7 @@ void InitCallstackCritical()
 {
 }
 
-void InitCallstack()
+void InitCallstack( bool )
 {
     ___tracy_init_demangle_buffer();
 }
@@ -1518,6 +1943,58 @@ CallstackEntryData DecodeCallstackPtr( uint64_t ptr )
 
 #endif
 
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+struct ThreadStackBounds
+{
+    uintptr_t low, high;
+    bool init;
+};
+
+static thread_local ThreadStackBounds s_stackBounds;
+
+#if TRACY_HAS_CALLSTACK != 4
+static void GetStackFromAttr( const pthread_attr_t& attr, ThreadStackBounds& bounds )
+{
+    void* addr;
+    size_t size;
+    if( pthread_attr_getstack( &attr, &addr, &size ) == 0 )
+    {
+        bounds.low = (uintptr_t)addr;
+        bounds.high = bounds.low + size;
+    }
+}
+#endif
+
+TRACY_API void GetThreadStackBounds( uintptr_t& low, uintptr_t& high )
+{
+    auto& bounds = s_stackBounds;
+    if( !bounds.init )
+    {
+        bounds.init = true;
+        bounds.low = bounds.high = 0;
+#if TRACY_HAS_CALLSTACK == 4
+        const auto self = pthread_self();
+        bounds.high = (uintptr_t)pthread_get_stackaddr_np( self );
+        bounds.low = bounds.high - pthread_get_stacksize_np( self );
+#elif TRACY_HAS_CALLSTACK == 6
+        pthread_attr_t attr;
+        pthread_attr_init( &attr );
+        if( pthread_attr_get_np( pthread_self(), &attr ) == 0 ) GetStackFromAttr( attr, bounds );
+        pthread_attr_destroy( &attr );
+#else
+        pthread_attr_t attr;
+        if( pthread_getattr_np( pthread_self(), &attr ) == 0 )
+        {
+            GetStackFromAttr( attr, bounds );
+            pthread_attr_destroy( &attr );
+        }
+#endif
+    }
+    low = bounds.low;
+    high = bounds.high;
+}
+#endif
+
 }
 
 #endif
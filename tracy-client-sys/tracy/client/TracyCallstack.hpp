@@ -16,6 +16,7 @@ struct ImageEntry
     uint64_t m_endAddress = 0;
     char* m_name = nullptr;
     char* m_path = nullptr;
+    char* m_buildId = nullptr;
 };
 
 }
@@ -46,6 +47,10 @@ static tracy_force_inline void* Callstack( int32_t /*depth*/ ) { return nullptr;
 #  include <elfutils/debuginfod.h>
 #endif
 
+#if defined TRACY_FRAME_POINTER_UNWIND && TRACY_HAS_CALLSTACK != 1 && ( defined __x86_64__ || defined __aarch64__ ) && defined __GNUC__
+#  define TRACY_HAS_FRAME_POINTER_UNWIND
+#endif
+
 #include <assert.h>
 #include <stdint.h>
 
@@ -83,9 +88,16 @@ struct CallstackEntryData
 CallstackSymbolData DecodeSymbolAddress( uint64_t ptr );
 const char* DecodeCallstackPtrFast( uint64_t ptr );
 CallstackEntryData DecodeCallstackPtr( uint64_t ptr );
-void InitCallstack();
+// Decoding may be done by several threads at once if threaded is set. Threads other than the
+// one calling InitCallstack() have to call InitCallstackThread() and EndCallstackThread(), which
+// are only available with libbacktrace.
+void InitCallstack( bool threaded = false );
 void InitCallstackCritical();
 void EndCallstack();
+#ifdef TRACY_USE_LIBBACKTRACE
+void InitCallstackThread();
+void EndCallstackThread();
+#endif
 const char* GetKernelModulePath( uint64_t addr );
 
 #ifdef TRACY_DEBUGINFOD
@@ -93,20 +105,57 @@ const uint8_t* GetBuildIdForImage( const char* image, size_t& size );
 debuginfod_client* GetDebuginfodClient();
 #endif
 
-#if TRACY_HAS_CALLSTACK == 1
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+
+// Address range of the stack of the calling thread, empty if it can't be determined.
+TRACY_API void GetThreadStackBounds( uintptr_t& low, uintptr_t& high );
+
+// Follows the chain of frame records, { previous frame pointer, return address }, which every
+// function built with frame pointers keeps on x86-64 and AArch64. A record is only read if it lies
+// within the stack of the thread and above the previous one, so a function without a frame pointer
+// ends the walk early instead of making it touch arbitrary memory.
+static tracy_force_inline size_t CaptureCallstack( uintptr_t* frames, int32_t depth )
+{
+    assert( depth >= 1 );
+
+    uintptr_t pc;
+#if defined __x86_64__
+    asm volatile( "leaq 0(%%rip), %0" : "=r" ( pc ) );
+#else
+    asm volatile( "adr %0, ." : "=r" ( pc ) );
+#endif
+    frames[0] = pc;
+    size_t num = 1;
+
+    uintptr_t low, high;
+    GetThreadStackBounds( low, high );
+    auto fp = (uintptr_t)__builtin_frame_address( 0 );
+    if( fp >= low )
+    {
+        while( num < (size_t)depth && ( fp & ( sizeof( uintptr_t ) - 1 ) ) == 0 && fp + 2 * sizeof( uintptr_t ) <= high )
+        {
+            const auto record = (const uintptr_t*)fp;
+            if( record[1] == 0 ) break;
+            frames[num++] = record[1];
+            if( record[0] <= fp ) break;
+            fp = record[0];
+        }
+    }
+
+    return num;
+}
+
+#elif TRACY_HAS_CALLSTACK == 1
 
 extern "C"
 {
     TRACY_API unsigned long ___tracy_RtlWalkFrameChain( void**, unsigned long, unsigned long );
 }
 
-static tracy_force_inline void* Callstack( int32_t depth )
+static tracy_force_inline size_t CaptureCallstack( uintptr_t* frames, int32_t depth )
 {
     assert( depth >= 1 && depth < 63 );
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    const auto num = ___tracy_RtlWalkFrameChain( (void**)( trace + 1 ), depth, 0 );
-    *trace = num;
-    return trace;
+    return ___tracy_RtlWalkFrameChain( (void**)frames, depth, 0 );
 }
 
 #elif TRACY_HAS_CALLSTACK == 2 || TRACY_HAS_CALLSTACK == 5
@@ -129,40 +178,39 @@ static _Unwind_Reason_Code tracy_unwind_callback( struct _Unwind_Context* ctx, v
     return _URC_NO_REASON;
 }
 
-static tracy_force_inline void* Callstack( int32_t depth )
+static tracy_force_inline size_t CaptureCallstack( uintptr_t* frames, int32_t depth )
 {
     assert( depth >= 1 && depth < 63 );
 
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    BacktraceState state = { (void**)(trace+1), (void**)(trace+1+depth) };
+    BacktraceState state = { (void**)frames, (void**)(frames+depth) };
     _Unwind_Backtrace( tracy_unwind_callback, &state );
 
-    *trace = (uintptr_t*)state.current - trace + 1;
-
-    return trace;
+    return (uintptr_t*)state.current - frames;
 }
 
 #elif TRACY_HAS_CALLSTACK == 3 || TRACY_HAS_CALLSTACK == 4 || TRACY_HAS_CALLSTACK == 6
 
-static tracy_force_inline void* Callstack( int32_t depth )
+static tracy_force_inline size_t CaptureCallstack( uintptr_t* frames, int32_t depth )
 {
     assert( depth >= 1 );
 
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + (size_t)depth ) * sizeof( uintptr_t ) );
-
 #ifdef TRACY_LIBUNWIND_BACKTRACE
-    size_t num =  unw_backtrace( (void**)(trace+1), depth );
+    return (size_t)unw_backtrace( (void**)frames, depth );
 #else
-    const auto num = (size_t)backtrace( (void**)(trace+1), depth );
+    return (size_t)backtrace( (void**)frames, depth );
 #endif
+}
 
-    *trace = num;
+#endif
 
+// Returns a tracy_malloc'd buffer holding the number of frames, followed by the frames.
+static tracy_force_inline void* Callstack( int32_t depth )
+{
+    auto trace = (uintptr_t*)tracy_malloc( ( 1 + (size_t)depth ) * sizeof( uintptr_t ) );
+    *trace = CaptureCallstack( trace+1, depth );
     return trace;
 }
 
-#endif
-
 }
 
 #endif
@@ -0,0 +1,60 @@
+#include "TracyCallstackTable.hpp"
+
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+
+#include <new>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+CallstackTable::CallstackTable()
+    : m_table( (std::atomic<uintptr_t*>*)tracy_malloc( sizeof( std::atomic<uintptr_t*> ) * TableSize ) )
+    , m_arena( (uintptr_t*)tracy_malloc( sizeof( uintptr_t ) * ArenaSize ) )
+    , m_used( 0 )
+{
+    for( int i=0; i<TableSize; i++ ) new(m_table+i) std::atomic<uintptr_t*>( nullptr );
+}
+
+CallstackTable::~CallstackTable()
+{
+    tracy_free( m_table );
+    tracy_free( m_arena );
+}
+
+void* CallstackTable::Intern( const uintptr_t* trace )
+{
+    const auto num = trace[0];
+    const auto size = sizeof( uintptr_t ) * ( num + 1 );
+
+    uint64_t hash = num;
+    for( uintptr_t i=1; i<=num; i++ ) hash = ( hash ^ trace[i] ) * 0x9E3779B97F4A7C15ull;
+    const auto idx = uint32_t( hash >> ( 64 - TableBits ) );
+
+    for( uint32_t probe=0; probe<MaxProbe; probe++ )
+    {
+        auto& slot = m_table[( idx + probe ) & ( TableSize - 1 )];
+        auto stored = slot.load( std::memory_order_acquire );
+        if( !stored )
+        {
+            if( m_used.load( std::memory_order_relaxed ) + num + 1 > ArenaSize ) break;
+            const auto offset = m_used.fetch_add( num + 1, std::memory_order_relaxed );
+            if( offset + num + 1 > ArenaSize ) break;
+            auto copy = m_arena + offset;
+            memcpy( copy, trace, size );
+            if( slot.compare_exchange_strong( stored, copy, std::memory_order_release, std::memory_order_acquire ) ) return copy;
+            // Another thread filled the slot first. The arena space taken for the copy is lost.
+        }
+        if( stored[0] == num && memcmp( stored + 1, trace + 1, size - sizeof( uintptr_t ) ) == 0 ) return stored;
+    }
+
+    auto copy = (uintptr_t*)tracy_malloc( size );
+    memcpy( copy, trace, size );
+    return copy;
+}
+
+}
+
+#endif
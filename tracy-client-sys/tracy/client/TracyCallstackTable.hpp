@@ -0,0 +1,49 @@
+#ifndef __TRACYCALLSTACKTABLE_HPP__
+#define __TRACYCALLSTACKTABLE_HPP__
+
+#include "TracyCallstack.hpp"
+
+#if defined TRACY_CALLSTACK_INTERNING && defined TRACY_HAS_CALLSTACK
+#  define TRACY_HAS_CALLSTACK_TABLE
+
+#include <atomic>
+#include <stdint.h>
+
+namespace tracy
+{
+
+// Interns the callstacks of zones and memory events, so that a site hit over and over doesn't make
+// a new allocation for each of its identical callstacks. Interned callstacks live in a single
+// arena for the lifetime of the table and are never freed individually. Once the arena is full,
+// new callstacks are copied to separate allocations, as without interning.
+class CallstackTable
+{
+public:
+    enum { MaxDepth = 62 };
+
+    CallstackTable();
+    ~CallstackTable();
+
+    // Trace holds the number of frames, followed by the frames. Returns the interned copy, or a
+    // tracy_malloc'd one if there's no room left.
+    void* Intern( const uintptr_t* trace );
+    bool Contains( const void* ptr ) const { return ptr >= m_arena && ptr < m_arena + ArenaSize; }
+
+    CallstackTable( const CallstackTable& ) = delete;
+    CallstackTable( CallstackTable&& ) = delete;
+    CallstackTable& operator=( const CallstackTable& ) = delete;
+    CallstackTable& operator=( CallstackTable&& ) = delete;
+
+private:
+    enum { TableBits = 14, TableSize = 1 << TableBits, MaxProbe = 16, ArenaSize = 128 * 1024 };
+
+    std::atomic<uintptr_t*>* m_table;
+    uintptr_t* m_arena;
+    std::atomic<size_t> m_used;
+};
+
+}
+
+#endif
+
+#endif
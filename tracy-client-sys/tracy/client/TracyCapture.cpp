@@ -0,0 +1,154 @@
+#ifdef TRACY_OFFLINE_CAPTURE
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#include "TracyCapture.hpp"
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+#ifndef _WIN32
+// Files are grown and mapped in windows of this size. Must be a multiple of the page size.
+constexpr uint64_t CaptureMapWindow = 32 * 1024 * 1024;
+#endif
+
+CaptureFile::CaptureFile( const char* path, uint64_t fileSize, uint32_t fileCount )
+    : m_fileSize( fileSize )
+    , m_fileCount( fileCount )
+    , m_index( 0 )
+    , m_written( 0 )
+#ifdef _WIN32
+    , m_file( nullptr )
+#else
+    , m_fd( -1 )
+    , m_map( nullptr )
+    , m_mapOffset( 0 )
+#endif
+{
+    const auto sz = strlen( path );
+    m_path = (char*)tracy_malloc( sz + 1 );
+    memcpy( m_path, path, sz + 1 );
+}
+
+CaptureFile::~CaptureFile()
+{
+    Close();
+    tracy_free( m_path );
+}
+
+void CaptureFile::FormatName( char* buf, uint32_t index ) const
+{
+    sprintf( buf, "%s.%u", m_path, index );
+}
+
+bool CaptureFile::Open()
+{
+    Close();
+
+    const auto sz = strlen( m_path ) + 16;
+    auto name = (char*)tracy_malloc( sz );
+    if( m_fileCount != 0 && m_index >= m_fileCount )
+    {
+        FormatName( name, m_index - m_fileCount );
+        remove( name );
+    }
+    FormatName( name, m_index++ );
+#ifdef _WIN32
+    m_file = fopen( name, "wb" );
+    const bool ok = m_file != nullptr;
+#else
+    m_fd = open( name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    const bool ok = m_fd != -1;
+#endif
+    tracy_free( name );
+    m_written = 0;
+    return ok;
+}
+
+void CaptureFile::Close()
+{
+#ifdef _WIN32
+    if( !m_file ) return;
+    fclose( m_file );
+    m_file = nullptr;
+#else
+    if( m_fd == -1 ) return;
+    if( m_map )
+    {
+        munmap( m_map, CaptureMapWindow );
+        m_map = nullptr;
+    }
+    // Drop the unused tail of the last mapped window.
+    if( ftruncate( m_fd, m_written ) != 0 ) {}
+    close( m_fd );
+    m_fd = -1;
+#endif
+}
+
+#ifndef _WIN32
+bool CaptureFile::MapWindow()
+{
+    if( m_map ) munmap( m_map, CaptureMapWindow );
+    m_map = nullptr;
+    m_mapOffset = m_written;
+    assert( m_mapOffset % CaptureMapWindow == 0 );
+    // The window is allocated up front, so that a full disk stops the capture here, rather than
+    // with a SIGBUS when the mapping is written to.
+#if defined __linux__ || defined __FreeBSD__
+    const auto err = posix_fallocate( m_fd, m_mapOffset, CaptureMapWindow );
+    if( err != 0 )
+    {
+        // Filesystems which can't allocate ahead are only grown.
+        if( err != EOPNOTSUPP && err != EINVAL ) return false;
+        if( ftruncate( m_fd, m_mapOffset + CaptureMapWindow ) != 0 ) return false;
+    }
+#else
+    if( ftruncate( m_fd, m_mapOffset + CaptureMapWindow ) != 0 ) return false;
+#endif
+    auto map = mmap( nullptr, CaptureMapWindow, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, m_mapOffset );
+    if( map == MAP_FAILED ) return false;
+    m_map = (char*)map;
+    return true;
+}
+#endif
+
+bool CaptureFile::Write( const void* _data, size_t len )
+{
+#ifdef _WIN32
+    if( !m_file ) return false;
+    if( fwrite( _data, 1, len, m_file ) != len ) return false;
+    m_written += len;
+    return true;
+#else
+    if( m_fd == -1 ) return false;
+    auto data = (const char*)_data;
+    while( len > 0 )
+    {
+        if( !m_map || m_written == m_mapOffset + CaptureMapWindow )
+        {
+            if( !MapWindow() ) return false;
+        }
+        const auto left = m_mapOffset + CaptureMapWindow - m_written;
+        const auto sz = len < left ? len : size_t( left );
+        memcpy( m_map + ( m_written - m_mapOffset ), data, sz );
+        m_written += sz;
+        data += sz;
+        len -= sz;
+    }
+    return true;
+#endif
+}
+
+}
+
+#endif
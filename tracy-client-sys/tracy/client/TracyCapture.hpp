@@ -0,0 +1,71 @@
+#ifndef __TRACYCAPTURE_HPP__
+#define __TRACYCAPTURE_HPP__
+
+#ifdef TRACY_OFFLINE_CAPTURE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_set>
+
+#include "../common/TracyProtocol.hpp"
+
+namespace tracy
+{
+
+// Rotating on-disk sink for the wire stream. Each file holds what a server would exchange with
+// the client over a fresh connection: the handshake shibboleth and protocol version, the
+// handshake status, the welcome message (and on-demand payload), followed by lz4sz_t prefixed
+// frames of a single LZ4 stream.
+class CaptureFile
+{
+public:
+    CaptureFile( const char* path, uint64_t fileSize, uint32_t fileCount );
+    ~CaptureFile();
+
+    bool Open();
+    void Close();
+    bool Write( const void* data, size_t len );
+    bool IsFull() const { return m_written >= m_fileSize; }
+
+    CaptureFile( const CaptureFile& ) = delete;
+    CaptureFile( CaptureFile&& ) = delete;
+    CaptureFile& operator=( const CaptureFile& ) = delete;
+    CaptureFile& operator=( CaptureFile&& ) = delete;
+
+private:
+    void FormatName( char* buf, uint32_t index ) const;
+
+    char* m_path;
+    uint64_t m_fileSize;
+    uint32_t m_fileCount;
+    uint32_t m_index;
+    uint64_t m_written;
+#ifdef _WIN32
+    FILE* m_file;
+#else
+    bool MapWindow();
+
+    int m_fd;
+    char* m_map;
+    uint64_t m_mapOffset;
+#endif
+};
+
+// Stands in for the server's bookkeeping of already requested data, so that the client can
+// answer the same queries a server would issue for the current capture file.
+class CaptureQueries
+{
+public:
+    bool Insert( ServerQuery type, uint64_t ptr ) { return m_seen[type].insert( ptr ).second; }
+    void Clear() { for( auto& v : m_seen ) v.clear(); }
+
+private:
+    std::unordered_set<uint64_t> m_seen[ServerQueryDataTransferPart+1];
+};
+
+}
+
+#endif
+
+#endif
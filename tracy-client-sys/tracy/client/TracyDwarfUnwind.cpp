@@ -0,0 +1,526 @@
+#include "TracyDwarfUnwind.hpp"
+
+#ifdef TRACY_HAS_DWARF_UNWIND
+
+#include <link.h>
+#include <stddef.h>
+#include <string.h>
+#include <asm/perf_regs.h>
+
+extern "C"
+{
+// Provided by the unwinder of the C++ runtime, libgcc_s or libunwind, which finds the frame
+// description entry of a code address in the .eh_frame sections of the loaded modules.
+struct dwarf_eh_bases
+{
+    void* tbase;
+    void* dbase;
+    void* func;
+};
+const void* _Unwind_Find_FDE( void* pc, struct dwarf_eh_bases* bases );
+}
+
+namespace tracy
+{
+
+namespace
+{
+
+#if defined __x86_64__
+constexpr uint64_t DwarfRegFp = 6;
+constexpr uint64_t DwarfRegSp = 7;
+#else
+constexpr uint64_t DwarfRegFp = 29;
+constexpr uint64_t DwarfRegSp = 31;
+constexpr uint64_t DwarfRegLr = 30;
+#endif
+
+constexpr int DwarfMaxRememberedStates = 8;
+
+enum : uint8_t
+{
+    DwarfCfaSp,
+    DwarfCfaFp,
+};
+
+enum : uint8_t
+{
+    DwarfRuleSame,
+    DwarfRuleUndefined,
+    DwarfRuleOffset,
+    DwarfRuleValOffset,
+    DwarfRuleUnsupported,
+};
+
+struct DwarfRule
+{
+    uint8_t kind;
+    int64_t offset;
+};
+
+struct DwarfState
+{
+    uint64_t cfaReg;
+    int64_t cfaOffset;
+    bool cfaExpression;
+    DwarfRule fp;
+    DwarfRule ra;
+};
+
+struct DwarfCie
+{
+    uint64_t codeAlign;
+    int64_t dataAlign;
+    uint64_t raReg;
+    uint8_t fdeEncoding;
+    bool augmented;
+    const uint8_t* insns;
+    const uint8_t* end;
+};
+
+template<typename T>
+T DwarfRead( const uint8_t*& ptr )
+{
+    T val;
+    memcpy( &val, ptr, sizeof( T ) );
+    ptr += sizeof( T );
+    return val;
+}
+
+uint64_t DwarfReadUleb( const uint8_t*& ptr )
+{
+    uint64_t val = 0;
+    int shift = 0;
+    uint8_t b;
+    do
+    {
+        b = *ptr++;
+        if( shift < 64 ) val |= uint64_t( b & 0x7F ) << shift;
+        shift += 7;
+    }
+    while( b & 0x80 );
+    return val;
+}
+
+int64_t DwarfReadSleb( const uint8_t*& ptr )
+{
+    uint64_t val = 0;
+    int shift = 0;
+    uint8_t b;
+    do
+    {
+        b = *ptr++;
+        if( shift < 64 ) val |= uint64_t( b & 0x7F ) << shift;
+        shift += 7;
+    }
+    while( b & 0x80 );
+    if( shift < 64 && ( b & 0x40 ) ) val |= ~uint64_t( 0 ) << shift;
+    return int64_t( val );
+}
+
+// Pointers of the DW_EH_PE_* encodings of the .eh_frame sections.
+bool DwarfReadEncoded( const uint8_t*& ptr, uint8_t encoding, const dwarf_eh_bases& bases, uint64_t& val )
+{
+    if( encoding == 0xFF ) return false;
+    const auto start = ptr;
+    switch( encoding & 0x0F )
+    {
+    case 0x00: val = DwarfRead<uint64_t>( ptr ); break;
+    case 0x01: val = DwarfReadUleb( ptr ); break;
+    case 0x02: val = DwarfRead<uint16_t>( ptr ); break;
+    case 0x03: val = DwarfRead<uint32_t>( ptr ); break;
+    case 0x04: val = DwarfRead<uint64_t>( ptr ); break;
+    case 0x09: val = uint64_t( DwarfReadSleb( ptr ) ); break;
+    case 0x0A: val = uint64_t( int64_t( DwarfRead<int16_t>( ptr ) ) ); break;
+    case 0x0B: val = uint64_t( int64_t( DwarfRead<int32_t>( ptr ) ) ); break;
+    case 0x0C: val = uint64_t( DwarfRead<int64_t>( ptr ) ); break;
+    default: return false;
+    }
+    switch( encoding & 0x70 )
+    {
+    case 0x00: break;
+    case 0x10: val += uint64_t( start ); break;
+    case 0x20: val += uint64_t( bases.tbase ); break;
+    case 0x30: val += uint64_t( bases.dbase ); break;
+    case 0x40: val += uint64_t( bases.func ); break;
+    default: return false;
+    }
+    if( encoding & 0x80 ) memcpy( &val, (const void*)val, sizeof( val ) );
+    return true;
+}
+
+bool DwarfParseCie( const uint8_t* ptr, const dwarf_eh_bases& bases, DwarfCie& cie )
+{
+    const auto length = DwarfRead<uint32_t>( ptr );
+    if( length == 0 || length == 0xFFFFFFFF ) return false;
+    cie.end = ptr + length;
+    if( DwarfRead<uint32_t>( ptr ) != 0 ) return false;
+    const auto version = *ptr++;
+    const auto augmentation = (const char*)ptr;
+    ptr += strlen( augmentation ) + 1;
+    if( augmentation[0] == 'e' && augmentation[1] == 'h' ) ptr += sizeof( uint64_t );
+    cie.codeAlign = DwarfReadUleb( ptr );
+    cie.dataAlign = DwarfReadSleb( ptr );
+    cie.raReg = version == 1 ? *ptr++ : DwarfReadUleb( ptr );
+    cie.fdeEncoding = 0;
+    cie.augmented = augmentation[0] == 'z';
+    if( cie.augmented )
+    {
+        const auto size = DwarfReadUleb( ptr );
+        const auto data = ptr;
+        for( auto aug = augmentation + 1; *aug; aug++ )
+        {
+            if( *aug == 'R' )
+            {
+                cie.fdeEncoding = *ptr++;
+            }
+            else if( *aug == 'L' )
+            {
+                ptr++;
+            }
+            else if( *aug == 'P' )
+            {
+                const auto encoding = *ptr++;
+                uint64_t personality;
+                if( !DwarfReadEncoded( ptr, encoding & 0x7F, bases, personality ) ) return false;
+            }
+            else if( *aug != 'S' && *aug != 'B' && *aug != 'G' )
+            {
+                break;
+            }
+        }
+        ptr = data + size;
+    }
+    else if( augmentation[0] != '\0' )
+    {
+        return false;
+    }
+    cie.insns = ptr;
+    return ptr <= cie.end;
+}
+
+void DwarfSetRule( DwarfState& state, const DwarfCie& cie, uint64_t reg, uint8_t kind, int64_t offset )
+{
+    if( reg == DwarfRegFp ) state.fp = { kind, offset };
+    if( reg == cie.raReg ) state.ra = { kind, offset };
+}
+
+void DwarfRestoreRule( DwarfState& state, const DwarfState& initial, const DwarfCie& cie, uint64_t reg )
+{
+    if( reg == DwarfRegFp ) state.fp = initial.fp;
+    if( reg == cie.raReg ) state.ra = initial.ra;
+}
+
+// Runs the call frame instructions until the row which covers pc has been built. Only the
+// instructions of the initial state of the CIE run without a pc, which is then 0.
+bool DwarfExecute( const uint8_t* ptr, const uint8_t* end, const DwarfCie& cie, const dwarf_eh_bases& bases, uint64_t loc, uint64_t pc, DwarfState& state, const DwarfState& initial )
+{
+    DwarfState remembered[DwarfMaxRememberedStates];
+    int numRemembered = 0;
+    while( ptr < end )
+    {
+        const auto op = *ptr++;
+        const auto high = op & 0xC0;
+        const auto low = uint64_t( op & 0x3F );
+        if( high == 0x40 )
+        {
+            loc += low * cie.codeAlign;
+            if( pc != 0 && loc > pc ) return true;
+            continue;
+        }
+        if( high == 0x80 )
+        {
+            DwarfSetRule( state, cie, low, DwarfRuleOffset, int64_t( DwarfReadUleb( ptr ) ) * cie.dataAlign );
+            continue;
+        }
+        if( high == 0xC0 )
+        {
+            DwarfRestoreRule( state, initial, cie, low );
+            continue;
+        }
+
+        uint64_t advance = 0;
+        switch( op )
+        {
+        case 0x00:      // DW_CFA_nop
+            break;
+        case 0x01:      // DW_CFA_set_loc
+            if( !DwarfReadEncoded( ptr, cie.fdeEncoding, bases, loc ) ) return false;
+            if( pc != 0 && loc > pc ) return true;
+            break;
+        case 0x02:      // DW_CFA_advance_loc1
+            advance = DwarfRead<uint8_t>( ptr );
+            break;
+        case 0x03:      // DW_CFA_advance_loc2
+            advance = DwarfRead<uint16_t>( ptr );
+            break;
+        case 0x04:      // DW_CFA_advance_loc4
+            advance = DwarfRead<uint32_t>( ptr );
+            break;
+        case 0x05:      // DW_CFA_offset_extended
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleOffset, int64_t( DwarfReadUleb( ptr ) ) * cie.dataAlign );
+            break;
+        }
+        case 0x06:      // DW_CFA_restore_extended
+            DwarfRestoreRule( state, initial, cie, DwarfReadUleb( ptr ) );
+            break;
+        case 0x07:      // DW_CFA_undefined
+            DwarfSetRule( state, cie, DwarfReadUleb( ptr ), DwarfRuleUndefined, 0 );
+            break;
+        case 0x08:      // DW_CFA_same_value
+            DwarfSetRule( state, cie, DwarfReadUleb( ptr ), DwarfRuleSame, 0 );
+            break;
+        case 0x09:      // DW_CFA_register
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleUnsupported, 0 );
+            break;
+        }
+        case 0x0A:      // DW_CFA_remember_state
+            if( numRemembered == DwarfMaxRememberedStates ) return false;
+            remembered[numRemembered++] = state;
+            break;
+        case 0x0B:      // DW_CFA_restore_state
+            if( numRemembered == 0 ) return false;
+            state = remembered[--numRemembered];
+            break;
+        case 0x0C:      // DW_CFA_def_cfa
+            state.cfaReg = DwarfReadUleb( ptr );
+            state.cfaOffset = int64_t( DwarfReadUleb( ptr ) );
+            state.cfaExpression = false;
+            break;
+        case 0x0D:      // DW_CFA_def_cfa_register
+            state.cfaReg = DwarfReadUleb( ptr );
+            state.cfaExpression = false;
+            break;
+        case 0x0E:      // DW_CFA_def_cfa_offset
+            state.cfaOffset = int64_t( DwarfReadUleb( ptr ) );
+            break;
+        case 0x0F:      // DW_CFA_def_cfa_expression
+        {
+            const auto size = DwarfReadUleb( ptr );
+            ptr += size;
+            state.cfaExpression = true;
+            break;
+        }
+        case 0x10:      // DW_CFA_expression
+        case 0x16:      // DW_CFA_val_expression
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            const auto size = DwarfReadUleb( ptr );
+            ptr += size;
+            DwarfSetRule( state, cie, reg, DwarfRuleUnsupported, 0 );
+            break;
+        }
+        case 0x11:      // DW_CFA_offset_extended_sf
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleOffset, DwarfReadSleb( ptr ) * cie.dataAlign );
+            break;
+        }
+        case 0x12:      // DW_CFA_def_cfa_sf
+            state.cfaReg = DwarfReadUleb( ptr );
+            state.cfaOffset = DwarfReadSleb( ptr ) * cie.dataAlign;
+            state.cfaExpression = false;
+            break;
+        case 0x13:      // DW_CFA_def_cfa_offset_sf
+            state.cfaOffset = DwarfReadSleb( ptr ) * cie.dataAlign;
+            break;
+        case 0x14:      // DW_CFA_val_offset
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleValOffset, int64_t( DwarfReadUleb( ptr ) ) * cie.dataAlign );
+            break;
+        }
+        case 0x15:      // DW_CFA_val_offset_sf
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleValOffset, DwarfReadSleb( ptr ) * cie.dataAlign );
+            break;
+        }
+        case 0x2D:      // DW_CFA_AARCH64_negate_ra_state, the return addresses are stripped anyway
+            break;
+        case 0x2E:      // DW_CFA_GNU_args_size
+            DwarfReadUleb( ptr );
+            break;
+        case 0x2F:      // DW_CFA_GNU_negative_offset_extended
+        {
+            const auto reg = DwarfReadUleb( ptr );
+            DwarfSetRule( state, cie, reg, DwarfRuleOffset, -int64_t( DwarfReadUleb( ptr ) ) * cie.dataAlign );
+            break;
+        }
+        default:
+            return false;
+        }
+        if( advance != 0 )
+        {
+            loc += advance * cie.codeAlign;
+            if( pc != 0 && loc > pc ) return true;
+        }
+    }
+    return true;
+}
+
+int DwarfModuleCounters( struct dl_phdr_info* info, size_t size, void* data )
+{
+    if( size >= offsetof( struct dl_phdr_info, dlpi_subs ) + sizeof( info->dlpi_subs ) )
+    {
+        auto counters = (uint64_t*)data;
+        counters[0] = info->dlpi_adds;
+        counters[1] = info->dlpi_subs;
+    }
+    return 1;
+}
+
+}
+
+uint64_t DwarfUnwindRegMask()
+{
+#if defined __x86_64__
+    return ( 1ull << PERF_REG_X86_BP ) | ( 1ull << PERF_REG_X86_SP ) | ( 1ull << PERF_REG_X86_IP );
+#else
+    return ( 1ull << PERF_REG_ARM64_X29 ) | ( 1ull << PERF_REG_ARM64_LR ) | ( 1ull << PERF_REG_ARM64_SP ) | ( 1ull << PERF_REG_ARM64_PC );
+#endif
+}
+
+DwarfUnwinder::DwarfUnwinder()
+    : m_adds( 0 )
+    , m_subs( 0 )
+{
+    memset( m_cache, 0, sizeof( m_cache ) );
+}
+
+// The loader passes its counters of loaded and unloaded modules to the first dl_iterate_phdr()
+// callback. Without them, nothing can be told about the modules and the cache isn't kept.
+void DwarfUnwinder::CheckModules()
+{
+    uint64_t counters[2] = { 0, 0 };
+    dl_iterate_phdr( DwarfModuleCounters, counters );
+    if( counters[0] != 0 && counters[0] == m_adds && counters[1] == m_subs ) return;
+    memset( m_cache, 0, sizeof( m_cache ) );
+    m_adds = counters[0];
+    m_subs = counters[1];
+}
+
+const DwarfUnwinder::Row* DwarfUnwinder::Lookup( uint64_t pc )
+{
+    auto& row = m_cache[( pc ^ ( pc >> 12 ) ) & ( CacheSize - 1 )];
+    if( row.pc == pc ) return row.valid ? &row : nullptr;
+    row.pc = pc;
+    row.valid = 0;
+
+    dwarf_eh_bases bases;
+    auto ptr = (const uint8_t*)_Unwind_Find_FDE( (void*)pc, &bases );
+    if( !ptr ) return nullptr;
+
+    const auto length = DwarfRead<uint32_t>( ptr );
+    if( length == 0 || length == 0xFFFFFFFF ) return nullptr;
+    const auto end = ptr + length;
+    const auto ciePtr = ptr - DwarfRead<uint32_t>( ptr );
+    DwarfCie cie;
+    if( !DwarfParseCie( ciePtr, bases, cie ) ) return nullptr;
+
+    uint64_t pcBegin, pcRange;
+    if( !DwarfReadEncoded( ptr, cie.fdeEncoding, bases, pcBegin ) ) return nullptr;
+    if( !DwarfReadEncoded( ptr, cie.fdeEncoding & 0x0F, bases, pcRange ) ) return nullptr;
+    if( pc < pcBegin || pc >= pcBegin + pcRange ) return nullptr;
+    if( cie.augmented )
+    {
+        const auto size = DwarfReadUleb( ptr );
+        ptr += size;
+    }
+
+    DwarfState initial = { DwarfRegSp, 0, false, { DwarfRuleSame, 0 }, { DwarfRuleSame, 0 } };
+    if( !DwarfExecute( cie.insns, cie.end, cie, bases, 0, 0, initial, initial ) ) return nullptr;
+    auto state = initial;
+    if( !DwarfExecute( ptr, end, cie, bases, pcBegin, pc, state, initial ) ) return nullptr;
+
+    if( state.cfaExpression ) return nullptr;
+    if( state.cfaReg == DwarfRegSp ) row.cfaReg = DwarfCfaSp;
+    else if( state.cfaReg == DwarfRegFp ) row.cfaReg = DwarfCfaFp;
+    else return nullptr;
+    row.cfaOffset = state.cfaOffset;
+    row.fpRule = state.fp.kind;
+    row.fpOffset = state.fp.offset;
+    row.raRule = state.ra.kind;
+    row.raOffset = state.ra.offset;
+    row.valid = 1;
+    return &row;
+}
+
+uint32_t DwarfUnwinder::Unwind( const uint64_t* regs, const char* stack, uint64_t stackSize, uint64_t* out, uint32_t max )
+{
+    auto pc = regs[DwarfUnwindRegPc];
+    auto sp = regs[DwarfUnwindRegSp];
+    auto fp = regs[DwarfUnwindRegFp];
+#if defined __aarch64__
+    auto lr = regs[DwarfUnwindRegLr];
+#endif
+    if( pc == 0 || max == 0 ) return 0;
+    CheckModules();
+    const auto stackBegin = sp;
+    const auto stackEnd = sp + stackSize;
+    auto load = [stack, stackBegin, stackEnd]( uint64_t addr, uint64_t& val ) {
+        if( addr < stackBegin || addr + sizeof( uint64_t ) > stackEnd ) return false;
+        memcpy( &val, stack + ( addr - stackBegin ), sizeof( uint64_t ) );
+        return true;
+    };
+
+    uint32_t cnt = 0;
+    out[cnt++] = pc;
+    while( cnt < max )
+    {
+        // A return address is past the call, which may be the last instruction of the function.
+        const auto row = Lookup( cnt == 1 ? pc : pc - 1 );
+        if( !row ) break;
+
+        const auto cfa = ( row->cfaReg == DwarfCfaSp ? sp : fp ) + row->cfaOffset;
+        if( cfa <= sp ) break;
+
+        uint64_t ra;
+        if( row->raRule == DwarfRuleOffset )
+        {
+            if( !load( cfa + row->raOffset, ra ) ) break;
+        }
+#if defined __aarch64__
+        else if( row->raRule == DwarfRuleSame && cnt == 1 )
+        {
+            ra = lr;
+        }
+#endif
+        else
+        {
+            break;
+        }
+
+        if( row->fpRule == DwarfRuleOffset )
+        {
+            if( !load( cfa + row->fpOffset, fp ) ) break;
+        }
+        else if( row->fpRule == DwarfRuleValOffset )
+        {
+            fp = cfa + row->fpOffset;
+        }
+        else if( row->fpRule != DwarfRuleSame )
+        {
+            fp = 0;
+        }
+
+#if defined __aarch64__
+        // Strips the pointer authentication code the return address may be signed with.
+        ra &= 0x0000FFFFFFFFFFFFull;
+#endif
+        if( ra == 0 ) break;
+        sp = cfa;
+        pc = ra;
+        out[cnt++] = ra;
+    }
+    return cnt;
+}
+
+}
+
+#endif
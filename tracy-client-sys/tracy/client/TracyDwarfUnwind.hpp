@@ -0,0 +1,73 @@
+#ifndef __TRACYDWARFUNWIND_HPP__
+#define __TRACYDWARFUNWIND_HPP__
+
+#include "TracySysTrace.hpp"
+
+#if defined TRACY_SAMPLING_STACK_UNWIND && defined TRACY_HAS_SYSTEM_TRACING && defined __linux__ && ( defined __x86_64__ || defined __aarch64__ )
+#  define TRACY_HAS_DWARF_UNWIND
+
+#include <stdint.h>
+
+namespace tracy
+{
+
+// The user space registers the unwinding starts from, in the order perf_event puts them in a
+// sample taken with DwarfUnwindRegMask() as the sample_regs_user.
+#if defined __x86_64__
+enum { DwarfUnwindRegFp, DwarfUnwindRegSp, DwarfUnwindRegPc, DwarfUnwindRegCount };
+#else
+enum { DwarfUnwindRegFp, DwarfUnwindRegLr, DwarfUnwindRegSp, DwarfUnwindRegPc, DwarfUnwindRegCount };
+#endif
+
+uint64_t DwarfUnwindRegMask();
+
+// Unwinds copies of the user stack of threads of this process, taken by perf_event along with
+// the samples, with the call frame information of the .eh_frame sections of the loaded modules,
+// so that neither the program nor its libraries have to keep frame pointers. Only the rules
+// compilers emit for the frame pointer and the return address are followed, and the unwinding
+// stops at the first frame it can't follow, or which would need memory outside of the copy.
+//
+// The rows of the call frame information are cached by return address, as a sampled program goes
+// through the same ones over and over. The cache is flushed whenever the loader counts a module
+// being loaded or unloaded, as the addresses may then belong to other code. An unwinder is meant
+// to be used by a single thread.
+class DwarfUnwinder
+{
+public:
+    DwarfUnwinder();
+
+    DwarfUnwinder( const DwarfUnwinder& ) = delete;
+    DwarfUnwinder& operator=( const DwarfUnwinder& ) = delete;
+
+    // Writes the sampled instruction pointer and then the return addresses to out, and returns
+    // how many of them there are.
+    uint32_t Unwind( const uint64_t* regs, const char* stack, uint64_t stackSize, uint64_t* out, uint32_t max );
+
+private:
+    enum { CacheSize = 4096 };
+
+    struct Row
+    {
+        uint64_t pc;
+        int64_t cfaOffset;
+        int64_t fpOffset;
+        int64_t raOffset;
+        uint8_t cfaReg;
+        uint8_t fpRule;
+        uint8_t raRule;
+        uint8_t valid;
+    };
+
+    const Row* Lookup( uint64_t pc );
+    void CheckModules();
+
+    Row m_cache[CacheSize];
+    uint64_t m_adds;
+    uint64_t m_subs;
+};
+
+}
+
+#endif
+
+#endif
@@ -582,10 +582,171 @@ static tracy_force_inline void ProcessRGB_AVX( const uint8_t* src, char*& dst )
 }
 #endif
 
+#ifdef __AVX512BW__
+// Same as ProcessRGB_AVX, with four blocks in the 128-bit lanes of a 512-bit register.
+static tracy_force_inline void ProcessRGB_AVX512( const uint8_t* src, char*& dst )
+{
+    __m512i px0 = _mm512_loadu_si512(((__m512i*)src) + 0);
+    __m512i px1 = _mm512_loadu_si512(((__m512i*)src) + 1);
+    __m512i px2 = _mm512_loadu_si512(((__m512i*)src) + 2);
+    __m512i px3 = _mm512_loadu_si512(((__m512i*)src) + 3);
+
+    __m512i smask = _mm512_set1_epi32( 0xF8FCF8 );
+    __m512i sd0 = _mm512_and_si512( px0, smask );
+    __m512i sd1 = _mm512_and_si512( px1, smask );
+    __m512i sd2 = _mm512_and_si512( px2, smask );
+    __m512i sd3 = _mm512_and_si512( px3, smask );
+
+    __m512i sc = _mm512_shuffle_epi32( sd0, (_MM_PERM_ENUM)_MM_SHUFFLE( 0, 0, 0, 0 ) );
+
+    __mmask64 sc0 = _mm512_cmpeq_epi8_mask( sd0, sc );
+    __mmask64 sc1 = _mm512_cmpeq_epi8_mask( sd1, sc );
+    __mmask64 sc2 = _mm512_cmpeq_epi8_mask( sd2, sc );
+    __mmask64 sc3 = _mm512_cmpeq_epi8_mask( sd3, sc );
+
+    const uint64_t sm = uint64_t( sc0 & sc1 & sc2 & sc3 );
+
+    const int64_t solid0 = ( sm & 0xFFFF ) != 0xFFFF;
+    const int64_t solid1 = ( ( sm >> 16 ) & 0xFFFF ) != 0xFFFF;
+    const int64_t solid2 = ( ( sm >> 32 ) & 0xFFFF ) != 0xFFFF;
+    const int64_t solid3 = ( sm >> 48 ) != 0xFFFF;
+
+    if( solid0 + solid1 + solid2 + solid3 == 0 )
+    {
+        const auto c0 = uint64_t( to565( src[0], src[1], src[2] ) ) << 16;
+        const auto c1 = uint64_t( to565( src[16], src[17], src[18] ) ) << 16;
+        const auto c2 = uint64_t( to565( src[32], src[33], src[34] ) ) << 16;
+        const auto c3 = uint64_t( to565( src[48], src[49], src[50] ) ) << 16;
+        memcpy( dst, &c0, 8 );
+        memcpy( dst+8, &c1, 8 );
+        memcpy( dst+16, &c2, 8 );
+        memcpy( dst+24, &c3, 8 );
+        dst += 32;
+        return;
+    }
+
+    __m512i amask = _mm512_set1_epi32( 0xFFFFFF );
+    px0 = _mm512_and_si512( px0, amask );
+    px1 = _mm512_and_si512( px1, amask );
+    px2 = _mm512_and_si512( px2, amask );
+    px3 = _mm512_and_si512( px3, amask );
+
+    __m512i min0 = _mm512_min_epu8( px0, px1 );
+    __m512i min1 = _mm512_min_epu8( px2, px3 );
+    __m512i min2 = _mm512_min_epu8( min0, min1 );
+
+    __m512i max0 = _mm512_max_epu8( px0, px1 );
+    __m512i max1 = _mm512_max_epu8( px2, px3 );
+    __m512i max2 = _mm512_max_epu8( max0, max1 );
+
+    __m512i min3 = _mm512_shuffle_epi32( min2, (_MM_PERM_ENUM)_MM_SHUFFLE( 2, 3, 0, 1 ) );
+    __m512i max3 = _mm512_shuffle_epi32( max2, (_MM_PERM_ENUM)_MM_SHUFFLE( 2, 3, 0, 1 ) );
+    __m512i min4 = _mm512_min_epu8( min2, min3 );
+    __m512i max4 = _mm512_max_epu8( max2, max3 );
+
+    __m512i min5 = _mm512_shuffle_epi32( min4, (_MM_PERM_ENUM)_MM_SHUFFLE( 0, 0, 2, 2 ) );
+    __m512i max5 = _mm512_shuffle_epi32( max4, (_MM_PERM_ENUM)_MM_SHUFFLE( 0, 0, 2, 2 ) );
+    __m512i rmin = _mm512_min_epu8( min4, min5 );
+    __m512i rmax = _mm512_max_epu8( max4, max5 );
+
+    __m512i range1 = _mm512_subs_epu8( rmax, rmin );
+    __m512i range2 = _mm512_sad_epu8( rmax, rmin );
+
+    uint16_t vrange0 = DivTable[_mm_cvtsi128_si32( _mm512_castsi512_si128( range2 ) ) >> 1];
+    uint16_t vrange1 = DivTable[_mm_cvtsi128_si32( _mm512_extracti32x4_epi32( range2, 1 ) ) >> 1];
+    uint16_t vrange2 = DivTable[_mm_cvtsi128_si32( _mm512_extracti32x4_epi32( range2, 2 ) ) >> 1];
+    uint16_t vrange3 = DivTable[_mm_cvtsi128_si32( _mm512_extracti32x4_epi32( range2, 3 ) ) >> 1];
+    __m512i range00 = _mm512_castsi128_si512( _mm_set1_epi16( vrange0 ) );
+    __m512i range01 = _mm512_inserti32x4( range00, _mm_set1_epi16( vrange1 ), 1 );
+    __m512i range02 = _mm512_inserti32x4( range01, _mm_set1_epi16( vrange2 ), 2 );
+    __m512i range = _mm512_inserti32x4( range02, _mm_set1_epi16( vrange3 ), 3 );
+
+    __m512i inset1 = _mm512_srli_epi16( range1, 4 );
+    __m512i inset = _mm512_and_si512( inset1, _mm512_set1_epi8( 0xF ) );
+    __m512i min = _mm512_adds_epu8( rmin, inset );
+    __m512i max = _mm512_subs_epu8( rmax, inset );
+
+    __m512i c0 = _mm512_subs_epu8( px0, rmin );
+    __m512i c1 = _mm512_subs_epu8( px1, rmin );
+    __m512i c2 = _mm512_subs_epu8( px2, rmin );
+    __m512i c3 = _mm512_subs_epu8( px3, rmin );
+
+    __m512i is0 = _mm512_maddubs_epi16( c0, _mm512_set1_epi8( 1 ) );
+    __m512i is1 = _mm512_maddubs_epi16( c1, _mm512_set1_epi8( 1 ) );
+    __m512i is2 = _mm512_maddubs_epi16( c2, _mm512_set1_epi8( 1 ) );
+    __m512i is3 = _mm512_maddubs_epi16( c3, _mm512_set1_epi8( 1 ) );
+
+    // There is no 512-bit horizontal add. Pairwise sums packed back to words end up in the same order.
+    __m512i ps0 = _mm512_madd_epi16( is0, _mm512_set1_epi16( 1 ) );
+    __m512i ps1 = _mm512_madd_epi16( is1, _mm512_set1_epi16( 1 ) );
+    __m512i ps2 = _mm512_madd_epi16( is2, _mm512_set1_epi16( 1 ) );
+    __m512i ps3 = _mm512_madd_epi16( is3, _mm512_set1_epi16( 1 ) );
+
+    __m512i s0 = _mm512_packus_epi32( ps0, ps1 );
+    __m512i s1 = _mm512_packus_epi32( ps2, ps3 );
+
+    __m512i m0 = _mm512_mulhi_epu16( s0, range );
+    __m512i m1 = _mm512_mulhi_epu16( s1, range );
+
+    __m512i p0 = _mm512_packus_epi16( m0, m1 );
+
+    __m512i p1 = _mm512_or_si512( _mm512_srai_epi32( p0, 6 ), _mm512_srai_epi32( p0, 12 ) );
+    __m512i p2 = _mm512_or_si512( _mm512_srai_epi32( p0, 18 ), p0 );
+    __m512i p3 = _mm512_or_si512( p1, p2 );
+    __m512i p =_mm512_shuffle_epi8( p3, _mm512_set1_epi32( 0x0C080400 ) );
+
+    __m512i mm0 = _mm512_unpacklo_epi8( _mm512_setzero_si512(), min );
+    __m512i mm1 = _mm512_unpacklo_epi8( _mm512_setzero_si512(), max );
+    __m512i mm2 = _mm512_unpacklo_epi64( mm1, mm0 );
+    __m512i mmr = _mm512_slli_epi64( _mm512_srli_epi64( mm2, 11 ), 11 );
+    __m512i mmg = _mm512_slli_epi64( _mm512_srli_epi64( mm2, 26 ), 5 );
+    __m512i mmb = _mm512_srli_epi64( _mm512_slli_epi64( mm2, 16 ), 59 );
+    __m512i mm3 = _mm512_or_si512( mmr, mmg );
+    __m512i mm4 = _mm512_or_si512( mm3, mmb );
+    __m512i mm5 = _mm512_shuffle_epi8( mm4, _mm512_set1_epi32( 0x09080100 ) );
+
+    __m512i d0 = _mm512_unpacklo_epi32( mm5, p );
+    __m512i d1 = _mm512_permutexvar_epi64( _mm512_set_epi64( 6, 4, 2, 0, 6, 4, 2, 0 ), d0 );
+    __m256i d2 = _mm512_castsi512_si256( d1 );
+
+    __m256i mask = _mm256_set_epi64x( 0xFFFF0000 | -solid3, 0xFFFF0000 | -solid2, 0xFFFF0000 | -solid1, 0xFFFF0000 | -solid0 );
+    __m256i d3 = _mm256_and_si256( d2, mask );
+    _mm256_storeu_si256( (__m256i*)dst, d3 );
+    dst += 32;
+}
+#endif
+
 void CompressImageDxt1( const char* src, char* dst, int w, int h )
 {
     assert( (w % 4) == 0 && (h % 4) == 0 );
 
+#ifdef __AVX512BW__
+    if( w%16 == 0 )
+    {
+        uint32_t buf[16*4];
+        int i = 0;
+
+        auto blocks = w * h / 64;
+        do
+        {
+            auto tmp = (char*)buf;
+            memcpy( tmp,        src,           16*4 );
+            memcpy( tmp + 16*4, src + w * 4,   16*4 );
+            memcpy( tmp + 32*4, src + w * 8,   16*4 );
+            memcpy( tmp + 48*4, src + w * 12,  16*4 );
+            src += 16*4;
+            if( ++i == w/16 )
+            {
+                src += w * 3 * 4;
+                i = 0;
+            }
+
+            ProcessRGB_AVX512( (uint8_t*)buf, dst );
+        }
+        while( --blocks );
+    }
+    else
+#endif
 #ifdef __AVX2__
     if( w%8 == 0 )
     {
@@ -78,6 +78,19 @@ public:
         m_write = m_ptr;
     }
 
+    void truncate( size_t num )
+    {
+        assert( num <= size() );
+        m_write = m_ptr + num;
+    }
+
+    void remove_front( size_t num )
+    {
+        assert( num <= size() );
+        memmove( m_ptr, m_ptr + num, ( size() - num ) * sizeof( T ) );
+        m_write -= num;
+    }
+
     void swap( FastVector& vec )
     {
         const auto ptr1 = m_ptr;
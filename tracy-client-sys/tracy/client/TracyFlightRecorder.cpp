@@ -0,0 +1,579 @@
+#ifndef TRACY_ON_DEMAND
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#include "TracyFlightRecorder.hpp"
+#include "../common/TracyAlign.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyProtocol.hpp"
+#include "../common/TracyQueue.hpp"
+
+namespace tracy
+{
+
+static size_t WireItemSize( const char* ptr )
+{
+    const auto idx = MemRead<uint8_t>( ptr );
+    if( idx >= (uint8_t)QueueType::StringData )
+    {
+        constexpr auto hdr = sizeof( QueueHeader ) + sizeof( QueueStringTransfer );
+        if( idx == (uint8_t)QueueType::FrameImageData || idx == (uint8_t)QueueType::SymbolCode || idx == (uint8_t)QueueType::SourceCode )
+        {
+            return hdr + sizeof( uint32_t ) + MemRead<uint32_t>( ptr + hdr );
+        }
+        return hdr + sizeof( uint16_t ) + MemRead<uint16_t>( ptr + hdr );
+    }
+    if( idx == (uint8_t)QueueType::SingleStringData || idx == (uint8_t)QueueType::SecondStringData )
+    {
+        return sizeof( QueueHeader ) + sizeof( uint16_t ) + MemRead<uint16_t>( ptr + sizeof( QueueHeader ) );
+    }
+    return QueueDataSize[idx];
+}
+
+// Returns the entry with the given key, inserting an empty one if there is none.
+template<class T>
+static T& Lookup( FastVector<T>& vec, uint64_t key )
+{
+    auto it = std::lower_bound( vec.begin(), vec.end(), key, []( const T& v, uint64_t k ) { return v.key < k; } );
+    if( it != vec.end() && it->key == key ) return *it;
+    const auto idx = size_t( it - vec.begin() );
+    vec.push_next();
+    it = vec.begin() + idx;
+    memmove( it + 1, it, ( vec.size() - idx - 1 ) * sizeof( T ) );
+    *it = {};
+    it->key = key;
+    return *it;
+}
+
+template<class T>
+static T* Find( FastVector<T>& vec, uint64_t key )
+{
+    auto it = std::lower_bound( vec.begin(), vec.end(), key, []( const T& v, uint64_t k ) { return v.key < k; } );
+    if( it == vec.end() || it->key != key ) return nullptr;
+    return it;
+}
+
+void FlightRecorder::Append( Blob& blob, const void* data, size_t len )
+{
+    if( blob.size + len > blob.capacity )
+    {
+        blob.capacity = std::max<uint32_t>( blob.capacity * 2, uint32_t( blob.size + len ) );
+        blob.data = (char*)tracy_realloc( blob.data, blob.capacity );
+    }
+    memcpy( blob.data + blob.size, data, len );
+    blob.size += uint32_t( len );
+}
+
+void FlightRecorder::Assign( Blob& blob, const void* data, size_t len )
+{
+    blob.size = 0;
+    Append( blob, data, len );
+}
+
+void FlightRecorder::Free( Blob& blob )
+{
+    tracy_free( blob.data );
+    blob = {};
+}
+
+void FlightRecorder::Erase( FastVector<Keyed>& vec, uint64_t key )
+{
+    auto it = Find( vec, key );
+    if( !it ) return;
+    Free( it->blob );
+    const auto idx = size_t( it - vec.begin() );
+    memmove( it, it + 1, ( vec.size() - idx - 1 ) * sizeof( Keyed ) );
+    vec.truncate( vec.size() - 1 );
+}
+
+FlightRecorder::FlightRecorder( size_t size, uint32_t window )
+    : m_data( (char*)tracy_malloc( size ) )
+    , m_size( size )
+    , m_head( 0 )
+    , m_tail( 0 )
+    , m_segmentStart( NoSegment )
+    , m_skip( false )
+    , m_dropped( false )
+    , m_final {}
+    , m_window( window )
+    , m_segmentTime( std::max<uint32_t>( window / 8, 100 ) )
+    , m_thread( 0 )
+    , m_refThread( 0 )
+    , m_validation( 0 )
+    , m_string {}
+    , m_stringPtr( nullptr )
+    , m_stringLen( 0 )
+    , m_payload {}
+    , m_zones( 16 )
+    , m_frames( 16 )
+    , m_locks( 64 )
+    , m_plots( 64 )
+    , m_params( 16 )
+    , m_static {}
+    , m_prologue {}
+{
+    assert( size % 8 == 0 );
+    assert( size >= 4 * ( TargetFrameSize + sizeof( RecordHeader ) ) );
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    for( auto& v : m_zones )
+    {
+        for( uint32_t i=0; i<v.size; i++ ) Free( v.zones[i].payload );
+        tracy_free( v.zones );
+    }
+    for( auto& v : m_frames ) Free( v.blob );
+    for( auto& v : m_locks ) Free( v.blob );
+    for( auto& v : m_plots ) Free( v.blob );
+    for( auto& v : m_params ) Free( v.blob );
+    Free( m_string );
+    Free( m_payload );
+    Free( m_static );
+    Free( m_prologue );
+    tracy_free( m_data );
+}
+
+FlightRecorder::RecordHeader FlightRecorder::Header( uint64_t pos ) const
+{
+    RecordHeader hdr;
+    memcpy( &hdr, m_data + pos % m_size, sizeof( hdr ) );
+    return hdr;
+}
+
+uint64_t FlightRecorder::Next( uint64_t pos ) const
+{
+    const auto hdr = Header( pos );
+    if( hdr.kind == Wrap ) return pos + m_size - pos % m_size;
+    return pos + RecordSize( hdr.size );
+}
+
+bool FlightRecorder::Write( uint8_t kind, const void* data, size_t len )
+{
+    const auto need = RecordSize( len );
+    const auto offset = m_tail % m_size;
+    const auto pad = offset + need > m_size ? m_size - offset : 0;
+    while( m_size - ( m_tail - m_head ) < pad + need )
+    {
+        if( !DropSegment() ) return false;
+    }
+    if( pad != 0 )
+    {
+        const RecordHeader wrap = { 0, Wrap, {} };
+        memcpy( m_data + offset, &wrap, sizeof( wrap ) );
+        m_tail += pad;
+    }
+    const RecordHeader hdr = { uint32_t( len ), kind, {} };
+    auto dst = m_data + m_tail % m_size;
+    memcpy( dst, &hdr, sizeof( hdr ) );
+    memcpy( dst + sizeof( hdr ), data, len );
+    m_tail += need;
+    return true;
+}
+
+// Drops the oldest segment, unless it is the one currently being recorded.
+bool FlightRecorder::DropSegment()
+{
+    if( m_head == m_tail || m_head == m_segmentStart ) return false;
+    auto pos = Next( m_head );
+    while( pos != m_tail && Header( pos ).kind != Segment ) pos = Next( pos );
+    m_head = pos;
+    m_dropped = true;
+    return true;
+}
+
+// Throws away everything recorded so far. Used after a replay fails, as the frames handed out
+// were already rebased and cannot be replayed again.
+bool FlightRecorder::Discard()
+{
+    m_head = m_tail;
+    m_segmentStart = NoSegment;
+    m_skip = true;
+    m_dropped = true;
+    return false;
+}
+
+bool FlightRecorder::IsSegmentDue() const
+{
+    if( m_segmentStart == NoSegment ) return true;
+    if( m_tail - m_segmentStart >= m_size / 8 ) return true;
+    return std::chrono::steady_clock::now() - m_segmentTimeStart >= m_segmentTime;
+}
+
+void FlightRecorder::BeginSegment( const Refs& refs )
+{
+    const auto now = std::chrono::steady_clock::now();
+    const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>( now.time_since_epoch() ).count();
+    const int64_t windowNs = std::chrono::duration_cast<std::chrono::nanoseconds>( m_window ).count();
+
+    // Keep the newest segment which started before the time window, but nothing older.
+    m_segmentStart = NoSegment;
+    while( m_head != m_tail )
+    {
+        auto pos = Next( m_head );
+        while( pos != m_tail && Header( pos ).kind != Segment ) pos = Next( pos );
+        if( pos == m_tail ) break;
+        int64_t start;
+        memcpy( &start, m_data + pos % m_size + sizeof( RecordHeader ), sizeof( start ) );
+        if( nowNs - start < windowNs ) break;
+        DropSegment();
+    }
+
+    char segment[sizeof( int64_t ) + sizeof( Refs )];
+    memcpy( segment, &nowNs, sizeof( nowNs ) );
+    memcpy( segment + sizeof( nowNs ), &refs, sizeof( refs ) );
+    const auto start = m_tail;
+    if( !Write( Segment, segment, sizeof( segment ) ) )
+    {
+        m_skip = true;
+        return;
+    }
+    m_segmentStart = start;
+    m_segmentTimeStart = now;
+    m_skip = false;
+
+    EmitPrologue( m_static.data, m_static.size );
+    for( auto& v : m_params ) EmitPrologue( v.blob.data, v.blob.size );
+    for( auto& v : m_plots ) EmitPrologue( v.blob.data, v.blob.size );
+    for( auto& v : m_locks ) EmitPrologue( v.blob.data, v.blob.size );
+    for( auto& v : m_frames ) EmitPrologue( v.blob.data, v.blob.size );
+    for( auto& v : m_zones )
+    {
+        if( v.size == 0 ) continue;
+        QueueItem item;
+        MemWrite( &item.hdr.type, QueueType::ThreadContext );
+        MemWrite( &item.threadCtx.thread, uint32_t( v.key ) );
+        EmitPrologue( &item, QueueDataSize[(int)QueueType::ThreadContext] );
+        int64_t ref = 0;
+        for( uint32_t i=0; i<v.size; i++ )
+        {
+            auto& zone = v.zones[i];
+            if( zone.validation != 0 )
+            {
+                MemWrite( &item.hdr.type, QueueType::ZoneValidation );
+                MemWrite( &item.zoneValidation.id, zone.validation );
+                EmitPrologue( &item, QueueDataSize[(int)QueueType::ZoneValidation] );
+            }
+            if( zone.alloc ) EmitPrologue( zone.payload.data, zone.payload.size );
+            const auto type = zone.alloc ? QueueType::ZoneBeginAllocSrcLoc : QueueType::ZoneBegin;
+            MemWrite( &item.hdr.type, type );
+            MemWrite( &item.zoneBegin.time, zone.time - ref );
+            MemWrite( &item.zoneBegin.srcloc, zone.srcloc );
+            EmitPrologue( &item, QueueDataSize[(int)type] );
+            ref = zone.time;
+        }
+    }
+    FlushPrologue();
+}
+
+void FlightRecorder::EmitPrologue( const void* data, size_t len )
+{
+    // Prologue data is a sequence of whole items, which may be split into frames at any item.
+    auto ptr = (const char*)data;
+    const auto end = ptr + len;
+    while( ptr < end )
+    {
+        const auto sz = WireItemSize( ptr );
+        if( m_prologue.size + sz > TargetFrameSize ) FlushPrologue();
+        Append( m_prologue, ptr, sz );
+        ptr += sz;
+    }
+}
+
+void FlightRecorder::FlushPrologue()
+{
+    if( m_prologue.size == 0 ) return;
+    if( !m_skip && !Write( Prologue, m_prologue.data, m_prologue.size ) )
+    {
+        m_head = m_tail;
+        m_segmentStart = NoSegment;
+        m_skip = true;
+        m_dropped = true;
+    }
+    m_prologue.size = 0;
+}
+
+void FlightRecorder::Record( const char* data, size_t len )
+{
+    Track( data, len );
+    if( m_skip ) return;
+    if( !Write( Frame, data, len ) )
+    {
+        // The current segment alone does not fit. Nothing before the next one can be replayed.
+        m_head = m_tail;
+        m_segmentStart = NoSegment;
+        m_skip = true;
+        m_dropped = true;
+    }
+}
+
+// Follows the stream the way a server would decode it, keeping state which has to be recreated
+// if the data establishing it gets dropped.
+void FlightRecorder::Track( const char* ptr, size_t len )
+{
+    const auto end = ptr + len;
+    while( ptr < end )
+    {
+        const auto idx = MemRead<uint8_t>( ptr );
+        const auto sz = WireItemSize( ptr );
+        if( idx == (uint8_t)QueueType::SourceLocationPayload )
+        {
+            Assign( m_payload, ptr, sz );
+            ptr += sz;
+            continue;
+        }
+        if( idx == (uint8_t)QueueType::SingleStringData )
+        {
+            m_stringPtr = ptr;
+            m_stringLen = sz;
+            ptr += sz;
+            continue;
+        }
+        if( idx >= (uint8_t)QueueType::StringData || idx == (uint8_t)QueueType::SecondStringData )
+        {
+            ptr += sz;
+            continue;
+        }
+
+        QueueItem item;
+        memcpy( &item, ptr, sz );
+        switch( (QueueType)idx )
+        {
+        case QueueType::ThreadContext:
+            m_thread = MemRead<uint32_t>( &item.threadCtx.thread );
+            m_refThread = 0;
+            m_validation = 0;
+            break;
+        case QueueType::ZoneValidation:
+            m_validation = MemRead<uint32_t>( &item.zoneValidation.id );
+            break;
+        case QueueType::ZoneBegin:
+        case QueueType::ZoneBeginCallstack:
+        case QueueType::ZoneBeginAllocSrcLoc:
+        case QueueType::ZoneBeginAllocSrcLocCallstack:
+        {
+            m_refThread += MemRead<int64_t>( &item.zoneBegin.time );
+            const bool alloc = idx == (uint8_t)QueueType::ZoneBeginAllocSrcLoc || idx == (uint8_t)QueueType::ZoneBeginAllocSrcLocCallstack;
+            auto& stack = Lookup( m_zones, m_thread );
+            if( stack.size == stack.capacity )
+            {
+                stack.capacity = std::max<uint32_t>( stack.capacity * 2, 16 );
+                stack.zones = (OpenZone*)tracy_realloc( stack.zones, stack.capacity * sizeof( OpenZone ) );
+            }
+            auto& zone = stack.zones[stack.size++];
+            zone.time = m_refThread;
+            zone.validation = m_validation;
+            zone.alloc = alloc;
+            zone.srcloc = MemRead<uint64_t>( &item.zoneBegin.srcloc );
+            zone.payload = {};
+            if( alloc )
+            {
+                zone.payload = m_payload;
+                m_payload = {};
+            }
+            m_validation = 0;
+            break;
+        }
+        case QueueType::ZoneEnd:
+        {
+            m_refThread += MemRead<int64_t>( &item.zoneEnd.time );
+            auto stack = Find( m_zones, m_thread );
+            if( stack && stack->size != 0 ) Free( stack->zones[--stack->size].payload );
+            m_validation = 0;
+            break;
+        }
+        case QueueType::GpuZoneBegin:
+        case QueueType::GpuZoneBeginCallstack:
+        case QueueType::GpuZoneBeginAllocSrcLoc:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstack:
+            m_refThread += MemRead<int64_t>( &item.gpuZoneBegin.cpuTime );
+            break;
+        case QueueType::GpuZoneEnd:
+            m_refThread += MemRead<int64_t>( &item.gpuZoneEnd.cpuTime );
+            break;
+        case QueueType::PlotDataInt:
+        case QueueType::PlotDataFloat:
+        case QueueType::PlotDataDouble:
+            m_refThread += MemRead<int64_t>( &item.plotDataInt.time );
+            break;
+#ifdef TRACY_FIBERS
+        case QueueType::FiberEnter:
+            m_refThread += MemRead<int64_t>( &item.fiberEnter.time );
+            break;
+        case QueueType::FiberLeave:
+            m_refThread += MemRead<int64_t>( &item.fiberLeave.time );
+            break;
+#endif
+        case QueueType::FrameMarkMsgStart:
+        {
+            auto& frame = Lookup( m_frames, MemRead<uint64_t>( &item.frameMark.name ) );
+            Assign( frame.blob, ptr, sz );
+            break;
+        }
+        case QueueType::FrameMarkMsgEnd:
+            Erase( m_frames, MemRead<uint64_t>( &item.frameMark.name ) );
+            break;
+        case QueueType::LockAnnounce:
+        {
+            auto& lock = Lookup( m_locks, MemRead<uint32_t>( &item.lockAnnounce.id ) );
+            Assign( lock.blob, ptr, sz );
+            break;
+        }
+        case QueueType::LockName:
+        {
+            auto& lock = Lookup( m_locks, MemRead<uint32_t>( &item.lockName.id ) );
+            if( m_stringPtr ) Append( lock.blob, m_stringPtr, m_stringLen );
+            Append( lock.blob, ptr, sz );
+            break;
+        }
+        case QueueType::LockTerminate:
+            Erase( m_locks, MemRead<uint32_t>( &item.lockTerminate.id ) );
+            break;
+        case QueueType::PlotConfig:
+        {
+            auto& plot = Lookup( m_plots, MemRead<uint64_t>( &item.plotConfig.name ) );
+            Assign( plot.blob, ptr, sz );
+            break;
+        }
+        case QueueType::ParamSetup:
+        {
+            auto& param = Lookup( m_params, MemRead<uint32_t>( &item.paramSetup.idx ) );
+            Assign( param.blob, ptr, sz );
+            break;
+        }
+        case QueueType::MessageAppInfo:
+        case QueueType::GpuContextName:
+        case QueueType::GpuAnnotationName:
+            if( m_stringPtr ) Append( m_static, m_stringPtr, m_stringLen );
+            Append( m_static, ptr, sz );
+            break;
+        case QueueType::GpuNewContext:
+        case QueueType::CpuTopology:
+            Append( m_static, ptr, sz );
+            break;
+        default:
+            break;
+        }
+        m_stringPtr = nullptr;
+        ptr += sz;
+    }
+
+    // A string may precede its item in the next frame.
+    if( m_stringPtr && m_stringPtr != m_string.data )
+    {
+        Assign( m_string, m_stringPtr, m_stringLen );
+        m_stringPtr = m_string.data;
+    }
+}
+
+// Delta times of serial, context switch and GPU items were computed against references which a
+// server starting at the oldest retained segment does not have. Add them to the first item of
+// each kind. Returns the kinds which were not found yet.
+uint8_t FlightRecorder::Rebase( char* ptr, size_t len, const Refs& refs, uint8_t pending ) const
+{
+    const auto end = ptr + len;
+    while( ptr < end && pending != 0 )
+    {
+        const auto idx = MemRead<uint8_t>( ptr );
+        const auto sz = WireItemSize( ptr );
+        if( idx >= (uint8_t)QueueType::StringData || idx == (uint8_t)QueueType::SingleStringData || idx == (uint8_t)QueueType::SecondStringData )
+        {
+            ptr += sz;
+            continue;
+        }
+
+        QueueItem item;
+        memcpy( &item, ptr, sz );
+        int64_t* time = nullptr;
+        int64_t ref = 0;
+        uint8_t kind = 0;
+        switch( (QueueType)idx )
+        {
+        case QueueType::LockWait:
+        case QueueType::LockSharedWait:
+            time = &item.lockWait.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::LockObtain:
+        case QueueType::LockSharedObtain:
+            time = &item.lockObtain.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::LockRelease:
+        case QueueType::LockSharedRelease:
+            time = &item.lockRelease.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::MemAlloc:
+        case QueueType::MemAllocNamed:
+        case QueueType::MemAllocCallstack:
+        case QueueType::MemAllocCallstackNamed:
+            time = &item.memAlloc.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::MemFree:
+        case QueueType::MemFreeNamed:
+        case QueueType::MemFreeCallstack:
+        case QueueType::MemFreeCallstackNamed:
+            time = &item.memFree.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::MemDiscard:
+        case QueueType::MemDiscardCallstack:
+            time = &item.memDiscard.time;
+            kind = RefsSerial;
+            break;
+        case QueueType::GpuZoneBeginSerial:
+        case QueueType::GpuZoneBeginCallstackSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
+            time = &item.gpuZoneBegin.cpuTime;
+            kind = RefsSerial;
+            break;
+        case QueueType::GpuZoneEndSerial:
+            time = &item.gpuZoneEnd.cpuTime;
+            kind = RefsSerial;
+            break;
+        case QueueType::ContextSwitch:
+            time = &item.contextSwitch.time;
+            kind = RefsCtx;
+            break;
+        case QueueType::ThreadWakeup:
+            time = &item.threadWakeup.time;
+            kind = RefsCtx;
+            break;
+        case QueueType::CallstackSample:
+        case QueueType::CallstackSampleContextSwitch:
+            time = &item.callstackSample.time;
+            kind = RefsCtx;
+            break;
+        case QueueType::GpuTime:
+            time = &item.gpuTime.gpuTime;
+            kind = RefsGpu;
+            break;
+        default:
+            break;
+        }
+        if( kind & pending )
+        {
+            switch( kind )
+            {
+            case RefsSerial: ref = refs.serial; break;
+            case RefsCtx: ref = refs.ctx; break;
+            case RefsGpu: ref = refs.gpu; break;
+            default: assert( false ); break;
+            }
+            MemWrite( time, MemRead<int64_t>( time ) + ref );
+            memcpy( ptr, &item, sz );
+            pending &= ~kind;
+        }
+        ptr += sz;
+    }
+    return pending;
+}
+
+}
+
+#endif
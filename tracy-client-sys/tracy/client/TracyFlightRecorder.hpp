@@ -0,0 +1,185 @@
+#ifndef __TRACYFLIGHTRECORDER_HPP__
+#define __TRACYFLIGHTRECORDER_HPP__
+
+#ifndef TRACY_ON_DEMAND
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TracyFastVector.hpp"
+
+namespace tracy
+{
+
+// Keeps the most recent part of the serialized stream while no server is connected, so that a
+// server connecting later receives the last seconds of data instead of everything since startup.
+//
+// Data is kept in segments, which start at points where the profiler has no partially written
+// frame. Only whole segments are dropped. Each segment is stored along with the delta time
+// references in effect at its start, and with a prologue which recreates what was established
+// by earlier data: lock and GPU context announcements, plot configuration, application info,
+// zones and discontinuous frames which are still open.
+class FlightRecorder
+{
+public:
+    struct Refs
+    {
+        int64_t serial;
+        int64_t ctx;
+        int64_t gpu;
+    };
+
+    FlightRecorder( size_t size, uint32_t window );
+    ~FlightRecorder();
+
+    bool IsSegmentDue() const;
+    void BeginSegment( const Refs& refs );
+    void Record( const char* data, size_t len );
+
+    // References in effect after the last recorded frame.
+    void Finish( const Refs& refs ) { m_final = refs; }
+    const Refs& FinalRefs() const { return m_final; }
+
+    bool IsEmpty() const { return m_head == m_tail; }
+    bool HasDropped() const { return m_dropped; }
+
+    // Hands out the retained frames, oldest first. Frames are modified in place, so this can only
+    // be done once, and the recording is discarded if the callback fails part way through.
+    // Callback must be bool( const char* data, size_t len ).
+    template<class Callable>
+    bool Replay( Callable&& callback )
+    {
+        // Only the prologue of the oldest segment is needed. Later segments follow on from it.
+        uint32_t segment = 0;
+        Refs refs = {};
+        uint8_t pending = RefsAll;
+        auto pos = m_head;
+        while( pos != m_tail )
+        {
+            const auto hdr = Header( pos );
+            auto data = m_data + ( pos % m_size ) + sizeof( RecordHeader );
+            switch( hdr.kind )
+            {
+            case Segment:
+                if( segment++ == 0 ) memcpy( &refs, data + sizeof( int64_t ), sizeof( refs ) );
+                break;
+            case Prologue:
+                if( segment == 1 && !callback( (const char*)data, hdr.size ) ) return Discard();
+                break;
+            case Frame:
+                if( pending != 0 ) pending = Rebase( data, hdr.size, refs, pending );
+                if( !callback( (const char*)data, hdr.size ) ) return Discard();
+                break;
+            default:
+                break;
+            }
+            pos = Next( pos );
+        }
+        m_head = m_tail;
+        m_segmentStart = NoSegment;
+        return true;
+    }
+
+    FlightRecorder( const FlightRecorder& ) = delete;
+    FlightRecorder( FlightRecorder&& ) = delete;
+    FlightRecorder& operator=( const FlightRecorder& ) = delete;
+    FlightRecorder& operator=( FlightRecorder&& ) = delete;
+
+private:
+    enum : uint8_t { Segment, Prologue, Frame, Wrap };
+    enum : uint8_t { RefsSerial = 1, RefsCtx = 2, RefsGpu = 4, RefsAll = 7 };
+    static constexpr uint64_t NoSegment = ~uint64_t( 0 );
+
+    struct RecordHeader
+    {
+        uint32_t size;
+        uint8_t kind;
+        uint8_t padding[3];
+    };
+
+    // Heap copy of a run of wire items. Plain data, so that it can be kept in a FastVector.
+    struct Blob
+    {
+        char* data;
+        uint32_t size;
+        uint32_t capacity;
+    };
+
+    struct Keyed
+    {
+        uint64_t key;
+        Blob blob;
+    };
+
+    struct OpenZone
+    {
+        int64_t time;
+        uint32_t validation;
+        bool alloc;
+        uint64_t srcloc;
+        Blob payload;
+    };
+
+    struct ThreadZones
+    {
+        uint64_t key;
+        OpenZone* zones;
+        uint32_t size;
+        uint32_t capacity;
+    };
+
+    static void Append( Blob& blob, const void* data, size_t len );
+    static void Assign( Blob& blob, const void* data, size_t len );
+    static void Free( Blob& blob );
+    static void Erase( FastVector<Keyed>& vec, uint64_t key );
+
+    static uint64_t RecordSize( size_t len ) { return ( sizeof( RecordHeader ) + len + 7 ) & ~uint64_t( 7 ); }
+    RecordHeader Header( uint64_t pos ) const;
+    uint64_t Next( uint64_t pos ) const;
+    bool Write( uint8_t kind, const void* data, size_t len );
+    bool DropSegment();
+    bool Discard();
+    uint8_t Rebase( char* data, size_t len, const Refs& refs, uint8_t pending ) const;
+
+    void Track( const char* data, size_t len );
+    void EmitPrologue( const void* data, size_t len );
+    void FlushPrologue();
+
+    char* m_data;
+    uint64_t m_size;
+    uint64_t m_head;
+    uint64_t m_tail;
+    uint64_t m_segmentStart;
+    bool m_skip;
+    bool m_dropped;
+    Refs m_final;
+    std::chrono::milliseconds m_window;
+    std::chrono::milliseconds m_segmentTime;
+    std::chrono::steady_clock::time_point m_segmentTimeStart;
+
+    // State of the recorded stream, as a server decoding it would see it.
+    uint32_t m_thread;
+    int64_t m_refThread;
+    uint32_t m_validation;
+    Blob m_string;
+    const char* m_stringPtr;
+    size_t m_stringLen;
+    Blob m_payload;
+
+    // Sorted by key.
+    FastVector<ThreadZones> m_zones;
+    FastVector<Keyed> m_frames;
+    FastVector<Keyed> m_locks;
+    FastVector<Keyed> m_plots;
+    FastVector<Keyed> m_params;
+    Blob m_static;
+    Blob m_prologue;
+};
+
+}
+
+#endif
+
+#endif
@@ -19,6 +19,13 @@ public:
 #ifdef TRACY_ON_DEMAND
         , m_lockCount( 0 )
         , m_active( false )
+#endif
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        , m_srcloc( srcloc )
+        , m_plotName( nullptr )
+        , m_uncontended( 0 )
+        , m_uncontendedReported( 0 )
+        , m_contended( false )
 #endif
     {
         assert( m_id != (std::numeric_limits<uint32_t>::max)() );
@@ -40,6 +47,9 @@ public:
 
     tracy_force_inline ~LockableCtx()
     {
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        if( m_uncontended != m_uncontendedReported ) ReportUncontended();
+#endif
         auto item = Profiler::QueueSerial();
         MemWrite( &item->hdr.type, QueueType::LockTerminate );
         MemWrite( &item->lockTerminate.id, m_id );
@@ -131,8 +141,29 @@ public:
         }
     }
 
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+    // The following are called with the lock held. Acquisitions which didn't have to wait are only
+    // counted, and the count is reported as a plot when the lock is next contended.
+    tracy_force_inline void AfterUncontendedLock()
+    {
+        m_uncontended++;
+        m_contended = false;
+    }
+
+    tracy_force_inline void AfterContendedLock()
+    {
+        m_contended = true;
+        if( m_uncontended != m_uncontendedReported ) ReportUncontended();
+    }
+
+    tracy_force_inline bool IsContended() const { return m_contended; }
+#endif
+
     tracy_force_inline void Mark( const SourceLocationData* srcloc )
     {
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        if( !m_contended ) return;
+#endif
 #ifdef TRACY_ON_DEMAND
         const auto active = m_active.load( std::memory_order_relaxed );
         if( !active ) return;
@@ -169,12 +200,37 @@ public:
     }
 
 private:
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+    tracy_no_inline void ReportUncontended()
+    {
+        if( !m_plotName )
+        {
+            // Not freed with the lock, as the name may still be queried by the server.
+            const auto name = m_srcloc->function;
+            const auto sz = strlen( name );
+            m_plotName = (char*)tracy_malloc( sz + 13 );
+            memcpy( m_plotName, name, sz );
+            memcpy( m_plotName + sz, " uncontended", 13 );
+        }
+        Profiler::PlotData( m_plotName, int64_t( m_uncontended ) );
+        m_uncontendedReported = m_uncontended;
+    }
+#endif
+
     uint32_t m_id;
 
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint32_t> m_lockCount;
     std::atomic<bool> m_active;
 #endif
+
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+    const SourceLocationData* m_srcloc;
+    char* m_plotName;
+    uint64_t m_uncontended;
+    uint64_t m_uncontendedReported;
+    bool m_contended;
+#endif
 };
 
 template<class T>
@@ -191,21 +247,41 @@ public:
 
     tracy_force_inline void lock()
     {
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        if( m_lockable.try_lock() )
+        {
+            m_ctx.AfterUncontendedLock();
+            return;
+        }
+#endif
         const auto runAfter = m_ctx.BeforeLock();
         m_lockable.lock();
         if( runAfter ) m_ctx.AfterLock();
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        m_ctx.AfterContendedLock();
+#endif
     }
 
     tracy_force_inline void unlock()
     {
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        const auto contended = m_ctx.IsContended();
+        m_lockable.unlock();
+        if( contended ) m_ctx.AfterUnlock();
+#else
         m_lockable.unlock();
         m_ctx.AfterUnlock();
+#endif
     }
 
     tracy_force_inline bool try_lock()
     {
         const auto acquired = m_lockable.try_lock();
+#ifdef TRACY_LOCK_CONTENTION_ONLY
+        if( acquired ) m_ctx.AfterUncontendedLock();
+#else
         m_ctx.AfterTryLock( acquired );
+#endif
         return acquired;
     }
 
@@ -234,9 +310,20 @@ public:
 #ifdef TRACY_ON_DEMAND
         , m_lockCount( 0 )
         , m_active( false )
+#endif
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        , m_srcloc( srcloc )
+        , m_readers( 0 )
+        , m_readersPeak( 0 )
+        , m_waitMax( 0 )
+        , m_reportNext( Profiler::GetTime() + SharedReportInterval )
 #endif
     {
         assert( m_id != (std::numeric_limits<uint32_t>::max)() );
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        for( auto& v : m_plotNames ) v = nullptr;
+        for( auto& v : m_wait ) v.store( 0, std::memory_order_relaxed );
+#endif
 
         auto item = Profiler::QueueSerial();
         MemWrite( &item->hdr.type, QueueType::LockAnnounce );
@@ -255,6 +342,9 @@ public:
 
     tracy_force_inline ~SharedLockableCtx()
     {
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        ReportShared( Profiler::GetTime() );
+#endif
         auto item = Profiler::QueueSerial();
         MemWrite( &item->hdr.type, QueueType::LockTerminate );
         MemWrite( &item->lockTerminate.id, m_id );
@@ -428,6 +518,27 @@ public:
         }
     }
 
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+    // Readers don't queue any events. The concurrent readers and the time readers waited for the
+    // lock are counted, and reported as plots every SharedReportInterval by the reader which first
+    // notices the interval has passed.
+    tracy_force_inline void AfterLockSharedAggregated( int64_t start )
+    {
+        const auto time = Profiler::GetTime();
+        CountShared( time, time - start );
+    }
+
+    tracy_force_inline void AfterTryLockSharedAggregated()
+    {
+        CountShared( Profiler::GetTime(), 0 );
+    }
+
+    tracy_force_inline void AfterUnlockSharedAggregated()
+    {
+        m_readers.fetch_sub( 1, std::memory_order_relaxed );
+    }
+#endif
+
     tracy_force_inline void Mark( const SourceLocationData* srcloc )
     {
 #ifdef TRACY_ON_DEMAND
@@ -466,12 +577,110 @@ public:
     }
 
 private:
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+    // Wait times are counted in power of two buckets of nanoseconds, the first bucket holding the
+    // readers which didn't wait at all.
+    static constexpr int SharedWaitBuckets = 32;
+    static constexpr int64_t SharedReportInterval = 100 * 1000 * 1000;  // 100 ms, in ns
+    static constexpr int SharedPlots = 5;
+
+    static tracy_force_inline int SharedWaitBucket( int64_t wait )
+    {
+        if( wait <= 0 ) return 0;
+#if defined __GNUC__ || defined __clang__
+        const int bucket = 64 - __builtin_clzll( uint64_t( wait ) );
+#else
+        int bucket = 0;
+        for( auto v = uint64_t( wait ); v != 0; v >>= 1 ) bucket++;
+#endif
+        return bucket < SharedWaitBuckets ? bucket : SharedWaitBuckets - 1;
+    }
+
+    tracy_force_inline void CountShared( int64_t time, int64_t wait )
+    {
+        const auto readers = m_readers.fetch_add( 1, std::memory_order_relaxed ) + 1;
+        auto peak = m_readersPeak.load( std::memory_order_relaxed );
+        while( readers > peak && !m_readersPeak.compare_exchange_weak( peak, readers, std::memory_order_relaxed ) ) {}
+        auto waitMax = m_waitMax.load( std::memory_order_relaxed );
+        while( wait > waitMax && !m_waitMax.compare_exchange_weak( waitMax, wait, std::memory_order_relaxed ) ) {}
+        m_wait[SharedWaitBucket( wait )].fetch_add( 1, std::memory_order_relaxed );
+
+        auto next = m_reportNext.load( std::memory_order_relaxed );
+        if( time >= next && m_reportNext.compare_exchange_strong( next, (std::numeric_limits<int64_t>::max)(), std::memory_order_acquire, std::memory_order_relaxed ) )
+        {
+            ReportShared( time );
+        }
+    }
+
+    // Called by a single thread at a time, the one which took the report time over.
+    tracy_no_inline void ReportShared( int64_t time )
+    {
+        uint64_t wait[SharedWaitBuckets];
+        uint64_t total = 0;
+        for( int i=0; i<SharedWaitBuckets; i++ )
+        {
+            wait[i] = m_wait[i].exchange( 0, std::memory_order_relaxed );
+            total += wait[i];
+        }
+        const auto peak = m_readersPeak.exchange( m_readers.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        const auto waitMax = m_waitMax.exchange( 0, std::memory_order_relaxed );
+
+        if( total != 0 || peak != 0 )
+        {
+            if( !m_plotNames[0] )
+            {
+                // Not freed with the lock, as the names may still be queried by the server.
+                static const char* suffix[SharedPlots] = { " readers", " shared locks", " shared wait p50", " shared wait p99", " shared wait max" };
+                const auto name = m_srcloc->function;
+                const auto sz = strlen( name );
+                for( int i=0; i<SharedPlots; i++ )
+                {
+                    const auto ssz = strlen( suffix[i] ) + 1;
+                    m_plotNames[i] = (char*)tracy_malloc( sz + ssz );
+                    memcpy( m_plotNames[i], name, sz );
+                    memcpy( m_plotNames[i] + sz, suffix[i], ssz );
+                }
+            }
+            Profiler::PlotData( m_plotNames[0], int64_t( peak ) );
+            Profiler::PlotData( m_plotNames[1], int64_t( total ) );
+            if( total != 0 )
+            {
+                // Percentiles are the upper bounds of their buckets.
+                int64_t percentile[2] = { 0, 0 };
+                const uint64_t target[2] = { ( total + 1 ) / 2, total - total / 100 };
+                uint64_t seen = 0;
+                int p = 0;
+                for( int i=0; i<SharedWaitBuckets && p<2; i++ )
+                {
+                    seen += wait[i];
+                    while( p<2 && seen >= target[p] ) percentile[p++] = i == 0 ? 0 : int64_t( uint64_t( 1 ) << i );
+                }
+                Profiler::PlotData( m_plotNames[2], percentile[0] );
+                Profiler::PlotData( m_plotNames[3], percentile[1] );
+                Profiler::PlotData( m_plotNames[4], waitMax );
+            }
+        }
+
+        m_reportNext.store( time + SharedReportInterval, std::memory_order_release );
+    }
+#endif
+
     uint32_t m_id;
 
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint32_t> m_lockCount;
     std::atomic<bool> m_active;
 #endif
+
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+    const SourceLocationData* m_srcloc;
+    char* m_plotNames[SharedPlots];
+    std::atomic<uint32_t> m_readers;
+    std::atomic<uint32_t> m_readersPeak;
+    std::atomic<int64_t> m_waitMax;
+    std::atomic<uint64_t> m_wait[SharedWaitBuckets];
+    std::atomic<int64_t> m_reportNext;
+#endif
 };
 
 template<class T>
@@ -508,21 +717,40 @@ public:
 
     tracy_force_inline void lock_shared()
     {
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        if( m_lockable.try_lock_shared() )
+        {
+            m_ctx.AfterTryLockSharedAggregated();
+            return;
+        }
+        const auto start = Profiler::GetTime();
+        m_lockable.lock_shared();
+        m_ctx.AfterLockSharedAggregated( start );
+#else
         const auto runAfter = m_ctx.BeforeLockShared();
         m_lockable.lock_shared();
         if( runAfter ) m_ctx.AfterLockShared();
+#endif
     }
 
     tracy_force_inline void unlock_shared()
     {
         m_lockable.unlock_shared();
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        m_ctx.AfterUnlockSharedAggregated();
+#else
         m_ctx.AfterUnlockShared();
+#endif
     }
 
     tracy_force_inline bool try_lock_shared()
     {
         const auto acquired = m_lockable.try_lock_shared();
+#ifdef TRACY_LOCK_SHARED_AGGREGATION
+        if( acquired ) m_ctx.AfterTryLockSharedAggregated();
+#else
         m_ctx.AfterTryLockShared( acquired );
+#endif
         return acquired;
     }
 
@@ -0,0 +1,215 @@
+#ifdef TRACY_MEMORY_AGGREGATION
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#include "TracyMemAggregate.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+// Pool 0 is the unnamed pool and the last pool takes everything which doesn't fit.
+constexpr uint32_t MemAggregateOverflow = MemAggregatePools - 1;
+
+struct MemAggregateCounters
+{
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> frees;
+};
+
+// Counters of one thread. Blocks are never freed, a block left by an exited thread is taken over
+// by the next new thread. The counters only ever grow, the profiler thread works with the deltas.
+struct MemAggregateBlock
+{
+    MemAggregateCounters pools[MemAggregatePools];
+    std::atomic<bool> used;
+    MemAggregateBlock* next;
+};
+
+struct MemAggregateHolder
+{
+    MemAggregateBlock* block;
+    ~MemAggregateHolder() { if( block ) block->used.store( false, std::memory_order_release ); }
+};
+
+std::atomic<MemAggregateBlock*> s_blocks { nullptr };
+std::atomic<const char*> s_poolNames[MemAggregatePools];
+std::atomic<uint32_t> s_poolCount { 1 };
+std::atomic<uint64_t> s_discards[MemAggregatePools];
+TracyMutex s_poolLock;
+
+thread_local MemAggregateHolder s_holder;
+thread_local const char* s_lastName = nullptr;
+thread_local uint32_t s_lastPool = 0;
+
+MemAggregateBlock* AcquireBlock()
+{
+    auto block = s_blocks.load( std::memory_order_acquire );
+    while( block )
+    {
+        bool expected = false;
+        if( !block->used.load( std::memory_order_relaxed ) && block->used.compare_exchange_strong( expected, true, std::memory_order_acquire ) ) return block;
+        block = block->next;
+    }
+
+    block = (MemAggregateBlock*)tracy_malloc( sizeof( MemAggregateBlock ) );
+    new(block) MemAggregateBlock();
+    block->used.store( true, std::memory_order_relaxed );
+    block->next = s_blocks.load( std::memory_order_relaxed );
+    while( !s_blocks.compare_exchange_weak( block->next, block, std::memory_order_release, std::memory_order_relaxed ) ) {}
+    return block;
+}
+
+tracy_force_inline MemAggregateCounters& GetCounters( uint32_t pool )
+{
+    auto block = s_holder.block;
+    if( !block )
+    {
+        block = AcquireBlock();
+        s_holder.block = block;
+    }
+    return block->pools[pool];
+}
+
+uint32_t FindPool( const char* name )
+{
+    const auto count = s_poolCount.load( std::memory_order_acquire );
+    for( uint32_t i=1; i<count; i++ )
+    {
+        if( s_poolNames[i].load( std::memory_order_relaxed ) == name ) return i;
+    }
+
+    std::lock_guard<TracyMutex> lock( s_poolLock );
+    const auto current = s_poolCount.load( std::memory_order_relaxed );
+    for( uint32_t i=count; i<current; i++ )
+    {
+        if( s_poolNames[i].load( std::memory_order_relaxed ) == name ) return i;
+    }
+    if( current == MemAggregateOverflow ) return MemAggregateOverflow;
+    s_poolNames[current].store( name, std::memory_order_relaxed );
+    s_poolCount.store( current + 1, std::memory_order_release );
+    return current;
+}
+
+tracy_force_inline uint32_t GetPool( const char* name )
+{
+    if( !name ) return 0;
+    if( name == s_lastName ) return s_lastPool;
+    const auto pool = FindPool( name );
+    s_lastName = name;
+    s_lastPool = pool;
+    return pool;
+}
+
+}
+
+TRACY_API void MemAggregateAlloc( const char* name, size_t size )
+{
+    auto& counters = GetCounters( GetPool( name ) );
+    counters.allocs.fetch_add( 1, std::memory_order_relaxed );
+    counters.bytes.fetch_add( size, std::memory_order_relaxed );
+}
+
+TRACY_API void MemAggregateFree( const char* name )
+{
+    GetCounters( GetPool( name ) ).frees.fetch_add( 1, std::memory_order_relaxed );
+}
+
+TRACY_API void MemAggregateDiscard( const char* name )
+{
+    s_discards[GetPool( name )].fetch_add( 1, std::memory_order_relaxed );
+}
+
+MemAggregate::MemAggregate()
+    : m_lastTime( 0 )
+{
+    memset( m_pools, 0, sizeof( m_pools ) );
+}
+
+MemAggregate::~MemAggregate()
+{
+    for( auto& pool : m_pools )
+    {
+        if( pool.plotAllocs )
+        {
+            tracy_free( pool.plotAllocs );
+            tracy_free( pool.plotBytes );
+            tracy_free( pool.plotLive );
+        }
+    }
+}
+
+void MemAggregate::Tick()
+{
+    auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    if( t - m_lastTime <= 100000000 ) return;   // 100 ms
+    m_lastTime = t;
+
+    uint64_t allocs[MemAggregatePools] = {};
+    uint64_t bytes[MemAggregatePools] = {};
+    uint64_t frees[MemAggregatePools] = {};
+    for( auto block = s_blocks.load( std::memory_order_acquire ); block; block = block->next )
+    {
+        for( uint32_t i=0; i<MemAggregatePools; i++ )
+        {
+            allocs[i] += block->pools[i].allocs.load( std::memory_order_relaxed );
+            bytes[i] += block->pools[i].bytes.load( std::memory_order_relaxed );
+            frees[i] += block->pools[i].frees.load( std::memory_order_relaxed );
+        }
+    }
+
+    const auto count = s_poolCount.load( std::memory_order_acquire );
+    for( uint32_t i=0; i<MemAggregatePools; i++ )
+    {
+        if( i >= count && i != MemAggregateOverflow ) continue;
+        auto& pool = m_pools[i];
+
+        const auto discards = s_discards[i].load( std::memory_order_relaxed );
+        const auto discarded = discards != pool.discards;
+        const auto changed = discarded || allocs[i] != pool.allocs || frees[i] != pool.frees;
+        if( !changed && !pool.active ) continue;
+
+        if( !pool.plotAllocs ) Setup( pool, i == 0 ? "Memory" : i == MemAggregateOverflow ? "Other memory pools" : s_poolNames[i].load( std::memory_order_relaxed ) );
+
+        // A discard drops all allocations live at the time it is seen here.
+        if( discarded ) pool.dropped = allocs[i] - frees[i];
+        const auto live = int64_t( allocs[i] - frees[i] - pool.dropped );
+
+        Profiler::PlotData( pool.plotAllocs, int64_t( allocs[i] - pool.allocs ) );
+        Profiler::PlotData( pool.plotBytes, int64_t( bytes[i] - pool.bytes ) );
+        Profiler::PlotData( pool.plotLive, live > 0 ? live : 0 );
+
+        pool.allocs = allocs[i];
+        pool.bytes = bytes[i];
+        pool.frees = frees[i];
+        pool.discards = discards;
+        pool.active = changed;
+    }
+}
+
+void MemAggregate::Setup( Pool& pool, const char* name )
+{
+    const auto sz = strlen( name );
+    pool.plotAllocs = (char*)tracy_malloc( sz + 16 );
+    pool.plotBytes = (char*)tracy_malloc( sz + 16 );
+    pool.plotLive = (char*)tracy_malloc( sz + 16 );
+    snprintf( pool.plotAllocs, sz + 16, "%s allocations", name );
+    snprintf( pool.plotBytes, sz + 16, "%s allocated", name );
+    snprintf( pool.plotLive, sz + 16, "%s live", name );
+    Profiler::ConfigurePlot( pool.plotBytes, PlotFormatType::Memory, false, true, 0 );
+}
+
+}
+
+#endif
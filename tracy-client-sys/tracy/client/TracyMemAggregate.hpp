@@ -0,0 +1,67 @@
+#ifndef __TRACYMEMAGGREGATE_HPP__
+#define __TRACYMEMAGGREGATE_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+#ifdef TRACY_MEMORY_AGGREGATION
+static constexpr bool MemoryAggregation = true;
+#else
+static constexpr bool MemoryAggregation = false;
+#endif
+
+}
+
+#ifdef TRACY_MEMORY_AGGREGATION
+
+namespace tracy
+{
+
+// Instead of sending each memory event, allocations and frees are counted per memory pool in
+// per-thread counters, which the profiler thread turns into plots of the allocation rate and of
+// the number of live allocations. Pools are told apart by the address of their name, the unnamed
+// pool having a null name. Pools past the first MemAggregatePools ones are counted together.
+static constexpr uint32_t MemAggregatePools = 32;
+
+TRACY_API void MemAggregateAlloc( const char* name, size_t size );
+TRACY_API void MemAggregateFree( const char* name );
+TRACY_API void MemAggregateDiscard( const char* name );
+
+class MemAggregate
+{
+    struct Pool
+    {
+        uint64_t allocs;
+        uint64_t bytes;
+        uint64_t frees;
+        uint64_t discards;
+        uint64_t dropped;           // allocations live at the last discard
+        char* plotAllocs;
+        char* plotBytes;
+        char* plotLive;
+        bool active;
+    };
+
+public:
+    MemAggregate();
+    ~MemAggregate();
+
+    void Tick();
+
+private:
+    void Setup( Pool& pool, const char* name );
+
+    Pool m_pools[MemAggregatePools];
+    uint64_t m_lastTime;
+};
+
+}
+
+#endif
+
+#endif
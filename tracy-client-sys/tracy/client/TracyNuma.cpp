@@ -0,0 +1,121 @@
+#include "TracyNuma.hpp"
+
+#ifdef TRACY_HAS_NUMA
+
+#include <atomic>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../common/TracySystem.hpp"
+
+#ifndef MADV_POPULATE_WRITE
+#  define MADV_POPULATE_WRITE 23
+#endif
+
+namespace tracy
+{
+
+constexpr int MaxNumaCpus = 4096;
+constexpr int NumaMpolPreferred = 1;
+
+static uint8_t s_numaCpuNode[MaxNumaCpus];
+static uint32_t s_numaNodeCount = 1;
+static bool s_numaHugePages = false;
+static bool s_numaPrefault = false;
+static std::atomic<int> s_numaInit { 0 };
+
+// Parses cpulist files, e.g. "0-7,16-23".
+static void MapNumaCpus( const char* list, uint32_t node )
+{
+    auto ptr = list;
+    while( *ptr >= '0' && *ptr <= '9' )
+    {
+        char* end;
+        const auto first = strtol( ptr, &end, 10 );
+        auto last = first;
+        if( *end == '-' ) last = strtol( end + 1, &end, 10 );
+        for( long i=first; i<=last && i<MaxNumaCpus; i++ ) s_numaCpuNode[i] = uint8_t( node );
+        ptr = *end == ',' ? end + 1 : end;
+    }
+}
+
+static void InitNuma()
+{
+    int expected = 0;
+    if( !s_numaInit.compare_exchange_strong( expected, 1, std::memory_order_acquire ) )
+    {
+        while( s_numaInit.load( std::memory_order_acquire ) != 2 ) {}
+        return;
+    }
+
+    uint32_t count = 1;
+    for( uint32_t i=0; i<MaxNumaNodes; i++ )
+    {
+        char path[64];
+        sprintf( path, "/sys/devices/system/node/node%u/cpulist", i );
+        FILE* f = fopen( path, "rb" );
+        if( !f ) continue;
+        char buf[4096];
+        const auto read = fread( buf, 1, sizeof( buf ) - 1, f );
+        buf[read] = '\0';
+        fclose( f );
+        MapNumaCpus( buf, i );
+        count = i + 1;
+    }
+    s_numaNodeCount = count;
+
+    // The queue blocks follow the huge page and prefault settings of the rest of the Tracy heap.
+    const char* hugePages = GetEnvVar( "TRACY_HUGE_PAGES" );
+    s_numaHugePages = hugePages && hugePages[0] == '1';
+    const char* prefault = GetEnvVar( "TRACY_HEAP_PREFAULT" );
+    s_numaPrefault = prefault && prefault[0] == '1';
+
+    s_numaInit.store( 2, std::memory_order_release );
+}
+
+uint32_t GetNumaNodeCount()
+{
+    if( s_numaInit.load( std::memory_order_acquire ) != 2 ) InitNuma();
+    return s_numaNodeCount;
+}
+
+uint32_t GetCurrentNumaNode()
+{
+    if( s_numaInit.load( std::memory_order_acquire ) != 2 ) InitNuma();
+    if( s_numaNodeCount == 1 ) return 0;
+    const auto cpu = sched_getcpu();
+    if( cpu < 0 || cpu >= MaxNumaCpus ) return 0;
+    return s_numaCpuNode[cpu];
+}
+
+void* NumaAlloc( size_t size, uint32_t node )
+{
+    auto ptr = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( ptr == MAP_FAILED ) return nullptr;
+    if( GetNumaNodeCount() > 1 )
+    {
+        // Failure (e.g. mbind not permitted in a container) is fine, pages then follow the first
+        // touch, which usually happens on the requested node anyway.
+        unsigned long mask = 1ul << node;
+        syscall( SYS_mbind, ptr, size, NumaMpolPreferred, &mask, sizeof( mask ) * 8 + 1, 0 );
+    }
+    // Faulted in only after the binding, so that the pages land on the node. Kernels without
+    // MADV_POPULATE_WRITE leave them to the first touch.
+    if( s_numaHugePages ) madvise( ptr, size, MADV_HUGEPAGE );
+    if( s_numaPrefault ) madvise( ptr, size, MADV_POPULATE_WRITE );
+    return ptr;
+}
+
+void NumaFree( void* ptr, size_t size )
+{
+    munmap( ptr, size );
+}
+
+}
+
+#endif
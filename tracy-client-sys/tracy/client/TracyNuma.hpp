@@ -0,0 +1,32 @@
+#ifndef __TRACYNUMA_HPP__
+#define __TRACYNUMA_HPP__
+
+#if defined TRACY_NUMA && defined __linux__
+#  define TRACY_HAS_NUMA
+#endif
+
+#ifdef TRACY_HAS_NUMA
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tracy
+{
+
+constexpr uint32_t MaxNumaNodes = 64;
+
+// Topology is read once, on first use. Systems which do not expose NUMA information are treated
+// as having a single node.
+uint32_t GetNumaNodeCount();
+// Node of the CPU the calling thread is currently running on.
+uint32_t GetCurrentNumaNode();
+
+// Page granular allocation, preferably placed on the given node.
+void* NumaAlloc( size_t size, uint32_t node );
+void NumaFree( void* ptr, size_t size );
+
+}
+
+#endif
+
+#endif
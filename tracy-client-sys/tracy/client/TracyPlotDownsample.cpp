@@ -0,0 +1,235 @@
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string.h>
+
+#include "TracyPlotDownsample.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+struct PlotDownsamplePolicy
+{
+    char* name;
+    std::atomic<int64_t> window;    // in ns
+    std::atomic<uint8_t> aggregate;
+};
+
+// Per-thread state of a plot, keyed by the address of its name. The policy is matched again once
+// new policies are added.
+struct PlotDownsampleSlot
+{
+    const char* name;
+    uint32_t count;
+    int32_t policy;
+    uint32_t samples;
+    int64_t start;
+    int64_t time;
+    double min;
+    double max;
+    double sum;
+    double last;
+};
+
+constexpr uint32_t PlotDownsampleSlots = 64;
+constexpr uint32_t PlotDownsampleMaxProbe = 8;
+
+// The slots of a thread. The lock is taken by the thread for every value, and by the profiler
+// thread when it sends the windows which have ended. Blocks are never freed, the block of an
+// exited thread is taken over by the next new thread.
+struct PlotDownsampleBlock
+{
+    PlotDownsampleSlot slots[PlotDownsampleSlots];
+    TracyMutex lock;
+    std::atomic<bool> used;
+    PlotDownsampleBlock* next;
+};
+
+struct PlotDownsampleHolder
+{
+    PlotDownsampleBlock* ptr;
+    ~PlotDownsampleHolder() { if( ptr ) ptr->used.store( false, std::memory_order_release ); }
+};
+
+PlotDownsamplePolicy s_plotDownsamplePolicies[MaxPlotDownsamplePolicies];
+std::atomic<uint32_t> s_plotDownsamplePolicyCount( 0 );
+TracyMutex s_plotDownsampleLock;
+std::atomic<PlotDownsampleBlock*> s_plotDownsampleBlocks( nullptr );
+
+thread_local PlotDownsampleHolder s_plotDownsampleBlock { nullptr };
+
+}
+
+static tracy_no_inline PlotDownsampleBlock* PlotDownsampleAcquire()
+{
+    for( auto block = s_plotDownsampleBlocks.load( std::memory_order_acquire ); block; block = block->next )
+    {
+        bool expected = false;
+        if( !block->used.load( std::memory_order_relaxed ) && block->used.compare_exchange_strong( expected, true, std::memory_order_acquire ) ) return block;
+    }
+
+    auto block = (PlotDownsampleBlock*)tracy_malloc( sizeof( PlotDownsampleBlock ) );
+    memset( (void*)block->slots, 0, sizeof( block->slots ) );
+    new(&block->lock) TracyMutex();
+    new(&block->used) std::atomic<bool>( true );
+    auto head = s_plotDownsampleBlocks.load( std::memory_order_relaxed );
+    do
+    {
+        block->next = head;
+    }
+    while( !s_plotDownsampleBlocks.compare_exchange_weak( head, block, std::memory_order_release, std::memory_order_relaxed ) );
+    return block;
+}
+
+static int32_t PlotDownsampleMatch( const char* name, uint32_t count )
+{
+    for( uint32_t i=0; i<count; i++ )
+    {
+        if( strcmp( s_plotDownsamplePolicies[i].name, name ) == 0 ) return int32_t( i );
+    }
+    return -1;
+}
+
+static void PlotDownsampleSend( PlotDownsampleSlot& slot, PlotAggregate aggregate )
+{
+    double val;
+    switch( aggregate )
+    {
+    case PlotAggregate::Min: val = slot.min; break;
+    case PlotAggregate::Max: val = slot.max; break;
+    case PlotAggregate::Mean: val = slot.sum / slot.samples; break;
+    case PlotAggregate::Sum: val = slot.sum; break;
+    default: val = slot.last; break;
+    }
+    slot.samples = 0;
+
+#ifdef TRACY_ON_DEMAND
+    if( !GetProfiler().IsConnected() ) return;
+#endif
+    TracyLfqPrepare( QueueType::PlotDataDouble );
+    MemWrite( &item->plotDataDouble.name, (uint64_t)slot.name );
+    MemWrite( &item->plotDataDouble.time, slot.time );
+    MemWrite( &item->plotDataDouble.val, val );
+    TracyLfqCommit;
+}
+
+TRACY_API void PlotDownsampleSetup( const char* name, int64_t window, PlotAggregate aggregate )
+{
+    const auto ns = window > 0 ? window + 1 : 0;
+    std::lock_guard<TracyMutex> lock( s_plotDownsampleLock );
+    auto count = s_plotDownsamplePolicyCount.load( std::memory_order_relaxed );
+
+    auto idx = PlotDownsampleMatch( name, count );
+    if( idx < 0 )
+    {
+        if( count == MaxPlotDownsamplePolicies ) return;
+        const auto sz = strlen( name ) + 1;
+        auto& policy = s_plotDownsamplePolicies[count];
+        policy.name = (char*)tracy_malloc( sz );
+        memcpy( policy.name, name, sz );
+        policy.window.store( ns, std::memory_order_relaxed );
+        policy.aggregate.store( (uint8_t)aggregate, std::memory_order_relaxed );
+        s_plotDownsamplePolicyCount.store( count + 1, std::memory_order_release );
+        return;
+    }
+    s_plotDownsamplePolicies[idx].window.store( ns, std::memory_order_relaxed );
+    s_plotDownsamplePolicies[idx].aggregate.store( (uint8_t)aggregate, std::memory_order_relaxed );
+}
+
+TRACY_API bool PlotDownsample( const char* name, double val )
+{
+    const auto count = s_plotDownsamplePolicyCount.load( std::memory_order_acquire );
+    if( count == 0 ) return false;
+
+    auto block = s_plotDownsampleBlock.ptr;
+    if( !block )
+    {
+        block = PlotDownsampleAcquire();
+        s_plotDownsampleBlock.ptr = block;
+    }
+    std::lock_guard<TracyMutex> lock( block->lock );
+
+    auto idx = uint32_t( ( uint64_t( name ) * 0x9E3779B97F4A7C15ull ) >> 58 );
+    PlotDownsampleSlot* slot = nullptr;
+    for( uint32_t probe=0; probe<PlotDownsampleMaxProbe; probe++ )
+    {
+        auto& s = block->slots[idx];
+        if( s.name == name )
+        {
+            slot = &s;
+            break;
+        }
+        if( !s.name )
+        {
+            s.name = name;
+            slot = &s;
+            break;
+        }
+        idx = ( idx + 1 ) & ( PlotDownsampleSlots - 1 );
+    }
+    if( !slot ) return false;
+
+    if( slot->count != count )
+    {
+        slot->policy = PlotDownsampleMatch( name, count );
+        slot->count = count;
+    }
+    if( slot->policy < 0 ) return false;
+
+    const auto& policy = s_plotDownsamplePolicies[slot->policy];
+    const auto window = policy.window.load( std::memory_order_relaxed );
+    const auto aggregate = (PlotAggregate)policy.aggregate.load( std::memory_order_relaxed );
+    if( window == 0 )
+    {
+        if( slot->samples != 0 ) PlotDownsampleSend( *slot, aggregate );
+        return false;
+    }
+
+    const auto time = Profiler::GetTime();
+    if( slot->samples != 0 && time - slot->start >= window ) PlotDownsampleSend( *slot, aggregate );
+    if( slot->samples == 0 )
+    {
+        slot->start = time;
+        slot->min = slot->max = slot->sum = val;
+    }
+    else
+    {
+        if( val < slot->min ) slot->min = val;
+        if( val > slot->max ) slot->max = val;
+        slot->sum += val;
+    }
+    slot->samples++;
+    slot->time = time;
+    slot->last = val;
+    return true;
+}
+
+
+void PlotDownsampleFlush()
+{
+    const auto count = s_plotDownsamplePolicyCount.load( std::memory_order_acquire );
+    if( count == 0 ) return;
+
+    const auto time = Profiler::GetTime();
+    for( auto block = s_plotDownsampleBlocks.load( std::memory_order_acquire ); block; block = block->next )
+    {
+        // A thread holding the lock is about to send its own windows.
+        if( !block->lock.try_lock() ) continue;
+        for( auto& slot : block->slots )
+        {
+            if( slot.samples == 0 || slot.policy < 0 ) continue;
+            const auto& policy = s_plotDownsamplePolicies[slot.policy];
+            if( time - slot.start < policy.window.load( std::memory_order_relaxed ) ) continue;
+            PlotDownsampleSend( slot, (PlotAggregate)policy.aggregate.load( std::memory_order_relaxed ) );
+        }
+        block->lock.unlock();
+    }
+}
+
+}
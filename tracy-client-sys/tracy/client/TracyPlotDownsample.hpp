@@ -0,0 +1,38 @@
+#ifndef __TRACYPLOTDOWNSAMPLE_HPP__
+#define __TRACYPLOTDOWNSAMPLE_HPP__
+
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+enum class PlotAggregate : uint8_t
+{
+    Last,           // Last value of the window.
+    Min,            // Smallest value of the window.
+    Max,            // Largest value of the window.
+    Mean,           // Average of the values of the window.
+    Sum             // Sum of the values of the window.
+};
+
+constexpr uint32_t MaxPlotDownsamplePolicies = 64;
+
+// Downsamples the plot with the given name on each thread: values are accumulated over windows of
+// the given number of nanoseconds, and a single value per window is sent. A window is sent with
+// the first value after its end, or by the profiler thread soon after its end if no value follows,
+// at the time of its last value. A window of zero sends every value again. Setting up an existing
+// plot only changes its window and aggregate.
+TRACY_API void PlotDownsampleSetup( const char* name, int64_t window, PlotAggregate aggregate );
+
+// Takes the value if the plot is downsampled. Otherwise it has to be sent as usual.
+TRACY_API bool PlotDownsample( const char* name, double val );
+
+// Sends the windows which have ended without a value after them, including the ones of exited
+// threads. Called periodically by the profiler thread.
+void PlotDownsampleFlush();
+
+}
+
+#endif
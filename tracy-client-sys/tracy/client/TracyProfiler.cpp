@@ -15,6 +15,7 @@
 #    include <excpt.h>
 #  endif
 #else
+#  include <inttypes.h>
 #  include <sys/time.h>
 #  include <sys/param.h>
 #endif
@@ -62,6 +63,7 @@
 #include <atomic>
 #include <chrono>
 #include <limits>
+#include <math.h>
 #include <new>
 #include <stdlib.h>
 #include <string.h>
@@ -74,6 +76,7 @@
 #include "../common/TracySystem.hpp"
 #include "../common/TracyYield.hpp"
 #include "../common/tracy_lz4.hpp"
+#include "../common/tracy_lz4hc.hpp"
 #include "tracy_rpmalloc.hpp"
 #include "TracyCallstack.hpp"
 #include "TracyDebug.hpp"
@@ -83,7 +86,10 @@
 #include "TracyThread.hpp"
 #include "TracyTimer.hpp"
 #include "TracyArmCpuTable.hpp"
+#include "TracyCapture.hpp"
+#include "TracyFlightRecorder.hpp"
 #include "TracySysTrace.hpp"
+#include "TracyZoneCounters.hpp"
 #include "../tracy/TracyC.h"
 
 #if defined TRACY_MANUAL_LIFETIME && !defined(TRACY_DELAYED_INIT)
@@ -124,6 +130,8 @@ extern "C" typedef char* (WINAPI *t_WineGetBuildId)();
 #endif
 #if defined __linux__
 #  include <sys/sysinfo.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
 #  include <sys/utsname.h>
 #endif
 
@@ -309,7 +317,10 @@ struct InitTimeWrapper
 
 struct ProducerWrapper
 {
-    tracy::moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptr;
+#ifdef TRACY_COMPACT_ZONES
+    ~ProducerWrapper() { FlushPendingZone( ptr ); }
+#endif
+    EventQueue::ExplicitProducer* ptr;
 };
 
 struct ThreadHandleWrapper
@@ -841,6 +852,9 @@ std::atomic<bool> s_symbolThreadGone { false };
 #ifdef TRACY_HAS_SYSTEM_TRACING
 static std::atomic<Thread*> s_sysTraceThread(nullptr);
 #endif
+#ifdef TRACY_HAS_SYS_SAMPLER
+static Thread* s_sysSamplerThread;
+#endif
 
 #if defined __linux__ && !defined TRACY_NO_CRASH_HANDLER
 #  ifndef TRACY_CRASH_SIGNAL
@@ -1133,14 +1147,25 @@ void Profiler::EndSamplingProfiling()
 
 constexpr size_t QueuePrealloc = 256 * 1024;
 
+#ifndef TRACY_DELAYED_INIT
+// TRACY_QUEUE_PREALLOC sets the number of events the queue blocks allocated at startup can hold,
+// so that a program producing bursts of events doesn't have to allocate new blocks mid-burst.
+static size_t GetQueuePrealloc()
+{
+    const char* prealloc = GetEnvVar( "TRACY_QUEUE_PREALLOC" );
+    if( prealloc && atoi( prealloc ) > 0 ) return size_t( atoi( prealloc ) );
+    return QueuePrealloc;
+}
+#endif
+
 #ifdef TRACY_DELAYED_INIT
 struct ThreadNameData;
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue();
+TRACY_API EventQueue& GetQueue();
 
 struct ProfilerData
 {
     int64_t initTime = SetupHwTimer();
-    moodycamel::ConcurrentQueue<QueueItem> queue;
+    EventQueue queue;
     Profiler profiler;
     std::atomic<uint32_t> lockCounter { 0 };
     std::atomic<uint8_t> gpuCtxCounter { 0 };
@@ -1150,8 +1175,12 @@ struct ProfilerData
 struct ProducerWrapper
 {
     ProducerWrapper( ProfilerData& data ) : detail( data.queue ), ptr( data.queue.get_explicit_producer( detail ) ) {}
-    moodycamel::ProducerToken detail;
-    tracy::moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptr;
+#ifdef TRACY_COMPACT_ZONES
+    // A zone left open by the exiting thread must not hold the queue tail back.
+    ~ProducerWrapper() { FlushPendingZone( ptr ); }
+#endif
+    EventProducerToken detail;
+    EventQueue::ExplicitProducer* ptr;
 };
 
 struct ProfilerThreadData
@@ -1279,9 +1308,9 @@ static ProfilerThreadData& GetProfilerThreadData()
 }
 #endif
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken() { return GetProfilerThreadData().token.ptr; }
+TRACY_API EventQueue::ExplicitProducer* GetToken() { return GetProfilerThreadData().token.ptr; }
 TRACY_API Profiler& GetProfiler() { return GetProfilerData().profiler; }
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue() { return GetProfilerData().queue; }
+TRACY_API EventQueue& GetQueue() { return GetProfilerData().queue; }
 TRACY_API int64_t GetInitTime() { return GetProfilerData().initTime; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return GetProfilerData().lockCounter; }
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter() { return GetProfilerData().gpuCtxCounter; }
@@ -1305,10 +1334,10 @@ namespace
 // MSVC static initialization order solution. gcc/clang uses init_order() to avoid all this.
 
 // 1a. But s_queue is needed for initialization of variables in point 2.
-extern moodycamel::ConcurrentQueue<QueueItem> s_queue;
+extern EventQueue s_queue;
 
 // 2. If these variables would be in the .CRT$XCB section, they would be initialized only in main thread.
-thread_local moodycamel::ProducerToken init_order(107) s_token_detail( s_queue );
+thread_local EventProducerToken init_order(107) s_token_detail( s_queue );
 thread_local ProducerWrapper init_order(108) s_token { s_queue.get_explicit_producer( s_token_detail ) };
 thread_local ThreadHandleWrapper init_order(104) s_threadHandle { detail::GetThreadHandleImpl() };
 
@@ -1323,7 +1352,7 @@ std::atomic<int> init_order(102) RpInitDone( 0 );
 std::atomic<int> init_order(102) RpInitLock( 0 );
 thread_local bool RpThreadInitDone = false;
 thread_local bool RpThreadShutdown = false;
-moodycamel::ConcurrentQueue<QueueItem> init_order(103) s_queue( QueuePrealloc );
+EventQueue init_order(103) s_queue( GetQueuePrealloc() );
 std::atomic<uint32_t> init_order(104) s_lockCounter( 0 );
 std::atomic<uint8_t> init_order(104) s_gpuCtxCounter( 0 );
 
@@ -1339,9 +1368,9 @@ thread_local LuaZoneState init_order(104) s_luaZoneState { 0, false };
 
 static Profiler init_order(105) s_profiler;
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken() { return s_token.ptr; }
+TRACY_API EventQueue::ExplicitProducer* GetToken() { return s_token.ptr; }
 TRACY_API Profiler& GetProfiler() { return s_profiler; }
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue() { return s_queue; }
+TRACY_API EventQueue& GetQueue() { return s_queue; }
 TRACY_API int64_t GetInitTime() { return s_initTime.val; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return s_lockCounter; }
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter() { return s_gpuCtxCounter; }
@@ -1358,10 +1387,44 @@ TRACY_API LuaZoneState& GetLuaZoneState() { return s_luaZoneState; }
 TRACY_API bool ProfilerAvailable() { return s_instance != nullptr; }
 TRACY_API bool ProfilerAllocatorAvailable() { return !RpThreadShutdown; }
 
+#ifdef TRACY_FIBERS
+#  ifdef TRACY_ON_DEMAND
+static thread_local FiberState s_fiberState { nullptr, 0, 0, false, 0 };
+#  else
+static thread_local FiberState s_fiberState { nullptr, 0, 0, false };
+#  endif
+TRACY_API FiberState& GetFiberState() { return s_fiberState; }
+#endif
+
 TRACY_API bool BeginSamplingProfiling() { return GetProfiler().BeginSamplingProfiling(); }
 TRACY_API void EndSamplingProfiling() { return GetProfiler().EndSamplingProfiling(); }
 
 constexpr static size_t SafeSendBufferSize = 65536;
+constexpr static int Lz4DictSize = 64 * 1024;
+constexpr static int Lz4SendBatch = 16;
+
+// Compression levels available to the adaptive mode, from the strongest to the fastest. Positive
+// values are LZ4HC levels, negative values are LZ4 acceleration factors.
+constexpr static int Lz4Levels[] = { 9, 4, -1, -2, -4, -8, -16 };
+constexpr static int Lz4LevelCount = sizeof( Lz4Levels ) / sizeof( *Lz4Levels );
+constexpr static int Lz4DefaultLevel = 2;
+constexpr static int Lz4AdaptFrames = 4;
+
+// Smallest frame which still holds the largest symbol code payload, and whose ring buffer keeps
+// the LZ4 dictionary intact.
+constexpr static uint32_t MinFrameSize = 128 * 1024;
+static_assert( MinFrameSize * 2 >= Lz4DictSize && MinFrameSize > SafeSendBufferSize + 64, "Minimum frame size too small" );
+
+// TRACY_FRAME_SIZE sets the size of the frames the data is sent in, in KiB. Smaller frames cut
+// the memory taken by the send buffers on constrained targets. The server sizes its buffers for
+// the protocol's TargetFrameSize, which is therefore also the largest frame size.
+static uint32_t GetFrameSize()
+{
+    const char* frameSize = GetEnvVar( "TRACY_FRAME_SIZE" );
+    if( !frameSize || atoi( frameSize ) <= 0 ) return TargetFrameSize;
+    const auto size = uint64_t( atoi( frameSize ) ) * 1024;
+    return uint32_t( std::min<uint64_t>( std::max<uint64_t>( size, MinFrameSize ), TargetFrameSize ) );
+}
 
 Profiler::Profiler()
     : m_timeBegin( 0 )
@@ -1371,29 +1434,137 @@ Profiler::Profiler()
     , m_shutdownManual( false )
     , m_shutdownFinished( false )
     , m_sock( nullptr )
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    , m_shm( nullptr )
+#endif
     , m_broadcast( nullptr )
     , m_noExit( false )
     , m_userPort( 0 )
     , m_zoneId( 1 )
     , m_samplingPeriod( 0 )
     , m_stream( LZ4_createStream() )
-    , m_buffer( (char*)tracy_malloc( TargetFrameSize*3 ) )
+    , m_frameSize( GetFrameSize() )
+    , m_lz4Size( Lz4CompressBound( m_frameSize ) )
+    , m_buffer( (char*)tracy_malloc( m_frameSize*3 ) )
     , m_bufferOffset( 0 )
     , m_bufferStart( 0 )
-    , m_lz4Buf( (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) ) )
-    , m_serialQueue( 1024*1024 )
-    , m_serialDequeue( 1024*1024 )
+    , m_lz4Buf( (char*)tracy_malloc( m_lz4Size + sizeof( lz4sz_t ) ) )
+    , m_lz4Threads( 0 )
+    , m_lz4JobCount( 0 )
+    , m_lz4Pool( nullptr )
+    , m_lz4Jobs( nullptr )
+    , m_lz4Head( 0 )
+    , m_lz4Tail( 0 )
+    , m_lz4Next( 0 )
+    , m_lz4DictSize( 0 )
+    , m_lz4Exit( false )
+    , m_streamHC( nullptr )
+    , m_lz4Adaptive( false )
+    , m_lz4Level( Lz4DefaultLevel )
+    , m_lz4StreamLevel( Lz4DefaultLevel )
+    , m_lz4Prev( nullptr )
+    , m_lz4PrevSize( 0 )
+    , m_lz4CompressTime( 0 )
+    , m_lz4SendTime( 0 )
+    , m_lz4Frames( 0 )
+    , m_lz4AdaptStart( 0 )
+    , m_lz4Warmup( 0 )
+    , m_lz4WarmupLeft( 0 )
+#ifdef TRACY_OFFLINE_CAPTURE
+    , m_capture( nullptr )
+    , m_captureSeen( nullptr )
+    , m_captureQueries( 1024 )
+    , m_captureDequeue( 1024 )
+#endif
+#ifdef TRACY_FAN_OUT
+    , m_fanOutCount( 0 )
+    , m_fanOutWait( 1000 )
+    , m_fanOutLimit( 64 * 1024 * 1024 )
+    , m_fanOutBuf( nullptr )
+    , m_fanOutTarget( FanOutAll )
+    , m_fanOutNextId( 0 )
+#endif
+#ifndef TRACY_ON_DEMAND
+    , m_recorder( nullptr )
+#endif
+#ifndef TRACY_THREAD_SERIAL_QUEUES
+    , m_serialQueue( 16*1024 )
+#elif defined TRACY_MEMORY_BATCHING
+    , m_serialLimit( 0 )
+#endif
+    , m_serialDequeue( 16*1024 )
+#ifdef TRACY_FIBERS
+    , m_fiberCount( 0 )
+#endif
 #ifndef TRACY_NO_FRAME_IMAGE
     , m_fiQueue( 16 )
     , m_fiDequeue( 16 )
+    , m_fiBudget( 128 * 1024 * 1024 )
+    , m_fiPending( 0 )
+    , m_fiDropped( 0 )
+    , m_fiDownscaled( 0 )
+    , m_fiDroppedReported( 0 )
+    , m_fiDownscaledReported( 0 )
+    , m_fiThreads( 0 )
+    , m_fiPool( nullptr )
+    , m_fiTileSrc( nullptr )
+    , m_fiTileDst( nullptr )
+    , m_fiTileW( 0 )
+    , m_fiTileH( 0 )
+    , m_fiTileCount( 0 )
+    , m_fiTileNext( 0 )
+    , m_fiTileDone( 0 )
+    , m_fiTileExit( false )
 #endif
     , m_symbolQueue( 8*1024 )
+#ifdef TRACY_HAS_CALLSTACK
+    , m_symbolCache( nullptr )
+#endif
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+    , m_callstackTable( nullptr )
+#endif
+    , m_memSampleInterval( 0 )
+#ifdef TRACY_ZONE_COALESCE
+    , m_coalesceThreshold( 1000 )
+#endif
+    , m_memElideWindow( 0 )
+    , m_memElideLastPlot( 0 )
+#ifdef TRACY_USE_LIBBACKTRACE
+    , m_symbolThreads( 1 )
+    , m_symbolHelpers( nullptr )
+    , m_symbolHelpersBusy( 0 )
+    , m_symbolExit( false )
+#endif
     , m_frameCount( 0 )
     , m_isConnected( false )
+#ifdef TRACY_WORKER_WAKEUP
+    , m_idleSpins( 0 )
+    , m_idleTimeout( 10 )
+    , m_idleBusy( false )
+    , m_idlePolling( false )
+#endif
+    , m_statQueueDepth( 0 )
+    , m_statSerialDepth( 0 )
+    , m_statSymbolQueueDepth( 0 )
+    , m_statWorkerBusy( 0 )
+    , m_statWorkerIdle( 0 )
+    , m_statRawBytes( 0 )
+    , m_statCompressedBytes( 0 )
+    , m_statSendTime( 0 )
+    , m_statSymbols( 0 )
+    , m_statSamplesLost( 0 )
+    , m_statLastTick( 0 )
+    , m_statIdle( 0 )
+    , m_statSerialPeak( 0 )
+    , m_statPlots( false )
+    , m_statPlotsConfigured( false )
+    , m_statPlotted()
 #ifdef TRACY_ON_DEMAND
     , m_connectionId( 0 )
     , m_symbolsBusy( false )
-    , m_deferredQueue( 64*1024 )
+    , m_deferredQueue( 4*1024 )
+    , m_deferredDead( 0 )
+    , m_deferredCompactAt( 1024 )
 #endif
     , m_paramCallback( nullptr )
     , m_sourceCallback( nullptr )
@@ -1408,20 +1579,22 @@ Profiler::Profiler()
 #ifndef TRACY_DELAYED_INIT
 #  ifdef _MSC_VER
     // 3. But these variables need to be initialized in main thread within the .CRT$XCB section. Do it here.
-    s_token_detail = moodycamel::ProducerToken( s_queue );
+    s_token_detail = EventProducerToken( s_queue );
     s_token = ProducerWrapper { s_queue.get_explicit_producer( s_token_detail ) };
     s_threadHandle = ThreadHandleWrapper { m_mainThread };
 #  endif
 #endif
 
-    CalibrateDelay();
-    ReportTopology();
-
 #ifdef __linux__
     m_kcore = (KCore*)tracy_malloc( sizeof( KCore ) );
     new(m_kcore) KCore();
 #endif
 
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+    m_callstackTable = (CallstackTable*)tracy_malloc( sizeof( CallstackTable ) );
+    new(m_callstackTable) CallstackTable();
+#endif
+
 #ifndef TRACY_NO_EXIT
     const char* noExitEnv = GetEnvVar( "TRACY_NO_EXIT" );
     if( noExitEnv && noExitEnv[0] == '1' )
@@ -1436,6 +1609,135 @@ Profiler::Profiler()
         m_userPort = atoi( userPort );
     }
 
+    const char* adaptiveCompression = GetEnvVar( "TRACY_ADAPTIVE_COMPRESSION" );
+    if( adaptiveCompression && adaptiveCompression[0] == '1' )
+    {
+        m_lz4Adaptive = true;
+        m_streamHC = LZ4_createStreamHC();
+    }
+
+    // The first frames of a connection carry the strings, source locations and symbols the server
+    // hasn't seen yet, and are compressed with an empty history. TRACY_COMPRESSION_WARMUP gives
+    // the number of megabytes of the stream, from the start of each connection, to be compressed
+    // with LZ4HC instead, for links where the bandwidth matters more than the time it takes.
+    const char* compressionWarmup = GetEnvVar( "TRACY_COMPRESSION_WARMUP" );
+    if( compressionWarmup )
+    {
+        m_lz4Warmup = size_t( atoi( compressionWarmup ) ) * 1024 * 1024;
+        m_lz4WarmupLeft = m_lz4Warmup;
+        if( m_lz4Warmup != 0 && !m_streamHC ) m_streamHC = LZ4_createStreamHC();
+    }
+
+    const char* compressionThreads = GetEnvVar( "TRACY_COMPRESSION_THREADS" );
+    if( compressionThreads )
+    {
+        const auto threads = atoi( compressionThreads );
+        if( threads > 0 )
+        {
+            m_lz4Threads = std::min( threads, 64 );
+            m_lz4JobCount = m_lz4Threads * 2;
+            m_lz4Jobs = (Lz4Job*)tracy_malloc( sizeof( Lz4Job ) * m_lz4JobCount );
+            for( uint32_t i=0; i<m_lz4JobCount; i++ )
+            {
+                m_lz4Jobs[i].src = (char*)tracy_malloc( Lz4DictSize + m_frameSize );
+                m_lz4Jobs[i].dst = (char*)tracy_malloc( m_lz4Size + sizeof( lz4sz_t ) );
+                m_lz4Jobs[i].done = true;
+            }
+        }
+    }
+
+#ifndef TRACY_NO_FRAME_IMAGE
+    const char* frameImageThreads = GetEnvVar( "TRACY_FRAME_IMAGE_THREADS" );
+    if( frameImageThreads )
+    {
+        const auto threads = atoi( frameImageThreads );
+        if( threads > 0 ) m_fiThreads = std::min( threads, 64 );
+    }
+    const char* frameImageBudget = GetEnvVar( "TRACY_FRAME_IMAGE_BUDGET" );
+    if( frameImageBudget )
+    {
+        const auto budget = atoi( frameImageBudget );
+        if( budget >= 0 ) m_fiBudget = size_t( budget ) * 1024 * 1024;
+    }
+#endif
+
+    const char* clientStats = GetEnvVar( "TRACY_CLIENT_STATS" );
+    if( clientStats && clientStats[0] == '1' )
+    {
+        m_statPlots = true;
+    }
+
+    const char* memSampleInterval = GetEnvVar( "TRACY_MEMORY_SAMPLE_INTERVAL" );
+    if( memSampleInterval )
+    {
+        const auto interval = atoll( memSampleInterval );
+        if( interval > 0 ) m_memSampleInterval = uint64_t( interval );
+    }
+
+    const char* memElideWindow = GetEnvVar( "TRACY_MEMORY_ELIDE_WINDOW" );
+    if( memElideWindow )
+    {
+        const auto window = atoll( memElideWindow );
+        if( window > 0 ) m_memElideWindow = int64_t( window );
+    }
+    memset( m_memElided, 0, sizeof( m_memElided ) );
+    memset( m_memElidedPlotted, 0, sizeof( m_memElidedPlotted ) );
+
+#ifdef TRACY_ZONE_COALESCE
+    const char* coalesceThreshold = GetEnvVar( "TRACY_ZONE_COALESCE_THRESHOLD" );
+    if( coalesceThreshold )
+    {
+        const auto threshold = atoll( coalesceThreshold );
+        if( threshold >= 0 ) m_coalesceThreshold = int64_t( threshold );
+    }
+#endif
+
+#ifdef TRACY_USE_LIBBACKTRACE
+    const char* symbolThreads = GetEnvVar( "TRACY_SYMBOL_THREADS" );
+    if( symbolThreads )
+    {
+        const auto threads = atoi( symbolThreads );
+        if( threads > 0 ) m_symbolThreads = std::min( threads, 64 );
+    }
+#endif
+
+#if !defined TRACY_ON_DEMAND && !defined TRACY_OFFLINE_CAPTURE
+    const char* flightRecorder = GetEnvVar( "TRACY_FLIGHT_RECORDER" );
+    if( flightRecorder && atoi( flightRecorder ) > 0 )
+    {
+        size_t size = 64;
+        const char* flightRecorderSize = GetEnvVar( "TRACY_FLIGHT_RECORDER_SIZE" );
+        if( flightRecorderSize && atoi( flightRecorderSize ) > 0 ) size = atoi( flightRecorderSize );
+        // Must hold a few full frames.
+        size = std::max<size_t>( size, 4 * TargetFrameSize / ( 1024 * 1024 ) + 1 );
+        m_recorder = (FlightRecorder*)tracy_malloc( sizeof( FlightRecorder ) );
+        new(m_recorder) FlightRecorder( size * 1024 * 1024, uint32_t( atoi( flightRecorder ) ) * 1000 );
+    }
+#endif
+
+#ifdef TRACY_OFFLINE_CAPTURE
+    {
+        char defaultPath[32];
+        const char* capturePath = GetEnvVar( "TRACY_CAPTURE_FILE" );
+        if( !capturePath )
+        {
+            sprintf( defaultPath, "tracy-%" PRIu64, GetPid() );
+            capturePath = defaultPath;
+        }
+        uint64_t fileSize = 256;
+        const char* captureSize = GetEnvVar( "TRACY_CAPTURE_FILE_SIZE" );
+        if( captureSize && atoi( captureSize ) > 0 ) fileSize = atoi( captureSize );
+        uint32_t fileCount = 8;
+        const char* captureCount = GetEnvVar( "TRACY_CAPTURE_FILE_COUNT" );
+        if( captureCount && atoi( captureCount ) >= 0 ) fileCount = atoi( captureCount );
+
+        m_capture = (CaptureFile*)tracy_malloc( sizeof( CaptureFile ) );
+        new(m_capture) CaptureFile( capturePath, fileSize * 1024 * 1024, fileCount );
+        m_captureSeen = (CaptureQueries*)tracy_malloc( sizeof( CaptureQueries ) );
+        new(m_captureSeen) CaptureQueries();
+    }
+#endif
+
     m_safeSendBuffer = (char*)tracy_malloc( SafeSendBufferSize );
 
 #ifndef _WIN32
@@ -1449,6 +1751,10 @@ Profiler::Profiler()
     m_pipeBufSize = fcntl( m_pipe[0], F_GETPIPE_SZ );
 #  endif
     fcntl( m_pipe[1], F_SETFL, O_NONBLOCK );
+#  if defined __linux__ && defined SYS_process_vm_readv
+    m_pid = getpid();
+    m_vmReadv = true;
+#  endif
 #endif
 
 #if !defined(TRACY_DELAYED_INIT) || !defined(TRACY_MANUAL_LIFETIME)
@@ -1529,13 +1835,37 @@ void Profiler::SpawnWorkerThreads()
 #ifndef TRACY_NO_FRAME_IMAGE
     s_compressThread = (Thread*)tracy_malloc( sizeof( Thread ) );
     new(s_compressThread) Thread( LaunchCompressWorker, this );
+    if( m_fiThreads != 0 )
+    {
+        m_fiPool = (Thread**)tracy_malloc( sizeof( Thread* ) * m_fiThreads );
+        for( uint32_t i=0; i<m_fiThreads; i++ )
+        {
+            m_fiPool[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+            new(m_fiPool[i]) Thread( LaunchCompressTileWorker, this );
+        }
+    }
 #endif
 
+    if( m_lz4Threads != 0 )
+    {
+        m_lz4Pool = (Thread**)tracy_malloc( sizeof( Thread* ) * m_lz4Threads );
+        for( uint32_t i=0; i<m_lz4Threads; i++ )
+        {
+            m_lz4Pool[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+            new(m_lz4Pool[i]) Thread( LaunchLz4Worker, this );
+        }
+    }
+
 #ifdef TRACY_HAS_CALLSTACK
     s_symbolThread = (Thread*)tracy_malloc( sizeof( Thread ) );
     new(s_symbolThread) Thread( LaunchSymbolWorker, this );
 #endif
 
+#ifdef TRACY_HAS_SYS_SAMPLER
+    s_sysSamplerThread = (Thread*)tracy_malloc( sizeof( Thread ) );
+    new(s_sysSamplerThread) Thread( LaunchSysSamplerWorker, this );
+#endif
+
 #if defined _WIN32 && !defined TRACY_WIN32_NO_DESKTOP && !defined TRACY_NO_CRASH_HANDLER
     s_profilerThreadId = GetThreadId( s_thread->Handle() );
 #  ifdef TRACY_HAS_CALLSTACK
@@ -1560,6 +1890,11 @@ Profiler::~Profiler()
     StopSystemTracing();
 #endif
 
+#ifdef TRACY_HAS_SYS_SAMPLER
+    s_sysSamplerThread->~Thread();
+    tracy_free( s_sysSamplerThread );
+#endif
+
 #ifdef TRACY_HAS_CALLSTACK
     s_symbolThread->~Thread();
     tracy_free( s_symbolThread );
@@ -1568,15 +1903,62 @@ Profiler::~Profiler()
 #ifndef TRACY_NO_FRAME_IMAGE
     s_compressThread->~Thread();
     tracy_free( s_compressThread );
+    if( m_fiPool )
+    {
+        m_fiTileLock.lock();
+        m_fiTileExit = true;
+        m_fiTileLock.unlock();
+        m_fiTileWake.notify_all();
+        for( uint32_t i=0; i<m_fiThreads; i++ )
+        {
+            m_fiPool[i]->~Thread();
+            tracy_free( m_fiPool[i] );
+        }
+        tracy_free( m_fiPool );
+    }
 #endif
 
     s_thread->~Thread();
     tracy_free( s_thread );
 
+    if( m_lz4Pool )
+    {
+        // The profiler thread is gone, nothing more will be submitted. Workers drain what's left and exit.
+        m_lz4Lock.lock();
+        m_lz4Exit = true;
+        m_lz4Lock.unlock();
+        m_lz4Wake.notify_all();
+        for( uint32_t i=0; i<m_lz4Threads; i++ )
+        {
+            m_lz4Pool[i]->~Thread();
+            tracy_free( m_lz4Pool[i] );
+        }
+        tracy_free( m_lz4Pool );
+    }
+    if( m_lz4Jobs )
+    {
+        for( uint32_t i=0; i<m_lz4JobCount; i++ )
+        {
+            tracy_free( m_lz4Jobs[i].src );
+            tracy_free( m_lz4Jobs[i].dst );
+        }
+        tracy_free( m_lz4Jobs );
+    }
+
 #ifdef TRACY_HAS_CALLSTACK
+    if( m_symbolCache )
+    {
+        m_symbolCache->~SymbolCache();
+        tracy_free( m_symbolCache );
+    }
     EndCallstack();
 #endif
 
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+    m_callstackTable->~CallstackTable();
+    tracy_free( m_callstackTable );
+#endif
+
 #ifdef __linux__
     m_kcore->~KCore();
     tracy_free( m_kcore );
@@ -1591,6 +1973,36 @@ Profiler::~Profiler()
     tracy_free( m_lz4Buf );
     tracy_free( m_buffer );
     LZ4_freeStream( (LZ4_stream_t*)m_stream );
+    if( m_streamHC ) LZ4_freeStreamHC( (LZ4_streamHC_t*)m_streamHC );
+
+#ifndef TRACY_ON_DEMAND
+    if( m_recorder )
+    {
+        m_recorder->~FlightRecorder();
+        tracy_free( m_recorder );
+    }
+#endif
+
+#ifdef TRACY_FIBERS
+    const auto fibers = m_fiberCount.load( std::memory_order_relaxed );
+    for( uint32_t i=0; i<fibers; i++ ) tracy_free( (void*)m_fiberNames[i / FiberNameChunk][i % FiberNameChunk] );
+    for( uint32_t i=0; i<fibers; i+=FiberNameChunk ) tracy_free( m_fiberNames[i / FiberNameChunk] );
+#endif
+
+#ifdef TRACY_OFFLINE_CAPTURE
+    m_capture->~CaptureFile();
+    tracy_free( m_capture );
+    m_captureSeen->~CaptureQueries();
+    tracy_free( m_captureSeen );
+#endif
+
+#ifdef TRACY_FAN_OUT
+    while( m_fanOutCount != 0 ) CloseFanOut( 0 );
+    tracy_free( m_fanOutBuf );
+#endif
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    EndShmTransport();
+#endif
 
     if( m_sock )
     {
@@ -1638,10 +2050,22 @@ void Profiler::Worker()
 
     while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
 
+#ifdef TRACY_HAS_TSC_TIMER
+    TscTimerCalibrate();
+#endif
+#ifdef TRACY_HAS_CNTVCT_TIMER
+    CntvctTimerCalibrate();
+#endif
+
 #ifdef TRACY_USE_RPMALLOC
     rpmalloc_thread_initialize();
 #endif
 
+    // Kept off the constructor, so that the startup of the application doesn't wait for them.
+    // Both are only needed once a server connects.
+    CalibrateDelay();
+    ReportTopology();
+
     m_exectime = 0;
     const auto execname = GetProcessExecutablePath();
     if( execname )
@@ -1723,7 +2147,18 @@ void Profiler::Worker()
     memcpy( welcome.hostInfo, hostinfo, hisz );
     memset( welcome.hostInfo + hisz, 0, WelcomeMessageHostInfoSize - hisz );
 
-    moodycamel::ConsumerToken token( GetQueue() );
+    EventConsumerToken token( GetQueue() );
+
+#ifdef TRACY_OFFLINE_CAPTURE
+    return CaptureWorker( token, welcome );
+#endif
+
+#ifdef TRACY_FAN_OUT
+    const char* fanOutWait = GetEnvVar( "TRACY_FAN_OUT_WAIT" );
+    if( fanOutWait && atoi( fanOutWait ) >= 0 ) m_fanOutWait = atoi( fanOutWait );
+    const char* fanOutBacklog = GetEnvVar( "TRACY_FAN_OUT_BACKLOG" );
+    if( fanOutBacklog && atoi( fanOutBacklog ) > 0 ) m_fanOutLimit = size_t( atoi( fanOutBacklog ) ) * 1024 * 1024;
+#endif
 
     ListenSocket listen;
     bool isListening = false;
@@ -1772,6 +2207,9 @@ void Profiler::Worker()
 #  else
     const char* addr = "255.255.255.255";
 #  endif
+    // Announcing to a multicast group instead only reaches the servers which listen for it.
+    const char* broadcastGroup = GetEnvVar( "TRACY_BROADCAST_GROUP" );
+    if( broadcastGroup ) addr = broadcastGroup;
     if( !m_broadcast->Open( addr, broadcastPort ) )
     {
         m_broadcast->~UdpBroadcast();
@@ -1782,7 +2220,19 @@ void Profiler::Worker()
 
     int broadcastLen = 0;
     auto& broadcastMsg = GetBroadcastMessage( procname, pnsz, broadcastLen, dataPort );
-    uint64_t lastBroadcast = 0;
+
+    // Servers drop clients they have not heard from for a few seconds, so announcements go out
+    // every 3 s. With TRACY_BROADCAST_MAX_INTERVAL, in seconds, the interval doubles after each
+    // announcement nobody answers, up to that, for hosts running many idle clients. Up to a tenth
+    // of the interval is randomly taken off, so that processes started together don't announce
+    // together.
+    constexpr int64_t BroadcastInterval = 3000000000;
+    int64_t broadcastMaxInterval = BroadcastInterval;
+    const char* broadcastMax = GetEnvVar( "TRACY_BROADCAST_MAX_INTERVAL" );
+    if( broadcastMax && atoi( broadcastMax ) > 3 ) broadcastMaxInterval = int64_t( atoi( broadcastMax ) ) * 1000000000;
+    int64_t broadcastInterval = BroadcastInterval;
+    int64_t nextBroadcast = 0;
+    uint64_t broadcastRng = GetPid() * 0x9E3779B97F4A7C15ull + uint64_t( std::chrono::high_resolution_clock::now().time_since_epoch().count() );
 
     // Connections loop.
     // Each iteration of the loop handles whole connection. Multiple iterations will only
@@ -1804,19 +2254,34 @@ void Profiler::Worker()
                 return;
             }
 #endif
+#ifdef TRACY_ON_DEMAND
+            // Nothing else needs the thread until a server connects, but shutdown is only seen in
+            // between the waits.
+            m_sock = listen.Accept( 100 );
+#else
             m_sock = listen.Accept();
+#endif
             if( m_sock ) break;
 #ifndef TRACY_ON_DEMAND
-            ProcessSysTime();
-#  ifdef TRACY_HAS_SYSPOWER
-            m_sysPower.Tick();
+#  ifdef TRACY_MEMORY_AGGREGATION
+            m_memAggregate.Tick();
 #  endif
+#  ifdef TRACY_HAS_ZONE_STATS
+            m_zoneStats.Tick();
+#  endif
+            PlotDownsampleFlush();
+#  ifdef TRACY_HAS_TSC_TIMER
+            TscTimerRevalidate();
+#  endif
+            if( m_recorder ) RecordFlight( token );
+#else
+            CompactDeferredQueue();
 #endif
 
             if( m_broadcast )
             {
                 const auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-                if( t - lastBroadcast > 3000000000 )  // 3s
+                if( t >= nextBroadcast )
                 {
                     m_programNameLock.lock();
                     if( m_programName )
@@ -1826,7 +2291,11 @@ void Profiler::Worker()
                     }
                     m_programNameLock.unlock();
 
-                    lastBroadcast = t;
+                    broadcastRng ^= broadcastRng << 13;
+                    broadcastRng ^= broadcastRng >> 7;
+                    broadcastRng ^= broadcastRng << 17;
+                    nextBroadcast = t + broadcastInterval - int64_t( broadcastRng % uint64_t( broadcastInterval / 10 ) );
+                    broadcastInterval = std::min( broadcastInterval * 2, broadcastMaxInterval );
                     const auto ts = std::chrono::duration_cast<std::chrono::seconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
                     broadcastMsg.activeTime = int32_t( ts - m_epoch );
                     assert( broadcastMsg.activeTime >= 0 );
@@ -1837,7 +2306,8 @@ void Profiler::Worker()
 
         if( m_broadcast )
         {
-            lastBroadcast = 0;
+            nextBroadcast = 0;
+            broadcastInterval = BroadcastInterval;
             broadcastMsg.activeTime = -1;
             m_broadcast->Send( broadcastPort, &broadcastMsg, broadcastLen );
         }
@@ -1875,12 +2345,23 @@ void Profiler::Worker()
             }
         }
 
+#ifdef TRACY_FAN_OUT
+        GatherFanOut( listen );
+#endif
+
 #ifdef TRACY_ON_DEMAND
         while( m_symbolsBusy.load( std::memory_order_acquire ) ) { YieldThread(); }
         m_symbolsBusy.store( true, std::memory_order_release );
         const auto currentTime = GetTime();
         ClearQueues( token );
         m_connectionId.fetch_add( 1, std::memory_order_release );
+#else
+        if( m_recorder )
+        {
+            FinishFlight();
+            // Allocations made before the retained part of the recording are not known to the server.
+            if( m_recorder->HasDropped() ) MemWrite( &welcome.flags, uint8_t( flags | WelcomeFlag::IgnoreMemFaults ) );
+        }
 #endif
         m_isConnected.store( true, std::memory_order_release );
         InstallCrashHandler();
@@ -1888,60 +2369,57 @@ void Profiler::Worker()
         HandshakeStatus handshake = HandshakeWelcome;
         m_sock->Send( &handshake, sizeof( handshake ) );
 
-        LZ4_resetStream( (LZ4_stream_t*)m_stream );
+        ResetLz4Stream();
         m_sock->Send( &welcome, sizeof( welcome ) );
+#ifdef TRACY_FAN_OUT
+        const SocketChunk welcomeChunks[] = { { &handshake, sizeof( handshake ) }, { &welcome, sizeof( welcome ) } };
+        SendFanOut( welcomeChunks, 2 );
+#endif
 
         m_threadCtx = 0;
         m_refTimeSerial = 0;
         m_refTimeCtx = 0;
         m_refTimeGpu = 0;
 
+        bool replayed = true;
+#ifndef TRACY_ON_DEMAND
+        // If the replay fails, the server is gone and the recording is discarded along with it.
+        if( m_recorder ) replayed = ReplayFlight();
+#endif
+
 #ifdef TRACY_ON_DEMAND
         OnDemandPayloadMessage onDemand;
         onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
         onDemand.currentTime = currentTime;
 
         m_sock->Send( &onDemand, sizeof( onDemand ) );
+#  ifdef TRACY_FAN_OUT
+        const SocketChunk onDemandChunk = { &onDemand, sizeof( onDemand ) };
+        SendFanOut( &onDemandChunk, 1 );
+#  endif
 
-        m_deferredLock.lock();
-        for( auto& item : m_deferredQueue )
-        {
-            uint64_t ptr;
-            uint16_t size;
-            const auto idx = MemRead<uint8_t>( &item.hdr.idx );
-            switch( (QueueType)idx )
-            {
-            case QueueType::MessageAppInfo:
-                ptr = MemRead<TaggedUserlandAddress>( &item.messageFat.textAndMetadata ).GetAddress();
-                size = MemRead<uint16_t>( &item.messageFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            case QueueType::LockName:
-                ptr = MemRead<uint64_t>( &item.lockNameFat.name );
-                size = MemRead<uint16_t>( &item.lockNameFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            case QueueType::GpuContextName:
-                ptr = MemRead<uint64_t>( &item.gpuContextNameFat.ptr );
-                size = MemRead<uint16_t>( &item.gpuContextNameFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            default:
-                break;
-            }
-            AppendData( &item, QueueDataSize[idx] );
-        }
-        m_deferredLock.unlock();
+        SendDeferredQueue();
 #endif
 
         // Main communications loop
         int keepAlive = 0;
-        for(;;)
+        ResetStatsTick();
+        while( replayed )
         {
-            ProcessSysTime();
-#ifdef TRACY_HAS_SYSPOWER
-            m_sysPower.Tick();
+#ifdef TRACY_MEMORY_AGGREGATION
+            m_memAggregate.Tick();
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+            m_zoneStats.Tick();
 #endif
+            PlotDownsampleFlush();
+#ifdef TRACY_ON_DEMAND
+            CompactDeferredQueue();
+#endif
+#ifdef TRACY_HAS_TSC_TIMER
+            TscTimerRevalidate();
+#endif
+            TickStats();
             const auto status = Dequeue( token );
             const auto serialStatus = DequeueSerial();
             if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost )
@@ -1954,7 +2432,11 @@ void Profiler::Worker()
                 {
                     if( !CommitData() ) break;
                 }
-                if( keepAlive == 500 )
+                else if( !SendLz4Frames( true ) ) break;
+#ifdef TRACY_FAN_OUT
+                PollFanOut();
+#endif
+                if( keepAlive >= 500 )
                 {
                     QueueItem ka;
                     ka.hdr.type = QueueType::KeepAlive;
@@ -1965,27 +2447,50 @@ void Profiler::Worker()
                 }
                 else if( !m_sock->HasData() )
                 {
+#ifdef TRACY_WORKER_WAKEUP
+                    // The keep alive counts in units of 10 ms, which only the waits which run
+                    // into the timeout add to.
+                    keepAlive += IdleWait() / 10;
+#else
                     keepAlive++;
-                    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                    IdleSleep( 10 );
+#endif
                 }
             }
             else
             {
                 keepAlive = 0;
+#ifdef TRACY_WORKER_WAKEUP
+                m_idleBusy = true;
+#endif
             }
 
             bool connActive = true;
+            bool answered = false;
             while( m_sock->HasData() )
             {
-                connActive = HandleServerQuery();
+                connActive = HandleServerQueries();
+                answered = true;
                 if( !connActive ) break;
             }
             if( !connActive || ShouldExit() ) break;
+#ifdef TRACY_FAN_OUT
+            if( !HandleFanOutQueries() ) break;
+#endif
+            // The answers would otherwise wait for the frame to fill up, or for the queues to run
+            // dry, while the server shows the zones it asked about without a name.
+            if( answered && m_bufferOffset != m_bufferStart && !CommitData() ) break;
         }
         if( ShouldExit() ) break;
 
         m_isConnected.store( false, std::memory_order_release );
         RemoveCrashHandler();
+#ifdef TRACY_FAN_OUT
+        while( m_fanOutCount != 0 ) CloseFanOut( 0 );
+#endif
+#ifdef TRACY_HAS_SHM_TRANSPORT
+        EndShmTransport();
+#endif
 
 #ifdef TRACY_ON_DEMAND
         m_bufferOffset = 0;
@@ -2076,7 +2581,7 @@ void Profiler::Worker()
 
         while( m_sock->HasData() )
         {
-            if( !HandleServerQuery() )
+            if( !HandleServerQueries() )
             {
                 m_shutdownFinished.store( true, std::memory_order_relaxed );
                 return;
@@ -2107,12 +2612,18 @@ void Profiler::Worker()
     {
         while( m_sock->HasData() )
         {
-            if( !HandleServerQuery() )
+            if( !HandleServerQueries() )
             {
+#ifdef TRACY_FAN_OUT
+                FinishFanOut();
+#endif
                 m_shutdownFinished.store( true, std::memory_order_relaxed );
                 return;
             }
         }
+#ifdef TRACY_FAN_OUT
+        PollFanOut();
+#endif
 #ifdef TRACY_HAS_CALLSTACK
         for(;;)
         {
@@ -2140,103 +2651,729 @@ void Profiler::Worker()
     }
 }
 
-#ifndef TRACY_NO_FRAME_IMAGE
-void Profiler::CompressWorker()
+#ifdef TRACY_ON_DEMAND
+void Profiler::SendDeferredQueue()
 {
-    ThreadExitHandler threadExitHandler;
-    SetThreadName( "Tracy DXT1" );
-    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
-
-#ifdef TRACY_USE_RPMALLOC
-    rpmalloc_thread_initialize();
-#endif
-
-    for(;;)
+    m_deferredLock.lock();
+    for( auto& item : m_deferredQueue )
     {
-        const auto shouldExit = ShouldExit();
-
+        uint64_t ptr;
+        uint16_t size;
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        switch( (QueueType)idx )
         {
-            bool lockHeld = true;
-            while( !m_fiLock.try_lock() )
-            {
-                if( m_shutdownManual.load( std::memory_order_relaxed ) )
-                {
-                    lockHeld = false;
-                    break;
-                }
-            }
-            if( !m_fiQueue.empty() ) m_fiQueue.swap( m_fiDequeue );
-            if( lockHeld )
-            {
-                m_fiLock.unlock();
-            }
+        case QueueType::MessageAppInfo:
+            ptr = MemRead<TaggedUserlandAddress>( &item.messageFat.textAndMetadata ).GetAddress();
+            size = MemRead<uint16_t>( &item.messageFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        case QueueType::LockName:
+            ptr = MemRead<uint64_t>( &item.lockNameFat.name );
+            size = MemRead<uint16_t>( &item.lockNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        case QueueType::GpuContextName:
+            ptr = MemRead<uint64_t>( &item.gpuContextNameFat.ptr );
+            size = MemRead<uint16_t>( &item.gpuContextNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        default:
+            break;
         }
+        AppendData( &item, QueueDataSize[idx] );
+    }
+    m_deferredLock.unlock();
+}
 
-        const auto sz = m_fiDequeue.size();
-        if( sz > 0 )
-        {
-            auto fi = m_fiDequeue.data();
-            auto end = fi + sz;
-            while( fi != end )
-            {
-                const auto w = fi->w;
-                const auto h = fi->h;
-                const auto csz = size_t( w * h / 2 );
-                auto etc1buf = (char*)tracy_malloc( csz );
-                CompressImageDxt1( (const char*)fi->image, etc1buf, w, h );
-                tracy_free( fi->image );
-
-                TracyLfqPrepare( QueueType::FrameImage );
-                MemWrite( &item->frameImageFat.image, (uint64_t)etc1buf );
-                MemWrite( &item->frameImageFat.frame, fi->frame );
-                MemWrite( &item->frameImageFat.w, w );
-                MemWrite( &item->frameImageFat.h, h );
-                uint8_t flip = fi->flip;
-                MemWrite( &item->frameImageFat.flip, flip );
-                TracyLfqCommit;
+void Profiler::CompactDeferredQueue()
+{
+    if( m_deferredDead.load( std::memory_order_relaxed ) < m_deferredCompactAt ) return;
 
-                fi++;
-            }
-            m_fiDequeue.clear();
-        }
-        else
-        {
-            std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
-        }
+    m_deferredLock.lock();
+    // The announce, name and terminate items of a dead lock are of no use to a server which is yet
+    // to connect. Lock ids are never reused.
+    FastVector<uint32_t> dead( 1024 );
+    for( auto& item : m_deferredQueue )
+    {
+        if( item.hdr.type == QueueType::LockTerminate ) *dead.push_next() = MemRead<uint32_t>( &item.lockTerminate.id );
+    }
+    std::sort( dead.begin(), dead.end() );
 
-        if( shouldExit )
+    size_t num = 0;
+    auto dst = m_deferredQueue.begin();
+    for( auto it = m_deferredQueue.begin(); it != m_deferredQueue.end(); ++it )
+    {
+        bool isDead = false;
+        switch( it->hdr.type )
         {
-            return;
+        case QueueType::LockAnnounce:
+            isDead = std::binary_search( dead.begin(), dead.end(), MemRead<uint32_t>( &it->lockAnnounce.id ) );
+            break;
+        case QueueType::LockTerminate:
+            isDead = true;
+            break;
+        case QueueType::LockName:
+            // The name itself may still be referenced by the serial queue, so it stays allocated.
+            isDead = std::binary_search( dead.begin(), dead.end(), MemRead<uint32_t>( &it->lockNameFat.id ) );
+            break;
+        default:
+            break;
         }
+        if( isDead ) continue;
+        if( dst != it ) memcpy( dst.get(), it.get(), sizeof( QueueItem ) );
+        ++dst;
+        num++;
     }
+    m_deferredQueue.truncate( num );
+    m_deferredDead.store( 0, std::memory_order_relaxed );
+    m_deferredCompactAt = std::max<size_t>( 1024, num / 2 );
+    m_deferredLock.unlock();
 }
 #endif
 
-static void FreeAssociatedMemory( const QueueItem& item )
-{
-    if( item.hdr.idx >= (int)QueueType::Terminate ) return;
-
+#ifndef TRACY_ON_DEMAND
+// Serializes queued events into the flight recorder while waiting for a server. Segments start
+// on an empty frame buffer with the thread context reset, so that each of them can be decoded on
+// its own once older data is dropped.
+void Profiler::RecordFlight( EventConsumerToken& token )
+{
+    // Queues have to be kept drained for memory use to stay bounded. Return to the listen socket
+    // now and then, in case producers are faster than the worker.
+    const auto start = std::chrono::steady_clock::now();
+    for(;;)
+    {
+        if( m_recorder->IsSegmentDue() )
+        {
+            if( m_bufferOffset != m_bufferStart ) CommitData();
+            m_threadCtx = 0;
+            m_recorder->BeginSegment( { m_refTimeSerial, m_refTimeCtx, m_refTimeGpu } );
+        }
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty ) break;
+        if( std::chrono::steady_clock::now() - start > std::chrono::milliseconds( 100 ) ) break;
+    }
+}
+
+void Profiler::FinishFlight()
+{
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+    m_recorder->Finish( { m_refTimeSerial, m_refTimeCtx, m_refTimeGpu } );
+}
+
+// Sends the recording to a freshly connected server. Recorded frames were encoded against the
+// references of the recording, which are taken over for the data that follows.
+bool Profiler::ReplayFlight()
+{
+    if( m_recorder->IsEmpty() ) return true;
+    const auto& refs = m_recorder->FinalRefs();
+    m_refTimeSerial = refs.serial;
+    m_refTimeCtx = refs.ctx;
+    m_refTimeGpu = refs.gpu;
+    return m_recorder->Replay( [this]( const char* data, size_t len ) { return SendData( data, len, false ); } );
+}
+#endif
+
+#ifdef TRACY_OFFLINE_CAPTURE
+// Offline capture has no server to talk to. The stream is written to a set of rotating files,
+// each of them starting like a fresh connection would, so every file can be imported on its own.
+// The queries a server would issue are derived from the outgoing frames, see ScanCaptureFrame().
+void Profiler::CaptureWorker( EventConsumerToken& token, const WelcomeMessage& welcome )
+{
+#ifdef TRACY_ON_DEMAND
+    m_connectionId.fetch_add( 1, std::memory_order_release );
+#endif
+    m_isConnected.store( true, std::memory_order_release );
+    if( !StartCaptureFile( welcome ) )
+    {
+        m_isConnected.store( false, std::memory_order_release );
+        for(;;)
+        {
+            if( ShouldExit() )
+            {
+                m_shutdownFinished.store( true, std::memory_order_relaxed );
+                return;
+            }
+
+            ClearQueues( token );
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+    InstallCrashHandler();
+
+    bool active = true;
+    ResetStatsTick();
+    while( active && !ShouldExit() )
+    {
+#ifdef TRACY_MEMORY_AGGREGATION
+        m_memAggregate.Tick();
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        m_zoneStats.Tick();
+#endif
+        PlotDownsampleFlush();
+#ifdef TRACY_HAS_TSC_TIMER
+        TscTimerRevalidate();
+#endif
+        TickStats();
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost ) break;
+        const bool idle = status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty && m_captureQueries.empty();
+        if( !HandleCaptureQueries() ) break;
+        if( idle )
+        {
+            if( m_bufferOffset != m_bufferStart )
+            {
+                if( !CommitData() ) break;
+            }
+            else if( !SendLz4Frames( true ) ) break;
+#ifdef TRACY_WORKER_WAKEUP
+            if( m_captureQueries.empty() ) IdleWait();
+#else
+            if( m_captureQueries.empty() ) IdleSleep( 10 );
+#endif
+        }
+#ifdef TRACY_WORKER_WAKEUP
+        else
+        {
+            m_idleBusy = true;
+        }
+#endif
+        active = RotateCaptureFile( welcome );
+    }
+
+    if( active )
+    {
+#ifdef TRACY_HAS_CALLSTACK
+        while( s_symbolThreadGone.load() == false ) { YieldThread(); }
+#endif
+#ifdef TRACY_HAS_SYSTEM_TRACING
+        StopSystemTracing();
+#endif
+
+        // Write items remaining in queues, along with everything they reference.
+        for(;;)
+        {
+            const auto status = Dequeue( token );
+            const auto serialStatus = DequeueSerial();
+            if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost ) break;
+            if( !HandleCaptureQueries() ) break;
+#ifdef TRACY_HAS_CALLSTACK
+            for(;;)
+            {
+                auto si = m_symbolQueue.front();
+                if( !si ) break;
+                HandleSymbolQueueItem( *si );
+                m_symbolQueue.pop();
+            }
+#endif
+            if( !RotateCaptureFile( welcome ) ) break;
+            if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty )
+            {
+                if( m_bufferOffset != m_bufferStart && !CommitData() ) break;
+#ifdef TRACY_HAS_CALLSTACK
+                if( m_captureQueries.empty() && !m_symbolQueue.front() )
+#else
+                if( m_captureQueries.empty() )
+#endif
+                {
+                    QueueItem terminate;
+                    MemWrite( &terminate.hdr.type, QueueType::Terminate );
+                    SendData( (const char*)&terminate, 1 );
+                    break;
+                }
+            }
+        }
+    }
+
+    m_capture->Close();
+    m_shutdownFinished.store( true, std::memory_order_relaxed );
+}
+
+// Rotation happens between items. Everything written so far, including replies to the queries it
+// raised, goes to the old file. Replies which are produced asynchronously (symbol resolution) may
+// still land in the new one.
+bool Profiler::RotateCaptureFile( const WelcomeMessage& welcome )
+{
+    if( !m_capture->IsFull() ) return true;
+    for(;;)
+    {
+        if( !HandleCaptureQueries() ) return false;
+        if( m_bufferOffset == m_bufferStart ) break;
+        if( !CommitData() ) return false;
+    }
+    return SendLz4Frames( true ) && StartCaptureFile( welcome );
+}
+
+// Writes the part of a connection handshake the server would have received from the client.
+bool Profiler::StartCaptureFile( const WelcomeMessage& welcome )
+{
+    if( !m_capture->Open() ) return false;
+
+    ResetLz4Stream();
+    m_threadCtx = 0;
+    m_refTimeSerial = 0;
+    m_refTimeCtx = 0;
+    m_refTimeGpu = 0;
+    m_captureSeen->Clear();
+    m_captureQueries.clear();
+
+    const uint32_t protocolVersion = ProtocolVersion;
+    const HandshakeStatus handshake = HandshakeWelcome;
+    if( !m_capture->Write( HandshakeShibboleth, HandshakeShibbolethSize ) ) return false;
+    if( !m_capture->Write( &protocolVersion, sizeof( protocolVersion ) ) ) return false;
+    if( !m_capture->Write( &handshake, sizeof( handshake ) ) ) return false;
+    if( !m_capture->Write( &welcome, sizeof( welcome ) ) ) return false;
+#ifdef TRACY_ON_DEMAND
+    OnDemandPayloadMessage onDemand;
+    onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
+    onDemand.currentTime = GetTime();
+    if( !m_capture->Write( &onDemand, sizeof( onDemand ) ) ) return false;
+
+    SendDeferredQueue();
+#endif
+    return true;
+}
+
+// Queues the queries a server would issue after receiving this frame. Payloads sent in reply
+// are scanned in turn when their frame is committed.
+void Profiler::ScanCaptureFrame( const char* ptr, size_t len )
+{
+    const auto end = ptr + len;
+    while( ptr < end )
+    {
+        const auto idx = MemRead<uint8_t>( ptr );
+        if( idx >= (uint8_t)QueueType::StringData )
+        {
+            ptr += sizeof( QueueHeader ) + sizeof( QueueStringTransfer );
+            uint32_t sz;
+            if( idx == (uint8_t)QueueType::FrameImageData || idx == (uint8_t)QueueType::SymbolCode || idx == (uint8_t)QueueType::SourceCode )
+            {
+                sz = MemRead<uint32_t>( ptr );
+                ptr += sizeof( uint32_t );
+            }
+            else
+            {
+                sz = MemRead<uint16_t>( ptr );
+                ptr += sizeof( uint16_t );
+            }
+            if( idx == (uint8_t)QueueType::CallstackPayload )
+            {
+                for( uint32_t i=0; i<sz/8; i++ )
+                {
+                    QueueCaptureQuery( ServerQueryCallstackFrame, MemRead<uint64_t>( ptr + i*8 ) );
+                }
+            }
+            ptr += sz;
+            continue;
+        }
+        if( idx == (uint8_t)QueueType::SingleStringData || idx == (uint8_t)QueueType::SecondStringData )
+        {
+            ptr += sizeof( QueueHeader );
+            const auto sz = MemRead<uint16_t>( ptr );
+            ptr += sizeof( uint16_t ) + sz;
+            continue;
+        }
+
+        QueueItem item;
+        memcpy( &item, ptr, QueueDataSize[idx] );
+        ptr += QueueDataSize[idx];
+        switch( (QueueType)idx )
+        {
+        case QueueType::ThreadContext:
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.threadCtx.thread ) );
+            break;
+        case QueueType::ZoneBegin:
+        case QueueType::ZoneBeginCallstack:
+            QueueCaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item.zoneBegin.srcloc ) );
+            break;
+        case QueueType::GpuZoneBegin:
+        case QueueType::GpuZoneBeginCallstack:
+        case QueueType::GpuZoneBeginSerial:
+        case QueueType::GpuZoneBeginCallstackSerial:
+            QueueCaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item.gpuZoneBegin.srcloc ) );
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.gpuZoneBegin.thread ) );
+            break;
+        case QueueType::GpuZoneBeginAllocSrcLoc:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstack:
+        case QueueType::GpuZoneBeginAllocSrcLocSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.gpuZoneBegin.thread ) );
+            break;
+        case QueueType::LockAnnounce:
+            QueueCaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item.lockAnnounce.lckloc ) );
+            break;
+        case QueueType::SourceLocation:
+            QueueCaptureQuery( ServerQueryString, MemRead<uint64_t>( &item.srcloc.name ) );
+            QueueCaptureQuery( ServerQueryString, MemRead<uint64_t>( &item.srcloc.function ) );
+            QueueCaptureQuery( ServerQueryString, MemRead<uint64_t>( &item.srcloc.file ) );
+            break;
+        case QueueType::PlotDataInt:
+        case QueueType::PlotDataFloat:
+        case QueueType::PlotDataDouble:
+            QueueCaptureQuery( ServerQueryPlotName, MemRead<uint64_t>( &item.plotDataInt.name ) );
+            break;
+        case QueueType::PlotConfig:
+            QueueCaptureQuery( ServerQueryPlotName, MemRead<uint64_t>( &item.plotConfig.name ) );
+            break;
+        case QueueType::FrameMarkMsg:
+        case QueueType::FrameMarkMsgStart:
+        case QueueType::FrameMarkMsgEnd:
+            QueueCaptureQuery( ServerQueryFrameName, MemRead<uint64_t>( &item.frameMark.name ) );
+            break;
+        case QueueType::MessageLiteral:
+        case QueueType::MessageLiteralCallstack:
+            QueueCaptureQuery( ServerQueryString, MemRead<TaggedUserlandAddress>( &item.messageLiteral.textAndMetadata ).GetAddress() );
+            break;
+        case QueueType::MessageLiteralColor:
+        case QueueType::MessageLiteralColorCallstack:
+            QueueCaptureQuery( ServerQueryString, MemRead<TaggedUserlandAddress>( &item.messageColorLiteral.textAndMetadata ).GetAddress() );
+            break;
+        case QueueType::MemNamePayload:
+            QueueCaptureQuery( ServerQueryString, MemRead<uint64_t>( &item.memName.name ) );
+            break;
+        case QueueType::MemDiscard:
+        case QueueType::MemDiscardCallstack:
+            QueueCaptureQuery( ServerQueryString, MemRead<uint64_t>( &item.memDiscard.name ) );
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.memDiscard.thread ) );
+            break;
+        case QueueType::MemAlloc:
+        case QueueType::MemAllocNamed:
+        case QueueType::MemAllocCallstack:
+        case QueueType::MemAllocCallstackNamed:
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.memAlloc.thread ) );
+            break;
+        case QueueType::MemFree:
+        case QueueType::MemFreeNamed:
+        case QueueType::MemFreeCallstack:
+        case QueueType::MemFreeCallstackNamed:
+            QueueCaptureQuery( ServerQueryThreadString, MemRead<uint32_t>( &item.memFree.thread ) );
+            break;
+        case QueueType::CallstackFrame:
+            QueueCaptureQuery( ServerQuerySymbol, MemRead<uint64_t>( &item.callstackFrame.symAddr ) );
+            break;
+#ifdef TRACY_FIBERS
+        case QueueType::FiberEnter:
+            QueueCaptureQuery( ServerQueryFiberName, MemRead<uint64_t>( &item.fiberEnter.fiber ) );
+            break;
+#endif
+#ifdef TRACY_HAS_SYSTEM_TRACING
+        case QueueType::ContextSwitch:
+            QueueCaptureQuery( ServerQueryExternalName, MemRead<uint32_t>( &item.contextSwitch.oldThread ) );
+            QueueCaptureQuery( ServerQueryExternalName, MemRead<uint32_t>( &item.contextSwitch.newThread ) );
+            break;
+        case QueueType::ThreadWakeup:
+            QueueCaptureQuery( ServerQueryExternalName, MemRead<uint32_t>( &item.threadWakeup.thread ) );
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+}
+
+void Profiler::QueueCaptureQuery( ServerQuery type, uint64_t ptr )
+{
+    if( ptr == 0 || !m_captureSeen->Insert( type, ptr ) ) return;
+    auto query = m_captureQueries.push_next();
+    query->type = type;
+    query->ptr = ptr;
+    query->extra = 0;
+}
+
+bool Profiler::HandleCaptureQueries()
+{
+    // Replies may queue further queries, which are handled in the next pass.
+    while( !m_captureQueries.empty() )
+    {
+        m_captureQueries.swap( m_captureDequeue );
+        for( auto& query : m_captureDequeue )
+        {
+            if( !HandleServerQuery( query ) ) return false;
+        }
+        m_captureDequeue.clear();
+    }
+    return true;
+}
+#endif
+
+#ifndef TRACY_NO_FRAME_IMAGE
+void Profiler::CompressWorker()
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy DXT1" );
+    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+#ifdef TRACY_USE_RPMALLOC
+    rpmalloc_thread_initialize();
+#endif
+
+    for(;;)
+    {
+        const auto shouldExit = ShouldExit();
+
+        {
+            bool lockHeld = true;
+            while( !m_fiLock.try_lock() )
+            {
+                if( m_shutdownManual.load( std::memory_order_relaxed ) )
+                {
+                    lockHeld = false;
+                    break;
+                }
+            }
+            if( !m_fiQueue.empty() ) m_fiQueue.swap( m_fiDequeue );
+            if( lockHeld )
+            {
+                m_fiLock.unlock();
+            }
+        }
+
+        const auto sz = m_fiDequeue.size();
+        if( sz > 0 )
+        {
+            auto fi = m_fiDequeue.begin();
+            const auto end = m_fiDequeue.end();
+            while( fi != end )
+            {
+                const auto w = fi->w;
+                const auto h = fi->h;
+                const auto csz = size_t( w * h / 2 );
+                auto etc1buf = (char*)tracy_malloc( csz );
+                CompressFrameImage( (const char*)fi->image, etc1buf, w, h );
+                tracy_free( fi->image );
+                m_fiPending.fetch_sub( size_t( w ) * size_t( h ) * 4, std::memory_order_relaxed );
+
+                TracyLfqPrepare( QueueType::FrameImage );
+                MemWrite( &item->frameImageFat.image, (uint64_t)etc1buf );
+                MemWrite( &item->frameImageFat.frame, fi->frame );
+                MemWrite( &item->frameImageFat.w, w );
+                MemWrite( &item->frameImageFat.h, h );
+                uint8_t flip = fi->flip;
+                MemWrite( &item->frameImageFat.flip, flip );
+                TracyLfqCommit;
+
+                ++fi;
+            }
+            m_fiDequeue.clear();
+        }
+        else
+        {
+#ifdef TRACY_WORKER_WAKEUP
+            m_fiWakeup.Park( 20 );
+#else
+            std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+#endif
+        }
+        ReportFrameImageStats();
+
+        if( shouldExit )
+        {
+            return;
+        }
+    }
+}
+
+void Profiler::DownscaleFrameImage( const char* src, char* dst, uint16_t w, uint16_t h )
+{
+    // 2x2 box filter, separately on each channel.
+    const auto stride = size_t( w ) * 4;
+    for( int y=0; y<h/2; y++ )
+    {
+        auto r0 = (const uint8_t*)src + stride * y * 2;
+        auto r1 = r0 + stride;
+        for( int x=0; x<w/2; x++ )
+        {
+            for( int c=0; c<4; c++ )
+            {
+                *dst++ = char( ( r0[c] + r0[c+4] + r1[c] + r1[c+4] + 2 ) >> 2 );
+            }
+            r0 += 8;
+            r1 += 8;
+        }
+    }
+}
+
+void Profiler::ReportFrameImageStats()
+{
+    const auto dropped = m_fiDropped.load( std::memory_order_relaxed );
+    if( dropped != m_fiDroppedReported )
+    {
+        m_fiDroppedReported = dropped;
+        PlotData( "Tracy frame images dropped", int64_t( dropped ) );
+    }
+    const auto downscaled = m_fiDownscaled.load( std::memory_order_relaxed );
+    if( downscaled != m_fiDownscaledReported )
+    {
+        m_fiDownscaledReported = downscaled;
+        PlotData( "Tracy frame images downscaled", int64_t( downscaled ) );
+    }
+}
+
+// Rows of pixels in a tile. A multiple of the DXT1 block height.
+static constexpr int FrameImageTileRows = 32;
+
+void Profiler::CompressFrameImage( const char* src, char* dst, int w, int h )
+{
+    if( m_fiThreads == 0 || h <= FrameImageTileRows )
+    {
+        CompressImageDxt1( src, dst, w, h );
+        return;
+    }
+
+    const auto tiles = uint32_t( ( h + FrameImageTileRows - 1 ) / FrameImageTileRows );
+    std::unique_lock<std::mutex> lock( m_fiTileLock );
+    m_fiTileSrc = src;
+    m_fiTileDst = dst;
+    m_fiTileW = w;
+    m_fiTileH = h;
+    m_fiTileCount = tiles;
+    m_fiTileNext = 0;
+    m_fiTileDone = 0;
+    lock.unlock();
+    m_fiTileWake.notify_all();
+
+    // Take part in the work, instead of waiting idle for the pool.
+    for(;;)
+    {
+        lock.lock();
+        if( m_fiTileNext == tiles ) break;
+        const auto tile = m_fiTileNext++;
+        lock.unlock();
+        CompressImageTile( tile );
+        lock.lock();
+        m_fiTileDone++;
+        lock.unlock();
+    }
+    m_fiTileFinished.wait( lock, [this, tiles] { return m_fiTileDone == tiles; } );
+}
+
+void Profiler::CompressImageTile( uint32_t tile )
+{
+    const auto w = m_fiTileW;
+    const auto y = int( tile ) * FrameImageTileRows;
+    const auto rows = std::min( FrameImageTileRows, m_fiTileH - y );
+    // Each row of 4x4 blocks takes w * 2 bytes of DXT1 data.
+    CompressImageDxt1( m_fiTileSrc + size_t( y ) * w * 4, m_fiTileDst + size_t( y ) * w / 2, w, rows );
+}
+
+void Profiler::CompressTileWorker()
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy DXT1" );
+
+#ifdef TRACY_USE_RPMALLOC
+    rpmalloc_thread_initialize();
+#endif
+
+    for(;;)
+    {
+        std::unique_lock<std::mutex> lock( m_fiTileLock );
+        m_fiTileWake.wait( lock, [this] { return m_fiTileNext != m_fiTileCount || m_fiTileExit; } );
+        if( m_fiTileNext == m_fiTileCount ) break;
+        const auto tile = m_fiTileNext++;
+        lock.unlock();
+
+        CompressImageTile( tile );
+
+        lock.lock();
+        const auto finished = ++m_fiTileDone == m_fiTileCount;
+        lock.unlock();
+        if( finished ) m_fiTileFinished.notify_one();
+    }
+}
+#endif
+
+#ifdef TRACY_HAS_SYS_SAMPLER
+void Profiler::SysSamplerWorker()
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy System Sampler" );
+    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+#ifdef TRACY_USE_RPMALLOC
+    rpmalloc_thread_initialize();
+#endif
+
+    SysSampler sampler;
+    sampler.Run();
+}
+#endif
+
+void Profiler::Lz4Worker()
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy LZ4" );
+
+#ifdef TRACY_USE_RPMALLOC
+    rpmalloc_thread_initialize();
+#endif
+
+    auto stream = LZ4_createStream();
+    LZ4_streamHC_t* streamHC = nullptr;
+    for(;;)
+    {
+        std::unique_lock<std::mutex> lock( m_lz4Lock );
+        m_lz4Wake.wait( lock, [this] { return m_lz4Next != m_lz4Tail || m_lz4Exit; } );
+        if( m_lz4Next == m_lz4Tail ) break;
+        auto& job = m_lz4Jobs[m_lz4Next++ % m_lz4JobCount];
+        lock.unlock();
+
+        // Dictionary and frame are contiguous, so LZ4 treats the dictionary as a prefix.
+        const auto level = Lz4Levels[job.level];
+        lz4sz_t lz4sz;
+        if( level > 0 )
+        {
+            if( !streamHC ) streamHC = LZ4_createStreamHC();
+            LZ4_resetStreamHC_fast( streamHC, level );
+            LZ4_loadDictHC( streamHC, job.src, job.dictSize );
+            lz4sz = LZ4_compress_HC_continue( streamHC, job.src + job.dictSize, job.dst + sizeof( lz4sz_t ), job.srcSize, m_lz4Size );
+        }
+        else
+        {
+            LZ4_loadDict( stream, job.src, job.dictSize );
+            lz4sz = LZ4_compress_fast_continue( stream, job.src + job.dictSize, job.dst + sizeof( lz4sz_t ), job.srcSize, m_lz4Size, -level );
+        }
+        memcpy( job.dst, &lz4sz, sizeof( lz4sz ) );
+
+        lock.lock();
+        job.done = true;
+        lock.unlock();
+        m_lz4Done.notify_one();
+    }
+    LZ4_freeStream( stream );
+    if( streamHC ) LZ4_freeStreamHC( streamHC );
+}
+
+static void FreeAssociatedMemory( const QueueItem& item )
+{
+    if( item.hdr.idx >= (int)QueueType::Terminate ) return;
+
     uint64_t ptr;
     switch( item.hdr.type )
     {
     case QueueType::ZoneText:
     case QueueType::ZoneName:
         ptr = MemRead<uint64_t>( &item.zoneTextFat.text );
-        tracy_free( (void*)ptr );
+        StringArenaFree( (const char*)ptr );
         break;
     case QueueType::MessageColor:
     case QueueType::MessageColorCallstack:
         ptr = MemRead<TaggedUserlandAddress>( &item.messageColorFat.textAndMetadata ).GetAddress();
-        tracy_free( (void*)ptr );
+        StringArenaFree( (const char*)ptr );
         break;
     case QueueType::Message:
     case QueueType::MessageCallstack:
+        ptr = MemRead<TaggedUserlandAddress>( &item.messageFat.textAndMetadata ).GetAddress();
+        StringArenaFree( (const char*)ptr );
+        break;
 #ifndef TRACY_ON_DEMAND
     case QueueType::MessageAppInfo:
-#endif
         ptr = MemRead<TaggedUserlandAddress>( &item.messageFat.textAndMetadata ).GetAddress();
         tracy_free( (void*)ptr );
         break;
+#endif
     case QueueType::ZoneBeginAllocSrcLoc:
     case QueueType::ZoneBeginAllocSrcLocCallstack:
         ptr = MemRead<uint64_t>( &item.zoneBegin.srcloc );
@@ -2252,7 +3389,7 @@ static void FreeAssociatedMemory( const QueueItem& item )
     case QueueType::CallstackSerial:
     case QueueType::Callstack:
         ptr = MemRead<uint64_t>( &item.callstackFat.ptr );
-        tracy_free( (void*)ptr );
+        if( !Profiler::IsInternedCallstack( (void*)ptr ) ) tracy_free( (void*)ptr );
         break;
     case QueueType::CallstackAlloc:
         ptr = MemRead<uint64_t>( &item.callstackAllocFat.nativePtr );
@@ -2329,14 +3466,21 @@ static void FreeAssociatedMemory( const QueueItem& item )
 #endif
     case QueueType::SourceCodeMetadata:
         ptr = MemRead<uint64_t>( &item.sourceCodeMetadata.ptr );
-        tracy_free( (void*)ptr );
+        if( MemRead<uint32_t>( &item.sourceCodeMetadata.size ) & SourceCodeCachedFile )
+        {
+            SourceCache::Release( (SourceCache::File*)ptr );
+        }
+        else
+        {
+            tracy_free( (void*)ptr );
+        }
         break;
     default:
         break;
     }
 }
 
-void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
+void Profiler::ClearQueues( EventConsumerToken& token )
 {
     for(;;)
     {
@@ -2347,8 +3491,205 @@ void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
     ClearSerial();
 }
 
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+// Not owned by the profiler, so that threads may keep their queues across profiler lifetimes.
+static std::atomic<SerialQueue*> s_serialQueues { nullptr };
+
+struct SerialQueueHolder
+{
+    SerialQueue* ptr;
+    bool released;
+    ~SerialQueueHolder()
+    {
+        if( ptr ) ptr->Release();
+        ptr = nullptr;
+        released = true;
+    }
+};
+
+static thread_local SerialQueueHolder s_serialQueue { nullptr, false };
+
+static tracy_no_inline SerialQueue* AcquireSerialQueue()
+{
+    for( auto queue = s_serialQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        if( queue->TryAcquire() ) return queue;
+    }
+
+    auto queue = (SerialQueue*)tracy_malloc( sizeof( SerialQueue ) );
+    new(queue) SerialQueue();
+    auto head = s_serialQueues.load( std::memory_order_relaxed );
+    do
+    {
+        queue->SetNext( head );
+    }
+    while( !s_serialQueues.compare_exchange_weak( head, queue, std::memory_order_release, std::memory_order_relaxed ) );
+    return queue;
+}
+
+// Taken by the threads which queue events after their own queue was released, as another thread
+// may already own it.
+static tracy_no_inline SerialQueue* GetSharedSerialQueue()
+{
+    static SerialQueue* shared = [] {
+        auto queue = AcquireSerialQueue();
+#ifdef TRACY_MEMORY_BATCHING
+        queue->SetShared();
+#endif
+        return queue;
+    }();
+    return shared;
+}
+
+TRACY_API SerialQueue* GetSerialQueue()
+{
+    auto queue = s_serialQueue.ptr;
+    if( !queue )
+    {
+        if( s_serialQueue.released ) return GetSharedSerialQueue();
+        queue = AcquireSerialQueue();
+        s_serialQueue.ptr = queue;
+    }
+    return queue;
+}
+
+// The time by which the records of the serial queues are merged, which is the time of the first
+// event of the items with a time on the serial or, with fibers, the thread timeline. The entry of
+// a fiber is left out, as it is queued by whatever the thread emits after it, with the time it
+// was entered.
+static bool SerialTime( const QueueItem* items, size_t count, int64_t& time )
+{
+    for( size_t i=0; i<count; i++ )
+    {
+        const auto item = items + i;
+        switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+        {
+        case QueueType::LockWait:
+        case QueueType::LockSharedWait:
+            time = MemRead<int64_t>( &item->lockWait.time );
+            return true;
+        case QueueType::LockObtain:
+        case QueueType::LockSharedObtain:
+            time = MemRead<int64_t>( &item->lockObtain.time );
+            return true;
+        case QueueType::LockRelease:
+        case QueueType::LockSharedRelease:
+            time = MemRead<int64_t>( &item->lockRelease.time );
+            return true;
+        case QueueType::MemAlloc:
+        case QueueType::MemAllocNamed:
+        case QueueType::MemAllocCallstack:
+        case QueueType::MemAllocCallstackNamed:
+            time = MemRead<int64_t>( &item->memAlloc.time );
+            return true;
+        case QueueType::MemFree:
+        case QueueType::MemFreeNamed:
+        case QueueType::MemFreeCallstack:
+        case QueueType::MemFreeCallstackNamed:
+            time = MemRead<int64_t>( &item->memFree.time );
+            return true;
+        case QueueType::MemDiscard:
+        case QueueType::MemDiscardCallstack:
+            time = MemRead<int64_t>( &item->memDiscard.time );
+            return true;
+        case QueueType::GpuZoneBeginSerial:
+        case QueueType::GpuZoneBeginCallstackSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
+            time = MemRead<int64_t>( &item->gpuZoneBegin.cpuTime );
+            return true;
+        case QueueType::GpuZoneEndSerial:
+            time = MemRead<int64_t>( &item->gpuZoneEnd.cpuTime );
+            return true;
+#ifdef TRACY_FIBERS
+        case QueueType::ZoneBegin:
+        case QueueType::ZoneBeginCallstack:
+        case QueueType::ZoneBeginAllocSrcLoc:
+        case QueueType::ZoneBeginAllocSrcLocCallstack:
+            time = MemRead<int64_t>( &item->zoneBegin.time );
+            return true;
+        case QueueType::ZoneEnd:
+            time = MemRead<int64_t>( &item->zoneEnd.time );
+            return true;
+        case QueueType::FiberLeave:
+            time = MemRead<int64_t>( &item->fiberLeave.time );
+            return true;
+#endif
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// Merges the records of all serial queues into m_serialDequeue, by their times. Only records with
+// times below one read before the queues are collected are merged, as records with later times
+// may still be missing from queues which were already collected. These are left for the next call.
+//
+// A ring slot left pending may hold any time from the limit of the previous call on, so while one
+// is, the limit isn't raised.
+void Profiler::CollectSerial()
+{
+    auto limit = GetTime();
+    const auto shouldAbort = [this] { return m_shutdownManual.load( std::memory_order_relaxed ); };
+    const auto head = s_serialQueues.load( std::memory_order_acquire );
+#ifdef TRACY_MEMORY_BATCHING
+    bool pending = false;
+    for( auto queue = head; queue; queue = queue->Next() ) pending |= queue->Collect( shouldAbort, SerialTime );
+    if( pending ) limit = m_serialLimit;
+    m_serialLimit = limit;
+#else
+    for( auto queue = head; queue; queue = queue->Next() ) queue->Collect( shouldAbort, SerialTime );
+#endif
+
+    for(;;)
+    {
+        SerialQueue* first = nullptr;
+        int64_t next = limit;
+        for( auto queue = head; queue; queue = queue->Next() )
+        {
+            if( !queue->HasRecord( limit ) ) continue;
+            const auto time = queue->NextTime();
+            if( !first || time < first->NextTime() )
+            {
+                if( first ) next = first->NextTime();
+                first = queue;
+            }
+            else if( time < next )
+            {
+                next = time;
+            }
+        }
+        if( !first ) break;
+        first->Take( m_serialDequeue, next );
+    }
+
+    for( auto queue = head; queue; queue = queue->Next() ) queue->Compact();
+}
+#endif
+
 void Profiler::ClearSerial()
 {
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+    for( auto queue = s_serialQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        auto& lock = queue->GetLock();
+        bool lockHeld = true;
+        while( !lock.try_lock() )
+        {
+            if( m_shutdownManual.load( std::memory_order_relaxed ) )
+            {
+                lockHeld = false;
+                break;
+            }
+        }
+        queue->Clear( [this] ( QueueItem& item ) { FreeAssociatedMemory( item ); } );
+        if( lockHeld )
+        {
+            lock.unlock();
+        }
+    }
+#else
     bool lockHeld = true;
     while( !m_serialLock.try_lock() )
     {
@@ -2364,12 +3705,13 @@ void Profiler::ClearSerial()
     {
         m_serialLock.unlock();
     }
+#endif
 
     for( auto& v : m_serialDequeue ) FreeAssociatedMemory( v );
     m_serialDequeue.clear();
 }
 
-Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
+Profiler::DequeueStatus Profiler::Dequeue( EventConsumerToken& token )
 {
     bool connectionLost = false;
     const auto sz = GetQueue().try_dequeue_bulk_single( token,
@@ -2385,11 +3727,96 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
             int64_t refThread = m_refTimeThread;
             int64_t refCtx = m_refTimeCtx;
             int64_t refGpu = m_refTimeGpu;
+#ifdef TRACY_ZONE_COALESCE
+            // The run of short sibling zones waiting to be sent as one.
+            const int64_t threshold = m_coalesceThreshold;
+            uint64_t runSrcloc = 0;
+            uint64_t runCount = 0;
+            int64_t runBegin = 0;
+            int64_t runEnd = 0;
+            auto flushRun = [this, &refThread, &runSrcloc, &runCount, &runBegin, &runEnd] () -> bool
+            {
+                if( runCount == 0 ) return true;
+                QueueItem run;
+                MemWrite( &run.hdr.type, QueueType::ZoneBegin );
+                MemWrite( &run.zoneBegin.time, runBegin - refThread );
+                MemWrite( &run.zoneBegin.srcloc, runSrcloc );
+                if( !AppendData( &run, QueueDataSize[(int)QueueType::ZoneBegin] ) ) return false;
+                if( runCount > 1 )
+                {
+                    MemWrite( &run.hdr.type, QueueType::ZoneValue );
+                    MemWrite( &run.zoneValue.value, runCount );
+                    if( !AppendData( &run, QueueDataSize[(int)QueueType::ZoneValue] ) ) return false;
+                }
+                MemWrite( &run.hdr.type, QueueType::ZoneEnd );
+                MemWrite( &run.zoneEnd.time, runEnd - runBegin );
+                refThread = runEnd;
+                runCount = 0;
+                return AppendData( &run, QueueDataSize[(int)QueueType::ZoneEnd] );
+            };
+#endif
             while( sz-- > 0 )
             {
                 uint64_t ptr;
                 uint16_t size;
                 auto idx = MemRead<uint8_t>( &item->hdr.idx );
+#ifdef TRACY_ZONE_COALESCE
+                {
+                    // A zone is a candidate if both its begin and end are in this batch, with nothing
+                    // in between. Consecutive candidates are then siblings.
+                    uint64_t srcloc = 0;
+                    int64_t t = 0, end = 0;
+                    size_t count = 0;
+                    if( idx == (uint8_t)QueueType::ZoneBegin && sz > 0 && MemRead<uint8_t>( &item[1].hdr.idx ) == (uint8_t)QueueType::ZoneEnd )
+                    {
+                        srcloc = MemRead<uint64_t>( &item->zoneBegin.srcloc );
+                        t = MemRead<int64_t>( &item->zoneBegin.time );
+                        end = MemRead<int64_t>( &item[1].zoneEnd.time );
+                        count = 2;
+                    }
+                    else if( idx == (uint8_t)QueueType::ZoneCompact )
+                    {
+                        srcloc = MemRead<uint64_t>( &item->zoneCompact.srcloc );
+                        t = MemRead<int64_t>( &item->zoneCompact.time );
+                        end = MemRead<int64_t>( &item->zoneCompact.end );
+                        count = 1;
+                    }
+                    if( srcloc != 0 && end - t < threshold )
+                    {
+                        if( runCount != 0 && runSrcloc == srcloc && t - runEnd < threshold )
+                        {
+                            runEnd = end;
+                            runCount++;
+                        }
+                        else
+                        {
+                            if( !flushRun() )
+                            {
+                                connectionLost = true;
+                                m_refTimeThread = refThread;
+                                m_refTimeCtx = refCtx;
+                                m_refTimeGpu = refGpu;
+                                return;
+                            }
+                            runSrcloc = srcloc;
+                            runCount = 1;
+                            runBegin = t;
+                            runEnd = end;
+                        }
+                        item += count;
+                        sz -= count - 1;
+                        continue;
+                    }
+                    if( !flushRun() )
+                    {
+                        connectionLost = true;
+                        m_refTimeThread = refThread;
+                        m_refTimeCtx = refCtx;
+                        m_refTimeGpu = refGpu;
+                        return;
+                    }
+                }
+#endif
                 if( idx < (int)QueueType::Terminate )
                 {
                     switch( (QueueType)idx )
@@ -2399,7 +3826,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         ptr = MemRead<uint64_t>( &item->zoneTextFat.text );
                         size = MemRead<uint16_t>( &item->zoneTextFat.size );
                         SendSingleString( (const char*)ptr, size );
-                        tracy_free_fast( (void*)ptr );
+                        StringArenaFree( (const char*)ptr );
                         break;
                     case QueueType::Message:
                     case QueueType::MessageCallstack:
@@ -2408,7 +3835,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         ptr = taggedPtr.GetAddress();
                         size = MemRead<uint16_t>( &item->messageFat.size );
                         SendSingleString( (const char*)ptr, size );
-                        tracy_free_fast( (void*)ptr );
+                        StringArenaFree( (const char*)ptr );
                         
                         const uint8_t metadata = (uint8_t)taggedPtr.GetTag();
                         QueueItem itemWithMetadata;
@@ -2426,7 +3853,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         ptr = taggedPtr.GetAddress();
                         size = MemRead<uint16_t>( &item->messageColorFat.size );
                         SendSingleString( (const char*)ptr, size );
-                        tracy_free_fast( (void*)ptr );
+                        StringArenaFree( (const char*)ptr );
 
                         const uint8_t metadata = (uint8_t)taggedPtr.GetTag();
                         QueueItem itemWithMetadata;
@@ -2460,7 +3887,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                     case QueueType::Callstack:
                         ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
                         SendCallstackPayload( ptr );
-                        tracy_free_fast( (void*)ptr );
+                        if( !IsInternedCallstack( (void*)ptr ) ) tracy_free_fast( (void*)ptr );
                         break;
                     case QueueType::CallstackAlloc:
                         ptr = MemRead<uint64_t>( &item->callstackAllocFat.nativePtr );
@@ -2659,8 +4086,17 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         auto ptr = (const char*)MemRead<uint64_t>( &item->sourceCodeMetadata.ptr );
                         auto size = MemRead<uint32_t>( &item->sourceCodeMetadata.size );
                         auto id = MemRead<uint32_t>( &item->sourceCodeMetadata.id );
-                        SendLongString( (uint64_t)id, ptr, size, QueueType::SourceCode );
-                        tracy_free_fast( (void*)ptr );
+                        if( size & SourceCodeCachedFile )
+                        {
+                            auto file = (SourceCache::File*)ptr;
+                            SendLongString( (uint64_t)id, file->data, file->size, QueueType::SourceCode );
+                            SourceCache::Release( file );
+                        }
+                        else
+                        {
+                            SendLongString( (uint64_t)id, ptr, size, QueueType::SourceCode );
+                            tracy_free_fast( (void*)ptr );
+                        }
                         ++item;
                         continue;
                     }
@@ -2669,6 +4105,29 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         break;
                     }
                 }
+                else if( idx == (uint8_t)QueueType::ZoneCompact )
+                {
+#ifdef TRACY_ZONE_SAMPLING
+                    // Zones dropped by a minimum duration policy have no source location.
+                    if( MemRead<uint64_t>( &item->zoneCompact.srcloc ) == 0 )
+                    {
+                        ++item;
+                        continue;
+                    }
+#endif
+                    // Sent as the zone begin and end it stands for.
+                    int64_t t = MemRead<int64_t>( &item->zoneCompact.time );
+                    int64_t end = MemRead<int64_t>( &item->zoneCompact.end );
+                    QueueItem begin;
+                    MemWrite( &begin.hdr.type, QueueType::ZoneBegin );
+                    MemWrite( &begin.zoneBegin.time, t - refThread );
+                    MemWrite( &begin.zoneBegin.srcloc, MemRead<uint64_t>( &item->zoneCompact.srcloc ) );
+                    AppendData( &begin, QueueDataSize[(int)QueueType::ZoneBegin] );
+                    refThread = end;
+                    idx = (uint8_t)QueueType::ZoneEnd;
+                    MemWrite( &item->hdr.type, QueueType::ZoneEnd );
+                    MemWrite( &item->zoneEnd.time, end - t );
+                }
                 if( !AppendData( item++, QueueDataSize[idx] ) )
                 {
                     connectionLost = true;
@@ -2678,6 +4137,9 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                     return;
                 }
             }
+#ifdef TRACY_ZONE_COALESCE
+            if( !flushRun() ) connectionLost = true;
+#endif
             m_refTimeThread = refThread;
             m_refTimeCtx = refCtx;
             m_refTimeGpu = refGpu;
@@ -2687,7 +4149,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
     return sz > 0 ? DequeueStatus::DataDequeued : DequeueStatus::QueueEmpty;
 }
 
-Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop )
+Profiler::DequeueStatus Profiler::DequeueContextSwitches( EventConsumerToken& token, int64_t& timeStop )
 {
     const auto sz = GetQueue().try_dequeue_bulk_single( token, [] ( const uint64_t& ) {},
         [this, &timeStop] ( QueueItem* item, size_t sz )
@@ -2759,8 +4221,13 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
 
 Profiler::DequeueStatus Profiler::DequeueSerial()
 {
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+    CollectSerial();
+#else
     {
+        // Producers hold the lock only for a moment, but one may have been preempted with it.
         bool lockHeld = true;
+        int spins = 0;
         while( !m_serialLock.try_lock() )
         {
             if( m_shutdownManual.load( std::memory_order_relaxed ) )
@@ -2768,6 +4235,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                 lockHeld = false;
                 break;
             }
+            if( ++spins < 64 ) YieldThread(); else std::this_thread::yield();
         }
         if( !m_serialQueue.empty() ) m_serialQueue.swap( m_serialDequeue );
         if( lockHeld )
@@ -2775,6 +4243,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
             m_serialLock.unlock();
         }
     }
+#endif
 
     DequeueStatus dequeueStatus = DequeueStatus::QueueEmpty;
 
@@ -2782,6 +4251,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
     if( sz > 0 )
     {
         dequeueStatus = DequeueStatus::DataDequeued;
+        if( sz > m_statSerialPeak ) m_statSerialPeak = sz;
 
         InitRpmalloc();
         int64_t refSerial = m_refTimeSerial;
@@ -2789,12 +4259,19 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
 #ifdef TRACY_FIBERS
         int64_t refThread = m_refTimeThread;
 #endif
-        auto item = m_serialDequeue.data();
-        auto end = item + sz;
-        while( item != end )
+        auto it = m_serialDequeue.begin();
+        const auto end = m_serialDequeue.end();
+        if( m_memElideWindow != 0 ) ElideShortLivedAllocs( it, end );
+        while( it != end )
         {
             uint64_t ptr;
+            auto item = it.get();
             auto idx = MemRead<uint8_t>( &item->hdr.idx );
+            if( idx == (uint8_t)QueueType::NUM_TYPES )
+            {
+                ++it;
+                continue;
+            }
             if( idx < (int)QueueType::Terminate )
             {
                 switch( (QueueType)idx )
@@ -2802,7 +4279,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                 case QueueType::CallstackSerial:
                     ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
                     SendCallstackPayload( ptr );
-                    tracy_free_fast( (void*)ptr );
+                    if( !IsInternedCallstack( (void*)ptr ) ) tracy_free_fast( (void*)ptr );
                     break;
                 case QueueType::LockWait:
                 case QueueType::LockSharedWait:
@@ -2967,7 +4444,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ptr = MemRead<uint64_t>( &item->zoneTextFat.text );
                     uint16_t size = MemRead<uint16_t>( &item->zoneTextFat.size );
                     SendSingleString( (const char*)ptr, size );
-                    tracy_free_fast( (void*)ptr );
+                    StringArenaFree( (const char*)ptr );
                     break;
                 }
                 case QueueType::Message:
@@ -2977,7 +4454,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ptr = MemRead<TaggedUserlandAddress>( &item->messageFat.textAndMetadata ).GetAddress();
                     uint16_t size = MemRead<uint16_t>( &item->messageFat.size );
                     SendSingleString( (const char*)ptr, size );
-                    tracy_free_fast( (void*)ptr );
+                    StringArenaFree( (const char*)ptr );
                     break;
                 }
                 case QueueType::MessageColor:
@@ -2987,7 +4464,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ptr = MemRead<TaggedUserlandAddress>( &item->messageColorFat.textAndMetadata ).GetAddress();
                     uint16_t size = MemRead<uint16_t>( &item->messageColorFat.size );
                     SendSingleString( (const char*)ptr, size );
-                    tracy_free_fast( (void*)ptr );
+                    StringArenaFree( (const char*)ptr );
                     break;
                 }
                 case QueueType::Callstack:
@@ -2995,7 +4472,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     ThreadCtxCheckSerial( callstackFatThread );
                     ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
                     SendCallstackPayload( ptr );
-                    tracy_free_fast( (void*)ptr );
+                    if( !IsInternedCallstack( (void*)ptr ) ) tracy_free_fast( (void*)ptr );
                     break;
                 }
                 case QueueType::CallstackAlloc:
@@ -3084,7 +4561,7 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
             {
                 dequeueStatus = DequeueStatus::ConnectionLost;
             }
-            item++;
+            ++it;
         }
         m_refTimeSerial = refSerial;
         m_refTimeGpu = refGpu;
@@ -3092,8 +4569,86 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
         m_refTimeThread = refThread;
 #endif
         m_serialDequeue.clear();
+        if( m_memElideWindow != 0 ) PlotElidedAllocs();
+    }
+    return dequeueStatus;
+}
+
+void Profiler::ElideShortLivedAllocs( SegmentedVector<QueueItem>::iterator it, SegmentedVector<QueueItem>::iterator end )
+{
+    // The last allocation of each pointer, direct mapped. An allocation evicted by another one is
+    // sent as usual.
+    enum { Slots = 1024 };
+    QueueItem* recent[Slots] = {};
+    auto slot = [&recent] ( uint64_t ptr ) -> QueueItem*& { return recent[( ptr ^ ( ptr >> 10 ) ^ ( ptr >> 20 ) ) >> 4 & ( Slots - 1 )]; };
+
+    for( ; it != end; ++it )
+    {
+        const auto item = it.get();
+        const auto idx = MemRead<uint8_t>( &item->hdr.idx );
+        switch( (QueueType)idx )
+        {
+        case QueueType::MemAlloc:
+            slot( MemRead<uint64_t>( &item->memAlloc.ptr ) ) = item;
+            break;
+        case QueueType::MemFree:
+        {
+            const auto ptr = MemRead<uint64_t>( &item->memFree.ptr );
+            auto& alloc = slot( ptr );
+            if( alloc && MemRead<uint64_t>( &alloc->memAlloc.ptr ) == ptr )
+            {
+                if( MemRead<int64_t>( &item->memFree.time ) - MemRead<int64_t>( &alloc->memAlloc.time ) < m_memElideWindow )
+                {
+                    uint64_t size = 0;
+                    memcpy( &size, &alloc->memAlloc.size, 6 );
+                    int cls = 0;
+                    while( cls < MemElideClasses - 1 && size > ( uint64_t( 16 ) << ( cls * 2 ) ) ) cls++;
+                    m_memElided[cls]++;
+                    // Skipped by DequeueSerial().
+                    MemWrite( &alloc->hdr.idx, (uint8_t)QueueType::NUM_TYPES );
+                    MemWrite( &item->hdr.idx, (uint8_t)QueueType::NUM_TYPES );
+                }
+                alloc = nullptr;
+            }
+            break;
+        }
+        case QueueType::MemAllocCallstack:
+        case QueueType::MemFreeCallstack:
+        {
+            // These go to the same pool, and end the life of the last plain allocation.
+            const auto ptr = (QueueType)idx == QueueType::MemAllocCallstack ? MemRead<uint64_t>( &item->memAlloc.ptr ) : MemRead<uint64_t>( &item->memFree.ptr );
+            auto& alloc = slot( ptr );
+            if( alloc && MemRead<uint64_t>( &alloc->memAlloc.ptr ) == ptr ) alloc = nullptr;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void Profiler::PlotElidedAllocs()
+{
+    const auto t = GetTime();
+    if( t - m_memElideLastPlot < 100 * 1000 * 1000 ) return;
+    m_memElideLastPlot = t;
+
+    static const char* names[MemElideClasses] = {
+        "Short-lived allocs up to 16 B",
+        "Short-lived allocs up to 64 B",
+        "Short-lived allocs up to 256 B",
+        "Short-lived allocs up to 1 KiB",
+        "Short-lived allocs up to 4 KiB",
+        "Short-lived allocs up to 16 KiB",
+        "Short-lived allocs up to 64 KiB",
+        "Short-lived allocs over 64 KiB"
+    };
+    for( int i=0; i<MemElideClasses; i++ )
+    {
+        if( m_memElided[i] == m_memElidedPlotted[i] ) continue;
+        m_memElidedPlotted[i] = m_memElided[i];
+        PlotData( names[i], int64_t( m_memElided[i] ) );
     }
-    return dequeueStatus;
 }
 
 Profiler::ThreadCtxStatus Profiler::ThreadCtxCheck( uint32_t threadId )
@@ -3108,10 +4663,10 @@ Profiler::ThreadCtxStatus Profiler::ThreadCtxCheck( uint32_t threadId )
     return ThreadCtxStatus::Changed;
 }
 
-bool Profiler::CommitData()
+bool Profiler::CommitData( bool flush )
 {
-    bool ret = SendData( m_buffer + m_bufferStart, m_bufferOffset - m_bufferStart );
-    if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
+    bool ret = SendData( m_buffer + m_bufferStart, m_bufferOffset - m_bufferStart, flush );
+    if( m_bufferOffset > int( m_frameSize * 2 ) ) m_bufferOffset = 0;
     m_bufferStart = m_bufferOffset;
     return ret;
 }
@@ -3129,6 +4684,24 @@ char* Profiler::SafeCopyProlog( const char* data, size_t size )
 #ifdef _WIN32
     success = ReadProcessMemory( GetCurrentProcess(), data, buf, size, nullptr ) != 0;
 #else
+#  if defined __linux__ && defined SYS_process_vm_readv
+    // A single syscall for the whole range, failing on unmapped memory instead of faulting.
+    // Seccomp profiles of some containers reject it, in which case the pipe is used instead.
+    if( m_vmReadv )
+    {
+        struct iovec local = { buf, size };
+        struct iovec remote = { (void*)data, size };
+        ssize_t result;
+        while( ( result = syscall( SYS_process_vm_readv, m_pid, &local, 1, &remote, 1, 0 ) ) < 0 && errno == EINTR ) { /* retry */ }
+        if( result >= 0 || ( errno != ENOSYS && errno != EPERM ) )
+        {
+            if( size_t( result ) == size ) return buf;
+            SafeCopyEpilog( buf );
+            return nullptr;
+        }
+        m_vmReadv = false;
+    }
+#  endif
     // Send through the pipe to ensure safe reads
     for( size_t offset = 0; offset != size; /*in loop*/ )
     {
@@ -3165,11 +4738,625 @@ void Profiler::SafeCopyEpilog( char* buf )
 #endif
 }
 
-bool Profiler::SendData( const char* data, size_t len )
+static int64_t GetStatsTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+ProfilerStats Profiler::GetStats() const
+{
+    ProfilerStats stats;
+    stats.queueDepth = m_statQueueDepth.load( std::memory_order_relaxed );
+    stats.serialDepth = m_statSerialDepth.load( std::memory_order_relaxed );
+    stats.symbolQueueDepth = m_statSymbolQueueDepth.load( std::memory_order_relaxed );
+    stats.workerBusyNs = m_statWorkerBusy.load( std::memory_order_relaxed );
+    stats.workerIdleNs = m_statWorkerIdle.load( std::memory_order_relaxed );
+    stats.rawBytes = m_statRawBytes.load( std::memory_order_relaxed );
+    stats.compressedBytes = m_statCompressedBytes.load( std::memory_order_relaxed );
+    stats.sendNs = m_statSendTime.load( std::memory_order_relaxed );
+    stats.symbolsResolved = m_statSymbols.load( std::memory_order_relaxed );
+    stats.samplesLost = m_statSamplesLost.load( std::memory_order_relaxed );
+#ifndef TRACY_NO_FRAME_IMAGE
+    stats.frameImageBacklog = m_fiPending.load( std::memory_order_relaxed );
+    stats.frameImagesDropped = m_fiDropped.load( std::memory_order_relaxed );
+#else
+    stats.frameImageBacklog = 0;
+    stats.frameImagesDropped = 0;
+#endif
+    return stats;
+}
+
+// Called when the profiler thread starts serving a connection, so that the time before it isn't
+// accounted for and the rates plotted on the first tick start from the current totals.
+void Profiler::ResetStatsTick()
+{
+    m_statLastTick = GetStatsTime();
+    m_statIdle = 0;
+    m_statSerialPeak = 0;
+    m_statPlotsConfigured = false;
+    m_statPlotted = GetStats();
+}
+
+void Profiler::IdleSleep( int ms )
+{
+    const auto t0 = GetStatsTime();
+    std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+    m_statIdle += GetStatsTime() - t0;
+}
+
+#ifdef TRACY_WORKER_WAKEUP
+int Profiler::IdleWait()
+{
+    enum { IdleSpins = 64 };
+    enum { IdleWaitMin = 10 };
+    enum { IdleWaitMax = 50 };
+    const auto busy = m_idleBusy;
+    m_idleBusy = false;
+    if( m_idlePolling )
+    {
+        if( busy )
+        {
+            IdleSleep( IdleWaitMin );
+            return IdleWaitMin;
+        }
+        m_idlePolling = false;
+    }
+    if( m_idleSpins > 0 )
+    {
+        m_idleSpins--;
+        std::this_thread::yield();
+        return 0;
+    }
+    const auto timeout = m_idleTimeout;
+    const auto t0 = GetStatsTime();
+    const auto woken = GetWorkerWakeup().Park( timeout );
+    const auto waited = GetStatsTime() - t0;
+    m_statIdle += waited;
+    if( woken )
+    {
+        // Woken up right away, this is a trickle rather than the start of a burst.
+        if( waited < int64_t( IdleWaitMin ) * 1000 * 1000 )
+        {
+            m_idlePolling = true;
+        }
+        else
+        {
+            m_idleSpins = IdleSpins;
+        }
+        m_idleTimeout = IdleWaitMin;
+        return 0;
+    }
+    m_idleTimeout = std::min<int>( timeout * 2, IdleWaitMax );
+    return timeout;
+}
+#endif
+
+void Profiler::TickStats()
+{
+    const auto t = GetStatsTime();
+    const auto period = t - m_statLastTick;
+    if( period <= 100000000 ) return;   // 100 ms
+    m_statLastTick = t;
+
+    const auto idle = std::min( m_statIdle, period );
+    m_statIdle = 0;
+    m_statWorkerBusy.fetch_add( uint64_t( period - idle ), std::memory_order_relaxed );
+    m_statWorkerIdle.fetch_add( uint64_t( idle ), std::memory_order_relaxed );
+    m_statQueueDepth.store( GetQueue().size_approx(), std::memory_order_relaxed );
+    m_statSerialDepth.store( m_statSerialPeak, std::memory_order_relaxed );
+    m_statSerialPeak = 0;
+    m_statSymbolQueueDepth.store( m_symbolQueue.size(), std::memory_order_relaxed );
+
+    if( !m_statPlots ) return;
+    if( !m_statPlotsConfigured )
+    {
+        ConfigurePlot( "Tracy worker busy", PlotFormatType::Percentage, false, true, 0 );
+        ConfigurePlot( "Tracy send time", PlotFormatType::Percentage, false, true, 0 );
+        ConfigurePlot( "Tracy raw data rate", PlotFormatType::Memory, false, true, 0 );
+        ConfigurePlot( "Tracy sent data rate", PlotFormatType::Memory, false, true, 0 );
+        m_statPlotsConfigured = true;
+    }
+    const auto stats = GetStats();
+    const auto& prev = m_statPlotted;
+    const auto seconds = double( period ) / 1000000000.0;
+    PlotData( "Tracy queue depth", int64_t( stats.queueDepth ) );
+    PlotData( "Tracy serial queue depth", int64_t( stats.serialDepth ) );
+    PlotData( "Tracy symbol queue depth", int64_t( stats.symbolQueueDepth ) );
+    PlotData( "Tracy worker busy", 100.0 * double( period - idle ) / double( period ) );
+    PlotData( "Tracy send time", 100.0 * double( stats.sendNs - prev.sendNs ) / double( period ) );
+    PlotData( "Tracy raw data rate", double( stats.rawBytes - prev.rawBytes ) / seconds );
+    PlotData( "Tracy sent data rate", double( stats.compressedBytes - prev.compressedBytes ) / seconds );
+    if( stats.samplesLost != prev.samplesLost ) PlotData( "Tracy samples lost", int64_t( stats.samplesLost ) );
+    m_statPlotted = stats;
+}
+
+bool Profiler::SendFrames( const SocketChunk* chunks, int num )
+{
+    size_t len = 0;
+    for( int i=0; i<num; i++ ) len += size_t( chunks[i].len );
+    m_statCompressedBytes.fetch_add( len, std::memory_order_relaxed );
+
+#ifdef TRACY_OFFLINE_CAPTURE
+    if( m_capture )
+    {
+        for( int i=0; i<num; i++ )
+        {
+            if( !m_capture->Write( chunks[i].buf, chunks[i].len ) ) return false;
+        }
+        return true;
+    }
+#endif
+    const auto t0 = GetStatsTime();
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    if( m_shm )
+    {
+        const auto written = m_shm->Write( chunks, num );
+        m_statSendTime.fetch_add( uint64_t( GetStatsTime() - t0 ), std::memory_order_relaxed );
+        return written;
+    }
+#endif
+    const auto ret = num == 1 ? m_sock->Send( chunks[0].buf, chunks[0].len ) : m_sock->SendVec( chunks, num );
+    m_statSendTime.fetch_add( uint64_t( GetStatsTime() - t0 ), std::memory_order_relaxed );
+    return ret != -1;
+}
+
+#ifdef TRACY_FAN_OUT
+// Neither the LZ4 stream nor the delta times can be picked up in the middle, so passive connections
+// are only taken in right after the server connects. Those which are already connecting by then
+// are accepted right away. If there are any, more are waited for until TRACY_FAN_OUT_WAIT
+// milliseconds (one second by default) have passed, otherwise the session starts without them.
+// They are sent the same events as the server, but each connection only gets the answers to its
+// own queries, see HandleFanOutQueries().
+void Profiler::GatherFanOut( ListenSocket& listen )
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( m_fanOutWait );
+    bool probed = false;
+    while( m_fanOutCount < MaxFanOut && std::chrono::steady_clock::now() < deadline && !ShouldExit() )
+    {
+        auto sock = listen.Accept();
+        if( !sock )
+        {
+            if( !probed && m_fanOutCount == 0 ) break;
+            continue;
+        }
+        probed = true;
+
+        char shibboleth[HandshakeShibbolethSize];
+        uint32_t protocolVersion;
+        if( !sock->ReadRaw( shibboleth, HandshakeShibbolethSize, 1000 ) ||
+            memcmp( shibboleth, HandshakeShibboleth, HandshakeShibbolethSize ) != 0 ||
+            !sock->ReadRaw( &protocolVersion, sizeof( protocolVersion ), 1000 ) )
+        {
+            sock->~Socket();
+            tracy_free( sock );
+            continue;
+        }
+        if( protocolVersion != ProtocolVersion )
+        {
+            HandshakeStatus status = HandshakeProtocolMismatch;
+            sock->Send( &status, sizeof( status ) );
+            sock->~Socket();
+            tracy_free( sock );
+            continue;
+        }
+        if( !m_fanOutBuf ) m_fanOutBuf = (char*)tracy_malloc( m_lz4Size + sizeof( lz4sz_t ) );
+        m_fanOut[m_fanOutCount++] = { sock, nullptr, 0, 0, 0, ++m_fanOutNextId, nullptr, 0, 0 };
+    }
+}
+
+// The passive connections get other answers than the server, so they can't share its LZ4 stream.
+// Their frames are compressed on their own, which the stream decoder takes just as well.
+void Profiler::SendFanOutFrame( const char* data, size_t len )
+{
+    const lz4sz_t lz4sz = LZ4_compress_fast( data, m_fanOutBuf + sizeof( lz4sz_t ), (int)len, m_lz4Size, 1 );
+    memcpy( m_fanOutBuf, &lz4sz, sizeof( lz4sz ) );
+    const SocketChunk chunk = { m_fanOutBuf, int( lz4sz + sizeof( lz4sz_t ) ) };
+    SendFanOut( &chunk, 1, m_fanOutTarget );
+}
+
+// Passive connections are never waited for. What doesn't fit in the socket buffer is queued, up
+// to TRACY_FAN_OUT_BACKLOG megabytes (64 by default) per connection, past which the connection is
+// dropped, as the stream can't skip data.
+void Profiler::SendFanOut( const SocketChunk* chunks, int num, uint32_t target )
+{
+    PollFanOut();
+    for( int i=0; i<m_fanOutCount; )
+    {
+        auto& sink = m_fanOut[i];
+        if( target != FanOutAll && sink.id != target )
+        {
+            i++;
+            continue;
+        }
+        bool ok = true;
+        for( int j=0; j<num; j++ )
+        {
+            auto ptr = (const char*)chunks[j].buf;
+            auto len = size_t( chunks[j].len );
+            if( sink.sent == sink.size )
+            {
+                const auto ret = sink.sock->TrySend( ptr, int( len ) );
+                if( ret < 0 ) { ok = false; break; }
+                ptr += ret;
+                len -= size_t( ret );
+                if( len == 0 ) continue;
+            }
+            if( sink.size + len > sink.capacity && sink.sent != 0 )
+            {
+                memmove( sink.backlog, sink.backlog + sink.sent, sink.size - sink.sent );
+                sink.size -= sink.sent;
+                sink.sent = 0;
+            }
+            if( sink.size + len > sink.capacity )
+            {
+                if( sink.size + len > m_fanOutLimit ) { ok = false; break; }
+                auto capacity = std::max<size_t>( sink.capacity, 1024 * 1024 );
+                while( capacity < sink.size + len ) capacity *= 2;
+                capacity = std::min( capacity, m_fanOutLimit );
+                sink.backlog = (char*)tracy_realloc( sink.backlog, capacity );
+                sink.capacity = capacity;
+            }
+            memcpy( sink.backlog + sink.size, ptr, len );
+            sink.size += len;
+        }
+        if( ok ) i++;
+        else CloseFanOut( i );
+    }
+}
+
+bool Profiler::FlushFanOut( FanOutSink& sink )
+{
+    if( sink.sent == sink.size ) return true;
+    const auto ret = sink.sock->TrySend( sink.backlog + sink.sent, int( std::min<size_t>( sink.size - sink.sent, 1024 * 1024 * 1024 ) ) );
+    if( ret < 0 ) return false;
+    sink.sent += size_t( ret );
+    if( sink.sent == sink.size )
+    {
+        sink.sent = 0;
+        sink.size = 0;
+    }
+    return true;
+}
+
+// Only the queries which are answered right away from what the client has at hand are taken from
+// the passive connections. The other ones are answered later on, to everyone, or change the state
+// of the client, and are left to the server.
+static bool IsFanOutQuery( uint8_t type )
+{
+    switch( type )
+    {
+    case ServerQueryString:
+    case ServerQueryThreadString:
+    case ServerQuerySourceLocation:
+    case ServerQueryPlotName:
+    case ServerQueryFrameName:
+#ifdef TRACY_FIBERS
+    case ServerQueryFiberName:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Sends out queued data and takes in the queries of the passive connections, which would
+// otherwise fill up the socket buffers and stall them.
+void Profiler::PollFanOut()
+{
+    for( int i=0; i<m_fanOutCount; )
+    {
+        auto& sink = m_fanOut[i];
+        bool ok = FlushFanOut( sink );
+        while( ok && sink.sock->HasData() )
+        {
+            ServerQueryPacket queries[64];
+            const auto num = sink.sock->ReadMany( queries, sizeof( ServerQueryPacket ), 64, 10 );
+            if( num == 0 ) ok = false;
+            for( int j=0; j<num; j++ )
+            {
+                if( queries[j].type == ServerQueryTerminate ) ok = false;
+                if( !IsFanOutQuery( queries[j].type ) ) continue;
+                if( sink.queryCount == sink.queryCapacity )
+                {
+                    sink.queryCapacity = std::max<uint32_t>( sink.queryCapacity * 2, 64 );
+                    sink.queries = (ServerQueryPacket*)tracy_realloc( sink.queries, sink.queryCapacity * sizeof( ServerQueryPacket ) );
+                }
+                sink.queries[sink.queryCount++] = queries[j];
+            }
+        }
+        if( ok ) i++;
+        else CloseFanOut( i );
+    }
+}
+
+// Answers the queries of the passive connections, each to the connection which asked alone.
+bool Profiler::HandleFanOutQueries()
+{
+    if( m_fanOutCount == 0 ) return true;
+    bool pending = false;
+    for( int i=0; i<m_fanOutCount; i++ ) pending |= m_fanOut[i].queryCount != 0;
+    if( !pending ) return true;
+    if( m_bufferOffset != m_bufferStart && !CommitData() ) return false;
+
+    for( int i=0; i<m_fanOutCount; i++ )
+    {
+        auto& sink = m_fanOut[i];
+        if( sink.queryCount == 0 ) continue;
+        // Sending may drop connections, which moves the other ones around.
+        const auto queries = sink.queries;
+        const auto count = sink.queryCount;
+        sink.queries = nullptr;
+        sink.queryCount = 0;
+        sink.queryCapacity = 0;
+        const auto start = m_bufferStart;
+        m_fanOutTarget = sink.id;
+        for( uint32_t j=0; j<count; j++ ) HandleServerQuery( queries[j] );
+        tracy_free( queries );
+        if( !EndFanOutAnswers() ) return false;
+        // The answers are sent, and the LZ4 stream of the server may still refer to the data
+        // before them.
+        m_bufferOffset = m_bufferStart = start;
+    }
+    return true;
+}
+
+// Sends the answers collected for m_fanOutTarget, after which frames go to everyone again.
+bool Profiler::EndFanOutAnswers()
+{
+    const bool ret = m_fanOutTarget == FanOutAll || m_bufferOffset == m_bufferStart || CommitData();
+    m_fanOutTarget = FanOutAll;
+    return ret;
+}
+
+// The client is going away. Passive connections which are behind get a last chance to catch up.
+void Profiler::FinishFanOut()
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 2 );
+    for(;;)
+    {
+        PollFanOut();
+        bool pending = false;
+        for( int i=0; i<m_fanOutCount; i++ ) pending |= m_fanOut[i].sent != m_fanOut[i].size;
+        if( !pending || std::chrono::steady_clock::now() > deadline ) break;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    while( m_fanOutCount != 0 ) CloseFanOut( 0 );
+}
+
+void Profiler::CloseFanOut( int idx )
+{
+    auto& sink = m_fanOut[idx];
+    sink.sock->~Socket();
+    tracy_free( sink.sock );
+    tracy_free( sink.backlog );
+    tracy_free( sink.queries );
+    sink = m_fanOut[--m_fanOutCount];
+}
+#endif
+
+bool Profiler::SendData( const char* data, size_t len, bool flush )
+{
+#ifdef TRACY_OFFLINE_CAPTURE
+    if( m_capture ) ScanCaptureFrame( data, len );
+#endif
+#ifndef TRACY_ON_DEMAND
+    if( m_recorder && !m_isConnected.load( std::memory_order_relaxed ) )
+    {
+        m_recorder->Record( data, len );
+        return true;
+    }
+#endif
+#ifdef TRACY_FAN_OUT
+    if( m_fanOutCount != 0 && m_fanOutTarget != FanOutServer )
+    {
+        SendFanOutFrame( data, len );
+        if( m_fanOutTarget != FanOutAll ) return true;
+    }
+#endif
+    m_statRawBytes.fetch_add( len, std::memory_order_relaxed );
+    auto lz4Level = m_lz4Level;
+    if( m_lz4WarmupLeft != 0 )
+    {
+        lz4Level = 0;
+        m_lz4WarmupLeft -= std::min( m_lz4WarmupLeft, len );
+    }
+    if( m_lz4Threads == 0 )
+    {
+        // The history of m_stream is only current if it compressed the previous frame.
+        if( !m_lz4Adaptive && lz4Level == m_lz4StreamLevel && lz4Level == Lz4DefaultLevel )
+        {
+            const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, m_lz4Size, 1 );
+            memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
+            const SocketChunk chunk = { m_lz4Buf, int( lz4sz + sizeof( lz4sz_t ) ) };
+            return SendFrames( &chunk, 1 );
+        }
+
+        const auto t0 = GetTime();
+        const auto level = Lz4Levels[lz4Level];
+        if( lz4Level != m_lz4StreamLevel )
+        {
+            if( level > 0 || Lz4Levels[m_lz4StreamLevel] > 0 )
+            {
+                // Stream history is kept by the stream which compressed the previous frame. Hand
+                // its tail over to the other one. The previous frame is still intact in m_buffer.
+                const auto dictSize = std::min( m_lz4PrevSize, Lz4DictSize );
+                const auto dict = m_lz4Prev + m_lz4PrevSize - dictSize;
+                if( level > 0 )
+                {
+                    LZ4_resetStreamHC_fast( (LZ4_streamHC_t*)m_streamHC, level );
+                    LZ4_loadDictHC( (LZ4_streamHC_t*)m_streamHC, dict, dictSize );
+                }
+                else
+                {
+                    LZ4_loadDict( (LZ4_stream_t*)m_stream, dict, dictSize );
+                }
+            }
+            m_lz4StreamLevel = lz4Level;
+        }
+        lz4sz_t lz4sz;
+        if( level > 0 )
+        {
+            lz4sz = LZ4_compress_HC_continue( (LZ4_streamHC_t*)m_streamHC, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, m_lz4Size );
+        }
+        else
+        {
+            lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, m_lz4Size, -level );
+        }
+        memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
+        m_lz4Prev = data;
+        m_lz4PrevSize = (int)len;
+
+        const auto t1 = GetTime();
+        const SocketChunk chunk = { m_lz4Buf, int( lz4sz + sizeof( lz4sz_t ) ) };
+        const auto ret = SendFrames( &chunk, 1 );
+        m_lz4CompressTime += t1 - t0;
+        m_lz4SendTime += GetTime() - t1;
+        if( m_lz4Adaptive && !flush ) AdaptCompressionLevel();
+        return ret;
+    }
+
+    if( m_lz4Tail - m_lz4Head == m_lz4JobCount )
+    {
+        {
+            const auto t0 = m_lz4Adaptive ? GetTime() : 0;
+            std::unique_lock<std::mutex> lock( m_lz4Lock );
+            auto& oldest = m_lz4Jobs[m_lz4Head % m_lz4JobCount];
+            m_lz4Done.wait( lock, [&oldest] { return oldest.done; } );
+            if( m_lz4Adaptive ) m_lz4CompressTime += GetTime() - t0;
+        }
+        if( !SendLz4Frames( false ) ) return false;
+    }
+
+    auto& job = m_lz4Jobs[m_lz4Tail % m_lz4JobCount];
+    if( m_lz4DictSize != 0 )
+    {
+        // The previous job is never in the same slot, and its source is only read by the pool.
+        const auto& prev = m_lz4Jobs[( m_lz4Tail - 1 ) % m_lz4JobCount];
+        memcpy( job.src, prev.src + prev.dictSize + prev.srcSize - m_lz4DictSize, m_lz4DictSize );
+    }
+    memcpy( job.src + m_lz4DictSize, data, len );
+    job.dictSize = m_lz4DictSize;
+    job.srcSize = (int)len;
+    job.level = lz4Level;
+    m_lz4DictSize = std::min( (int)len, Lz4DictSize );
+
+    m_lz4Lock.lock();
+    job.done = false;
+    m_lz4Tail++;
+    m_lz4Lock.unlock();
+    m_lz4Wake.notify_one();
+
+    const auto ret = SendLz4Frames( flush );
+    if( m_lz4Adaptive && !flush ) AdaptCompressionLevel();
+    return ret;
+}
+
+// Looks at how much of the time since the last adjustment was spent blocked, using full frames
+// only. Blocking on the socket for a tenth of it means the link can't keep up, which moves towards
+// LZ4HC. Compressing (or waiting for a saturated compression pool) for half of it means the
+// profiler thread can't keep up, which moves towards faster levels. Otherwise the level drifts
+// back from the faster ones to the default, as a fast link alone is no reason to compress worse.
+void Profiler::AdaptCompressionLevel()
+{
+    if( ++m_lz4Frames < Lz4AdaptFrames ) return;
+    const auto now = GetTime();
+    const auto wall = now - m_lz4AdaptStart;
+    if( m_lz4SendTime * 10 > wall && m_lz4SendTime > m_lz4CompressTime )
+    {
+        if( m_lz4Level > 0 ) m_lz4Level--;
+    }
+    else if( m_lz4CompressTime * 2 > wall )
+    {
+        if( m_lz4Level < Lz4LevelCount - 1 ) m_lz4Level++;
+    }
+    else if( m_lz4Level > Lz4DefaultLevel )
+    {
+        m_lz4Level--;
+    }
+    m_lz4AdaptStart = now;
+    m_lz4CompressTime = 0;
+    m_lz4SendTime = 0;
+    m_lz4Frames = 0;
+}
+
+// Sends compressed frames in submission order. Frames which are not yet compressed are waited
+// for only if flush is set, otherwise sending stops at the first one. Consecutive finished
+// frames are handed to the socket in one vectored send.
+bool Profiler::SendLz4Frames( bool flush )
+{
+    if( m_lz4Head == m_lz4Tail ) return true;
+
+    SocketChunk chunks[Lz4SendBatch];
+    std::unique_lock<std::mutex> lock( m_lz4Lock );
+    while( m_lz4Head != m_lz4Tail )
+    {
+        auto& oldest = m_lz4Jobs[m_lz4Head % m_lz4JobCount];
+        if( !oldest.done )
+        {
+            if( !flush ) break;
+            const auto t0 = m_lz4Adaptive ? GetTime() : 0;
+            m_lz4Done.wait( lock, [&oldest] { return oldest.done; } );
+            if( m_lz4Adaptive ) m_lz4CompressTime += GetTime() - t0;
+        }
+
+        int num = 0;
+        while( num < Lz4SendBatch && m_lz4Head + num != m_lz4Tail )
+        {
+            const auto& job = m_lz4Jobs[( m_lz4Head + num ) % m_lz4JobCount];
+            if( !job.done ) break;
+            lz4sz_t lz4sz;
+            memcpy( &lz4sz, job.dst, sizeof( lz4sz ) );
+            chunks[num].buf = job.dst;
+            chunks[num].len = int( lz4sz + sizeof( lz4sz_t ) );
+            num++;
+        }
+        lock.unlock();
+
+        const auto t0 = m_lz4Adaptive ? GetTime() : 0;
+        const auto sent = SendFrames( chunks, num );
+        if( m_lz4Adaptive ) m_lz4SendTime += GetTime() - t0;
+        m_lz4Head += num;
+        if( !sent )
+        {
+            DiscardLz4Frames();
+            return false;
+        }
+
+        lock.lock();
+    }
+    return true;
+}
+
+// Starts a new stream for a fresh connection. The server's decoder starts with empty history.
+void Profiler::ResetLz4Stream()
 {
-    const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
-    memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
-    return m_sock->Send( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) ) != -1;
+    LZ4_resetStream( (LZ4_stream_t*)m_stream );
+    DiscardLz4Frames();
+    m_lz4Level = Lz4DefaultLevel;
+    m_lz4StreamLevel = Lz4DefaultLevel;
+    m_lz4Prev = nullptr;
+    m_lz4PrevSize = 0;
+    m_lz4CompressTime = 0;
+    m_lz4SendTime = 0;
+    m_lz4Frames = 0;
+    m_lz4AdaptStart = GetTime();
+    m_lz4WarmupLeft = m_lz4Warmup;
+}
+
+// Drops frames still in flight, e.g. after the connection was lost. The next connection starts
+// with a fresh stream, so the dictionary is reset as well.
+void Profiler::DiscardLz4Frames()
+{
+    m_lz4DictSize = 0;
+    if( m_lz4Head == m_lz4Tail ) return;
+
+    std::unique_lock<std::mutex> lock( m_lz4Lock );
+    while( m_lz4Head != m_lz4Tail )
+    {
+        auto& job = m_lz4Jobs[m_lz4Head % m_lz4JobCount];
+        m_lz4Done.wait( lock, [&job] { return job.done; } );
+        m_lz4Head++;
+    }
 }
 
 void Profiler::SendString( uint64_t str, const char* ptr, size_t len, QueueType type )
@@ -3237,7 +5424,7 @@ void Profiler::SendLongString( uint64_t str, const char* ptr, size_t len, QueueT
     MemWrite( &item.stringTransfer.ptr, str );
 
     assert( len <= std::numeric_limits<uint32_t>::max() );
-    assert( QueueDataSize[(int)type] + sizeof( uint32_t ) + len <= TargetFrameSize );
+    assert( QueueDataSize[(int)type] + sizeof( uint32_t ) + len <= m_frameSize );
     auto l32 = uint32_t( len );
 
     NeedDataSize( QueueDataSize[(int)type] + sizeof( l32 ) + l32 );
@@ -3412,18 +5599,29 @@ void Profiler::QueueSourceCodeQuery( uint32_t id )
 #ifdef TRACY_HAS_CALLSTACK
 void Profiler::HandleSymbolQueueItem( const SymbolQueueItem& si )
 {
+    m_statSymbols.fetch_add( 1, std::memory_order_relaxed );
     switch( si.type )
     {
     case SymbolQueueItemType::CallstackFrame:
     {
-        const auto frameData = DecodeCallstackPtr( si.ptr );
-        auto data = tracy_malloc_fast( sizeof( CallstackEntry ) * frameData.size );
-        memcpy( data, frameData.data, sizeof( CallstackEntry ) * frameData.size );
+        CallstackEntry* data;
+        uint8_t size;
+        const char* imageName;
+        if( !m_symbolCache->Get( si.ptr, data, size, imageName ) )
+        {
+            const auto frameData = DecodeCallstackPtr( si.ptr );
+            // Strings of the decoded frames are freed by the worker, cache them before queuing.
+            m_symbolCache->Put( si.ptr, frameData );
+            size = frameData.size;
+            imageName = frameData.imageName;
+            data = (CallstackEntry*)tracy_malloc_fast( sizeof( CallstackEntry ) * size );
+            memcpy( data, frameData.data, sizeof( CallstackEntry ) * size );
+        }
         TracyLfqPrepare( QueueType::CallstackFrameSize );
         MemWrite( &item->callstackFrameSizeFat.ptr, si.ptr );
-        MemWrite( &item->callstackFrameSizeFat.size, frameData.size );
+        MemWrite( &item->callstackFrameSizeFat.size, size );
         MemWrite( &item->callstackFrameSizeFat.data, (uint64_t)data );
-        MemWrite( &item->callstackFrameSizeFat.imageName, (uint64_t)frameData.imageName );
+        MemWrite( &item->callstackFrameSizeFat.imageName, (uint64_t)imageName );
         TracyLfqCommit;
         break;
     }
@@ -3516,6 +5714,48 @@ void Profiler::HandleSymbolQueueItem( const SymbolQueueItem& si )
     }
 }
 
+#ifdef TRACY_USE_LIBBACKTRACE
+bool Profiler::TakeSymbolQueueItem( SymbolQueueItem& si, bool helper )
+{
+    std::lock_guard<TracyMutex> lock( m_symbolLock );
+    auto ptr = m_symbolQueue.front();
+    if( !ptr ) return false;
+    // Everything other than frame and symbol lookups is left to the symbol worker.
+    if( helper && ptr->type != SymbolQueueItemType::CallstackFrame && ptr->type != SymbolQueueItemType::SymbolQuery ) return false;
+    si = *ptr;
+    m_symbolQueue.pop();
+    return true;
+}
+
+void Profiler::SymbolHelperWorker()
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy Symbol Helper" );
+    InitCallstackThread();
+
+    while( !m_symbolExit.load( std::memory_order_acquire ) )
+    {
+        bool handled = false;
+        m_symbolHelpersBusy.fetch_add( 1, std::memory_order_acq_rel );
+#ifdef TRACY_ON_DEMAND
+        if( IsConnected() )
+#endif
+        {
+            SymbolQueueItem si;
+            if( TakeSymbolQueueItem( si, true ) )
+            {
+                HandleSymbolQueueItem( si );
+                handled = true;
+            }
+        }
+        m_symbolHelpersBusy.fetch_sub( 1, std::memory_order_acq_rel );
+        if( !handled ) std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    }
+
+    EndCallstackThread();
+}
+#endif
+
 void Profiler::SymbolWorker()
 {
 #if defined __linux__ && !defined TRACY_NO_CRASH_HANDLER
@@ -3527,8 +5767,43 @@ void Profiler::SymbolWorker()
 #ifdef TRACY_USE_RPMALLOC
     InitRpmalloc();
 #endif
-    InitCallstack();
-    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+#ifdef TRACY_USE_LIBBACKTRACE
+    InitCallstack( m_symbolThreads > 1 );
+#else
+    InitCallstack();
+#endif
+    m_symbolCache = (SymbolCache*)tracy_malloc( sizeof( SymbolCache ) );
+    new(m_symbolCache) SymbolCache();
+    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+#ifdef TRACY_USE_LIBBACKTRACE
+    if( m_symbolThreads > 1 )
+    {
+        m_symbolHelpers = (Thread**)tracy_malloc( sizeof( Thread* ) * ( m_symbolThreads - 1 ) );
+        for( uint32_t i=0; i<m_symbolThreads-1; i++ )
+        {
+            m_symbolHelpers[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+            new(m_symbolHelpers[i]) Thread( LaunchSymbolHelperWorker, this );
+        }
+    }
+    // Helpers have to be gone before the profiler thread takes over the queue.
+    auto finish = [this] {
+        if( m_symbolHelpers )
+        {
+            m_symbolExit.store( true, std::memory_order_release );
+            for( uint32_t i=0; i<m_symbolThreads-1; i++ )
+            {
+                m_symbolHelpers[i]->~Thread();
+                tracy_free( m_symbolHelpers[i] );
+            }
+            tracy_free( m_symbolHelpers );
+            m_symbolHelpers = nullptr;
+        }
+        s_symbolThreadGone.store( true, std::memory_order_release );
+    };
+#else
+    auto finish = [] { s_symbolThreadGone.store( true, std::memory_order_release ); };
+#endif
 
     for(;;)
     {
@@ -3538,26 +5813,42 @@ void Profiler::SymbolWorker()
         {
             if( shouldExit )
             {
-                s_symbolThreadGone.store( true, std::memory_order_release );
+                finish();
                 return;
             }
+#  ifdef TRACY_USE_LIBBACKTRACE
+            {
+                std::lock_guard<TracyMutex> lock( m_symbolLock );
+                while( m_symbolQueue.front() ) m_symbolQueue.pop();
+            }
+            while( m_symbolHelpersBusy.load( std::memory_order_acquire ) != 0 ) YieldThread();
+#  else
             while( m_symbolQueue.front() ) m_symbolQueue.pop();
+#  endif
             std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
             m_symbolsBusy.store( false, std::memory_order_release );
             continue;
         }
 #endif
+#ifdef TRACY_USE_LIBBACKTRACE
+        SymbolQueueItem si;
+        if( TakeSymbolQueueItem( si, false ) )
+        {
+            HandleSymbolQueueItem( si );
+        }
+#else
         auto si = m_symbolQueue.front();
         if( si )
         {
             HandleSymbolQueueItem( *si );
             m_symbolQueue.pop();
         }
+#endif
         else
         {
             if( shouldExit )
             {
-                s_symbolThreadGone.store( true, std::memory_order_release );
+                finish();
                 return;
             }
             std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
@@ -3566,11 +5857,41 @@ void Profiler::SymbolWorker()
 }
 #endif
 
-bool Profiler::HandleServerQuery()
+bool Profiler::HandleServerQueries()
 {
-    ServerQueryPacket payload;
-    if( !m_sock->Read( &payload, sizeof( payload ), 10 ) ) return false;
+    // The server sends its queries in bursts, e.g. for all the frames of a new callstack, so
+    // everything that has already arrived is taken out of the socket buffer in one go.
+    enum { QueryBatch = 256 };
+    ServerQueryPacket payload[QueryBatch];
+    const auto num = m_sock->ReadMany( payload, sizeof( ServerQueryPacket ), QueryBatch, 10 );
+    if( num == 0 ) return false;
+#ifdef TRACY_FAN_OUT
+    // The answers only go to the server, the passive connections get their own. What was queued
+    // before goes to everyone.
+    if( m_fanOutCount != 0 )
+    {
+        if( m_bufferOffset != m_bufferStart && !CommitData() ) return false;
+        m_fanOutTarget = FanOutServer;
+    }
+#endif
+    bool ret = true;
+    for( int i=0; i<num && ret; i++ )
+    {
+#ifdef TRACY_FAN_OUT
+        // The events sent while disconnecting are for everyone.
+        if( payload[i].type == ServerQueryDisconnect && !EndFanOutAnswers() ) ret = false;
+        if( !ret ) break;
+#endif
+        ret = HandleServerQuery( payload[i] );
+    }
+#ifdef TRACY_FAN_OUT
+    if( !EndFanOutAnswers() ) ret = false;
+#endif
+    return ret;
+}
 
+bool Profiler::HandleServerQuery( const ServerQueryPacket& payload )
+{
     uint8_t type;
     uint64_t ptr;
     memcpy( &type, &payload.type, sizeof( payload.type ) );
@@ -3661,6 +5982,11 @@ bool Profiler::HandleServerQuery()
     case ServerQueryFiberName:
         SendString( ptr, (const char*)ptr, QueueType::FiberName );
         break;
+#endif
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    case ServerQueryShmTransport:
+        StartShmTransport();
+        break;
 #endif
     default:
         assert( false );
@@ -3670,9 +5996,50 @@ bool Profiler::HandleServerQuery()
     return true;
 }
 
+#ifdef TRACY_HAS_SHM_TRANSPORT
+// A server on the same host can take the frames through shared memory instead of the socket,
+// see ShmRingWriter. The answer is sent right away, so that it precedes the frames which go
+// through the ring. Without a ring, or if it can't be created, an empty name keeps the frames on
+// the socket. The ring is TRACY_SHM_SIZE megabytes, 8 by default.
+void Profiler::StartShmTransport()
+{
+    char name[ShmRingNameSize] = {};
+    if( !m_shm )
+    {
+        size_t size = 8;
+        const char* shmSize = GetEnvVar( "TRACY_SHM_SIZE" );
+        if( shmSize && atoi( shmSize ) > 0 ) size = size_t( atoi( shmSize ) );
+        auto shm = (ShmRingWriter*)tracy_malloc( sizeof( ShmRingWriter ) );
+        new(shm) ShmRingWriter();
+        if( shm->Create( size * 1024 * 1024 ) )
+        {
+            m_shm = shm;
+        }
+        else
+        {
+            shm->~ShmRingWriter();
+            tracy_free( shm );
+        }
+    }
+    if( m_shm ) memcpy( name, m_shm->Name(), strlen( m_shm->Name() ) );
+
+    const lz4sz_t marker = ShmTransportMarker;
+    m_sock->Send( &marker, sizeof( marker ) );
+    m_sock->Send( name, sizeof( name ) );
+}
+
+void Profiler::EndShmTransport()
+{
+    if( !m_shm ) return;
+    m_shm->~ShmRingWriter();
+    tracy_free( m_shm );
+    m_shm = nullptr;
+}
+#endif
+
 void Profiler::HandleDisconnect()
 {
-    moodycamel::ConsumerToken token( GetQueue() );
+    EventConsumerToken token( GetQueue() );
 
 #ifdef TRACY_HAS_SYSTEM_TRACING
     if( s_sysTraceThread )
@@ -3705,7 +6072,7 @@ void Profiler::HandleDisconnect()
             {
                 while( m_sock->HasData() )
                 {
-                    if( !HandleServerQuery() ) return;
+                    if( !HandleServerQueries() ) return;
                 }
                 if( m_bufferOffset != m_bufferStart )
                 {
@@ -3734,7 +6101,7 @@ void Profiler::HandleDisconnect()
         {
             while( m_sock->HasData() )
             {
-                if( !HandleServerQuery() ) return;
+                if( !HandleServerQueries() ) return;
             }
             if( m_bufferOffset != m_bufferStart )
             {
@@ -3977,11 +6344,87 @@ void Profiler::ReportTopology()
 #endif
 }
 
+struct MemSampler
+{
+    int64_t left;
+    uint64_t rng;
+};
+
+static thread_local MemSampler s_memSampler;
+
+static int64_t NextMemSample( MemSampler& sampler, uint64_t interval )
+{
+    // xorshift64*, mapped to (0, 1].
+    sampler.rng ^= sampler.rng >> 12;
+    sampler.rng ^= sampler.rng << 25;
+    sampler.rng ^= sampler.rng >> 27;
+    const auto r = sampler.rng * 0x2545F4914F6CDD1Dull;
+    const auto u = double( ( r >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+    return int64_t( -log( u ) * double( interval ) ) + 1;
+}
+
+bool Profiler::SampleMemAllocSlow( size_t size, uint64_t interval )
+{
+    auto& sampler = s_memSampler;
+    if( sampler.rng == 0 )
+    {
+        sampler.rng = ( uint64_t( GetThreadHandle() ) << 32 ) ^ uint64_t( GetTime() ) ^ 0x9E3779B97F4A7C15ull;
+        if( sampler.rng == 0 ) sampler.rng = 1;
+        sampler.left = NextMemSample( sampler, interval );
+    }
+    sampler.left -= int64_t( size );
+    if( sampler.left > 0 ) return false;
+    sampler.left = NextMemSample( sampler, interval );
+    return true;
+}
+
+#ifdef TRACY_FIBERS
+void Profiler::SendFiberLeave( FiberState& state )
+{
+    TracyQueuePrepare( QueueType::FiberLeave );
+    MemWrite( &item->fiberLeave.time, GetTime() );
+    TracyQueueCommit( fiberLeave );
+    state.active = false;
+}
+
+uint32_t Profiler::RegisterFiber( const char* name )
+{
+    auto& profiler = GetProfiler();
+    std::lock_guard<TracyMutex> lock( profiler.m_fiberLock );
+    const auto id = profiler.m_fiberCount.load( std::memory_order_relaxed );
+    if( id == FiberNameChunk * FiberNameChunks ) return id;
+    auto& chunk = profiler.m_fiberNames[id / FiberNameChunk];
+    if( id % FiberNameChunk == 0 ) chunk = (const char**)tracy_malloc( sizeof( const char* ) * FiberNameChunk );
+    const auto len = strlen( name );
+    auto ptr = (char*)tracy_malloc( len + 1 );
+    memcpy( ptr, name, len + 1 );
+    chunk[id % FiberNameChunk] = ptr;
+    profiler.m_fiberCount.store( id + 1, std::memory_order_release );
+    return id;
+}
+#endif
+
 void Profiler::SendCallstack( int32_t depth, const char** skipBefore )
 {
 #ifdef TRACY_HAS_CALLSTACK
+#  ifdef TRACY_HAS_CALLSTACK_TABLE
+    void* ptr;
+    if( depth <= CallstackTable::MaxDepth )
+    {
+        uintptr_t trace[1 + CallstackTable::MaxDepth];
+        trace[0] = CaptureCallstack( trace+1, depth );
+        CutCallstack( trace, skipBefore );
+        ptr = m_callstackTable->Intern( trace );
+    }
+    else
+    {
+        ptr = Callstack( depth );
+        CutCallstack( ptr, skipBefore );
+    }
+#  else
     auto ptr = Callstack( depth );
     CutCallstack( ptr, skipBefore );
+#  endif
 
     TracyQueuePrepare( QueueType::Callstack );
     MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
@@ -4020,32 +6463,27 @@ found:
 #endif
 }
 
-#ifdef TRACY_HAS_SYSTIME
-void Profiler::ProcessSysTime()
+void Profiler::HandleParameter( uint64_t payload )
 {
-    if( m_shutdown.load( std::memory_order_relaxed ) ) return;
-    auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    if( t - m_sysTimeLast > 100000000 )    // 100 ms
+    const auto idx = uint32_t( payload >> 32 );
+    const auto val = int32_t( payload & 0xFFFFFFFF );
+#ifdef TRACY_ZONE_CATEGORIES
+    if( idx >= ZoneCategoryParameterBase && idx < ZoneCategoryParameterBase + MaxZoneCategories )
     {
-        auto sysTime = m_sysTime.Get();
-        if( sysTime >= 0 )
-        {
-            m_sysTimeLast = t;
-
-            TracyLfqPrepare( QueueType::SysTimeReport );
-            MemWrite( &item->sysTime.time, GetTime() );
-            MemWrite( &item->sysTime.sysTime, sysTime );
-            TracyLfqCommit;
-        }
+        ZoneCategoryParameter( idx - ZoneCategoryParameterBase, val );
+        AckServerQuery();
+        return;
+    }
+#endif
+#ifdef TRACY_ZONE_SAMPLING
+    if( idx >= ZoneSamplingParameterBase )
+    {
+        ZoneSamplingParameter( idx - ZoneSamplingParameterBase, val );
+        AckServerQuery();
+        return;
     }
-}
 #endif
-
-void Profiler::HandleParameter( uint64_t payload )
-{
     assert( m_paramCallback );
-    const auto idx = uint32_t( payload >> 32 );
-    const auto val = int32_t( payload & 0xFFFFFFFF );
     m_paramCallback( m_paramCallbackData, idx, val );
     AckServerQuery();
 }
@@ -4070,29 +6508,15 @@ void Profiler::HandleSymbolCodeQuery( uint64_t symbol, uint32_t size )
 void Profiler::HandleSourceCodeQuery( char* data, char* image, uint32_t id )
 {
     bool ok = false;
-    FILE* f = fopen( data, "rb" );
-    if( f )
+    auto file = m_sourceCache.Get( data, m_exectime, m_frameSize - 16 );
+    if( file )
     {
-        struct stat st;
-        if( fstat( fileno( f ), &st ) == 0 && (uint64_t)st.st_mtime < m_exectime && st.st_size < ( TargetFrameSize - 16 ) )
-        {
-            auto ptr = (char*)tracy_malloc_fast( st.st_size );
-            auto rd = fread( ptr, 1, st.st_size, f );
-            if( rd == (size_t)st.st_size )
-            {
-                TracyLfqPrepare( QueueType::SourceCodeMetadata );
-                MemWrite( &item->sourceCodeMetadata.ptr, (uint64_t)ptr );
-                MemWrite( &item->sourceCodeMetadata.size, (uint32_t)rd );
-                MemWrite( &item->sourceCodeMetadata.id, id );
-                TracyLfqCommit;
-                ok = true;
-            }
-            else
-            {
-                tracy_free_fast( ptr );
-            }
-        }
-        fclose( f );
+        TracyLfqPrepare( QueueType::SourceCodeMetadata );
+        MemWrite( &item->sourceCodeMetadata.ptr, (uint64_t)file );
+        MemWrite( &item->sourceCodeMetadata.size, file->size | SourceCodeCachedFile );
+        MemWrite( &item->sourceCodeMetadata.id, id );
+        TracyLfqCommit;
+        ok = true;
     }
 
 #ifdef TRACY_DEBUGINFOD
@@ -4108,7 +6532,7 @@ void Profiler::HandleSourceCodeQuery( char* data, char* image, uint32_t id )
             {
                 struct stat st;
                 fstat( d, &st );
-                if( st.st_size < ( TargetFrameSize - 16 ) )
+                if( st.st_size < ( m_frameSize - 16 ) )
                 {
                     lseek( d, 0, SEEK_SET );
                     auto ptr = (char*)tracy_malloc_fast( st.st_size );
@@ -4143,7 +6567,7 @@ void Profiler::HandleSourceCodeQuery( char* data, char* image, uint32_t id )
         char* ptr = m_sourceCallback( m_sourceCallbackData, data, sz );
         if( ptr )
         {
-            if( sz < ( TargetFrameSize - 16 ) )
+            if( sz < ( m_frameSize - 16 ) )
             {
                 TracyLfqPrepare( QueueType::SourceCodeMetadata );
                 MemWrite( &item->sourceCodeMetadata.ptr, (uint64_t)ptr );
@@ -4185,22 +6609,41 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin( const struct ___tracy_source_l
     ctx.active = active;
 #endif
     if( !ctx.active ) return ctx;
+#ifdef TRACY_ZONE_CATEGORIES
+    if( !tracy::ZoneCategoryEnabled( srcloc->category ) )
+    {
+        ctx.active = 0;
+        return ctx;
+    }
+#endif
     const auto id = tracy::GetProfiler().GetNextZoneId();
+#ifdef TRACY_HAS_ZONE_STATS
+    ctx.id = id | tracy::ZoneStatsIdFlag;
+    tracy::ZoneStatsBegin( (const tracy::SourceLocationData*)srcloc, ctx.id );
+#else
     ctx.id = id;
 
-#ifndef TRACY_NO_VERIFY
+#  ifndef TRACY_NO_VERIFY
     {
         TracyQueuePrepareC( tracy::QueueType::ZoneValidation );
         tracy::MemWrite( &item->zoneValidation.id, id );
         TracyQueueCommitC( zoneValidationThread );
     }
-#endif
+#  endif
+#  ifdef TRACY_COMPACT_ZONES
+    tracy::Profiler::BeginCompactZone( (uint64_t)srcloc );
+#  else
     {
         TracyQueuePrepareC( tracy::QueueType::ZoneBegin );
         tracy::MemWrite( &item->zoneBegin.time, tracy::Profiler::GetTime() );
         tracy::MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
         TracyQueueCommitC( zoneBeginThread );
     }
+#  endif
+#  ifdef TRACY_ZONE_COUNTERS
+    tracy::ZoneCountersPush();
+#  endif
+#endif
     return ctx;
 }
 
@@ -4213,7 +6656,24 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_callstack( const struct ___trac
     ctx.active = active;
 #endif
     if( !ctx.active ) return ctx;
-    const auto id = tracy::GetProfiler().GetNextZoneId();
+#ifdef TRACY_ZONE_CATEGORIES
+    if( !tracy::ZoneCategoryEnabled( srcloc->category ) )
+    {
+        ctx.active = 0;
+        return ctx;
+    }
+#endif
+    auto id = tracy::GetProfiler().GetNextZoneId();
+#ifdef TRACY_HAS_ZONE_STATS
+    if( depth <= 0 || !tracy::has_callstack() )
+    {
+        ctx.id = id | tracy::ZoneStatsIdFlag;
+        tracy::ZoneStatsBegin( (const tracy::SourceLocationData*)srcloc, ctx.id );
+        return ctx;
+    }
+    id &= ~tracy::ZoneStatsIdFlag;
+    tracy::ZoneStatsEmitOpen();
+#endif
     ctx.id = id;
 
 #ifndef TRACY_NO_VERIFY
@@ -4229,14 +6689,32 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_callstack( const struct ___trac
         tracy::GetProfiler().SendCallstack( depth );
         zoneQueue = tracy::QueueType::ZoneBeginCallstack;
     }
+#ifdef TRACY_COMPACT_ZONES
+    else
+    {
+        tracy::Profiler::BeginCompactZone( (uint64_t)srcloc );
+#ifdef TRACY_ZONE_COUNTERS
+        tracy::ZoneCountersPush();
+#endif
+        return ctx;
+    }
+#endif
     TracyQueuePrepareC( zoneQueue );
     tracy::MemWrite( &item->zoneBegin.time, tracy::Profiler::GetTime() );
     tracy::MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
     TracyQueueCommitC( zoneBeginThread );
 
+#ifdef TRACY_ZONE_COUNTERS
+    tracy::ZoneCountersPush();
+#endif
     return ctx;
 }
 
+#ifdef TRACY_ZONE_CATEGORIES
+TRACY_API void ___tracy_zone_category_setup( uint32_t category, const char* name, int32_t enabled ) { tracy::ZoneCategorySetup( category, name, enabled != 0 ); }
+TRACY_API void ___tracy_zone_category_enable( uint32_t category, int32_t enabled ) { tracy::ZoneCategoryEnable( category, enabled != 0 ); }
+#endif
+
 TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc( uint64_t srcloc, int32_t active )
 {
     ___tracy_c_zone_context ctx;
@@ -4250,7 +6728,11 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc( uint64_t srcloc, int32_t
         tracy::tracy_free( (void*)srcloc );
         return ctx;
     }
-    const auto id = tracy::GetProfiler().GetNextZoneId();
+    auto id = tracy::GetProfiler().GetNextZoneId();
+#ifdef TRACY_HAS_ZONE_STATS
+    id &= ~tracy::ZoneStatsIdFlag;
+    tracy::ZoneStatsEmitOpen();
+#endif
     ctx.id = id;
 
 #ifndef TRACY_NO_VERIFY
@@ -4266,6 +6748,9 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc( uint64_t srcloc, int32_t
         tracy::MemWrite( &item->zoneBegin.srcloc, srcloc );
         TracyQueueCommitC( zoneBeginThread );
     }
+#ifdef TRACY_ZONE_COUNTERS
+    tracy::ZoneCountersPush();
+#endif
     return ctx;
 }
 
@@ -4282,7 +6767,11 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc_callstack( uint64_t srclo
         tracy::tracy_free( (void*)srcloc );
         return ctx;
     }
-    const auto id = tracy::GetProfiler().GetNextZoneId();
+    auto id = tracy::GetProfiler().GetNextZoneId();
+#ifdef TRACY_HAS_ZONE_STATS
+    id &= ~tracy::ZoneStatsIdFlag;
+    tracy::ZoneStatsEmitOpen();
+#endif
     ctx.id = id;
 
 #ifndef TRACY_NO_VERIFY
@@ -4303,12 +6792,29 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc_callstack( uint64_t srclo
     tracy::MemWrite( &item->zoneBegin.srcloc, srcloc );
     TracyQueueCommitC( zoneBeginThread );
 
+#ifdef TRACY_ZONE_COUNTERS
+    tracy::ZoneCountersPush();
+#endif
     return ctx;
 }
 
 TRACY_API void ___tracy_emit_zone_end( TracyCZoneCtx ctx )
 {
     if( !ctx.active ) return;
+#ifdef TRACY_HAS_ZONE_STATS
+    if( ctx.id & tracy::ZoneStatsIdFlag )
+    {
+        tracy::ZoneStatsEnd();
+        return;
+    }
+#endif
+#ifdef TRACY_ZONE_COUNTERS
+    tracy::ZoneCountersPop();
+#endif
+#ifdef TRACY_COMPACT_ZONES
+    // The begin is still pending, so this has to be the innermost zone.
+    if( tracy::Profiler::EndCompactZone() ) return;
+#endif
 #ifndef TRACY_NO_VERIFY
     {
         TracyQueuePrepareC( tracy::QueueType::ZoneValidation );
@@ -4327,7 +6833,10 @@ TRACY_API void ___tracy_emit_zone_text( TracyCZoneCtx ctx, const char* txt, size
 {
     assert( size < std::numeric_limits<uint16_t>::max() );
     if( !ctx.active ) return;
-    auto ptr = (char*)tracy::tracy_malloc( size );
+#ifdef TRACY_HAS_ZONE_STATS
+    if( ctx.id & tracy::ZoneStatsIdFlag ) tracy::ZoneStatsEmitOpen();
+#endif
+    auto ptr = tracy::StringArenaAlloc( size );
     memcpy( ptr, txt, size );
 #ifndef TRACY_NO_VERIFY
     {
@@ -4348,7 +6857,10 @@ TRACY_API void ___tracy_emit_zone_name( TracyCZoneCtx ctx, const char* txt, size
 {
     assert( size < std::numeric_limits<uint16_t>::max() );
     if( !ctx.active ) return;
-    auto ptr = (char*)tracy::tracy_malloc( size );
+#ifdef TRACY_HAS_ZONE_STATS
+    if( ctx.id & tracy::ZoneStatsIdFlag ) tracy::ZoneStatsEmitOpen();
+#endif
+    auto ptr = tracy::StringArenaAlloc( size );
     memcpy( ptr, txt, size );
 #ifndef TRACY_NO_VERIFY
     {
@@ -4367,6 +6879,9 @@ TRACY_API void ___tracy_emit_zone_name( TracyCZoneCtx ctx, const char* txt, size
 
 TRACY_API void ___tracy_emit_zone_color( TracyCZoneCtx ctx, uint32_t color ) {
     if( !ctx.active ) return;
+#ifdef TRACY_HAS_ZONE_STATS
+    if( ctx.id & tracy::ZoneStatsIdFlag ) tracy::ZoneStatsEmitOpen();
+#endif
 #ifndef TRACY_NO_VERIFY
     {
         TracyQueuePrepareC( tracy::QueueType::ZoneValidation );
@@ -4386,6 +6901,9 @@ TRACY_API void ___tracy_emit_zone_color( TracyCZoneCtx ctx, uint32_t color ) {
 TRACY_API void ___tracy_emit_zone_value( TracyCZoneCtx ctx, uint64_t value )
 {
     if( !ctx.active ) return;
+#ifdef TRACY_HAS_ZONE_STATS
+    if( ctx.id & tracy::ZoneStatsIdFlag ) tracy::ZoneStatsEmitOpen();
+#endif
 #ifndef TRACY_NO_VERIFY
     {
         TracyQueuePrepareC( tracy::QueueType::ZoneValidation );
@@ -4400,6 +6918,36 @@ TRACY_API void ___tracy_emit_zone_value( TracyCZoneCtx ctx, uint64_t value )
     }
 }
 
+TRACY_API int64_t ___tracy_get_time(void)
+{
+    return tracy::Profiler::GetTime();
+}
+
+TRACY_API void ___tracy_emit_zone_batch( const struct ___tracy_zone_batch_event* events, size_t count )
+{
+    tracy::ZoneBatch batch( count != 0 );
+    if( !batch.IsActive() ) return;
+    for( size_t i=0; i<count; i++ )
+    {
+        const auto& ev = events[i];
+        switch( ev.type )
+        {
+        case TracyZoneBatchBegin:
+            batch.Begin( (const tracy::SourceLocationData*)ev.srcloc, ev.time );
+            break;
+        case TracyZoneBatchEnd:
+            batch.End( ev.time );
+            break;
+        case TracyZoneBatchValue:
+            batch.Value( ev.value );
+            break;
+        default:
+            assert( false );
+            break;
+        }
+    }
+}
+
 TRACY_API void ___tracy_emit_memory_alloc( const void* ptr, size_t size, int32_t secure ) { tracy::Profiler::MemAlloc( ptr, size, secure != 0 ); }
 TRACY_API void ___tracy_emit_memory_alloc_callstack( const void* ptr, size_t size, int32_t depth, int32_t secure )
 {
@@ -4464,10 +7012,12 @@ TRACY_API void ___tracy_emit_frame_mark( const char* name ) { tracy::Profiler::S
 TRACY_API void ___tracy_emit_frame_mark_start( const char* name ) { tracy::Profiler::SendFrameMark( name, tracy::QueueType::FrameMarkMsgStart ); }
 TRACY_API void ___tracy_emit_frame_mark_end( const char* name ) { tracy::Profiler::SendFrameMark( name, tracy::QueueType::FrameMarkMsgEnd ); }
 TRACY_API void ___tracy_emit_frame_image( const void* image, uint16_t w, uint16_t h, uint8_t offset, int32_t flip ) { tracy::Profiler::SendFrameImage( image, w, h, offset, flip != 0 ); }
+TRACY_API void ___tracy_emit_frame_image_compressed( const void* image, uint16_t w, uint16_t h, uint8_t offset, int32_t flip ) { tracy::Profiler::SendFrameImageCompressed( image, w, h, offset, flip != 0 ); }
 TRACY_API void ___tracy_emit_plot( const char* name, double val ) { tracy::Profiler::PlotData( name, val ); }
 TRACY_API void ___tracy_emit_plot_float( const char* name, float val ) { tracy::Profiler::PlotData( name, val ); }
 TRACY_API void ___tracy_emit_plot_int( const char* name, int64_t val ) { tracy::Profiler::PlotData( name, val ); }
 TRACY_API void ___tracy_emit_plot_config( const char* name, int32_t type, int32_t step, int32_t fill, uint32_t color ) { tracy::Profiler::ConfigurePlot( name, tracy::PlotFormatType(type), step != 0, fill != 0, color ); }
+TRACY_API void ___tracy_emit_plot_downsample( const char* name, int64_t window, int32_t aggregate ) { tracy::PlotDownsampleSetup( name, window, tracy::PlotAggregate(aggregate) ); }
 
 static_assert( TracyMessageSeverityTrace == int(tracy::MessageSeverity::Trace), "Mismatch between C and C++ versions of message severity" );
 static_assert( TracyMessageSeverityDebug == int(tracy::MessageSeverity::Debug), "Mismatch between C and C++ versions of message severity" );
@@ -4743,7 +7293,7 @@ struct __tracy_lockable_context_data
 #endif
 };
 
-TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_lockable_ctx( const struct ___tracy_source_location_data* srcloc )
+static struct __tracy_lockable_context_data* AnnounceLockableCtx( const struct ___tracy_source_location_data* srcloc, tracy::LockType type )
 {
     struct __tracy_lockable_context_data *lockdata = (__tracy_lockable_context_data*)tracy::tracy_malloc( sizeof( __tracy_lockable_context_data ) );
     lockdata->m_id =tracy:: GetLockCounter().fetch_add( 1, std::memory_order_relaxed );
@@ -4758,7 +7308,7 @@ TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_lockable_ctx(
     tracy::MemWrite( &item->lockAnnounce.id, lockdata->m_id );
     tracy::MemWrite( &item->lockAnnounce.time, tracy::Profiler::GetTime() );
     tracy::MemWrite( &item->lockAnnounce.lckloc, (uint64_t)srcloc );
-    tracy::MemWrite( &item->lockAnnounce.type, tracy::LockType::Lockable );
+    tracy::MemWrite( &item->lockAnnounce.type, type );
 #ifdef TRACY_ON_DEMAND
     tracy::GetProfiler().DeferItem( *item );
 #endif
@@ -4767,6 +7317,16 @@ TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_lockable_ctx(
     return lockdata;
 }
 
+TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_lockable_ctx( const struct ___tracy_source_location_data* srcloc )
+{
+    return AnnounceLockableCtx( srcloc, tracy::LockType::Lockable );
+}
+
+TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_shared_lockable_ctx( const struct ___tracy_source_location_data* srcloc )
+{
+    return AnnounceLockableCtx( srcloc, tracy::LockType::SharedLockable );
+}
+
 TRACY_API void ___tracy_terminate_lockable_ctx( struct __tracy_lockable_context_data* lockdata )
 {
     auto item = tracy::Profiler::QueueSerial();
@@ -4866,6 +7426,88 @@ TRACY_API void ___tracy_after_try_lock_lockable_ctx( struct __tracy_lockable_con
     }
 }
 
+TRACY_API int32_t ___tracy_before_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata )
+{
+#ifdef TRACY_ON_DEMAND
+    bool queue = false;
+    const auto locks = lockdata->m_lockCount.fetch_add( 1, std::memory_order_relaxed );
+    const auto active = lockdata->m_active.load( std::memory_order_relaxed );
+    if( locks == 0 || active )
+    {
+        const bool connected = tracy::GetProfiler().IsConnected();
+        if( active != connected ) lockdata->m_active.store( connected, std::memory_order_relaxed );
+        if( connected ) queue = true;
+    }
+    if( !queue ) return static_cast<int32_t>(false);
+#endif
+
+    auto item = tracy::Profiler::QueueSerial();
+    tracy::MemWrite( &item->hdr.type, tracy::QueueType::LockSharedWait );
+    tracy::MemWrite( &item->lockWait.thread, tracy::GetThreadHandle() );
+    tracy::MemWrite( &item->lockWait.id, lockdata->m_id );
+    tracy::MemWrite( &item->lockWait.time, tracy::Profiler::GetTime() );
+    tracy::Profiler::QueueSerialFinish();
+    return static_cast<int32_t>(true);
+}
+
+TRACY_API void ___tracy_after_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata )
+{
+    auto item = tracy::Profiler::QueueSerial();
+    tracy::MemWrite( &item->hdr.type, tracy::QueueType::LockSharedObtain );
+    tracy::MemWrite( &item->lockObtain.thread, tracy::GetThreadHandle() );
+    tracy::MemWrite( &item->lockObtain.id, lockdata->m_id );
+    tracy::MemWrite( &item->lockObtain.time, tracy::Profiler::GetTime() );
+    tracy::Profiler::QueueSerialFinish();
+}
+
+TRACY_API void ___tracy_after_unlock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata )
+{
+#ifdef TRACY_ON_DEMAND
+    lockdata->m_lockCount.fetch_sub( 1, std::memory_order_relaxed );
+    if( !lockdata->m_active.load( std::memory_order_relaxed ) ) return;
+    if( !tracy::GetProfiler().IsConnected() )
+    {
+        lockdata->m_active.store( false, std::memory_order_relaxed );
+        return;
+    }
+#endif
+
+    auto item = tracy::Profiler::QueueSerial();
+    tracy::MemWrite( &item->hdr.type, tracy::QueueType::LockSharedRelease );
+    tracy::MemWrite( &item->lockReleaseShared.thread, tracy::GetThreadHandle() );
+    tracy::MemWrite( &item->lockReleaseShared.id, lockdata->m_id );
+    tracy::MemWrite( &item->lockReleaseShared.time, tracy::Profiler::GetTime() );
+    tracy::Profiler::QueueSerialFinish();
+}
+
+TRACY_API void ___tracy_after_try_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata, int32_t acquired )
+{
+#ifdef TRACY_ON_DEMAND
+    if( !acquired ) return;
+
+    bool queue = false;
+    const auto locks = lockdata->m_lockCount.fetch_add( 1, std::memory_order_relaxed );
+    const auto active = lockdata->m_active.load( std::memory_order_relaxed );
+    if( locks == 0 || active )
+    {
+        const bool connected = tracy::GetProfiler().IsConnected();
+        if( active != connected ) lockdata->m_active.store( connected, std::memory_order_relaxed );
+        if( connected ) queue = true;
+    }
+    if( !queue ) return;
+#endif
+
+    if( acquired )
+    {
+        auto item = tracy::Profiler::QueueSerial();
+        tracy::MemWrite( &item->hdr.type, tracy::QueueType::LockSharedObtain );
+        tracy::MemWrite( &item->lockObtain.thread, tracy::GetThreadHandle() );
+        tracy::MemWrite( &item->lockObtain.id, lockdata->m_id );
+        tracy::MemWrite( &item->lockObtain.time, tracy::Profiler::GetTime() );
+        tracy::Profiler::QueueSerialFinish();
+    }
+}
+
 TRACY_API void ___tracy_mark_lockable_ctx( struct __tracy_lockable_context_data* lockdata, const struct ___tracy_source_location_data* srcloc )
 {
 #ifdef TRACY_ON_DEMAND
@@ -4908,9 +7550,45 @@ TRACY_API int32_t ___tracy_connected( void )
     return static_cast<int32_t>( tracy::GetProfiler().IsConnected() );
 }
 
+TRACY_API const void* ___tracy_connected_flag( void )
+{
+    static_assert( sizeof( std::atomic<bool> ) == 1, "The flag must be readable as a byte" );
+    return tracy::GetProfiler().ConnectedFlag();
+}
+
+TRACY_API void ___tracy_get_client_stats( struct ___tracy_client_stats* stats )
+{
+    const auto s = tracy::GetProfiler().GetStats();
+    stats->queueDepth = s.queueDepth;
+    stats->serialDepth = s.serialDepth;
+    stats->symbolQueueDepth = s.symbolQueueDepth;
+    stats->frameImageBacklog = s.frameImageBacklog;
+    stats->workerBusyNs = s.workerBusyNs;
+    stats->workerIdleNs = s.workerIdleNs;
+    stats->rawBytes = s.rawBytes;
+    stats->compressedBytes = s.compressedBytes;
+    stats->sendNs = s.sendNs;
+    stats->symbolsResolved = s.symbolsResolved;
+    stats->samplesLost = s.samplesLost;
+    stats->frameImagesDropped = s.frameImagesDropped;
+}
+
+TRACY_API int32_t ___tracy_set_thread_affinity( const char* cpus )
+{
+    return tracy::SetProfilerThreadAffinity( cpus );
+}
+
+TRACY_API int32_t ___tracy_set_thread_priority( int32_t nice, int32_t sched )
+{
+    if( sched < 0 || sched > (int32_t)tracy::ThreadSched::Idle ) return 0;
+    return tracy::SetProfilerThreadPriority( nice, (tracy::ThreadSched)sched );
+}
+
 #ifdef TRACY_FIBERS
 TRACY_API void ___tracy_fiber_enter( const char* fiber ){ tracy::Profiler::EnterFiber( fiber, 0 ); }
 TRACY_API void ___tracy_fiber_leave( void ){ tracy::Profiler::LeaveFiber(); }
+TRACY_API uint32_t ___tracy_fiber_register( const char* name ){ return tracy::Profiler::RegisterFiber( name ); }
+TRACY_API void ___tracy_fiber_enter_id( uint32_t id ){ tracy::Profiler::EnterFiberId( id, 0 ); }
 #endif
 
 #  if defined TRACY_MANUAL_LIFETIME && defined TRACY_DELAYED_INIT
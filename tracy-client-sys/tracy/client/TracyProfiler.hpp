@@ -3,23 +3,38 @@
 
 #include <assert.h>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
 
 #include "tracy_concurrentqueue.h"
 #include "tracy_SPSCQueue.h"
+#include "TracyThreadQueue.hpp"
 #include "TracyCallstack.hpp"
+#include "TracyCallstackTable.hpp"
 #include "TracyKCore.hpp"
-#include "TracySysPower.hpp"
-#include "TracySysTime.hpp"
+#include "TracyMemAggregate.hpp"
+#include "TracyPlotDownsample.hpp"
+#include "TracySerialQueue.hpp"
+#include "TracySourceCache.hpp"
+#include "TracyStringArena.hpp"
+#include "TracySymbolCache.hpp"
+#include "TracySysSampler.hpp"
 #include "TracyTimer.hpp"
+#include "TracyWakeup.hpp"
 #include "TracyFastVector.hpp"
+#include "TracySegmentedVector.hpp"
+#include "TracyZoneCategory.hpp"
+#include "TracyZoneSampling.hpp"
+#include "TracyZoneStats.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyAlign.hpp"
 #include "../common/TracyAlloc.hpp"
 #include "../common/TracyMutex.hpp"
 #include "../common/TracyProtocol.hpp"
+#include "../common/TracyShmRing.hpp"
 
 #ifdef __linux__
 #  include <signal.h>
@@ -32,6 +47,16 @@
 #  define TracyConcatIndirect(x,y) x##y
 #endif
 
+// Minimum duration policies drop zones when they are compacted.
+#if defined TRACY_ZONE_SAMPLING && !defined TRACY_COMPACT_ZONES
+#  define TRACY_COMPACT_ZONES
+#endif
+
+// Zones of fibers go through the serial queue, where items can't be held back.
+#if defined TRACY_COMPACT_ZONES && defined TRACY_FIBERS
+#  undef TRACY_COMPACT_ZONES
+#endif
+
 namespace tracy
 {
 #if defined(TRACY_DELAYED_INIT) && defined(TRACY_MANUAL_LIFETIME)
@@ -47,16 +72,39 @@ TRACY_API bool BeginSamplingProfiling();
 TRACY_API void EndSamplingProfiling();
 
 class GpuCtx;
+class ListenSocket;
 class Profiler;
 class Socket;
+class Thread;
 class UdpBroadcast;
+struct SocketChunk;
+#ifdef TRACY_OFFLINE_CAPTURE
+class CaptureFile;
+class CaptureQueries;
+#endif
+#ifndef TRACY_ON_DEMAND
+class FlightRecorder;
+#endif
 
 struct GpuCtxWrapper
 {
     GpuCtx* ptr;
 };
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken();
+#ifdef TRACY_THREAD_QUEUES
+typedef ThreadQueueSet EventQueue;
+typedef ThreadQueueProducerToken EventProducerToken;
+typedef ThreadQueueConsumerToken EventConsumerToken;
+#else
+typedef moodycamel::ConcurrentQueue<QueueItem> EventQueue;
+typedef moodycamel::ProducerToken EventProducerToken;
+typedef moodycamel::ConsumerToken EventConsumerToken;
+#endif
+
+TRACY_API EventQueue::ExplicitProducer* GetToken();
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+TRACY_API SerialQueue* GetSerialQueue();
+#endif
 TRACY_API Profiler& GetProfiler();
 TRACY_API std::atomic<uint32_t>& GetLockCounter();
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter();
@@ -65,6 +113,25 @@ TRACY_API uint32_t GetThreadHandle();
 TRACY_API bool ProfilerAvailable();
 TRACY_API bool ProfilerAllocatorAvailable();
 
+#ifdef TRACY_COMPACT_ZONES
+// A zone begin may be left unpublished at the tail of the thread's queue, so that it can be turned
+// into a single ZoneCompact item if the zone ends before anything else is emitted by the thread.
+// Anything else put into the queue has to publish it first.
+static tracy_force_inline void FlushPendingZone( EventQueue::ExplicitProducer* token )
+{
+    auto& pending = token->get_pending_zone();
+    if( pending )
+    {
+        pending = nullptr;
+        auto& tail = token->get_tail_index();
+        tail.store( tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+}
+#  define TracyLfqFlushPendingZone tracy::FlushPendingZone( __token );
+#else
+#  define TracyLfqFlushPendingZone
+#endif
+
 struct SourceLocationData
 {
     const char* name;
@@ -72,8 +139,28 @@ struct SourceLocationData
     const char* file;
     uint32_t line;
     uint32_t color;
+#ifdef TRACY_ZONE_CATEGORIES
+    uint32_t category = 0;  // zero for none, see TracyZoneCategory.hpp
+#endif
+};
+
+#ifdef TRACY_FIBERS
+// A fiber entry is only sent along with the first thing the thread emits while in the fiber, so
+// that fibers which are left without having emitted anything don't cost a queue item at all.
+struct FiberState
+{
+    const char* pending;    // entered, not sent yet
+    int64_t time;
+    int32_t groupHint;
+    bool active;            // entry sent, not left yet
+#ifdef TRACY_ON_DEMAND
+    uint64_t connection;    // of the entry, the state is stale once it changes
+#endif
 };
 
+TRACY_API FiberState& GetFiberState();
+#endif
+
 #ifdef TRACY_ON_DEMAND
 struct LuaZoneState
 {
@@ -83,25 +170,35 @@ struct LuaZoneState
 #endif
 
 
+#ifdef TRACY_WORKER_WAKEUP
+#  define TracyLfqWakeWorker tracy::GetWorkerWakeup().Notify();
+#else
+#  define TracyLfqWakeWorker
+#endif
+
 #define TracyLfqPrepare( _type ) \
     tracy::moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
     auto __token = tracy::GetToken(); \
+    TracyLfqFlushPendingZone \
     auto& __tail = __token->get_tail_index(); \
     auto item = __token->enqueue_begin( __magic ); \
     tracy::MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommit \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + 1, std::memory_order_release ); \
+    TracyLfqWakeWorker
 
 #define TracyLfqPrepareC( _type ) \
     tracy::moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
     auto __token = tracy::GetToken(); \
+    TracyLfqFlushPendingZone \
     auto& __tail = __token->get_tail_index(); \
     auto item = __token->enqueue_begin( __magic ); \
     tracy::MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommitC \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + 1, std::memory_order_release ); \
+    TracyLfqWakeWorker
 
 
 #ifdef TRACY_FIBERS
@@ -128,8 +225,30 @@ struct LuaZoneState
 typedef void(*ParameterCallback)( void* data, uint32_t idx, int32_t val );
 typedef char*(*SourceContentsCallback)( void* data, const char* filename, size_t& size );
 
+// Counters the profiler keeps about itself, see Profiler::GetStats(). The depths are sampled by
+// the profiler thread every 100 ms while a server is connected, the rest are totals since the
+// profiler was started.
+struct ProfilerStats
+{
+    uint64_t queueDepth;            // events waiting in the event queues
+    uint64_t serialDepth;           // most events taken from the serial queues at once
+    uint64_t symbolQueueDepth;      // frames and symbols waiting to be resolved
+    uint64_t frameImageBacklog;     // bytes of frame images waiting to be compressed
+    uint64_t workerBusyNs;          // time the profiler thread spent working while connected
+    uint64_t workerIdleNs;          // time it spent waiting for events while connected
+    uint64_t rawBytes;              // data handed to compression
+    uint64_t compressedBytes;       // data sent, after compression
+    uint64_t sendNs;                // time spent in socket sends
+    uint64_t symbolsResolved;       // symbol queue items handled
+    uint64_t samplesLost;           // samples dropped by the kernel because a buffer was full
+    uint64_t frameImagesDropped;    // frame images dropped because the budget was exceeded
+};
+
 class Profiler
 {
+    // Size classes of the elided allocations: up to 16 bytes, 64 bytes, ... 64 KiB, and larger.
+    enum { MemElideClasses = 8 };
+
     struct FrameImageQueueItem
     {
         void* image;
@@ -164,6 +283,12 @@ public:
 
     static tracy_force_inline int64_t GetTime()
     {
+#ifdef TRACY_HAS_TSC_TIMER
+        if( timers::tsc::enabled() ) return timers::tsc::now();
+#endif
+#ifdef TRACY_HAS_CNTVCT_TIMER
+        if( timers::cntvct::enabled() ) return timers::cntvct::now();
+#endif
         return high_res_time::now().time_since_epoch().count();
     }
 
@@ -177,25 +302,106 @@ public:
 
     static tracy_force_inline QueueItem* QueueSerial()
     {
-        auto& p = GetProfiler();
-        p.m_serialLock.lock();
-        return p.m_serialQueue.prepare_next();
+        QueueSerialLock();
+        return QueueSerialNext();
     }
 
     static tracy_force_inline QueueItem* QueueSerialCallstack( void* ptr )
     {
-        auto& p = GetProfiler();
-        p.m_serialLock.lock();
-        p.SendCallstackSerial( ptr );
-        return p.m_serialQueue.prepare_next();
+        QueueSerialLock();
+        SendCallstackSerial( ptr );
+        return QueueSerialNext();
     }
 
     static tracy_force_inline void QueueSerialFinish()
     {
-        auto& p = GetProfiler();
-        p.m_serialQueue.commit_next();
-        p.m_serialLock.unlock();
+        QueueSerialCommitNext();
+        QueueSerialUnlock();
+    }
+
+#ifdef TRACY_COMPACT_ZONES
+    static tracy_force_inline void BeginCompactZone( uint64_t srcloc )
+    {
+        auto token = GetToken();
+        auto& pending = token->get_pending_zone();
+        auto item = pending;
+#ifdef TRACY_ZONE_SAMPLING
+        // The slot of a dropped zone can be taken over.
+        if( !item || MemRead<QueueType>( &item->hdr.type ) != QueueType::ZoneCompact )
+#endif
+        {
+            FlushPendingZone( token );
+            moodycamel::ConcurrentQueueDefaultTraits::index_t idx;
+            item = token->enqueue_begin( idx );
+        }
+        MemWrite( &item->hdr.type, QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, GetTime() );
+        MemWrite( &item->zoneBegin.srcloc, srcloc );
+        pending = item;
+    }
+
+    // Fails if anything was emitted since the zone began, which then has to end regularly. A zone
+    // shorter than minDuration is dropped. Its slot stays pending, to be reused by the next zone.
+    static tracy_force_inline bool EndCompactZone( int64_t minDuration = 0 )
+    {
+        auto token = GetToken();
+        auto& pending = token->get_pending_zone();
+        if( !pending ) return false;
+        const auto end = GetTime();
+#ifdef TRACY_ZONE_SAMPLING
+        if( MemRead<QueueType>( &pending->hdr.type ) == QueueType::ZoneCompact ) return false;
+        if( end - MemRead<int64_t>( &pending->zoneBegin.time ) < minDuration )
+        {
+            MemWrite( &pending->hdr.type, QueueType::ZoneCompact );
+            MemWrite( &pending->zoneCompact.srcloc, uint64_t( 0 ) );
+            return true;
+        }
+#endif
+        MemWrite( &pending->hdr.type, QueueType::ZoneCompact );
+        MemWrite( &pending->zoneCompact.end, end );
+        pending = nullptr;
+        auto& tail = token->get_tail_index();
+        tail.store( tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+        TracyLfqWakeWorker
+        return true;
+    }
+#endif
+
+    // For batches of items, which keep the serial queue locked in between.
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+    static tracy_force_inline void QueueSerialLock() { GetSerialQueue()->Lock(); QueueSerialFiber(); }
+    static tracy_force_inline QueueItem* QueueSerialNext() { return GetSerialQueue()->Queue().prepare_next(); }
+    static tracy_force_inline void QueueSerialCommitNext() { GetSerialQueue()->Queue().commit_next(); }
+    static tracy_force_inline void QueueSerialUnlock() { GetSerialQueue()->Unlock(); TracyLfqWakeWorker }
+#else
+    static tracy_force_inline void QueueSerialLock() { GetProfiler().m_serialLock.lock(); QueueSerialFiber(); }
+    static tracy_force_inline QueueItem* QueueSerialNext() { return GetProfiler().m_serialQueue.prepare_next(); }
+    static tracy_force_inline void QueueSerialCommitNext() { GetProfiler().m_serialQueue.commit_next(); }
+    static tracy_force_inline void QueueSerialUnlock() { GetProfiler().m_serialLock.unlock(); TracyLfqWakeWorker }
+#endif
+
+#ifdef TRACY_FIBERS
+    // Sends the pending fiber entry of the thread, ahead of what it emits next.
+    static tracy_force_inline void QueueSerialFiber()
+    {
+        auto& fiber = GetFiberState();
+        if( !fiber.pending ) return;
+        auto item = QueueSerialNext();
+        MemWrite( &item->hdr.type, QueueType::FiberEnter );
+        MemWrite( &item->fiberEnter.time, fiber.time );
+        MemWrite( &item->fiberEnter.fiber, (uint64_t)fiber.pending );
+        MemWrite( &item->fiberEnter.thread, GetThreadHandle() );
+        MemWrite( &item->fiberEnter.groupHint, fiber.groupHint );
+        QueueSerialCommitNext();
+        fiber.pending = nullptr;
+        fiber.active = true;
+#ifdef TRACY_ON_DEMAND
+        fiber.connection = GetProfiler().ConnectionId();
+#endif
     }
+#else
+    static tracy_force_inline void QueueSerialFiber() {}
+#endif
 
     static tracy_force_inline void SendFrameMark( const char* name )
     {
@@ -231,9 +437,42 @@ public:
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
 #  endif
-        const auto sz = size_t( w ) * size_t( h ) * 4;
-        auto ptr = (char*)tracy_malloc( sz );
-        memcpy( ptr, image, sz );
+        auto sz = size_t( w ) * size_t( h ) * 4;
+        // The compressed image has to go out in a single frame.
+        if( sz / 8 + 64 > profiler.m_frameSize )
+        {
+            profiler.m_fiDropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+        char* ptr;
+        const auto budget = profiler.m_fiBudget;
+        const auto pending = profiler.m_fiPending.load( std::memory_order_relaxed );
+        if( budget != 0 && pending + sz > budget / 2 && ( w % 8 ) == 0 && ( h % 8 ) == 0 )
+        {
+            // The compression thread is falling behind. Send the image at half resolution.
+            if( pending + sz / 4 > budget )
+            {
+                profiler.m_fiDropped.fetch_add( 1, std::memory_order_relaxed );
+                return;
+            }
+            sz /= 4;
+            ptr = (char*)tracy_malloc( sz );
+            DownscaleFrameImage( (const char*)image, ptr, w, h );
+            w /= 2;
+            h /= 2;
+            profiler.m_fiDownscaled.fetch_add( 1, std::memory_order_relaxed );
+        }
+        else
+        {
+            if( budget != 0 && pending + sz > budget )
+            {
+                profiler.m_fiDropped.fetch_add( 1, std::memory_order_relaxed );
+                return;
+            }
+            ptr = (char*)tracy_malloc( sz );
+            memcpy( ptr, image, sz );
+        }
+        profiler.m_fiPending.fetch_add( sz, std::memory_order_relaxed );
 
         profiler.m_fiLock.lock();
         auto fi = profiler.m_fiQueue.prepare_next();
@@ -244,6 +483,48 @@ public:
         fi->flip = flip;
         profiler.m_fiQueue.commit_next();
         profiler.m_fiLock.unlock();
+#ifdef TRACY_WORKER_WAKEUP
+        profiler.m_fiWakeup.Notify();
+#endif
+#else
+        static_cast<void>(image); // unused
+        static_cast<void>(w); // unused
+        static_cast<void>(h); // unused
+        static_cast<void>(offset); // unused
+        static_cast<void>(flip); // unused
+#endif
+    }
+
+    // Takes an image already compressed to DXT1 (BC1), e.g. on the GPU: 8 bytes for each 4x4 block,
+    // in rows of blocks from the top, w * h / 2 bytes in total. It is copied and sent as it is,
+    // without going through the compression thread.
+    static tracy_force_inline void SendFrameImageCompressed( const void* image, uint16_t w, uint16_t h, uint8_t offset, bool flip )
+    {
+#ifndef TRACY_NO_FRAME_IMAGE
+        auto& profiler = GetProfiler();
+        assert( profiler.m_frameCount.load( std::memory_order_relaxed ) < (std::numeric_limits<uint32_t>::max)() );
+        assert( ( w % 4 ) == 0 && ( h % 4 ) == 0 );
+#  ifdef TRACY_ON_DEMAND
+        if( !profiler.IsConnected() ) return;
+#  endif
+        const auto csz = size_t( w ) * size_t( h ) / 2;
+        if( csz + 64 > profiler.m_frameSize )
+        {
+            profiler.m_fiDropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+        auto ptr = (char*)tracy_malloc( csz );
+        memcpy( ptr, image, csz );
+
+        const auto frame = uint32_t( profiler.m_frameCount.load( std::memory_order_relaxed ) - offset );
+        const uint8_t flipByte = flip;
+        TracyLfqPrepare( QueueType::FrameImage );
+        MemWrite( &item->frameImageFat.image, (uint64_t)ptr );
+        MemWrite( &item->frameImageFat.frame, frame );
+        MemWrite( &item->frameImageFat.w, w );
+        MemWrite( &item->frameImageFat.h, h );
+        MemWrite( &item->frameImageFat.flip, flipByte );
+        TracyLfqCommit;
 #else
         static_cast<void>(image); // unused
         static_cast<void>(w); // unused
@@ -255,6 +536,7 @@ public:
 
     static tracy_force_inline void PlotData( const char* name, int64_t val )
     {
+        if( PlotDownsample( name, double( val ) ) ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
@@ -267,6 +549,7 @@ public:
 
     static tracy_force_inline void PlotData( const char* name, float val )
     {
+        if( PlotDownsample( name, double( val ) ) ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
@@ -279,6 +562,7 @@ public:
 
     static tracy_force_inline void PlotData( const char* name, double val )
     {
+        if( PlotDownsample( name, val ) ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
@@ -316,7 +600,7 @@ public:
             tracy::GetProfiler().SendCallstack( callstack_depth );
         }
 
-        auto ptr = (char*)tracy_malloc( txtLength );
+        auto ptr = StringArenaAlloc( txtLength );
         memcpy( ptr, txt, txtLength );
         TaggedUserlandAddress taggedPtr{ (uint64_t)ptr, MakeMessageMetadata( source, severity ) };
 
@@ -395,46 +679,77 @@ public:
     static tracy_force_inline void MemAlloc( const void* ptr, size_t size, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
+#ifdef TRACY_MEMORY_AGGREGATION
+        MemAggregateAlloc( nullptr, size );
+        return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+#ifdef TRACY_MEMORY_BATCHING
+        auto queue = GetSerialQueue();
+        if( auto item = queue->RingPrepare() )
+        {
+            WriteMemAlloc( item, QueueType::MemAlloc, thread, ptr, size );
+            queue->RingPublish();
+            MemWrite( &item->memAlloc.time, GetTime() );
+            queue->RingCommit();
+            TracyLfqWakeWorker
+            return;
+        }
+#endif
+        QueueSerialLock();
         SendMemAlloc( QueueType::MemAlloc, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        QueueSerialUnlock();
     }
 
     static tracy_force_inline void MemFree( const void* ptr, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
+#ifdef TRACY_MEMORY_AGGREGATION
+        MemAggregateFree( nullptr );
+        return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+#ifdef TRACY_MEMORY_BATCHING
+        auto queue = GetSerialQueue();
+        if( auto item = queue->RingPrepare() )
+        {
+            WriteMemFree( item, QueueType::MemFree, thread, ptr );
+            queue->RingPublish();
+            MemWrite( &item->memFree.time, GetTime() );
+            queue->RingCommit();
+            TracyLfqWakeWorker
+            return;
+        }
+#endif
+        QueueSerialLock();
         SendMemFree( QueueType::MemFree, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        QueueSerialUnlock();
     }
 
     static tracy_force_inline void MemAllocCallstack( const void* ptr, size_t size, int32_t depth, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
-        if( depth > 0 && has_callstack() )
+        if( depth > 0 && has_callstack() && !MemoryAggregation && SampleMemAlloc( size ) )
         {
-            auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-            if( !profiler.IsConnected() ) return;
+            if( !GetProfiler().IsConnected() ) return;
 #  endif
             const auto thread = GetThreadHandle();
 
-            auto callstack = Callstack( depth );
+            auto callstack = InternedCallstack( depth );
 
-            profiler.m_serialLock.lock();
+            QueueSerialLock();
             SendCallstackSerial( callstack );
             SendMemAlloc( QueueType::MemAllocCallstack, thread, ptr, size );
-            profiler.m_serialLock.unlock();
+            QueueSerialUnlock();
         }
         else
         {
@@ -450,20 +765,19 @@ public:
             MemFree( ptr, secure );
             return;
         }
-        if( depth > 0 && has_callstack() )
+        if( depth > 0 && has_callstack() && !MemoryAggregation && GetProfiler().m_memSampleInterval == 0 )
         {
-            auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-            if( !profiler.IsConnected() ) return;
+            if( !GetProfiler().IsConnected() ) return;
 #  endif
             const auto thread = GetThreadHandle();
 
-            auto callstack = Callstack( depth );
+            auto callstack = InternedCallstack( depth );
 
-            profiler.m_serialLock.lock();
+            QueueSerialLock();
             SendCallstackSerial( callstack );
             SendMemFree( QueueType::MemFreeCallstack, thread, ptr );
-            profiler.m_serialLock.unlock();
+            QueueSerialUnlock();
         }
         else
         {
@@ -474,49 +788,56 @@ public:
     static tracy_force_inline void MemAllocNamed( const void* ptr, size_t size, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
+#ifdef TRACY_MEMORY_AGGREGATION
+        MemAggregateAlloc( name, size );
+        return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        QueueSerialLock();
         SendMemName( name );
         SendMemAlloc( QueueType::MemAllocNamed, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        QueueSerialUnlock();
     }
 
     static tracy_force_inline void MemFreeNamed( const void* ptr, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
+#ifdef TRACY_MEMORY_AGGREGATION
+        MemAggregateFree( name );
+        return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        QueueSerialLock();
         SendMemName( name );
         SendMemFree( QueueType::MemFreeNamed, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        QueueSerialUnlock();
     }
 
     static tracy_force_inline void MemAllocCallstackNamed( const void* ptr, size_t size, int32_t depth, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
-        if( depth > 0 && has_callstack() )
+        if( depth > 0 && has_callstack() && !MemoryAggregation && SampleMemAlloc( size ) )
         {
-            auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-            if( !profiler.IsConnected() ) return;
+            if( !GetProfiler().IsConnected() ) return;
 #  endif
             const auto thread = GetThreadHandle();
 
-            auto callstack = Callstack( depth );
+            auto callstack = InternedCallstack( depth );
 
-            profiler.m_serialLock.lock();
+            QueueSerialLock();
             SendCallstackSerial( callstack );
             SendMemName( name );
             SendMemAlloc( QueueType::MemAllocCallstackNamed, thread, ptr, size );
-            profiler.m_serialLock.unlock();
+            QueueSerialUnlock();
         }
         else
         {
@@ -527,21 +848,20 @@ public:
     static tracy_force_inline void MemFreeCallstackNamed( const void* ptr, int32_t depth, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
-        if( depth > 0 && has_callstack() )
+        if( depth > 0 && has_callstack() && !MemoryAggregation && GetProfiler().m_memSampleInterval == 0 )
         {
-            auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-            if( !profiler.IsConnected() ) return;
+            if( !GetProfiler().IsConnected() ) return;
 #  endif
             const auto thread = GetThreadHandle();
 
-            auto callstack = Callstack( depth );
+            auto callstack = InternedCallstack( depth );
 
-            profiler.m_serialLock.lock();
+            QueueSerialLock();
             SendCallstackSerial( callstack );
             SendMemName( name );
             SendMemFree( QueueType::MemFreeCallstackNamed, thread, ptr );
-            profiler.m_serialLock.unlock();
+            QueueSerialUnlock();
         }
         else
         {
@@ -552,32 +872,36 @@ public:
     static tracy_force_inline void MemDiscard( const char* name, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
+#ifdef TRACY_MEMORY_AGGREGATION
+        MemAggregateDiscard( name );
+        return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
+        QueueSerialLock();
         SendMemDiscard( QueueType::MemDiscard, thread, name );
-        GetProfiler().m_serialLock.unlock();
+        QueueSerialUnlock();
     }
 
     static tracy_force_inline void MemDiscardCallstack( const char* name, bool secure, int32_t depth )
     {
         if( secure && !ProfilerAvailable() ) return;
-        if( depth > 0 && has_callstack() )
+        if( depth > 0 && has_callstack() && !MemoryAggregation )
         {
 #  ifdef TRACY_ON_DEMAND
             if( !GetProfiler().IsConnected() ) return;
 #  endif
             const auto thread = GetThreadHandle();
 
-            auto callstack = Callstack( depth );
+            auto callstack = InternedCallstack( depth );
 
-            GetProfiler().m_serialLock.lock();
+            QueueSerialLock();
             SendCallstackSerial( callstack );
             SendMemDiscard( QueueType::MemDiscard, thread, name );
-            GetProfiler().m_serialLock.unlock();
+            QueueSerialUnlock();
         }
         else
         {
@@ -589,7 +913,7 @@ public:
     {
         if( depth > 0 && has_callstack() )
         {
-            auto ptr = Callstack( depth );
+            auto ptr = InternedCallstack( depth );
             TracyQueuePrepare( QueueType::Callstack );
             MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
             TracyQueueCommit( callstackFatThread );
@@ -626,16 +950,24 @@ public:
     }
 
 #ifdef TRACY_FIBERS
+    // The entry is sent with whatever the thread emits next, see FiberState. A fiber which is left,
+    // or switched from, before that is not sent at all.
     static tracy_force_inline void EnterFiber( const char* fiber, int32_t groupHint )
     {
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
-        TracyQueuePrepare( QueueType::FiberEnter );
-        MemWrite( &item->fiberEnter.time, GetTime() );
-        MemWrite( &item->fiberEnter.fiber, (uint64_t)fiber );
-        MemWrite( &item->fiberEnter.groupHint, groupHint );
-        TracyQueueCommit( fiberEnter );
+        auto& state = GetFiberState();
+#ifdef TRACY_ON_DEMAND
+        DropStaleFiberState( state );
+        state.connection = GetProfiler().ConnectionId();
+#endif
+        // Leave the fiber switched from right away, so that it doesn't seem to run until the
+        // entry of the next one is sent.
+        if( state.active ) SendFiberLeave( state );
+        state.pending = fiber;
+        state.time = GetTime();
+        state.groupHint = groupHint;
     }
 
     static tracy_force_inline void LeaveFiber()
@@ -643,15 +975,72 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
 #endif
-        TracyQueuePrepare( QueueType::FiberLeave );
-        MemWrite( &item->fiberLeave.time, GetTime() );
-        TracyQueueCommit( fiberLeave );
+        auto& state = GetFiberState();
+#ifdef TRACY_ON_DEMAND
+        DropStaleFiberState( state );
+#endif
+        if( state.pending )
+        {
+            state.pending = nullptr;
+            return;
+        }
+        if( state.active ) SendFiberLeave( state );
+    }
+
+#ifdef TRACY_ON_DEMAND
+    // A fiber entered during an earlier connection is unknown to the current server, and must not
+    // be left or entered on its behalf.
+    static tracy_force_inline void DropStaleFiberState( FiberState& state )
+    {
+        if( state.connection == GetProfiler().ConnectionId() ) return;
+        state.pending = nullptr;
+        state.active = false;
+    }
+#endif
+
+    // Fiber names registered once, to be referred to by their id. The name is copied, and the id
+    // stays valid for the lifetime of the profiler. As each id is a fiber of its own in the trace,
+    // schedulers switching between many short lived tasks should pool the ids, so that there are
+    // only as many of them as tasks run at once.
+    static uint32_t RegisterFiber( const char* name );
+
+    static tracy_force_inline void EnterFiberId( uint32_t id, int32_t groupHint )
+    {
+        auto& profiler = GetProfiler();
+        if( id >= profiler.m_fiberCount.load( std::memory_order_acquire ) ) return;
+        EnterFiber( profiler.m_fiberNames[id / FiberNameChunk][id % FiberNameChunk], groupHint );
     }
 #endif
 
     void SendCallstack( int32_t depth, const char** skipBefore );
     static void CutCallstack( void* callstack, const char** skipBefore );
 
+    // Callstack() for the callstacks of zones and memory events, which with
+    // TRACY_CALLSTACK_INTERNING is shared between identical callstacks. Interned callstacks must
+    // not be modified or freed.
+    static tracy_force_inline void* InternedCallstack( int32_t depth )
+    {
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+        if( depth <= CallstackTable::MaxDepth )
+        {
+            uintptr_t trace[1 + CallstackTable::MaxDepth];
+            trace[0] = CaptureCallstack( trace+1, depth );
+            return GetProfiler().m_callstackTable->Intern( trace );
+        }
+#endif
+        return Callstack( depth );
+    }
+
+    static tracy_force_inline bool IsInternedCallstack( const void* ptr )
+    {
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+        return GetProfiler().m_callstackTable->Contains( ptr );
+#else
+        (void)ptr;
+        return false;
+#endif
+    }
+
     static bool ShouldExit();
 
     tracy_force_inline bool IsConnected() const
@@ -659,6 +1048,11 @@ public:
         return m_isConnected.load( std::memory_order_acquire );
     }
 
+    const std::atomic<bool>* ConnectedFlag() const { return &m_isConnected; }
+
+    ProfilerStats GetStats() const;
+    void CountLostSamples( uint64_t count ) { m_statSamplesLost.fetch_add( count, std::memory_order_relaxed ); }
+
     tracy_force_inline void SetProgramName( const char* name )
     {
         m_programNameLock.lock();
@@ -677,6 +1071,7 @@ public:
         m_deferredLock.lock();
         auto dst = m_deferredQueue.push_next();
         memcpy( dst, &item, sizeof( item ) );
+        if( item.hdr.type == QueueType::LockTerminate ) m_deferredDead.fetch_add( 1, std::memory_order_relaxed );
         m_deferredLock.unlock();
     }
 #endif
@@ -747,24 +1142,45 @@ private:
 #ifndef TRACY_NO_FRAME_IMAGE
     static void LaunchCompressWorker( void* ptr ) { ((Profiler*)ptr)->CompressWorker(); }
     void CompressWorker();
+    static void DownscaleFrameImage( const char* src, char* dst, uint16_t w, uint16_t h );
+    void ReportFrameImageStats();
+    static void LaunchCompressTileWorker( void* ptr ) { ((Profiler*)ptr)->CompressTileWorker(); }
+    void CompressTileWorker();
+    void CompressFrameImage( const char* src, char* dst, int w, int h );
+    void CompressImageTile( uint32_t tile );
+#endif
+
+    static void LaunchLz4Worker( void* ptr ) { ((Profiler*)ptr)->Lz4Worker(); }
+    void Lz4Worker();
+
+#ifdef TRACY_HAS_SYS_SAMPLER
+    static void LaunchSysSamplerWorker( void* ptr ) { ((Profiler*)ptr)->SysSamplerWorker(); }
+    void SysSamplerWorker();
 #endif
 
 #ifdef TRACY_HAS_CALLSTACK
     static void LaunchSymbolWorker( void* ptr ) { ((Profiler*)ptr)->SymbolWorker(); }
     void SymbolWorker();
     void HandleSymbolQueueItem( const SymbolQueueItem& si );
+#  ifdef TRACY_USE_LIBBACKTRACE
+    static void LaunchSymbolHelperWorker( void* ptr ) { ((Profiler*)ptr)->SymbolHelperWorker(); }
+    void SymbolHelperWorker();
+    bool TakeSymbolQueueItem( SymbolQueueItem& si, bool helper );
+#  endif
 #endif
 
     void InstallCrashHandler();
     void RemoveCrashHandler();
 
-    void ClearQueues( tracy::moodycamel::ConsumerToken& token );
+    void ClearQueues( EventConsumerToken& token );
     void ClearSerial();
-    DequeueStatus Dequeue( tracy::moodycamel::ConsumerToken& token );
-    DequeueStatus DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop );
+    DequeueStatus Dequeue( EventConsumerToken& token );
+    DequeueStatus DequeueContextSwitches( EventConsumerToken& token, int64_t& timeStop );
     DequeueStatus DequeueSerial();
+    void ElideShortLivedAllocs( SegmentedVector<QueueItem>::iterator it, SegmentedVector<QueueItem>::iterator end );
+    void PlotElidedAllocs();
     ThreadCtxStatus ThreadCtxCheck( uint32_t threadId );
-    bool CommitData();
+    bool CommitData( bool flush = true );
 
     tracy_force_inline bool AppendData( const void* data, size_t len )
     {
@@ -775,11 +1191,11 @@ private:
 
     tracy_force_inline bool NeedDataSize( size_t len )
     {
-        assert( len <= TargetFrameSize );
+        assert( len <= m_frameSize );
         bool ret = true;
-        if( m_bufferOffset - m_bufferStart + (int)len > TargetFrameSize )
+        if( m_bufferOffset - m_bufferStart + (int)len > (int)m_frameSize )
         {
-            ret = CommitData();
+            ret = CommitData( false );
         }
         return ret;
     }
@@ -805,7 +1221,12 @@ private:
         return false;
     }
 
-    bool SendData( const char* data, size_t len );
+    bool SendData( const char* data, size_t len, bool flush = true );
+    bool SendFrames( const SocketChunk* chunks, int num );
+    bool SendLz4Frames( bool flush );
+    void DiscardLz4Frames();
+    void ResetLz4Stream();
+    void AdaptCompressionLevel();
     void SendLongString( uint64_t ptr, const char* str, size_t len, QueueType type );
     void SendSourceLocation( uint64_t ptr );
     void SendSourceLocationPayload( uint64_t ptr );
@@ -819,11 +1240,21 @@ private:
     void QueueKernelCode( uint64_t symbol, uint32_t size );
     void QueueSourceCodeQuery( uint32_t id );
 
-    bool HandleServerQuery();
+    bool HandleServerQueries();
+    bool HandleServerQuery( const ServerQueryPacket& payload );
     void HandleDisconnect();
     void HandleParameter( uint64_t payload );
     void HandleSymbolCodeQuery( uint64_t symbol, uint32_t size );
     void HandleSourceCodeQuery( char* data, char* image, uint32_t id );
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    void StartShmTransport();
+    void EndShmTransport();
+#endif
+
+#ifdef TRACY_ON_DEMAND
+    void SendDeferredQueue();
+    void CompactDeferredQueue();
+#endif
 
     void AckServerQuery();
     void AckSymbolCodeNotAvailable();
@@ -831,24 +1262,50 @@ private:
     void CalibrateDelay();
     void ReportTopology();
 
+    // With TRACY_MEMORY_SAMPLE_INTERVAL set, the callstack of an allocation is only captured once
+    // in about that many bytes allocated by the thread. The distance between samples is drawn from
+    // an exponential distribution, so that any byte is equally likely to be sampled regardless of
+    // the pattern of allocations. Frees are never sampled.
+    static tracy_force_inline bool SampleMemAlloc( size_t size )
+    {
+        const auto interval = GetProfiler().m_memSampleInterval;
+        return interval == 0 || SampleMemAllocSlow( size, interval );
+    }
+    static bool SampleMemAllocSlow( size_t size, uint64_t interval );
+
     static tracy_force_inline void SendCallstackSerial( void* ptr )
     {
         if( has_callstack() )
         {
-            auto item = GetProfiler().m_serialQueue.prepare_next();
+            auto item = QueueSerialNext();
             MemWrite( &item->hdr.type, QueueType::CallstackSerial );
             MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
-            GetProfiler().m_serialQueue.commit_next();
+            QueueSerialCommitNext();
         }
     }
 
     static tracy_force_inline void SendMemAlloc( QueueType type, const uint32_t thread, const void* ptr, size_t size )
+    {
+        auto item = QueueSerialNext();
+        WriteMemAlloc( item, type, thread, ptr, size );
+        MemWrite( &item->memAlloc.time, GetTime() );
+        QueueSerialCommitNext();
+    }
+
+    static tracy_force_inline void SendMemFree( QueueType type, const uint32_t thread, const void* ptr )
+    {
+        auto item = QueueSerialNext();
+        WriteMemFree( item, type, thread, ptr );
+        MemWrite( &item->memFree.time, GetTime() );
+        QueueSerialCommitNext();
+    }
+
+    // Everything but the time, which is to be taken after the sequence number of the event.
+    static tracy_force_inline void WriteMemAlloc( QueueItem* item, QueueType type, const uint32_t thread, const void* ptr, size_t size )
     {
         assert( type == QueueType::MemAlloc || type == QueueType::MemAllocCallstack || type == QueueType::MemAllocNamed || type == QueueType::MemAllocCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
         MemWrite( &item->hdr.type, type );
-        MemWrite( &item->memAlloc.time, GetTime() );
         MemWrite( &item->memAlloc.thread, thread );
         MemWrite( &item->memAlloc.ptr, (uint64_t)ptr );
         if( compile_time_condition<sizeof( size ) == 4>::value )
@@ -862,40 +1319,36 @@ private:
             memcpy( &item->memAlloc.size, &size, 4 );
             memcpy( ((char*)&item->memAlloc.size)+4, ((char*)&size)+4, 2 );
         }
-        GetProfiler().m_serialQueue.commit_next();
     }
 
-    static tracy_force_inline void SendMemFree( QueueType type, const uint32_t thread, const void* ptr )
+    static tracy_force_inline void WriteMemFree( QueueItem* item, QueueType type, const uint32_t thread, const void* ptr )
     {
         assert( type == QueueType::MemFree || type == QueueType::MemFreeCallstack || type == QueueType::MemFreeNamed || type == QueueType::MemFreeCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
         MemWrite( &item->hdr.type, type );
-        MemWrite( &item->memFree.time, GetTime() );
         MemWrite( &item->memFree.thread, thread );
         MemWrite( &item->memFree.ptr, (uint64_t)ptr );
-        GetProfiler().m_serialQueue.commit_next();
     }
 
     static tracy_force_inline void SendMemDiscard( QueueType type, const uint32_t thread, const char* name )
     {
         assert( type == QueueType::MemDiscard || type == QueueType::MemDiscardCallstack );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = QueueSerialNext();
         MemWrite( &item->hdr.type, type );
         MemWrite( &item->memDiscard.time, GetTime() );
         MemWrite( &item->memDiscard.thread, thread );
         MemWrite( &item->memDiscard.name, (uint64_t)name );
-        GetProfiler().m_serialQueue.commit_next();
+        QueueSerialCommitNext();
     }
 
     static tracy_force_inline void SendMemName( const char* name )
     {
         assert( name );
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = QueueSerialNext();
         MemWrite( &item->hdr.type, QueueType::MemNamePayload );
         MemWrite( &item->memName.name, (uint64_t)name );
-        GetProfiler().m_serialQueue.commit_next();
+        QueueSerialCommitNext();
     }
 
     uint64_t m_resolution;
@@ -906,6 +1359,9 @@ private:
     std::atomic<bool> m_shutdownManual;
     std::atomic<bool> m_shutdownFinished;
     Socket* m_sock;
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    ShmRingWriter* m_shm;
+#endif
     UdpBroadcast* m_broadcast;
     bool m_noExit;
     uint32_t m_userPort;
@@ -919,43 +1375,254 @@ private:
     int64_t m_refTimeGpu;
 
     void* m_stream;     // LZ4_stream_t*
+    uint32_t m_frameSize;
+    uint32_t m_lz4Size;
     char* m_buffer;
     int m_bufferOffset;
     int m_bufferStart;
 
     char* m_lz4Buf;
 
-    FastVector<QueueItem> m_serialQueue, m_serialDequeue;
+    // Frames are compressed by a pool of threads when TRACY_COMPRESSION_THREADS is set. Each job
+    // carries the tail of the previous frame as a dictionary, which the server-side stream decoder
+    // still has in its history, so the wire format is the same as with inline compression.
+    struct Lz4Job
+    {
+        char* src;      // dictionary followed by frame data
+        char* dst;      // lz4sz_t header followed by compressed data
+        int dictSize;
+        int srcSize;
+        int level;
+        bool done;      // guarded by m_lz4Lock
+    };
+
+    uint32_t m_lz4Threads;
+    uint32_t m_lz4JobCount;
+    Thread** m_lz4Pool;
+    Lz4Job* m_lz4Jobs;
+    uint64_t m_lz4Head;     // oldest job not yet sent, profiler thread only
+    uint64_t m_lz4Tail;     // next job to be submitted, written by profiler thread under m_lz4Lock
+    uint64_t m_lz4Next;     // next job to be compressed, guarded by m_lz4Lock
+    int m_lz4DictSize;
+    bool m_lz4Exit;
+    std::mutex m_lz4Lock;
+    std::condition_variable m_lz4Wake, m_lz4Done;
+
+    // TRACY_ADAPTIVE_COMPRESSION picks the compression level at runtime, see AdaptCompressionLevel().
+    void* m_streamHC;   // LZ4_streamHC_t*
+    bool m_lz4Adaptive;
+    int m_lz4Level;
+    int m_lz4StreamLevel;
+    const char* m_lz4Prev;
+    int m_lz4PrevSize;
+    int64_t m_lz4CompressTime;
+    int64_t m_lz4SendTime;
+    int m_lz4Frames;
+    int64_t m_lz4AdaptStart;
+    // TRACY_COMPRESSION_WARMUP compresses the start of each connection at the highest level.
+    size_t m_lz4Warmup;
+    size_t m_lz4WarmupLeft;
+
+#ifdef TRACY_OFFLINE_CAPTURE
+    // TRACY_OFFLINE_CAPTURE writes the stream to disk instead of a socket, see CaptureWorker().
+    void CaptureWorker( EventConsumerToken& token, const WelcomeMessage& welcome );
+    bool StartCaptureFile( const WelcomeMessage& welcome );
+    bool RotateCaptureFile( const WelcomeMessage& welcome );
+    void ScanCaptureFrame( const char* ptr, size_t len );
+    void QueueCaptureQuery( ServerQuery type, uint64_t ptr );
+    bool HandleCaptureQueries();
+
+    CaptureFile* m_capture;
+    CaptureQueries* m_captureSeen;
+    FastVector<ServerQueryPacket> m_captureQueries, m_captureDequeue;
+#endif
+
+#ifdef TRACY_FAN_OUT
+    // TRACY_FAN_OUT copies the stream sent to the server to passive connections, see GatherFanOut().
+    struct FanOutSink
+    {
+        Socket* sock;
+        char* backlog;
+        size_t size;
+        size_t sent;
+        size_t capacity;
+        uint32_t id;
+        ServerQueryPacket* queries;     // not answered yet, see HandleFanOutQueries()
+        uint32_t queryCount;
+        uint32_t queryCapacity;
+    };
+
+    static constexpr int MaxFanOut = 4;
+    // Where the frames go. Other values are the id of a single passive connection.
+    static constexpr uint32_t FanOutAll = 0;
+    static constexpr uint32_t FanOutServer = ~uint32_t( 0 );
+
+    void GatherFanOut( ListenSocket& listen );
+    void SendFanOut( const SocketChunk* chunks, int num, uint32_t target = FanOutAll );
+    void SendFanOutFrame( const char* data, size_t len );
+    bool FlushFanOut( FanOutSink& sink );
+    void PollFanOut();
+    bool HandleFanOutQueries();
+    bool EndFanOutAnswers();
+    void FinishFanOut();
+    void CloseFanOut( int idx );
+
+    FanOutSink m_fanOut[MaxFanOut];
+    int m_fanOutCount;
+    int m_fanOutWait;
+    size_t m_fanOutLimit;
+    char* m_fanOutBuf;
+    uint32_t m_fanOutTarget;
+    uint32_t m_fanOutNextId;
+#endif
+
+#ifndef TRACY_ON_DEMAND
+    // TRACY_FLIGHT_RECORDER keeps the last seconds of data until a server connects.
+    void RecordFlight( EventConsumerToken& token );
+    void FinishFlight();
+    bool ReplayFlight();
+
+    FlightRecorder* m_recorder;
+#endif
+
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+    void CollectSerial();
+#  ifdef TRACY_MEMORY_BATCHING
+    int64_t m_serialLimit;
+#  endif
+#else
+    SegmentedVector<QueueItem> m_serialQueue;
     TracyMutex m_serialLock;
+#endif
+    SegmentedVector<QueueItem> m_serialDequeue;
+
+#ifdef TRACY_FIBERS
+    static constexpr uint32_t FiberNameChunk = 4096;
+    static constexpr uint32_t FiberNameChunks = 1024;
+    static void SendFiberLeave( FiberState& state );
+    TracyMutex m_fiberLock;
+    std::atomic<uint32_t> m_fiberCount;
+    const char** m_fiberNames[FiberNameChunks];
+#endif
 
 #ifndef TRACY_NO_FRAME_IMAGE
-    FastVector<FrameImageQueueItem> m_fiQueue, m_fiDequeue;
+    SegmentedVector<FrameImageQueueItem> m_fiQueue, m_fiDequeue;
     TracyMutex m_fiLock;
+
+    // Images waiting for compression may take up to m_fiBudget bytes (TRACY_FRAME_IMAGE_BUDGET, in
+    // MiB, zero for no limit). Past half of it new images are downscaled, past all of it dropped.
+    size_t m_fiBudget;
+    std::atomic<size_t> m_fiPending;
+    std::atomic<uint64_t> m_fiDropped;
+    std::atomic<uint64_t> m_fiDownscaled;
+#ifdef TRACY_WORKER_WAKEUP
+    WorkerWakeup m_fiWakeup;
+#endif
+    uint64_t m_fiDroppedReported;
+    uint64_t m_fiDownscaledReported;
+
+    // With TRACY_FRAME_IMAGE_THREADS set, images are split into tiles of rows, which are compressed
+    // by the compression thread and a pool of helpers. One image is in flight at a time.
+    uint32_t m_fiThreads;
+    Thread** m_fiPool;
+    const char* m_fiTileSrc;
+    char* m_fiTileDst;
+    int m_fiTileW;
+    int m_fiTileH;
+    uint32_t m_fiTileCount;     // tiles of the current image, guarded by m_fiTileLock
+    uint32_t m_fiTileNext;      // next tile to be compressed, guarded by m_fiTileLock
+    uint32_t m_fiTileDone;      // guarded by m_fiTileLock
+    bool m_fiTileExit;
+    std::mutex m_fiTileLock;
+    std::condition_variable m_fiTileWake, m_fiTileFinished;
 #endif
 
     SPSCQueue<SymbolQueueItem> m_symbolQueue;
+#ifdef TRACY_HAS_CALLSTACK
+    SymbolCache* m_symbolCache;
+#endif
+    SourceCache m_sourceCache;
+#ifdef TRACY_HAS_CALLSTACK_TABLE
+    CallstackTable* m_callstackTable;
+#endif
+    uint64_t m_memSampleInterval;
+#ifdef TRACY_ZONE_COALESCE
+    // Runs of sibling zones of a source location, each shorter than this and this close to the
+    // previous one, are sent by Dequeue() as a single zone with the number of zones as its value.
+    int64_t m_coalesceThreshold;
+#endif
+    // With TRACY_MEMORY_ELIDE_WINDOW set to a number of ns, MemAlloc and MemFree events of the
+    // same pointer closer than that and taken from the serial queue together are not sent. They
+    // are counted per size class instead, and the counts are plotted.
+    int64_t m_memElideWindow;
+    int64_t m_memElideLastPlot;
+    uint64_t m_memElided[MemElideClasses];
+    uint64_t m_memElidedPlotted[MemElideClasses];
+#ifdef TRACY_USE_LIBBACKTRACE
+    // With TRACY_SYMBOL_THREADS set, callstack frames and symbol queries are also resolved by
+    // helper threads. All consumers of m_symbolQueue take items under m_symbolLock.
+    uint32_t m_symbolThreads;
+    Thread** m_symbolHelpers;
+    TracyMutex m_symbolLock;
+    std::atomic<uint32_t> m_symbolHelpersBusy;
+    std::atomic<bool> m_symbolExit;
+#endif
 
     std::atomic<uint64_t> m_frameCount;
     std::atomic<bool> m_isConnected;
+
+    // Counters behind GetStats(). TickStats() samples the depths and, if TRACY_CLIENT_STATS is
+    // set, plots the counters. The m_stat* members which are not atomic are profiler thread only.
+    void TickStats();
+    void ResetStatsTick();
+    void IdleSleep( int ms );
+#ifdef TRACY_WORKER_WAKEUP
+    // Waits for new events. After being woken up the thread only yields for a while, as more events
+    // tend to follow, and the longer nothing comes, the longer it parks, up to IdleWaitMax ms. Events
+    // trickling in would wake it up one by one, so while they keep coming it sleeps instead, as if
+    // there was no wakeup. m_idleBusy tells that there were events to send since the last wait.
+    // Returns the time it waited for if nothing woke it up, zero otherwise.
+    int IdleWait();
+    int m_idleSpins;
+    int m_idleTimeout;
+    bool m_idleBusy;
+    bool m_idlePolling;
+#endif
+
+    std::atomic<uint64_t> m_statQueueDepth;
+    std::atomic<uint64_t> m_statSerialDepth;
+    std::atomic<uint64_t> m_statSymbolQueueDepth;
+    std::atomic<uint64_t> m_statWorkerBusy;
+    std::atomic<uint64_t> m_statWorkerIdle;
+    std::atomic<uint64_t> m_statRawBytes;
+    std::atomic<uint64_t> m_statCompressedBytes;
+    std::atomic<uint64_t> m_statSendTime;
+    std::atomic<uint64_t> m_statSymbols;
+    std::atomic<uint64_t> m_statSamplesLost;
+    int64_t m_statLastTick;
+    int64_t m_statIdle;             // since m_statLastTick
+    uint64_t m_statSerialPeak;      // since m_statLastTick
+    bool m_statPlots;
+    bool m_statPlotsConfigured;
+    ProfilerStats m_statPlotted;    // at the previous tick, for the rates
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint64_t> m_connectionId;
     std::atomic<bool> m_symbolsBusy;
 
     TracyMutex m_deferredLock;
-    FastVector<QueueItem> m_deferredQueue;
+    SegmentedVector<QueueItem> m_deferredQueue;
+    // Locks terminated since the last compaction of the deferred queue, which drops their items
+    // once there are at least m_deferredCompactAt of them.
+    std::atomic<size_t> m_deferredDead;
+    size_t m_deferredCompactAt;
 #endif
 
-#ifdef TRACY_HAS_SYSTIME
-    void ProcessSysTime();
-
-    SysTime m_sysTime;
-    uint64_t m_sysTimeLast = 0;
-#else
-    void ProcessSysTime() {}
+#ifdef TRACY_MEMORY_AGGREGATION
+    MemAggregate m_memAggregate;
 #endif
 
-#ifdef TRACY_HAS_SYSPOWER
-    SysPower m_sysPower;
+#ifdef TRACY_HAS_ZONE_STATS
+    ZoneStats m_zoneStats;
 #endif
 
     ParameterCallback m_paramCallback;
@@ -978,6 +1645,10 @@ private:
 #else
     int m_pipe[2];
     int m_pipeBufSize;
+#  ifdef __linux__
+    int m_pid;
+    bool m_vmReadv;
+#  endif
 #endif
 
 #ifdef __linux__
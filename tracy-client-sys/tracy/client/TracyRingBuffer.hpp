@@ -68,6 +68,7 @@ public:
     bool IsValid() const { return m_metadata != nullptr; }
     int GetId() const { return m_id; }
     int GetCpu() const { return m_cpu; }
+    int GetFd() const { return m_fd; }
 
     void Enable()
     {
@@ -5,6 +5,7 @@
 #include <rocprofiler-sdk/registration.h>
 #include <rocprofiler-sdk/rocprofiler.h>
 
+#include <atomic>
 #include <iostream>
 #include <mutex>
 #include <set>
@@ -34,12 +35,26 @@ namespace
 
 using kernel_symbol_data_t = rocprofiler_callback_tracing_code_object_kernel_symbol_register_data_t;
 
+// Dispatches are spread over shards by their id, so that concurrent streams and devices rarely wait on the same lock.
+constexpr size_t DispatchShards = 64;
+
 struct DispatchData
 {
-    int64_t launch_start;
-    int64_t launch_end;
-    uint32_t thread_id;
-    uint16_t query_id;
+    int64_t launch_start = 0;
+    int64_t launch_end = 0;
+    uint32_t thread_id = 0;
+    uint16_t query_id = 0;
+    bool counting = false;      // counter values were asked for
+    bool emitted = false;       // the zone has been sent
+    bool counted = false;       // the counter values have been sent
+    // Counter values which arrived before the completion record was consumed.
+    std::vector<std::pair<uint64_t, double>> counters;
+};
+
+struct alignas( 64 ) DispatchShard
+{
+    std::mutex mut;
+    tracy::unordered_map<rocprofiler_dispatch_id_t, DispatchData> dispatches;
 };
 
 struct ToolData
@@ -50,13 +65,15 @@ struct ToolData
     rocprofiler_client_id_t client_id;
     uint8_t context_id;
     bool init;
-    uint64_t query_id;
+    std::atomic<uint16_t> query_id;
     int64_t previous_cpu_time;
-    tracy::unordered_map<rocprofiler_kernel_id_t, kernel_symbol_data_t> client_kernels;
-    tracy::unordered_map<rocprofiler_dispatch_id_t, DispatchData> dispatch_data;
+    // Kernel source locations live until the end of the program, as the profiler may ask for them at any time.
+    tracy::unordered_map<rocprofiler_kernel_id_t, const tracy::SourceLocationData*> kernel_src_locs;
+    std::shared_mutex kernel_mut;
+    DispatchShard dispatch_shards[DispatchShards];
     tracy::unordered_set<std::string> counter_names = { "SQ_WAVES", "GL2C_MISS", "GL2C_HIT" };
     std::unique_ptr<tracy::Thread> cal_thread;
-    std::mutex mut{};
+    rocprofiler_buffer_id_t buffer{};
 };
 
 using namespace tracy;
@@ -69,6 +86,11 @@ rocprofiler_context_id_t& get_client_ctx()
 
 const char* CTX_NAME = "rocprofv3";
 
+DispatchShard& dispatch_shard( ToolData* data, rocprofiler_dispatch_id_t dispatch_id )
+{
+    return data->dispatch_shards[dispatch_id % DispatchShards];
+}
+
 uint8_t gpu_context_allocate( ToolData* data )
 {
 
@@ -127,109 +149,176 @@ uint8_t gpu_context_allocate( ToolData* data )
     return context_id;
 }
 
-uint64_t kernel_src_loc( ToolData* data, uint64_t kernel_id )
+const SourceLocationData* kernel_src_loc( ToolData* data, uint64_t kernel_id )
 {
-    uint64_t src_loc = 0;
-    auto _lk = std::unique_lock{ data->mut };
-    rocprofiler_kernel_id_t kid = kernel_id;
-    if( data->client_kernels.count( kid ) )
-    {
-        auto& sym_data = data->client_kernels[kid];
-        const char* name = sym_data.kernel_name;
-        size_t name_len = strlen( name );
-        uint32_t line = 0;
-        src_loc = tracy::Profiler::AllocSourceLocation( line, NULL, 0, name, name_len, NULL, 0 );
-    }
-    return src_loc;
+    static const SourceLocationData unknown = { nullptr, nullptr, "", 0, 0 };
+    auto _lk = std::shared_lock{ data->kernel_mut };
+    auto it = data->kernel_src_locs.find( kernel_id );
+    return it != data->kernel_src_locs.end() ? it->second : &unknown;
 }
 
-void record_interval( ToolData* data, rocprofiler_timestamp_t start_timestamp, rocprofiler_timestamp_t end_timestamp,
-                      uint64_t src_loc, rocprofiler_dispatch_id_t dispatch_id )
+void add_kernel_src_loc( ToolData* data, const kernel_symbol_data_t* sym_data )
 {
+    size_t name_len = strlen( sym_data->kernel_name );
+    char* name = (char*)tracy::tracy_malloc( name_len + 1 );
+    memcpy( name, sym_data->kernel_name, name_len + 1 );
+    auto* src_loc = (SourceLocationData*)tracy::tracy_malloc( sizeof( SourceLocationData ) );
+    new( src_loc ) SourceLocationData{ nullptr, name, "", 0, 0 };
+
+    auto _lk = std::unique_lock{ data->kernel_mut };
+    data->kernel_src_locs[sym_data->kernel_id] = src_loc;
+}
 
-    uint16_t query_id = 0;
-    uint8_t context_id = data->context_id;
-
+void emit_counters( ToolData* data, const DispatchData& dispatch, const std::pair<uint64_t, double>* counters, size_t count )
+{
+    for( size_t i = 0; i < count; ++i )
     {
-        auto _lk = std::unique_lock{ data->mut };
-        query_id = data->query_id;
-        data->query_id++;
-        if( dispatch_id != UINT64_MAX )
-        {
-            DispatchData& dispatch_data = data->dispatch_data[dispatch_id];
-            dispatch_data.query_id = query_id;
-            dispatch_data.thread_id = tracy::GetThreadHandle();
-        }
+        auto* item = tracy::Profiler::QueueSerial();
+        tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneAnnotation );
+        tracy::MemWrite( &item->zoneAnnotation.noteId, counters[i].first );
+        tracy::MemWrite( &item->zoneAnnotation.queryId, dispatch.query_id );
+        tracy::MemWrite( &item->zoneAnnotation.thread, dispatch.thread_id );
+        tracy::MemWrite( &item->zoneAnnotation.value, counters[i].second );
+        tracy::MemWrite( &item->zoneAnnotation.context, data->context_id );
+        tracy::Profiler::QueueSerialFinish();
     }
+}
 
-    uint64_t cpu_start_time = 0, cpu_end_time = 0;
-    if( dispatch_id == UINT64_MAX )
-    {
-        cpu_start_time = tracy::Profiler::GetTime();
-        cpu_end_time = tracy::Profiler::GetTime();
-    }
-    else
-    {
-        auto _lk = std::unique_lock{ data->mut };
-        DispatchData& dispatch_data = data->dispatch_data[dispatch_id];
-        cpu_start_time = dispatch_data.launch_start;
-        cpu_end_time = dispatch_data.launch_end;
-    }
+void record_interval( ToolData* data, rocprofiler_timestamp_t start_timestamp, rocprofiler_timestamp_t end_timestamp,
+                      int64_t cpu_start_time, int64_t cpu_end_time, const SourceLocationData* src_loc,
+                      uint16_t query_id )
+{
+    const uint8_t context_id = data->context_id;
+    const uint32_t thread_id = tracy::GetThreadHandle();
 
-    if( src_loc != 0 )
+    tracy::Profiler::QueueSerialLock();
     {
-        {
-            auto* item = tracy::Profiler::QueueSerial();
-            tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneBeginAllocSrcLocSerial );
-            tracy::MemWrite( &item->gpuZoneBegin.cpuTime, cpu_start_time );
-            tracy::MemWrite( &item->gpuZoneBegin.srcloc, (uint64_t)src_loc );
-            tracy::MemWrite( &item->gpuZoneBegin.thread, tracy::GetThreadHandle() );
-            tracy::MemWrite( &item->gpuZoneBegin.queryId, query_id );
-            tracy::MemWrite( &item->gpuZoneBegin.context, context_id );
-            tracy::Profiler::QueueSerialFinish();
-        }
-    }
-    else
-    {
-        static const ___tracy_source_location_data src_loc = { NULL, NULL, NULL, 0, 0 };
-        {
-            auto* item = tracy::Profiler::QueueSerial();
-            tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneBeginSerial );
-            tracy::MemWrite( &item->gpuZoneBegin.cpuTime, cpu_start_time );
-            tracy::MemWrite( &item->gpuZoneBegin.srcloc, (uint64_t)&src_loc );
-            tracy::MemWrite( &item->gpuZoneBegin.thread, tracy::GetThreadHandle() );
-            tracy::MemWrite( &item->gpuZoneBegin.queryId, query_id );
-            tracy::MemWrite( &item->gpuZoneBegin.context, context_id );
-            tracy::Profiler::QueueSerialFinish();
-        }
+        auto* item = tracy::Profiler::QueueSerialNext();
+        tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneBeginSerial );
+        tracy::MemWrite( &item->gpuZoneBegin.cpuTime, cpu_start_time );
+        tracy::MemWrite( &item->gpuZoneBegin.srcloc, (uint64_t)src_loc );
+        tracy::MemWrite( &item->gpuZoneBegin.thread, thread_id );
+        tracy::MemWrite( &item->gpuZoneBegin.queryId, query_id );
+        tracy::MemWrite( &item->gpuZoneBegin.context, context_id );
+        tracy::Profiler::QueueSerialCommitNext();
     }
 
     {
-        auto* item = tracy::Profiler::QueueSerial();
+        auto* item = tracy::Profiler::QueueSerialNext();
         tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuTime );
         tracy::MemWrite( &item->gpuTime.gpuTime, start_timestamp );
         tracy::MemWrite( &item->gpuTime.queryId, query_id );
         tracy::MemWrite( &item->gpuTime.context, context_id );
-        tracy::Profiler::QueueSerialFinish();
+        tracy::Profiler::QueueSerialCommitNext();
     }
 
     {
-        auto* item = tracy::Profiler::QueueSerial();
+        auto* item = tracy::Profiler::QueueSerialNext();
         tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneEndSerial );
         tracy::MemWrite( &item->gpuZoneEnd.cpuTime, cpu_end_time );
-        tracy::MemWrite( &item->gpuZoneEnd.thread, tracy::GetThreadHandle() );
+        tracy::MemWrite( &item->gpuZoneEnd.thread, thread_id );
         tracy::MemWrite( &item->gpuZoneEnd.queryId, query_id );
         tracy::MemWrite( &item->gpuZoneEnd.context, context_id );
-        tracy::Profiler::QueueSerialFinish();
+        tracy::Profiler::QueueSerialCommitNext();
     }
 
     {
-        auto* item = tracy::Profiler::QueueSerial();
+        auto* item = tracy::Profiler::QueueSerialNext();
         tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuTime );
         tracy::MemWrite( &item->gpuTime.gpuTime, end_timestamp );
         tracy::MemWrite( &item->gpuTime.queryId, query_id );
         tracy::MemWrite( &item->gpuTime.context, context_id );
-        tracy::Profiler::QueueSerialFinish();
+        tracy::Profiler::QueueSerialCommitNext();
+    }
+    tracy::Profiler::QueueSerialUnlock();
+}
+
+void record_dispatch( ToolData* data, const rocprofiler_buffer_tracing_kernel_dispatch_record_t* record )
+{
+    const auto dispatch_id = record->dispatch_info.dispatch_id;
+    const auto* src_loc = kernel_src_loc( data, record->dispatch_info.kernel_id );
+
+    auto& shard = dispatch_shard( data, dispatch_id );
+    auto _lk = std::unique_lock{ shard.mut };
+    auto it = shard.dispatches.find( dispatch_id );
+    if( it == shard.dispatches.end() )
+    {
+        // Dispatched before the tool was ready.
+        _lk.unlock();
+        const auto now = tracy::Profiler::GetTime();
+        record_interval( data, record->start_timestamp, record->end_timestamp, now, now, src_loc,
+                         data->query_id.fetch_add( 1, std::memory_order_relaxed ) );
+        return;
+    }
+
+    auto& dispatch = it->second;
+    dispatch.query_id = data->query_id.fetch_add( 1, std::memory_order_relaxed );
+    dispatch.thread_id = tracy::GetThreadHandle();
+    record_interval( data, record->start_timestamp, record->end_timestamp, dispatch.launch_start, dispatch.launch_end,
+                     src_loc, dispatch.query_id );
+    dispatch.emitted = true;
+    if( !dispatch.counters.empty() )
+    {
+        emit_counters( data, dispatch, dispatch.counters.data(), dispatch.counters.size() );
+        dispatch.counted = true;
+    }
+    if( !dispatch.counting || dispatch.counted ) shard.dispatches.erase( it );
+}
+
+void record_memory_copy( ToolData* data, const rocprofiler_buffer_tracing_memory_copy_record_t* record )
+{
+    static const SourceLocationData DeviceToDevice = { nullptr, "DeviceToDeviceCopy", "", 0, 0 };
+    static const SourceLocationData DeviceToHost = { nullptr, "DeviceToHostCopy", "", 0, 0 };
+    static const SourceLocationData HostToDevice = { nullptr, "HostToDeviceCopy", "", 0, 0 };
+    static const SourceLocationData HostToHost = { nullptr, "HostToHostCopy", "", 0, 0 };
+
+    const SourceLocationData* src_loc = nullptr;
+    switch( record->operation )
+    {
+    case ROCPROFILER_MEMORY_COPY_DEVICE_TO_DEVICE:
+        src_loc = &DeviceToDevice;
+        break;
+    case ROCPROFILER_MEMORY_COPY_DEVICE_TO_HOST:
+        src_loc = &DeviceToHost;
+        break;
+    case ROCPROFILER_MEMORY_COPY_HOST_TO_DEVICE:
+        src_loc = &HostToDevice;
+        break;
+    case ROCPROFILER_MEMORY_COPY_HOST_TO_HOST:
+        src_loc = &HostToHost;
+        break;
+    default:
+        return;
+    }
+    const auto now = tracy::Profiler::GetTime();
+    record_interval( data, record->start_timestamp, record->end_timestamp, now, now, src_loc,
+                     data->query_id.fetch_add( 1, std::memory_order_relaxed ) );
+}
+
+/**
+ * Callback from rocprofiler on its own thread with the records of the completed kernel dispatches and memory copies,
+ * so that turning them into zones doesn't hold up the threads of the application.
+ */
+void buffer_callback( rocprofiler_context_id_t /*context*/, rocprofiler_buffer_id_t /*buffer_id*/,
+                      rocprofiler_record_header_t** headers, size_t num_headers, void* callback_data,
+                      uint64_t /*drop_count*/ )
+{
+    assert( callback_data != nullptr );
+    ToolData* data = static_cast<ToolData*>( callback_data );
+    if( !data->init ) return;
+
+    for( size_t i = 0; i < num_headers; ++i )
+    {
+        auto* header = headers[i];
+        if( header->category != ROCPROFILER_BUFFER_CATEGORY_TRACING ) continue;
+        if( header->kind == ROCPROFILER_BUFFER_TRACING_KERNEL_DISPATCH )
+        {
+            record_dispatch( data, static_cast<rocprofiler_buffer_tracing_kernel_dispatch_record_t*>( header->payload ) );
+        }
+        else if( header->kind == ROCPROFILER_BUFFER_TRACING_MEMORY_COPY )
+        {
+            record_memory_copy( data, static_cast<rocprofiler_buffer_tracing_memory_copy_record_t*>( header->payload ) );
+        }
     }
 }
 
@@ -249,29 +338,24 @@ void record_callback( rocprofiler_dispatch_counting_service_data_t dispatch_data
                           "query record counter id" );
         sums[_counter_id.handle] += record_data[i].counter_value;
     }
-
-    uint16_t query_id = 0;
-    uint32_t thread_id = 0;
+    std::vector<std::pair<uint64_t, double>> counters( sums.begin(), sums.end() );
+
+    // The counter values may arrive before or after the completion record of the dispatch. Whichever comes second
+    // sends the counters, as annotations of the zone of the dispatch.
+    const auto dispatch_id = dispatch_data.dispatch_info.dispatch_id;
+    auto& shard = dispatch_shard( data, dispatch_id );
+    auto _lk = std::unique_lock{ shard.mut };
+    auto it = shard.dispatches.find( dispatch_id );
+    if( it == shard.dispatches.end() ) return;
+    auto& dispatch = it->second;
+    if( dispatch.emitted )
     {
-        auto _lk = std::unique_lock{ data->mut };
-        // An assumption is made here that the counter values are supplied after the dispatch
-        // complete callback.
-        assert( data->dispatch_data.count( dispatch_data.dispatch_info.dispatch_id ) );
-        DispatchData& ddata = data->dispatch_data[dispatch_data.dispatch_info.dispatch_id];
-        query_id = ddata.query_id;
-        thread_id = ddata.thread_id;
+        emit_counters( data, dispatch, counters.data(), counters.size() );
+        shard.dispatches.erase( it );
     }
-
-    for( auto& p : sums )
+    else
     {
-        auto* item = tracy::Profiler::QueueSerial();
-        tracy::MemWrite( &item->hdr.type, tracy::QueueType::GpuZoneAnnotation );
-        tracy::MemWrite( &item->zoneAnnotation.noteId, p.first );
-        tracy::MemWrite( &item->zoneAnnotation.queryId, query_id );
-        tracy::MemWrite( &item->zoneAnnotation.thread, thread_id );
-        tracy::MemWrite( &item->zoneAnnotation.value, p.second );
-        tracy::MemWrite( &item->zoneAnnotation.context, data->context_id );
-        tracy::Profiler::QueueSerialFinish();
+        dispatch.counters = std::move( counters );
     }
 }
 
@@ -288,6 +372,12 @@ void dispatch_callback( rocprofiler_dispatch_counting_service_data_t dispatch_da
     ToolData* data = static_cast<ToolData*>( callback_data );
     if( !data->init ) return;
 
+    {
+        auto& shard = dispatch_shard( data, dispatch_data.dispatch_info.dispatch_id );
+        auto _lk = std::unique_lock{ shard.mut };
+        shard.dispatches[dispatch_data.dispatch_info.dispatch_id].counting = true;
+    }
+
     /**
      * This simple example uses the same profile counter set for all agents.
      * We store this in a cache to prevent constructing many identical profile counter
@@ -387,63 +477,28 @@ void tool_callback_tracing_callback( rocprofiler_callback_tracing_record_t recor
     {
         auto* sym_data = static_cast<kernel_symbol_data_t*>( record.payload );
 
+        // The source locations of unloaded kernels are kept, as zones may still refer to them.
         if( record.phase == ROCPROFILER_CALLBACK_PHASE_LOAD )
         {
-            auto _lk = std::unique_lock{ data->mut };
-            data->client_kernels.emplace( sym_data->kernel_id, *sym_data );
-        }
-        else if( record.phase == ROCPROFILER_CALLBACK_PHASE_UNLOAD )
-        {
-            auto _lk = std::unique_lock{ data->mut };
-            data->client_kernels.erase( sym_data->kernel_id );
+            add_kernel_src_loc( data, sym_data );
         }
     }
-    else if( record.kind == ROCPROFILER_CALLBACK_TRACING_KERNEL_DISPATCH )
+    else if( record.kind == ROCPROFILER_CALLBACK_TRACING_KERNEL_DISPATCH &&
+             record.operation == ROCPROFILER_KERNEL_DISPATCH_ENQUEUE )
     {
         auto* rdata = static_cast<rocprofiler_callback_tracing_kernel_dispatch_data_t*>( record.payload );
-        if( record.operation == ROCPROFILER_KERNEL_DISPATCH_ENQUEUE )
-        {
-            if( record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER )
-            {
-                auto _lk = std::unique_lock{ data->mut };
-                data->dispatch_data[rdata->dispatch_info.dispatch_id].launch_start = tracy::Profiler::GetTime();
-            }
-            else if( record.phase == ROCPROFILER_CALLBACK_PHASE_EXIT )
-            {
-                auto _lk = std::unique_lock{ data->mut };
-                data->dispatch_data[rdata->dispatch_info.dispatch_id].launch_end = tracy::Profiler::GetTime();
-            }
-        }
-        else if( record.operation == ROCPROFILER_KERNEL_DISPATCH_COMPLETE )
+        const auto now = tracy::Profiler::GetTime();
+        auto& shard = dispatch_shard( data, rdata->dispatch_info.dispatch_id );
+        auto _lk = std::unique_lock{ shard.mut };
+        auto& dispatch = shard.dispatches[rdata->dispatch_info.dispatch_id];
+        if( record.phase == ROCPROFILER_CALLBACK_PHASE_ENTER )
         {
-            uint64_t src_loc = kernel_src_loc( data, rdata->dispatch_info.kernel_id );
-            record_interval( data, rdata->start_timestamp, rdata->end_timestamp, src_loc,
-                             rdata->dispatch_info.dispatch_id );
+            dispatch.launch_start = now;
         }
-    }
-    else if( record.kind == ROCPROFILER_CALLBACK_TRACING_MEMORY_COPY &&
-             record.operation != ROCPROFILER_MEMORY_COPY_NONE && record.phase == ROCPROFILER_CALLBACK_PHASE_EXIT )
-    {
-        auto* rdata = static_cast<rocprofiler_callback_tracing_memory_copy_data_t*>( record.payload );
-        const char* name = nullptr;
-        switch( record.operation )
+        else if( record.phase == ROCPROFILER_CALLBACK_PHASE_EXIT )
         {
-        case ROCPROFILER_MEMORY_COPY_DEVICE_TO_DEVICE:
-            name = "DeviceToDeviceCopy";
-            break;
-        case ROCPROFILER_MEMORY_COPY_DEVICE_TO_HOST:
-            name = "DeviceToHostCopy";
-            break;
-        case ROCPROFILER_MEMORY_COPY_HOST_TO_DEVICE:
-            name = "HostToDeviceCopy";
-            break;
-        case ROCPROFILER_MEMORY_COPY_HOST_TO_HOST:
-            name = "HostToHostCopy";
-            break;
+            dispatch.launch_end = now;
         }
-        size_t name_len = strlen( name );
-        uint64_t src_loc = tracy::Profiler::AllocSourceLocation( 0, NULL, 0, name, name_len, NULL, 0 );
-        record_interval( data, rdata->start_timestamp, rdata->end_timestamp, src_loc, UINT64_MAX );
     }
 }
 
@@ -507,17 +562,32 @@ int tool_init( rocprofiler_client_finalize_t fini_func, void* user_data )
                                                                       tool_callback_tracing_callback, user_data ),
                       "callback tracing service failed to configure" );
 
-    rocprofiler_tracing_operation_t ops2[] = { ROCPROFILER_KERNEL_DISPATCH_COMPLETE,
-                                               ROCPROFILER_KERNEL_DISPATCH_ENQUEUE };
+    // Only the CPU side of the launch is traced with callbacks, the completions come in through the buffer.
+    rocprofiler_tracing_operation_t ops2[] = { ROCPROFILER_KERNEL_DISPATCH_ENQUEUE };
     ROCPROFILER_CALL(
         rocprofiler_configure_callback_tracing_service( get_client_ctx(), ROCPROFILER_CALLBACK_TRACING_KERNEL_DISPATCH,
-                                                        ops2, 2, tool_callback_tracing_callback, user_data ),
+                                                        ops2, 1, tool_callback_tracing_callback, user_data ),
         "callback tracing service failed to configure" );
 
-    ROCPROFILER_CALL( rocprofiler_configure_callback_tracing_service( get_client_ctx(),
-                                                                      ROCPROFILER_CALLBACK_TRACING_MEMORY_COPY, nullptr,
-                                                                      0, tool_callback_tracing_callback, user_data ),
-                      "callback tracing service failed to configure" );
+    constexpr size_t buffer_size = 4 * 1024 * 1024;
+    constexpr size_t buffer_watermark = buffer_size / 4;
+    ROCPROFILER_CALL( rocprofiler_create_buffer( get_client_ctx(), buffer_size, buffer_watermark,
+                                                 ROCPROFILER_BUFFER_POLICY_LOSSLESS, buffer_callback, user_data,
+                                                 &data->buffer ),
+                      "buffer creation failed" );
+
+    ROCPROFILER_CALL( rocprofiler_configure_buffer_tracing_service(
+                          get_client_ctx(), ROCPROFILER_BUFFER_TRACING_KERNEL_DISPATCH, nullptr, 0, data->buffer ),
+                      "buffer tracing service failed to configure" );
+
+    ROCPROFILER_CALL( rocprofiler_configure_buffer_tracing_service(
+                          get_client_ctx(), ROCPROFILER_BUFFER_TRACING_MEMORY_COPY, nullptr, 0, data->buffer ),
+                      "buffer tracing service failed to configure" );
+
+    rocprofiler_callback_thread_t buffer_thread;
+    ROCPROFILER_CALL( rocprofiler_create_callback_thread( &buffer_thread ), "callback thread creation failed" );
+    ROCPROFILER_CALL( rocprofiler_assign_callback_thread( data->buffer, buffer_thread ),
+                      "callback thread assignment failed" );
 
     ROCPROFILER_CALL( rocprofiler_start_context( get_client_ctx() ), "start context" );
     return 0;
@@ -525,9 +595,10 @@ int tool_init( rocprofiler_client_finalize_t fini_func, void* user_data )
 
 void tool_fini( void* tool_data_v )
 {
+    ToolData* data = static_cast<ToolData*>( tool_data_v );
+    rocprofiler_flush_buffer( data->buffer );
     rocprofiler_stop_context( get_client_ctx() );
 
-    ToolData* data = static_cast<ToolData*>( tool_data_v );
     data->init = false;
     data->cal_thread.reset();
 }
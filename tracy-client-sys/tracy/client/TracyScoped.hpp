@@ -11,6 +11,7 @@
 #include "../common/TracyAlloc.hpp"
 #include "TracyProfiler.hpp"
 #include "TracyCallstack.hpp"
+#include "TracyZoneCounters.hpp"
 
 #if (defined(__GNUC__) || defined(__clang__))
 #  define TRACY_ATTRIBUTE_FORMAT_PRINTF(fmt_idx, arg_idx) \
@@ -37,6 +38,33 @@ public:
 #endif
     {
         if( !m_active ) return;
+#ifdef TRACY_ZONE_CATEGORIES
+        if( !ZoneCategoryEnabled( srcloc->category ) )
+        {
+            m_active = false;
+            return;
+        }
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        if( depth <= 0 || !has_callstack() )
+        {
+#  ifdef TRACY_ON_DEMAND
+            m_connectionId = GetProfiler().ConnectionId();
+#  endif
+            m_stats = true;
+            ZoneStatsBegin( srcloc, 0 );
+            return;
+        }
+        ZoneStatsEmitOpen();
+#endif
+#ifdef TRACY_ZONE_SAMPLING
+        m_minDuration = ZoneSamplingCheck( srcloc );
+        if( m_minDuration < 0 )
+        {
+            m_active = false;
+            return;
+        }
+#endif
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
 #endif
@@ -46,10 +74,23 @@ public:
             GetProfiler().SendCallstack( depth );
             zoneQueue = QueueType::ZoneBeginCallstack;
         }
+#ifdef TRACY_COMPACT_ZONES
+        else
+        {
+            Profiler::BeginCompactZone( (uint64_t)srcloc );
+#  ifdef TRACY_ZONE_COUNTERS
+            ZoneCountersRead( m_counters );
+#  endif
+            return;
+        }
+#endif
         TracyQueuePrepare( zoneQueue );
         MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
         MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
         TracyQueueCommit( zoneBeginThread );
+#ifdef TRACY_ZONE_COUNTERS
+        ZoneCountersRead( m_counters );
+#endif
     }
 
     tracy_force_inline ScopedZone( uint32_t line, const char* source, size_t sourceSz, const char* function, size_t functionSz, const char* name, size_t nameSz, uint32_t color, int32_t depth = -1, bool is_active = true )
@@ -62,6 +103,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        ZoneStatsEmitOpen();
 #endif
         auto zoneQueue = QueueType::ZoneBeginAllocSrcLoc;
         if( depth > 0 && has_callstack() )
@@ -75,6 +119,9 @@ public:
         MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
         MemWrite( &item->zoneBegin.srcloc, srcloc );
         TracyQueueCommit( zoneBeginThread );
+#ifdef TRACY_ZONE_COUNTERS
+        ZoneCountersRead( m_counters );
+#endif
     }
 
     tracy_force_inline ScopedZone( uint32_t line, const char* source, size_t sourceSz, const char* function, size_t functionSz, const char* name, size_t nameSz, int32_t depth, bool is_active = true ) : ScopedZone( line, source, sourceSz, function, functionSz, name, nameSz, 0, depth, is_active ) {}
@@ -82,6 +129,27 @@ public:
     tracy_force_inline ~ScopedZone()
     {
         if( !m_active ) return;
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats )
+        {
+            ZoneStatsEnd();
+            return;
+        }
+#endif
+#ifdef TRACY_ZONE_COUNTERS
+        // Sending the counters flushes a pending compact zone, so zones with counters are never
+        // compacted or dropped by zone sampling.
+#  ifdef TRACY_ON_DEMAND
+        if( GetProfiler().ConnectionId() == m_connectionId ) ZoneCountersEmit( m_counters );
+#  else
+        ZoneCountersEmit( m_counters );
+#  endif
+#endif
+#if defined TRACY_COMPACT_ZONES && defined TRACY_ZONE_SAMPLING
+        if( Profiler::EndCompactZone( m_minDuration ) ) return;
+#elif defined TRACY_COMPACT_ZONES
+        if( Profiler::EndCompactZone() ) return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
@@ -97,7 +165,10 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
-        auto ptr = (char*)tracy_malloc( size );
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
+#endif
+        auto ptr = StringArenaAlloc( size );
         memcpy( ptr, txt, size );
         TracyQueuePrepare( QueueType::ZoneText );
         MemWrite( &item->zoneTextFat.text, (uint64_t)ptr );
@@ -110,6 +181,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
 #endif
         va_list args;
         va_start( args, fmt );
@@ -118,7 +192,7 @@ public:
         if( size < 0 ) return;
         assert( size < (std::numeric_limits<uint16_t>::max)() );
 
-        char* ptr = (char*)tracy_malloc( size_t( size ) + 1 );
+        char* ptr = StringArenaAlloc( size_t( size ) + 1 );
         va_start( args, fmt );
         vsnprintf( ptr, size_t( size ) + 1, fmt, args );
         va_end( args );
@@ -136,7 +210,10 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
-        auto ptr = (char*)tracy_malloc( size );
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
+#endif
+        auto ptr = StringArenaAlloc( size );
         memcpy( ptr, txt, size );
         TracyQueuePrepare( QueueType::ZoneName );
         MemWrite( &item->zoneTextFat.text, (uint64_t)ptr );
@@ -149,6 +226,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
 #endif
         va_list args;
         va_start( args, fmt );
@@ -157,7 +237,7 @@ public:
         if( size < 0 ) return;
         assert( size < (std::numeric_limits<uint16_t>::max)() );
 
-        char* ptr = (char*)tracy_malloc( size_t( size ) + 1 );
+        char* ptr = StringArenaAlloc( size_t( size ) + 1 );
         va_start( args, fmt );
         vsnprintf( ptr, size_t( size ) + 1, fmt, args );
         va_end( args );
@@ -173,6 +253,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
 #endif
         TracyQueuePrepare( QueueType::ZoneColor );
         MemWrite( &item->zoneColor.b, uint8_t( ( color       ) & 0xFF ) );
@@ -186,6 +269,9 @@ public:
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
+#endif
+#ifdef TRACY_HAS_ZONE_STATS
+        if( m_stats ) ZoneStatsEmitOpen();
 #endif
         TracyQueuePrepare( QueueType::ZoneValue );
         MemWrite( &item->zoneValue.value, value );
@@ -195,11 +281,161 @@ public:
     tracy_force_inline bool IsActive() const { return m_active; }
 
 private:
+#if defined TRACY_ZONE_SAMPLING || defined TRACY_ZONE_CATEGORIES
+    bool m_active;
+#else
     const bool m_active;
+#endif
+#ifdef TRACY_ZONE_SAMPLING
+    int64_t m_minDuration = 0;
+#endif
 
 #ifdef TRACY_ON_DEMAND
     uint64_t m_connectionId = 0;
 #endif
+#ifdef TRACY_HAS_ZONE_STATS
+    bool m_stats = false;
+#endif
+#ifdef TRACY_ZONE_COUNTERS
+    ZoneCounters m_counters;
+#endif
+};
+
+// A zone of a category, which is compiled out if the category is left out of
+// TRACY_ZONE_CATEGORY_MASK.
+template<uint32_t Category, bool Compiled = ZoneCategoryCompiled( Category )>
+class CategoryZone : public ScopedZone
+{
+public:
+    using ScopedZone::ScopedZone;
+};
+
+template<uint32_t Category>
+class CategoryZone<Category, false>
+{
+public:
+    template<typename... Args> tracy_force_inline CategoryZone( Args&&... ) {}
+
+    tracy_force_inline void Text( const char*, size_t ) {}
+    void TextFmt( const char*, ... ) {}
+    tracy_force_inline void Name( const char*, size_t ) {}
+    void NameFmt( const char*, ... ) {}
+    tracy_force_inline void Color( uint32_t ) {}
+    tracy_force_inline void Value( uint64_t ) {}
+    tracy_force_inline bool IsActive() const { return false; }
+};
+
+// Emits zones with timestamps known up front, e.g. ones replayed from a job system journal. Items
+// are written directly into the thread's queue and published at once by Commit(), which is also
+// called on destruction. Times are Profiler::GetTime() ticks and must not decrease. No other
+// events may be emitted from the thread while the batch exists. With TRACY_FIBERS the batch holds
+// the serial queue lock, so it should be kept short.
+class ZoneBatch
+{
+public:
+    ZoneBatch( const ZoneBatch& ) = delete;
+    ZoneBatch( ZoneBatch&& ) = delete;
+    ZoneBatch& operator=( const ZoneBatch& ) = delete;
+    ZoneBatch& operator=( ZoneBatch&& ) = delete;
+
+    tracy_force_inline ZoneBatch( bool is_active = true )
+#ifdef TRACY_ON_DEMAND
+        : m_active( is_active && GetProfiler().IsConnected() )
+#else
+        : m_active( is_active )
+#endif
+    {
+        if( !m_active ) return;
+#ifdef TRACY_FIBERS
+        m_thread = GetThreadHandle();
+        Profiler::QueueSerialLock();
+#else
+        m_token = GetToken();
+#ifdef TRACY_COMPACT_ZONES
+        FlushPendingZone( m_token );
+#endif
+        m_tail = m_token->get_tail_index().load( std::memory_order_relaxed );
+#endif
+    }
+
+    tracy_force_inline ~ZoneBatch()
+    {
+        if( !m_active ) return;
+#ifdef TRACY_FIBERS
+        Profiler::QueueSerialUnlock();
+#else
+        Commit();
+#endif
+    }
+
+    tracy_force_inline void Begin( const SourceLocationData* srcloc, int64_t time )
+    {
+        if( !m_active ) return;
+        auto item = Prepare( QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, time );
+        MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
+#ifdef TRACY_FIBERS
+        MemWrite( &item->zoneBeginThread.thread, m_thread );
+        Profiler::QueueSerialCommitNext();
+#endif
+    }
+
+    tracy_force_inline void End( int64_t time )
+    {
+        if( !m_active ) return;
+        auto item = Prepare( QueueType::ZoneEnd );
+        MemWrite( &item->zoneEnd.time, time );
+#ifdef TRACY_FIBERS
+        MemWrite( &item->zoneEndThread.thread, m_thread );
+        Profiler::QueueSerialCommitNext();
+#endif
+    }
+
+    tracy_force_inline void Value( uint64_t value )
+    {
+        if( !m_active ) return;
+        auto item = Prepare( QueueType::ZoneValue );
+        MemWrite( &item->zoneValue.value, value );
+#ifdef TRACY_FIBERS
+        MemWrite( &item->zoneValueThread.thread, m_thread );
+        Profiler::QueueSerialCommitNext();
+#endif
+    }
+
+    // Makes the items written so far available to the profiler.
+    tracy_force_inline void Commit()
+    {
+        if( !m_active ) return;
+#ifdef TRACY_FIBERS
+        Profiler::QueueSerialUnlock();
+        Profiler::QueueSerialLock();
+#else
+        m_token->get_tail_index().store( m_tail, std::memory_order_release );
+#endif
+    }
+
+    tracy_force_inline bool IsActive() const { return m_active; }
+
+private:
+    tracy_force_inline QueueItem* Prepare( QueueType type )
+    {
+#ifdef TRACY_FIBERS
+        auto item = Profiler::QueueSerialNext();
+#else
+        auto item = m_token->enqueue_at( m_tail++ );
+#endif
+        MemWrite( &item->hdr.type, type );
+        return item;
+    }
+
+    const bool m_active;
+
+#ifdef TRACY_FIBERS
+    uint32_t m_thread;
+#else
+    EventQueue::ExplicitProducer* m_token;
+    moodycamel::ConcurrentQueueDefaultTraits::index_t m_tail;
+#endif
 };
 
 }
@@ -0,0 +1,213 @@
+#ifndef __TRACYSEGMENTEDVECTOR_HPP__
+#define __TRACYSEGMENTEDVECTOR_HPP__
+
+#include <algorithm>
+#include <assert.h>
+#include <stddef.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// A vector stored in a list of fixed-size segments. Growing links a new segment instead of
+// copying, so elements never move. Cleared segments are kept for reuse, and swap() exchanges
+// them along with the contents.
+template<typename T>
+class SegmentedVector
+{
+    struct Segment
+    {
+        Segment* next;
+    };
+
+    static constexpr size_t HeaderSize = ( sizeof( Segment ) + alignof( T ) - 1 ) / alignof( T ) * alignof( T );
+
+    static tracy_force_inline T* Data( Segment* seg ) { return (T*)( (char*)seg + HeaderSize ); }
+
+public:
+    class iterator
+    {
+    public:
+        iterator( Segment* seg, T* ptr, size_t segmentSize ) : m_seg( seg ), m_ptr( ptr ), m_segmentSize( segmentSize ) {}
+
+        T& operator*() const { return *m_ptr; }
+        T* operator->() const { return m_ptr; }
+        T* get() const { return m_ptr; }
+
+        iterator& operator++()
+        {
+            if( ++m_ptr == Data( m_seg ) + m_segmentSize && m_seg->next )
+            {
+                m_seg = m_seg->next;
+                m_ptr = Data( m_seg );
+            }
+            return *this;
+        }
+
+        iterator operator++( int )
+        {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==( const iterator& other ) const { return m_ptr == other.m_ptr; }
+        bool operator!=( const iterator& other ) const { return m_ptr != other.m_ptr; }
+
+    private:
+        Segment* m_seg;
+        T* m_ptr;
+        size_t m_segmentSize;
+    };
+
+    SegmentedVector( size_t segmentSize )
+        : m_segmentSize( segmentSize )
+        , m_head( AllocSegment() )
+        , m_tail( m_head )
+        , m_write( Data( m_head ) )
+        , m_end( m_write + segmentSize )
+        , m_full( 0 )
+        , m_free( nullptr )
+    {
+        assert( segmentSize != 0 );
+    }
+
+    SegmentedVector( const SegmentedVector& ) = delete;
+    SegmentedVector( SegmentedVector&& ) = delete;
+
+    ~SegmentedVector()
+    {
+        FreeList( m_head );
+        FreeList( m_free );
+    }
+
+    SegmentedVector& operator=( const SegmentedVector& ) = delete;
+    SegmentedVector& operator=( SegmentedVector&& ) = delete;
+
+    bool empty() const { return m_write == Data( m_head ); }
+    size_t size() const { return m_full * m_segmentSize + size_t( m_write - Data( m_tail ) ); }
+
+    iterator begin() const { return iterator( m_head, Data( m_head ), m_segmentSize ); }
+    iterator end() const { return iterator( m_tail, m_write, m_segmentSize ); }
+
+    T* push_next()
+    {
+        if( m_write == m_end ) AllocMore();
+        return m_write++;
+    }
+
+    T* prepare_next()
+    {
+        if( m_write == m_end ) AllocMore();
+        return m_write;
+    }
+
+    void commit_next()
+    {
+        m_write++;
+    }
+
+    void clear()
+    {
+        if( m_tail != m_head )
+        {
+            m_tail->next = m_free;
+            m_free = m_head->next;
+            m_head->next = nullptr;
+            m_tail = m_head;
+        }
+        m_write = Data( m_head );
+        m_end = m_write + m_segmentSize;
+        m_full = 0;
+    }
+
+    void truncate( size_t num )
+    {
+        assert( num <= size() );
+        // A full tail segment is kept rather than starting an empty one.
+        const auto full = std::min( num / m_segmentSize, m_full );
+        auto seg = m_head;
+        for( size_t i=0; i<full; i++ ) seg = seg->next;
+        if( seg != m_tail )
+        {
+            m_tail->next = m_free;
+            m_free = seg->next;
+            seg->next = nullptr;
+            m_tail = seg;
+        }
+        m_write = Data( seg ) + ( num - full * m_segmentSize );
+        m_end = Data( seg ) + m_segmentSize;
+        m_full = full;
+    }
+
+    void swap( SegmentedVector& vec )
+    {
+        assert( m_segmentSize == vec.m_segmentSize );
+        Swap( m_head, vec.m_head );
+        Swap( m_tail, vec.m_tail );
+        Swap( m_write, vec.m_write );
+        Swap( m_end, vec.m_end );
+        Swap( m_full, vec.m_full );
+        Swap( m_free, vec.m_free );
+    }
+
+private:
+    template<typename U>
+    static tracy_force_inline void Swap( U& a, U& b )
+    {
+        const auto tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    Segment* AllocSegment()
+    {
+        auto seg = (Segment*)tracy_malloc( HeaderSize + sizeof( T ) * m_segmentSize );
+        seg->next = nullptr;
+        return seg;
+    }
+
+    static void FreeList( Segment* seg )
+    {
+        while( seg )
+        {
+            auto next = seg->next;
+            tracy_free( seg );
+            seg = next;
+        }
+    }
+
+    tracy_no_inline void AllocMore()
+    {
+        Segment* seg;
+        if( m_free )
+        {
+            seg = m_free;
+            m_free = seg->next;
+            seg->next = nullptr;
+        }
+        else
+        {
+            seg = AllocSegment();
+        }
+        m_tail->next = seg;
+        m_tail = seg;
+        m_write = Data( seg );
+        m_end = m_write + m_segmentSize;
+        m_full++;
+    }
+
+    size_t m_segmentSize;
+    Segment* m_head;
+    Segment* m_tail;
+    T* m_write;
+    T* m_end;
+    size_t m_full;
+    Segment* m_free;
+};
+
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef __TRACYSERIALQUEUE_HPP__
+#define __TRACYSERIALQUEUE_HPP__
+
+// Memory event batching is built on top of the per-thread serial queues.
+#if defined TRACY_MEMORY_BATCHING && !defined TRACY_THREAD_SERIAL_QUEUES
+#  define TRACY_THREAD_SERIAL_QUEUES
+#endif
+
+#ifdef TRACY_THREAD_SERIAL_QUEUES
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "TracyFastVector.hpp"
+#include "TracySegmentedVector.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "../common/TracyMutex.hpp"
+#include "../common/TracyQueue.hpp"
+
+namespace tracy
+{
+
+// Serial queue of a single producing thread. Every group of items queued while the serial queue
+// is locked makes up a record. When the worker collects the queue, it stamps each record with the
+// time of its first timed event, or with the time of the record before it if it has none. The
+// worker merges the records of all threads by these times, so that the times of the events in the
+// merged stream never go backwards. The events of a record read the time with the lock held, so a
+// record with a time below one read by the worker before it collects the queue is always there to
+// be collected. The lock is only ever contended by the worker collecting the queued records.
+//
+// Queues are never freed. The queue of an exited thread is taken over by the next new thread. A
+// thread which queues events after giving up its queue, from the destructors of thread locals, uses
+// a queue shared with the other threads in the same case, which is only filled under the lock.
+//
+// With TRACY_MEMORY_BATCHING, single item events may be put in a ring of fixed size instead, which
+// the producer fills without taking the lock, and which is drained by the worker when it collects
+// the queue. A slot is published before the event time is read, and is marked ready once it is
+// written, so that the worker sees every slot with a time below the one it read before collecting
+// the queue, if only as pending. The worker doesn't wait for a pending slot, but leaves it and
+// what the thread queued after it for the next collection. The thread reads the times of its
+// events in program order, so the ring and the records are merged by their times.
+class SerialQueue
+{
+public:
+    struct Record
+    {
+        int64_t time;
+        size_t size;
+    };
+
+#ifdef TRACY_MEMORY_BATCHING
+    enum { RingSize = 1024 };
+
+    struct RingSlot
+    {
+        QueueItem item;
+        std::atomic<bool> ready;
+    };
+#endif
+
+    SerialQueue()
+        : m_queue( 1024 )
+        , m_records( 256 )
+        , m_dequeue( 1024 )
+        , m_dequeueRecords( 256 )
+        , m_used( true )
+        , m_next( nullptr )
+    {
+    }
+
+    SerialQueue( const SerialQueue& ) = delete;
+    SerialQueue( SerialQueue&& ) = delete;
+    SerialQueue& operator=( const SerialQueue& ) = delete;
+    SerialQueue& operator=( SerialQueue&& ) = delete;
+
+    // Producer side.
+    tracy_force_inline void Lock()
+    {
+        m_lock.lock();
+        m_start = m_queue.size();
+    }
+
+    tracy_force_inline FastVector<QueueItem>& Queue() { return m_queue; }
+
+    tracy_force_inline void Unlock()
+    {
+        const auto size = m_queue.size() - m_start;
+        if( size != 0 )
+        {
+            *m_records.push_next() = size;
+        }
+        m_lock.unlock();
+    }
+
+#ifdef TRACY_MEMORY_BATCHING
+    // Producer side, without the lock. Returns the item to be filled in, or nullptr if the ring is
+    // full and the event has to be queued under the lock. The filled in item is published with
+    // RingPublish, after which the event time is written. The slot becomes ready to be collected
+    // with RingCommit.
+    tracy_force_inline QueueItem* RingPrepare()
+    {
+        if( m_shared ) return nullptr;
+        const auto tail = m_ringTail.load( std::memory_order_relaxed );
+        if( tail - m_ringHead.load( std::memory_order_acquire ) == RingSize ) return nullptr;
+        auto& slot = m_ring[tail % RingSize];
+        slot.ready.store( false, std::memory_order_relaxed );
+        return &slot.item;
+    }
+
+    tracy_force_inline void RingPublish()
+    {
+        const auto tail = m_ringTail.load( std::memory_order_relaxed );
+        m_ringTail.store( tail + 1, std::memory_order_release );
+    }
+
+    tracy_force_inline void RingCommit()
+    {
+        const auto tail = m_ringTail.load( std::memory_order_relaxed );
+        m_ring[( tail - 1 ) % RingSize].ready.store( true, std::memory_order_release );
+    }
+#endif
+
+#ifdef TRACY_MEMORY_BATCHING
+    // The ring only takes a single producer, so a shared queue doesn't use it.
+    void SetShared() { m_shared = true; }
+#endif
+
+    void Release() { m_used.store( false, std::memory_order_release ); }
+    bool TryAcquire()
+    {
+        bool expected = false;
+        return !m_used.load( std::memory_order_relaxed ) && m_used.compare_exchange_strong( expected, true, std::memory_order_acquire );
+    }
+
+    // Consumer side. Moves the queued records behind the ones which are left from the previous
+    // collection. The time of a record is taken by timeOf( items, count, time ), which returns false
+    // if none of the items carry a time. Returns true if a ring slot was left pending.
+    template<class ShouldAbort, class TimeOf>
+    bool Collect( ShouldAbort shouldAbort, TimeOf timeOf )
+    {
+        bool pending = false;
+        bool lockHeld = true;
+        while( !m_lock.try_lock() )
+        {
+            if( shouldAbort() )
+            {
+                lockHeld = false;
+                break;
+            }
+        }
+#ifdef TRACY_MEMORY_BATCHING
+        if( m_ringHead.load( std::memory_order_relaxed ) != m_ringTail.load( std::memory_order_acquire ) )
+        {
+            pending = CollectRing( timeOf );
+        }
+        else
+#endif
+        if( !m_records.empty() )
+        {
+            size_t item = 0;
+            for( auto& size : m_records )
+            {
+                timeOf( &m_queue[item], size, m_time );
+                item += size;
+                *m_dequeueRecords.push_next() = Record { m_time, size };
+            }
+            if( m_dequeue.empty() )
+            {
+                m_queue.swap( m_dequeue );
+            }
+            else
+            {
+                for( auto& v : m_queue ) memcpy( m_dequeue.push_next(), &v, sizeof( QueueItem ) );
+                m_queue.clear();
+            }
+            m_records.clear();
+        }
+        if( lockHeld ) m_lock.unlock();
+        m_item = 0;
+        m_record = 0;
+        return pending;
+    }
+
+    bool HasRecord( int64_t limit ) const { return m_record != m_dequeueRecords.size() && m_dequeueRecords[m_record].time < limit; }
+    int64_t NextTime() const { return m_dequeueRecords[m_record].time; }
+
+    // Copies records with times below the limit to out.
+    void Take( SegmentedVector<QueueItem>& out, int64_t limit )
+    {
+        do
+        {
+            const auto size = m_dequeueRecords[m_record].size;
+            for( size_t i=0; i<size; i++ ) memcpy( out.push_next(), &m_dequeue[m_item+i], sizeof( QueueItem ) );
+            m_item += size;
+            m_record++;
+        }
+        while( HasRecord( limit ) );
+    }
+
+    // Drops the records taken since the last collection.
+    void Compact()
+    {
+        if( m_record == m_dequeueRecords.size() )
+        {
+            m_dequeue.clear();
+            m_dequeueRecords.clear();
+        }
+        else if( m_record != 0 )
+        {
+            m_dequeue.remove_front( m_item );
+            m_dequeueRecords.remove_front( m_record );
+        }
+        m_item = 0;
+        m_record = 0;
+    }
+
+    // Both sides of the queue, for dropping everything. Called with the lock held.
+    TracyMutex& GetLock() { return m_lock; }
+    template<class Func>
+    void Clear( Func func )
+    {
+#ifdef TRACY_MEMORY_BATCHING
+        m_ringHead.store( m_ringTail.load( std::memory_order_acquire ), std::memory_order_release );
+#endif
+        for( auto& v : m_queue ) func( v );
+        for( auto& v : m_dequeue ) func( v );
+        m_queue.clear();
+        m_records.clear();
+        m_dequeue.clear();
+        m_dequeueRecords.clear();
+        m_item = 0;
+        m_record = 0;
+    }
+
+    SerialQueue* Next() const { return m_next; }
+    void SetNext( SerialQueue* next ) { m_next = next; }
+
+private:
+#ifdef TRACY_MEMORY_BATCHING
+    // Merges the published slots of the ring with the records queued under the lock, by their
+    // times. Stops at the first slot which is not ready, as the records after it may have been
+    // queued after it. Returns true if it did.
+    template<class TimeOf>
+    bool CollectRing( TimeOf timeOf )
+    {
+        bool pending = false;
+        auto head = m_ringHead.load( std::memory_order_relaxed );
+        const auto tail = m_ringTail.load( std::memory_order_acquire );
+        size_t record = 0;
+        size_t item = 0;
+        bool recordTimed = false;
+        int64_t recordTime = 0;
+        while( head != tail || record != m_records.size() )
+        {
+            if( record != m_records.size() && !recordTimed )
+            {
+                recordTime = m_time;
+                timeOf( &m_queue[item], m_records[record], recordTime );
+                recordTimed = true;
+            }
+            if( head != tail )
+            {
+                auto& slot = m_ring[head % RingSize];
+                if( !slot.ready.load( std::memory_order_acquire ) )
+                {
+                    pending = true;
+                    break;
+                }
+                int64_t slotTime = m_time;
+                timeOf( &slot.item, 1, slotTime );
+                if( record == m_records.size() || slotTime <= recordTime )
+                {
+                    memcpy( m_dequeue.push_next(), &slot.item, sizeof( QueueItem ) );
+                    *m_dequeueRecords.push_next() = Record { slotTime, 1 };
+                    m_time = slotTime;
+                    head++;
+                    continue;
+                }
+            }
+            const auto size = m_records[record++];
+            for( size_t i=0; i<size; i++ ) memcpy( m_dequeue.push_next(), &m_queue[item+i], sizeof( QueueItem ) );
+            item += size;
+            *m_dequeueRecords.push_next() = Record { recordTime, size };
+            m_time = recordTime;
+            recordTimed = false;
+        }
+        m_ringHead.store( head, std::memory_order_release );
+        if( record == m_records.size() )
+        {
+            m_queue.clear();
+            m_records.clear();
+        }
+        else
+        {
+            m_queue.remove_front( item );
+            m_records.remove_front( record );
+        }
+        return pending;
+    }
+#endif
+
+    TracyMutex m_lock;
+    FastVector<QueueItem> m_queue;
+    FastVector<size_t> m_records;
+    size_t m_start;
+
+    // Owned by the consumer. The time of the last collected record.
+    FastVector<QueueItem> m_dequeue;
+    FastVector<Record> m_dequeueRecords;
+    size_t m_item = 0;
+    size_t m_record = 0;
+    int64_t m_time = 0;
+
+    std::atomic<bool> m_used;
+    SerialQueue* m_next;
+
+#ifdef TRACY_MEMORY_BATCHING
+    bool m_shared = false;
+    // The tail is owned by the producer, the head by the worker.
+    std::atomic<size_t> m_ringTail { 0 };
+    RingSlot m_ring[RingSize];
+    std::atomic<size_t> m_ringHead { 0 };
+#endif
+};
+
+}
+
+#endif
+
+#endif
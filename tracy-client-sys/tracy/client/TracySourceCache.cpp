@@ -0,0 +1,136 @@
+#include "TracySourceCache.hpp"
+
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+SourceCache::SourceCache()
+    : m_count( 0 )
+    , m_bytes( 0 )
+    , m_tick( 0 )
+{
+}
+
+SourceCache::~SourceCache()
+{
+    for( uint32_t i=0; i<m_count; i++ ) Release( m_files[i] );
+}
+
+static SourceCache::File* NewSourceFile( const char* path, uint64_t mtime, const char* data, uint32_t size )
+{
+    auto file = (SourceCache::File*)tracy_malloc( sizeof( SourceCache::File ) );
+    new(&file->refs) std::atomic<uint32_t>( 1 );
+    const auto len = strlen( path );
+    file->path = (char*)tracy_malloc( len + 1 );
+    memcpy( file->path, path, len + 1 );
+    file->mtime = mtime;
+    file->lastUse = 0;
+    file->data = data;
+    file->size = size;
+    return file;
+}
+
+SourceCache::File* SourceCache::Get( const char* path, uint64_t maxMtime, size_t maxSize )
+{
+    std::lock_guard<TracyMutex> lock( m_lock );
+
+    FILE* f = fopen( path, "rb" );
+    if( !f ) return nullptr;
+    struct stat st;
+#ifdef _WIN32
+    if( fstat( fileno( f ), &st ) != 0 )
+#else
+    if( fstat( fileno( f ), &st ) != 0 || !S_ISREG( st.st_mode ) )
+#endif
+    {
+        fclose( f );
+        return nullptr;
+    }
+
+    const auto mtime = (uint64_t)st.st_mtime;
+    const auto size = (uint64_t)st.st_size;
+    File* file = nullptr;
+    if( mtime < maxMtime && size < maxSize )
+    {
+        for( uint32_t i=0; i<m_count; i++ )
+        {
+            auto v = m_files[i];
+            if( strcmp( v->path, path ) != 0 ) continue;
+            if( v->mtime == mtime && v->size == size )
+            {
+                file = v;
+                file->refs.fetch_add( 1, std::memory_order_relaxed );
+            }
+            else
+            {
+                Remove( i );
+            }
+            break;
+        }
+
+        if( !file )
+        {
+            static const char empty = '\0';
+            if( size == 0 )
+            {
+                file = NewSourceFile( path, mtime, &empty, 0 );
+            }
+            else
+            {
+                auto ptr = (char*)tracy_malloc( size );
+                if( fread( ptr, 1, size, f ) == size )
+                {
+                    file = NewSourceFile( path, mtime, ptr, uint32_t( size ) );
+                }
+                else
+                {
+                    tracy_free( ptr );
+                }
+            }
+            if( file && size <= CacheBytes )
+            {
+                while( m_count > 0 && ( m_count == CacheFiles || m_bytes + size > CacheBytes ) )
+                {
+                    uint32_t lru = 0;
+                    for( uint32_t i=1; i<m_count; i++ )
+                    {
+                        if( m_files[i]->lastUse < m_files[lru]->lastUse ) lru = i;
+                    }
+                    Remove( lru );
+                }
+                // One reference for the cache, one for the caller.
+                file->refs.fetch_add( 1, std::memory_order_relaxed );
+                m_files[m_count++] = file;
+                m_bytes += size;
+            }
+        }
+        if( file ) file->lastUse = ++m_tick;
+    }
+
+    fclose( f );
+    return file;
+}
+
+void SourceCache::Release( File* file )
+{
+    if( file->refs.fetch_sub( 1, std::memory_order_acq_rel ) != 1 ) return;
+    if( file->size != 0 ) tracy_free( (void*)file->data );
+    tracy_free( file->path );
+    tracy_free( file );
+}
+
+void SourceCache::Remove( uint32_t idx )
+{
+    auto file = m_files[idx];
+    m_bytes -= file->size;
+    m_files[idx] = m_files[--m_count];
+    Release( file );
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef __TRACYSOURCECACHE_HPP__
+#define __TRACYSOURCECACHE_HPP__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+// Set in QueueSourceCodeMetadata::size when ptr is a SourceCache::File, which is released with
+// SourceCache::Release() instead of being freed.
+static constexpr uint32_t SourceCodeCachedFile = 0x80000000;
+
+// Keeps the source files sent to the server, so that a file which is queried again, e.g. after a
+// reconnect, doesn't have to be read again. Files are keyed by path, size and modification time.
+// They are read into the heap, as a mapping would fault if the file got truncated while it is
+// being sent. Up to CacheFiles files and CacheBytes bytes are kept, the least recently used ones
+// are dropped first. A file is freed once neither the cache nor a queue item refers to it.
+class SourceCache
+{
+public:
+    struct File
+    {
+        std::atomic<uint32_t> refs;
+        char* path;
+        uint64_t mtime;
+        uint64_t lastUse;
+        const char* data;
+        uint32_t size;
+    };
+
+    SourceCache();
+    ~SourceCache();
+
+    // Returns the file with a reference for the caller, to be given back with Release(), or
+    // nullptr if it can't be read, was modified at or after maxMtime, or isn't smaller than maxSize.
+    File* Get( const char* path, uint64_t maxMtime, size_t maxSize );
+    static void Release( File* file );
+
+    SourceCache( const SourceCache& ) = delete;
+    SourceCache( SourceCache&& ) = delete;
+    SourceCache& operator=( const SourceCache& ) = delete;
+    SourceCache& operator=( SourceCache&& ) = delete;
+
+private:
+    enum { CacheFiles = 64 };
+    static constexpr size_t CacheBytes = 64 * 1024 * 1024;
+
+    void Remove( uint32_t idx );
+
+    TracyMutex m_lock;
+    File* m_files[CacheFiles];
+    uint32_t m_count;
+    size_t m_bytes;
+    uint64_t m_tick;
+};
+
+}
+
+#endif
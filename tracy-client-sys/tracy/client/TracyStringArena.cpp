@@ -0,0 +1,100 @@
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <string.h>
+
+#include "TracyStringArena.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+constexpr size_t StringArenaChunkSize = 32 * 1024;
+// Strings larger than this get a block of their own, so that they don't waste most of a chunk.
+constexpr size_t StringArenaMaxString = 2 * 1024;
+// Added to the count of a chunk while its producer may still allocate from it, so that the count
+// can't drop to zero before the producer tells how many strings it took out of the chunk.
+constexpr int64_t StringArenaOwned = int64_t( 1 ) << 48;
+
+// Every string is preceded by a pointer to its chunk, null for a string with a block of its own.
+typedef struct StringArenaChunk* StringArenaLink;
+
+struct StringArenaChunk
+{
+    std::atomic<int64_t> live;
+};
+
+struct StringArenaHolder
+{
+    StringArenaChunk* chunk;
+    char* ptr;
+    size_t left;
+    int64_t count;
+
+    ~StringArenaHolder() { if( chunk ) Release(); }
+
+    void Release()
+    {
+        const auto live = chunk->live.fetch_add( count - StringArenaOwned, std::memory_order_acq_rel ) + count - StringArenaOwned;
+        if( live == 0 ) tracy_free( chunk );
+    }
+};
+
+thread_local StringArenaHolder s_stringArena;
+
+tracy_no_inline void StringArenaRefill( StringArenaHolder& arena )
+{
+    if( arena.chunk ) arena.Release();
+    auto chunk = (StringArenaChunk*)tracy_malloc( StringArenaChunkSize );
+    new(chunk) StringArenaChunk { { StringArenaOwned } };
+    arena.chunk = chunk;
+    arena.ptr = (char*)chunk + sizeof( StringArenaChunk );
+    arena.left = StringArenaChunkSize - sizeof( StringArenaChunk );
+    arena.count = 0;
+}
+
+}
+
+TRACY_API char* StringArenaAlloc( size_t size )
+{
+    static_assert( sizeof( StringArenaChunk ) % sizeof( StringArenaLink ) == 0, "Chunk header breaks alignment" );
+
+    const auto need = ( sizeof( StringArenaLink ) + size + sizeof( StringArenaLink ) - 1 ) & ~( sizeof( StringArenaLink ) - 1 );
+    if( need > StringArenaMaxString )
+    {
+        auto block = (char*)tracy_malloc( sizeof( StringArenaLink ) + size );
+        StringArenaLink link = nullptr;
+        memcpy( block, &link, sizeof( link ) );
+        return block + sizeof( StringArenaLink );
+    }
+
+    auto& arena = s_stringArena;
+    if( arena.left < need ) StringArenaRefill( arena );
+    auto ptr = arena.ptr;
+    memcpy( ptr, &arena.chunk, sizeof( StringArenaLink ) );
+    arena.ptr += need;
+    arena.left -= need;
+    arena.count++;
+    return ptr + sizeof( StringArenaLink );
+}
+
+TRACY_API void StringArenaFree( const char* ptr )
+{
+    auto block = (char*)ptr - sizeof( StringArenaLink );
+    StringArenaLink chunk;
+    memcpy( &chunk, block, sizeof( chunk ) );
+    if( !chunk )
+    {
+        tracy_free( block );
+    }
+    else if( chunk->live.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+        tracy_free( chunk );
+    }
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef __TRACYSTRINGARENA_HPP__
+#define __TRACYSTRINGARENA_HPP__
+
+#include <stddef.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+// The zone texts and names and the messages are copied by the thread which produces them and
+// released by the profiler thread, once sent. Rather than going through the allocator for each
+// of them, and freeing every one across threads, they are bump allocated from chunks owned by the
+// producing thread. A chunk is freed as a whole by whichever side lets go of it last: the profiler
+// thread, after the last of its strings was sent, or the producer, when it moves on to a new chunk
+// or exits.
+TRACY_API char* StringArenaAlloc( size_t size );
+TRACY_API void StringArenaFree( const char* ptr );
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include "TracySymbolCache.hpp"
+
+#ifdef TRACY_HAS_CALLSTACK
+
+#include <mutex>
+#include <string.h>
+
+#include "TracyStringHelpers.hpp"
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+SymbolCache::SymbolCache()
+{
+    for( auto& shard : m_shards )
+    {
+        shard.entries = (Entry*)tracy_malloc( sizeof( Entry ) * ShardSize );
+        shard.buckets = (uint32_t*)tracy_malloc( sizeof( uint32_t ) * Buckets );
+        for( uint32_t i=0; i<Buckets; i++ ) shard.buckets[i] = Nil;
+        shard.used = 0;
+        shard.head = shard.tail = Nil;
+    }
+}
+
+SymbolCache::~SymbolCache()
+{
+    for( auto& shard : m_shards )
+    {
+        for( uint32_t i=0; i<shard.used; i++ ) tracy_free( shard.entries[i].frames );
+        tracy_free( shard.entries );
+        tracy_free( shard.buckets );
+    }
+}
+
+bool SymbolCache::Get( uint64_t ptr, CallstackEntry*& data, uint8_t& size, const char*& imageName )
+{
+    const auto hash = Hash( ptr );
+    auto& shard = m_shards[hash >> ( 64 - ShardBits )];
+    std::lock_guard<TracyMutex> lock( shard.lock );
+    const auto idx = Find( shard, uint32_t( hash % Buckets ), ptr );
+    if( idx == Nil ) return false;
+    if( idx != shard.head )
+    {
+        Unlink( shard, idx );
+        PushFront( shard, idx );
+    }
+
+    const auto& entry = shard.entries[idx];
+    size = entry.size;
+    imageName = entry.imageName;
+    data = (CallstackEntry*)tracy_malloc_fast( sizeof( CallstackEntry ) * size );
+    for( uint8_t i=0; i<size; i++ )
+    {
+        data[i] = entry.frames[i];
+        data[i].name = CopyStringFast( entry.frames[i].name );
+        data[i].file = CopyStringFast( entry.frames[i].file );
+    }
+    return true;
+}
+
+void SymbolCache::Put( uint64_t ptr, const CallstackEntryData& frames )
+{
+    size_t sz = sizeof( CallstackEntry ) * frames.size;
+    for( uint8_t i=0; i<frames.size; i++ )
+    {
+        sz += strlen( frames.data[i].name ) + strlen( frames.data[i].file ) + 2;
+    }
+    auto copy = (CallstackEntry*)tracy_malloc( sz );
+    auto str = (char*)( copy + frames.size );
+    for( uint8_t i=0; i<frames.size; i++ )
+    {
+        copy[i] = frames.data[i];
+        const auto nsz = strlen( frames.data[i].name ) + 1;
+        memcpy( str, frames.data[i].name, nsz );
+        copy[i].name = str;
+        str += nsz;
+        const auto fsz = strlen( frames.data[i].file ) + 1;
+        memcpy( str, frames.data[i].file, fsz );
+        copy[i].file = str;
+        str += fsz;
+    }
+
+    const auto hash = Hash( ptr );
+    auto& shard = m_shards[hash >> ( 64 - ShardBits )];
+    const auto bucket = uint32_t( hash % Buckets );
+    std::lock_guard<TracyMutex> lock( shard.lock );
+    if( Find( shard, bucket, ptr ) != Nil )
+    {
+        // Resolved by another thread in the meantime.
+        tracy_free( copy );
+        return;
+    }
+
+    uint32_t idx;
+    if( shard.used < ShardSize )
+    {
+        idx = shard.used++;
+    }
+    else
+    {
+        idx = shard.tail;
+        Evict( shard, idx );
+    }
+    auto& entry = shard.entries[idx];
+    entry.ptr = ptr;
+    entry.frames = copy;
+    entry.imageName = frames.imageName;
+    entry.size = frames.size;
+    entry.chain = shard.buckets[bucket];
+    shard.buckets[bucket] = idx;
+    PushFront( shard, idx );
+}
+
+uint32_t SymbolCache::Find( const Shard& shard, uint32_t bucket, uint64_t ptr )
+{
+    auto idx = shard.buckets[bucket];
+    while( idx != Nil && shard.entries[idx].ptr != ptr ) idx = shard.entries[idx].chain;
+    return idx;
+}
+
+void SymbolCache::Unlink( Shard& shard, uint32_t idx )
+{
+    auto& entry = shard.entries[idx];
+    if( entry.prev != Nil ) shard.entries[entry.prev].next = entry.next; else shard.head = entry.next;
+    if( entry.next != Nil ) shard.entries[entry.next].prev = entry.prev; else shard.tail = entry.prev;
+}
+
+void SymbolCache::PushFront( Shard& shard, uint32_t idx )
+{
+    auto& entry = shard.entries[idx];
+    entry.prev = Nil;
+    entry.next = shard.head;
+    if( shard.head != Nil ) shard.entries[shard.head].prev = idx; else shard.tail = idx;
+    shard.head = idx;
+}
+
+void SymbolCache::Evict( Shard& shard, uint32_t idx )
+{
+    auto& entry = shard.entries[idx];
+    Unlink( shard, idx );
+    auto link = &shard.buckets[Hash( entry.ptr ) % Buckets];
+    while( *link != idx ) link = &shard.entries[*link].chain;
+    *link = entry.chain;
+    tracy_free( entry.frames );
+}
+
+}
+
+#endif
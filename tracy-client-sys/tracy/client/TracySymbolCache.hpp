@@ -0,0 +1,71 @@
+#ifndef __TRACYSYMBOLCACHE_HPP__
+#define __TRACYSYMBOLCACHE_HPP__
+
+#include "TracyCallstack.hpp"
+
+#ifdef TRACY_HAS_CALLSTACK
+
+#include <stdint.h>
+
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+// Keeps the most recently resolved callstack frames, so that frames which are queried again, e.g.
+// after a reconnect, don't have to go through the debug information. Addresses are spread over
+// independently locked shards, each evicting its least recently used entry when full.
+class SymbolCache
+{
+public:
+    SymbolCache();
+    ~SymbolCache();
+
+    // On a hit, data receives a copy of the frames, allocated like the result of
+    // DecodeCallstackPtr() is copied for the queue: array with tracy_malloc_fast, strings with
+    // CopyStringFast. Image names are not copied.
+    bool Get( uint64_t ptr, CallstackEntry*& data, uint8_t& size, const char*& imageName );
+    void Put( uint64_t ptr, const CallstackEntryData& frames );
+
+    SymbolCache( const SymbolCache& ) = delete;
+    SymbolCache( SymbolCache&& ) = delete;
+    SymbolCache& operator=( const SymbolCache& ) = delete;
+    SymbolCache& operator=( SymbolCache&& ) = delete;
+
+private:
+    enum { ShardBits = 4, Shards = 1 << ShardBits, ShardSize = 4096, Buckets = ShardSize * 2 };
+    static constexpr uint32_t Nil = ~uint32_t( 0 );
+
+    struct Entry
+    {
+        uint64_t ptr;
+        CallstackEntry* frames;     // frames and their strings in a single allocation
+        const char* imageName;
+        uint32_t prev, next;        // LRU order, most recent first
+        uint32_t chain;             // next entry in the bucket
+        uint8_t size;
+    };
+
+    struct Shard
+    {
+        TracyMutex lock;
+        Entry* entries;
+        uint32_t* buckets;
+        uint32_t used;
+        uint32_t head, tail;
+    };
+
+    static uint64_t Hash( uint64_t ptr ) { return ptr * 0x9E3779B97F4A7C15ull; }
+    static uint32_t Find( const Shard& shard, uint32_t bucket, uint64_t ptr );
+    static void Unlink( Shard& shard, uint32_t idx );
+    static void PushFront( Shard& shard, uint32_t idx );
+    static void Evict( Shard& shard, uint32_t idx );
+
+    Shard m_shards[Shards];
+};
+
+}
+
+#endif
+
+#endif
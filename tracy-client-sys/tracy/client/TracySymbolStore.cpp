@@ -0,0 +1,346 @@
+#include "TracySymbolStore.hpp"
+
+#ifdef TRACY_HAS_SYMBOL_STORE
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits>
+#include <link.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TracyFastVector.hpp"
+#include "TracyStringHelpers.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
+#include "../common/TracySystem.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+// A store file starts with the header, followed by records appended by each run:
+//   uint32_t size of the record, including this field
+//   uint64_t address, relative to the image base
+//   uint8_t  number of frames, each one being:
+//     uint32_t line
+//     uint32_t symLen
+//     uint64_t symAddr relative to the image base plus one, or zero if not known
+//     uint16_t name length, name
+//     uint16_t file length, file
+// Processes sharing a file hold an exclusive flock() while appending or opening it.
+struct SymbolStoreHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+constexpr char SymbolStoreMagic[8] = { 'T', 'r', 'a', 'c', 'y', 'S', 'y', 'm' };
+constexpr uint32_t SymbolStoreVersion = 1;
+constexpr size_t SymbolStoreRecordMin = sizeof( uint32_t ) + sizeof( uint64_t ) + sizeof( uint8_t );
+constexpr size_t SymbolStoreFrameMin = sizeof( uint32_t ) * 2 + sizeof( uint64_t ) + sizeof( uint16_t ) * 2;
+
+struct SymbolStoreIndex
+{
+    uint64_t offset;
+    uint32_t pos;
+};
+
+struct SymbolStoreImage
+{
+    const char* imageName;      // image names are kept by the image cache until EndCallstack()
+    const char* data;           // file contents at the time it was opened
+    size_t size;
+    SymbolStoreIndex* index;    // sorted by offset, not changed after the image is opened
+    uint32_t count;
+    int fd;                     // appends go here, -1 if the image is not cached
+};
+
+char* s_symbolStoreDir;
+TracyMutex s_symbolStoreLock;
+FastVector<SymbolStoreImage*>* s_symbolStoreImages;
+
+struct BuildIdQuery
+{
+    uint64_t base;
+    char id[129];
+};
+
+}
+
+bool ReadImageBuildId( const struct dl_phdr_info* info, char* id )
+{
+    for( int i=0; i<info->dlpi_phnum; i++ )
+    {
+        const auto& phdr = info->dlpi_phdr[i];
+        if( phdr.p_type != PT_NOTE ) continue;
+        const size_t align = phdr.p_align == 8 ? 8 : 4;
+        auto ptr = (const char*)( info->dlpi_addr + phdr.p_vaddr );
+        const auto end = ptr + phdr.p_memsz;
+        while( ptr + sizeof( ElfW(Nhdr) ) <= end )
+        {
+            const auto nhdr = (const ElfW(Nhdr)*)ptr;
+            const auto desc = sizeof( ElfW(Nhdr) ) + ( ( nhdr->n_namesz + align - 1 ) & ~( align - 1 ) );
+            const auto next = desc + ( ( nhdr->n_descsz + align - 1 ) & ~( align - 1 ) );
+            if( next > size_t( end - ptr ) ) break;
+            if( nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && memcmp( ptr + sizeof( ElfW(Nhdr) ), "GNU", 4 ) == 0 &&
+                nhdr->n_descsz > 0 && nhdr->n_descsz <= 64 )
+            {
+                auto bid = (const uint8_t*)ptr + desc;
+                for( uint32_t j=0; j<nhdr->n_descsz; j++ ) sprintf( id + j*2, "%02x", bid[j] );
+                return true;
+            }
+            ptr += next;
+        }
+    }
+    return false;
+}
+
+static int BuildIdCallback( struct dl_phdr_info* info, size_t, void* data )
+{
+    auto& query = *(BuildIdQuery*)data;
+    if( uint64_t( info->dlpi_addr ) != query.base ) return 0;
+    ReadImageBuildId( info, query.id );
+    return 1;
+}
+
+static void LoadStoreImage( SymbolStoreImage& image, uint64_t imageBase )
+{
+    BuildIdQuery query;
+    query.base = imageBase;
+    query.id[0] = '\0';
+    dl_iterate_phdr( BuildIdCallback, &query );
+    if( !query.id[0] ) return;
+
+    const auto dsz = strlen( s_symbolStoreDir );
+    auto path = (char*)tracy_malloc( dsz + sizeof( query.id ) + 8 );
+    sprintf( path, "%s/%s.tsym", s_symbolStoreDir, query.id );
+    int fd = open( path, O_RDWR | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+    if( fd >= 0 )
+    {
+        SymbolStoreHeader hdr = {};
+        memcpy( hdr.magic, SymbolStoreMagic, sizeof( hdr.magic ) );
+        hdr.version = SymbolStoreVersion;
+        if( write( fd, &hdr, sizeof( hdr ) ) != sizeof( hdr ) )
+        {
+            close( fd );
+            fd = -1;
+        }
+    }
+    else if( errno == EEXIST )
+    {
+        fd = open( path, O_RDWR | O_APPEND | O_CLOEXEC );
+    }
+    tracy_free( path );
+    if( fd < 0 ) return;
+
+    struct stat st;
+    if( flock( fd, LOCK_EX ) != 0 || fstat( fd, &st ) != 0 || size_t( st.st_size ) < sizeof( SymbolStoreHeader ) )
+    {
+        close( fd );
+        return;
+    }
+    const auto size = size_t( st.st_size );
+    auto data = (const char*)mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( data == MAP_FAILED )
+    {
+        close( fd );
+        return;
+    }
+    SymbolStoreHeader hdr;
+    memcpy( &hdr, data, sizeof( hdr ) );
+    if( memcmp( hdr.magic, SymbolStoreMagic, sizeof( hdr.magic ) ) != 0 || hdr.version != SymbolStoreVersion || size > std::numeric_limits<uint32_t>::max() )
+    {
+        // Not ours to append to.
+        munmap( (void*)data, size );
+        close( fd );
+        return;
+    }
+
+    FastVector<SymbolStoreIndex> index( 1024 );
+    size_t pos = sizeof( SymbolStoreHeader );
+    while( pos + SymbolStoreRecordMin <= size )
+    {
+        uint32_t rsz;
+        memcpy( &rsz, data + pos, sizeof( rsz ) );
+        if( rsz < SymbolStoreRecordMin || rsz > size - pos ) break;
+        auto entry = index.push_next();
+        memcpy( &entry->offset, data + pos + sizeof( rsz ), sizeof( entry->offset ) );
+        entry->pos = uint32_t( pos );
+        pos += rsz;
+    }
+    // A record cut short by a process which went away would hide everything appended after it.
+    if( pos != size && ftruncate( fd, pos ) != 0 )
+    {
+        munmap( (void*)data, size );
+        close( fd );
+        return;
+    }
+    flock( fd, LOCK_UN );
+    std::sort( index.begin(), index.end(), []( const SymbolStoreIndex& lhs, const SymbolStoreIndex& rhs ) { return lhs.offset < rhs.offset; } );
+
+    image.data = data;
+    image.size = size;
+    image.count = uint32_t( index.size() );
+    if( image.count != 0 )
+    {
+        image.index = (SymbolStoreIndex*)tracy_malloc( sizeof( SymbolStoreIndex ) * image.count );
+        memcpy( image.index, index.data(), sizeof( SymbolStoreIndex ) * image.count );
+    }
+    image.fd = fd;
+}
+
+static SymbolStoreImage* GetStoreImage( const char* imageName, uint64_t imageBase )
+{
+    std::lock_guard<TracyMutex> lock( s_symbolStoreLock );
+    for( auto& v : *s_symbolStoreImages )
+    {
+        if( v->imageName == imageName ) return v;
+    }
+    auto image = (SymbolStoreImage*)tracy_malloc( sizeof( SymbolStoreImage ) );
+    memset( image, 0, sizeof( SymbolStoreImage ) );
+    image->imageName = imageName;
+    image->fd = -1;
+    LoadStoreImage( *image, imageBase );
+    *s_symbolStoreImages->push_next() = image;
+    return image;
+}
+
+void InitSymbolStore()
+{
+    const char* dir = GetEnvVar( "TRACY_SYMBOL_CACHE_DIR" );
+    if( !dir || !dir[0] ) return;
+    if( mkdir( dir, 0755 ) != 0 && errno != EEXIST ) return;
+    s_symbolStoreDir = CopyString( dir );
+    s_symbolStoreImages = (FastVector<SymbolStoreImage*>*)tracy_malloc( sizeof( FastVector<SymbolStoreImage*> ) );
+    new(s_symbolStoreImages) FastVector<SymbolStoreImage*>( 32 );
+}
+
+void EndSymbolStore()
+{
+    if( !s_symbolStoreDir ) return;
+    for( auto& v : *s_symbolStoreImages )
+    {
+        if( v->data ) munmap( (void*)v->data, v->size );
+        if( v->fd >= 0 ) close( v->fd );
+        tracy_free( v->index );
+        tracy_free( v );
+    }
+    s_symbolStoreImages->~FastVector<SymbolStoreImage*>();
+    tracy_free( s_symbolStoreImages );
+    tracy_free( s_symbolStoreDir );
+    s_symbolStoreDir = nullptr;
+}
+
+int SymbolStoreGet( const char* imageName, uint64_t imageBase, uint64_t ptr, CallstackEntry* frames, int maxFrames )
+{
+    if( !s_symbolStoreDir || !imageName ) return 0;
+    const auto image = GetStoreImage( imageName, imageBase );
+    const auto offset = ptr - imageBase;
+    auto it = std::lower_bound( image->index, image->index + image->count, offset, []( const SymbolStoreIndex& lhs, uint64_t rhs ) { return lhs.offset < rhs; } );
+    if( it == image->index + image->count || it->offset != offset ) return 0;
+
+    uint32_t rsz;
+    memcpy( &rsz, image->data + it->pos, sizeof( rsz ) );
+    auto p = image->data + it->pos + sizeof( uint32_t ) + sizeof( uint64_t );
+    const auto end = image->data + it->pos + rsz;
+    const int num = uint8_t( *p++ );
+    if( num == 0 || num > maxFrames ) return 0;
+    int i;
+    for( i=0; i<num; i++ )
+    {
+        if( size_t( end - p ) < SymbolStoreFrameMin ) break;
+        auto& frame = frames[i];
+        uint64_t symAddr;
+        uint16_t nsz, fsz;
+        memcpy( &frame.line, p, sizeof( uint32_t ) ); p += sizeof( uint32_t );
+        memcpy( &frame.symLen, p, sizeof( uint32_t ) ); p += sizeof( uint32_t );
+        memcpy( &symAddr, p, sizeof( uint64_t ) ); p += sizeof( uint64_t );
+        memcpy( &nsz, p, sizeof( uint16_t ) ); p += sizeof( uint16_t );
+        if( size_t( end - p ) < size_t( nsz ) + sizeof( uint16_t ) ) break;
+        frame.name = CopyStringFast( p, nsz ); p += nsz;
+        memcpy( &fsz, p, sizeof( uint16_t ) ); p += sizeof( uint16_t );
+        if( size_t( end - p ) < fsz )
+        {
+            tracy_free_fast( (void*)frame.name );
+            break;
+        }
+        frame.file = CopyStringFast( p, fsz ); p += fsz;
+        frame.symAddr = symAddr == 0 ? 0 : symAddr - 1 + imageBase;
+    }
+    if( i == num ) return num;
+
+    // Damaged record, leave the address to the debug information.
+    for( int j=0; j<i; j++ )
+    {
+        tracy_free_fast( (void*)frames[j].name );
+        tracy_free_fast( (void*)frames[j].file );
+    }
+    return 0;
+}
+
+void SymbolStorePut( const char* imageName, uint64_t imageBase, uint64_t ptr, const CallstackEntry* frames, int num )
+{
+    if( !s_symbolStoreDir || !imageName || num <= 0 || num > 255 ) return;
+    // Failed lookups are not remembered, neither are names made of a symbol offset, as they may
+    // depend on where the image was loaded.
+    if( num == 1 && strcmp( frames[0].name, "[error]" ) == 0 ) return;
+    for( int i=0; i<num; i++ )
+    {
+        if( strncmp( frames[i].name, "[unknown] + ", 12 ) == 0 ) return;
+    }
+    const auto image = GetStoreImage( imageName, imageBase );
+    if( image->fd < 0 ) return;
+
+    size_t sz = SymbolStoreRecordMin;
+    for( int i=0; i<num; i++ )
+    {
+        sz += SymbolStoreFrameMin + std::min<size_t>( strlen( frames[i].name ), std::numeric_limits<uint16_t>::max() ) +
+            std::min<size_t>( strlen( frames[i].file ), std::numeric_limits<uint16_t>::max() );
+    }
+    auto buf = (char*)tracy_malloc( sz );
+    auto p = buf;
+    const auto rsz = uint32_t( sz );
+    const auto offset = ptr - imageBase;
+    memcpy( p, &rsz, sizeof( rsz ) ); p += sizeof( rsz );
+    memcpy( p, &offset, sizeof( offset ) ); p += sizeof( offset );
+    *p++ = char( uint8_t( num ) );
+    for( int i=0; i<num; i++ )
+    {
+        const auto& frame = frames[i];
+        const uint64_t symAddr = frame.symAddr == 0 ? 0 : frame.symAddr - imageBase + 1;
+        const auto nsz = uint16_t( std::min<size_t>( strlen( frame.name ), std::numeric_limits<uint16_t>::max() ) );
+        const auto fsz = uint16_t( std::min<size_t>( strlen( frame.file ), std::numeric_limits<uint16_t>::max() ) );
+        memcpy( p, &frame.line, sizeof( uint32_t ) ); p += sizeof( uint32_t );
+        memcpy( p, &frame.symLen, sizeof( uint32_t ) ); p += sizeof( uint32_t );
+        memcpy( p, &symAddr, sizeof( uint64_t ) ); p += sizeof( uint64_t );
+        memcpy( p, &nsz, sizeof( uint16_t ) ); p += sizeof( uint16_t );
+        memcpy( p, frame.name, nsz ); p += nsz;
+        memcpy( p, &fsz, sizeof( uint16_t ) ); p += sizeof( uint16_t );
+        memcpy( p, frame.file, fsz ); p += fsz;
+    }
+    {
+        std::lock_guard<TracyMutex> lock( s_symbolStoreLock );
+        if( image->fd >= 0 && ( flock( image->fd, LOCK_EX ) != 0 || write( image->fd, buf, sz ) != ssize_t( sz ) ) )
+        {
+            // Don't append after a partial record.
+            close( image->fd );
+            image->fd = -1;
+        }
+        if( image->fd >= 0 ) flock( image->fd, LOCK_UN );
+    }
+    tracy_free( buf );
+}
+
+}
+
+#endif
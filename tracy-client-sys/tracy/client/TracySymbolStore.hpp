@@ -0,0 +1,35 @@
+#ifndef __TRACYSYMBOLSTORE_HPP__
+#define __TRACYSYMBOLSTORE_HPP__
+
+#include "TracyCallstack.hpp"
+
+#if defined TRACY_USE_LIBBACKTRACE && TRACY_HAS_CALLSTACK != 4
+#  define TRACY_HAS_SYMBOL_STORE
+
+#include <link.h>
+#include <stdint.h>
+
+namespace tracy
+{
+
+// Writes the GNU build id of the image as a hex string to id, which must hold 129 characters.
+// Returns false if the image has none.
+bool ReadImageBuildId( const struct dl_phdr_info* info, char* id );
+
+// Persistent cache of decoded callstack frames. When TRACY_SYMBOL_CACHE_DIR is set, the frames
+// of each image are kept in a file named after the build id of the image, so that later runs of
+// the same binary don't have to go through its debug information. Images without a build id are
+// not cached.
+void InitSymbolStore();
+void EndSymbolStore();
+
+// Fills frames with the stored frames of the address, strings allocated with CopyStringFast.
+// Returns the number of frames, zero if the address is not known.
+int SymbolStoreGet( const char* imageName, uint64_t imageBase, uint64_t ptr, CallstackEntry* frames, int maxFrames );
+void SymbolStorePut( const char* imageName, uint64_t imageBase, uint64_t ptr, const CallstackEntry* frames, int num );
+
+}
+
+#endif
+
+#endif
@@ -4,10 +4,11 @@
 
 #include <sys/types.h>
 #include <dirent.h>
-#include <chrono>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "TracyDebug.hpp"
 #include "TracyProfiler.hpp"
@@ -18,7 +19,6 @@ namespace tracy
 
 SysPower::SysPower()
     : m_domains( 4 )
-    , m_lastTime( 0 )
 {
     ScanDirectory( "/sys/devices/virtual/powercap/intel-rapl", -1 );
 }
@@ -27,41 +27,37 @@ SysPower::~SysPower()
 {
     for( auto& v : m_domains )
     {
-        fclose( v.handle );
+        close( v.fd );
         // Do not release v.name, as it may be still needed
     }
 }
 
 void SysPower::Tick()
 {
-    auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    if( t - m_lastTime > 10000000 )    // 10 ms
+    for( auto& v : m_domains )
     {
-        m_lastTime = t;
-        for( auto& v : m_domains )
+        char tmp[32];
+        const auto sz = pread( v.fd, tmp, sizeof( tmp ) - 1, 0 );
+        if( sz > 0 )
         {
-            char tmp[32];
-            if( fread( tmp, 1, 32, v.handle ) > 0 )
+            tmp[sz] = '\0';
+            auto p = (uint64_t)atoll( tmp );
+            uint64_t delta;
+            if( p >= v.value )
             {
-                rewind( v.handle );
-                auto p = (uint64_t)atoll( tmp );
-                uint64_t delta;
-                if( p >= v.value )
-                {
-                    delta = p - v.value;
-                }
-                else
-                {
-                    delta = v.overflow - v.value + p;
-                }
-                v.value = p;
-
-                TracyLfqPrepare( QueueType::SysPowerReport );
-                MemWrite( &item->sysPower.time, Profiler::GetTime() );
-                MemWrite( &item->sysPower.delta, delta );
-                MemWrite( &item->sysPower.name, (uint64_t)v.name );
-                TracyLfqCommit;
+                delta = p - v.value;
+            }
+            else
+            {
+                delta = v.overflow - v.value + p;
             }
+            v.value = p;
+
+            TracyLfqPrepare( QueueType::SysPowerReport );
+            MemWrite( &item->sysPower.time, Profiler::GetTime() );
+            MemWrite( &item->sysPower.delta, delta );
+            MemWrite( &item->sysPower.name, (uint64_t)v.name );
+            TracyLfqCommit;
         }
     }
 }
@@ -73,7 +69,7 @@ void SysPower::ScanDirectory( const char* path, int parent )
     struct dirent* ent;
     uint64_t maxRange = 0;
     char* name = nullptr;
-    FILE* handle = nullptr;
+    int fd = -1;
     while( ( ent = readdir( dir ) ) )
     {
         if( ent->d_type == DT_REG )
@@ -125,25 +121,25 @@ void SysPower::ScanDirectory( const char* path, int parent )
             {
                 char tmp[PATH_MAX];
                 snprintf( tmp, PATH_MAX, "%s/energy_uj", path );
-                handle = fopen( tmp, "r" );
+                fd = open( tmp, O_RDONLY | O_CLOEXEC );
             }
         }
-        if( name && handle && maxRange > 0 ) break;
+        if( name && fd >= 0 && maxRange > 0 ) break;
     }
-    if( name && handle && maxRange > 0 )
+    if( name && fd >= 0 && maxRange > 0 )
     {
         parent = (int)m_domains.size();
         Domain* domain = m_domains.push_next();
         domain->value = 0;
         domain->overflow = maxRange;
-        domain->handle = handle;
+        domain->fd = fd;
         domain->name = name;
         TracyDebug( "Power domain id %i, %s found at %s", parent, name, path );
     }
     else
     {
         if( name ) tracy_free( name );
-        if( handle ) fclose( handle );
+        if( fd >= 0 ) close( fd );
     }
 
     rewinddir( dir );
@@ -8,7 +8,6 @@
 #ifdef TRACY_HAS_SYSPOWER
 
 #include <stdint.h>
-#include <stdio.h>
 
 #include "TracyFastVector.hpp"
 
@@ -21,7 +20,7 @@ class SysPower
     {
         uint64_t value;
         uint64_t overflow;
-        FILE* handle;
+        int fd;
         const char* name;
     };
 
@@ -29,13 +28,14 @@ public:
     SysPower();
     ~SysPower();
 
+    bool Empty() const { return m_domains.empty(); }
+    // Reports the energy used by each domain since the previous call.
     void Tick();
 
 private:
     void ScanDirectory( const char* path, int parent );
 
     FastVector<Domain> m_domains;
-    uint64_t m_lastTime;
 };
 
 }
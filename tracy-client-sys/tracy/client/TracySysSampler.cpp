@@ -0,0 +1,397 @@
+#include "TracySysSampler.hpp"
+
+#ifdef TRACY_HAS_SYS_SAMPLER
+
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#ifdef __linux__
+#  include <sys/types.h>
+#  include <dirent.h>
+#  include <fcntl.h>
+#  include <limits.h>
+#  include <unistd.h>
+#endif
+
+#include "TracyDebug.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracySystem.hpp"
+
+namespace tracy
+{
+
+static int64_t SysSamplerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+#ifdef __linux__
+static char* CopyPlotName( const char* name )
+{
+    const auto sz = strlen( name );
+    auto ptr = (char*)tracy_malloc( sz + 1 );
+    memcpy( ptr, name, sz + 1 );
+    return ptr;
+}
+
+// Reads the whole (small) file at fd into buf, null terminated.
+static bool ReadSysFile( int fd, char* buf, size_t size )
+{
+    const auto sz = pread( fd, buf, size - 1, 0 );
+    if( sz <= 0 ) return false;
+    buf[sz] = '\0';
+    return true;
+}
+
+static bool ReadSysCounter( int fd, uint64_t& value )
+{
+    char tmp[32];
+    if( !ReadSysFile( fd, tmp, sizeof( tmp ) ) ) return false;
+    char* end;
+    value = strtoull( tmp, &end, 10 );
+    return end != tmp;
+}
+#endif
+
+static int GetSysSamplerInterval( const char* env, int interval )
+{
+    const char* val = GetEnvVar( env );
+    if( val ) interval = atoi( val );
+    return interval;
+}
+
+SysSampler::SysSampler()
+#ifdef __linux__
+    : m_cpuFreq( 16 )
+    , m_memBandwidth( 4 )
+    , m_memBandwidthLast( 0 )
+    , m_throttleLast( 0 )
+    , m_clockFd( -1 )
+    , m_clockId( CLOCK_REALTIME )
+    , m_clockFirst( 0 )
+    , m_sources( 8 )
+#else
+    : m_sources( 8 )
+#endif
+{
+#ifdef TRACY_HAS_SYSTIME
+    AddSource( &SysSampler::SampleSysTime, GetSysSamplerInterval( "TRACY_SYSTIME_INTERVAL", 100 ) );
+#endif
+#ifdef TRACY_HAS_SYSPOWER
+    if( !m_sysPower.Empty() ) AddSource( &SysSampler::SampleSysPower, GetSysSamplerInterval( "TRACY_SYSPOWER_INTERVAL", 10 ) );
+#endif
+#ifdef __linux__
+    m_throttle.fd = -1;
+
+    const auto cpuFreq = GetSysSamplerInterval( "TRACY_CPU_FREQ_INTERVAL", 0 );
+    if( cpuFreq > 0 )
+    {
+        SetupCpuFreq();
+        if( !m_cpuFreq.empty() ) AddSource( &SysSampler::SampleCpuFreq, cpuFreq );
+    }
+    const auto memBandwidth = GetSysSamplerInterval( "TRACY_MEM_BANDWIDTH_INTERVAL", 0 );
+    if( memBandwidth > 0 )
+    {
+        SetupMemBandwidth();
+        if( !m_memBandwidth.empty() ) AddSource( &SysSampler::SampleMemBandwidth, memBandwidth );
+    }
+    const auto throttle = GetSysSamplerInterval( "TRACY_CGROUP_THROTTLE_INTERVAL", 0 );
+    if( throttle > 0 )
+    {
+        SetupCgroupThrottle();
+        if( m_throttle.fd >= 0 ) AddSource( &SysSampler::SampleCgroupThrottle, throttle );
+    }
+    const auto clockSync = GetSysSamplerInterval( "TRACY_CLOCK_SYNC_INTERVAL", 0 );
+    if( clockSync > 0 )
+    {
+        SetupClockSync();
+        AddSource( &SysSampler::SampleClockSync, clockSync );
+    }
+#endif
+}
+
+SysSampler::~SysSampler()
+{
+    // The plot names are not released, as they may be still needed.
+#ifdef __linux__
+    for( auto& v : m_cpuFreq ) close( v.fd );
+    for( auto& v : m_memBandwidth ) close( v.fd );
+    if( m_throttle.fd >= 0 ) close( m_throttle.fd );
+    if( m_clockFd >= 0 ) close( m_clockFd );
+#endif
+}
+
+void SysSampler::AddSource( SampleFn sample, int interval )
+{
+    if( interval <= 0 ) return;
+    auto source = m_sources.push_next();
+    source->sample = sample;
+    source->interval = int64_t( interval ) * 1000 * 1000;
+    source->next = 0;
+}
+
+void SysSampler::Run()
+{
+    if( m_sources.empty() ) return;
+    while( !Profiler::ShouldExit() )
+    {
+        // Shutdown is only seen in between the waits.
+        int64_t wait = 20 * 1000 * 1000;
+#ifdef TRACY_ON_DEMAND
+        if( GetProfiler().IsConnected() )
+#endif
+        {
+            const auto now = SysSamplerNow();
+            for( auto& v : m_sources )
+            {
+                if( now >= v.next )
+                {
+                    (this->*v.sample)( now );
+                    // Intervals missed while the thread was held up are skipped.
+                    v.next += v.interval;
+                    if( v.next <= now ) v.next = now + v.interval;
+                }
+                wait = std::min( wait, v.next - now );
+            }
+        }
+        if( wait > 0 ) std::this_thread::sleep_for( std::chrono::nanoseconds( wait ) );
+    }
+}
+
+#ifdef TRACY_HAS_SYSTIME
+void SysSampler::SampleSysTime( int64_t )
+{
+    const auto sysTime = m_sysTime.Get();
+    if( sysTime >= 0 )
+    {
+        TracyLfqPrepare( QueueType::SysTimeReport );
+        MemWrite( &item->sysTime.time, Profiler::GetTime() );
+        MemWrite( &item->sysTime.sysTime, sysTime );
+        TracyLfqCommit;
+    }
+}
+#endif
+
+#ifdef TRACY_HAS_SYSPOWER
+void SysSampler::SampleSysPower( int64_t )
+{
+    m_sysPower.Tick();
+}
+#endif
+
+#ifdef __linux__
+void SysSampler::SetupCpuFreq()
+{
+    const auto cpus = sysconf( _SC_NPROCESSORS_CONF );
+    for( long i=0; i<cpus; i++ )
+    {
+        char tmp[PATH_MAX];
+        snprintf( tmp, PATH_MAX, "/sys/devices/system/cpu/cpu%li/cpufreq/scaling_cur_freq", i );
+        const int fd = open( tmp, O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) continue;
+        char name[64];
+        snprintf( name, sizeof( name ), "CPU %li frequency [MHz]", i );
+        auto counter = m_cpuFreq.push_next();
+        counter->fd = fd;
+        counter->value = 0;
+        counter->name = CopyPlotName( name );
+        Profiler::ConfigurePlot( counter->name, PlotFormatType::Number, true, false, 0 );
+    }
+    TracyDebug( "Sampling frequency of %i cores", (int)m_cpuFreq.size() );
+}
+
+void SysSampler::SetupMemBandwidth()
+{
+    static const char* path = "/sys/fs/resctrl/mon_data";
+    DIR* dir = opendir( path );
+    if( !dir ) return;
+    struct dirent* ent;
+    while( ( ent = readdir( dir ) ) )
+    {
+        if( strncmp( ent->d_name, "mon_L3_", 7 ) != 0 ) continue;
+        char tmp[PATH_MAX];
+        snprintf( tmp, PATH_MAX, "%s/%s/mbm_total_bytes", path, ent->d_name );
+        const int fd = open( tmp, O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) continue;
+        uint64_t value;
+        if( !ReadSysCounter( fd, value ) )
+        {
+            close( fd );
+            continue;
+        }
+        char name[64];
+        snprintf( name, sizeof( name ), "L3 %s memory bandwidth [MB/s]", ent->d_name + 7 );
+        auto counter = m_memBandwidth.push_next();
+        counter->fd = fd;
+        counter->value = value;
+        counter->name = CopyPlotName( name );
+        Profiler::ConfigurePlot( counter->name, PlotFormatType::Number, false, true, 0 );
+    }
+    closedir( dir );
+    m_memBandwidthLast = SysSamplerNow();
+}
+
+void SysSampler::SetupCgroupThrottle()
+{
+    // With cgroup v2, the process is in a single cgroup, listed as "0::/path".
+    FILE* f = fopen( "/proc/self/cgroup", "r" );
+    if( !f ) return;
+    char line[PATH_MAX];
+    char cgroup[PATH_MAX];
+    cgroup[0] = '\0';
+    while( fgets( line, sizeof( line ), f ) )
+    {
+        if( strncmp( line, "0::", 3 ) == 0 )
+        {
+            const auto sz = strcspn( line + 3, "\n" );
+            memcpy( cgroup, line + 3, sz );
+            cgroup[sz] = '\0';
+            break;
+        }
+    }
+    fclose( f );
+    if( cgroup[0] != '/' ) return;
+
+    // The cgroup2 hierarchy is usually at /sys/fs/cgroup, or at /sys/fs/cgroup/unified on hybrid
+    // setups.
+    char mount[PATH_MAX];
+    mount[0] = '\0';
+    f = fopen( "/proc/self/mounts", "r" );
+    if( !f ) return;
+    while( fgets( line, sizeof( line ), f ) )
+    {
+        char dev[64];
+        char type[64];
+        if( sscanf( line, "%63s %4095s %63s", dev, mount, type ) == 3 && strcmp( type, "cgroup2" ) == 0 ) break;
+        mount[0] = '\0';
+    }
+    fclose( f );
+    if( mount[0] == '\0' ) return;
+
+    char tmp[PATH_MAX];
+    const auto len = snprintf( tmp, PATH_MAX, "%s%s/cpu.stat", mount, strcmp( cgroup, "/" ) == 0 ? "" : cgroup );
+    if( len < 0 || len >= PATH_MAX ) return;
+    m_throttle.fd = open( tmp, O_RDONLY | O_CLOEXEC );
+    if( m_throttle.fd < 0 ) return;
+    m_throttle.value = 0;
+    m_throttle.name = "cgroup CPU throttled";
+    SampleCgroupThrottle( SysSamplerNow() );
+    Profiler::ConfigurePlot( m_throttle.name, PlotFormatType::Percentage, false, true, 0 );
+    // Long cgroup paths are cut short in the message.
+    TracyDebug( "Sampling CPU throttling of cgroup %.1024s", cgroup );
+}
+
+static const char* ClockDriftPlot = "Clock drift [us]";
+
+void SysSampler::SetupClockSync()
+{
+    const char* ptp = GetEnvVar( "TRACY_CLOCK_SYNC_PTP" );
+    if( ptp )
+    {
+        m_clockFd = open( ptp, O_RDONLY | O_CLOEXEC );
+        if( m_clockFd >= 0 )
+        {
+            // FD_TO_CLOCKID() of the kernel's posix-clock interface.
+            m_clockId = clockid_t( ( ~(unsigned)m_clockFd << 3 ) | 3 );
+            timespec ts;
+            if( clock_gettime( m_clockId, &ts ) != 0 )
+            {
+                close( m_clockFd );
+                m_clockFd = -1;
+                m_clockId = CLOCK_REALTIME;
+            }
+        }
+        if( m_clockFd < 0 ) TracyDebug( "Can't read PTP clock %s, using CLOCK_REALTIME", ptp );
+    }
+    Profiler::ConfigurePlot( ClockDriftPlot, PlotFormatType::Number, false, false, 0 );
+}
+
+static int64_t ReadClock( clockid_t id )
+{
+    timespec ts;
+    clock_gettime( id, &ts );
+    return int64_t( ts.tv_sec ) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+void SysSampler::SampleClockSync( int64_t )
+{
+    // The reading with the shortest window between the two profiler timestamps is the most
+    // precise. The profiler time the reference was read at is taken to be in the middle.
+    int64_t ref = 0, mono = 0, ticks = 0, window = std::numeric_limits<int64_t>::max();
+    for( int i=0; i<5; i++ )
+    {
+        const auto t0 = Profiler::GetTime();
+        const auto r = ReadClock( m_clockId );
+        const auto t1 = Profiler::GetTime();
+        const auto m = ReadClock( CLOCK_MONOTONIC_RAW );
+        if( t1 - t0 < window )
+        {
+            window = t1 - t0;
+            ref = r;
+            mono = m;
+            ticks = t0 + window / 2;
+        }
+    }
+
+    char tmp[128];
+    const auto len = snprintf( tmp, sizeof( tmp ), "Clock sync: %s %" PRIi64 " ns at %" PRIi64 " ticks (\xc2\xb1%" PRIi64 " ticks)",
+        m_clockFd >= 0 ? "ptp" : "realtime", ref, ticks, ( window + 1 ) / 2 );
+    Profiler::LogString( MessageSourceType::Tracy, MessageSeverity::Info, 0, 0, len, tmp );
+
+    if( m_clockFirst == 0 ) m_clockFirst = ref - mono;
+    Profiler::PlotData( ClockDriftPlot, double( ref - mono - m_clockFirst ) / 1000 );
+}
+
+void SysSampler::SampleCpuFreq( int64_t )
+{
+    for( auto& v : m_cpuFreq )
+    {
+        uint64_t khz;
+        if( ReadSysCounter( v.fd, khz ) ) Profiler::PlotData( v.name, int64_t( khz / 1000 ) );
+    }
+}
+
+void SysSampler::SampleMemBandwidth( int64_t now )
+{
+    const auto elapsed = now - m_memBandwidthLast;
+    if( elapsed <= 0 ) return;
+    m_memBandwidthLast = now;
+    for( auto& v : m_memBandwidth )
+    {
+        uint64_t bytes;
+        if( !ReadSysCounter( v.fd, bytes ) ) continue;
+        const auto delta = bytes >= v.value ? bytes - v.value : 0;
+        v.value = bytes;
+        // Bytes per nanosecond are GB/s.
+        Profiler::PlotData( v.name, double( delta ) / elapsed * 1000 );
+    }
+}
+
+void SysSampler::SampleCgroupThrottle( int64_t now )
+{
+    char buf[1024];
+    if( !ReadSysFile( m_throttle.fd, buf, sizeof( buf ) ) ) return;
+    const char* ptr = strstr( buf, "throttled_usec " );
+    if( !ptr ) return;
+    const auto usec = strtoull( ptr + 15, nullptr, 10 );
+    const auto elapsed = now - m_throttleLast;
+    if( m_throttleLast != 0 && elapsed > 0 )
+    {
+        const auto delta = usec >= m_throttle.value ? usec - m_throttle.value : 0;
+        Profiler::PlotData( m_throttle.name, std::min( 100.0, double( delta ) * 1000 * 100 / elapsed ) );
+    }
+    m_throttle.value = usec;
+    m_throttleLast = now;
+}
+#endif
+
+}
+
+#endif
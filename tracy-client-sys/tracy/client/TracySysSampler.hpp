@@ -0,0 +1,108 @@
+#ifndef __TRACYSYSSAMPLER_HPP__
+#define __TRACYSYSSAMPLER_HPP__
+
+#include "TracySysPower.hpp"
+#include "TracySysTime.hpp"
+
+#if defined TRACY_HAS_SYSTIME || defined TRACY_HAS_SYSPOWER
+#  define TRACY_HAS_SYS_SAMPLER
+#endif
+
+#ifdef TRACY_HAS_SYS_SAMPLER
+
+#include <stdint.h>
+#ifdef __linux__
+#  include <time.h>
+#endif
+
+#include "TracyFastVector.hpp"
+
+namespace tracy
+{
+
+// Samples the system metrics on a thread of its own, so that reading them doesn't hold up the
+// profiler thread draining the queues. Each source is read at its own interval, in ms, set by an
+// environment variable (0 turns the source off):
+//  - TRACY_SYSTIME_INTERVAL: the system CPU usage (100 by default).
+//  - TRACY_SYSPOWER_INTERVAL: the RAPL energy counters, on Linux (10 by default).
+//  - TRACY_CPU_FREQ_INTERVAL: the frequency of each core, on Linux (off by default).
+//  - TRACY_MEM_BANDWIDTH_INTERVAL: the memory bandwidth of each L3 domain, from the resctrl
+//    mbm_total_bytes counters, on Linux (off by default).
+//  - TRACY_CGROUP_THROTTLE_INTERVAL: the share of the time the cgroup of the process spent
+//    throttled by its CPU quota, on Linux with cgroup v2 (off by default).
+//  - TRACY_CLOCK_SYNC_INTERVAL: the reading of a reference clock, to line up the captures of
+//    processes on different hosts, on Linux (off by default). The reference is CLOCK_REALTIME, as
+//    kept in sync by NTP or PTP, or the PTP hardware clock at the path given in
+//    TRACY_CLOCK_SYNC_PTP, e.g. /dev/ptp0.
+// The last four are sent as plots. On Linux, the files are kept open and read with pread.
+//
+// Each clock sync reading is also sent as a message with the reference time in ns along with the
+// profiler time it was taken at, as "Clock sync: <ptp|realtime> <time> ns at <ticks> ticks
+// (±<error> ticks)", the first field naming the reference clock. Two of them give both the offset
+// and the rate of the profiler clock to the reference.
+// The plot shows how far the monotonic clock of the host drifted from the reference since the
+// first reading.
+class SysSampler
+{
+    typedef void (SysSampler::*SampleFn)( int64_t now );
+
+    struct Source
+    {
+        SampleFn sample;
+        int64_t interval;   // ns
+        int64_t next;
+    };
+
+    struct Counter
+    {
+        int fd;
+        uint64_t value;
+        const char* name;
+    };
+
+public:
+    SysSampler();
+    ~SysSampler();
+
+    // Samples the sources until the profiler shuts down.
+    void Run();
+
+private:
+    void AddSource( SampleFn sample, int interval );
+
+#ifdef TRACY_HAS_SYSTIME
+    void SampleSysTime( int64_t now );
+    SysTime m_sysTime;
+#endif
+#ifdef TRACY_HAS_SYSPOWER
+    void SampleSysPower( int64_t now );
+    SysPower m_sysPower;
+#endif
+#ifdef __linux__
+    void SetupCpuFreq();
+    void SetupMemBandwidth();
+    void SetupCgroupThrottle();
+    void SampleCpuFreq( int64_t now );
+    void SampleMemBandwidth( int64_t now );
+    void SampleCgroupThrottle( int64_t now );
+    void SetupClockSync();
+    void SampleClockSync( int64_t now );
+
+    FastVector<Counter> m_cpuFreq;
+    FastVector<Counter> m_memBandwidth;
+    int64_t m_memBandwidthLast;
+    Counter m_throttle;
+    int64_t m_throttleLast;
+    int m_clockFd;
+    clockid_t m_clockId;
+    int64_t m_clockFirst;   // reference - monotonic, ns
+#endif
+
+    FastVector<Source> m_sources;
+};
+
+}
+
+#endif
+
+#endif
@@ -6,8 +6,10 @@
 #    include <windows.h>
 #    include "../common/TracyWinFamily.hpp"
 #  elif defined __linux__
-#    include <stdio.h>
+#    include <fcntl.h>
 #    include <inttypes.h>
+#    include <stdio.h>
+#    include <unistd.h>
 #  elif defined __APPLE__
 #    include <mach/mach_host.h>
 #    include <mach/host_info.h>
@@ -55,16 +57,17 @@ void SysTime::ReadTimes()
 
 void SysTime::ReadTimes()
 {
-    uint64_t user, nice, system;
-    FILE* f = fopen( "/proc/stat", "r" );
-    if( f )
+    if( fd < 0 ) return;
+    // Only the first line, with the totals, is needed.
+    char buf[256];
+    const auto sz = pread( fd, buf, sizeof( buf ) - 1, 0 );
+    if( sz <= 0 ) return;
+    buf[sz] = '\0';
+    uint64_t user, nice, system, idleTime;
+    if( sscanf( buf, "cpu %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64, &user, &nice, &system, &idleTime ) == 4 )
     {
-        int read = fscanf( f, "cpu %" PRIu64 " %" PRIu64 " %" PRIu64" %" PRIu64, &user, &nice, &system, &idle );
-        fclose( f );
-        if (read == 4)
-        {
-            used = user + nice + system;
-        }
+        used = user + nice + system;
+        idle = idleTime;
     }
 }
 
@@ -93,10 +96,22 @@ void SysTime::ReadTimes()
 #endif
 
 SysTime::SysTime()
+    : idle( 0 )
+    , used( 0 )
 {
+#if defined __linux__
+    fd = open( "/proc/stat", O_RDONLY | O_CLOEXEC );
+#endif
     ReadTimes();
 }
 
+SysTime::~SysTime()
+{
+#if defined __linux__
+    if( fd >= 0 ) close( fd );
+#endif
+}
+
 float SysTime::Get()
 {
     const auto oldUsed = used;
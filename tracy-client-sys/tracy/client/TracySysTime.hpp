@@ -22,12 +22,16 @@ class SysTime
 {
 public:
     SysTime();
+    ~SysTime();
     float Get();
 
     void ReadTimes();
 
 private:
     uint64_t idle, used;
+#ifdef __linux__
+    int fd;     // /proc/stat, kept open so that each read is a single pread
+#endif
 };
 
 }
@@ -376,6 +376,7 @@ void SysTraceGetExternalName( uint64_t thread, const char*& threadName, const ch
 
 #    include <sys/types.h>
 #    include <sys/stat.h>
+#    include <dirent.h>
 #    include <sys/wait.h>
 #    include <fcntl.h>
 #    include <inttypes.h>
@@ -393,13 +394,20 @@ void SysTraceGetExternalName( uint64_t thread, const char*& threadName, const ch
 #    include <sys/mman.h>
 #    include <sys/ioctl.h>
 #    include <sys/syscall.h>
+#    include <sys/epoll.h>
+#    include <pthread.h>
+#    include <sched.h>
+#    include <condition_variable>
+#    include <mutex>
 
 #    if defined __i386 || defined __x86_64__
 #      include "TracyCpuid.hpp"
 #    endif
 
+#    include "TracyDwarfUnwind.hpp"
 #    include "TracyProfiler.hpp"
 #    include "TracyRingBuffer.hpp"
+#    include "TracySysTraceBpf.hpp"
 #    include "TracyThread.hpp"
 
 namespace tracy
@@ -409,6 +417,25 @@ static std::atomic<bool> traceActive { false };
 static int s_numCpus = 0;
 static int s_numBuffers = 0;
 static int s_ctxBufferIdx = 0;
+static int s_numReaders = 1;
+static uint32_t s_ringSize = 64*1024;
+static uint32_t s_ctxRingSize = 256*1024;
+static uint32_t s_wakeupWatermark = 0;
+static bool s_pollRings = false;
+#ifdef TRACY_HAS_BPF_OFFCPU
+static bool s_bpfOffCpuActive = false;
+#endif
+#ifdef TRACY_HAS_DWARF_UNWIND
+static uint32_t s_stackSize = 0;
+static int s_numUnwinders = 2;
+#endif
+
+// The adaptive sampling frequency controller, see AdjustSamplingFrequency().
+static uint64_t s_samplingBudget = 0;
+static int s_samplingMaxHz = 0;
+static std::atomic<int> s_samplingHz { 0 };
+static std::atomic<uint64_t> s_callstackSamples { 0 };
+static uint64_t* s_lastSampleTime = nullptr;
 
 static RingBuffer* s_ring = nullptr;
 
@@ -564,6 +591,30 @@ static char* GetTraceFsPath()
     return ret;
 }
 
+// Ring buffer sizes are rounded up to a power of two number of pages.
+static uint32_t GetRingSize( const char* name, uint32_t size )
+{
+    const char* env = GetEnvVar( name );
+    if( env )
+    {
+        const auto val = strtoull( env, nullptr, 10 );
+        if( val != 0 ) size = uint32_t( val < ( 1u << 30 ) ? val : ( 1u << 30 ) );
+    }
+    const auto pageSize = uint32_t( getpagesize() );
+    uint32_t ret = pageSize;
+    while( ret < size ) ret *= 2;
+    return ret;
+}
+
+// When the rings are polled, have the kernel signal a ring once it is filled past the watermark.
+static void SetRingWakeup( perf_event_attr& pe, uint32_t ringSize )
+{
+    if( !s_pollRings ) return;
+    const auto watermark = s_wakeupWatermark != 0 ? s_wakeupWatermark : ringSize / 4;
+    pe.watermark = 1;
+    pe.wakeup_watermark = watermark < ringSize / 2 ? watermark : ringSize / 2;
+}
+
 bool SysTraceStart( int64_t& samplingPeriod )
 {
 #ifndef CLOCK_MONOTONIC_RAW
@@ -578,19 +629,26 @@ bool SysTraceStart( int64_t& samplingPeriod )
     TracyDebug( "perf_event_paranoid: %i", paranoidLevel );
 #endif
 
+    int switchId = -1, wakingId = -1, vsyncId = -1;
     auto traceFsPath = GetTraceFsPath();
+#ifdef TRACY_HAS_BPF_OFFCPU
+    // The BPF programs attach to raw tracepoints, which don't need tracefs.
+    if( traceFsPath )
+#else
     if( !traceFsPath ) return false;
-    TracyDebug( "tracefs path: %s", traceFsPath );
+#endif
+    {
+        TracyDebug( "tracefs path: %s", traceFsPath );
 
-    int switchId = -1, wakingId = -1, vsyncId = -1;
-    const auto switchIdStr = ReadFile( traceFsPath, "/events/sched/sched_switch/id" );
-    if( switchIdStr ) switchId = atoi( switchIdStr );
-    const auto wakingIdStr = ReadFile( traceFsPath, "/events/sched/sched_waking/id" );
-    if( wakingIdStr ) wakingId = atoi( wakingIdStr );
-    const auto vsyncIdStr = ReadFile( traceFsPath, "/events/drm/drm_vblank_event/id" );
-    if( vsyncIdStr ) vsyncId = atoi( vsyncIdStr );
+        const auto switchIdStr = ReadFile( traceFsPath, "/events/sched/sched_switch/id" );
+        if( switchIdStr ) switchId = atoi( switchIdStr );
+        const auto wakingIdStr = ReadFile( traceFsPath, "/events/sched/sched_waking/id" );
+        if( wakingIdStr ) wakingId = atoi( wakingIdStr );
+        const auto vsyncIdStr = ReadFile( traceFsPath, "/events/drm/drm_vblank_event/id" );
+        if( vsyncIdStr ) vsyncId = atoi( vsyncIdStr );
 
-    tracy_free( traceFsPath );
+        tracy_free( traceFsPath );
+    }
 
     TracyDebug( "sched_switch id: %i", switchId );
     TracyDebug( "sched_waking id: %i", wakingId );
@@ -643,6 +701,45 @@ bool SysTraceStart( int64_t& samplingPeriod )
 
     s_numCpus = (int)std::thread::hardware_concurrency();
 
+    // One thread reading the sample rings of every 32 CPUs, unless set otherwise.
+    s_numReaders = ( s_numCpus + 31 ) / 32;
+    const char* numReadersEnv = GetEnvVar( "TRACY_SAMPLING_READERS" );
+    if( numReadersEnv ) s_numReaders = atoi( numReadersEnv );
+    if( s_numReaders < 1 ) s_numReaders = 1;
+    if( s_numReaders > s_numCpus ) s_numReaders = s_numCpus;
+    TracyDebug( "Sample ring readers: %i", s_numReaders );
+
+    // Ring buffer sizes in bytes, and whether the readers should wait for the rings to fill up
+    // instead of checking them every millisecond.
+#ifdef TRACY_HAS_DWARF_UNWIND
+    // Bytes of the user stack copied with every sample, 0 to use the frame pointer call chains of
+    // the kernel instead, and the number of threads unwinding the copies.
+    const char* stackSizeEnv = GetEnvVar( "TRACY_SAMPLING_STACK_SIZE" );
+    const auto stackSize = stackSizeEnv ? strtoull( stackSizeEnv, nullptr, 10 ) : 8192;
+    s_stackSize = uint32_t( ( stackSize < 65528 ? stackSize : 65528 ) & ~7ull );
+    const char* numUnwindersEnv = GetEnvVar( "TRACY_SAMPLING_UNWINDERS" );
+    if( numUnwindersEnv ) s_numUnwinders = atoi( numUnwindersEnv );
+    if( s_numUnwinders < 1 ) s_numUnwinders = 1;
+    if( s_numUnwinders > s_numCpus ) s_numUnwinders = s_numCpus;
+    TracyDebug( "Sampled user stack size: %u, unwinders: %i", s_stackSize, s_numUnwinders );
+    s_ringSize = GetRingSize( "TRACY_SAMPLING_RING_SIZE", s_stackSize != 0 ? 256*1024 : 64*1024 );
+#else
+    s_ringSize = GetRingSize( "TRACY_SAMPLING_RING_SIZE", 64*1024 );
+#endif
+    // Call stack samples per second, across all CPUs, the sampling frequency is adjusted to at
+    // run time, 0 to keep sampling at TRACY_SAMPLING_HZ.
+    const char* budgetEnv = GetEnvVar( "TRACY_SAMPLING_BUDGET" );
+    s_samplingBudget = budgetEnv ? strtoull( budgetEnv, nullptr, 10 ) : 0;
+    s_samplingMaxHz = GetSamplingFrequency();
+    s_samplingHz.store( s_samplingMaxHz, std::memory_order_relaxed );
+    if( s_samplingBudget != 0 ) TracyDebug( "Sampling budget: %" PRIu64 " samples/s", s_samplingBudget );
+    s_ctxRingSize = GetRingSize( "TRACY_CONTEXT_SWITCH_RING_SIZE", 256*1024 );
+    const char* pollEnv = GetEnvVar( "TRACY_SAMPLING_POLL" );
+    s_pollRings = pollEnv && pollEnv[0] == '1';
+    const char* watermarkEnv = GetEnvVar( "TRACY_SAMPLING_WAKEUP_WATERMARK" );
+    s_wakeupWatermark = watermarkEnv ? uint32_t( strtoul( watermarkEnv, nullptr, 10 ) ) : 0;
+    TracyDebug( "Ring sizes: %u, %u (context switches), %s", s_ringSize, s_ctxRingSize, s_pollRings ? "polled" : "checked every 1 ms" );
+
     const auto maxNumBuffers = s_numCpus * (
         1 +     // software sampling
         2 +     // CPU cycles + instructions retired
@@ -653,6 +750,11 @@ bool SysTraceStart( int64_t& samplingPeriod )
     );
     s_ring = (RingBuffer*)tracy_malloc( sizeof( RingBuffer ) * maxNumBuffers );
     s_numBuffers = 0;
+    if( s_samplingBudget != 0 )
+    {
+        s_lastSampleTime = (uint64_t*)tracy_malloc( sizeof( uint64_t ) * maxNumBuffers );
+        memset( s_lastSampleTime, 0, sizeof( uint64_t ) * maxNumBuffers );
+    }
 
     // software sampling
     perf_event_attr pe = {};
@@ -669,11 +771,43 @@ bool SysTraceStart( int64_t& samplingPeriod )
     pe.inherit = 1;
     pe.use_clockid = 1;
     pe.clockid = CLOCK_MONOTONIC_RAW;
+    SetRingWakeup( pe, s_ringSize );
 
     if( !noSoftwareSampling )
     {
         TracyDebug( "Setup software sampling" );
         ProbePreciseIp( pe, currentPid );
+#ifdef TRACY_HAS_DWARF_UNWIND
+        if( s_stackSize != 0 )
+        {
+            // The kernel still provides its own part of the call chain, the user part is unwound
+            // from the copy of the stack.
+            pe.sample_type |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+            pe.sample_regs_user = DwarfUnwindRegMask();
+            pe.sample_stack_user = s_stackSize;
+            pe.exclude_callchain_user = 1;
+            int fd = perf_event_open( &pe, currentPid, 0, -1, PERF_FLAG_FD_CLOEXEC );
+            if( fd == -1 )
+            {
+                pe.exclude_kernel = 1;
+                fd = perf_event_open( &pe, currentPid, 0, -1, PERF_FLAG_FD_CLOEXEC );
+                pe.exclude_kernel = 0;
+            }
+            if( fd == -1 )
+            {
+                TracyDebug( "  User stack sampling is not available, using frame pointer call chains" );
+                pe.sample_type &= ~uint64_t( PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER );
+                pe.sample_regs_user = 0;
+                pe.sample_stack_user = 0;
+                pe.exclude_callchain_user = 0;
+                s_stackSize = 0;
+            }
+            else
+            {
+                close( fd );
+            }
+        }
+#endif
         for( int i=0; i<s_numCpus; i++ )
         {
             int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
@@ -689,7 +823,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
                 }
                 TracyDebug( "  No access to kernel samples" );
             }
-            new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventCallstack );
+            new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventCallstack, i );
             if( s_ring[s_numBuffers].IsValid() )
             {
                 s_numBuffers++;
@@ -712,6 +846,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
     pe.inherit = 1;
     pe.use_clockid = 1;
     pe.clockid = CLOCK_MONOTONIC_RAW;
+    SetRingWakeup( pe, s_ringSize );
 
     if( !noRetirement )
     {
@@ -722,7 +857,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventCpuCycles );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventCpuCycles, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -737,7 +872,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventInstructionsRetired );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventInstructionsRetired, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -762,7 +897,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventCacheReference );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventCacheReference, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -777,7 +912,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventCacheMiss );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventCacheMiss, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -797,7 +932,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventBranchRetired );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventBranchRetired, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -812,7 +947,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, currentPid, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventBranchMiss );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventBranchMiss, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -836,6 +971,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
         pe.config = vsyncId;
         pe.use_clockid = 1;
         pe.clockid = CLOCK_MONOTONIC_RAW;
+        SetRingWakeup( pe, s_ringSize );
 
         TracyDebug( "Setup vsync capture" );
         for( int i=0; i<s_numCpus; i++ )
@@ -843,7 +979,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, -1, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventVsync, i );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventVsync, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -853,6 +989,15 @@ bool SysTraceStart( int64_t& samplingPeriod )
         }
     }
 
+#ifdef TRACY_HAS_BPF_OFFCPU
+    // Off-CPU time aggregated in the kernel replaces the context switch and wake up records.
+    if( !noCtxSwitch )
+    {
+        s_bpfOffCpuActive = BpfOffCpuStart( currentPid );
+        if( s_bpfOffCpuActive ) switchId = -1;
+    }
+#endif
+
     // context switches
     if( !noCtxSwitch && switchId != -1 )
     {
@@ -869,6 +1014,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
         pe.config = switchId;
         pe.use_clockid = 1;
         pe.clockid = CLOCK_MONOTONIC_RAW;
+        SetRingWakeup( pe, s_ctxRingSize );
 
         TracyDebug( "Setup context switch capture" );
         for( int i=0; i<s_numCpus; i++ )
@@ -876,7 +1022,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             const int fd = perf_event_open( &pe, -1, i, -1, PERF_FLAG_FD_CLOEXEC );
             if( fd != -1 )
             {
-                new( s_ring+s_numBuffers ) RingBuffer( 256*1024, fd, EventContextSwitch, i );
+                new( s_ring+s_numBuffers ) RingBuffer( s_ctxRingSize, fd, EventContextSwitch, i );
                 if( s_ring[s_numBuffers].IsValid() )
                 {
                     s_numBuffers++;
@@ -900,6 +1046,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
             pe.read_format = 0;
             pe.use_clockid = 1;
             pe.clockid = CLOCK_MONOTONIC_RAW;
+            SetRingWakeup( pe, s_ringSize );
 
             TracyDebug( "Setup waking up capture" );
             for( int i=0; i<s_numCpus; i++ )
@@ -907,7 +1054,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
                 const int fd = perf_event_open( &pe, -1, i, -1, PERF_FLAG_FD_CLOEXEC );
                 if( fd != -1 )
                 {
-                    new( s_ring+s_numBuffers ) RingBuffer( 64*1024, fd, EventWaking, i );
+                    new( s_ring+s_numBuffers ) RingBuffer( s_ringSize, fd, EventWaking, i );
                     if( s_ring[s_numBuffers].IsValid() )
                     {
                         s_numBuffers++;
@@ -929,10 +1076,11 @@ void SysTraceStop()
     traceActive.store( false, std::memory_order_relaxed );
 }
 
-static uint64_t* GetCallstackBlock( uint64_t cnt, RingBuffer& ring, uint64_t offset )
+// Removes the context markers and the bogus addresses from the call chain in trace[1..cnt], and
+// returns how many addresses are left.
+static uint64_t FilterCallchain( uint64_t* trace, uint64_t cnt )
 {
-    auto trace = (uint64_t*)tracy_malloc_fast( ( 1 + cnt ) * sizeof( uint64_t ) );
-    ring.Read( trace+1, offset, sizeof( uint64_t ) * cnt );
+    if( cnt == 0 ) return 0;
 
 #if defined __x86_64__ || defined _M_X64
     // remove non-canonical pointers
@@ -961,157 +1109,561 @@ static uint64_t* GetCallstackBlock( uint64_t cnt, RingBuffer& ring, uint64_t off
             cnt--;
         }
     }
+    return cnt;
+}
 
+static uint64_t* GetCallstackBlock( uint64_t cnt, RingBuffer& ring, uint64_t offset )
+{
+    auto trace = (uint64_t*)tracy_malloc_fast( ( 1 + cnt ) * sizeof( uint64_t ) );
+    ring.Read( trace+1, offset, sizeof( uint64_t ) * cnt );
+    cnt = FilterCallchain( trace, cnt );
     memcpy( trace, &cnt, sizeof( uint64_t ) );
     return trace;
 }
 
-void SysTraceWorker( void* ptr )
+#ifdef TRACY_HAS_DWARF_UNWIND
+// A sample whose user stack is waiting to be unwound. Followed by the kernel call chain and the
+// copy of the stack.
+struct StackSample
+{
+    int64_t time;
+    uint32_t tid;
+    uint32_t kernelCnt;
+    uint64_t stackSize;
+    uint64_t regs[DwarfUnwindRegCount];
+};
+
+// Hands the samples from the ring readers over to the unwinder threads. Samples which don't fit
+// are dropped and counted as lost, rather than holding up the readers.
+class StackSampleQueue
+{
+public:
+    enum { Size = 4096 };
+
+    ~StackSampleQueue()
+    {
+        while( m_head != m_tail ) tracy_free( m_samples[m_head++ % Size] );
+    }
+
+    bool Push( StackSample* sample )
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        if( m_tail - m_head == Size ) return false;
+        m_samples[m_tail++ % Size] = sample;
+        m_cv.notify_one();
+        return true;
+    }
+
+    // Returns nullptr once the queue is stopped.
+    StackSample* Pop()
+    {
+        std::unique_lock<std::mutex> lock( m_lock );
+        m_cv.wait( lock, [this] { return m_head != m_tail || m_stop; } );
+        if( m_stop ) return nullptr;
+        return m_samples[m_head++ % Size];
+    }
+
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        m_stop = true;
+        m_cv.notify_all();
+    }
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    StackSample* m_samples[Size];
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+    bool m_stop = false;
+};
+
+// Created by SysTraceWorker(), as the profiler, and with it the sampling, may be started before
+// the static objects of this file are constructed.
+static StackSampleQueue* s_stackSamples = nullptr;
+
+static void QueueStackSample( RingBuffer& ring, uint64_t offset, uint32_t tid, uint64_t t0, uint64_t cnt )
+{
+    // Layout, after the kernel call chain:
+    //   u64 abi
+    //   u64 regs[DwarfUnwindRegCount]   // if abi != PERF_SAMPLE_REGS_ABI_NONE
+    //   u64 size
+    //   u8  data[size]
+    //   u64 dyn_size                    // if size != 0
+    const auto chainOffset = offset;
+    offset += sizeof( uint64_t ) * cnt;
+    uint64_t abi;
+    ring.Read( &abi, offset, sizeof( uint64_t ) );
+    offset += sizeof( uint64_t );
+
+    uint64_t regs[DwarfUnwindRegCount] = {};
+    uint64_t stackSize = 0;
+    if( abi != PERF_SAMPLE_REGS_ABI_NONE )
+    {
+        ring.Read( regs, offset, sizeof( regs ) );
+        offset += sizeof( regs );
+        uint64_t size;
+        ring.Read( &size, offset, sizeof( uint64_t ) );
+        offset += sizeof( uint64_t );
+        if( size != 0 )
+        {
+            ring.Read( &stackSize, offset + size, sizeof( uint64_t ) );
+            if( stackSize > size ) stackSize = size;
+        }
+    }
+    else if( cnt == 0 )
+    {
+        return;
+    }
+
+    auto sample = (StackSample*)tracy_malloc( sizeof( StackSample ) + sizeof( uint64_t ) * cnt + stackSize );
+    sample->time = int64_t( t0 );
+    sample->tid = tid;
+    sample->kernelCnt = uint32_t( cnt );
+    sample->stackSize = stackSize;
+    memcpy( sample->regs, regs, sizeof( regs ) );
+    auto chain = (uint64_t*)( sample + 1 );
+    ring.Read( chain, chainOffset, sizeof( uint64_t ) * cnt );
+    ring.Read( chain + cnt, offset, stackSize );
+
+    if( !s_stackSamples->Push( sample ) )
+    {
+        tracy_free( sample );
+        GetProfiler().CountLostSamples( 1 );
+    }
+}
+
+static void SysTraceUnwinder( void* )
 {
     ThreadExitHandler threadExitHandler;
-    SetThreadName( "Tracy Sampling" );
+    SetThreadName( "Tracy Unwinder" );
     InitRpmalloc();
-    sched_param sp = { 95 };
-    if( pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp ) != 0 ) TracyDebug( "Failed to increase SysTraceWorker thread priority!" );
-    auto ctxBufferIdx = s_ctxBufferIdx;
-    auto ringArray = s_ring;
-    auto numBuffers = s_numBuffers;
-    for( int i=0; i<numBuffers; i++ ) ringArray[i].Enable();
-    for(;;)
+    auto unwinder = (DwarfUnwinder*)tracy_malloc( sizeof( DwarfUnwinder ) );
+    new( unwinder ) DwarfUnwinder();
+
+    // The same bound as sample_max_stack of the kernel call chains.
+    constexpr uint32_t MaxFrames = 127;
+    uint64_t trace[1 + MaxFrames + 1];
+    while( auto sample = s_stackSamples->Pop() )
     {
-#ifdef TRACY_ON_DEMAND
-        if( !GetProfiler().IsConnected() )
+        auto chain = (const uint64_t*)( sample + 1 );
+        uint64_t cnt = sample->kernelCnt < MaxFrames ? sample->kernelCnt : MaxFrames;
+        memcpy( trace+1, chain, sizeof( uint64_t ) * cnt );
+        cnt = FilterCallchain( trace, cnt );
+        if( sample->regs[DwarfUnwindRegPc] != 0 )
         {
-            if( !traceActive.load( std::memory_order_relaxed ) ) break;
-            for( int i=0; i<numBuffers; i++ )
-            {
-                auto& ring = ringArray[i];
-                const auto head = ring.LoadHead();
-                const auto tail = ring.GetTail();
-                if( head != tail )
-                {
-                    const auto end = head - tail;
-                    ring.Advance( end );
-                }
-            }
-            if( !traceActive.load( std::memory_order_relaxed ) ) break;
-            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
-            continue;
+            cnt += unwinder->Unwind( sample->regs, (const char*)( chain + sample->kernelCnt ), sample->stackSize, trace + 1 + cnt, uint32_t( MaxFrames - cnt ) );
         }
+        if( cnt > 0 )
+        {
+            auto block = (uint64_t*)tracy_malloc_fast( ( 1 + cnt ) * sizeof( uint64_t ) );
+            memcpy( block, &cnt, sizeof( uint64_t ) );
+            memcpy( block+1, trace+1, sizeof( uint64_t ) * cnt );
+
+            TracyLfqPrepare( QueueType::CallstackSample );
+            MemWrite( &item->callstackSampleFat.time, sample->time );
+            MemWrite( &item->callstackSampleFat.thread, sample->tid );
+            MemWrite( &item->callstackSampleFat.ptr, (uint64_t)block );
+            TracyLfqCommit;
+        }
+        tracy_free( sample );
+    }
+
+    unwinder->~DwarfUnwinder();
+    tracy_free( unwinder );
+}
 #endif
 
-        bool hadData = false;
-        for( int i=0; i<ctxBufferIdx; i++ )
+// The kernel puts a PERF_RECORD_LOST record in place of the samples it had to drop because the
+// ring buffer was full.
+static uint64_t CountLostSamples( RingBuffer& ring, uint64_t pos )
+{
+    // Layout:
+    //   u64 id
+    //   u64 lost
+    uint64_t lost;
+    ring.Read( &lost, pos + sizeof( perf_event_header ) + sizeof( uint64_t ), sizeof( uint64_t ) );
+    GetProfiler().CountLostSamples( lost );
+    return lost;
+}
+
+// Reads the sample ring buffers of the CPUs in the [cpuBegin, cpuEnd) range. The samples don't
+// need to be ordered, so the rings can be split between several reader threads.
+static bool ReadSampleRings( int cpuBegin, int cpuEnd )
+{
+    bool hadData = false;
+    for( int i=0; i<s_ctxBufferIdx; i++ )
+    {
+        if( !traceActive.load( std::memory_order_relaxed ) ) break;
+        auto& ring = s_ring[i];
+        const auto cpu = ring.GetCpu();
+        if( cpu < cpuBegin || cpu >= cpuEnd ) continue;
+        const auto head = ring.LoadHead();
+        const auto tail = ring.GetTail();
+        if( head == tail ) continue;
+        assert( head > tail );
+        hadData = true;
+
+        const auto id = ring.GetId();
+        assert( id != EventContextSwitch );
+        const auto end = head - tail;
+        uint64_t pos = 0;
+        if( id == EventCallstack )
         {
-            if( !traceActive.load( std::memory_order_relaxed ) ) break;
-            auto& ring = ringArray[i];
-            const auto head = ring.LoadHead();
-            const auto tail = ring.GetTail();
-            if( head == tail ) continue;
-            assert( head > tail );
-            hadData = true;
-
-            const auto id = ring.GetId();
-            assert( id != EventContextSwitch );
-            const auto end = head - tail;
-            uint64_t pos = 0;
-            if( id == EventCallstack )
+            // Samples closer together than the period of the adjusted frequency come from the
+            // threads which still sample at the frequency they inherited, and are dropped.
+            uint64_t samples = 0;
+            uint64_t minDelta = 0;
+            if( s_samplingBudget != 0 ) minDelta = 1000000000ull / s_samplingHz.load( std::memory_order_relaxed ) * 7 / 8;
+            while( pos < end )
             {
-                while( pos < end )
+                perf_event_header hdr;
+                ring.Read( &hdr, pos, sizeof( perf_event_header ) );
+                if( hdr.type == PERF_RECORD_SAMPLE )
                 {
-                    perf_event_header hdr;
-                    ring.Read( &hdr, pos, sizeof( perf_event_header ) );
-                    if( hdr.type == PERF_RECORD_SAMPLE )
+                    auto offset = pos + sizeof( perf_event_header );
+
+                    // Layout:
+                    //   u32 pid, tid
+                    //   u64 time
+                    //   u64 cnt
+                    //   u64 ip[cnt]
+
+                    uint32_t tid;
+                    uint64_t t0;
+                    uint64_t cnt;
+
+                    offset += sizeof( uint32_t );
+                    ring.Read( &tid, offset, sizeof( uint32_t ) );
+                    offset += sizeof( uint32_t );
+                    ring.Read( &t0, offset, sizeof( uint64_t ) );
+                    offset += sizeof( uint64_t );
+                    ring.Read( &cnt, offset, sizeof( uint64_t ) );
+                    offset += sizeof( uint64_t );
+
+                    if( minDelta != 0 )
                     {
-                        auto offset = pos + sizeof( perf_event_header );
-
-                        // Layout:
-                        //   u32 pid, tid
-                        //   u64 time
-                        //   u64 cnt
-                        //   u64 ip[cnt]
-
-                        uint32_t tid;
-                        uint64_t t0;
-                        uint64_t cnt;
-
-                        offset += sizeof( uint32_t );
-                        ring.Read( &tid, offset, sizeof( uint32_t ) );
-                        offset += sizeof( uint32_t );
-                        ring.Read( &t0, offset, sizeof( uint64_t ) );
-                        offset += sizeof( uint64_t );
-                        ring.Read( &cnt, offset, sizeof( uint64_t ) );
-                        offset += sizeof( uint64_t );
-
-                        if( cnt > 0 )
+                        if( t0 - s_lastSampleTime[i] < minDelta )
                         {
-                            auto trace = GetCallstackBlock( cnt, ring, offset );
-
-                            TracyLfqPrepare( QueueType::CallstackSample );
-                            MemWrite( &item->callstackSampleFat.time, t0 );
-                            MemWrite( &item->callstackSampleFat.thread, tid );
-                            MemWrite( &item->callstackSampleFat.ptr, (uint64_t)trace );
-                            TracyLfqCommit;
+                            pos += hdr.size;
+                            continue;
                         }
+                        s_lastSampleTime[i] = t0;
+                    }
+                    samples++;
+
+#ifdef TRACY_HAS_DWARF_UNWIND
+                    if( s_stackSize != 0 )
+                    {
+                        QueueStackSample( ring, offset, tid, t0, cnt );
+                    }
+                    else
+#endif
+                    if( cnt > 0 )
+                    {
+                        auto trace = GetCallstackBlock( cnt, ring, offset );
+
+                        TracyLfqPrepare( QueueType::CallstackSample );
+                        MemWrite( &item->callstackSampleFat.time, t0 );
+                        MemWrite( &item->callstackSampleFat.thread, tid );
+                        MemWrite( &item->callstackSampleFat.ptr, (uint64_t)trace );
+                        TracyLfqCommit;
                     }
-                    pos += hdr.size;
                 }
+                else if( hdr.type == PERF_RECORD_LOST )
+                {
+                    // The dropped samples were taken all the same, and count against the budget.
+                    samples += CountLostSamples( ring, pos );
+                }
+                pos += hdr.size;
             }
-            else
+            if( s_samplingBudget != 0 ) s_callstackSamples.fetch_add( samples, std::memory_order_relaxed );
+        }
+        else
+        {
+            while( pos < end )
             {
-                while( pos < end )
+                perf_event_header hdr;
+                ring.Read( &hdr, pos, sizeof( perf_event_header ) );
+                if( hdr.type == PERF_RECORD_SAMPLE )
                 {
-                    perf_event_header hdr;
-                    ring.Read( &hdr, pos, sizeof( perf_event_header ) );
-                    if( hdr.type == PERF_RECORD_SAMPLE )
-                    {
-                        auto offset = pos + sizeof( perf_event_header );
+                    auto offset = pos + sizeof( perf_event_header );
 
-                        // Layout:
-                        //   u64 ip
-                        //   u64 time
+                    // Layout:
+                    //   u64 ip
+                    //   u64 time
 
-                        uint64_t ip, t0;
-                        ring.Read( &ip, offset, sizeof( uint64_t ) );
-                        offset += sizeof( uint64_t );
-                        ring.Read( &t0, offset, sizeof( uint64_t ) );
-
-                        QueueType type;
-                        switch( id )
-                        {
-                        case EventCpuCycles:
-                            type = QueueType::HwSampleCpuCycle;
-                            break;
-                        case EventInstructionsRetired:
-                            type = QueueType::HwSampleInstructionRetired;
-                            break;
-                        case EventCacheReference:
-                            type = QueueType::HwSampleCacheReference;
-                            break;
-                        case EventCacheMiss:
-                            type = QueueType::HwSampleCacheMiss;
-                            break;
-                        case EventBranchRetired:
-                            type = QueueType::HwSampleBranchRetired;
-                            break;
-                        case EventBranchMiss:
-                            type = QueueType::HwSampleBranchMiss;
-                            break;
-                        default:
-                            abort();
-                        }
+                    uint64_t ip, t0;
+                    ring.Read( &ip, offset, sizeof( uint64_t ) );
+                    offset += sizeof( uint64_t );
+                    ring.Read( &t0, offset, sizeof( uint64_t ) );
 
-                        TracyLfqPrepare( type );
-                        MemWrite( &item->hwSample.ip, ip );
-                        MemWrite( &item->hwSample.time, t0 );
-                        TracyLfqCommit;
+                    QueueType type;
+                    switch( id )
+                    {
+                    case EventCpuCycles:
+                        type = QueueType::HwSampleCpuCycle;
+                        break;
+                    case EventInstructionsRetired:
+                        type = QueueType::HwSampleInstructionRetired;
+                        break;
+                    case EventCacheReference:
+                        type = QueueType::HwSampleCacheReference;
+                        break;
+                    case EventCacheMiss:
+                        type = QueueType::HwSampleCacheMiss;
+                        break;
+                    case EventBranchRetired:
+                        type = QueueType::HwSampleBranchRetired;
+                        break;
+                    case EventBranchMiss:
+                        type = QueueType::HwSampleBranchMiss;
+                        break;
+                    default:
+                        abort();
                     }
-                    pos += hdr.size;
+
+                    TracyLfqPrepare( type );
+                    MemWrite( &item->hwSample.ip, ip );
+                    MemWrite( &item->hwSample.time, t0 );
+                    TracyLfqCommit;
                 }
+                else if( hdr.type == PERF_RECORD_LOST )
+                {
+                    CountLostSamples( ring, pos );
+                }
+                pos += hdr.size;
             }
-            assert( pos == end );
+        }
+        assert( pos == end );
+        ring.Advance( end );
+    }
+    return hadData;
+}
+
+static void SkipRings( int begin, int end, int cpuBegin, int cpuEnd )
+{
+    for( int i=begin; i<end; i++ )
+    {
+        auto& ring = s_ring[i];
+        const auto cpu = ring.GetCpu();
+        if( cpu < cpuBegin || cpu >= cpuEnd ) continue;
+        const auto head = ring.LoadHead();
+        const auto tail = ring.GetTail();
+        if( head != tail )
+        {
+            const auto end = head - tail;
             ring.Advance( end );
         }
+    }
+}
+
+// Adds the rings in the [begin, end) range of the CPUs in the [cpuBegin, cpuEnd) range to an epoll
+// instance, which is created if needed.
+static int AddRingsToPoll( int epoll, int begin, int end, int cpuBegin, int cpuEnd )
+{
+    if( !s_pollRings ) return -1;
+    if( epoll < 0 )
+    {
+        epoll = epoll_create1( EPOLL_CLOEXEC );
+        if( epoll < 0 )
+        {
+            TracyDebug( "Failed to create epoll instance, checking rings every 1 ms" );
+            return -1;
+        }
+    }
+    for( int i=begin; i<end; i++ )
+    {
+        auto& ring = s_ring[i];
+        const auto cpu = ring.GetCpu();
+        if( cpu < cpuBegin || cpu >= cpuEnd ) continue;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = uint32_t( i );
+        epoll_ctl( epoll, EPOLL_CTL_ADD, ring.GetFd(), &ev );
+    }
+    return epoll;
+}
+
+// Waits until any of the polled rings is filled past its watermark. Reads are still done at least
+// every 100 ms, as a ring below its watermark is never signaled.
+static void WaitForRings( int epoll )
+{
+    if( epoll < 0 )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        return;
+    }
+    epoll_event ev[16];
+    epoll_wait( epoll, ev, 16, 100 );
+}
+
+// Keeps the rate of the call stack samples, taken on all CPUs together, within the budget set with
+// TRACY_SAMPLING_BUDGET. The frequency is halved as soon as the client falls behind on resolving the
+// sampled call stacks, and only raised back, up to TRACY_SAMPLING_HZ, once it has caught up.
+//
+// PERF_EVENT_IOC_PERIOD only changes the period of the events which were opened, and so of the
+// threads started from then on. The threads which already run keep the period they inherited, and
+// their extra samples are dropped by ReadSampleRings().
+static void AdjustSamplingFrequency( std::chrono::steady_clock::time_point& lastTime, uint64_t& lastSamples )
+{
+    enum { BacklogHigh = 16 * 1024, BacklogLow = BacklogHigh / 8 };
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( now - lastTime ).count();
+    if( elapsed < 250 ) return;
+    const auto samples = s_callstackSamples.load( std::memory_order_relaxed );
+    const auto rate = ( samples - lastSamples ) * 1000 / uint64_t( elapsed );
+    lastTime = now;
+    lastSamples = samples;
+
+    const auto backlog = GetProfiler().GetStats().symbolQueueDepth;
+    const int64_t hz = s_samplingHz.load( std::memory_order_relaxed );
+    int64_t target;
+    if( backlog > BacklogHigh )
+    {
+        target = hz / 2;
+    }
+    else
+    {
+        target = rate == 0 ? hz * 2 : int64_t( uint64_t( hz ) * s_samplingBudget / rate );
+        if( target > hz * 2 ) target = hz * 2;
+        else if( target < hz / 2 ) target = hz / 2;
+        if( target > hz && backlog > BacklogLow ) target = hz;
+    }
+    const int64_t minHz = s_samplingMaxHz < 100 ? s_samplingMaxHz : 100;
+    if( target > s_samplingMaxHz ) target = s_samplingMaxHz;
+    else if( target < minHz ) target = minHz;
+    if( target == hz || ( target > hz - hz / 10 && target < hz + hz / 10 ) ) return;
+
+    // The kernel turns the frequency of the CPU clock events into a period in nanoseconds when they
+    // are opened, which is what the ioctl then sets.
+    uint64_t period = 1000000000ull / uint64_t( target );
+    for( int i=0; i<s_ctxBufferIdx; i++ )
+    {
+        if( s_ring[i].GetId() == EventCallstack ) ioctl( s_ring[i].GetFd(), PERF_EVENT_IOC_PERIOD, &period );
+    }
+    s_samplingHz.store( int( target ), std::memory_order_relaxed );
+    TracyDebug( "Sampling frequency: %i Hz (%" PRIu64 " samples/s, %" PRIu64 " symbols queued)", int( target ), rate, backlog );
+    Profiler::PlotData( "Tracy sampling frequency", target );
+}
+
+struct SysTraceShard
+{
+    int cpuBegin;
+    int cpuEnd;
+};
+
+static void SysTraceReader( void* ptr )
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy Sampling" );
+    InitRpmalloc();
+    const auto shard = (const SysTraceShard*)ptr;
+    sched_param sp = { 95 };
+    if( pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp ) != 0 ) TracyDebug( "Failed to increase SysTraceReader thread priority!" );
+
+    // Keep the reader on the CPUs which write to its rings.
+    auto cpuSet = CPU_ALLOC( s_numCpus );
+    if( cpuSet )
+    {
+        const auto cpuSetSize = CPU_ALLOC_SIZE( s_numCpus );
+        CPU_ZERO_S( cpuSetSize, cpuSet );
+        for( int i=shard->cpuBegin; i<shard->cpuEnd; i++ ) CPU_SET_S( i, cpuSetSize, cpuSet );
+        if( pthread_setaffinity_np( pthread_self(), cpuSetSize, cpuSet ) != 0 ) TracyDebug( "Failed to set SysTraceReader thread affinity!" );
+        CPU_FREE( cpuSet );
+    }
+
+    const auto epoll = AddRingsToPoll( -1, 0, s_ctxBufferIdx, shard->cpuBegin, shard->cpuEnd );
+
+    for(;;)
+    {
+#ifdef TRACY_ON_DEMAND
+        if( !GetProfiler().IsConnected() )
+        {
+            if( !traceActive.load( std::memory_order_relaxed ) ) break;
+            SkipRings( 0, s_ctxBufferIdx, shard->cpuBegin, shard->cpuEnd );
+            if( !traceActive.load( std::memory_order_relaxed ) ) break;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            continue;
+        }
+#endif
+
+        const auto hadData = ReadSampleRings( shard->cpuBegin, shard->cpuEnd );
+        if( !traceActive.load( std::memory_order_relaxed ) ) break;
+        if( !hadData ) WaitForRings( epoll );
+    }
+
+    if( epoll >= 0 ) close( epoll );
+}
+
+void SysTraceWorker( void* ptr )
+{
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy Sampling" );
+    InitRpmalloc();
+    sched_param sp = { 95 };
+    if( pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp ) != 0 ) TracyDebug( "Failed to increase SysTraceWorker thread priority!" );
+    auto ctxBufferIdx = s_ctxBufferIdx;
+    auto ringArray = s_ring;
+    auto numBuffers = s_numBuffers;
+    for( int i=0; i<numBuffers; i++ ) ringArray[i].Enable();
+
+    // The sample rings are split by CPU between this thread and the reader threads. This thread
+    // also reads all the context switch, wake up and vsync rings, to keep them ordered by time.
+    const auto numReaders = s_numReaders;
+    const auto mainCpuEnd = s_numCpus / numReaders;
+#ifdef TRACY_HAS_DWARF_UNWIND
+    const auto numUnwinders = s_stackSize != 0 ? s_numUnwinders : 0;
+    if( numUnwinders != 0 )
+    {
+        s_stackSamples = (StackSampleQueue*)tracy_malloc( sizeof( StackSampleQueue ) );
+        new( s_stackSamples ) StackSampleQueue();
+    }
+#endif
+    auto shards = (SysTraceShard*)tracy_malloc( sizeof( SysTraceShard ) * numReaders );
+    auto readers = (Thread**)tracy_malloc( sizeof( Thread* ) * numReaders );
+    for( int i=1; i<numReaders; i++ )
+    {
+        shards[i].cpuBegin = s_numCpus * i / numReaders;
+        shards[i].cpuEnd = s_numCpus * ( i + 1 ) / numReaders;
+        readers[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+        new( readers[i] ) Thread( SysTraceReader, shards+i );
+    }
+#ifdef TRACY_HAS_DWARF_UNWIND
+    auto unwinders = (Thread**)tracy_malloc( sizeof( Thread* ) * ( numUnwinders + 1 ) );
+    for( int i=0; i<numUnwinders; i++ )
+    {
+        unwinders[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+        new( unwinders[i] ) Thread( SysTraceUnwinder, nullptr );
+    }
+#endif
+    auto epoll = AddRingsToPoll( -1, 0, ctxBufferIdx, 0, mainCpuEnd );
+    epoll = AddRingsToPoll( epoll, ctxBufferIdx, numBuffers, -1, s_numCpus );
+
+    auto samplingTime = std::chrono::steady_clock::now();
+    uint64_t samplingCount = 0;
+
+    for(;;)
+    {
+#ifdef TRACY_ON_DEMAND
+        if( !GetProfiler().IsConnected() )
+        {
+            if( !traceActive.load( std::memory_order_relaxed ) ) break;
+            SkipRings( 0, ctxBufferIdx, 0, mainCpuEnd );
+            SkipRings( ctxBufferIdx, numBuffers, -1, s_numCpus );
+#ifdef TRACY_HAS_BPF_OFFCPU
+            if( s_bpfOffCpuActive ) BpfOffCpuCollect( false );
+#endif
+            if( !traceActive.load( std::memory_order_relaxed ) ) break;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            continue;
+        }
+#endif
+
+        bool hadData = false;
+        if( ReadSampleRings( 0, mainCpuEnd ) ) hadData = true;
         if( !traceActive.load( std::memory_order_relaxed ) ) break;
 
         if( ctxBufferIdx != numBuffers )
@@ -1352,82 +1904,265 @@ void SysTraceWorker( void* ptr )
                 }
             }
         }
+#ifdef TRACY_HAS_BPF_OFFCPU
+        if( s_bpfOffCpuActive ) BpfOffCpuCollect( true );
+#endif
+        if( s_samplingBudget != 0 ) AdjustSamplingFrequency( samplingTime, samplingCount );
         if( !traceActive.load( std::memory_order_relaxed ) ) break;
-        if( !hadData )
+        if( !hadData ) WaitForRings( epoll );
+    }
+
+    if( epoll >= 0 ) close( epoll );
+#ifdef TRACY_HAS_BPF_OFFCPU
+    if( s_bpfOffCpuActive ) BpfOffCpuStop();
+#endif
+
+    for( int i=1; i<numReaders; i++ )
+    {
+        readers[i]->~Thread();
+        tracy_free( readers[i] );
+    }
+    tracy_free( readers );
+    tracy_free( shards );
+
+#ifdef TRACY_HAS_DWARF_UNWIND
+    if( numUnwinders != 0 )
+    {
+        s_stackSamples->Stop();
+        for( int i=0; i<numUnwinders; i++ )
         {
-            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            unwinders[i]->~Thread();
+            tracy_free( unwinders[i] );
         }
+        s_stackSamples->~StackSampleQueue();
+        tracy_free( s_stackSamples );
+        s_stackSamples = nullptr;
     }
+    tracy_free( unwinders );
+#endif
 
     for( int i=0; i<numBuffers; i++ ) ringArray[i].~RingBuffer();
     tracy_free_fast( ringArray );
+    if( s_lastSampleTime )
+    {
+        tracy_free( s_lastSampleTime );
+        s_lastSampleTime = nullptr;
+    }
 }
 
-void SysTraceGetExternalName( uint64_t thread, const char*& threadName, const char*& name )
+// Foreign thread and process names, so that each thread costs a single read of its status file
+// and each process a single read of its comm file, plus a read of the stat file per lookup. The tables are direct-mapped, a colliding entry
+// replaces the older one. A process seen for the first time has the names of up to
+// ExternalNameBatch of its threads read at once, as the other ones are usually queried next.
+// Ids get reused, so entries also hold the start time of their task and are only used while it
+// matches.
+enum { ExternalThreadSlots = 4096 };
+enum { ExternalProcessSlots = 1024 };
+enum { ExternalNameBatch = 64 };
+// TASK_COMM_LEN, the comm names are truncated to fit.
+enum { ExternalNameSize = 16 };
+
+struct ExternalThreadEntry
+{
+    uint32_t tid;
+    uint32_t pid;
+    uint64_t start;
+    char name[ExternalNameSize];
+};
+
+struct ExternalProcessEntry
+{
+    uint32_t pid;
+    uint64_t start;
+    char name[ExternalNameSize];
+};
+
+struct ExternalNameCache
+{
+    ExternalThreadEntry threads[ExternalThreadSlots];
+    ExternalProcessEntry processes[ExternalProcessSlots];
+};
+
+static ExternalNameCache* s_externalNames = nullptr;
+static std::mutex s_externalNamesLock;
+
+static void CopyExternalName( char* dst, const char* src, size_t sz )
+{
+    while( sz > 0 && src[sz-1] == '\n' ) sz--;
+    if( sz > ExternalNameSize - 1 ) sz = ExternalNameSize - 1;
+    memcpy( dst, src, sz );
+    dst[sz] = '\0';
+}
+
+static bool ReadExternalComm( const char* fn, char* dst )
+{
+    const int fd = open( fn, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return false;
+    char buf[64];
+    const auto sz = read( fd, buf, sizeof( buf ) );
+    close( fd );
+    if( sz <= 0 ) return false;
+    CopyExternalName( dst, buf, size_t( sz ) );
+    return true;
+}
+
+// Start time of a task in clock ticks since boot, field 22 of its stat file. Zero if the task is
+// gone.
+static uint64_t ReadExternalStart( const char* fn )
 {
-    FILE* f;
-    char fn[256];
-    sprintf( fn, "/proc/%" PRIu64 "/comm", thread );
-    f = fopen( fn, "rb" );
-    if( f )
+    const int fd = open( fn, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return 0;
+    char buf[512];
+    const auto sz = read( fd, buf, sizeof( buf ) - 1 );
+    close( fd );
+    if( sz <= 0 ) return 0;
+    buf[sz] = '\0';
+
+    // The name in field 2 may contain spaces and parentheses, fields are counted after it.
+    auto ptr = strrchr( buf, ')' );
+    if( !ptr ) return 0;
+    ptr++;
+    for( int field=3; field<22; field++ )
     {
-        char buf[256];
-        const auto sz = fread( buf, 1, 256, f );
-        if( sz > 0 && buf[sz-1] == '\n' ) buf[sz-1] = '\0';
-        threadName = CopyString( buf );
-        fclose( f );
+        while( *ptr == ' ' ) ptr++;
+        while( *ptr && *ptr != ' ' ) ptr++;
     }
-    else
+    return strtoull( ptr, nullptr, 10 );
+}
+
+// Reads the thread name and the process id from /proc/<tid>/status.
+static bool ReadExternalThread( uint32_t tid, ExternalThreadEntry& entry )
+{
+    char fn[64];
+    sprintf( fn, "/proc/%" PRIu32 "/status", tid );
+    const int fd = open( fn, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return false;
+    // Name and Tgid are among the first few lines.
+    char buf[1024];
+    const auto sz = read( fd, buf, sizeof( buf ) - 1 );
+    close( fd );
+    if( sz <= 0 ) return false;
+    buf[sz] = '\0';
+
+    bool hasName = false;
+    bool hasPid = false;
+    auto line = buf;
+    while( *line && !( hasName && hasPid ) )
     {
-        threadName = CopyString( "???", 3 );
+        auto end = strchr( line, '\n' );
+        if( !end ) end = line + strlen( line );
+        if( memcmp( "Name:\t", line, 6 ) == 0 )
+        {
+            CopyExternalName( entry.name, line + 6, size_t( end - line - 6 ) );
+            hasName = true;
+        }
+        else if( memcmp( "Tgid:\t", line, 6 ) == 0 )
+        {
+            entry.pid = uint32_t( atoi( line + 6 ) );
+            hasPid = true;
+        }
+        line = *end ? end + 1 : end;
     }
+    if( !hasName || !hasPid ) return false;
+    sprintf( fn, "/proc/%" PRIu32 "/stat", tid );
+    entry.start = ReadExternalStart( fn );
+    if( entry.start == 0 ) return false;
+    entry.tid = tid;
+    return true;
+}
 
-    sprintf( fn, "/proc/%" PRIu64 "/status", thread );
-    f = fopen( fn, "rb" );
-    if( f )
+static void ScanExternalProcessThreads( uint32_t pid )
+{
+    char fn[64];
+    sprintf( fn, "/proc/%" PRIu32 "/task", pid );
+    DIR* dir = opendir( fn );
+    if( !dir ) return;
+    int batch = 0;
+    struct dirent* ent;
+    while( batch < ExternalNameBatch && ( ent = readdir( dir ) ) )
     {
-        char* tmp = (char*)tracy_malloc_fast( 8*1024 );
-        const auto fsz = (ptrdiff_t)fread( tmp, 1, 8*1024, f );
-        fclose( f );
+        const auto tid = uint32_t( atoi( ent->d_name ) );
+        if( tid == 0 ) continue;
+        auto& entry = s_externalNames->threads[tid % ExternalThreadSlots];
+        if( entry.tid == tid ) continue;
+        sprintf( fn, "/proc/%" PRIu32 "/task/%" PRIu32 "/stat", pid, tid );
+        entry.start = ReadExternalStart( fn );
+        sprintf( fn, "/proc/%" PRIu32 "/task/%" PRIu32 "/comm", pid, tid );
+        if( entry.start != 0 && ReadExternalComm( fn, entry.name ) )
+        {
+            entry.tid = tid;
+            entry.pid = pid;
+        }
+        else
+        {
+            entry.tid = 0;
+        }
+        batch++;
+    }
+    closedir( dir );
+}
 
-        int pid = -1;
-        auto line = tmp;
-        for(;;)
+void SysTraceGetExternalName( uint64_t thread, const char*& threadName, const char*& name )
+{
+    const auto tid = uint32_t( thread );
+    char tmpThread[ExternalNameSize];
+    char tmpProcess[ExternalNameSize];
+    bool hasProcess = false;
+    uint32_t pid = 0;
+    {
+        std::lock_guard<std::mutex> lock( s_externalNamesLock );
+        if( !s_externalNames )
         {
-            if( memcmp( "Tgid:\t", line, 6 ) == 0 )
-            {
-                pid = atoi( line + 6 );
-                break;
-            }
-            while( line - tmp < fsz && *line != '\n' ) line++;
-            if( *line != '\n' ) break;
-            line++;
+            s_externalNames = (ExternalNameCache*)tracy_malloc( sizeof( ExternalNameCache ) );
+            memset( s_externalNames, 0, sizeof( ExternalNameCache ) );
         }
-        tracy_free_fast( tmp );
+        char fn[64];
+        auto& entry = s_externalNames->threads[tid % ExternalThreadSlots];
+        if( tid != 0 && entry.tid == tid )
+        {
+            sprintf( fn, "/proc/%" PRIu32 "/stat", tid );
+            if( ReadExternalStart( fn ) != entry.start ) entry.tid = 0;
+        }
+        if( tid == 0 || ( entry.tid != tid && !ReadExternalThread( tid, entry ) ) )
+        {
+            if( tid != 0 ) entry.tid = 0;
+            threadName = CopyString( "???", 3 );
+            name = CopyStringFast( "???", 3 );
+            return;
+        }
+        pid = entry.pid;
+        memcpy( tmpThread, entry.name, ExternalNameSize );
 
-        if( pid >= 0 )
+        auto& process = s_externalNames->processes[pid % ExternalProcessSlots];
+        sprintf( fn, "/proc/%" PRIu32 "/stat", pid );
+        const auto start = ReadExternalStart( fn );
+        if( process.pid == pid && process.start == start )
         {
+            hasProcess = true;
+        }
+        else if( start != 0 )
+        {
+            sprintf( fn, "/proc/%" PRIu32 "/comm", pid );
+            if( ReadExternalComm( fn, process.name ) )
             {
-                uint64_t _pid = pid;
-                TracyLfqPrepare( QueueType::TidToPid );
-                MemWrite( &item->tidToPid.tid, thread );
-                MemWrite( &item->tidToPid.pid, _pid );
-                TracyLfqCommit;
-            }
-            sprintf( fn, "/proc/%i/comm", pid );
-            f = fopen( fn, "rb" );
-            if( f )
-            {
-                char buf[256];
-                const auto sz = fread( buf, 1, 256, f );
-                if( sz > 0 && buf[sz-1] == '\n' ) buf[sz-1] = '\0';
-                name = CopyStringFast( buf );
-                fclose( f );
-                return;
+                process.pid = pid;
+                process.start = start;
+                hasProcess = true;
+                ScanExternalProcessThreads( pid );
             }
         }
+        if( hasProcess ) memcpy( tmpProcess, process.name, ExternalNameSize );
     }
-    name = CopyStringFast( "???", 3 );
+
+    threadName = CopyString( tmpThread );
+    {
+        uint64_t _pid = pid;
+        TracyLfqPrepare( QueueType::TidToPid );
+        MemWrite( &item->tidToPid.tid, thread );
+        MemWrite( &item->tidToPid.pid, _pid );
+        TracyLfqCommit;
+    }
+    name = hasProcess ? CopyStringFast( tmpProcess ) : CopyStringFast( "???", 3 );
 }
 
 }
@@ -0,0 +1,635 @@
+#include "TracySysTraceBpf.hpp"
+
+#ifdef TRACY_HAS_BPF_OFFCPU
+
+#include <chrono>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "TracyDebug.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+constexpr uint32_t BpfMaxCpus = 4096;
+constexpr uint32_t BpfMaxThreads = 65536;
+constexpr uint32_t BpfMaxOffCpuKeys = 16384;
+constexpr uint32_t BpfMaxStacks = 16384;
+constexpr uint32_t BpfMaxStackDepth = 127;
+constexpr uint32_t BpfMaxSyscalls = 1024;
+constexpr uint64_t BpfOffCpuSampleNs = 1000 * 1000;
+constexpr uint64_t BpfOffCpuMaxSamples = 1000;
+// Per collection, over all threads and stacks. Above it, each stack gets a share of the samples
+// in proportion to its off-CPU time.
+constexpr uint64_t BpfOffCpuMaxCollectSamples = 10000;
+
+struct BpfOffCpuKey
+{
+    uint32_t tid;
+    int32_t kernelStack;
+    int32_t userStack;
+    uint32_t pad;
+};
+
+struct BpfOffCpuValue
+{
+    uint64_t ns;
+    uint64_t count;
+};
+
+struct BpfSyscallValue
+{
+    uint64_t ns;
+    uint64_t count;
+};
+
+enum { BpfProgSwitch, BpfProgSysEnter, BpfProgSysExit, BpfNumProgs };
+
+int s_bpfLastSwitch = -1;       // cpu -> time the running thread was switched in
+int s_bpfSwitchedOut = -1;      // tid -> time and stacks of the last switch out
+int s_bpfOffCpu = -1;           // BpfOffCpuKey -> BpfOffCpuValue
+int s_bpfStacks = -1;
+int s_bpfSyscallStart = -1;     // tid -> time and number of the system call in progress
+int s_bpfSyscalls = -1;         // number -> BpfSyscallValue, mapped into memory
+int s_bpfLinks[BpfNumProgs] = { -1, -1, -1 };
+
+BpfSyscallValue* s_bpfSyscallData = nullptr;
+size_t s_bpfSyscallDataSize = 0;
+BpfSyscallValue* s_bpfSyscallPrev = nullptr;
+char** s_bpfSyscallPlots = nullptr;     // pairs of calls and latency plot names
+
+BpfOffCpuKey* s_bpfKeys = nullptr;
+BpfOffCpuValue* s_bpfValues = nullptr;
+bool s_bpfLookupAndDelete = true;
+int64_t s_bpfLastCollect = 0;
+
+long Bpf( int cmd, bpf_attr& attr )
+{
+    return syscall( __NR_bpf, cmd, &attr, sizeof( attr ) );
+}
+
+int BpfCreateMap( uint32_t type, uint32_t keySize, uint32_t valueSize, uint32_t maxEntries, uint32_t flags = 0 )
+{
+    bpf_attr attr = {};
+    attr.map_type = type;
+    attr.key_size = keySize;
+    attr.value_size = valueSize;
+    attr.max_entries = maxEntries;
+    attr.map_flags = flags;
+    return (int)Bpf( BPF_MAP_CREATE, attr );
+}
+
+// Just enough of an assembler for the programs below. Jumps go to labels, which are resolved once
+// the program is complete.
+class BpfAsm
+{
+public:
+    enum { MaxInsns = 128, MaxLabels = 8, MaxFixups = 16 };
+
+    BpfAsm()
+    {
+        for( auto& v : m_labels ) v = -1;
+    }
+
+    void Mov( int dst, int src ) { Emit( BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0 ); }
+    void Mov32( int dst, int src ) { Emit( BPF_ALU | BPF_MOV | BPF_X, dst, src, 0, 0 ); }
+    void MovImm( int dst, int32_t imm ) { Emit( BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm ); }
+    void AddImm( int dst, int32_t imm ) { Emit( BPF_ALU64 | BPF_ADD | BPF_K, dst, 0, 0, imm ); }
+    void Sub( int dst, int src ) { Emit( BPF_ALU64 | BPF_SUB | BPF_X, dst, src, 0, 0 ); }
+    void RshImm( int dst, int32_t imm ) { Emit( BPF_ALU64 | BPF_RSH | BPF_K, dst, 0, 0, imm ); }
+    void StackPtr( int dst, int16_t off ) { Mov( dst, BPF_REG_10 ); AddImm( dst, off ); }
+
+    void Load( int size, int dst, int src, int16_t off ) { Emit( BPF_LDX | BPF_MEM | size, dst, src, off, 0 ); }
+    void Store( int size, int dst, int16_t off, int src ) { Emit( BPF_STX | BPF_MEM | size, dst, src, off, 0 ); }
+    void StoreImm( int size, int dst, int16_t off, int32_t imm ) { Emit( BPF_ST | BPF_MEM | size, dst, 0, off, imm ); }
+    void AtomicAdd( int dst, int16_t off, int src ) { Emit( BPF_STX | BPF_XADD | BPF_DW, dst, src, off, 0 ); }
+
+    void LoadMap( int dst, int fd )
+    {
+        Emit( BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd );
+        Emit( 0, 0, 0, 0, 0 );
+    }
+
+    void Call( int func ) { Emit( BPF_JMP | BPF_CALL, 0, 0, 0, func ); }
+    void Exit() { Emit( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ); }
+
+    void JumpImm( int op, int dst, int32_t imm, int label ) { Fixup( label ); Emit( BPF_JMP | op | BPF_K, dst, 0, 0, imm ); }
+    void JumpReg( int op, int dst, int src, int label ) { Fixup( label ); Emit( BPF_JMP | op | BPF_X, dst, src, 0, 0 ); }
+    void Goto( int label ) { Fixup( label ); Emit( BPF_JMP | BPF_JA, 0, 0, 0, 0 ); }
+    void Bind( int label ) { m_labels[label] = m_size; }
+
+    const bpf_insn* Finish()
+    {
+        if( m_overflow ) return nullptr;
+        for( int i=0; i<m_numFixups; i++ )
+        {
+            const auto target = m_labels[m_fixups[i].label];
+            if( target < 0 ) return nullptr;
+            m_insns[m_fixups[i].insn].off = int16_t( target - m_fixups[i].insn - 1 );
+        }
+        return m_insns;
+    }
+
+    int Size() const { return m_size; }
+
+private:
+    void Emit( uint8_t code, int dst, int src, int16_t off, int32_t imm )
+    {
+        if( m_size == MaxInsns )
+        {
+            m_overflow = true;
+            return;
+        }
+        auto& insn = m_insns[m_size++];
+        memset( &insn, 0, sizeof( insn ) );
+        insn.code = code;
+        insn.dst_reg = uint8_t( dst );
+        insn.src_reg = uint8_t( src );
+        insn.off = off;
+        insn.imm = imm;
+    }
+
+    void Fixup( int label )
+    {
+        if( m_numFixups == MaxFixups )
+        {
+            m_overflow = true;
+            return;
+        }
+        m_fixups[m_numFixups].insn = m_size;
+        m_fixups[m_numFixups].label = label;
+        m_numFixups++;
+    }
+
+    struct FixupData
+    {
+        int insn;
+        int label;
+    };
+
+    bpf_insn m_insns[MaxInsns];
+    int m_size = 0;
+    int m_labels[MaxLabels];
+    FixupData m_fixups[MaxFixups];
+    int m_numFixups = 0;
+    bool m_overflow = false;
+};
+
+// Registers r0 to r5 are clobbered by helper calls, r6 to r9 are preserved and r10 is the frame
+// pointer. The context of a raw tracepoint is the array of the tracepoint arguments.
+enum { R0 = BPF_REG_0, R1, R2, R3, R4, R5, R6, R7, R8, R9, FP };
+
+// Leaves the thread id in r7 if the current thread belongs to the process, exits otherwise.
+void BpfFilterProcess( BpfAsm& a, uint32_t pid, int exitLabel )
+{
+    a.Call( BPF_FUNC_get_current_pid_tgid );
+    a.Mov32( R7, R0 );
+    a.RshImm( R0, 32 );
+    a.JumpImm( BPF_JNE, R0, int32_t( pid ), exitLabel );
+}
+
+// sched_switch runs on behalf of the thread being switched out. The time it was switched in is the
+// time the previous switch happened on the CPU, which ends the off-CPU interval the thread started
+// at its previous switch out.
+void BpfAsmSwitch( BpfAsm& a, uint32_t pid )
+{
+    enum { Exit, Record, Insert };
+
+    a.Mov( R6, R1 );
+    a.Call( BPF_FUNC_ktime_get_ns );
+    a.Mov( R8, R0 );
+    a.Call( BPF_FUNC_get_smp_processor_id );
+    a.Store( BPF_W, FP, -4, R0 );
+    a.LoadMap( R1, s_bpfLastSwitch );
+    a.StackPtr( R2, -4 );
+    a.Call( BPF_FUNC_map_lookup_elem );
+    a.JumpImm( BPF_JEQ, R0, 0, Exit );
+    a.Load( BPF_DW, R9, R0, 0 );
+    a.Store( BPF_DW, R0, 0, R8 );
+
+    BpfFilterProcess( a, pid, Exit );
+    a.JumpImm( BPF_JEQ, R7, 0, Exit );
+    a.Store( BPF_W, FP, -8, R7 );
+    a.LoadMap( R1, s_bpfSwitchedOut );
+    a.StackPtr( R2, -8 );
+    a.Call( BPF_FUNC_map_lookup_elem );
+    a.JumpImm( BPF_JEQ, R0, 0, Record );
+    a.Load( BPF_DW, R1, R0, 0 );
+    a.JumpReg( BPF_JGE, R1, R9, Record );
+    a.Sub( R9, R1 );
+    a.Load( BPF_W, R1, R0, 8 );
+    a.Load( BPF_W, R2, R0, 12 );
+    a.Store( BPF_W, FP, -24, R7 );
+    a.Store( BPF_W, FP, -20, R1 );
+    a.Store( BPF_W, FP, -16, R2 );
+    a.StoreImm( BPF_W, FP, -12, 0 );
+    a.LoadMap( R1, s_bpfOffCpu );
+    a.StackPtr( R2, -24 );
+    a.Call( BPF_FUNC_map_lookup_elem );
+    a.JumpImm( BPF_JEQ, R0, 0, Insert );
+    a.AtomicAdd( R0, 0, R9 );
+    a.MovImm( R1, 1 );
+    a.AtomicAdd( R0, 8, R1 );
+    a.Goto( Record );
+
+    a.Bind( Insert );
+    a.Store( BPF_DW, FP, -40, R9 );
+    a.StoreImm( BPF_DW, FP, -32, 1 );
+    a.LoadMap( R1, s_bpfOffCpu );
+    a.StackPtr( R2, -24 );
+    a.StackPtr( R3, -40 );
+    a.MovImm( R4, BPF_NOEXIST );
+    a.Call( BPF_FUNC_map_update_elem );
+
+    a.Bind( Record );
+    a.Mov( R1, R6 );
+    a.LoadMap( R2, s_bpfStacks );
+    a.MovImm( R3, 0 );
+    a.Call( BPF_FUNC_get_stackid );
+    a.Store( BPF_W, FP, -48, R0 );
+    a.Mov( R1, R6 );
+    a.LoadMap( R2, s_bpfStacks );
+    a.MovImm( R3, BPF_F_USER_STACK );
+    a.Call( BPF_FUNC_get_stackid );
+    a.Store( BPF_W, FP, -44, R0 );
+    a.Store( BPF_DW, FP, -56, R8 );
+    a.LoadMap( R1, s_bpfSwitchedOut );
+    a.StackPtr( R2, -8 );
+    a.StackPtr( R3, -56 );
+    a.MovImm( R4, BPF_ANY );
+    a.Call( BPF_FUNC_map_update_elem );
+
+    a.Bind( Exit );
+    a.MovImm( R0, 0 );
+    a.Exit();
+}
+
+void BpfAsmSysEnter( BpfAsm& a, uint32_t pid )
+{
+    enum { Exit };
+
+    a.Mov( R6, R1 );
+    BpfFilterProcess( a, pid, Exit );
+    a.Store( BPF_W, FP, -4, R7 );
+    a.Load( BPF_DW, R1, R6, 8 );         // args[1], the system call number
+    a.Store( BPF_DW, FP, -16, R1 );
+    a.Call( BPF_FUNC_ktime_get_ns );
+    a.Store( BPF_DW, FP, -24, R0 );
+    a.LoadMap( R1, s_bpfSyscallStart );
+    a.StackPtr( R2, -4 );
+    a.StackPtr( R3, -24 );
+    a.MovImm( R4, BPF_ANY );
+    a.Call( BPF_FUNC_map_update_elem );
+
+    a.Bind( Exit );
+    a.MovImm( R0, 0 );
+    a.Exit();
+}
+
+void BpfAsmSysExit( BpfAsm& a, uint32_t pid )
+{
+    enum { Exit };
+
+    BpfFilterProcess( a, pid, Exit );
+    a.Store( BPF_W, FP, -4, R7 );
+    a.Call( BPF_FUNC_ktime_get_ns );
+    a.Mov( R8, R0 );
+    a.LoadMap( R1, s_bpfSyscallStart );
+    a.StackPtr( R2, -4 );
+    a.Call( BPF_FUNC_map_lookup_elem );
+    a.JumpImm( BPF_JEQ, R0, 0, Exit );
+    a.Load( BPF_DW, R1, R0, 0 );
+    a.Sub( R8, R1 );
+    a.Load( BPF_DW, R9, R0, 8 );
+    a.LoadMap( R1, s_bpfSyscallStart );
+    a.StackPtr( R2, -4 );
+    a.Call( BPF_FUNC_map_delete_elem );
+    a.JumpImm( BPF_JGE, R9, BpfMaxSyscalls, Exit );
+    a.Store( BPF_W, FP, -8, R9 );
+    a.LoadMap( R1, s_bpfSyscalls );
+    a.StackPtr( R2, -8 );
+    a.Call( BPF_FUNC_map_lookup_elem );
+    a.JumpImm( BPF_JEQ, R0, 0, Exit );
+    a.AtomicAdd( R0, 0, R8 );
+    a.MovImm( R1, 1 );
+    a.AtomicAdd( R0, 8, R1 );
+
+    a.Bind( Exit );
+    a.MovImm( R0, 0 );
+    a.Exit();
+}
+
+int BpfLoad( BpfAsm& a, const char* tracepoint )
+{
+    const auto insns = a.Finish();
+    if( !insns ) return -1;
+
+#ifdef TRACY_VERBOSE
+    static char log[64*1024];
+#endif
+    bpf_attr attr = {};
+    attr.prog_type = BPF_PROG_TYPE_RAW_TRACEPOINT;
+    attr.insns = (uint64_t)insns;
+    attr.insn_cnt = uint32_t( a.Size() );
+    attr.license = (uint64_t)"Dual BSD/GPL";
+#ifdef TRACY_VERBOSE
+    attr.log_buf = (uint64_t)log;
+    attr.log_size = sizeof( log );
+    attr.log_level = 1;
+#endif
+    const int prog = (int)Bpf( BPF_PROG_LOAD, attr );
+    if( prog < 0 )
+    {
+#ifdef TRACY_VERBOSE
+        TracyDebug( "BPF program for %s rejected: %s\n%s", tracepoint, strerror( errno ), log );
+#endif
+        return -1;
+    }
+
+    attr = {};
+    attr.raw_tracepoint.name = (uint64_t)tracepoint;
+    attr.raw_tracepoint.prog_fd = uint32_t( prog );
+    const int link = (int)Bpf( BPF_RAW_TRACEPOINT_OPEN, attr );
+    if( link < 0 )
+    {
+        TracyDebug( "Failed to attach BPF program to %s: %s", tracepoint, strerror( errno ) );
+    }
+    // The attachment keeps the program loaded.
+    close( prog );
+    return link;
+}
+
+void BpfClose( int& fd )
+{
+    if( fd >= 0 ) close( fd );
+    fd = -1;
+}
+
+bool BpfLookup( int map, const void* key, void* value )
+{
+    bpf_attr attr = {};
+    attr.map_fd = uint32_t( map );
+    attr.key = (uint64_t)key;
+    attr.value = (uint64_t)value;
+    return Bpf( BPF_MAP_LOOKUP_ELEM, attr ) == 0;
+}
+
+bool BpfTake( int map, const void* key, void* value )
+{
+    bpf_attr attr = {};
+    attr.map_fd = uint32_t( map );
+    attr.key = (uint64_t)key;
+    attr.value = (uint64_t)value;
+    if( s_bpfLookupAndDelete )
+    {
+        if( Bpf( BPF_MAP_LOOKUP_AND_DELETE_ELEM, attr ) == 0 ) return true;
+        if( errno == ENOENT ) return false;
+        // Hash maps support this from Linux 5.14 on. Increments made in between the lookup and the
+        // delete are lost with the fallback.
+        s_bpfLookupAndDelete = false;
+    }
+    if( Bpf( BPF_MAP_LOOKUP_ELEM, attr ) != 0 ) return false;
+    Bpf( BPF_MAP_DELETE_ELEM, attr );
+    return true;
+}
+
+// Kernel frames first, then user frames, both starting with the innermost one, as in callchains
+// collected by perf.
+uint32_t BpfReadStack( int32_t id, uint64_t* out, uint32_t space )
+{
+    if( id < 0 || space == 0 ) return 0;
+    uint64_t ips[BpfMaxStackDepth];
+    if( !BpfLookup( s_bpfStacks, &id, ips ) ) return 0;
+    uint32_t cnt = 0;
+    while( cnt < BpfMaxStackDepth && cnt < space && ips[cnt] != 0 )
+    {
+        out[cnt] = ips[cnt];
+        cnt++;
+    }
+    return cnt;
+}
+
+uint64_t BpfOffCpuSamples( const BpfOffCpuValue& value )
+{
+    auto samples = ( value.ns + BpfOffCpuSampleNs / 2 ) / BpfOffCpuSampleNs;
+    if( samples == 0 ) samples = 1;
+    if( samples > BpfOffCpuMaxSamples ) samples = BpfOffCpuMaxSamples;
+    return samples;
+}
+
+// The samples are spread over the off-CPU time, taken to end at the collection.
+void BpfSendOffCpu( const BpfOffCpuKey& key, const BpfOffCpuValue& value, uint64_t samples, int64_t now )
+{
+    uint64_t ips[BpfMaxStackDepth * 2];
+    auto cnt = BpfReadStack( key.kernelStack, ips, BpfMaxStackDepth * 2 );
+    cnt += BpfReadStack( key.userStack, ips + cnt, BpfMaxStackDepth * 2 - cnt );
+    if( cnt == 0 ) return;
+
+    const auto step = int64_t( value.ns / samples );
+    for( uint64_t i=0; i<samples; i++ )
+    {
+        auto trace = (uint64_t*)tracy_malloc_fast( ( 1 + cnt ) * sizeof( uint64_t ) );
+        trace[0] = cnt;
+        memcpy( trace+1, ips, cnt * sizeof( uint64_t ) );
+
+        TracyLfqPrepare( QueueType::CallstackSampleContextSwitch );
+        MemWrite( &item->callstackSampleFat.time, now - int64_t( samples - 1 - i ) * step );
+        MemWrite( &item->callstackSampleFat.thread, key.tid );
+        MemWrite( &item->callstackSampleFat.ptr, (uint64_t)trace );
+        TracyLfqCommit;
+    }
+}
+
+void BpfCollectOffCpu( bool send )
+{
+    uint32_t numKeys = 0;
+    bpf_attr attr = {};
+    attr.map_fd = uint32_t( s_bpfOffCpu );
+    attr.key = 0;
+    attr.next_key = (uint64_t)s_bpfKeys;
+    while( numKeys < BpfMaxOffCpuKeys && Bpf( BPF_MAP_GET_NEXT_KEY, attr ) == 0 )
+    {
+        attr.key = (uint64_t)( s_bpfKeys + numKeys );
+        numKeys++;
+        attr.next_key = (uint64_t)( s_bpfKeys + numKeys );
+    }
+
+    uint32_t numValues = 0;
+    uint64_t total = 0;
+    for( uint32_t i=0; i<numKeys; i++ )
+    {
+        if( !BpfTake( s_bpfOffCpu, s_bpfKeys + i, s_bpfValues + numValues ) ) continue;
+        s_bpfKeys[numValues] = s_bpfKeys[i];
+        total += BpfOffCpuSamples( s_bpfValues[numValues] );
+        numValues++;
+    }
+    if( !send ) return;
+
+    const auto now = Profiler::GetTime();
+    for( uint32_t i=0; i<numValues; i++ )
+    {
+        auto samples = BpfOffCpuSamples( s_bpfValues[i] );
+        if( total > BpfOffCpuMaxCollectSamples )
+        {
+            samples = samples * BpfOffCpuMaxCollectSamples / total;
+            if( samples == 0 ) continue;
+        }
+        BpfSendOffCpu( s_bpfKeys[i], s_bpfValues[i], samples, now );
+    }
+}
+
+void BpfCollectSyscalls( bool send )
+{
+    for( uint32_t i=0; i<BpfMaxSyscalls; i++ )
+    {
+        BpfSyscallValue value;
+        value.count = __atomic_load_n( &s_bpfSyscallData[i].count, __ATOMIC_RELAXED );
+        value.ns = __atomic_load_n( &s_bpfSyscallData[i].ns, __ATOMIC_RELAXED );
+        auto& prev = s_bpfSyscallPrev[i];
+        const auto count = value.count - prev.count;
+        if( count == 0 ) continue;
+        const auto ns = value.ns - prev.ns;
+        prev = value;
+        if( !send ) continue;
+
+        if( !s_bpfSyscallPlots[i*2] )
+        {
+            for( int j=0; j<2; j++ )
+            {
+                auto name = (char*)tracy_malloc( 32 );
+                snprintf( name, 32, j == 0 ? "syscall %u calls" : "syscall %u latency", i );
+                s_bpfSyscallPlots[i*2+j] = name;
+            }
+        }
+        Profiler::PlotData( s_bpfSyscallPlots[i*2], int64_t( count ) );
+        Profiler::PlotData( s_bpfSyscallPlots[i*2+1], int64_t( ns / count ) );
+    }
+}
+
+}
+
+bool BpfOffCpuStart( uint32_t pid )
+{
+    s_bpfLastSwitch = BpfCreateMap( BPF_MAP_TYPE_ARRAY, sizeof( uint32_t ), sizeof( uint64_t ), BpfMaxCpus );
+    s_bpfSwitchedOut = BpfCreateMap( BPF_MAP_TYPE_LRU_HASH, sizeof( uint32_t ), 16, BpfMaxThreads );
+    s_bpfOffCpu = BpfCreateMap( BPF_MAP_TYPE_HASH, sizeof( BpfOffCpuKey ), sizeof( BpfOffCpuValue ), BpfMaxOffCpuKeys );
+    s_bpfStacks = BpfCreateMap( BPF_MAP_TYPE_STACK_TRACE, sizeof( uint32_t ), BpfMaxStackDepth * sizeof( uint64_t ), BpfMaxStacks );
+    s_bpfSyscallStart = BpfCreateMap( BPF_MAP_TYPE_LRU_HASH, sizeof( uint32_t ), 16, BpfMaxThreads );
+    s_bpfSyscalls = BpfCreateMap( BPF_MAP_TYPE_ARRAY, sizeof( uint32_t ), sizeof( BpfSyscallValue ), BpfMaxSyscalls, BPF_F_MMAPABLE );
+    if( s_bpfLastSwitch < 0 || s_bpfSwitchedOut < 0 || s_bpfOffCpu < 0 || s_bpfStacks < 0 )
+    {
+        TracyDebug( "Failed to create BPF maps: %s", strerror( errno ) );
+        BpfOffCpuStop();
+        return false;
+    }
+
+    {
+        BpfAsm a;
+        BpfAsmSwitch( a, pid );
+        s_bpfLinks[BpfProgSwitch] = BpfLoad( a, "sched_switch" );
+        if( s_bpfLinks[BpfProgSwitch] < 0 )
+        {
+            BpfOffCpuStop();
+            return false;
+        }
+    }
+
+    // The latencies are read from the memory mapped map, which needs Linux 5.5.
+    if( s_bpfSyscallStart >= 0 && s_bpfSyscalls >= 0 )
+    {
+        const auto pageSize = (size_t)sysconf( _SC_PAGESIZE );
+        s_bpfSyscallDataSize = ( BpfMaxSyscalls * sizeof( BpfSyscallValue ) + pageSize - 1 ) & ~( pageSize - 1 );
+        auto data = mmap( nullptr, s_bpfSyscallDataSize, PROT_READ, MAP_SHARED, s_bpfSyscalls, 0 );
+        if( data != MAP_FAILED )
+        {
+            BpfAsm enter, exit;
+            BpfAsmSysEnter( enter, pid );
+            BpfAsmSysExit( exit, pid );
+            s_bpfSyscallData = (BpfSyscallValue*)data;
+            s_bpfLinks[BpfProgSysExit] = BpfLoad( exit, "sys_exit" );
+            if( s_bpfLinks[BpfProgSysExit] >= 0 ) s_bpfLinks[BpfProgSysEnter] = BpfLoad( enter, "sys_enter" );
+            if( s_bpfLinks[BpfProgSysEnter] < 0 )
+            {
+                BpfClose( s_bpfLinks[BpfProgSysExit] );
+                munmap( s_bpfSyscallData, s_bpfSyscallDataSize );
+                s_bpfSyscallData = nullptr;
+            }
+        }
+    }
+    if( s_bpfSyscallData )
+    {
+        s_bpfSyscallPrev = (BpfSyscallValue*)tracy_malloc( BpfMaxSyscalls * sizeof( BpfSyscallValue ) );
+        memset( s_bpfSyscallPrev, 0, BpfMaxSyscalls * sizeof( BpfSyscallValue ) );
+        s_bpfSyscallPlots = (char**)tracy_malloc( BpfMaxSyscalls * 2 * sizeof( char* ) );
+        memset( s_bpfSyscallPlots, 0, BpfMaxSyscalls * 2 * sizeof( char* ) );
+    }
+    TracyDebug( "BPF off-CPU collection enabled, system call latencies %s", s_bpfSyscallData ? "enabled" : "not available" );
+
+    s_bpfKeys = (BpfOffCpuKey*)tracy_malloc( ( BpfMaxOffCpuKeys + 1 ) * sizeof( BpfOffCpuKey ) );
+    s_bpfValues = (BpfOffCpuValue*)tracy_malloc( BpfMaxOffCpuKeys * sizeof( BpfOffCpuValue ) );
+    return true;
+}
+
+void BpfOffCpuCollect( bool send )
+{
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    if( now - s_bpfLastCollect < 100 * 1000 * 1000 ) return;
+    s_bpfLastCollect = now;
+
+    BpfCollectOffCpu( send );
+    if( s_bpfSyscallData ) BpfCollectSyscalls( send );
+}
+
+void BpfOffCpuStop()
+{
+    for( auto& v : s_bpfLinks ) BpfClose( v );
+    if( s_bpfSyscallData )
+    {
+        munmap( s_bpfSyscallData, s_bpfSyscallDataSize );
+        s_bpfSyscallData = nullptr;
+    }
+    BpfClose( s_bpfLastSwitch );
+    BpfClose( s_bpfSwitchedOut );
+    BpfClose( s_bpfOffCpu );
+    BpfClose( s_bpfStacks );
+    BpfClose( s_bpfSyscallStart );
+    BpfClose( s_bpfSyscalls );
+    if( s_bpfSyscallPrev )
+    {
+        tracy_free( s_bpfSyscallPrev );
+        s_bpfSyscallPrev = nullptr;
+    }
+    if( s_bpfSyscallPlots )
+    {
+        for( uint32_t i=0; i<BpfMaxSyscalls * 2; i++ )
+        {
+            if( s_bpfSyscallPlots[i] ) tracy_free( s_bpfSyscallPlots[i] );
+        }
+        tracy_free( s_bpfSyscallPlots );
+        s_bpfSyscallPlots = nullptr;
+    }
+    if( s_bpfKeys )
+    {
+        tracy_free( s_bpfKeys );
+        s_bpfKeys = nullptr;
+    }
+    if( s_bpfValues )
+    {
+        tracy_free( s_bpfValues );
+        s_bpfValues = nullptr;
+    }
+}
+
+}
+
+#endif
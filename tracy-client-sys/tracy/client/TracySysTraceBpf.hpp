@@ -0,0 +1,31 @@
+#ifndef __TRACYSYSTRACEBPF_HPP__
+#define __TRACYSYSTRACEBPF_HPP__
+
+#include "TracySysTrace.hpp"
+
+#if defined TRACY_BPF_OFFCPU && defined TRACY_HAS_SYSTEM_TRACING && defined __linux__
+#  define TRACY_HAS_BPF_OFFCPU
+
+#include <stdint.h>
+
+namespace tracy
+{
+
+// Collects the off-CPU time and the system call latencies of the threads of a process with eBPF
+// programs attached to the sched_switch, sys_enter and sys_exit raw tracepoints. The programs are
+// assembled here and loaded with the bpf() system call, so neither libbpf nor tracefs is needed.
+// Everything is aggregated in kernel maps, keyed by the thread and its kernel and user stacks for
+// the off-CPU time, and by the system call number for the latencies.
+//
+// Collect() reads the maps, at most every 100 ms, and turns the off-CPU time into context switch
+// callstack samples, one for each millisecond spent off-CPU with a given stack. The system call
+// latencies are sent as plots. Without send, the maps are only drained.
+bool BpfOffCpuStart( uint32_t pid );
+void BpfOffCpuCollect( bool send );
+void BpfOffCpuStop();
+
+}
+
+#endif
+
+#endif
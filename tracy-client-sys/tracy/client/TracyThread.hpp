@@ -11,6 +11,8 @@
 #  include "tracy_rpmalloc.hpp"
 #endif
 
+#include "TracyThreadPolicy.hpp"
+
 namespace tracy
 {
 
@@ -50,7 +52,13 @@ public:
     HANDLE Handle() const { return m_hnd; }
 
 private:
-    static DWORD WINAPI Launch( void* ptr ) { ((Thread*)ptr)->m_func( ((Thread*)ptr)->m_ptr ); return 0; }
+    static DWORD WINAPI Launch( void* ptr )
+    {
+        RegisterProfilerThread();
+        ((Thread*)ptr)->m_func( ((Thread*)ptr)->m_ptr );
+        UnregisterProfilerThread();
+        return 0;
+    }
 
     void(*m_func)( void* ptr );
     void* m_ptr;
@@ -77,7 +85,13 @@ public:
     pthread_t Handle() const { return m_thread; }
 
 private:
-    static void* Launch( void* ptr ) { ((Thread*)ptr)->m_func( ((Thread*)ptr)->m_ptr ); return nullptr; }
+    static void* Launch( void* ptr )
+    {
+        RegisterProfilerThread();
+        ((Thread*)ptr)->m_func( ((Thread*)ptr)->m_ptr );
+        UnregisterProfilerThread();
+        return nullptr;
+    }
     void(*m_func)( void* ptr );
     void* m_ptr;
     pthread_t m_thread;
@@ -0,0 +1,169 @@
+#include "TracyThreadPolicy.hpp"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <mutex>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../common/TracySystem.hpp"
+
+namespace tracy
+{
+
+constexpr int MaxProfilerThreads = 64;
+
+static std::mutex s_policyLock;
+static pid_t s_policyThreads[MaxProfilerThreads];
+static bool s_policyInit = false;
+static bool s_policyAffinity = false;
+static cpu_set_t s_policyCpus;
+static cpu_set_t s_policyInheritedCpus;
+static int s_policyNice = 0;
+static ThreadSched s_policySched = ThreadSched::Normal;
+
+// Parses cpulist strings, e.g. "0-7,16-23".
+static bool ParseCpuList( const char* list, cpu_set_t& set )
+{
+    CPU_ZERO( &set );
+    auto ptr = list;
+    while( *ptr >= '0' && *ptr <= '9' )
+    {
+        char* end;
+        const auto first = strtol( ptr, &end, 10 );
+        auto last = first;
+        if( *end == '-' ) last = strtol( end + 1, &end, 10 );
+        if( last < first ) return false;
+        for( long i=first; i<=last && i<CPU_SETSIZE; i++ ) CPU_SET( i, &set );
+        if( *end == ',' ) ptr = end + 1;
+        else if( *end == '\0' ) break;
+        else return false;
+    }
+    return *ptr != '\0' && CPU_COUNT( &set ) != 0;
+}
+
+static bool ApplyAffinity( pid_t tid )
+{
+    const auto& set = s_policyAffinity ? s_policyCpus : s_policyInheritedCpus;
+    return sched_setaffinity( tid, sizeof( set ), &set ) == 0;
+}
+
+static bool ApplyPriority( pid_t tid )
+{
+    // The system tracing readers raise themselves to real time priority to keep up with the
+    // kernel buffers, which is kept.
+    const auto current = sched_getscheduler( tid );
+    if( current == SCHED_FIFO || current == SCHED_RR ) return true;
+    sched_param param = {};
+    const int policy = s_policySched == ThreadSched::Batch ? SCHED_BATCH : ( s_policySched == ThreadSched::Idle ? SCHED_IDLE : SCHED_OTHER );
+    bool ok = sched_setscheduler( tid, policy, &param ) == 0;
+    ok &= setpriority( PRIO_PROCESS, tid, s_policyNice ) == 0;
+    return ok;
+}
+
+static void InitPolicy()
+{
+    s_policyInit = true;
+    // Resetting the affinity goes back to the CPUs the profiler threads were started with.
+    if( sched_getaffinity( 0, sizeof( s_policyInheritedCpus ), &s_policyInheritedCpus ) != 0 )
+    {
+        memset( &s_policyInheritedCpus, 0xFF, sizeof( s_policyInheritedCpus ) );
+    }
+    const char* cpus = GetEnvVar( "TRACY_THREAD_AFFINITY" );
+    if( cpus ) s_policyAffinity = ParseCpuList( cpus, s_policyCpus );
+    const char* nice = GetEnvVar( "TRACY_THREAD_NICE" );
+    if( nice ) s_policyNice = atoi( nice );
+    const char* sched = GetEnvVar( "TRACY_THREAD_SCHED" );
+    if( sched )
+    {
+        if( strcmp( sched, "batch" ) == 0 ) s_policySched = ThreadSched::Batch;
+        else if( strcmp( sched, "idle" ) == 0 ) s_policySched = ThreadSched::Idle;
+    }
+}
+
+void RegisterProfilerThread()
+{
+    const auto tid = (pid_t)syscall( SYS_gettid );
+    std::lock_guard<std::mutex> lock( s_policyLock );
+    if( !s_policyInit ) InitPolicy();
+    for( int i=0; i<MaxProfilerThreads; i++ )
+    {
+        if( s_policyThreads[i] == 0 )
+        {
+            s_policyThreads[i] = tid;
+            break;
+        }
+    }
+    // Threads inherit the affinity and scheduling class of their creator, which is left alone
+    // unless a policy was asked for.
+    if( s_policyAffinity ) ApplyAffinity( tid );
+    if( s_policyNice != 0 || s_policySched != ThreadSched::Normal ) ApplyPriority( tid );
+}
+
+void UnregisterProfilerThread()
+{
+    const auto tid = (pid_t)syscall( SYS_gettid );
+    std::lock_guard<std::mutex> lock( s_policyLock );
+    for( int i=0; i<MaxProfilerThreads; i++ )
+    {
+        if( s_policyThreads[i] == tid ) s_policyThreads[i] = 0;
+    }
+}
+
+static bool ApplyToAll( bool(*apply)( pid_t ) )
+{
+    bool ok = true;
+    for( int i=0; i<MaxProfilerThreads; i++ )
+    {
+        if( s_policyThreads[i] != 0 ) ok &= apply( s_policyThreads[i] );
+    }
+    return ok;
+}
+
+TRACY_API bool SetProfilerThreadAffinity( const char* cpus )
+{
+    std::lock_guard<std::mutex> lock( s_policyLock );
+    if( !s_policyInit ) InitPolicy();
+    if( !cpus || !*cpus )
+    {
+        s_policyAffinity = false;
+    }
+    else
+    {
+        cpu_set_t set;
+        if( !ParseCpuList( cpus, set ) ) return false;
+        s_policyCpus = set;
+        s_policyAffinity = true;
+    }
+    return ApplyToAll( ApplyAffinity );
+}
+
+TRACY_API bool SetProfilerThreadPriority( int nice, ThreadSched sched )
+{
+    std::lock_guard<std::mutex> lock( s_policyLock );
+    if( !s_policyInit ) InitPolicy();
+    s_policyNice = nice;
+    s_policySched = sched;
+    return ApplyToAll( ApplyPriority );
+}
+
+}
+
+#else
+
+namespace tracy
+{
+
+void RegisterProfilerThread() {}
+void UnregisterProfilerThread() {}
+TRACY_API bool SetProfilerThreadAffinity( const char* ) { return false; }
+TRACY_API bool SetProfilerThreadPriority( int, ThreadSched ) { return false; }
+
+}
+
+#endif
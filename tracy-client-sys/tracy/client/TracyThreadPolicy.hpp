@@ -0,0 +1,31 @@
+#ifndef __TRACYTHREADPOLICY_HPP__
+#define __TRACYTHREADPOLICY_HPP__
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+enum class ThreadSched : int
+{
+    Normal,
+    Batch,
+    Idle
+};
+
+// CPU placement and priority of the threads the profiler starts, so that they can be kept off
+// the cores reserved for latency critical work. The initial policy comes from
+// TRACY_THREAD_AFFINITY, a CPU list such as "0-1,6", TRACY_THREAD_NICE and TRACY_THREAD_SCHED,
+// which is one of "normal", "batch" or "idle". Changes apply to the running threads as well as to
+// the ones started later. Only implemented on Linux, the setters fail elsewhere.
+void RegisterProfilerThread();
+void UnregisterProfilerThread();
+
+// Null or empty cpus lets the threads run anywhere again. Returns false if the list does not
+// parse or if the policy could not be applied to some of the threads.
+TRACY_API bool SetProfilerThreadAffinity( const char* cpus );
+TRACY_API bool SetProfilerThreadPriority( int nice, ThreadSched sched );
+
+}
+
+#endif
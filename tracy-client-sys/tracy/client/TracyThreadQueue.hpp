@@ -0,0 +1,567 @@
+#ifndef __TRACYTHREADQUEUE_HPP__
+#define __TRACYTHREADQUEUE_HPP__
+
+// NUMA placement is built on top of the per-thread queues.
+#if defined TRACY_NUMA && !defined TRACY_THREAD_QUEUES
+#  define TRACY_THREAD_QUEUES
+#endif
+
+#ifdef TRACY_THREAD_QUEUES
+
+#include <assert.h>
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tracy_concurrentqueue.h"
+#include "TracyNuma.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "../common/TracyMutex.hpp"
+#include "../common/TracyQueue.hpp"
+#include "../common/TracySystem.hpp"
+
+#if defined _MSC_VER
+#  pragma warning( push )
+#  pragma warning( disable : 4324 )
+#endif
+
+namespace tracy
+{
+
+class ThreadQueueSet;
+class ThreadQueueProducerToken;
+struct ThreadQueueConsumerToken;
+
+// Event queue of a single producing thread, read by the profiler worker. Items are stored in a
+// chain of fixed-size blocks. Blocks drained by the worker are handed back to the owning thread,
+// so once a thread has reached its working set no allocations are made, and producers never
+// touch memory shared with other producers.
+//
+// With TRACY_NUMA, blocks come from pools local to the NUMA node the producing thread runs on, so
+// that events are written to and read from node-local memory, and the queue reports its node to
+// the consumer.
+//
+// The producer interface matches the one of moodycamel's ExplicitProducer, which is what the
+// TracyLfqPrepare / TracyLfqCommit macros expect.
+class ThreadQueue
+{
+public:
+    typedef moodycamel::ConcurrentQueueDefaultTraits::index_t index_t;
+
+    enum { BlockSize = 2048 };
+    // Upper bound of items handed out in a single dequeue, same as for moodycamel's queue.
+    enum { MaxDequeue = 8192 };
+
+    explicit ThreadQueue( ThreadQueueSet* set )
+        : m_tail( 0 )
+        , m_tailBlock( nullptr )
+        , m_spare( nullptr )
+        , m_pendingZone( nullptr )
+        , m_head( 0 )
+        , m_headBase( 0 )
+        , m_headBlock( nullptr )
+        , m_returned( nullptr )
+        , m_orphaned( false )
+        , m_node( 0 )
+        , m_thread( detail::GetThreadHandleImpl() )
+        , m_next( nullptr )
+        , m_token( nullptr )
+        , m_set( set )
+    {
+    }
+
+    inline ~ThreadQueue();
+
+    tracy_force_inline QueueItem* enqueue_begin( index_t& currentTailIndex )
+    {
+        currentTailIndex = m_tail.load( std::memory_order_relaxed );
+        if( moodycamel::details::cqUnlikely( ( currentTailIndex & ( BlockSize - 1 ) ) == 0 ) ) AppendBlock();
+        return m_tailBlock->items + ( currentTailIndex & ( BlockSize - 1 ) );
+    }
+
+    tracy_force_inline QueueItem* enqueue_at( index_t currentTailIndex )
+    {
+        if( moodycamel::details::cqUnlikely( ( currentTailIndex & ( BlockSize - 1 ) ) == 0 ) ) AppendBlock();
+        return m_tailBlock->items + ( currentTailIndex & ( BlockSize - 1 ) );
+    }
+
+    tracy_force_inline std::atomic<index_t>& get_tail_index() { return m_tail; }
+    tracy_force_inline QueueItem*& get_pending_zone() { return m_pendingZone; }
+
+    template<class NotifyThread, class ProcessData>
+    size_t dequeue_bulk( NotifyThread& notifyThread, ProcessData& processData )
+    {
+        const auto tail = m_tail.load( std::memory_order_acquire );
+        const auto first = m_head;
+        if( first == tail ) return 0;
+        const auto last = tail - first > MaxDequeue ? first + MaxDequeue : tail;
+
+        notifyThread( m_thread );
+
+        auto head = first;
+        do
+        {
+            if( head - m_headBase == BlockSize )
+            {
+                // The producer links the next block before publishing any item in it.
+                auto next = m_headBlock->next.load( std::memory_order_acquire );
+                assert( next );
+                ReturnBlock( m_headBlock );
+                m_headBlock = next;
+                m_headBase = head;
+            }
+            const auto left = m_headBase + BlockSize - head;
+            const auto sz = last - head < left ? last - head : left;
+            processData( m_headBlock->items + ( head - m_headBase ), size_t( sz ) );
+            head += sz;
+        }
+        while( head != last );
+        m_head = head;
+
+        return size_t( last - first );
+    }
+
+    ThreadQueue( const ThreadQueue& ) = delete;
+    ThreadQueue( ThreadQueue&& ) = delete;
+    ThreadQueue& operator=( const ThreadQueue& ) = delete;
+    ThreadQueue& operator=( ThreadQueue&& ) = delete;
+
+private:
+    friend class ThreadQueueSet;
+    friend class ThreadQueueProducerToken;
+
+    struct Block
+    {
+        std::atomic<Block*> next;
+        uint32_t node;
+        QueueItem items[BlockSize];
+    };
+
+    inline void FreeList( Block* block );
+
+    // Producer side. Called when the tail crosses into a new block.
+    tracy_no_inline inline void AppendBlock();
+
+    // Consumer side. The producer only ever takes the whole list, so there is no ABA problem.
+    void ReturnBlock( Block* block )
+    {
+        auto top = m_returned.load( std::memory_order_relaxed );
+        do
+        {
+            block->next.store( top, std::memory_order_relaxed );
+        }
+        while( !m_returned.compare_exchange_weak( top, block, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    bool IsDrained() const { return m_head == m_tail.load( std::memory_order_acquire ); }
+
+    // Written by the producer.
+    alignas( 64 ) std::atomic<index_t> m_tail;
+    Block* m_tailBlock;
+    Block* m_spare;
+    QueueItem* m_pendingZone;
+
+    // Owned by the consumer.
+    alignas( 64 ) index_t m_head;
+    index_t m_headBase;
+    Block* m_headBlock;
+
+    alignas( 64 ) std::atomic<Block*> m_returned;
+    std::atomic<bool> m_orphaned;
+    std::atomic<uint32_t> m_node;
+    uint32_t m_thread;
+    ThreadQueue* m_next;
+    ThreadQueueProducerToken* m_token;
+    ThreadQueueSet* m_set;
+};
+
+// Stands in for moodycamel::ConcurrentQueue<QueueItem> when TRACY_THREAD_QUEUES is defined. Queues
+// of all threads are kept in a list. Threads only append to it when they are created. The single
+// consumer scans it in cycles which visit every queue once, picking up where it left off on the
+// previous call. Each cycle first visits the queues on the consumer's own NUMA node, then the
+// remaining ones. Queues of exited threads are recycled once drained.
+class ThreadQueueSet
+{
+public:
+    typedef ThreadQueue ExplicitProducer;
+
+    explicit ThreadQueueSet( size_t = 0 ) : m_list( nullptr ), m_cursor( nullptr ), m_remote( false ), m_free( nullptr ), m_reclaim( false ) {}
+    inline ~ThreadQueueSet();
+
+    ThreadQueue* get_explicit_producer( ThreadQueueProducerToken& token );
+
+    template<class NotifyThread, class ProcessData>
+    size_t try_dequeue_bulk_single( const ThreadQueueConsumerToken&, NotifyThread notifyThread, ProcessData processData )
+    {
+#ifdef TRACY_HAS_NUMA
+        const auto node = GetCurrentNumaNode();
+#else
+        const uint32_t node = 0;
+#endif
+        // Finishing the current pass and going through both passes of the next cycle covers all
+        // queues.
+        size_t sz = 0;
+        for( int i=0; i<3 && sz == 0; i++ )
+        {
+            auto queue = m_cursor ? m_cursor : m_list.load( std::memory_order_acquire );
+            while( queue )
+            {
+                auto next = queue->m_next;
+                if( ( queue->m_node.load( std::memory_order_relaxed ) != node ) == m_remote )
+                {
+                    sz = queue->dequeue_bulk( notifyThread, processData );
+                    if( queue->m_orphaned.load( std::memory_order_acquire ) ) m_reclaim = true;
+                    if( sz != 0 )
+                    {
+                        m_cursor = next;
+                        if( !next ) m_remote = !m_remote;
+                        break;
+                    }
+                }
+                queue = next;
+            }
+            if( !queue )
+            {
+                m_cursor = nullptr;
+                m_remote = !m_remote;
+            }
+        }
+
+        if( m_reclaim ) Reclaim();
+        return sz;
+    }
+
+    // Items waiting in all queues. Consumer only, as it reads the heads of the queues.
+    size_t size_approx() const
+    {
+        size_t sz = 0;
+        for( auto queue = m_list.load( std::memory_order_acquire ); queue; queue = queue->m_next )
+        {
+            sz += size_t( queue->m_tail.load( std::memory_order_relaxed ) - queue->m_head );
+        }
+        return sz;
+    }
+
+    ThreadQueueSet( const ThreadQueueSet& ) = delete;
+    ThreadQueueSet( ThreadQueueSet&& ) = delete;
+    ThreadQueueSet& operator=( const ThreadQueueSet& ) = delete;
+    ThreadQueueSet& operator=( ThreadQueueSet&& ) = delete;
+
+private:
+    friend class ThreadQueueProducerToken;
+
+    friend class ThreadQueue;
+
+    inline ThreadQueue* Acquire( ThreadQueueProducerToken* token );
+    inline void Reclaim();
+
+#ifdef TRACY_HAS_NUMA
+    enum { BlocksPerChunk = 16 };
+    static constexpr size_t ChunkHeaderSize = 64;
+    static constexpr size_t ChunkSize = ChunkHeaderSize + BlocksPerChunk * sizeof( ThreadQueue::Block );
+
+    struct NumaChunk
+    {
+        NumaChunk* next;
+    };
+
+    struct NumaPool
+    {
+        TracyMutex lock;
+        ThreadQueue::Block* free = nullptr;
+        NumaChunk* chunks = nullptr;
+    };
+
+    inline ThreadQueue::Block* AllocBlock( uint32_t node );
+    inline void FreeBlock( ThreadQueue::Block* block );
+
+    NumaPool m_pools[MaxNumaNodes];
+#endif
+
+    std::atomic<ThreadQueue*> m_list;
+    ThreadQueue* m_cursor;
+    bool m_remote;
+
+    TracyMutex m_freeLock;
+    ThreadQueue* m_free;
+    bool m_reclaim;
+};
+
+class ThreadQueueProducerToken
+{
+public:
+    explicit ThreadQueueProducerToken( ThreadQueueSet& set ) : m_queue( set.Acquire( this ) ) {}
+
+    ThreadQueueProducerToken( ThreadQueueProducerToken&& other ) noexcept
+        : m_queue( other.m_queue )
+    {
+        other.m_queue = nullptr;
+        if( m_queue ) m_queue->m_token = this;
+    }
+
+    ThreadQueueProducerToken& operator=( ThreadQueueProducerToken&& other ) noexcept
+    {
+        std::swap( m_queue, other.m_queue );
+        if( m_queue ) m_queue->m_token = this;
+        if( other.m_queue ) other.m_queue->m_token = &other;
+        return *this;
+    }
+
+    ~ThreadQueueProducerToken()
+    {
+        if( !m_queue ) return;
+        m_queue->m_token = nullptr;
+        m_queue->m_orphaned.store( true, std::memory_order_release );
+    }
+
+    ThreadQueueProducerToken( const ThreadQueueProducerToken& ) = delete;
+    ThreadQueueProducerToken& operator=( const ThreadQueueProducerToken& ) = delete;
+
+private:
+    friend class ThreadQueueSet;
+
+    ThreadQueue* m_queue;
+};
+
+// The consumer side keeps its state in the queue set, as there is only one consumer.
+struct ThreadQueueConsumerToken
+{
+    explicit ThreadQueueConsumerToken( ThreadQueueSet& ) {}
+};
+
+inline ThreadQueue* ThreadQueueSet::get_explicit_producer( ThreadQueueProducerToken& token )
+{
+    return token.m_queue;
+}
+
+ThreadQueue::~ThreadQueue()
+{
+    assert( m_head == m_tail.load( std::memory_order_relaxed ) );
+    if( m_headBlock )
+    {
+        m_headBlock->next.store( nullptr, std::memory_order_relaxed );
+        FreeList( m_headBlock );
+    }
+    FreeList( m_spare );
+    FreeList( m_returned.load( std::memory_order_acquire ) );
+}
+
+void ThreadQueue::FreeList( Block* block )
+{
+    while( block )
+    {
+        auto next = block->next.load( std::memory_order_relaxed );
+#ifdef TRACY_HAS_NUMA
+        m_set->FreeBlock( block );
+#else
+        tracy_free( block );
+#endif
+        block = next;
+    }
+}
+
+void ThreadQueue::AppendBlock()
+{
+    if( !m_spare ) m_spare = m_returned.exchange( nullptr, std::memory_order_acquire );
+#ifdef TRACY_HAS_NUMA
+    // Threads may have migrated since the spare blocks were allocated.
+    const auto node = GetCurrentNumaNode();
+    m_node.store( node, std::memory_order_relaxed );
+    while( m_spare && m_spare->node != node )
+    {
+        auto next = m_spare->next.load( std::memory_order_relaxed );
+        m_set->FreeBlock( m_spare );
+        m_spare = next;
+    }
+#endif
+    Block* block;
+    if( m_spare )
+    {
+        block = m_spare;
+        m_spare = block->next.load( std::memory_order_relaxed );
+    }
+    else
+    {
+#ifdef TRACY_HAS_NUMA
+        block = m_set->AllocBlock( node );
+#else
+        block = (Block*)tracy_malloc( sizeof( Block ) );
+        block->node = 0;
+#endif
+    }
+    block->next.store( nullptr, std::memory_order_relaxed );
+
+    if( m_tailBlock )
+    {
+        m_tailBlock->next.store( block, std::memory_order_release );
+    }
+    else
+    {
+        // First block. The consumer does not look at it before an item is published.
+        m_headBlock = block;
+    }
+    m_tailBlock = block;
+}
+
+#ifdef TRACY_HAS_NUMA
+ThreadQueue::Block* ThreadQueueSet::AllocBlock( uint32_t node )
+{
+    auto& pool = m_pools[node];
+    pool.lock.lock();
+    if( !pool.free )
+    {
+        auto chunk = (char*)NumaAlloc( ChunkSize, node );
+        if( !chunk )
+        {
+            pool.lock.unlock();
+            auto block = (ThreadQueue::Block*)tracy_malloc( sizeof( ThreadQueue::Block ) );
+            block->node = MaxNumaNodes;
+            return block;
+        }
+        ( (NumaChunk*)chunk )->next = pool.chunks;
+        pool.chunks = (NumaChunk*)chunk;
+        for( int i=0; i<BlocksPerChunk; i++ )
+        {
+            auto block = (ThreadQueue::Block*)( chunk + ChunkHeaderSize + i * sizeof( ThreadQueue::Block ) );
+            block->node = node;
+            block->next.store( pool.free, std::memory_order_relaxed );
+            pool.free = block;
+        }
+    }
+    auto block = pool.free;
+    pool.free = block->next.load( std::memory_order_relaxed );
+    pool.lock.unlock();
+    return block;
+}
+
+void ThreadQueueSet::FreeBlock( ThreadQueue::Block* block )
+{
+    if( block->node == MaxNumaNodes )
+    {
+        tracy_free( block );
+        return;
+    }
+    auto& pool = m_pools[block->node];
+    pool.lock.lock();
+    block->next.store( pool.free, std::memory_order_relaxed );
+    pool.free = block;
+    pool.lock.unlock();
+}
+#endif
+
+ThreadQueueSet::~ThreadQueueSet()
+{
+    auto queue = m_list.load( std::memory_order_acquire );
+    while( queue )
+    {
+        auto next = queue->m_next;
+        if( queue->m_token ) queue->m_token->m_queue = nullptr;
+        // Whatever was not consumed is dropped, as with moodycamel's queue.
+        queue->m_head = queue->m_tail.load( std::memory_order_relaxed );
+        queue->~ThreadQueue();
+        tracy_free( queue );
+        queue = next;
+    }
+    queue = m_free;
+    while( queue )
+    {
+        auto next = queue->m_next;
+        queue->~ThreadQueue();
+        tracy_free( queue );
+        queue = next;
+    }
+#ifdef TRACY_HAS_NUMA
+    for( auto& pool : m_pools )
+    {
+        auto chunk = pool.chunks;
+        while( chunk )
+        {
+            auto next = chunk->next;
+            NumaFree( chunk, ChunkSize );
+            chunk = next;
+        }
+    }
+#endif
+}
+
+ThreadQueue* ThreadQueueSet::Acquire( ThreadQueueProducerToken* token )
+{
+    m_freeLock.lock();
+    auto queue = m_free;
+    if( queue ) m_free = queue->m_next;
+    m_freeLock.unlock();
+
+    if( queue )
+    {
+        queue->m_thread = detail::GetThreadHandleImpl();
+        queue->m_orphaned.store( false, std::memory_order_relaxed );
+    }
+    else
+    {
+        queue = (ThreadQueue*)tracy_malloc( sizeof( ThreadQueue ) );
+        new(queue) ThreadQueue( this );
+    }
+    queue->m_token = token;
+
+    auto head = m_list.load( std::memory_order_relaxed );
+    do
+    {
+        queue->m_next = head;
+    }
+    while( !m_list.compare_exchange_weak( head, queue, std::memory_order_release, std::memory_order_relaxed ) );
+    return queue;
+}
+
+// Consumer side. Producers only ever prepend to the list, so everything past the list head can be
+// unlinked without synchronization.
+void ThreadQueueSet::Reclaim()
+{
+    m_reclaim = false;
+    m_cursor = nullptr;
+
+    ThreadQueue* prev = nullptr;
+    auto queue = m_list.load( std::memory_order_acquire );
+    while( queue )
+    {
+        auto next = queue->m_next;
+        if( queue->m_orphaned.load( std::memory_order_acquire ) && queue->IsDrained() )
+        {
+            if( prev )
+            {
+                prev->m_next = next;
+            }
+            else
+            {
+                auto expected = queue;
+                if( !m_list.compare_exchange_strong( expected, next, std::memory_order_acq_rel ) )
+                {
+                    // A new queue was prepended in the meantime.
+                    prev = expected;
+                    while( prev->m_next != queue ) prev = prev->m_next;
+                    prev->m_next = next;
+                }
+            }
+            m_freeLock.lock();
+            queue->m_next = m_free;
+            m_free = queue;
+            m_freeLock.unlock();
+        }
+        else
+        {
+            prev = queue;
+        }
+        queue = next;
+    }
+}
+
+}
+
+#if defined _MSC_VER
+#  pragma warning( pop )
+#endif
+
+#endif
+
+#endif
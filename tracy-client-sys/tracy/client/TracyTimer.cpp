@@ -1,2 +1,300 @@
 #include "TracyTimer.hpp"
 
+#ifdef TRACY_HAS_TSC_TIMER
+
+#include <chrono>
+#include <sched.h>
+#include <stdlib.h>
+#include <thread>
+#include <time.h>
+
+#include "TracyCpuid.hpp"
+#include "TracyDebug.hpp"
+#include "../common/TracySystem.hpp"
+
+namespace tracy
+{
+
+TRACY_API timers::tsc::Data timers::tsc::data;
+
+namespace
+{
+
+constexpr int64_t TscRevalidatePeriod = 1000 * 1000 * 1000;
+
+struct TscSample
+{
+    uint64_t tsc;
+    int64_t ns;             // middle of the kernel clock reads around the counter read
+    int64_t window;         // time between the kernel clock reads
+    uint32_t cpu;
+};
+
+cpu_set_t s_tscCpus;
+uint32_t s_tscCpu;          // where the first calibration was done, its offset is 0
+uint64_t s_tscFirst;
+int64_t s_nsFirst;
+int64_t s_tscLastRevalidate;
+uint32_t s_tscNextCpu;
+
+int64_t TscRawNs()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+    return int64_t( ts.tv_sec ) * 1000000000ll + ts.tv_nsec;
+}
+
+// Keeps the read with the smallest window, which is the one the least likely to have been
+// interrupted between the kernel clock reads.
+TscSample TscMeasure()
+{
+    TscSample best = {};
+    best.window = INT64_MAX;
+    for( int i=0; i<200; i++ )
+    {
+        unsigned int aux;
+        const auto t0 = TscRawNs();
+        const auto tsc = __rdtscp( &aux );
+        const auto t1 = TscRawNs();
+        if( t1 - t0 < best.window ) best = { tsc, t0 + ( t1 - t0 ) / 2, t1 - t0, aux & 0xFFF };
+    }
+    return best;
+}
+
+bool TscPin( uint32_t cpu )
+{
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    return sched_setaffinity( 0, sizeof( set ), &set ) == 0;
+}
+
+// Takes a sample on the reference CPU and one on the other CPU right after it. The difference of
+// the counters, less the ticks which have passed between the samples, is the offset of the CPU.
+// Offsets within the measurement error are taken as 0, as counters synchronized by the firmware
+// are the common case.
+bool TscMeasureOffset( uint32_t cpu, uint64_t mul, int64_t& offset )
+{
+    if( !TscPin( s_tscCpu ) ) return false;
+    const auto ref = TscMeasure();
+    if( !TscPin( cpu ) ) return false;
+    const auto s = TscMeasure();
+    if( ref.cpu != s_tscCpu || s.cpu != cpu ) return false;
+    const auto elapsed = int64_t( ( __int128( s.ns - ref.ns ) << 32 ) / mul );
+    const auto error = int64_t( ( __int128( s.window + ref.window ) << 32 ) / mul );
+    offset = int64_t( s.tsc - ref.tsc ) - elapsed;
+    if( llabs( offset ) <= error ) offset = 0;
+    return true;
+}
+
+}
+
+void TscTimerCalibrate()
+{
+    uint32_t regs[4];
+    if( !__get_cpuid( 0x80000000, regs, regs+1, regs+2, regs+3 ) || regs[0] < 0x80000007 ) return;
+    __get_cpuid( 0x80000001, regs, regs+1, regs+2, regs+3 );
+    if( !( regs[3] & ( 1 << 27 ) ) )
+    {
+        TracyDebug( "TSC timer: rdtscp is not supported" );
+        return;
+    }
+    __get_cpuid( 0x80000007, regs, regs+1, regs+2, regs+3 );
+    if( !( regs[3] & ( 1 << 8 ) ) )
+    {
+        const char* noCheck = GetEnvVar( "TRACY_NO_INVARIANT_CHECK" );
+        if( !noCheck || noCheck[0] != '1' )
+        {
+            TracyDebug( "TSC timer: the counter is not invariant" );
+            return;
+        }
+    }
+
+    // Fails if the kernel has more CPUs than fit in the set, which are more than MaxCpus.
+    cpu_set_t prev;
+    if( sched_getaffinity( 0, sizeof( prev ), &prev ) != 0 ) return;
+    static_assert( CPU_SETSIZE <= timers::tsc::MaxCpus, "CPU set is larger than the offset table" );
+
+    s_tscCpu = 0;
+    while( !CPU_ISSET( s_tscCpu, &prev ) ) s_tscCpu++;
+    if( !TscPin( s_tscCpu ) ) return;
+
+    const auto s0 = TscMeasure();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    const auto s1 = TscMeasure();
+    if( s0.cpu != s_tscCpu || s1.cpu != s_tscCpu || s1.tsc <= s0.tsc )
+    {
+        sched_setaffinity( 0, sizeof( prev ), &prev );
+        return;
+    }
+
+    auto& data = timers::tsc::data;
+    auto& p = data.params[0];
+    p.tscBase = s1.tsc;
+    p.nsBase = s1.ns;
+    p.mul = uint64_t( ( __int128( s1.ns - s0.ns ) << 32 ) / ( s1.tsc - s0.tsc ) );
+    data.current.store( 0, std::memory_order_relaxed );
+
+    for( uint32_t cpu=0; cpu<CPU_SETSIZE; cpu++ )
+    {
+        if( cpu == s_tscCpu || !CPU_ISSET( cpu, &prev ) ) continue;
+        int64_t offset;
+        if( TscMeasureOffset( cpu, p.mul, offset ) ) data.offset[cpu].store( offset, std::memory_order_relaxed );
+    }
+    sched_setaffinity( 0, sizeof( prev ), &prev );
+
+    s_tscCpus = prev;
+    s_tscFirst = s0.tsc;
+    s_nsFirst = s0.ns;
+    s_tscLastRevalidate = s1.ns;
+    s_tscNextCpu = 0;
+    data.enabled.store( true, std::memory_order_release );
+}
+
+void TscTimerRevalidate()
+{
+    auto& data = timers::tsc::data;
+    if( !timers::tsc::enabled() ) return;
+    const auto now = TscRawNs();
+    if( now - s_tscLastRevalidate < TscRevalidatePeriod ) return;
+    s_tscLastRevalidate = now;
+
+    cpu_set_t prev;
+    if( sched_getaffinity( 0, sizeof( prev ), &prev ) != 0 ) return;
+
+    const auto current = data.current.load( std::memory_order_relaxed );
+    const auto& p = data.params[current];
+
+    // One CPU per period, so that a CPU whose counter was written to by the firmware, e.g. after
+    // a resume, is caught eventually.
+    do { s_tscNextCpu = ( s_tscNextCpu + 1 ) % CPU_SETSIZE; } while( !CPU_ISSET( s_tscNextCpu, &s_tscCpus ) );
+    if( s_tscNextCpu != s_tscCpu )
+    {
+        int64_t offset;
+        if( TscMeasureOffset( s_tscNextCpu, p.mul, offset ) ) data.offset[s_tscNextCpu].store( offset, std::memory_order_relaxed );
+    }
+
+    if( !TscPin( s_tscCpu ) )
+    {
+        sched_setaffinity( 0, sizeof( prev ), &prev );
+        return;
+    }
+    const auto s = TscMeasure();
+    sched_setaffinity( 0, sizeof( prev ), &prev );
+    if( s.cpu != s_tscCpu || s.tsc <= s_tscFirst ) return;
+
+    // The slope over the whole run is the most precise one there is. The new parameters continue
+    // from the current conversion, so that time doesn't jump, and steer the error out over the
+    // next period. Errors too large to be steered out are stepped over.
+    const auto mapped = p.nsBase + int64_t( ( __int128( int64_t( s.tsc - p.tscBase ) ) * p.mul ) >> 32 );
+    const auto error = mapped - s.ns;
+    const auto mul = uint64_t( ( __int128( s.ns - s_nsFirst ) << 32 ) / ( s.tsc - s_tscFirst ) );
+
+    auto& n = data.params[current ^ 1];
+    n.tscBase = s.tsc;
+    if( llabs( error ) > TscRevalidatePeriod / 4 )
+    {
+        n.nsBase = s.ns;
+        n.mul = mul;
+    }
+    else
+    {
+        const auto periodTicks = ( __int128( TscRevalidatePeriod ) << 32 ) / mul;
+        n.nsBase = mapped;
+        n.mul = uint64_t( ( __int128( TscRevalidatePeriod - error ) << 32 ) / periodTicks );
+    }
+    data.current.store( current ^ 1, std::memory_order_release );
+}
+
+}
+
+#endif
+
+#ifdef TRACY_HAS_CNTVCT_TIMER
+
+#include <chrono>
+#include <stdlib.h>
+#include <thread>
+#include <time.h>
+
+#include "TracyDebug.hpp"
+
+namespace tracy
+{
+
+TRACY_API timers::cntvct::Data timers::cntvct::data;
+
+namespace
+{
+
+struct CntvctSample
+{
+    uint64_t ticks;
+    int64_t ns;             // middle of the kernel clock reads around the counter read
+    int64_t window;         // time between the kernel clock reads
+};
+
+int64_t CntvctRawNs()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+    return int64_t( ts.tv_sec ) * 1000000000ll + ts.tv_nsec;
+}
+
+CntvctSample CntvctMeasure()
+{
+    CntvctSample best = {};
+    best.window = INT64_MAX;
+    for( int i=0; i<200; i++ )
+    {
+        const auto t0 = CntvctRawNs();
+        const auto ticks = timers::cntvct::ticks();
+        const auto t1 = CntvctRawNs();
+        if( t1 - t0 < best.window ) best = { ticks, t0 + ( t1 - t0 ) / 2, t1 - t0 };
+    }
+    return best;
+}
+
+}
+
+void CntvctTimerCalibrate()
+{
+#ifdef __APPLE__
+    mach_timebase_info_data_t timebase;
+    if( mach_timebase_info( &timebase ) != KERN_SUCCESS || timebase.numer == 0 || timebase.denom == 0 ) return;
+    const auto mul = uint64_t( ( __int128( timebase.numer ) << 32 ) / timebase.denom );
+#else
+    uint64_t freq;
+    asm volatile( "mrs %0, cntfrq_el0" : "=r" (freq) );
+    if( freq == 0 )
+    {
+        TracyDebug( "CNTVCT timer: the counter frequency is not set" );
+        return;
+    }
+    const auto mul = uint64_t( ( __int128( 1000000000 ) << 32 ) / freq );
+#endif
+
+    // The kernel clock is derived from the same counter, unless the system uses another clock
+    // source or the frequency register is wrong, which the firmware of some boards gets wrong.
+    const auto s0 = CntvctMeasure();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    const auto s1 = CntvctMeasure();
+    if( s1.ticks <= s0.ticks ) return;
+    const auto predicted = int64_t( ( __int128( s1.ticks - s0.ticks ) * mul ) >> 32 );
+    const auto measured = s1.ns - s0.ns;
+    if( llabs( predicted - measured ) > measured / 1000 + s0.window + s1.window )
+    {
+        TracyDebug( "CNTVCT timer: the counter doesn't match the kernel clock" );
+        return;
+    }
+
+    auto& data = timers::cntvct::data;
+    data.base = s1.ticks;
+    data.nsBase = s1.ns;
+    data.mul = mul;
+    data.enabled.store( true, std::memory_order_release );
+}
+
+}
+
+#endif
@@ -15,8 +15,20 @@
 #  include <mach/mach_time.h>
 #endif
 
+#include "../common/TracyApi.h"
 #include "../common/TracyForceInline.hpp"
 
+#if defined TRACY_TSC_TIMER && defined __linux__ && defined __x86_64__
+#  define TRACY_HAS_TSC_TIMER
+#  include <atomic>
+#  include <x86intrin.h>
+#endif
+
+#if defined TRACY_TSC_TIMER && defined __aarch64__ && ( defined __linux__ || defined __APPLE__ ) && !defined TRACY_TIMER_FALLBACK
+#  define TRACY_HAS_CNTVCT_TIMER
+#  include <atomic>
+#endif
+
 // TODO: Move these to some kind of common utility code location
 #if __cplusplus >= 201803L
 #define TRACY_LIKELY [[likely]]
@@ -171,8 +183,105 @@ public:
 };
 #endif
 
+#ifdef TRACY_HAS_TSC_TIMER
+// Time stamp counter of the CPU, converted to CLOCK_MONOTONIC_RAW nanoseconds, so that it can be
+// mixed with the timestamps of the kernel. The counters of the CPUs are not assumed to be in sync,
+// the offset of every CPU is measured and rdtscp tells which CPU the counter was read on. The
+// conversion is calibrated by the profiler thread before the counter is used, and revalidated
+// periodically, see TscTimerRevalidate().
+struct tsc
+{
+    static constexpr uint32_t MaxCpus = 1024;
+
+    struct Params
+    {
+        uint64_t tscBase;
+        int64_t nsBase;
+        uint64_t mul;           // nanoseconds per tick, 32.32 fixed point
+    };
+
+    // The parameters are double buffered. A reader would have to stall for a full revalidation
+    // period to see a slot being overwritten.
+    struct Data
+    {
+        Params params[2];
+        std::atomic<uint32_t> current;
+        std::atomic<bool> enabled;
+        std::atomic<int64_t> offset[MaxCpus];   // in ticks
+    };
+
+    TRACY_API static Data data;
+
+    static tracy_force_inline bool enabled() { return data.enabled.load( std::memory_order_relaxed ); }
+
+    static tracy_force_inline int64_t now()
+    {
+        unsigned int aux;
+        const auto t = __rdtscp( &aux );
+        const auto& p = data.params[data.current.load( std::memory_order_acquire )];
+        // Linux keeps the CPU number in the low 12 bits and the NUMA node above.
+        const auto ticks = int64_t( t - p.tscBase ) - data.offset[aux & ( MaxCpus - 1 )].load( std::memory_order_relaxed );
+        return p.nsBase + int64_t( ( __int128( ticks ) * p.mul ) >> 32 );
+    }
+};
+#endif
+
+#ifdef TRACY_HAS_CNTVCT_TIMER
+// Virtual counter of the generic timer, converted to CLOCK_MONOTONIC_RAW nanoseconds. The
+// architecture keeps the counter in sync between the CPUs and at a fixed frequency, so one
+// conversion, set up by the profiler thread before the counter is used, holds for the whole run.
+// On macOS the counter is read through mach_continuous_time(), which is the same counter plus the
+// time spent asleep, like CLOCK_MONOTONIC_RAW there.
+struct cntvct
+{
+    struct Data
+    {
+        uint64_t base;
+        int64_t nsBase;
+        uint64_t mul;           // nanoseconds per tick, 32.32 fixed point
+        std::atomic<bool> enabled;
+    };
+
+    TRACY_API static Data data;
+
+    static tracy_force_inline bool enabled() { return data.enabled.load( std::memory_order_acquire ); }
+
+    static tracy_force_inline uint64_t ticks()
+    {
+#  ifdef __APPLE__
+        return mach_continuous_time();
+#  else
+        uint64_t t;
+        asm volatile( "mrs %0, cntvct_el0" : "=r" (t) );
+        return t;
+#  endif
+    }
+
+    static tracy_force_inline int64_t now()
+    {
+        return data.nsBase + int64_t( ( __int128( int64_t( ticks() - data.base ) ) * data.mul ) >> 32 );
+    }
+};
+#endif
+
 } // namespace timers
 
+#ifdef TRACY_HAS_CNTVCT_TIMER
+// Takes the frequency of the counter from the system and checks it against the kernel clock. The
+// counter is not used if they disagree.
+void CntvctTimerCalibrate();
+#endif
+
+#ifdef TRACY_HAS_TSC_TIMER
+// Checks for an invariant counter with rdtscp, which can be skipped with TRACY_NO_INVARIANT_CHECK=1,
+// and measures the offsets of all the CPUs the thread may run on. Moves the calling thread between
+// the CPUs.
+void TscTimerCalibrate();
+// Steers the conversion back to the kernel clock, and measures the offset of one CPU again. Does
+// nothing if called more often than once a second.
+void TscTimerRevalidate();
+#endif
+
 #if defined(TRACY_TIMER_FALLBACK)
 
 using high_res_time = std::chrono::steady_clock;
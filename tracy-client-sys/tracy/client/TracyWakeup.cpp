@@ -0,0 +1,74 @@
+#include "TracyWakeup.hpp"
+
+#ifdef TRACY_WORKER_WAKEUP
+
+#if defined __linux__
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+#elif defined _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#  ifdef _MSC_VER
+#    pragma comment(lib, "synchronization.lib")
+#  endif
+#else
+#  include <chrono>
+#endif
+
+namespace tracy
+{
+
+bool WorkerWakeup::Park( int ms )
+{
+    const auto seq = m_seq.load( std::memory_order_relaxed );
+    m_parked.store( 1, std::memory_order_seq_cst );
+#if defined __linux__
+    struct timespec timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_nsec = long( ms % 1000 ) * 1000 * 1000;
+    syscall( SYS_futex, &m_seq, FUTEX_WAIT_PRIVATE, seq, &timeout, nullptr, 0 );
+#elif defined _WIN32
+    auto expected = seq;
+    WaitOnAddress( &m_seq, &expected, sizeof( expected ), DWORD( ms ) );
+#else
+    {
+        std::unique_lock<std::mutex> lock( m_lock );
+        m_cv.wait_for( lock, std::chrono::milliseconds( ms ), [this, seq] { return m_seq.load( std::memory_order_relaxed ) != seq; } );
+    }
+#endif
+    m_parked.store( 0, std::memory_order_relaxed );
+    return m_seq.load( std::memory_order_relaxed ) != seq;
+}
+
+void WorkerWakeup::NotifySlow()
+{
+    // Only the first producer to see the worker parked makes the call.
+    if( m_parked.exchange( 0, std::memory_order_relaxed ) == 0 ) return;
+#if defined __linux__
+    m_seq.fetch_add( 1, std::memory_order_release );
+    syscall( SYS_futex, &m_seq, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0 );
+#elif defined _WIN32
+    m_seq.fetch_add( 1, std::memory_order_release );
+    WakeByAddressSingle( &m_seq );
+#else
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        m_seq.fetch_add( 1, std::memory_order_release );
+    }
+    m_cv.notify_one();
+#endif
+}
+
+TRACY_API WorkerWakeup& GetWorkerWakeup()
+{
+    static WorkerWakeup wakeup;
+    return wakeup;
+}
+
+}
+
+#endif
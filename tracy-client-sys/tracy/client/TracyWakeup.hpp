@@ -0,0 +1,54 @@
+#ifndef __TRACYWAKEUP_HPP__
+#define __TRACYWAKEUP_HPP__
+
+#ifdef TRACY_WORKER_WAKEUP
+
+#include <atomic>
+#include <stdint.h>
+
+#if !defined __linux__ && !defined _WIN32
+#  include <condition_variable>
+#  include <mutex>
+#endif
+
+#include "../common/TracyApi.h"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// Lets a worker thread sleep until there is work for it, instead of polling on a timer. The
+// worker announces that it parks and then waits on the wakeup counter, and producers only bump
+// the counter and make the wake up call while it is parked, so that the event hot path is a single
+// relaxed load. An event which races the announcement isn't seen, in which case the worker stays
+// parked until the timeout, as long as it would have slept when polling.
+class WorkerWakeup
+{
+public:
+    tracy_force_inline void Notify()
+    {
+        if( m_parked.load( std::memory_order_relaxed ) != 0 ) NotifySlow();
+    }
+
+    // Returns true if the wait was cut short by a notification.
+    bool Park( int ms );
+
+private:
+    void NotifySlow();
+
+    std::atomic<uint32_t> m_parked { 0 };
+    std::atomic<uint32_t> m_seq { 0 };
+#if !defined __linux__ && !defined _WIN32
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+#endif
+};
+
+// Wakes the profiler thread, which sends out the queued events.
+TRACY_API WorkerWakeup& GetWorkerWakeup();
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifdef TRACY_ZONE_CATEGORIES
+
+#include <stdio.h>
+#include <string.h>
+
+#include "TracyProfiler.hpp"
+#include "TracyZoneCategory.hpp"
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+TRACY_API std::atomic<uint32_t> s_zoneCategoryDisabled { 0 };
+
+TRACY_API void ZoneCategorySetup( uint32_t category, const char* name, bool enabled )
+{
+    if( category == 0 || category >= MaxZoneCategories ) return;
+    ZoneCategoryEnable( category, enabled );
+
+    // Parameter names have to stay valid for the lifetime of the profiler.
+    const auto lsz = strlen( name ) + 16;
+    auto label = (char*)tracy_malloc( lsz );
+    snprintf( label, lsz, "Category: %s", name );
+    Profiler::ParameterSetup( ZoneCategoryParameterBase + category, label, true, enabled ? 1 : 0 );
+}
+
+TRACY_API void ZoneCategoryEnable( uint32_t category, bool enabled )
+{
+    if( category == 0 || category >= MaxZoneCategories ) return;
+    if( enabled )
+    {
+        s_zoneCategoryDisabled.fetch_and( ~( 1u << category ), std::memory_order_relaxed );
+    }
+    else
+    {
+        s_zoneCategoryDisabled.fetch_or( 1u << category, std::memory_order_relaxed );
+    }
+}
+
+void ZoneCategoryParameter( uint32_t idx, int32_t val )
+{
+    ZoneCategoryEnable( idx, val != 0 );
+}
+
+}
+
+#endif
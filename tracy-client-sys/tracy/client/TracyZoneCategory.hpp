@@ -0,0 +1,59 @@
+#ifndef __TRACYZONECATEGORY_HPP__
+#define __TRACYZONECATEGORY_HPP__
+
+#include <atomic>
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+#include "../common/TracyForceInline.hpp"
+
+// Categories left out of this mask are compiled out of the category zone macros. Bit N stands for
+// category N. Category 0, for zones without a category, is always kept.
+#ifndef TRACY_ZONE_CATEGORY_MASK
+#  define TRACY_ZONE_CATEGORY_MASK 0xFFFFFFFF
+#endif
+
+// Source locations only carry a category with TRACY_ZONE_CATEGORIES. It defaults to zero, so the
+// plain zone macros keep their initializers, which needs C++14. Goes at the end of an initializer.
+#ifdef TRACY_ZONE_CATEGORIES
+#  define TracySrcLocCategory( category ) , category
+#else
+#  define TracySrcLocCategory( category )
+#endif
+
+namespace tracy
+{
+
+constexpr uint32_t MaxZoneCategories = 32;
+
+constexpr bool ZoneCategoryCompiled( uint32_t category )
+{
+    return category == 0 || ( category < MaxZoneCategories && ( ( uint32_t( TRACY_ZONE_CATEGORY_MASK ) >> category ) & 1 ) != 0 );
+}
+
+#ifdef TRACY_ZONE_CATEGORIES
+
+// Parameter indices starting at this one switch the categories on and off.
+constexpr uint32_t ZoneCategoryParameterBase = 0x80001000;
+
+// The categories which are switched off, bit N standing for category N.
+extern TRACY_API std::atomic<uint32_t> s_zoneCategoryDisabled;
+
+// Categories out of range can't be switched off, so they are always enabled.
+static tracy_force_inline bool ZoneCategoryEnabled( uint32_t category )
+{
+    return category >= MaxZoneCategories || ( ( s_zoneCategoryDisabled.load( std::memory_order_relaxed ) >> category ) & 1 ) == 0;
+}
+
+// Names a category, and registers it as a parameter, so that it can be switched from the
+// profiler. Categories range from 1 to 31, others are ignored.
+TRACY_API void ZoneCategorySetup( uint32_t category, const char* name, bool enabled );
+TRACY_API void ZoneCategoryEnable( uint32_t category, bool enabled );
+
+void ZoneCategoryParameter( uint32_t idx, int32_t val );
+
+#endif
+
+}
+
+#endif
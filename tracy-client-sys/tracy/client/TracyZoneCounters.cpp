@@ -0,0 +1,253 @@
+#ifdef TRACY_ZONE_COUNTERS
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#include "TracyZoneCounters.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+enum ZoneCounter
+{
+    ZoneCounterCycles,
+    ZoneCounterInstructions,
+    ZoneCounterL1dMisses,
+    ZoneCounterLlcMisses,
+    ZoneCounterBranchMisses
+};
+
+const char* const ZoneCounterNames[ZoneCounterCount] = {
+    "cycles",
+    "instructions",
+    "L1d misses",
+    "LLC misses",
+    "branch misses"
+};
+
+constexpr uint32_t ZoneCountersStackDepth = 64;
+
+#ifdef __linux__
+struct ZoneCounterEvent
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+const ZoneCounterEvent ZoneCounterEvents[ZoneCounterCount] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+// The cycle counter leads the perf event group of the thread, the others are left out if the CPU
+// can't count them. The group is scheduled onto the PMU as a whole, so all counters cover the
+// same time.
+struct ZoneCountersThread
+{
+    enum class State : uint8_t { Unopened, Open, Unavailable };
+
+    State state = State::Unopened;
+    uint32_t count = 0;                         // counters in the group
+    int fd[ZoneCounterCount];
+    int8_t slot[ZoneCounterCount];              // position in the group, -1 if not counted
+    perf_event_mmap_page* page[ZoneCounterCount];
+    size_t pageSize = 0;
+
+    ZoneCounters stack[ZoneCountersStackDepth];
+    uint32_t depth = 0;
+
+    ~ZoneCountersThread()
+    {
+        if( state != State::Open ) return;
+        for( uint32_t i=0; i<count; i++ )
+        {
+            if( page[i] ) munmap( page[i], pageSize );
+            close( fd[i] );
+        }
+    }
+};
+#else
+struct ZoneCountersThread
+{
+    ZoneCounters stack[ZoneCountersStackDepth];
+    uint32_t depth = 0;
+};
+#endif
+
+thread_local ZoneCountersThread s_zoneCounters;
+
+#ifdef __linux__
+bool ZoneCountersOpen( ZoneCountersThread& t )
+{
+    t.pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    int leader = -1;
+    for( uint32_t i=0; i<ZoneCounterCount; i++ )
+    {
+        t.slot[i] = -1;
+
+        perf_event_attr pe = {};
+        pe.type = ZoneCounterEvents[i].type;
+        pe.size = sizeof( perf_event_attr );
+        pe.config = ZoneCounterEvents[i].config;
+        pe.read_format = PERF_FORMAT_GROUP;
+        pe.disabled = leader < 0 ? 1 : 0;
+        pe.exclude_kernel = 1;
+        pe.exclude_hv = 1;
+
+        const int fd = (int)syscall( __NR_perf_event_open, &pe, 0, -1, leader, PERF_FLAG_FD_CLOEXEC );
+        if( fd < 0 )
+        {
+            if( leader < 0 ) return false;
+            continue;
+        }
+        if( leader < 0 ) leader = fd;
+
+        auto page = mmap( nullptr, t.pageSize, PROT_READ, MAP_SHARED, fd, 0 );
+        t.page[t.count] = page == MAP_FAILED ? nullptr : (perf_event_mmap_page*)page;
+        t.fd[t.count] = fd;
+        t.slot[i] = int8_t( t.count++ );
+    }
+    ioctl( leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+    ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    return true;
+}
+
+#if defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64
+tracy_force_inline uint64_t Rdpmc( uint32_t counter )
+{
+    uint32_t lo, hi;
+    asm volatile( "rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter) );
+    return ( uint64_t( hi ) << 32 ) | lo;
+}
+
+// Follows the protocol described for perf_event_mmap_page in perf_event.h. Fails if the kernel
+// doesn't allow rdpmc, or if the group is not on the PMU right now.
+bool ZoneCountersReadPmc( const ZoneCountersThread& t, uint64_t* values )
+{
+    for( uint32_t i=0; i<t.count; i++ )
+    {
+        const volatile perf_event_mmap_page* page = t.page[i];
+        if( !page ) return false;
+        uint32_t seq;
+        uint64_t value;
+        do
+        {
+            seq = page->lock;
+            std::atomic_signal_fence( std::memory_order_acq_rel );
+            const auto idx = page->index;
+            if( !page->cap_user_rdpmc || idx == 0 ) return false;
+            const auto shift = 64 - page->pmc_width;
+            const auto pmc = int64_t( Rdpmc( idx - 1 ) << shift ) >> shift;
+            value = page->offset + pmc;
+            std::atomic_signal_fence( std::memory_order_acq_rel );
+        }
+        while( page->lock != seq );
+        values[i] = value;
+    }
+    return true;
+}
+#else
+bool ZoneCountersReadPmc( const ZoneCountersThread&, uint64_t* ) { return false; }
+#endif
+
+bool ZoneCountersReadGroup( const ZoneCountersThread& t, uint64_t* values )
+{
+    uint64_t data[1 + ZoneCounterCount];
+    const auto sz = read( t.fd[0], data, sizeof( data ) );
+    if( sz < (ssize_t)sizeof( uint64_t ) || data[0] != t.count ) return false;
+    memcpy( values, data+1, t.count * sizeof( uint64_t ) );
+    return true;
+}
+#endif
+
+}
+
+TRACY_API void ZoneCountersRead( ZoneCounters& counters )
+{
+    counters.valid = false;
+#ifdef __linux__
+    auto& t = s_zoneCounters;
+    if( t.state != ZoneCountersThread::State::Open )
+    {
+        if( t.state == ZoneCountersThread::State::Unavailable ) return;
+        t.state = ZoneCountersOpen( t ) ? ZoneCountersThread::State::Open : ZoneCountersThread::State::Unavailable;
+        if( t.state == ZoneCountersThread::State::Unavailable ) return;
+    }
+
+    uint64_t values[ZoneCounterCount];
+    if( !ZoneCountersReadPmc( t, values ) && !ZoneCountersReadGroup( t, values ) ) return;
+    for( uint32_t i=0; i<ZoneCounterCount; i++ )
+    {
+        counters.value[i] = t.slot[i] < 0 ? 0 : values[t.slot[i]];
+    }
+    counters.valid = true;
+#endif
+}
+
+TRACY_API void ZoneCountersEmit( const ZoneCounters& start )
+{
+    if( !start.valid ) return;
+    ZoneCounters end;
+    ZoneCountersRead( end );
+    if( !end.valid ) return;
+
+    char buf[256];
+    size_t len = 0;
+    for( uint32_t i=0; i<ZoneCounterCount; i++ )
+    {
+#ifdef __linux__
+        if( s_zoneCounters.slot[i] < 0 ) continue;
+#endif
+        const auto delta = end.value[i] - start.value[i];
+        len += snprintf( buf+len, sizeof( buf ) - len, "%s%s: %" PRIu64, len == 0 ? "" : "\n", ZoneCounterNames[i], delta );
+        if( i == ZoneCounterInstructions )
+        {
+            const auto cycles = end.value[ZoneCounterCycles] - start.value[ZoneCounterCycles];
+            if( cycles != 0 ) len += snprintf( buf+len, sizeof( buf ) - len, " (IPC %.2f)", double( delta ) / cycles );
+        }
+    }
+
+    auto ptr = StringArenaAlloc( len );
+    memcpy( ptr, buf, len );
+    TracyQueuePrepare( QueueType::ZoneText );
+    MemWrite( &item->zoneTextFat.text, (uint64_t)ptr );
+    MemWrite( &item->zoneTextFat.size, (uint16_t)len );
+    TracyQueueCommit( zoneTextFatThread );
+}
+
+TRACY_API void ZoneCountersPush()
+{
+    auto& t = s_zoneCounters;
+    if( t.depth < ZoneCountersStackDepth ) ZoneCountersRead( t.stack[t.depth] );
+    t.depth++;
+}
+
+TRACY_API void ZoneCountersPop()
+{
+    auto& t = s_zoneCounters;
+    if( t.depth == 0 ) return;
+    t.depth--;
+    if( t.depth < ZoneCountersStackDepth ) ZoneCountersEmit( t.stack[t.depth] );
+}
+
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __TRACYZONECOUNTERS_HPP__
+#define __TRACYZONECOUNTERS_HPP__
+
+#ifdef TRACY_ZONE_COUNTERS
+
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+// Hardware performance counters of the calling thread: cycles, instructions, L1 data cache read
+// misses, last level cache misses and branch misses. They are read when a zone begins and when it
+// ends, and the differences are sent as the text of the zone. The counters only count user space
+// and follow the thread across CPUs. They are read with rdpmc where the kernel allows it, and with
+// a read() of the perf event group elsewhere.
+static constexpr uint32_t ZoneCounterCount = 5;
+
+struct ZoneCounters
+{
+    uint64_t value[ZoneCounterCount];
+    bool valid;
+};
+
+// The counters of a thread are opened by the first read on the thread. If the CPU has no counters
+// which can be used, e.g. when running in a virtual machine or with a restrictive
+// perf_event_paranoid, nothing is read and valid is left false.
+TRACY_API void ZoneCountersRead( ZoneCounters& counters );
+// Sends the differences to the counters read at the start of the current zone of the thread.
+TRACY_API void ZoneCountersEmit( const ZoneCounters& start );
+
+// For zones which have no place to keep the counters in, such as the ones of the C API. The
+// counters are kept on a stack of the thread, so such zones have to end in the order they were
+// started in.
+TRACY_API void ZoneCountersPush();
+TRACY_API void ZoneCountersPop();
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+#ifdef TRACY_ZONE_SAMPLING
+
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#include "TracyProfiler.hpp"
+#include "TracyZoneSampling.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+struct ZoneSamplingPolicy
+{
+    char* name;
+    char* label;
+    ZoneSamplingMode mode;
+    std::atomic<int32_t> value;
+};
+
+// Source locations which were already matched against the policies. The state holds the number
+// of policies at the time of matching in the upper bits, so that sites are matched again once new
+// policies are added, and the index of the matching policy plus one (or zero) in the low byte.
+struct ZoneSamplingSite
+{
+    std::atomic<const SourceLocationData*> srcloc;
+    std::atomic<uint32_t> state;
+};
+
+constexpr uint32_t ZoneSamplingSiteCount = 4096;
+constexpr uint32_t ZoneSamplingMaxProbe = 16;
+
+ZoneSamplingPolicy s_zoneSamplingPolicies[MaxZoneSamplingPolicies];
+std::atomic<uint32_t> s_zoneSamplingPolicyCount( 0 );
+TracyMutex s_zoneSamplingLock;
+ZoneSamplingSite s_zoneSamplingSites[ZoneSamplingSiteCount];
+
+// Per-thread state of the policies: zones passed over for OneIn, theoretical arrival time of the
+// next zone for PerSecond.
+thread_local uint32_t s_zoneSamplingCounter[MaxZoneSamplingPolicies];
+thread_local int64_t s_zoneSamplingNext[MaxZoneSamplingPolicies];
+
+}
+
+static uint32_t ZoneSamplingMatch( const SourceLocationData* srcloc, uint32_t count )
+{
+    const auto name = srcloc->name ? srcloc->name : srcloc->function;
+    if( !name ) return 0;
+    for( uint32_t i=0; i<count; i++ )
+    {
+        if( strcmp( s_zoneSamplingPolicies[i].name, name ) == 0 ) return i + 1;
+    }
+    return 0;
+}
+
+static uint32_t ZoneSamplingLookup( const SourceLocationData* srcloc, uint32_t count )
+{
+    auto idx = uint32_t( ( uint64_t( srcloc ) * 0x9E3779B97F4A7C15ull ) >> 52 );
+    for( uint32_t probe=0; probe<ZoneSamplingMaxProbe; probe++ )
+    {
+        auto& site = s_zoneSamplingSites[idx];
+        auto key = site.srcloc.load( std::memory_order_acquire );
+        if( !key && site.srcloc.compare_exchange_strong( key, srcloc, std::memory_order_acq_rel ) ) key = srcloc;
+        if( key == srcloc )
+        {
+            const auto state = site.state.load( std::memory_order_acquire );
+            if( ( state >> 8 ) == count ) return state & 0xFF;
+            const auto policy = ZoneSamplingMatch( srcloc, count );
+            site.state.store( ( count << 8 ) | policy, std::memory_order_release );
+            return policy;
+        }
+        idx = ( idx + 1 ) & ( ZoneSamplingSiteCount - 1 );
+    }
+    return ZoneSamplingMatch( srcloc, count );
+}
+
+TRACY_API void ZoneSamplingSetup( const char* name, ZoneSamplingMode mode, int32_t value )
+{
+    std::lock_guard<TracyMutex> lock( s_zoneSamplingLock );
+    const auto count = s_zoneSamplingPolicyCount.load( std::memory_order_relaxed );
+    for( uint32_t i=0; i<count; i++ )
+    {
+        if( strcmp( s_zoneSamplingPolicies[i].name, name ) == 0 )
+        {
+            s_zoneSamplingPolicies[i].value.store( value, std::memory_order_relaxed );
+            return;
+        }
+    }
+    if( count == MaxZoneSamplingPolicies ) return;
+
+    static const char* suffix[] = { "1 in N", "per second", "min ns" };
+    const auto nsz = strlen( name );
+    const auto lsz = nsz + 32;
+    auto& policy = s_zoneSamplingPolicies[count];
+    policy.name = (char*)tracy_malloc( nsz + 1 );
+    memcpy( policy.name, name, nsz + 1 );
+    // Parameter names have to stay valid for the lifetime of the profiler.
+    policy.label = (char*)tracy_malloc( lsz );
+    snprintf( policy.label, lsz, "Sampling: %s (%s)", name, suffix[(int)mode] );
+    policy.mode = mode;
+    policy.value.store( value, std::memory_order_relaxed );
+    s_zoneSamplingPolicyCount.store( count + 1, std::memory_order_release );
+
+    Profiler::ParameterSetup( ZoneSamplingParameterBase + count, policy.label, false, value );
+}
+
+TRACY_API int64_t ZoneSamplingCheck( const SourceLocationData* srcloc )
+{
+    const auto count = s_zoneSamplingPolicyCount.load( std::memory_order_acquire );
+    if( count == 0 ) return 0;
+    const auto match = ZoneSamplingLookup( srcloc, count );
+    if( match == 0 ) return 0;
+
+    const auto idx = match - 1;
+    auto& policy = s_zoneSamplingPolicies[idx];
+    const auto value = policy.value.load( std::memory_order_relaxed );
+    if( value <= 0 ) return 0;
+    switch( policy.mode )
+    {
+    case ZoneSamplingMode::OneIn:
+        if( ++s_zoneSamplingCounter[idx] < uint32_t( value ) ) return -1;
+        s_zoneSamplingCounter[idx] = 0;
+        return 0;
+    case ZoneSamplingMode::PerSecond:
+    {
+        // Token bucket holding up to one second worth of zones.
+        const int64_t second = 1000000000;
+        const auto interval = second / value;
+        const auto now = Profiler::GetTime();
+        auto& next = s_zoneSamplingNext[idx];
+        if( next < now ) next = now;
+        if( next - now > second - interval ) return -1;
+        next += interval;
+        return 0;
+    }
+    case ZoneSamplingMode::MinDuration:
+        return value;
+    default:
+        assert( false );
+        return 0;
+    }
+}
+
+void ZoneSamplingParameter( uint32_t idx, int32_t val )
+{
+    if( idx >= s_zoneSamplingPolicyCount.load( std::memory_order_acquire ) ) return;
+    s_zoneSamplingPolicies[idx].value.store( val, std::memory_order_relaxed );
+}
+
+}
+
+#endif
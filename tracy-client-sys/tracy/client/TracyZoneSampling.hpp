@@ -0,0 +1,41 @@
+#ifndef __TRACYZONESAMPLING_HPP__
+#define __TRACYZONESAMPLING_HPP__
+
+#ifdef TRACY_ZONE_SAMPLING
+
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+struct SourceLocationData;
+
+enum class ZoneSamplingMode : uint8_t
+{
+    OneIn,          // Keep one in every value zones.
+    PerSecond,      // Keep at most value zones per second on each thread.
+    MinDuration     // Keep zones lasting at least value nanoseconds.
+};
+
+// Parameter indices starting at this one are taken by the sampling policies.
+constexpr uint32_t ZoneSamplingParameterBase = 0x80000000;
+constexpr uint32_t MaxZoneSamplingPolicies = 64;
+
+// Applies a sampling policy to every zone with the given name. Unnamed zones are matched by their
+// function name. The value is also registered as a parameter, so that it can be adjusted from the
+// profiler. A value of zero keeps all zones. Setting up an existing policy only changes its value.
+TRACY_API void ZoneSamplingSetup( const char* name, ZoneSamplingMode mode, int32_t value );
+
+// Decides about a zone which is about to begin. A negative result drops the zone. Otherwise the
+// zone is kept if it lasts at least the returned number of nanoseconds.
+TRACY_API int64_t ZoneSamplingCheck( const SourceLocationData* srcloc );
+
+void ZoneSamplingParameter( uint32_t idx, int32_t val );
+
+}
+
+#endif
+
+#endif
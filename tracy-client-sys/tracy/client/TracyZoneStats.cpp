@@ -0,0 +1,377 @@
+#include "TracyZoneStats.hpp"
+
+#ifdef TRACY_HAS_ZONE_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TracyProfiler.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracySystem.hpp"
+
+namespace tracy
+{
+
+namespace
+{
+
+// The last site takes every source location which doesn't fit.
+constexpr uint32_t ZoneStatsOverflow = ZoneStatsSites - 1;
+constexpr uint32_t ZoneStatsMaxProbe = 16;
+// Outliers are only picked once a site has this many zones to base the percentile on.
+constexpr uint64_t ZoneStatsMinSamples = 100;
+
+// All written by the owning thread only. The counts and the histogram only ever grow, the
+// profiler thread works with the deltas. The minimum, kept as duration + 1 so that zero means
+// none, and the maximum are taken and reset by the profiler thread.
+struct ZoneStatsCounters
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint32_t> hist[ZoneStatsBuckets];
+};
+
+// Counters of one thread. Blocks are never freed, a block left by an exited thread is taken over
+// by the next new thread.
+struct ZoneStatsBlock
+{
+    ZoneStatsCounters sites[ZoneStatsSites];
+    std::atomic<bool> used;
+    ZoneStatsBlock* next;
+};
+
+struct ZoneStatsHolder
+{
+    ZoneStatsBlock* block;
+    ~ZoneStatsHolder() { if( block ) block->used.store( false, std::memory_order_release ); }
+};
+
+struct ZoneStatsEntry
+{
+    const SourceLocationData* srcloc;
+    int64_t start;
+    uint32_t id;
+    uint32_t site;
+#ifdef TRACY_ON_DEMAND
+    uint64_t connectionId;
+#endif
+};
+
+// The zones which were sent are always the outermost ones, as sending a zone sends the zones it is
+// nested in too.
+struct ZoneStatsStack
+{
+    ZoneStatsEntry entries[ZoneStatsMaxDepth];
+    uint32_t depth;
+    uint32_t emitted;
+};
+
+std::atomic<ZoneStatsBlock*> s_blocks { nullptr };
+std::atomic<const SourceLocationData*> s_siteSrcloc[ZoneStatsSites];
+// Duration from which a zone is an outlier, in nanoseconds. Zero while there is none.
+std::atomic<int64_t> s_siteThreshold[ZoneStatsSites];
+
+thread_local ZoneStatsHolder s_holder;
+thread_local ZoneStatsStack s_stack;
+
+ZoneStatsBlock* AcquireBlock()
+{
+    auto block = s_blocks.load( std::memory_order_acquire );
+    while( block )
+    {
+        bool expected = false;
+        if( !block->used.load( std::memory_order_relaxed ) && block->used.compare_exchange_strong( expected, true, std::memory_order_acquire ) ) return block;
+        block = block->next;
+    }
+
+    block = (ZoneStatsBlock*)tracy_malloc( sizeof( ZoneStatsBlock ) );
+    new(block) ZoneStatsBlock();
+    block->used.store( true, std::memory_order_relaxed );
+    block->next = s_blocks.load( std::memory_order_relaxed );
+    while( !s_blocks.compare_exchange_weak( block->next, block, std::memory_order_release, std::memory_order_relaxed ) ) {}
+    return block;
+}
+
+uint32_t GetSite( const SourceLocationData* srcloc )
+{
+    auto idx = uint32_t( ( uint64_t( srcloc ) * 0x9E3779B97F4A7C15ull ) >> 32 ) % ZoneStatsOverflow;
+    for( uint32_t probe=0; probe<ZoneStatsMaxProbe; probe++ )
+    {
+        auto& site = s_siteSrcloc[idx];
+        auto key = site.load( std::memory_order_acquire );
+        if( !key && site.compare_exchange_strong( key, srcloc, std::memory_order_acq_rel ) ) return idx;
+        if( key == srcloc ) return idx;
+        if( ++idx == ZoneStatsOverflow ) idx = 0;
+    }
+    return ZoneStatsOverflow;
+}
+
+// Two buckets per power of two, the upper half of each power of two going to the second one.
+tracy_force_inline uint32_t GetBucket( uint64_t ns )
+{
+    if( ns < 2 ) return uint32_t( ns );
+#if defined __GNUC__ || defined __clang__
+    const uint32_t log = 63 - __builtin_clzll( ns );
+#else
+    uint32_t log = 0;
+    for( auto v = ns >> 1; v != 0; v >>= 1 ) log++;
+#endif
+    const auto bucket = log * 2 + uint32_t( ( ns >> ( log - 1 ) ) & 1 );
+    return bucket < ZoneStatsBuckets ? bucket : ZoneStatsBuckets - 1;
+}
+
+// The shortest duration which falls into the bucket.
+int64_t GetBucketStart( uint32_t bucket )
+{
+    if( bucket < 2 ) return bucket;
+    const auto log = bucket / 2;
+    return int64_t( ( 1ull << log ) | ( uint64_t( bucket & 1 ) << ( log - 1 ) ) );
+}
+
+void Count( uint32_t site, int64_t duration )
+{
+    auto block = s_holder.block;
+    if( !block )
+    {
+        block = AcquireBlock();
+        s_holder.block = block;
+    }
+    auto& c = block->sites[site];
+    const auto ns = uint64_t( duration > 0 ? duration : 0 );
+    c.count.store( c.count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    c.total.store( c.total.load( std::memory_order_relaxed ) + ns, std::memory_order_relaxed );
+    auto& bucket = c.hist[GetBucket( ns )];
+    bucket.store( bucket.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+
+    auto max = c.max.load( std::memory_order_relaxed );
+    while( ns > max && !c.max.compare_exchange_weak( max, ns, std::memory_order_relaxed ) ) {}
+    auto min = c.min.load( std::memory_order_relaxed );
+    while( ( min == 0 || ns + 1 < min ) && !c.min.compare_exchange_weak( min, ns + 1, std::memory_order_relaxed ) ) {}
+}
+
+void EmitOpen( ZoneStatsStack& stack, uint32_t depth )
+{
+#ifdef TRACY_ON_DEMAND
+    auto& profiler = GetProfiler();
+    if( !profiler.IsConnected() ) return;
+    const auto connectionId = profiler.ConnectionId();
+#endif
+    for( uint32_t i=stack.emitted; i<depth; i++ )
+    {
+        auto& e = stack.entries[i];
+#ifndef TRACY_NO_VERIFY
+        if( e.id != 0 )
+        {
+            TracyQueuePrepare( QueueType::ZoneValidation );
+            MemWrite( &item->zoneValidation.id, e.id );
+            TracyQueueCommit( zoneValidationThread );
+        }
+#endif
+        TracyQueuePrepare( QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, e.start );
+        MemWrite( &item->zoneBegin.srcloc, (uint64_t)e.srcloc );
+        TracyQueueCommit( zoneBeginThread );
+#ifdef TRACY_ON_DEMAND
+        e.connectionId = connectionId;
+#endif
+    }
+    if( depth > stack.emitted ) stack.emitted = depth;
+}
+
+}
+
+TRACY_API void ZoneStatsBegin( const SourceLocationData* srcloc, uint32_t id )
+{
+    auto& stack = s_stack;
+    const auto depth = stack.depth++;
+    if( depth >= ZoneStatsMaxDepth ) return;
+    auto& e = stack.entries[depth];
+    e.srcloc = srcloc;
+    e.id = id;
+    e.site = GetSite( srcloc );
+    e.start = Profiler::GetTime();
+}
+
+TRACY_API void ZoneStatsEnd()
+{
+    const auto end = Profiler::GetTime();
+    auto& stack = s_stack;
+    const auto depth = --stack.depth;
+    if( depth >= ZoneStatsMaxDepth ) return;
+    auto& e = stack.entries[depth];
+    const auto duration = end - e.start;
+    Count( e.site, duration );
+
+    if( depth >= stack.emitted )
+    {
+        const auto threshold = s_siteThreshold[e.site].load( std::memory_order_relaxed );
+        if( threshold == 0 || duration < threshold ) return;
+        EmitOpen( stack, depth + 1 );
+        if( depth >= stack.emitted ) return;
+    }
+    stack.emitted = depth;
+
+#ifdef TRACY_ON_DEMAND
+    if( GetProfiler().ConnectionId() != e.connectionId ) return;
+#endif
+#ifndef TRACY_NO_VERIFY
+    if( e.id != 0 )
+    {
+        TracyQueuePrepare( QueueType::ZoneValidation );
+        MemWrite( &item->zoneValidation.id, e.id );
+        TracyQueueCommit( zoneValidationThread );
+    }
+#endif
+    TracyQueuePrepare( QueueType::ZoneEnd );
+    MemWrite( &item->zoneEnd.time, end );
+    TracyQueueCommit( zoneEndThread );
+}
+
+TRACY_API void ZoneStatsEmitOpen()
+{
+    auto& stack = s_stack;
+    EmitOpen( stack, std::min( stack.depth, ZoneStatsMaxDepth ) );
+}
+
+ZoneStats::ZoneStats()
+    : m_interval( 1000 )
+    , m_outliers( 0 )
+    , m_lastTime( 0 )
+{
+    memset( m_sites, 0, sizeof( m_sites ) );
+
+    const char* interval = GetEnvVar( "TRACY_ZONE_STATS_INTERVAL" );
+    if( interval && atoi( interval ) > 0 ) m_interval = atoi( interval );
+    const char* outliers = GetEnvVar( "TRACY_ZONE_STATS_OUTLIERS" );
+    if( outliers )
+    {
+        const auto percentile = atof( outliers );
+        if( percentile > 0 && percentile < 100 ) m_outliers = percentile / 100;
+    }
+}
+
+ZoneStats::~ZoneStats()
+{
+    for( auto& site : m_sites )
+    {
+        if( site.plotCalls )
+        {
+            tracy_free( site.plotCalls );
+            tracy_free( site.plotMean );
+            tracy_free( site.plotMin );
+            tracy_free( site.plotMax );
+            tracy_free( site.plotP99 );
+        }
+    }
+}
+
+void ZoneStats::Tick()
+{
+    auto t = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    if( t - m_lastTime <= m_interval * 1000000 ) return;
+    m_lastTime = t;
+
+    for( uint32_t i=0; i<ZoneStatsSites; i++ )
+    {
+        const auto srcloc = s_siteSrcloc[i].load( std::memory_order_acquire );
+        if( !srcloc && i != ZoneStatsOverflow ) continue;
+        auto& site = m_sites[i];
+
+        uint64_t count = 0;
+        uint64_t total = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        uint32_t hist[ZoneStatsBuckets] = {};
+        for( auto block = s_blocks.load( std::memory_order_acquire ); block; block = block->next )
+        {
+            auto& c = block->sites[i];
+            count += c.count.load( std::memory_order_relaxed );
+            total += c.total.load( std::memory_order_relaxed );
+            if( c.max.load( std::memory_order_relaxed ) != 0 ) max = std::max( max, c.max.exchange( 0, std::memory_order_relaxed ) );
+            const auto m = c.min.load( std::memory_order_relaxed ) != 0 ? c.min.exchange( 0, std::memory_order_relaxed ) : 0;
+            if( m != 0 && ( min == 0 || m < min ) ) min = m;
+            for( uint32_t b=0; b<ZoneStatsBuckets; b++ ) hist[b] += c.hist[b].load( std::memory_order_relaxed );
+        }
+
+        const auto calls = count - site.count;
+        if( calls == 0 && !site.active ) continue;
+        if( !site.plotCalls )
+        {
+            if( i == ZoneStatsOverflow ) Setup( site, "Other zones", nullptr, 0 );
+            else Setup( site, srcloc->name ? srcloc->name : srcloc->function, srcloc->file, srcloc->line );
+        }
+
+        // Histogram counts wrap around, their deltas don't as long as an interval has less than
+        // 2^32 zones.
+        uint64_t seen = 0;
+        uint32_t p99 = 0;
+        uint64_t below = 0;
+        for( uint32_t b=0; b<ZoneStatsBuckets; b++ )
+        {
+            const auto delta = uint32_t( hist[b] - site.hist[b] );
+            site.hist[b] = hist[b];
+            site.seen[b] += delta;
+            seen += site.seen[b];
+            if( below * 100 < calls * 99 ) p99 = b;
+            below += delta;
+        }
+
+        if( calls != 0 )
+        {
+            Profiler::PlotData( site.plotCalls, int64_t( calls ) );
+            Profiler::PlotData( site.plotMean, int64_t( ( total - site.total ) / calls ) );
+            Profiler::PlotData( site.plotMin, int64_t( min != 0 ? min - 1 : 0 ) );
+            Profiler::PlotData( site.plotMax, int64_t( max ) );
+            Profiler::PlotData( site.plotP99, GetBucketStart( p99 + 1 ) );
+        }
+        else
+        {
+            Profiler::PlotData( site.plotCalls, int64_t( 0 ) );
+        }
+
+        // The outliers are picked from the durations seen over the whole run.
+        if( m_outliers > 0 && seen >= ZoneStatsMinSamples && i != ZoneStatsOverflow )
+        {
+            const auto limit = uint64_t( seen * m_outliers );
+            uint64_t sum = 0;
+            uint32_t b = 0;
+            while( b < ZoneStatsBuckets - 1 && sum + site.seen[b] <= limit ) sum += site.seen[b++];
+            s_siteThreshold[i].store( GetBucketStart( b + 1 ), std::memory_order_relaxed );
+        }
+
+        site.count = count;
+        site.total = total;
+        site.active = calls != 0;
+    }
+}
+
+// Unnamed zones in the same function, or zones sharing a name, are told apart by their location.
+void ZoneStats::Setup( Site& site, const char* name, const char* file, uint32_t line )
+{
+    const auto sz = strlen( name ) + ( file ? strlen( file ) + 16 : 0 ) + 16;
+    auto prefix = (char*)tracy_malloc( sz );
+    if( file ) snprintf( prefix, sz, "%s (%s:%u)", name, file, unsigned( line ) );
+    else memcpy( prefix, name, strlen( name ) + 1 );
+    site.plotCalls = (char*)tracy_malloc( sz );
+    site.plotMean = (char*)tracy_malloc( sz );
+    site.plotMin = (char*)tracy_malloc( sz );
+    site.plotMax = (char*)tracy_malloc( sz );
+    site.plotP99 = (char*)tracy_malloc( sz );
+    snprintf( site.plotCalls, sz, "%s calls", prefix );
+    snprintf( site.plotMean, sz, "%s mean ns", prefix );
+    snprintf( site.plotMin, sz, "%s min ns", prefix );
+    snprintf( site.plotMax, sz, "%s max ns", prefix );
+    snprintf( site.plotP99, sz, "%s p99 ns", prefix );
+    tracy_free( prefix );
+}
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __TRACYZONESTATS_HPP__
+#define __TRACYZONESTATS_HPP__
+
+// Fibers move zones between threads, which the per-thread zone stack can't follow.
+#if defined TRACY_ZONE_STATS && !defined TRACY_FIBERS
+#  define TRACY_HAS_ZONE_STATS
+#endif
+
+#ifdef TRACY_HAS_ZONE_STATS
+
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+struct SourceLocationData;
+
+// Instead of sending each zone with a constant source location, the zones are counted per source
+// location in per-thread counters: the number of zones, their total, minimum and maximum duration,
+// and a histogram of the durations with two buckets per power of two nanoseconds. The profiler
+// thread turns them into plots of each source location every TRACY_ZONE_STATS_INTERVAL ms (1000
+// by default). Source locations past the first ZoneStatsSites - 1 are counted together.
+//
+// Zones slower than the TRACY_ZONE_STATS_OUTLIERS percentile (e.g. 99.9) of their source location
+// are sent as regular zones, together with the zones they are nested in. So are the zones which
+// get a text, a name, a color or a value, and the ones enclosing a zone which is always sent, such
+// as a zone with a callstack or an allocated source location.
+static constexpr uint32_t ZoneStatsSites = 128;
+static constexpr uint32_t ZoneStatsBuckets = 64;
+// Zones nested deeper than this are not counted.
+static constexpr uint32_t ZoneStatsMaxDepth = 128;
+// Set in the ids of the C API zones which are counted, so that they can be told apart at the end.
+static constexpr uint32_t ZoneStatsIdFlag = 0x80000000;
+
+// The id is sent with the zone for validation if it gets sent, zero for none. Zones have to end
+// in the order they were started in.
+TRACY_API void ZoneStatsBegin( const SourceLocationData* srcloc, uint32_t id );
+TRACY_API void ZoneStatsEnd();
+// Sends the begins of all the counted zones of the thread which are still open and not sent yet.
+TRACY_API void ZoneStatsEmitOpen();
+
+class ZoneStats
+{
+    struct Site
+    {
+        uint64_t count;
+        uint64_t total;
+        uint32_t hist[ZoneStatsBuckets];
+        uint64_t seen[ZoneStatsBuckets];
+        char* plotCalls;
+        char* plotMean;
+        char* plotMin;
+        char* plotMax;
+        char* plotP99;
+        bool active;
+    };
+
+public:
+    ZoneStats();
+    ~ZoneStats();
+
+    void Tick();
+
+private:
+    void Setup( Site& site, const char* name, const char* file, uint32_t line );
+
+    Site m_sites[ZoneStatsSites];
+    int64_t m_interval;
+    double m_outliers;
+    int64_t m_lastTime;
+};
+
+}
+
+#endif
+
+#endif
@@ -943,7 +943,8 @@ private:
 			pr_blockIndexSize(EXPLICIT_INITIAL_INDEX_SIZE >> 1),
 			pr_blockIndexFront(0),
 			pr_blockIndexEntries(nullptr),
-			pr_blockIndexRaw(nullptr)
+			pr_blockIndexRaw(nullptr),
+			pr_pendingZone(nullptr)
 		{
 			size_t poolBasedIndexSize = details::ceil_to_pow_2(_parent->initialBlockPoolSize) >> 1;
 			if (poolBasedIndexSize > pr_blockIndexSize) {
@@ -1072,11 +1073,27 @@ private:
             return (*this->tailBlock)[currentTailIndex];
         }
 
+        // Slot at an index past the published tail. Indices must be visited in order, starting
+        // from the current tail; the caller publishes them by storing the new tail index.
+        tracy_force_inline T* enqueue_at(index_t currentTailIndex)
+        {
+            if (details::cqUnlikely((currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0)) {
+                this->enqueue_begin_alloc(currentTailIndex);
+            }
+            return (*this->tailBlock)[currentTailIndex];
+        }
+
         tracy_force_inline std::atomic<index_t>& get_tail_index()
         {
             return this->tailIndex;
         }
 
+        // Item at the tail which is written, but held back from publishing (TRACY_COMPACT_ZONES).
+        tracy_force_inline T*& get_pending_zone()
+        {
+            return this->pr_pendingZone;
+        }
+
 		template<class NotifyThread, class ProcessData>
 		size_t dequeue_bulk(NotifyThread notifyThread, ProcessData processData)
 		{
@@ -1204,6 +1221,7 @@ private:
 		size_t pr_blockIndexFront;		// Next slot (not current)
 		BlockIndexEntry* pr_blockIndexEntries;
 		void* pr_blockIndexRaw;
+		T* pr_pendingZone;
 	};
 
     ExplicitProducer* get_explicit_producer(producer_token_t const& token)
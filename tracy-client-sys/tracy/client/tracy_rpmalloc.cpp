@@ -184,6 +184,12 @@ extern int madvise(caddr_t, size_t, int);
 #  ifndef MAP_UNINITIALIZED
 #    define MAP_UNINITIALIZED 0
 #  endif
+#  ifndef MAP_POPULATE
+#    define MAP_POPULATE 0
+#  endif
+#  if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+#    define MADV_POPULATE_WRITE 23
+#  endif
 #endif
 #include <errno.h>
 
@@ -891,13 +897,15 @@ _rpmalloc_mmap_os(size_t size, size_t* offset) {
 	}
 #else
 	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNINITIALIZED;
+	int populate = _memory_config.populate_pages ? MAP_POPULATE : 0;
+	(void)populate;
 #  if defined(__APPLE__) && !TARGET_OS_IPHONE && !TARGET_OS_SIMULATOR
 	int fd = (int)VM_MAKE_TAG(240U);
 	if (_memory_huge_pages)
 		fd |= VM_FLAGS_SUPERPAGE_SIZE_2MB;
 	void* ptr = mmap(0, size + padding, PROT_READ | PROT_WRITE, flags, fd, 0);
 #  elif defined(MAP_HUGETLB)
-	void* ptr = mmap(0, size + padding, PROT_READ | PROT_WRITE | PROT_MAX(PROT_READ | PROT_WRITE), (_memory_huge_pages ? MAP_HUGETLB : 0) | flags, -1, 0);
+	void* ptr = mmap(0, size + padding, PROT_READ | PROT_WRITE | PROT_MAX(PROT_READ | PROT_WRITE), (_memory_huge_pages ? MAP_HUGETLB : 0) | flags | populate, -1, 0);
 #    if defined(MADV_HUGEPAGE)
 	// In some configurations, huge pages allocations might fail thus
 	// we fallback to normal allocations and promote the region as transparent huge page
@@ -907,6 +915,11 @@ _rpmalloc_mmap_os(size_t size, size_t* offset) {
 			int prm = madvise(ptr, size + padding, MADV_HUGEPAGE);
 			(void)prm;
 			rpmalloc_assert((prm == 0), "Failed to promote the page to THP");
+#      if defined(MADV_POPULATE_WRITE)
+			// Populated only now, so that the pages are already huge ones.
+			if (populate)
+				madvise(ptr, size + padding, MADV_POPULATE_WRITE);
+#      endif
 		}
 	}
 #    endif
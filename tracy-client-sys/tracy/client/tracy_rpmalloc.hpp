@@ -190,6 +190,9 @@ typedef struct rpmalloc_config_t {
 	//  supporting it to be able to distinguish among anonymous regions.
 	const char *page_name;
 	const char *huge_page_name;
+	//! Fault in the pages of every memory map up front (Linux only), so that first use of
+	//  the memory doesn't stall on page faults.
+	int populate_pages;
 } rpmalloc_config_t;
 
 //! Initialize allocator with default configuration
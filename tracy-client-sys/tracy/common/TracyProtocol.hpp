@@ -56,7 +56,8 @@ enum ServerQuery : uint8_t
     ServerQuerySymbolCode,
     ServerQuerySourceCode,
     ServerQueryDataTransfer,
-    ServerQueryDataTransferPart
+    ServerQueryDataTransferPart,
+    ServerQueryShmTransport     // see ShmRingWriter
 };
 
 struct ServerQueryPacket
@@ -128,6 +128,7 @@ enum class QueueType : uint8_t
     SymbolCode,
     SourceCode,
     FiberName,
+    ZoneCompact,        // only used in client queues, never sent
     NUM_TYPES
 };
 
@@ -153,6 +154,11 @@ struct QueueZoneBeginThread : public QueueZoneBegin
     uint32_t thread;
 };
 
+struct QueueZoneCompact : public QueueZoneBegin
+{
+    int64_t end;
+};
+
 struct QueueZoneEnd
 {
     int64_t time;
@@ -785,6 +791,7 @@ struct QueueItem
         QueueZoneBegin zoneBegin;
         QueueZoneBeginLean zoneBeginLean;
         QueueZoneBeginThread zoneBeginThread;
+        QueueZoneCompact zoneCompact;
         QueueZoneEnd zoneEnd;
         QueueZoneEndThread zoneEndThread;
         QueueZoneValidation zoneValidation;
@@ -997,6 +1004,7 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // symbol code
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // source code
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // fiber name
+    sizeof( QueueHeader ) + sizeof( QueueZoneCompact ),     // not sent
 };
 
 static_assert( QueueItemSize == 32, "Queue item size not 32 bytes" );
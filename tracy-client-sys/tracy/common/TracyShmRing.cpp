@@ -0,0 +1,245 @@
+#include "TracyShmRing.hpp"
+
+#ifdef TRACY_HAS_SHM_TRANSPORT
+
+#include <algorithm>
+#include <assert.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace tracy
+{
+
+static void ShmFutexWait( std::atomic<uint32_t>* addr, uint32_t expected, int ms )
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = long( ms % 1000 ) * 1000000;
+    // Not FUTEX_PRIVATE_FLAG, the other side lives in another process.
+    syscall( SYS_futex, (uint32_t*)addr, FUTEX_WAIT, expected, &ts, nullptr, 0 );
+}
+
+static void ShmFutexWake( std::atomic<uint32_t>* addr )
+{
+    syscall( SYS_futex, (uint32_t*)addr, FUTEX_WAKE, 1, nullptr, nullptr, 0 );
+}
+
+ShmRingWriter::ShmRingWriter()
+    : m_hdr( nullptr )
+    , m_data( nullptr )
+    , m_mapSize( 0 )
+    , m_size( 0 )
+    , m_linked( false )
+{
+    m_name[0] = '\0';
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    if( !m_hdr ) return;
+    m_hdr->closed.store( 1, std::memory_order_release );
+    m_hdr->headSeq.fetch_add( 1, std::memory_order_release );
+    ShmFutexWake( &m_hdr->headSeq );
+    Unlink();
+    munmap( m_hdr, m_mapSize );
+}
+
+bool ShmRingWriter::Create( size_t size )
+{
+    assert( !m_hdr );
+    size_t ringSize = 64 * 1024;
+    while( ringSize < size ) ringSize *= 2;
+
+    static std::atomic<uint32_t> s_counter { 0 };
+    snprintf( m_name, ShmRingNameSize, "/tracy-%d-%u", int( getpid() ), s_counter.fetch_add( 1, std::memory_order_relaxed ) );
+    const int fd = shm_open( m_name, O_CREAT | O_EXCL | O_RDWR, 0600 );
+    if( fd == -1 )
+    {
+        m_name[0] = '\0';
+        return false;
+    }
+    m_linked = true;
+
+    const auto mapSize = sizeof( ShmRingHeader ) + ringSize;
+    void* map = MAP_FAILED;
+    if( ftruncate( fd, off_t( mapSize ) ) == 0 ) map = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED )
+    {
+        Unlink();
+        m_name[0] = '\0';
+        return false;
+    }
+
+    m_hdr = new(map) ShmRingHeader();
+    m_hdr->magic = ShmRingMagic;
+    m_hdr->version = ShmRingVersion;
+    m_hdr->size = ringSize;
+    m_hdr->attached.store( 0, std::memory_order_relaxed );
+    m_hdr->closed.store( 0, std::memory_order_relaxed );
+    m_hdr->head.store( 0, std::memory_order_relaxed );
+    m_hdr->headSeq.store( 0, std::memory_order_relaxed );
+    m_hdr->readerWaiting.store( 0, std::memory_order_relaxed );
+    m_hdr->tail.store( 0, std::memory_order_relaxed );
+    m_hdr->tailSeq.store( 0, std::memory_order_relaxed );
+    m_hdr->writerWaiting.store( 0, std::memory_order_relaxed );
+    m_data = (char*)map + sizeof( ShmRingHeader );
+    m_mapSize = mapSize;
+    m_size = ringSize;
+    return true;
+}
+
+bool ShmRingWriter::Write( const SocketChunk* chunks, int num, int timeout )
+{
+    assert( m_hdr );
+    // The reader can write to the header, only the positions are taken from it.
+    const auto size = m_size;
+    auto head = m_hdr->head.load( std::memory_order_relaxed );
+    for( int i=0; i<num; i++ )
+    {
+        auto ptr = (const char*)chunks[i].buf;
+        auto len = size_t( chunks[i].len );
+        int waited = 0;
+        while( len > 0 )
+        {
+            auto tail = m_hdr->tail.load( std::memory_order_acquire );
+            if( head - tail > size ) return false;
+            if( head - tail == size )
+            {
+                Publish( head );
+                if( m_hdr->closed.load( std::memory_order_acquire ) != 0 ) return false;
+                const auto seq = m_hdr->tailSeq.load( std::memory_order_acquire );
+                m_hdr->writerWaiting.store( 1, std::memory_order_seq_cst );
+                tail = m_hdr->tail.load( std::memory_order_seq_cst );
+                if( head - tail > size ) return false;
+                if( head - tail == size )
+                {
+                    if( waited >= timeout ) return false;
+                    ShmFutexWait( &m_hdr->tailSeq, seq, 10 );
+                    waited += 10;
+                    continue;
+                }
+            }
+            waited = 0;
+            const auto offset = size_t( head & ( size - 1 ) );
+            const auto n = std::min( { len, size_t( size - ( head - tail ) ), size_t( size - offset ) } );
+            memcpy( m_data + offset, ptr, n );
+            ptr += n;
+            len -= n;
+            head += n;
+        }
+    }
+    Publish( head );
+    if( m_linked && m_hdr->attached.load( std::memory_order_relaxed ) != 0 ) Unlink();
+    return m_hdr->closed.load( std::memory_order_relaxed ) == 0;
+}
+
+void ShmRingWriter::Publish( uint64_t head )
+{
+    if( m_hdr->head.load( std::memory_order_relaxed ) == head ) return;
+    m_hdr->head.store( head, std::memory_order_release );
+    m_hdr->headSeq.fetch_add( 1, std::memory_order_seq_cst );
+    if( m_hdr->readerWaiting.load( std::memory_order_seq_cst ) != 0 )
+    {
+        m_hdr->readerWaiting.store( 0, std::memory_order_relaxed );
+        ShmFutexWake( &m_hdr->headSeq );
+    }
+}
+
+// The object is only needed under its name until the reader has it mapped.
+void ShmRingWriter::Unlink()
+{
+    if( !m_linked ) return;
+    shm_unlink( m_name );
+    m_linked = false;
+}
+
+ShmRingReader::ShmRingReader()
+    : m_hdr( nullptr )
+    , m_data( nullptr )
+    , m_mapSize( 0 )
+    , m_size( 0 )
+{
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    if( !m_hdr ) return;
+    m_hdr->closed.store( 1, std::memory_order_release );
+    m_hdr->tailSeq.fetch_add( 1, std::memory_order_release );
+    ShmFutexWake( &m_hdr->tailSeq );
+    munmap( m_hdr, m_mapSize );
+}
+
+bool ShmRingReader::Open( const char* name )
+{
+    assert( !m_hdr );
+    const int fd = shm_open( name, O_RDWR, 0 );
+    if( fd == -1 ) return false;
+    struct
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t size;
+    } info;
+    if( pread( fd, &info, sizeof( info ), 0 ) != sizeof( info ) || info.magic != ShmRingMagic || info.version != ShmRingVersion ||
+        info.size == 0 || ( info.size & ( info.size - 1 ) ) != 0 )
+    {
+        close( fd );
+        return false;
+    }
+    const auto mapSize = sizeof( ShmRingHeader ) + size_t( info.size );
+    auto map = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED ) return false;
+    m_hdr = (ShmRingHeader*)map;
+    m_data = (char*)map + sizeof( ShmRingHeader );
+    m_mapSize = mapSize;
+    m_size = size_t( info.size );
+    m_hdr->attached.store( 1, std::memory_order_release );
+    return true;
+}
+
+int ShmRingReader::Read( void* buf, int len, int timeout )
+{
+    assert( m_hdr );
+    const auto size = m_size;
+    const auto tail = m_hdr->tail.load( std::memory_order_relaxed );
+    auto head = m_hdr->head.load( std::memory_order_acquire );
+    if( head == tail )
+    {
+        if( m_hdr->closed.load( std::memory_order_acquire ) != 0 ) return -1;
+        const auto seq = m_hdr->headSeq.load( std::memory_order_acquire );
+        m_hdr->readerWaiting.store( 1, std::memory_order_seq_cst );
+        head = m_hdr->head.load( std::memory_order_seq_cst );
+        if( head == tail )
+        {
+            ShmFutexWait( &m_hdr->headSeq, seq, timeout );
+            head = m_hdr->head.load( std::memory_order_acquire );
+            if( head == tail ) return m_hdr->closed.load( std::memory_order_acquire ) != 0 ? -1 : 0;
+        }
+    }
+
+    const auto offset = size_t( tail & ( size - 1 ) );
+    const auto n = std::min( { size_t( len ), size_t( head - tail ), size_t( size - offset ) } );
+    memcpy( buf, m_data + offset, n );
+    m_hdr->tail.store( tail + n, std::memory_order_release );
+    m_hdr->tailSeq.fetch_add( 1, std::memory_order_seq_cst );
+    if( m_hdr->writerWaiting.load( std::memory_order_seq_cst ) != 0 )
+    {
+        m_hdr->writerWaiting.store( 0, std::memory_order_relaxed );
+        ShmFutexWake( &m_hdr->tailSeq );
+    }
+    return int( n );
+}
+
+}
+
+#endif
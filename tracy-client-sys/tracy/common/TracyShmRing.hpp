@@ -0,0 +1,110 @@
+#ifndef __TRACYSHMRING_HPP__
+#define __TRACYSHMRING_HPP__
+
+#if defined TRACY_SHM_TRANSPORT && defined __linux__ && !defined __ANDROID__
+#  define TRACY_HAS_SHM_TRANSPORT
+#endif
+
+#ifdef TRACY_HAS_SHM_TRANSPORT
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TracyProtocol.hpp"
+#include "TracySocket.hpp"
+
+namespace tracy
+{
+
+// Single producer, single consumer byte ring in a POSIX shared memory object, carrying the same
+// lz4sz_t prefixed frames as the socket would. Each side sleeps on a futex when the ring is empty
+// or full, and the other side only makes the wake up call when the sleeper has announced itself.
+//
+// A server running on the same host asks for the ring with ServerQueryShmTransport. The client
+// answers on the socket with ShmTransportMarker in place of a frame size, followed by the name of
+// the object in ShmRingNameSize bytes, and sends all the frames after it through the ring. An
+// empty name means that the ring could not be set up, and the frames keep coming over the socket.
+// Queries are still sent over the socket.
+constexpr lz4sz_t ShmTransportMarker = ~lz4sz_t( 0 );
+constexpr size_t ShmRingNameSize = 64;
+constexpr uint32_t ShmRingMagic = 0x6d686354;     // "Tchm"
+constexpr uint32_t ShmRingVersion = 1;
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    std::atomic<uint32_t> attached;
+    std::atomic<uint32_t> closed;
+
+    alignas( 64 ) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> headSeq;
+    std::atomic<uint32_t> readerWaiting;
+
+    alignas( 64 ) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> tailSeq;
+    std::atomic<uint32_t> writerWaiting;
+};
+
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    // Size is rounded up to a power of two.
+    bool Create( size_t size );
+    const char* Name() const { return m_name; }
+
+    // Blocks while the ring is full. Fails if the reader went away, or if it did not take anything
+    // in for the timeout.
+    bool Write( const SocketChunk* chunks, int num, int timeout = 10000 );
+
+    ShmRingWriter( const ShmRingWriter& ) = delete;
+    ShmRingWriter( ShmRingWriter&& ) = delete;
+    ShmRingWriter& operator=( const ShmRingWriter& ) = delete;
+    ShmRingWriter& operator=( ShmRingWriter&& ) = delete;
+
+private:
+    void Publish( uint64_t head );
+    void Unlink();
+
+    ShmRingHeader* m_hdr;
+    char* m_data;
+    size_t m_mapSize;
+    size_t m_size;          // of the ring, the copy in the header is only for the reader
+    char m_name[ShmRingNameSize];
+    bool m_linked;
+};
+
+class ShmRingReader
+{
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    bool Open( const char* name );
+
+    // Waits up to timeout milliseconds for data. Returns the number of bytes read, zero on timeout,
+    // or -1 once the writer is gone and the ring is empty.
+    int Read( void* buf, int len, int timeout );
+
+    ShmRingReader( const ShmRingReader& ) = delete;
+    ShmRingReader( ShmRingReader&& ) = delete;
+    ShmRingReader& operator=( const ShmRingReader& ) = delete;
+    ShmRingReader& operator=( ShmRingReader&& ) = delete;
+
+private:
+    ShmRingHeader* m_hdr;
+    char* m_data;
+    size_t m_mapSize;
+    size_t m_size;
+};
+
+}
+
+#endif
+
+#endif
@@ -28,6 +28,7 @@
 #  include <arpa/inet.h>
 #  include <sys/socket.h>
 #  include <sys/param.h>
+#  include <sys/uio.h>
 #  include <errno.h>
 #  include <fcntl.h>
 #  include <netinet/in.h>
@@ -71,6 +72,7 @@ void InitWinSock()
 
 
 constexpr size_t BufSize = 128 * 1024;
+constexpr int MaxSendChunks = 16;    // _XOPEN_IOV_MAX
 
 Socket::Socket()
     : m_buf( (char*)tracy_malloc( BufSize ) )
@@ -293,6 +295,104 @@ int Socket::Send( const void* _buf, int len )
     return int( buf - start );
 }
 
+int Socket::TrySend( const void* buf, int len )
+{
+    const auto sock = m_sock.load( std::memory_order_relaxed );
+    assert( sock != -1 );
+#ifdef _WIN32
+    u_long nonblocking = 1;
+    ioctlsocket( sock, FIONBIO, &nonblocking );
+    const auto ret = send( sock, (const char*)buf, len, 0 );
+    const auto err = WSAGetLastError();
+    nonblocking = 0;
+    ioctlsocket( sock, FIONBIO, &nonblocking );
+    if( ret == SOCKET_ERROR ) return err == WSAEWOULDBLOCK ? 0 : -1;
+#else
+    const auto ret = send( sock, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT );
+    if( ret == -1 ) return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) ? 0 : -1;
+#endif
+    return int( ret );
+}
+
+int Socket::SendVec( const SocketChunk* chunks, int count )
+{
+    const auto sock = m_sock.load( std::memory_order_relaxed );
+    assert( sock != -1 );
+    int total = 0;
+    while( count > 0 )
+    {
+        const auto num = count < MaxSendChunks ? count : MaxSendChunks;
+#ifdef _WIN32
+        WSABUF vec[MaxSendChunks];
+        for( int i=0; i<num; i++ )
+        {
+            vec[i].buf = (CHAR*)chunks[i].buf;
+            vec[i].len = (ULONG)chunks[i].len;
+        }
+#else
+        struct iovec vec[MaxSendChunks];
+        for( int i=0; i<num; i++ )
+        {
+            vec[i].iov_base = (void*)chunks[i].buf;
+            vec[i].iov_len = (size_t)chunks[i].len;
+        }
+#endif
+        int idx = 0;
+        for(;;)
+        {
+#ifdef _WIN32
+            while( idx < num && vec[idx].len == 0 ) idx++;
+            if( idx == num ) break;
+            DWORD sent;
+            if( WSASend( sock, vec + idx, DWORD( num - idx ), &sent, 0, nullptr, nullptr ) == SOCKET_ERROR ) return -1;
+            size_t ret = sent;
+            total += int( sent );
+            while( ret > 0 )
+            {
+                if( ret >= vec[idx].len )
+                {
+                    ret -= vec[idx].len;
+                    idx++;
+                }
+                else
+                {
+                    vec[idx].buf += ret;
+                    vec[idx].len -= ULONG( ret );
+                    ret = 0;
+                }
+            }
+#else
+            while( idx < num && vec[idx].iov_len == 0 ) idx++;
+            if( idx == num ) break;
+            struct msghdr msg = {};
+            msg.msg_iov = vec + idx;
+            msg.msg_iovlen = num - idx;
+            const auto sent = sendmsg( sock, &msg, MSG_NOSIGNAL );
+            if( sent == -1 ) return -1;
+            size_t ret = size_t( sent );
+            total += int( sent );
+            while( ret > 0 )
+            {
+                if( ret >= vec[idx].iov_len )
+                {
+                    ret -= vec[idx].iov_len;
+                    idx++;
+                }
+                else
+                {
+                    vec[idx].iov_base = (char*)vec[idx].iov_base + ret;
+                    vec[idx].iov_len -= ret;
+                    ret = 0;
+                }
+            }
+#endif
+        }
+        chunks += num;
+        count -= num;
+    }
+    return total;
+}
+
 int Socket::GetSendBufSize()
 {
     const auto sock = m_sock.load( std::memory_order_relaxed );
@@ -407,6 +507,29 @@ bool Socket::ReadImpl( char*& buf, int& len, int timeout )
     return true;
 }
 
+int Socket::ReadMany( void* _buf, int size, int count, int timeout )
+{
+    auto buf = (char*)_buf;
+    int num = 0;
+    if( m_bufLeft < size )
+    {
+        if( !Read( buf, size, timeout ) ) return 0;
+        buf += size;
+        num++;
+    }
+
+    auto more = m_bufLeft / size;
+    if( more > count - num ) more = count - num;
+    if( more > 0 )
+    {
+        const auto sz = more * size;
+        memcpy( buf, m_bufPtr, sz );
+        m_bufPtr += sz;
+        m_bufLeft -= sz;
+    }
+    return num + more;
+}
+
 bool Socket::ReadRaw( void* _buf, int len, int timeout )
 {
     auto buf = (char*)_buf;
@@ -510,7 +633,7 @@ bool ListenSocket::Listen( uint16_t port, int backlog )
     return true;
 }
 
-Socket* ListenSocket::Accept()
+Socket* ListenSocket::Accept( int timeout )
 {
     struct sockaddr_storage remote;
     socklen_t sz = sizeof( remote );
@@ -519,7 +642,7 @@ Socket* ListenSocket::Accept()
     fd.fd = (socket_t)m_sock;
     fd.events = POLLIN;
 
-    if( poll( &fd, 1, 10 ) > 0 )
+    if( poll( &fd, 1, timeout ) > 0 )
     {
         int sock = accept( m_sock, (sockaddr*)&remote, &sz);
         if( sock == -1 ) return nullptr;
@@ -608,6 +731,17 @@ bool UdpBroadcast::Open( const char* addr, uint16_t port )
 
     m_sock = sock;
     inet_pton( AF_INET, addr, &m_addr );
+    if( ( ntohl( m_addr ) >> 28 ) == 0xE )
+    {
+        // Keep multicast announcements on the local network.
+#if defined _WIN32
+        DWORD ttl = 1;
+        setsockopt( sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof( ttl ) );
+#else
+        int ttl = 1;
+        setsockopt( sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) );
+#endif
+    }
     return true;
 }
 
@@ -721,6 +855,15 @@ bool UdpListen::Listen( uint16_t port )
     return true;
 }
 
+bool UdpListen::JoinGroup( const char* addr )
+{
+    assert( m_sock != -1 );
+    struct ip_mreq mreq;
+    if( inet_pton( AF_INET, addr, &mreq.imr_multiaddr ) != 1 ) return false;
+    mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+    return setsockopt( m_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&mreq, sizeof( mreq ) ) == 0;
+}
+
 void UdpListen::Close()
 {
     assert( m_sock != -1 );
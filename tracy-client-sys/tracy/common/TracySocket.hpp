@@ -15,6 +15,12 @@ namespace tracy
 void InitWinSock();
 #endif
 
+struct SocketChunk
+{
+    const void* buf;
+    int len;
+};
+
 class Socket
 {
 public:
@@ -27,6 +33,10 @@ public:
     void Close();
 
     int Send( const void* buf, int len );
+    int SendVec( const SocketChunk* chunks, int count );
+    // Sends as much as fits in the socket buffer without blocking. Returns the number of bytes
+    // sent, which may be zero, or -1 on failure.
+    int TrySend( const void* buf, int len );
     int GetSendBufSize();
 
     int ReadUpTo( void* buf, int len );
@@ -45,6 +55,9 @@ public:
     }
 
     bool ReadRaw( void* buf, int len, int timeout );
+    // Reads at least one and at most count messages of size bytes, taking every complete one
+    // which has already arrived. Returns the number of messages read, or zero on failure.
+    int ReadMany( void* buf, int size, int count, int timeout );
     bool HasData();
     bool IsValid() const;
 
@@ -76,7 +89,8 @@ public:
     ~ListenSocket();
 
     bool Listen( uint16_t port, int backlog );
-    Socket* Accept();
+    // Waits up to timeout milliseconds for a connection.
+    Socket* Accept( int timeout = 10 );
     void Close();
 
     ListenSocket( const ListenSocket& ) = delete;
@@ -94,6 +108,8 @@ public:
     UdpBroadcast();
     ~UdpBroadcast();
 
+    // The address may also be a multicast group, which reaches only the listeners which joined
+    // it, on the local network like a broadcast would.
     bool Open( const char* addr, uint16_t port );
     void Close();
 
@@ -137,6 +153,8 @@ public:
     ~UdpListen();
 
     bool Listen( uint16_t port );
+    // Also receive the datagrams sent to a multicast group, see UdpBroadcast::Open().
+    bool JoinGroup( const char* addr );
     void Close();
 
     const char* Read( size_t& len, IpAddress& addr, int timeout );
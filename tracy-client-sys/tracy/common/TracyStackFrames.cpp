@@ -6,6 +6,10 @@ namespace tracy
 const char* s_tracyStackFrames_[] = {
     "tracy::Callstack",
     "tracy::Callstack(int)",
+    "tracy::CaptureCallstack",
+    "tracy::CaptureCallstack(unsigned long*, int)",
+    "tracy::Profiler::InternedCallstack",
+    "tracy::Profiler::InternedCallstack(int)",
     "tracy::GpuCtxScope::{ctor}",
     "tracy::Profiler::SendCallstack",
     "tracy::Profiler::SendCallstack(int)",
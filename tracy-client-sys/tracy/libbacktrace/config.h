@@ -16,6 +16,7 @@
 #define HAVE_READLINK 1
 #define HAVE_DL_ITERATE_PHDR 1
 #define HAVE_ATOMIC_FUNCTIONS 1
+#define HAVE_SYNC_FUNCTIONS 1
 #define HAVE_DECL_STRNLEN 1
 #define HAVE_DECL__PGMPTR 0
 
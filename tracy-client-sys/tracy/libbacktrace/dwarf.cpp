@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.  */
 #include "config.h"
 
 #include <errno.h>
+#include <mutex>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -667,11 +669,21 @@ struct unit
   const char *abs_filename;
   /* The abbreviations for this unit.  */
   struct abbrevs abbrevs;
+  /* Offset of the abbreviations in .debug_abbrev.  */
+  uint64_t abbrev_offset;
+  /* Whether the address ranges were taken from .debug_aranges.  */
+  int aranges;
 
   /* The fields above this point are read in during initialization and
-     may be accessed freely.  The fields below this point are read in
-     as needed, and therefore require care, as different threads may
-     try to initialize them simultaneously.  */
+     may be accessed freely, except for units found through
+     .debug_aranges.  For those, everything from lineoff to abbrevs is
+     only read by unit_ready, which has to be called first.  The fields
+     below this point are read in as needed, and therefore require care,
+     as different threads may try to initialize them simultaneously.  */
+
+  /* 1 if the fields above have not been read yet, -1 if reading them
+     failed.  */
+  int lazy;
 
   /* PC to line number mapping.  This is NULL if the values have not
      been read.  This is (struct line *) -1 if there was an error
@@ -709,6 +721,15 @@ struct unit_addrs_vector
   size_t count;
 };
 
+/* A sorted list of compilation unit address ranges, followed by a
+   sentinel entry.  */
+
+struct unit_addrs_map
+{
+  struct unit_addrs *addrs;
+  size_t count;
+};
+
 /* A growable vector of compilation unit pointer.  */
 
 struct unit_vector
@@ -731,6 +752,13 @@ struct dwarf_data
   struct unit_addrs *addrs;
   /* Number of address ranges in list.  */
   size_t addrs_count;
+  /* The end of the highest address range.  */
+  uintptr_t addrs_high;
+  /* Whether any of the units were found through .debug_aranges.  */
+  int aranges_units;
+  /* The address ranges of those units as found in their DIEs, for the
+     PCs .debug_aranges leaves out.  NULL if not read yet.  */
+  struct unit_addrs_map *aranges_rescan;
   /* A sorted list of units.  */
   struct unit **units;
   /* Number of units in the list.  */
@@ -1584,9 +1612,9 @@ unit_addrs_compare (const void *v1, const void *v2)
     return 1;
   if (a1->high > a2->high)
     return -1;
-  if (a1->u->lineoff < a2->u->lineoff)
+  if (a1->u->low_offset < a2->u->low_offset)
     return -1;
-  if (a1->u->lineoff > a2->u->lineoff)
+  if (a1->u->low_offset > a2->u->low_offset)
     return 1;
   return 0;
 }
@@ -2400,6 +2428,10 @@ find_address_ranges (struct backtrace_state *state,
 	    return 0;
 	}
 
+      /* Only the attributes of the unit were asked for.  */
+      if (addrs == NULL)
+	return 1;
+
       if (abbrev->tag == DW_TAG_compile_unit
 	  || abbrev->tag == DW_TAG_subprogram
 	  || abbrev->tag == DW_TAG_skeleton_unit)
@@ -2431,6 +2463,193 @@ find_address_ranges (struct backtrace_state *state,
   return 1;
 }
 
+/* Read the address ranges of compilation units from .debug_aranges.
+   Units covered there are marked lazy, so that neither their
+   abbreviations nor their unit DIE have to be read until a PC in one of
+   their ranges is looked up.  A set which can't be read leaves its unit
+   to find_address_ranges.  Nothing requires .debug_aranges to list all
+   the ranges of a unit, so a PC it misses is looked up again in the
+   ranges found by aranges_rescan.  Returns 1 on success, 0 on
+   failure.  */
+
+static int
+read_aranges (struct backtrace_state *state,
+	      struct libbacktrace_base_address base_address,
+	      const struct dwarf_sections *dwarf_sections,
+	      int is_bigendian, struct unit **units, size_t units_count,
+	      backtrace_error_callback error_callback, void *data,
+	      struct unit_addrs_vector *addrs)
+{
+  struct dwarf_buf aranges;
+
+  aranges.name = ".debug_aranges";
+  aranges.start = dwarf_sections->data[DEBUG_ARANGES];
+  aranges.buf = aranges.start;
+  aranges.left = dwarf_sections->size[DEBUG_ARANGES];
+  aranges.is_bigendian = is_bigendian;
+  aranges.error_callback = error_callback;
+  aranges.data = data;
+  aranges.reported_underflow = 0;
+
+  while (aranges.left > 0)
+    {
+      uint64_t len;
+      int is_dwarf64;
+      struct dwarf_buf set_buf;
+      struct dwarf_buf tuples;
+      uint64_t info_offset;
+      int addrsize;
+      int segsize;
+      size_t header;
+      size_t tuple_size;
+      size_t count;
+      size_t i;
+      struct unit *u;
+      const unsigned char *set_start;
+
+      set_start = aranges.buf;
+      len = read_initial_length (&aranges, &is_dwarf64);
+      set_buf = aranges;
+      set_buf.left = len;
+      if (!advance (&aranges, len))
+	return 1;
+
+      if (read_uint16 (&set_buf) != 2)
+	continue;
+      info_offset = read_offset (&set_buf, is_dwarf64);
+      addrsize = read_byte (&set_buf);
+      segsize = read_byte (&set_buf);
+      if (set_buf.reported_underflow
+	  || segsize != 0
+	  || (addrsize != 4 && addrsize != 8))
+	continue;
+
+      /* Tuples are aligned to their size, counting from the start of
+	 the set.  */
+      tuple_size = 2 * addrsize;
+      header = set_buf.buf - set_start;
+      if (header % tuple_size != 0
+	  && !advance (&set_buf, tuple_size - header % tuple_size))
+	continue;
+
+      u = find_unit (units, units_count, info_offset);
+      if (u == NULL || u->low_offset != info_offset)
+	continue;
+
+      /* Check the whole set before using any of it.  */
+      tuples = set_buf;
+      count = 0;
+      while (tuples.left >= tuple_size)
+	{
+	  uint64_t low;
+	  uint64_t length;
+
+	  low = read_address (&tuples, addrsize);
+	  length = read_address (&tuples, addrsize);
+	  if (low == 0 && length == 0)
+	    break;
+	  ++count;
+	}
+      if (count == 0)
+	continue;
+
+      for (i = 0; i < count; ++i)
+	{
+	  uint64_t low;
+	  uint64_t length;
+	  uintptr_t lowpc;
+	  uintptr_t highpc;
+
+	  low = read_address (&set_buf, addrsize);
+	  length = read_address (&set_buf, addrsize);
+
+	  /* Code removed by the linker may be left at address zero.  */
+	  if (low == 0 || length == 0)
+	    continue;
+
+	  lowpc = libbacktrace_add_base ((uintptr_t) low, base_address);
+	  highpc = libbacktrace_add_base ((uintptr_t) (low + length),
+					  base_address);
+	  if (!add_unit_addr (state, (void *) u, lowpc, highpc,
+			      error_callback, data, (void *) addrs))
+	    return 0;
+	}
+      u->lazy = 1;
+      u->aranges = 1;
+    }
+
+  return 1;
+}
+
+/* Read everything about a unit found through .debug_aranges that is
+   normally read by build_address_map.  Returns 1 on success, 0 on
+   failure.  */
+
+static int
+read_unit_attrs (struct backtrace_state *state, struct dwarf_data *ddata,
+		 struct unit *u, backtrace_error_callback error_callback,
+		 void *data)
+{
+  struct dwarf_buf unit_buf;
+
+  if (!read_abbrevs (state, u->abbrev_offset,
+		     ddata->dwarf_sections.data[DEBUG_ABBREV],
+		     ddata->dwarf_sections.size[DEBUG_ABBREV],
+		     ddata->is_bigendian, error_callback, data, &u->abbrevs))
+    return 0;
+
+  unit_buf.name = ".debug_info";
+  unit_buf.start = ddata->dwarf_sections.data[DEBUG_INFO];
+  unit_buf.buf = u->unit_data;
+  unit_buf.left = u->unit_data_len;
+  unit_buf.is_bigendian = ddata->is_bigendian;
+  unit_buf.error_callback = error_callback;
+  unit_buf.data = data;
+  unit_buf.reported_underflow = 0;
+
+  if (!find_address_ranges (state, ddata->base_address, &unit_buf,
+			    &ddata->dwarf_sections, ddata->is_bigendian,
+			    ddata->altlink, error_callback, data, u, NULL,
+			    NULL))
+    return 0;
+  return !unit_buf.reported_underflow;
+}
+
+/* Make sure that the fields of U read during initialization are
+   available.  Returns 1 on success, 0 if they couldn't be read.  */
+
+static int
+unit_ready (struct backtrace_state *state, struct dwarf_data *ddata,
+	    struct unit *u, backtrace_error_callback error_callback,
+	    void *data)
+{
+  int lazy;
+
+  if (!state->threaded)
+    {
+      if (u->lazy == 1)
+	u->lazy = read_unit_attrs (state, ddata, u, error_callback, data)
+		  ? 0 : -1;
+      return u->lazy == 0;
+    }
+
+  lazy = backtrace_atomic_load_int (&u->lazy);
+  if (lazy == 1)
+    {
+      static std::mutex unit_lock;
+      std::lock_guard<std::mutex> lock (unit_lock);
+
+      lazy = backtrace_atomic_load_int (&u->lazy);
+      if (lazy == 1)
+	{
+	  lazy = read_unit_attrs (state, ddata, u, error_callback, data)
+		 ? 0 : -1;
+	  backtrace_atomic_store_int (&u->lazy, lazy);
+	}
+    }
+  return lazy == 0;
+}
+
 /* Build a mapping from address ranges to the compilation units where
    the line number information for that range can be found.  Returns 1
    on success, 0 on failure.  */
@@ -2484,7 +2703,6 @@ build_address_map (struct backtrace_state *state,
       uint64_t abbrev_offset;
       int addrsize;
       struct unit *u;
-      enum dwarf_tag unit_tag;
 
       if (info.reported_underflow)
 	goto fail;
@@ -2538,11 +2756,6 @@ build_address_map (struct backtrace_state *state,
 
       memset (&u->abbrevs, 0, sizeof u->abbrevs);
       abbrev_offset = read_offset (&unit_buf, is_dwarf64);
-      if (!read_abbrevs (state, abbrev_offset,
-			 dwarf_sections->data[DEBUG_ABBREV],
-			 dwarf_sections->size[DEBUG_ABBREV],
-			 is_bigendian, error_callback, data, &u->abbrevs))
-	goto fail;
 
       if (version < 5)
 	addrsize = read_byte (&unit_buf);
@@ -2576,6 +2789,9 @@ build_address_map (struct backtrace_state *state,
       u->str_offsets_base = 0;
       u->addr_base = 0;
       u->rnglists_base = 0;
+      u->abbrev_offset = abbrev_offset;
+      u->aranges = 0;
+      u->lazy = 0;
 
       /* The actual line number mappings will be read as needed.  */
       u->lines = NULL;
@@ -2583,6 +2799,44 @@ build_address_map (struct backtrace_state *state,
       u->function_addrs = NULL;
       u->function_addrs_count = 0;
 
+      if (unit_buf.reported_underflow)
+	goto fail;
+    }
+  if (info.reported_underflow)
+    goto fail;
+
+  pu = (struct unit **) units.base;
+  if (dwarf_sections->size[DEBUG_ARANGES] > 0
+      && !read_aranges (state, base_address, dwarf_sections, is_bigendian,
+			pu, units_count, error_callback, data, addrs))
+    goto fail;
+
+  /* Walk the DIEs of the units which .debug_aranges doesn't know.  */
+  for (i = 0; i < units_count; ++i)
+    {
+      struct dwarf_buf unit_buf;
+      enum dwarf_tag unit_tag;
+      struct unit *u;
+
+      u = pu[i];
+      if (u->lazy)
+	continue;
+
+      if (!read_abbrevs (state, u->abbrev_offset,
+			 dwarf_sections->data[DEBUG_ABBREV],
+			 dwarf_sections->size[DEBUG_ABBREV],
+			 is_bigendian, error_callback, data, &u->abbrevs))
+	goto fail;
+
+      unit_buf.name = ".debug_info";
+      unit_buf.start = dwarf_sections->data[DEBUG_INFO];
+      unit_buf.buf = u->unit_data;
+      unit_buf.left = u->unit_data_len;
+      unit_buf.is_bigendian = is_bigendian;
+      unit_buf.error_callback = error_callback;
+      unit_buf.data = data;
+      unit_buf.reported_underflow = 0;
+
       if (!find_address_ranges (state, base_address, &unit_buf, dwarf_sections,
 				is_bigendian, altlink, error_callback, data,
 				u, addrs, &unit_tag))
@@ -2591,8 +2845,6 @@ build_address_map (struct backtrace_state *state,
       if (unit_buf.reported_underflow)
 	goto fail;
     }
-  if (info.reported_underflow)
-    goto fail;
 
   /* Add a trailing addrs entry, but don't include it in addrs->count.  */
   pa = ((struct unit_addrs *)
@@ -3353,14 +3605,16 @@ read_line_info (struct backtrace_state *state, struct dwarf_data *ddata,
   return 0;
 }
 
-static const char *read_referenced_name (struct dwarf_data *, struct unit *,
+static const char *read_referenced_name (struct backtrace_state *,
+					 struct dwarf_data *, struct unit *,
 					 uint64_t, backtrace_error_callback,
 					 void *);
 
 /* Read the name of a function from a DIE referenced by ATTR with VAL.  */
 
 static const char *
-read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
+read_referenced_name_from_attr (struct backtrace_state *state,
+				struct dwarf_data *ddata, struct unit *u,
 				struct attr *attr, struct attr_val *val,
 				backtrace_error_callback error_callback,
 				void *data)
@@ -3382,27 +3636,32 @@ read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
       struct unit *unit
 	= find_unit (ddata->units, ddata->units_count,
 		     val->u.uint);
-      if (unit == NULL)
+      if (unit == NULL
+	  || !unit_ready (state, ddata, unit, error_callback, data))
 	return NULL;
 
       uint64_t offset = val->u.uint - unit->low_offset;
-      return read_referenced_name (ddata, unit, offset, error_callback, data);
+      return read_referenced_name (state, ddata, unit, offset, error_callback,
+				   data);
     }
 
   if (val->encoding == ATTR_VAL_UINT
       || val->encoding == ATTR_VAL_REF_UNIT)
-    return read_referenced_name (ddata, u, val->u.uint, error_callback, data);
+    return read_referenced_name (state, ddata, u, val->u.uint, error_callback,
+				 data);
 
   if (val->encoding == ATTR_VAL_REF_ALT_INFO)
     {
       struct unit *alt_unit
 	= find_unit (ddata->altlink->units, ddata->altlink->units_count,
 		     val->u.uint);
-      if (alt_unit == NULL)
+      if (alt_unit == NULL
+	  || !unit_ready (state, ddata->altlink, alt_unit, error_callback,
+			  data))
 	return NULL;
 
       uint64_t offset = val->u.uint - alt_unit->low_offset;
-      return read_referenced_name (ddata->altlink, alt_unit, offset,
+      return read_referenced_name (state, ddata->altlink, alt_unit, offset,
 				   error_callback, data);
     }
 
@@ -3414,9 +3673,9 @@ read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
    the same compilation unit.  */
 
 static const char *
-read_referenced_name (struct dwarf_data *ddata, struct unit *u,
-		      uint64_t offset, backtrace_error_callback error_callback,
-		      void *data)
+read_referenced_name (struct backtrace_state *state, struct dwarf_data *ddata,
+		      struct unit *u, uint64_t offset,
+		      backtrace_error_callback error_callback, void *data)
 {
   struct dwarf_buf unit_buf;
   uint64_t code;
@@ -3507,8 +3766,9 @@ read_referenced_name (struct dwarf_data *ddata, struct unit *u,
 	  {
 	    const char *name;
 
-	    name = read_referenced_name_from_attr (ddata, u, &abbrev->attrs[i],
-						   &val, error_callback, data);
+	    name = read_referenced_name_from_attr (state, ddata, u,
+						   &abbrev->attrs[i], &val,
+						   error_callback, data);
 	    if (name != NULL)
 	      ret = name;
 	  }
@@ -3676,7 +3936,7 @@ read_function_entry (struct backtrace_state *state, struct dwarf_data *ddata,
 		    const char *name;
 
 		    name
-		      = read_referenced_name_from_attr (ddata, u,
+		      = read_referenced_name_from_attr (state, ddata, u,
 							&abbrev->attrs[i], &val,
 							error_callback, data);
 		    if (name != NULL)
@@ -3986,6 +4246,161 @@ report_inlined_functions (uintptr_t pc, struct function *function, const char* c
   return 0;
 }
 
+/* Find the range in ADDRS that includes PC.  Returns NULL if there is
+   none.  */
+
+static struct unit_addrs *
+search_unit_addrs (struct unit_addrs *addrs, size_t addrs_count,
+		   uintptr_t pc)
+{
+  struct unit_addrs *entry;
+
+  /* Our search isn't safe if PC == -1, as we use that as a sentinel
+     value, so skip the search in that case.  */
+  if (addrs_count == 0 || pc + 1 == 0)
+    return NULL;
+  entry = (struct unit_addrs *) bsearch (&pc, addrs, addrs_count,
+					 sizeof (struct unit_addrs),
+					 unit_addrs_search);
+  if (entry == NULL)
+    return NULL;
+
+  /* Here pc >= entry->low && pc < (entry + 1)->low.  The unit_addrs
+     are sorted by low, so if pc > p->low we are at the end of a range
+     of unit_addrs with the same low value.  If pc == p->low walk
+     forward to the end of the range with that low value.  Then walk
+     backward and use the first range that includes pc.  */
+  while (pc == (entry + 1)->low)
+    ++entry;
+  while (1)
+    {
+      if (pc < entry->high)
+	return entry;
+      if (entry == addrs)
+	return NULL;
+      if ((entry - 1)->low < entry->low)
+	return NULL;
+      --entry;
+    }
+}
+
+/* Walk the DIEs of the units found through .debug_aranges for their
+   address ranges.  Returns the sorted ranges, which are empty on
+   failure.  */
+
+static struct unit_addrs_map *
+read_aranges_rescan (struct backtrace_state *state, struct dwarf_data *ddata,
+		     backtrace_error_callback error_callback, void *data)
+{
+  static struct unit_addrs_map empty;
+  struct unit_addrs_vector addrs;
+  struct unit_addrs *pa;
+  struct unit_addrs_map *map;
+  size_t i;
+
+  memset (&addrs, 0, sizeof addrs);
+  for (i = 0; i < ddata->units_count; ++i)
+    {
+      struct unit *u;
+      struct unit scan;
+      struct dwarf_buf unit_buf;
+      size_t first;
+      size_t j;
+
+      u = ddata->units[i];
+      if (!u->aranges || !unit_ready (state, ddata, u, error_callback, data))
+	continue;
+
+      /* Other threads may be using U, and find_address_ranges sets its
+	 attributes again, so walk with a copy of the fields read during
+	 initialization.  */
+      memcpy (&scan, u, offsetof (struct unit, lazy));
+
+      unit_buf.name = ".debug_info";
+      unit_buf.start = ddata->dwarf_sections.data[DEBUG_INFO];
+      unit_buf.buf = u->unit_data;
+      unit_buf.left = u->unit_data_len;
+      unit_buf.is_bigendian = ddata->is_bigendian;
+      unit_buf.error_callback = error_callback;
+      unit_buf.data = data;
+      unit_buf.reported_underflow = 0;
+
+      first = addrs.count;
+      if (!find_address_ranges (state, ddata->base_address, &unit_buf,
+				&ddata->dwarf_sections, ddata->is_bigendian,
+				ddata->altlink, error_callback, data, &scan,
+				&addrs, NULL)
+	  || unit_buf.reported_underflow)
+	goto fail;
+
+      pa = (struct unit_addrs *) addrs.vec.base;
+      for (j = first; j < addrs.count; ++j)
+	pa[j].u = u;
+    }
+
+  /* Add a trailing addrs entry, but don't include it in addrs.count.  */
+  pa = ((struct unit_addrs *)
+	backtrace_vector_grow (state, sizeof (struct unit_addrs),
+			       error_callback, data, &addrs.vec));
+  if (pa == NULL)
+    goto fail;
+  pa->low = 0;
+  --pa->low;
+  pa->high = pa->low;
+  pa->u = NULL;
+
+  if (!backtrace_vector_release (state, &addrs.vec, error_callback, data))
+    goto fail;
+  map = ((struct unit_addrs_map *)
+	 backtrace_alloc (state, sizeof *map, error_callback, data));
+  if (map == NULL)
+    goto fail;
+  map->addrs = (struct unit_addrs *) addrs.vec.base;
+  map->count = addrs.count;
+  backtrace_qsort (map->addrs, map->count, sizeof (struct unit_addrs),
+		   unit_addrs_compare);
+  return map;
+
+ fail:
+  backtrace_vector_free (state, &addrs.vec, error_callback, data);
+  return &empty;
+}
+
+/* Return the address ranges found by read_aranges_rescan, reading them
+   on first use.  */
+
+static struct unit_addrs_map *
+aranges_rescan (struct backtrace_state *state, struct dwarf_data *ddata,
+		backtrace_error_callback error_callback, void *data)
+{
+  struct unit_addrs_map *map;
+
+  if (!state->threaded)
+    {
+      if (ddata->aranges_rescan == NULL)
+	ddata->aranges_rescan = read_aranges_rescan (state, ddata,
+						     error_callback, data);
+      return ddata->aranges_rescan;
+    }
+
+  map = ((struct unit_addrs_map *)
+	 backtrace_atomic_load_pointer (&ddata->aranges_rescan));
+  if (map == NULL)
+    {
+      static std::mutex rescan_lock;
+      std::lock_guard<std::mutex> lock (rescan_lock);
+
+      map = ((struct unit_addrs_map *)
+	     backtrace_atomic_load_pointer (&ddata->aranges_rescan));
+      if (map == NULL)
+	{
+	  map = read_aranges_rescan (state, ddata, error_callback, data);
+	  backtrace_atomic_store_pointer (&ddata->aranges_rescan, map);
+	}
+    }
+  return map;
+}
+
 /* Look for a PC in the DWARF mapping for one module.  On success,
    call CALLBACK and return whatever it returns.  On error, call
    ERROR_CALLBACK and return 0.  Sets *FOUND to 1 if the PC is found,
@@ -3997,8 +4412,8 @@ dwarf_lookup_pc (struct backtrace_state *state, struct dwarf_data *ddata,
 		 backtrace_error_callback error_callback, void *data,
 		 int *found)
 {
+  struct unit_addrs *addrs;
   struct unit_addrs *entry;
-  int found_entry;
   struct unit *u;
   int new_data;
   struct line *lines;
@@ -4012,42 +4427,26 @@ dwarf_lookup_pc (struct backtrace_state *state, struct dwarf_data *ddata,
 
   *found = 1;
 
-  /* Find an address range that includes PC.  Our search isn't safe if
-     PC == -1, as we use that as a sentinel value, so skip the search
-     in that case.  */
-  entry = (ddata->addrs_count == 0 || pc + 1 == 0
-	   ? NULL
-	   : (struct unit_addrs*)bsearch (&pc, ddata->addrs, ddata->addrs_count,
-		      sizeof (struct unit_addrs), unit_addrs_search));
-
-  if (entry == NULL)
+  /* Find an address range that includes PC.  A PC within the ranges of
+     the module that isn't found may have been left out of
+     .debug_aranges, so look at the ranges of the units in their DIEs.
+     PCs of other modules are outside, and don't cause them to be
+     read.  */
+  addrs = ddata->addrs;
+  entry = search_unit_addrs (addrs, ddata->addrs_count, pc);
+  if (entry == NULL
+      && ddata->aranges_units
+      && pc >= addrs[0].low
+      && pc < ddata->addrs_high)
     {
-      *found = 0;
-      return 0;
-    }
+      struct unit_addrs_map *map;
 
-  /* Here pc >= entry->low && pc < (entry + 1)->low.  The unit_addrs
-     are sorted by low, so if pc > p->low we are at the end of a range
-     of unit_addrs with the same low value.  If pc == p->low walk
-     forward to the end of the range with that low value.  Then walk
-     backward and use the first range that includes pc.  */
-  while (pc == (entry + 1)->low)
-    ++entry;
-  found_entry = 0;
-  while (1)
-    {
-      if (pc < entry->high)
-	{
-	  found_entry = 1;
-	  break;
-	}
-      if (entry == ddata->addrs)
-	break;
-      if ((entry - 1)->low < entry->low)
-	break;
-      --entry;
+      map = aranges_rescan (state, ddata, error_callback, data);
+      addrs = map->addrs;
+      entry = search_unit_addrs (addrs, map->count, pc);
     }
-  if (!found_entry)
+
+  if (entry == NULL)
     {
       *found = 0;
       return 0;
@@ -4065,7 +4464,7 @@ dwarf_lookup_pc (struct backtrace_state *state, struct dwarf_data *ddata,
   /* Skip units with no useful line number information by walking
      backward.  Useless line number information is marked by setting
      lines == -1.  */
-  while (entry > ddata->addrs
+  while (entry > addrs
 	 && pc >= (entry - 1)->low
 	 && pc < (entry - 1)->high)
     {
@@ -4097,8 +4496,13 @@ dwarf_lookup_pc (struct backtrace_state *state, struct dwarf_data *ddata,
 
       function_addrs = NULL;
       function_addrs_count = 0;
-      if (read_line_info (state, ddata, error_callback, data, entry->u, &lhdr,
-			  &lines, &count))
+      if (!unit_ready (state, ddata, entry->u, error_callback, data))
+	{
+	  lines = (struct line *) (uintptr_t) -1;
+	  count = 0;
+	}
+      else if (read_line_info (state, ddata, error_callback, data, entry->u,
+			       &lhdr, &lines, &count))
 	{
 	  struct function_vector *pfvec;
 
@@ -4308,21 +4712,36 @@ dwarf_fileline (struct backtrace_state *state, uintptr_t pc,
   }
   else
     {
-      struct dwarf_data **pp;
-
-      pp = (struct dwarf_data **) (void *) &state->fileline_data;
+      int refreshed = 0;
       while (1)
 	{
-	  ddata = backtrace_atomic_load_pointer (pp);
-	  if (ddata == NULL)
-	    break;
+	  struct dwarf_data **pp;
+
+	  pp = (struct dwarf_data **) (void *) &state->fileline_data;
+	  while (1)
+	    {
+	      ddata = backtrace_atomic_load_pointer (pp);
+	      if (ddata == NULL)
+		break;
 
-	  ret = dwarf_lookup_pc (state, ddata, pc, callback, error_callback,
-				 data, &found);
-	  if (ret != 0 || found)
-	    return ret;
+	      ret = dwarf_lookup_pc (state, ddata, pc, callback, error_callback,
+				     data, &found);
+	      if (ret != 0 || found)
+		return ret;
 
-	  pp = &ddata->next;
+	      pp = &ddata->next;
+	    }
+
+	  // Same refresh as above. New entries are appended atomically, but the
+	  // refresh itself keeps unsynchronized state, so only one thread may run
+	  // it. Look again even if nothing was added here, as another thread may
+	  // have added the range in the meantime.
+	  if (refreshed || !state->request_known_address_ranges_refresh_fn)
+	    break;
+	  refreshed = 1;
+	  static std::mutex refresh_lock;
+	  std::lock_guard<std::mutex> lock (refresh_lock);
+	  state->request_known_address_ranges_refresh_fn (state, pc);
 	}
     }
 
@@ -4350,6 +4769,7 @@ build_dwarf_data (struct backtrace_state *state,
   struct unit **units;
   size_t units_count;
   struct dwarf_data *fdata;
+  size_t i;
 
   if (!build_address_map (state, base_address, dwarf_sections, is_bigendian,
 			  altlink, error_callback, data, &addrs_vec,
@@ -4379,6 +4799,16 @@ build_dwarf_data (struct backtrace_state *state,
   fdata->base_address = base_address;
   fdata->addrs = addrs;
   fdata->addrs_count = addrs_count;
+  fdata->addrs_high = 0;
+  fdata->aranges_units = 0;
+  for (i = 0; i < addrs_count; ++i)
+    {
+      if (addrs[i].high > fdata->addrs_high)
+	fdata->addrs_high = addrs[i].high;
+      if (addrs[i].u->aranges)
+	fdata->aranges_units = 1;
+    }
+  fdata->aranges_rescan = NULL;
   fdata->units = units;
   fdata->units_count = units_count;
   fdata->dwarf_sections = *dwarf_sections;
@@ -366,7 +366,8 @@ static const char * const dwarf_section_names[DEBUG_MAX] =
   ".debug_addr",
   ".debug_str_offsets",
   ".debug_line_str",
-  ".debug_rnglists"
+  ".debug_rnglists",
+  ".debug_aranges"
 };
 
 /* Information we gather for the sections we care about.  */
@@ -5020,6 +5021,57 @@ elf_zstd_decompress (const unsigned char *pin, size_t sin,
 #define ZDEBUG_TABLE_SIZE \
   (ZLIB_TABLE_SIZE > ZSTD_TABLE_SIZE ? ZLIB_TABLE_SIZE : ZSTD_TABLE_SIZE)
 
+/* Allocate SIZE bytes to hold an uncompressed debug section.  If a
+   scratch directory is configured this is a file backed view, whose
+   pages the kernel can evict and bring back as the DWARF reader
+   touches them, rather than a heap buffer that has to stay resident.
+   Sets *SCRATCH to whether that is the case.  Returns NULL on
+   error.  */
+
+static unsigned char *
+elf_uncompressed_alloc (struct backtrace_state *state, size_t size,
+			backtrace_error_callback error_callback, void *data,
+			int *scratch)
+{
+  struct backtrace_view view;
+
+  if (backtrace_get_scratch_view (state, size, error_callback, data, &view))
+    {
+      *scratch = 1;
+      return (unsigned char *) view.base;
+    }
+  *scratch = 0;
+  return (unsigned char *) backtrace_alloc (state, size, error_callback,
+					    data);
+}
+
+/* Finish with memory returned by elf_uncompressed_alloc.  If OK is
+   non-zero the section has been uncompressed into it and will be kept,
+   otherwise the memory is released.  */
+
+static void
+elf_uncompressed_done (struct backtrace_state *state, unsigned char *po,
+		       size_t size, int scratch, int ok,
+		       backtrace_error_callback error_callback, void *data)
+{
+  struct backtrace_view view;
+
+  if (!scratch)
+    {
+      if (!ok)
+	backtrace_free (state, po, size, error_callback, data);
+      return;
+    }
+
+  view.data = po;
+  view.base = po;
+  view.len = size;
+  if (ok)
+    backtrace_seal_scratch_view (&view);
+  else
+    backtrace_release_view (state, &view, error_callback, data);
+}
+
 /* Uncompress the old compressed debug format, the one emitted by
    --compress-debug-sections=zlib-gnu.  The compressed data is in
    COMPRESSED / COMPRESSED_SIZE, and the function writes to
@@ -5038,6 +5090,7 @@ elf_uncompress_zdebug (struct backtrace_state *state,
   size_t sz;
   size_t i;
   unsigned char *po;
+  int scratch;
 
   *uncompressed = NULL;
   *uncompressed_size = 0;
@@ -5053,18 +5106,17 @@ elf_uncompress_zdebug (struct backtrace_state *state,
   for (i = 0; i < 8; i++)
     sz = (sz << 8) | compressed[i + 4];
 
-  if (*uncompressed != NULL && *uncompressed_size >= sz)
-    po = *uncompressed;
-  else
-    {
-      po = (unsigned char *) backtrace_alloc (state, sz, error_callback, data);
-      if (po == NULL)
-	return 0;
-    }
+  po = elf_uncompressed_alloc (state, sz, error_callback, data, &scratch);
+  if (po == NULL)
+    return 0;
 
   if (!elf_zlib_inflate_and_verify (compressed + 12, compressed_size - 12,
 				    zdebug_table, po, sz))
-    return 1;
+    {
+      elf_uncompressed_done (state, po, sz, scratch, 0, error_callback, data);
+      return 1;
+    }
+  elf_uncompressed_done (state, po, sz, scratch, 1, error_callback, data);
 
   *uncompressed = po;
   *uncompressed_size = sz;
@@ -5089,9 +5141,8 @@ elf_uncompress_chdr (struct backtrace_state *state,
 		     unsigned char **uncompressed, size_t *uncompressed_size)
 {
   b_elf_chdr chdr;
-  char *alc;
-  size_t alc_len;
   unsigned char *po;
+  int scratch;
 
   *uncompressed = NULL;
   *uncompressed_size = 0;
@@ -5105,18 +5156,10 @@ elf_uncompress_chdr (struct backtrace_state *state,
      https://github.com/ianlancetaylor/libbacktrace/pull/120.  */
   memcpy (&chdr, compressed, sizeof (b_elf_chdr));
 
-  alc = NULL;
-  alc_len = 0;
-  if (*uncompressed != NULL && *uncompressed_size >= chdr.ch_size)
-    po = *uncompressed;
-  else
-    {
-      alc_len = chdr.ch_size;
-      alc = (char*)backtrace_alloc (state, alc_len, error_callback, data);
-      if (alc == NULL)
-	return 0;
-      po = (unsigned char *) alc;
-    }
+  po = elf_uncompressed_alloc (state, chdr.ch_size, error_callback, data,
+			       &scratch);
+  if (po == NULL)
+    return 0;
 
   switch (chdr.ch_type)
     {
@@ -5140,14 +5183,17 @@ elf_uncompress_chdr (struct backtrace_state *state,
       goto skip;
     }
 
+  elf_uncompressed_done (state, po, chdr.ch_size, scratch, 1, error_callback,
+			 data);
+
   *uncompressed = po;
   *uncompressed_size = chdr.ch_size;
 
   return 1;
 
  skip:
-  if (alc != NULL && alc_len > 0)
-    backtrace_free (state, alc, alc_len, error_callback, data);
+  elf_uncompressed_done (state, po, chdr.ch_size, scratch, 0, error_callback,
+			 data);
   return 1;
 }
 
@@ -7580,8 +7626,8 @@ backtrace_initialize (struct backtrace_state *state, const char *filename,
       if (found_sym)
 	backtrace_atomic_store_pointer (&state->syminfo_fn, &elf_syminfo);
       else
-	(void) __sync_bool_compare_and_swap (&state->syminfo_fn, NULL,
-					     elf_nosyms);
+	(void) __sync_bool_compare_and_swap (&state->syminfo_fn, (syminfo) NULL,
+					     &elf_nosyms);
     }
 
   if (!state->threaded)
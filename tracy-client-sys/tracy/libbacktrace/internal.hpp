@@ -207,6 +207,22 @@ extern void backtrace_release_view (struct backtrace_state *state,
 				    backtrace_error_callback error_callback,
 				    void *data);
 
+/* Create a writable view of SIZE bytes which is backed by an unlinked
+   file in the directory named by the TRACY_DEBUG_SECTION_DIR
+   environment variable, so that the kernel can page it out instead of
+   keeping it in anonymous memory.  Store the result in *VIEW.  Returns
+   1 on success, 0 if the variable is not set or the file can't be
+   created, in which case the caller should fall back to
+   backtrace_alloc.  */
+extern int backtrace_get_scratch_view (struct backtrace_state *state,
+				       uint64_t size,
+				       backtrace_error_callback error_callback,
+				       void *data,
+				       struct backtrace_view *view);
+
+/* Make a view created by backtrace_get_scratch_view read only.  */
+extern void backtrace_seal_scratch_view (struct backtrace_view *view);
+
 /* Close a file opened by backtrace_open.  Returns 1 on success, 0 on
    error.  */
 
@@ -317,6 +333,7 @@ enum dwarf_section
   DEBUG_STR_OFFSETS,
   DEBUG_LINE_STR,
   DEBUG_RNGLISTS,
+  DEBUG_ARANGES,
 
   DEBUG_MAX
 };
@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.  */
 #include "config.h"
 
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -94,6 +96,73 @@ backtrace_get_view (struct backtrace_state *state ATTRIBUTE_UNUSED,
   return 1;
 }
 
+/* Create a writable view of SIZE bytes backed by a scratch file.  */
+
+int
+backtrace_get_scratch_view (struct backtrace_state *state ATTRIBUTE_UNUSED,
+			    uint64_t size,
+			    backtrace_error_callback error_callback
+			      ATTRIBUTE_UNUSED,
+			    void *data ATTRIBUTE_UNUSED,
+			    struct backtrace_view *view)
+{
+  const char *dir;
+  size_t dirlen;
+  char path[4096];
+  int descriptor;
+  size_t pagesize;
+  void *map;
+
+  dir = getenv ("TRACY_DEBUG_SECTION_DIR");
+  if (dir == NULL || *dir == '\0')
+    return 0;
+
+  if ((uint64_t) (size_t) size != size || size == 0)
+    return 0;
+
+  dirlen = strlen (dir);
+  if (dirlen + sizeof "/tracy-debug-XXXXXX" > sizeof path)
+    return 0;
+  memcpy (path, dir, dirlen);
+  memcpy (path + dirlen, "/tracy-debug-XXXXXX", sizeof "/tracy-debug-XXXXXX");
+
+  /* Failures are not reported, the caller carries on with the heap.  */
+  descriptor = mkstemp (path);
+  if (descriptor < 0)
+    return 0;
+  unlink (path);
+
+  pagesize = getpagesize ();
+  size = (size + (pagesize - 1)) & ~ (pagesize - 1);
+
+  if (ftruncate (descriptor, size) < 0)
+    {
+      close (descriptor);
+      return 0;
+    }
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  close (descriptor);
+  if (map == MAP_FAILED)
+    return 0;
+
+  view->data = map;
+  view->base = map;
+  view->len = size;
+
+  return 1;
+}
+
+/* Make a scratch view read only.  Its pages are then only written
+   back, never changed, which lets the kernel drop them under memory
+   pressure and read them back when they are used again.  */
+
+void
+backtrace_seal_scratch_view (struct backtrace_view *view)
+{
+  mprotect (view->base, view->len, PROT_READ);
+}
+
 /* Release a view read by backtrace_get_view.  */
 
 void
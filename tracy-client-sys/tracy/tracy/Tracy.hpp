@@ -33,6 +33,11 @@
 #define ZoneScopedC(x)
 #define ZoneScopedNC(x,y)
 
+#define ZoneNamedCat(x,y,z)
+#define ZoneNamedNCat(x,y,z,w)
+#define ZoneScopedCat(x)
+#define ZoneScopedNCat(x,y)
+
 #define ZoneText(x,y)
 #define ZoneTextV(x,y,z)
 #define ZoneTextF(x,...)
@@ -54,6 +59,7 @@
 #define FrameMarkEnd(x)
 
 #define FrameImage(x,y,z,w,a)
+#define FrameImageCompressed(x,y,z,w,a)
 
 #define TracyLockable( type, varname ) type varname
 #define TracyLockableN( type, varname, desc ) type varname
@@ -66,6 +72,7 @@
 
 #define TracyPlot(x,y)
 #define TracyPlotConfig(x,y,z,w,a)
+#define TracyPlotDownsample(x,y,z)
 
 #define TracyMessage(x,y)
 #define TracyMessageL(x)
@@ -118,6 +125,9 @@
 #define TracySourceCallbackRegister(x,y)
 #define TracyParameterRegister(x,y)
 #define TracyParameterSetup(x,y,z,w)
+#define TracyZoneSampling(x,y,z)
+#define TracyZoneCategorySetup(x,y,z)
+#define TracyZoneCategoryEnable(x,y)
 #define TracyIsConnected false
 #define TracyIsStarted false
 #define TracySetProgramName(x)
@@ -125,6 +135,9 @@
 #define TracyFiberEnter(x)
 #define TracyFiberEnterHint(x,y)
 #define TracyFiberLeave
+#define TracyFiberRegister(x) 0
+#define TracyFiberEnterId(x)
+#define TracyFiberEnterIdHint(x,y)
 
 #else
 
@@ -144,6 +157,9 @@
 #define ZoneNamedN( varname, name, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { name, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active )
 #define ZoneNamedC( varname, color, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { nullptr, TracyFunction,  TracyFile, (uint32_t)TracyLine, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active )
 #define ZoneNamedNC( varname, name, color, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { name, TracyFunction,  TracyFile, (uint32_t)TracyLine, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active )
+// The category has to be a constant expression, see TracyZoneCategory.hpp.
+#define ZoneNamedCat( varname, category, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { nullptr, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 TracySrcLocCategory( category ) }; tracy::CategoryZone<category> varname( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active )
+#define ZoneNamedNCat( varname, name, category, active ) static constexpr tracy::SourceLocationData TracyConcat(__tracy_source_location,TracyLine) { name, TracyFunction,  TracyFile, (uint32_t)TracyLine, 0 TracySrcLocCategory( category ) }; tracy::CategoryZone<category> varname( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active )
 
 #define ZoneTransient( varname, active ) tracy::ScopedZone varname( TracyLine, TracyFile, strlen( TracyFile ), TracyFunction, strlen( TracyFunction ), nullptr, 0, TRACY_CALLSTACK, active )
 #define ZoneTransientN( varname, name, active ) tracy::ScopedZone varname( TracyLine, TracyFile, strlen( TracyFile ), TracyFunction, strlen( TracyFunction ), name, strlen( name ), TRACY_CALLSTACK, active )
@@ -177,6 +193,8 @@
 #define ZoneScopedN( name ) SuppressVarShadowWarning( ZoneNamedN( ___tracy_scoped_zone, name, true ) )
 #define ZoneScopedC( color ) SuppressVarShadowWarning( ZoneNamedC( ___tracy_scoped_zone, color, true ) )
 #define ZoneScopedNC( name, color ) SuppressVarShadowWarning( ZoneNamedNC( ___tracy_scoped_zone, name, color, true ) )
+#define ZoneScopedCat( category ) SuppressVarShadowWarning( ZoneNamedCat( ___tracy_scoped_zone, category, true ) )
+#define ZoneScopedNCat( name, category ) SuppressVarShadowWarning( ZoneNamedNCat( ___tracy_scoped_zone, name, category, true ) )
 
 #define ZoneText( txt, size ) ___tracy_scoped_zone.Text( txt, size )
 #define ZoneTextV( varname, txt, size ) varname.Text( txt, size )
@@ -199,6 +217,7 @@
 #define FrameMarkEnd( name ) tracy::Profiler::SendFrameMark( name, tracy::QueueType::FrameMarkMsgEnd )
 
 #define FrameImage( image, width, height, offset, flip ) tracy::Profiler::SendFrameImage( image, width, height, offset, flip )
+#define FrameImageCompressed( image, width, height, offset, flip ) tracy::Profiler::SendFrameImageCompressed( image, width, height, offset, flip )
 
 #define TracyLockable( type, varname ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static constexpr tracy::SourceLocationData srcloc { nullptr, #type " " #varname, TracyFile, TracyLine, 0 }; return &srcloc; }() }
 #define TracyLockableN( type, varname, desc ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static constexpr tracy::SourceLocationData srcloc { nullptr, desc, TracyFile, TracyLine, 0 }; return &srcloc; }() }
@@ -211,6 +230,7 @@
 
 #define TracyPlot( name, val ) tracy::Profiler::PlotData( name, val )
 #define TracyPlotConfig( name, type, step, fill, color ) tracy::Profiler::ConfigurePlot( name, type, step, fill, color )
+#define TracyPlotDownsample( name, window, aggregate ) tracy::PlotDownsampleSetup( name, window, tracy::PlotAggregate::aggregate )
 
 #define TracyAppInfo( txt, size ) tracy::Profiler::MessageAppInfo( txt, size )
 
@@ -269,10 +289,27 @@
 #define TracyIsConnected tracy::GetProfiler().IsConnected()
 #define TracySetProgramName( name ) tracy::GetProfiler().SetProgramName( name );
 
+#ifdef TRACY_ZONE_SAMPLING
+#  define TracyZoneSampling( name, mode, value ) tracy::ZoneSamplingSetup( name, tracy::ZoneSamplingMode::mode, value )
+#else
+#  define TracyZoneSampling( name, mode, value )
+#endif
+
+#ifdef TRACY_ZONE_CATEGORIES
+#  define TracyZoneCategorySetup( category, name, enabled ) tracy::ZoneCategorySetup( category, name, enabled )
+#  define TracyZoneCategoryEnable( category, enabled ) tracy::ZoneCategoryEnable( category, enabled )
+#else
+#  define TracyZoneCategorySetup( category, name, enabled )
+#  define TracyZoneCategoryEnable( category, enabled )
+#endif
+
 #ifdef TRACY_FIBERS
 #  define TracyFiberEnter( fiber ) tracy::Profiler::EnterFiber( fiber, 0 )
 #  define TracyFiberEnterHint( fiber, groupHint ) tracy::Profiler::EnterFiber( fiber, groupHint )
 #  define TracyFiberLeave tracy::Profiler::LeaveFiber()
+#  define TracyFiberRegister( name ) tracy::Profiler::RegisterFiber( name )
+#  define TracyFiberEnterId( id ) tracy::Profiler::EnterFiberId( id, 0 )
+#  define TracyFiberEnterIdHint( id, groupHint ) tracy::Profiler::EnterFiberId( id, groupHint )
 #endif
 
 #endif
@@ -18,6 +18,15 @@ enum TracyPlotFormatEnum
     TracyPlotFormatWatt
 };
 
+enum TracyPlotAggregateEnum
+{
+    TracyPlotAggregateLast,
+    TracyPlotAggregateMin,
+    TracyPlotAggregateMax,
+    TracyPlotAggregateMean,
+    TracyPlotAggregateSum
+};
+
 enum TracyMessageSeverity
 {
     TracyMessageSeverityTrace,   // Broadly track variable states and events in the software program.
@@ -28,6 +37,13 @@ enum TracyMessageSeverity
     TracyMessageSeverityFatal,   // Describes a critical event that will lead to a software failure/crash.
 };
 
+enum TracyZoneBatchType
+{
+    TracyZoneBatchBegin,         // Zone described by srcloc begins at time.
+    TracyZoneBatchEnd,           // Innermost open zone ends at time.
+    TracyZoneBatchValue,         // Value is attached to the innermost open zone.
+};
+
 TRACY_API void ___tracy_set_thread_name( const char* name );
 
 #define TracyCSetThreadName( name ) ___tracy_set_thread_name( name );
@@ -59,6 +75,7 @@ typedef const void* TracyCLockCtx;
 #define TracyCZoneName(c,x,y)
 #define TracyCZoneColor(c,x)
 #define TracyCZoneValue(c,x)
+#define TracyCZoneBatch(x,y)
 
 #define TracyCAlloc(x,y)
 #define TracyCFree(x)
@@ -77,11 +94,13 @@ typedef const void* TracyCLockCtx;
 #define TracyCFrameMarkStart(x)
 #define TracyCFrameMarkEnd(x)
 #define TracyCFrameImage(x,y,z,w,a)
+#define TracyCFrameImageCompressed(x,y,z,w,a)
 
 #define TracyCPlot(x,y)
 #define TracyCPlotF(x,y)
 #define TracyCPlotI(x,y)
 #define TracyCPlotConfig(x,y,z,w,a)
+#define TracyCPlotDownsample(x,y,z)
 
 #define TracyCMessage(x,y)
 #define TracyCMessageL(x)
@@ -120,6 +139,11 @@ typedef const void* TracyCLockCtx;
 #define TracyCLockAfterTryLock(l,x)
 #define TracyCLockMark(l)
 #define TracyCLockCustomName(l,x,y)
+#define TracyCSharedLockAnnounce(l)
+#define TracyCLockBeforeLockShared(l)
+#define TracyCLockAfterLockShared(l)
+#define TracyCLockAfterUnlockShared(l)
+#define TracyCLockAfterTryLockShared(l,x)
 
 #define TracyCIsConnected 0
 #define TracyCIsStarted 0
@@ -127,9 +151,16 @@ typedef const void* TracyCLockCtx;
 #define TracyCBeginSamplingProfiling() 0
 #define TracyCEndSamplingProfiling()
 
+#define TracyCZoneCat(c,x,y)
+#define TracyCZoneNCat(c,x,y,z)
+#define TracyCZoneCategorySetup(x,y,z)
+#define TracyCZoneCategoryEnable(x,y)
+
 #ifdef TRACY_FIBERS
 #  define TracyCFiberEnter(fiber)
 #  define TracyCFiberLeave
+#  define TracyCFiberRegister(name) 0
+#  define TracyCFiberEnterId(id)
 #endif
 
 #else
@@ -148,14 +179,33 @@ struct ___tracy_source_location_data
     const char* file;
     uint32_t line;
     uint32_t color;
+#ifdef TRACY_ZONE_CATEGORIES
+    uint32_t category;
+#endif
 };
 
+#ifdef TRACY_ZONE_CATEGORIES
+#  define TracyCSrcLocCategory( category ) , category
+#else
+#  define TracyCSrcLocCategory( category )
+#endif
+
 struct ___tracy_c_zone_context
 {
     uint32_t id;
     int32_t active;
 };
 
+// Times are in the units of ___tracy_get_time() and must not decrease within a batch, nor
+// between a batch and the events emitted on the same thread before it.
+struct ___tracy_zone_batch_event
+{
+    const struct ___tracy_source_location_data* srcloc;
+    int64_t time;
+    uint64_t value;
+    uint8_t type;
+};
+
 struct ___tracy_gpu_time_data
 {
     int64_t gpuTime;
@@ -206,6 +256,22 @@ struct ___tracy_gpu_time_sync_data {
     uint8_t context;
 };
 
+// See tracy::ProfilerStats.
+struct ___tracy_client_stats {
+    uint64_t queueDepth;
+    uint64_t serialDepth;
+    uint64_t symbolQueueDepth;
+    uint64_t frameImageBacklog;
+    uint64_t workerBusyNs;
+    uint64_t workerIdleNs;
+    uint64_t rawBytes;
+    uint64_t compressedBytes;
+    uint64_t sendNs;
+    uint64_t symbolsResolved;
+    uint64_t samplesLost;
+    uint64_t frameImagesDropped;
+};
+
 struct __tracy_lockable_context_data;
 
 // Some containers don't support storing const types.
@@ -237,6 +303,9 @@ TRACY_API void ___tracy_emit_zone_name( TracyCZoneCtx ctx, const char* txt, size
 TRACY_API void ___tracy_emit_zone_color( TracyCZoneCtx ctx, uint32_t color );
 TRACY_API void ___tracy_emit_zone_value( TracyCZoneCtx ctx, uint64_t value );
 
+TRACY_API int64_t ___tracy_get_time(void);
+TRACY_API void ___tracy_emit_zone_batch( const struct ___tracy_zone_batch_event* events, size_t count );
+
 TRACY_API void ___tracy_emit_gpu_zone_begin( const struct ___tracy_gpu_zone_begin_data );
 TRACY_API void ___tracy_emit_gpu_zone_begin_callstack( const struct ___tracy_gpu_zone_begin_callstack_data );
 TRACY_API void ___tracy_emit_gpu_zone_begin_alloc( const struct ___tracy_gpu_zone_begin_data );
@@ -260,15 +329,27 @@ TRACY_API void ___tracy_emit_gpu_calibration_serial( const struct ___tracy_gpu_c
 TRACY_API void ___tracy_emit_gpu_time_sync_serial( const struct ___tracy_gpu_time_sync_data );
 
 TRACY_API int32_t ___tracy_connected(void);
+// Points to a byte which is nonzero while a server is connected, for bindings which check the
+// connection inline. It is to be read atomically, and stays valid as long as the profiler does.
+TRACY_API const void* ___tracy_connected_flag(void);
+TRACY_API void ___tracy_get_client_stats( struct ___tracy_client_stats* stats );
+
+// See tracy::SetProfilerThreadAffinity() and tracy::SetProfilerThreadPriority(). The scheduling
+// class is 0 for normal, 1 for batch and 2 for idle. Return 1 on success.
+TRACY_API int32_t ___tracy_set_thread_affinity( const char* cpus );
+TRACY_API int32_t ___tracy_set_thread_priority( int32_t nice, int32_t sched );
 
 #ifndef TRACY_CALLSTACK
 #define TRACY_CALLSTACK 0
 #endif
 
-#define TracyCZone( ctx, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
-#define TracyCZoneN( ctx, name, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
-#define TracyCZoneC( ctx, color, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, color }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
-#define TracyCZoneNC( ctx, name, color, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, color }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+#define TracyCZone( ctx, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+#define TracyCZoneN( ctx, name, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+#define TracyCZoneC( ctx, color, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, color TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+#define TracyCZoneNC( ctx, name, color, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, color TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+
+#define TracyCZoneCat( ctx, category, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( category ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
+#define TracyCZoneNCat( ctx, name, category, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( category ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), TRACY_CALLSTACK, active );
 
 #define TracyCZoneEnd( ctx ) ___tracy_emit_zone_end( ctx );
 
@@ -277,6 +358,8 @@ TRACY_API int32_t ___tracy_connected(void);
 #define TracyCZoneColor( ctx, color ) ___tracy_emit_zone_color( ctx, color );
 #define TracyCZoneValue( ctx, value ) ___tracy_emit_zone_value( ctx, value );
 
+#define TracyCZoneBatch( events, count ) ___tracy_emit_zone_batch( events, count );
+
 
 TRACY_API void ___tracy_emit_memory_alloc( const void* ptr, size_t size, int32_t secure );
 TRACY_API void ___tracy_emit_memory_alloc_callstack( const void* ptr, size_t size, int32_t depth, int32_t secure );
@@ -314,31 +397,35 @@ TRACY_API void ___tracy_emit_frame_mark( const char* name );
 TRACY_API void ___tracy_emit_frame_mark_start( const char* name );
 TRACY_API void ___tracy_emit_frame_mark_end( const char* name );
 TRACY_API void ___tracy_emit_frame_image( const void* image, uint16_t w, uint16_t h, uint8_t offset, int32_t flip );
+TRACY_API void ___tracy_emit_frame_image_compressed( const void* image, uint16_t w, uint16_t h, uint8_t offset, int32_t flip );
 
 #define TracyCFrameMark ___tracy_emit_frame_mark( 0 );
 #define TracyCFrameMarkNamed( name ) ___tracy_emit_frame_mark( name );
 #define TracyCFrameMarkStart( name ) ___tracy_emit_frame_mark_start( name );
 #define TracyCFrameMarkEnd( name ) ___tracy_emit_frame_mark_end( name );
 #define TracyCFrameImage( image, width, height, offset, flip ) ___tracy_emit_frame_image( image, width, height, offset, flip );
+#define TracyCFrameImageCompressed( image, width, height, offset, flip ) ___tracy_emit_frame_image_compressed( image, width, height, offset, flip );
 
 
 TRACY_API void ___tracy_emit_plot( const char* name, double val );
 TRACY_API void ___tracy_emit_plot_float( const char* name, float val );
 TRACY_API void ___tracy_emit_plot_int( const char* name, int64_t val );
 TRACY_API void ___tracy_emit_plot_config( const char* name, int32_t type, int32_t step, int32_t fill, uint32_t color );
+TRACY_API void ___tracy_emit_plot_downsample( const char* name, int64_t window, int32_t aggregate );
 TRACY_API void ___tracy_emit_message_appinfo( const char* txt, size_t size );
 
 #define TracyCPlot( name, val ) ___tracy_emit_plot( name, val );
 #define TracyCPlotF( name, val ) ___tracy_emit_plot_float( name, val );
 #define TracyCPlotI( name, val ) ___tracy_emit_plot_int( name, val );
 #define TracyCPlotConfig( name, type, step, fill, color ) ___tracy_emit_plot_config( name, type, step, fill, color );
+#define TracyCPlotDownsample( name, window, aggregate ) ___tracy_emit_plot_downsample( name, window, aggregate );
 #define TracyCAppInfo( txt, size ) ___tracy_emit_message_appinfo( txt, size );
 
 
-#define TracyCZoneS( ctx, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
-#define TracyCZoneNS( ctx, name, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
-#define TracyCZoneCS( ctx, color, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, color }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
-#define TracyCZoneNCS( ctx, name, color, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, color }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
+#define TracyCZoneS( ctx, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
+#define TracyCZoneNS( ctx, name, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
+#define TracyCZoneCS( ctx, color, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, color TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
+#define TracyCZoneNCS( ctx, name, color, depth, active ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { name, __func__,  TracyFile, (uint32_t)TracyLine, color TracyCSrcLocCategory( 0 ) }; TracyCZoneCtx ctx = ___tracy_emit_zone_begin_callstack( &TracyConcat(__tracy_source_location,TracyLine), depth, active );
 
 #define TracyCAllocS( ptr, size, depth ) ___tracy_emit_memory_alloc_callstack( ptr, size, depth, 0 )
 #define TracyCFreeS( ptr, depth ) ___tracy_emit_memory_free_callstack( ptr, depth, 0 )
@@ -366,15 +453,25 @@ TRACY_API void ___tracy_after_unlock_lockable_ctx( struct __tracy_lockable_conte
 TRACY_API void ___tracy_after_try_lock_lockable_ctx( struct __tracy_lockable_context_data* lockdata, int32_t acquired );
 TRACY_API void ___tracy_mark_lockable_ctx( struct __tracy_lockable_context_data* lockdata, const struct ___tracy_source_location_data* srcloc );
 TRACY_API void ___tracy_custom_name_lockable_ctx( struct __tracy_lockable_context_data* lockdata, const char* name, size_t nameSz );
+TRACY_API struct __tracy_lockable_context_data* ___tracy_announce_shared_lockable_ctx( const struct ___tracy_source_location_data* srcloc );
+TRACY_API int32_t ___tracy_before_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata );
+TRACY_API void ___tracy_after_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata );
+TRACY_API void ___tracy_after_unlock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata );
+TRACY_API void ___tracy_after_try_lock_shared_lockable_ctx( struct __tracy_lockable_context_data* lockdata, int32_t acquired );
 
-#define TracyCLockAnnounce( lock ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; lock = ___tracy_announce_lockable_ctx( &TracyConcat(__tracy_source_location,TracyLine) );
+#define TracyCLockAnnounce( lock ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; lock = ___tracy_announce_lockable_ctx( &TracyConcat(__tracy_source_location,TracyLine) );
 #define TracyCLockTerminate( lock ) ___tracy_terminate_lockable_ctx( lock );
 #define TracyCLockBeforeLock( lock ) ___tracy_before_lock_lockable_ctx( lock );
 #define TracyCLockAfterLock( lock ) ___tracy_after_lock_lockable_ctx( lock );
 #define TracyCLockAfterUnlock( lock ) ___tracy_after_unlock_lockable_ctx( lock );
 #define TracyCLockAfterTryLock( lock, acquired ) ___tracy_after_try_lock_lockable_ctx( lock, acquired );
-#define TracyCLockMark( lock ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 }; ___tracy_mark_lockable_ctx( lock, &TracyConcat(__tracy_source_location,TracyLine) );
+#define TracyCLockMark( lock ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; ___tracy_mark_lockable_ctx( lock, &TracyConcat(__tracy_source_location,TracyLine) );
 #define TracyCLockCustomName( lock, name, nameSz ) ___tracy_custom_name_lockable_ctx( lock, name, nameSz );
+#define TracyCSharedLockAnnounce( lock ) static const struct ___tracy_source_location_data TracyConcat(__tracy_source_location,TracyLine) = { NULL, __func__,  TracyFile, (uint32_t)TracyLine, 0 TracyCSrcLocCategory( 0 ) }; lock = ___tracy_announce_shared_lockable_ctx( &TracyConcat(__tracy_source_location,TracyLine) );
+#define TracyCLockBeforeLockShared( lock ) ___tracy_before_lock_shared_lockable_ctx( lock );
+#define TracyCLockAfterLockShared( lock ) ___tracy_after_lock_shared_lockable_ctx( lock );
+#define TracyCLockAfterUnlockShared( lock ) ___tracy_after_unlock_shared_lockable_ctx( lock );
+#define TracyCLockAfterTryLockShared( lock, acquired ) ___tracy_after_try_lock_shared_lockable_ctx( lock, acquired );
 
 #define TracyCIsConnected ___tracy_connected()
 
@@ -384,12 +481,27 @@ TRACY_API void ___tracy_end_sampling_profiler( void );
 #define TracyCBeginSamplingProfiling() ___tracy_begin_sampling_profiling()
 #define TracyCEndSamplingProfiling() ___tracy_end_sampling_profiling()
 
+#ifdef TRACY_ZONE_CATEGORIES
+TRACY_API void ___tracy_zone_category_setup( uint32_t category, const char* name, int32_t enabled );
+TRACY_API void ___tracy_zone_category_enable( uint32_t category, int32_t enabled );
+
+#  define TracyCZoneCategorySetup( category, name, enabled ) ___tracy_zone_category_setup( category, name, enabled );
+#  define TracyCZoneCategoryEnable( category, enabled ) ___tracy_zone_category_enable( category, enabled );
+#else
+#  define TracyCZoneCategorySetup( category, name, enabled )
+#  define TracyCZoneCategoryEnable( category, enabled )
+#endif
+
 #ifdef TRACY_FIBERS
 TRACY_API void ___tracy_fiber_enter( const char* fiber );
 TRACY_API void ___tracy_fiber_leave( void );
+TRACY_API uint32_t ___tracy_fiber_register( const char* name );
+TRACY_API void ___tracy_fiber_enter_id( uint32_t id );
 
 #  define TracyCFiberEnter( fiber ) ___tracy_fiber_enter( fiber );
 #  define TracyCFiberLeave ___tracy_fiber_leave();
+#  define TracyCFiberRegister( name ) ___tracy_fiber_register( name )
+#  define TracyCFiberEnterId( id ) ___tracy_fiber_enter_id( id );
 #endif
 
 #endif
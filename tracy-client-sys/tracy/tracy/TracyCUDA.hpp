@@ -49,6 +49,10 @@ using CUDACtx = std::nullptr_t;
 #define TRACY_CUDA_ENABLE_COLLECTOR_THREAD (1)
 #endif//TRACY_CUDA_ENABLE_COLLECTOR_THREAD
 
+#ifndef TRACY_CUDA_ENABLE_PARSER_THREAD
+#define TRACY_CUDA_ENABLE_PARSER_THREAD (1)
+#endif//TRACY_CUDA_ENABLE_PARSER_THREAD
+
 #ifndef TRACY_CUDA_ENABLE_CUDA_CALL_STATS
 #define TRACY_CUDA_ENABLE_CUDA_CALL_STATS (0)
 #endif//TRACY_CUDA_ENABLE_CUDA_CALL_STATS
@@ -337,6 +341,7 @@ struct ConcurrentHashMap {
     }
     auto fetch(TKey key, TValue& value) {
         ZoneNamed(fetch, instrument);
+        auto lock = acquire_read_lock();
         auto it = mapping.find(key);
         if (it != mapping.end()) {
             value = it->second;
@@ -520,6 +525,7 @@ namespace tracy
         {
             ZoneScoped;
             CUPTI::FlushActivity();
+            CUPTI::WaitForActivityParsed();
         }
 
         void printStats()
@@ -642,14 +648,39 @@ namespace tracy
         }
 
         struct CUPTI {
+        static constexpr size_t activityBufferSize = 1 * 1024*1024; // 1MB
+
+        // NOTE: according to the CUPTI documentation: "To minimize profiling overhead
+        // the client should return as quickly as possible from these callbacks." Buffers are
+        // recycled rather than allocated for every request, so the pool grows to the number of
+        // buffers CUPTI and the parser thread hold on to at once, and no further.
+        struct ActivityBufferPool {
+            std::mutex m;
+            std::vector<uint8_t*> available;
+
+            uint8_t* Acquire() {
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    if (!available.empty()) {
+                        uint8_t* buffer = available.back();
+                        available.pop_back();
+                        return buffer;
+                    }
+                }
+                return (uint8_t*)tracyMalloc(activityBufferSize);
+            }
+
+            void Release(uint8_t* buffer) {
+                std::unique_lock<std::mutex> lock(m);
+                available.push_back(buffer);
+            }
+        };
+
         static void CUPTIAPI OnBufferRequested(uint8_t **buffer, size_t *size, size_t *maxNumRecords)
         {
             ZoneScoped;
-            // TODO(marcos): avoid malloc and instead suballocate from a large circular buffer;
-            // according to the CUPTI documentation: "To minimize profiling overhead the client
-            // should return as quickly as possible from these callbacks."
-            *size = 1 * 1024*1024; // 1MB
-            *buffer = (uint8_t*)tracyMalloc(*size);
+            *size = activityBufferSize;
+            *buffer = PersistentState::Get().activityBuffers.Acquire();
             assert(*buffer != nullptr);
             FlushActivityAsync();
         }
@@ -659,7 +690,24 @@ namespace tracy
             // CUDA 6.0 onwards: all buffers from this callback are "global" buffers
             // (i.e. there is no context/stream specific buffer; ctx is always NULL)
             ZoneScoped;
-            tracy::SetThreadName("NVIDIA CUPTI Worker");
+            static thread_local bool named = false;
+            if (!named) {
+                tracy::SetThreadName("NVIDIA CUPTI Worker");
+                named = true;
+            }
+            size_t dropped = 0;
+            CUPTI_API_CALL(cuptiActivityGetNumDroppedRecords(ctx, streamId, &dropped));
+            assert(dropped == 0);
+            #if TRACY_CUDA_ENABLE_PARSER_THREAD
+            PersistentState::Get().parser.Push(buffer, validSize);
+            #else
+            ProcessActivityBuffer(buffer, validSize);
+            #endif
+        }
+
+        static void ProcessActivityBuffer(uint8_t* buffer, size_t validSize)
+        {
+            ZoneScoped;
             CUptiResult status;
             CUpti_Activity* record = nullptr;
             while ((status = cuptiActivityGetNextRecord(buffer, validSize, &record)) == CUPTI_SUCCESS) {
@@ -668,11 +716,11 @@ namespace tracy
             if (status != CUPTI_ERROR_MAX_LIMIT_REACHED) {
                 CUptiCallChecked(status, "cuptiActivityGetNextRecord", TracyFile, TracyLine);
             }
-            size_t dropped = 0;
-            CUPTI_API_CALL(cuptiActivityGetNumDroppedRecords(ctx, streamId, &dropped));
-            assert(dropped == 0);
-            tracyFree(buffer);
-            PersistentState::Get().profilerHost->OnEventsProcessed();
+            auto& persistent = PersistentState::Get();
+            persistent.activityBuffers.Release(buffer);
+            if (persistent.profilerHost != nullptr) {
+                persistent.profilerHost->OnEventsProcessed();
+            }
         }
 
         // correlationID -> [CPU start time, CPU end time, CUPTI start time]
@@ -965,13 +1013,32 @@ namespace tracy
         }
 
         static tracy::SourceLocationData* getKernelSourceLocation(const char* kernelName)
+        {
+            // NOTE: CUPTI shares the name string among all the activity records of the same
+            // kernel, so its address identifies the kernel: the name is only demangled and
+            // hashed the first time the kernel shows up, and a kernel launched over and over
+            // again is told apart from the previous one without taking any lock at all
+            static thread_local const char* lastKernelName = nullptr;
+            static thread_local tracy::SourceLocationData* lastSrcLoc = nullptr;
+            if (kernelName == lastKernelName) {
+                return lastSrcLoc;
+            }
+            auto& kernelNameSrcLoc = PersistentState::Get().kernelNameSrcLoc;
+            tracy::SourceLocationData* pSrcLoc = nullptr;
+            if (!kernelNameSrcLoc.fetch(uintptr_t(kernelName), pSrcLoc)) {
+                pSrcLoc = internKernelSourceLocation(kernelName);
+                kernelNameSrcLoc.emplace(uintptr_t(kernelName), pSrcLoc);
+            }
+            lastKernelName = kernelName;
+            lastSrcLoc = pSrcLoc;
+            return pSrcLoc;
+        }
+
+        static tracy::SourceLocationData* internKernelSourceLocation(const char* kernelName)
         {
             auto& kernelSrcLoc = PersistentState::Get().kernelSrcLoc;
             std::string_view demangledName;
         #ifndef _MSC_VER
-            // TODO(marcos): extractActualNameNested is the main bottleneck right now;
-            // we need a specialized StringTable mapping from "peristent" kernel names
-            // (const char*/uintptr_t) to memoized, lazily initialized demangled names
             auto& demangledNameTable = PersistentState::Get().demangledNameTable;
             std::string demangled = extractActualNameNested(kernelName);
             demangledName = demangledNameTable[demangled];
@@ -1182,6 +1249,7 @@ namespace tracy
             cudaDeviceSynchronize();
 
             FlushActivity();
+            WaitForActivityParsed();
 
             auto& subscriber = PersistentState::Get().subscriber;
             for (auto activity : activities) {
@@ -1244,6 +1312,74 @@ namespace tracy
         };
         #endif
 
+        #if TRACY_CUDA_ENABLE_PARSER_THREAD
+        // NOTE: the CUPTI worker thread only hands the completed buffers over, so that
+        // building the zones out of the activity records doesn't hold back the delivery of the
+        // next buffers, nor the application threads waiting on CUPTI for new ones
+        struct Parser {
+            struct CompletedBuffer { uint8_t* buffer; size_t validSize; };
+            std::mutex mtx;
+            std::condition_variable signal;
+            std::condition_variable drained;
+            std::vector<CompletedBuffer> pending;
+            bool busy = false;
+            bool running = true;
+            std::thread thread = std::thread(
+                [this]() {
+                    tracy::SetThreadName("Tracy CUDA Parser");
+                    atexit([]() {
+                        auto& parser = CUPTI::PersistentState::Get().parser;
+                        {
+                            std::unique_lock<std::mutex> lock(parser.mtx);
+                            parser.running = false;
+                        }
+                        parser.signal.notify_one();
+                        parser.thread.join();
+                    });
+                    std::vector<CompletedBuffer> batch;
+                    std::unique_lock<std::mutex> lock(mtx);
+                    while (running || !pending.empty()) {
+                        if (pending.empty()) {
+                            signal.wait(lock);
+                            continue;
+                        }
+                        batch.swap(pending);
+                        busy = true;
+                        lock.unlock();
+                        for (auto& completed : batch) {
+                            ProcessActivityBuffer(completed.buffer, completed.validSize);
+                        }
+                        batch.clear();
+                        lock.lock();
+                        busy = false;
+                        drained.notify_all();
+                    }
+                }
+            );
+
+            void Push(uint8_t* buffer, size_t validSize) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    pending.push_back({ buffer, validSize });
+                }
+                signal.notify_one();
+            }
+
+            void WaitDrained() {
+                std::unique_lock<std::mutex> lock(mtx);
+                drained.wait(lock, [this]() { return pending.empty() && !busy; });
+            }
+        };
+        #endif
+
+        static void WaitForActivityParsed()
+        {
+            #if TRACY_CUDA_ENABLE_PARSER_THREAD
+            ZoneScoped;
+            PersistentState::Get().parser.WaitDrained();
+            #endif
+        }
+
         static void FlushActivityAsync()
         {
             #if TRACY_CUDA_ENABLE_COLLECTOR_THREAD
@@ -1258,6 +1394,7 @@ namespace tracy
             // returning from main() because the Tracy client worker thread may still
             // be responding to string/source-location requests from the server
             SourceLocationMap kernelSrcLoc;
+            ConcurrentHashMap<uintptr_t, tracy::SourceLocationData*> kernelNameSrcLoc;
             StringTable demangledNameTable;
             SourceLocationLUT cudaCallSourceLocation;
 
@@ -1267,8 +1404,12 @@ namespace tracy
             ConcurrentHashMap<uintptr_t, int> memAllocAddress;
             CUpti_SubscriberHandle subscriber = {};
             CUDACtx* profilerHost = nullptr;
+            ActivityBufferPool activityBuffers;
 
             Collector collector;
+            #if TRACY_CUDA_ENABLE_PARSER_THREAD
+            Parser parser;
+            #endif
 
             static PersistentState& Get() {
                 static PersistentState& persistent = *(new PersistentState());
@@ -40,7 +40,7 @@ using TracyD3D12Ctx = void*;
 #include <cassert>
 #include <d3d12.h>
 #include <dxgi.h>
-#include <queue>
+#include <atomic>
 
 #define TracyD3D12Panic(msg, ...) do { assert(false && "TracyD3D12: " msg); TracyMessageLC("TracyD3D12: " msg, tracy::Color::Red4); __VA_ARGS__; } while(false);
 
@@ -64,14 +64,28 @@ namespace tracy
         ID3D12QueryHeap* m_queryHeap = nullptr;
         ID3D12Resource* m_readbackBuffer = nullptr;
 
+        // The readback buffer stays mapped for the lifetime of the context.
+        uint64_t* m_timestampData = nullptr;
+
         // In-progress payload.
         uint32_t m_queryLimit = 0;
         std::atomic<uint32_t> m_queryCounter = 0;
         uint32_t m_previousQueryCounter = 0;
 
-        uint32_t m_activePayload = 0;
+        // Payload number N is signaled on the fence with value N and lives in slot (N-1) % m_payloadCapacity
+        // until it is collected. NewFrame() is the only producer and Collect() the only consumer.
         ID3D12Fence* m_payloadFence = nullptr;
-        std::queue<D3D12QueryPayload> m_payloadQueue;
+        D3D12QueryPayload* m_payloads = nullptr;
+        uint32_t m_payloadCapacity = 0;
+        std::atomic<UINT64> m_activePayload = 0;
+        std::atomic<UINT64> m_collectedPayload = 0;
+
+        // The queries of a payload are resolved into the readback buffer by a command list of the context,
+        // executed on the queue right before the payload is signaled.
+        static constexpr uint32_t ResolveListCount = 8;
+        ID3D12CommandAllocator* m_resolveAllocators[ResolveListCount] = {};
+        ID3D12GraphicsCommandList* m_resolveLists[ResolveListCount] = {};
+        UINT64 m_resolvePayloads[ResolveListCount] = {};
 
         UINT64 m_prevCalibrationTicksCPU = 0;
 
@@ -171,11 +185,34 @@ namespace tracy
                 TracyD3D12Panic("Failed to create query readback buffer.", return);
             }
 
+            D3D12_RANGE mapRange{ 0, m_queryLimit * sizeof(uint64_t) };
+            void* readbackBufferMapping = nullptr;
+            if (FAILED(m_readbackBuffer->Map(0, &mapRange, &readbackBufferMapping)))
+            {
+                TracyD3D12Panic("Failed to map readback buffer.", return);
+            }
+            m_timestampData = static_cast<uint64_t*>(readbackBufferMapping);
+
+            for (uint32_t i = 0; i < ResolveListCount; ++i)
+            {
+                const auto type = queue->GetDesc().Type;
+                if (FAILED(device->CreateCommandAllocator(type, IID_PPV_ARGS(&m_resolveAllocators[i]))) ||
+                    FAILED(device->CreateCommandList(0, type, m_resolveAllocators[i], nullptr, IID_PPV_ARGS(&m_resolveLists[i]))))
+                {
+                    TracyD3D12Panic("Failed to create query resolve command list.", return);
+                }
+                m_resolveLists[i]->Close();
+            }
+
             if (FAILED(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_payloadFence))))
             {
                 TracyD3D12Panic("Failed to create payload fence.", return);
             }
 
+            // Every payload but an empty one holds at least a (begin, end) pair of queries.
+            m_payloadCapacity = m_queryLimit / 2;
+            m_payloads = static_cast<D3D12QueryPayload*>(tracy_malloc(m_payloadCapacity * sizeof(D3D12QueryPayload)));
+
             float period = [queue]()
             {
                 uint64_t timestampFrequency;
@@ -222,10 +259,18 @@ namespace tracy
         {
             ZoneScopedC(Color::Red4);
             // collect all pending timestamps
-            while (m_payloadFence->GetCompletedValue() != m_activePayload)
+            while (m_payloadFence->GetCompletedValue() < m_activePayload.load(std::memory_order_relaxed))
                 /* busy-wait ... */;
             Collect();
+            for (uint32_t i = 0; i < ResolveListCount; ++i)
+            {
+                m_resolveLists[i]->Release();
+                m_resolveAllocators[i]->Release();
+            }
+            tracy_free(m_payloads);
             m_payloadFence->Release();
+            D3D12_RANGE writtenRange{ 0, 0 };
+            m_readbackBuffer->Unmap(0, &writtenRange);
             m_readbackBuffer->Release();
             m_queryHeap->Release();
         }
@@ -233,8 +278,20 @@ namespace tracy
 
         void NewFrame()
         {
+            const auto payload = m_activePayload.load(std::memory_order_relaxed) + 1;
+            if (payload - m_collectedPayload.load(std::memory_order_acquire) > m_payloadCapacity)
+            {
+                // All slots are waiting to be collected: the queries carry over to the next frame.
+                return;
+            }
+
             uint32_t queryCounter = m_queryCounter.exchange(0);
-            m_payloadQueue.emplace(D3D12QueryPayload{ m_previousQueryCounter, queryCounter });
+            if (queryCounter > m_queryLimit)
+            {
+                queryCounter = m_queryLimit;
+            }
+
+            const uint32_t queryIdStart = m_previousQueryCounter;
             m_previousQueryCounter += queryCounter;
 
             if (m_previousQueryCounter >= m_queryLimit)
@@ -242,7 +299,14 @@ namespace tracy
                 m_previousQueryCounter -= m_queryLimit;
             }
 
-            m_queue->Signal(m_payloadFence, ++m_activePayload);
+            if (queryCounter != 0)
+            {
+                ResolvePayload(payload, queryIdStart, queryCounter);
+            }
+
+            m_payloads[(payload - 1) % m_payloadCapacity] = D3D12QueryPayload{ queryIdStart, queryCounter };
+            m_activePayload.store(payload, std::memory_order_release);
+            m_queue->Signal(m_payloadFence, payload);
         }
 
         void Name( const char* name, uint16_t len )
@@ -266,61 +330,98 @@ namespace tracy
             if (!GetProfiler().IsConnected())
             {
                 m_queryCounter = 0;
+                m_collectedPayload.store(NewestReadyPayload(), std::memory_order_release);
 
                 return;
             }
 #endif
 
             // Find out what payloads are available.
-            const auto newestReadyPayload = m_payloadFence->GetCompletedValue();
-            const auto payloadCount = m_payloadQueue.size() - (m_activePayload - newestReadyPayload);
+            const auto newestReadyPayload = NewestReadyPayload();
+            const auto collectedPayload = m_collectedPayload.load(std::memory_order_relaxed);
 
-            if (!payloadCount)
+            if (newestReadyPayload <= collectedPayload)
             {
                 return;  // No payloads are available yet, exit out.
             }
 
-            D3D12_RANGE mapRange{ 0, m_queryLimit * sizeof(uint64_t) };
-
-            // Map the readback buffer so we can fetch the query data from the GPU.
-            void* readbackBufferMapping = nullptr;
-
-            if (FAILED(m_readbackBuffer->Map(0, &mapRange, &readbackBufferMapping)))
+            Profiler::QueueSerialLock();
+            for (auto payload = collectedPayload + 1; payload <= newestReadyPayload; ++payload)
             {
-                TracyD3D12Panic("Failed to map readback buffer.", return);
+                const auto& data = m_payloads[(payload - 1) % m_payloadCapacity];
+
+                // A payload wrapping around the end of the query heap is read in two contiguous ranges.
+                const auto tailCount = m_queryLimit - data.m_queryIdStart;
+                const auto firstCount = data.m_queryCount < tailCount ? data.m_queryCount : tailCount;
+                EmitTimestamps(data.m_queryIdStart, firstCount);
+                EmitTimestamps(0, data.m_queryCount - firstCount);
             }
+            Profiler::QueueSerialUnlock();
 
-            auto* timestampData = static_cast<uint64_t*>(readbackBufferMapping);
+            m_collectedPayload.store(newestReadyPayload, std::memory_order_release);
 
-            for (uint32_t i = 0; i < payloadCount; ++i)
-            {
-                const auto& payload = m_payloadQueue.front();
+            // Recalibrate to account for drift.
+            RecalibrateClocks();
+        }
 
-                for (uint32_t j = 0; j < payload.m_queryCount; ++j)
-                {
-                    const auto counter = (payload.m_queryIdStart + j) % m_queryLimit;
-                    const auto timestamp = timestampData[counter];
-                    const auto queryId = counter;
+    private:
+        UINT64 NewestReadyPayload() const
+        {
+            // The payloads are stored before they are signaled, and the fence value may be UINT64_MAX on device removal.
+            const auto activePayload = m_activePayload.load(std::memory_order_acquire);
+            const auto completedPayload = m_payloadFence->GetCompletedValue();
+            return completedPayload < activePayload ? completedPayload : activePayload;
+        }
 
-                    auto* item = Profiler::QueueSerial();
-                    MemWrite(&item->hdr.type, QueueType::GpuTime);
-                    MemWrite(&item->gpuTime.gpuTime, timestamp);
-                    MemWrite(&item->gpuTime.queryId, static_cast<uint16_t>(queryId));
-                    MemWrite(&item->gpuTime.context, GetId());
+        // Must be called with the serial queue locked.
+        void EmitTimestamps(uint32_t queryIdStart, uint32_t queryCount)
+        {
+            for (uint32_t i = 0; i < queryCount; ++i)
+            {
+                const auto queryId = queryIdStart + i;
+
+                auto* item = Profiler::QueueSerialNext();
+                MemWrite(&item->hdr.type, QueueType::GpuTime);
+                MemWrite(&item->gpuTime.gpuTime, m_timestampData[queryId]);
+                MemWrite(&item->gpuTime.queryId, static_cast<uint16_t>(queryId));
+                MemWrite(&item->gpuTime.context, GetId());
+                Profiler::QueueSerialCommitNext();
+            }
+        }
 
-                    Profiler::QueueSerialFinish();
-                }
+        // Resolves the queries of a payload in at most two contiguous ranges, so zones don't need to resolve
+        // their own queries in the command lists they are recorded in.
+        void ResolvePayload(UINT64 payload, uint32_t queryIdStart, uint32_t queryCount)
+        {
+            const auto slot = payload % ResolveListCount;
+            if (m_payloadFence->GetCompletedValue() < m_resolvePayloads[slot])
+            {
+                // The GPU is more than ResolveListCount frames behind; wait for the list to be done with.
+                ZoneScopedC(Color::Red4);
+                m_payloadFence->SetEventOnCompletion(m_resolvePayloads[slot], nullptr);
+            }
 
-                m_payloadQueue.pop();
+            auto* allocator = m_resolveAllocators[slot];
+            auto* list = m_resolveLists[slot];
+            if (FAILED(allocator->Reset()) || FAILED(list->Reset(allocator, nullptr)))
+            {
+                TracyD3D12Panic("Failed to reset query resolve command list.", return);
             }
 
-            m_readbackBuffer->Unmap(0, nullptr);
+            const auto tailCount = m_queryLimit - queryIdStart;
+            const auto firstCount = queryCount < tailCount ? queryCount : tailCount;
+            list->ResolveQueryData(m_queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, queryIdStart, firstCount, m_readbackBuffer, queryIdStart * sizeof(uint64_t));
+            if (firstCount != queryCount)
+            {
+                list->ResolveQueryData(m_queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, queryCount - firstCount, m_readbackBuffer, 0);
+            }
+            list->Close();
 
-            // Recalibrate to account for drift.
-            RecalibrateClocks();
+            ID3D12CommandList* lists[] = { list };
+            m_queue->ExecuteCommandLists(1, lists);
+            m_resolvePayloads[slot] = payload;
         }
 
-    private:
         tracy_force_inline uint32_t NextQueryId()
         {
             uint32_t queryCounter = m_queryCounter.fetch_add(2);
@@ -430,8 +531,6 @@ namespace tracy
             MemWrite(&item->gpuZoneEnd.queryId, static_cast<uint16_t>(queryId));
             MemWrite(&item->gpuZoneEnd.context, m_ctx->GetId());
             Profiler::QueueSerialFinish();
-
-            m_cmdList->ResolveQueryData(m_ctx->m_queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, m_queryId, 2, m_ctx->m_readbackBuffer, m_queryId * sizeof(uint64_t));
         }
     };
 
@@ -5,6 +5,7 @@
 
 #ifndef TRACY_ENABLE
 
+#include <stdint.h>
 #include <string.h>
 
 namespace tracy
@@ -122,11 +123,14 @@ static inline void LuaRemove( char* script )
 
 static inline void LuaHook( lua_State* L, lua_Debug* ar ) {}
 
+static inline void LuaSetHook( lua_State* L, uint32_t interval = 1 ) {}
+
 }
 
 #else
 
 #include <assert.h>
+#include <atomic>
 #include <limits>
 
 #include "../common/TracyColor.hpp"
@@ -156,6 +160,168 @@ static inline void LuaShortenSrc( char* dst, const char* src )
     dst[l] = 0;
 }
 
+// Source locations of the zones begun from Lua, one for every call site and zone name seen on the
+// thread, so that a zone doesn't have to allocate a source location and send its strings again
+// every time. The entries are never freed, as the profiler may ask for them at any time. Past
+// Limit entries, e.g. with zone names made up on the fly, zones fall back to allocating.
+class LuaSrcLocCache
+{
+public:
+    enum { Limit = 16 * 1024 };
+
+    LuaSrcLocCache() : m_table( nullptr ), m_mask( 0 ), m_size( 0 ) {}
+    ~LuaSrcLocCache() { if( m_table ) tracy_free( m_table ); }
+
+    LuaSrcLocCache( const LuaSrcLocCache& ) = delete;
+    LuaSrcLocCache& operator=( const LuaSrcLocCache& ) = delete;
+
+    const SourceLocationData* Get( uint32_t line, const char* file, const char* function, const char* name, size_t nameSz )
+    {
+        const auto fileSz = strlen( file );
+        const auto functionSz = strlen( function );
+        uint64_t hash = Hash( 0xcbf29ce484222325ull ^ line, file, fileSz + 1 );
+        hash = Hash( hash, function, functionSz + 1 );
+        if( name ) hash = Hash( hash, name, nameSz );
+
+        if( !m_table ) Grow();
+        auto idx = hash & m_mask;
+        while( auto entry = m_table[idx] )
+        {
+            if( entry->hash == hash && entry->srcloc.line == line &&
+                strcmp( entry->srcloc.file, file ) == 0 && strcmp( entry->srcloc.function, function ) == 0 &&
+                ( name ? entry->srcloc.name && entry->nameSz == nameSz && memcmp( entry->srcloc.name, name, nameSz ) == 0 : !entry->srcloc.name ) )
+            {
+                return &entry->srcloc;
+            }
+            idx = ( idx + 1 ) & m_mask;
+        }
+        if( m_size == Limit ) return nullptr;
+
+        const auto sz = sizeof( Entry ) + fileSz + 1 + functionSz + 1 + ( name ? nameSz + 1 : 0 );
+        auto entry = (Entry*)tracy_malloc( sz );
+        auto dst = (char*)( entry + 1 );
+        memcpy( dst, file, fileSz + 1 );
+        entry->srcloc.file = dst;
+        dst += fileSz + 1;
+        memcpy( dst, function, functionSz + 1 );
+        entry->srcloc.function = dst;
+        dst += functionSz + 1;
+        if( name )
+        {
+            memcpy( dst, name, nameSz );
+            dst[nameSz] = '\0';
+            entry->srcloc.name = dst;
+        }
+        else
+        {
+            entry->srcloc.name = nullptr;
+        }
+        entry->srcloc.line = line;
+        entry->srcloc.color = 0;
+#ifdef TRACY_ZONE_CATEGORIES
+        entry->srcloc.category = 0;
+#endif
+        entry->hash = hash;
+        entry->nameSz = nameSz;
+
+        m_table[idx] = entry;
+        if( ++m_size * 2 > m_mask ) Grow();
+        return &entry->srcloc;
+    }
+
+private:
+    struct Entry
+    {
+        SourceLocationData srcloc;
+        uint64_t hash;
+        size_t nameSz;
+    };
+
+    static uint64_t Hash( uint64_t hash, const char* ptr, size_t sz )
+    {
+        for( size_t i=0; i<sz; i++ )
+        {
+            hash ^= (uint8_t)ptr[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    void Grow()
+    {
+        const auto mask = m_mask ? m_mask * 2 + 1 : 255;
+        auto table = (Entry**)tracy_malloc( ( mask + 1 ) * sizeof( Entry* ) );
+        memset( table, 0, ( mask + 1 ) * sizeof( Entry* ) );
+        if( m_table )
+        {
+            for( size_t i=0; i<=m_mask; i++ )
+            {
+                auto entry = m_table[i];
+                if( !entry ) continue;
+                auto idx = entry->hash & mask;
+                while( table[idx] ) idx = ( idx + 1 ) & mask;
+                table[idx] = entry;
+            }
+            tracy_free( m_table );
+        }
+        m_table = table;
+        m_mask = mask;
+    }
+
+    Entry** m_table;
+    size_t m_mask;
+    size_t m_size;
+};
+
+static tracy_force_inline LuaSrcLocCache& GetLuaSrcLocCache()
+{
+    static thread_local LuaSrcLocCache cache;
+    return cache;
+}
+
+static tracy_force_inline void LuaBeginZone( uint32_t line, const char* file, const char* function, const char* name = nullptr, size_t nameSz = 0 )
+{
+#ifdef TRACY_HAS_ZONE_STATS
+    ZoneStatsEmitOpen();
+#endif
+    const auto srcloc = GetLuaSrcLocCache().Get( line, file, function, name, nameSz );
+    if( srcloc )
+    {
+        TracyQueuePrepare( QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
+        MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
+        TracyQueueCommit( zoneBeginThread );
+    }
+    else
+    {
+        TracyQueuePrepare( QueueType::ZoneBeginAllocSrcLoc );
+        MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
+        MemWrite( &item->zoneBegin.srcloc, Profiler::AllocSourceLocation( line, file, function, name, nameSz ) );
+        TracyQueueCommit( zoneBeginThread );
+    }
+}
+
+// State of LuaHook on the thread. Whether the zones are sampled is decided at the outermost call,
+// for it and for all the calls made from inside of it.
+struct LuaHookState
+{
+    uint32_t depth;
+    uint32_t calls;
+    bool active;
+};
+
+static tracy_force_inline LuaHookState& GetLuaHookState()
+{
+    static thread_local LuaHookState state = { 0, 0, true };
+    return state;
+}
+
+static tracy_force_inline std::atomic<uint32_t>& LuaHookInterval()
+{
+    static std::atomic<uint32_t> interval( 1 );
+    return interval;
+}
+
 #ifdef TRACY_HAS_CALLSTACK
 static tracy_force_inline void SendLuaCallstack( lua_State* L, uint32_t depth )
 {
@@ -216,6 +382,9 @@ static inline int LuaZoneBeginS( lua_State* L )
     const auto depth = uint32_t( lua_tointeger( L, 1 ) );
 #endif
     assert( depth > 0 ); // Would crash later anyway, this is not allowed
+#ifdef TRACY_HAS_ZONE_STATS
+    ZoneStatsEmitOpen();
+#endif
     SendLuaCallstack( L, depth );
 
     lua_Debug dbg;
@@ -248,6 +417,9 @@ static inline int LuaZoneBeginNS( lua_State* L )
     const auto depth = uint32_t( lua_tointeger( L, 2 ) );
 #endif
     assert( depth > 0 ); // Would crash later anyway, this is not allowed
+#ifdef TRACY_HAS_ZONE_STATS
+    ZoneStatsEmitOpen();
+#endif
     SendLuaCallstack( L, depth );
 
     lua_Debug dbg;
@@ -285,12 +457,7 @@ static inline int LuaZoneBegin( lua_State* L )
     lua_getinfo( L, "Snl", &dbg );
     char src[256];
     LuaShortenSrc( src, dbg.source );
-    const auto srcloc = Profiler::AllocSourceLocation( dbg.currentline, src, dbg.name ? dbg.name : dbg.short_src );
-
-    TracyQueuePrepare( QueueType::ZoneBeginAllocSrcLoc );
-    MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
-    MemWrite( &item->zoneBegin.srcloc, srcloc );
-    TracyQueueCommit( zoneBeginThread );
+    LuaBeginZone( dbg.currentline, src, dbg.name ? dbg.name : dbg.short_src );
     return 0;
 #endif
 }
@@ -314,12 +481,7 @@ static inline int LuaZoneBeginN( lua_State* L )
     char src[256];
     LuaShortenSrc( src, dbg.source );
     const auto name = lua_tolstring( L, 1, &nsz );
-    const auto srcloc = Profiler::AllocSourceLocation( dbg.currentline, src, dbg.name ? dbg.name : dbg.short_src, name, nsz );
-
-    TracyQueuePrepare( QueueType::ZoneBeginAllocSrcLoc );
-    MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
-    MemWrite( &item->zoneBegin.srcloc, srcloc );
-    TracyQueueCommit( zoneBeginThread );
+    LuaBeginZone( dbg.currentline, src, dbg.name ? dbg.name : dbg.short_src, name, nsz );
     return 0;
 #endif
 }
@@ -358,7 +520,7 @@ static inline int LuaZoneText( lua_State* L )
     const auto size = strlen( txt );
     assert( size < (std::numeric_limits<uint16_t>::max)() );
 
-    auto ptr = (char*)tracy_malloc( size );
+    auto ptr = StringArenaAlloc( size );
     memcpy( ptr, txt, size );
 
     TracyQueuePrepare( QueueType::ZoneText );
@@ -383,7 +545,7 @@ static inline int LuaZoneName( lua_State* L )
     const auto size = strlen( txt );
     assert( size < (std::numeric_limits<uint16_t>::max)() );
 
-    auto ptr = (char*)tracy_malloc( size );
+    auto ptr = StringArenaAlloc( size );
     memcpy( ptr, txt, size );
 
     TracyQueuePrepare( QueueType::ZoneName );
@@ -403,7 +565,7 @@ static inline int LuaMessage( lua_State* L )
     const auto size = strlen( txt );
     assert( size < (std::numeric_limits<uint16_t>::max)() );
 
-    auto ptr = (char*)tracy_malloc( size );
+    auto ptr = StringArenaAlloc( size );
     memcpy( ptr, txt, size );
 
     TaggedUserlandAddress taggedPtr{ (uint64_t)ptr, MakeMessageMetadata( MessageSourceType::User, MessageSeverity::Info ) };
@@ -451,8 +613,15 @@ static inline void LuaRemove( char* script ) {}
 
 static inline void LuaHook( lua_State* L, lua_Debug* ar )
 {
+    auto& state = detail::GetLuaHookState();
     if ( ar->event == LUA_HOOKCALL )
     {
+        if ( state.depth++ == 0 )
+        {
+            const auto interval = detail::LuaHookInterval().load( std::memory_order_relaxed );
+            state.active = state.calls++ % interval == 0;
+        }
+        if ( !state.active ) return;
 #ifdef TRACY_ON_DEMAND
         const auto zoneCnt = GetLuaZoneState().counter++;
         if ( zoneCnt != 0 && !GetLuaZoneState().active ) return;
@@ -463,14 +632,13 @@ static inline void LuaHook( lua_State* L, lua_Debug* ar )
 
         char src[256];
         detail::LuaShortenSrc( src, ar->short_src );
-
-        const auto srcloc = Profiler::AllocSourceLocation( ar->currentline, src, ar->name ? ar->name : ar->short_src );
-        TracyQueuePrepare( QueueType::ZoneBeginAllocSrcLoc );
-        MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
-        MemWrite( &item->zoneBegin.srcloc, srcloc );
-        TracyQueueCommit( zoneBeginThread );
+        detail::LuaBeginZone( ar->currentline, src, ar->name ? ar->name : ar->short_src );
     }
     else if (ar->event == LUA_HOOKRET) {
+        // Returns from the functions which were running when the hook was set have no zone.
+        if ( state.depth == 0 ) return;
+        state.depth--;
+        if ( !state.active ) return;
 #ifdef TRACY_ON_DEMAND
         assert( GetLuaZoneState().counter != 0 );
         GetLuaZoneState().counter--;
@@ -487,6 +655,15 @@ static inline void LuaHook( lua_State* L, lua_Debug* ar )
     }
 }
 
+// Sets LuaHook on the state, which begins a zone for every call of a Lua function. With an
+// interval above 1, only one in every interval outermost calls on each thread is zoned, along
+// with all the calls made from inside of it.
+static inline void LuaSetHook( lua_State* L, uint32_t interval = 1 )
+{
+    detail::LuaHookInterval().store( interval > 0 ? interval : 1, std::memory_order_relaxed );
+    lua_sethook( L, LuaHook, LUA_MASKCALL | LUA_MASKRET, 0 );
+}
+
 }
 
 #endif
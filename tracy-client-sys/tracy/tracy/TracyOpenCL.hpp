@@ -86,6 +86,8 @@ namespace tracy {
             int64_t tcpu, tgpu;
             TRACY_CL_ASSERT(m_contextId != 255);
 
+            for (auto& complete : m_complete) complete.store(nullptr, std::memory_order_relaxed);
+
             cl_int err = CL_SUCCESS;
             cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
             TRACY_CL_CHECK_ERROR(err)
@@ -153,21 +155,21 @@ namespace tracy {
             for (; m_tail != m_head; m_tail = (m_tail + 1) % QueryCount)
             {
                 EventInfo eventInfo = GetQuery(m_tail);
-                cl_int eventStatus;
-                cl_int err = clGetEventInfo(eventInfo.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &eventStatus, nullptr);
-                if (err != CL_SUCCESS)
+                if (eventInfo.event == nullptr)
                 {
-                    std::ostringstream oss;
-                    oss << "clGetEventInfo falied with error code " << err << ", on event " << eventInfo.event << ", skipping...";
-                    auto msg = oss.str();
-                    TracyMessage(msg.data(), msg.size());
-                    if (eventInfo.event == nullptr) {
-                        TracyMessageL("A TracyCLZone must be paird with a TracyCLZoneSetEvent, check your code!");
-                    }
-                    assert(false && "clGetEventInfo failed, maybe a TracyCLZone is not paired with TracyCLZoneSetEvent");
+                    TracyMessageL("A TracyCLZone must be paird with a TracyCLZoneSetEvent, check your code!");
+                    assert(false && "TracyCLZone is not paired with TracyCLZoneSetEvent");
                     continue;
                 }
-                if (eventStatus != CL_COMPLETE) return;
+
+                // The completed event is stored on its begin query by the callback set up in SetEvent(), so nothing
+                // has to be asked of the driver for the events which are still running. The end query is always
+                // collected after the begin query of the same event.
+                if (eventInfo.phase == EventPhase::Begin)
+                {
+                    if (m_complete[m_tail].load(std::memory_order_acquire) != eventInfo.event) return;
+                    m_complete[m_tail].store(nullptr, std::memory_order_relaxed);
+                }
 
                 cl_int eventInfoQuery = (eventInfo.phase == EventPhase::Begin)
                     ? CL_PROFILING_COMMAND_START
@@ -220,11 +222,23 @@ namespace tracy {
             return m_query[id];
         }
 
+        tracy_force_inline void WatchEvent(unsigned int beginQueryId, cl_event event)
+        {
+            GetQuery(beginQueryId).event = event;
+            TRACY_CL_CHECK_ERROR(clSetEventCallback(event, CL_COMPLETE, OnEventComplete, &m_complete[beginQueryId]));
+        }
+
     private:
+        // Also called when the command was terminated with an error, which Collect() then reports.
+        static void CL_CALLBACK OnEventComplete(cl_event event, cl_int, void* complete)
+        {
+            static_cast<std::atomic<cl_event>*>(complete)->store(event, std::memory_order_release);
+        }
 
         unsigned int m_contextId;
 
         EventInfo m_query[QueryCount];
+        std::atomic<cl_event> m_complete[QueryCount];
         unsigned int m_head; // index at which a new event should be inserted
         unsigned int m_tail; // oldest event
 
@@ -333,7 +347,7 @@ namespace tracy {
             if (!m_active) return;
             m_event = event;
             TRACY_CL_CHECK_ERROR(clRetainEvent(m_event));
-            m_ctx->GetQuery(m_beginQueryId).event = m_event;
+            m_ctx->WatchEvent(m_beginQueryId, m_event);
         }
 
         tracy_force_inline ~OpenCLCtxScope()
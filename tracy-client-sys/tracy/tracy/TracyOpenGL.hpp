@@ -153,12 +153,29 @@ public:
         }
 #endif
 
-        while( m_tail != m_head )
+        // Results of queries of the same target become available in the order the queries were issued, so the
+        // newest available query is searched for with a few availability checks, instead of one for every query.
+        const auto pending = ( m_head + QueryCount - m_tail ) % QueryCount;
+        unsigned int ready;
+        if( IsAvailable( pending - 1 ) )
         {
-            GLint available;
-            glGetQueryObjectiv( m_query[m_tail], GL_QUERY_RESULT_AVAILABLE, &available );
-            if( !available ) return;
+            ready = pending;
+        }
+        else
+        {
+            unsigned int lo = 0;
+            unsigned int hi = pending - 1;
+            while( lo < hi )
+            {
+                const auto mid = lo + ( hi - lo ) / 2;
+                if( IsAvailable( mid ) ) lo = mid + 1;
+                else hi = mid;
+            }
+            ready = lo;
+        }
 
+        for( unsigned int i=0; i<ready; i++ )
+        {
             uint64_t time;
             glGetQueryObjectui64v( m_query[m_tail], GL_QUERY_RESULT, &time );
 
@@ -173,6 +190,13 @@ public:
     }
 
 private:
+    tracy_force_inline bool IsAvailable( unsigned int offset )
+    {
+        GLint available;
+        glGetQueryObjectiv( m_query[( m_tail + offset ) % QueryCount], GL_QUERY_RESULT_AVAILABLE, &available );
+        return available != 0;
+    }
+
     tracy_force_inline unsigned int NextQueryId()
     {
         const auto id = m_head;
@@ -44,6 +44,7 @@ using TracyVkCtx = void*;
 #include "../client/TracyCallstack.hpp"
 
 #include <atomic>
+#include <limits>
 
 namespace tracy
 {
@@ -104,7 +105,6 @@ public:
         , m_context( GetGpuCtxCounter().fetch_add( 1, std::memory_order_relaxed ) )
         , m_head( 0 )
         , m_tail( 0 )
-        , m_oldCnt( 0 )
         , m_queryCount( QueryCount )
 #if !defined TRACY_VK_USE_SYMBOL_TABLE
         , m_vkGetCalibratedTimestampsEXT( vkGetCalibratedTimestampsEXT )
@@ -164,13 +164,14 @@ public:
         else
         {
             FindCalibratedTimestampDeviation();
-            Calibrate( device, m_prevCalibration, tgpu );
+            while( !Calibrate( device, m_prevCalibration, tgpu ) ) {}
             tcpu = Profiler::GetTime();
         }
 
         WriteInitialItem( physdev, tcpu, tgpu );
 
-        m_res = (int64_t*)tracy_malloc( sizeof( int64_t ) * m_queryCount );
+        // Results are read back along with their availability.
+        m_res = (int64_t*)tracy_malloc( sizeof( int64_t ) * m_queryCount * 2 );
     }
 
 #if defined VK_EXT_host_query_reset
@@ -189,7 +190,6 @@ public:
         , m_context( GetGpuCtxCounter().fetch_add(1, std::memory_order_relaxed) )
         , m_head( 0 )
         , m_tail( 0 )
-        , m_oldCnt( 0 )
         , m_queryCount( QueryCount )
 #if !defined TRACY_VK_USE_SYMBOL_TABLE
         , m_vkGetCalibratedTimestampsEXT( vkGetCalibratedTimestampsEXT )
@@ -211,7 +211,7 @@ public:
         // We require a host time domain to be available to properly calibrate.
         FindCalibratedTimestampDeviation();
         int64_t tgpu;
-        Calibrate( device, m_prevCalibration, tgpu );
+        while( !Calibrate( device, m_prevCalibration, tgpu ) ) {}
         int64_t tcpu = Profiler::GetTime();
 
         CreateQueryPool();
@@ -261,7 +261,6 @@ public:
                 VK_FUNCTION_WRAPPER( vkCmdResetQueryPool( cmdbuf, m_query, 0, m_queryCount ) ) :
                 VK_FUNCTION_WRAPPER( vkResetQueryPool( m_device, m_query, 0, m_queryCount ) );
             m_tail = head;
-            m_oldCnt = 0;
             int64_t tgpu;
             if( m_timeDomain != VK_TIME_DOMAIN_DEVICE_EXT ) Calibrate( m_device, m_prevCalibration, tgpu );
             return;
@@ -269,50 +268,47 @@ public:
 #endif
         assert( head > m_tail );
 
-        const unsigned int wrappedTail = (unsigned int)( m_tail % m_queryCount );
-
-        unsigned int cnt;
-        if( m_oldCnt != 0 )
+        // The pending queries are read back in one call for each contiguous range of the pool, so
+        // in at most two calls when they wrap around its end. Readback stops at the first query
+        // which isn't available yet, where the next call picks up. The results of a range are
+        // queued with a single lock of the serial queue.
+        while( m_tail != head )
         {
-            cnt = m_oldCnt;
-            m_oldCnt = 0;
-        }
-        else
-        {
-            cnt = (unsigned int)( head - m_tail );
+            const unsigned int wrappedTail = (unsigned int)( m_tail % m_queryCount );
+            unsigned int cnt = (unsigned int)( head - m_tail );
             assert( cnt <= m_queryCount );
-            if( wrappedTail + cnt > m_queryCount )
-            {
-                cnt = m_queryCount - wrappedTail;
-            }
-        }
+            if( wrappedTail + cnt > m_queryCount ) cnt = m_queryCount - wrappedTail;
 
+            VK_FUNCTION_WRAPPER( vkGetQueryPoolResults( m_device, m_query, wrappedTail, cnt, sizeof( int64_t ) * m_queryCount * 2, m_res, sizeof( int64_t ) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT ) );
 
-        VK_FUNCTION_WRAPPER( vkGetQueryPoolResults( m_device, m_query, wrappedTail, cnt, sizeof( int64_t ) * m_queryCount * 2, m_res, sizeof( int64_t ) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT ) );
+            unsigned int ready = 0;
+            while( ready < cnt && m_res[ready * 2 + 1] != 0 ) ready++;
+            if( ready == 0 ) break;
 
-        for( unsigned int idx=0; idx<cnt; idx++ )
-        {
-            int64_t avail = m_res[idx * 2 + 1];
-            if( avail == 0 )
+            Profiler::QueueSerialLock();
+            for( unsigned int idx=0; idx<ready; idx++ )
             {
-                m_oldCnt = cnt - idx;
-                cnt = idx;
-
-                break;
+                auto item = Profiler::QueueSerialNext();
+                MemWrite( &item->hdr.type, QueueType::GpuTime );
+                MemWrite( &item->gpuTime.gpuTime, m_res[idx * 2] );
+                MemWrite( &item->gpuTime.queryId, uint16_t( wrappedTail + idx ) );
+                MemWrite( &item->gpuTime.context, m_context );
+                Profiler::QueueSerialCommitNext();
             }
+            Profiler::QueueSerialUnlock();
 
-            auto item = Profiler::QueueSerial();
-            MemWrite( &item->hdr.type, QueueType::GpuTime );
-            MemWrite( &item->gpuTime.gpuTime, m_res[idx * 2] );
-            MemWrite( &item->gpuTime.queryId, uint16_t( wrappedTail + idx ) );
-            MemWrite( &item->gpuTime.context, m_context );
-            Profiler::QueueSerialFinish();
+            cmdbuf ?
+                VK_FUNCTION_WRAPPER( vkCmdResetQueryPool( cmdbuf, m_query, wrappedTail, ready ) ) :
+                VK_FUNCTION_WRAPPER( vkResetQueryPool( m_device, m_query, wrappedTail, ready ) );
+
+            m_tail += ready;
+            if( ready != cnt ) break;
         }
 
         if( m_timeDomain != VK_TIME_DOMAIN_DEVICE_EXT )
         {
             int64_t tgpu, tcpu;
-            Calibrate( m_device, tcpu, tgpu );
+            if( !Calibrate( m_device, tcpu, tgpu ) ) return;
             const auto refCpu = Profiler::GetTime();
             const auto delta = tcpu - m_prevCalibration;
             if( delta > 0 )
@@ -327,12 +323,6 @@ public:
                 Profiler::QueueSerialFinish();
             }
         }
-
-        cmdbuf ?
-            VK_FUNCTION_WRAPPER( vkCmdResetQueryPool( cmdbuf, m_query, wrappedTail, cnt ) ) :
-            VK_FUNCTION_WRAPPER( vkResetQueryPool( m_device, m_query, wrappedTail, cnt ) );
-
-        m_tail += cnt;
     }
 
     tracy_force_inline unsigned int NextQueryId()
@@ -352,20 +342,40 @@ public:
     }
 
 private:
-    tracy_force_inline void Calibrate( VkDevice device, int64_t& tCpu, int64_t& tGpu )
+    // Keeps the pair of timestamps with the lowest deviation out of a few reads. Fails if even that
+    // one is above the threshold, which is then raised a little, so that a device which has gotten
+    // noisier is still followed instead of being retried for as long as it takes. Readings below
+    // the threshold pull it back down towards the margin it was set up with, so that it doesn't
+    // stay loose after the noise has gone.
+    tracy_force_inline bool Calibrate( VkDevice device, int64_t& tCpu, int64_t& tGpu )
     {
         assert( m_timeDomain != VK_TIME_DOMAIN_DEVICE_EXT );
+        constexpr int MaxTries = 8;
         VkCalibratedTimestampInfoEXT spec[2] = {
             { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, VK_TIME_DOMAIN_DEVICE_EXT },
             { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, m_timeDomain },
         };
         uint64_t ts[2];
-        uint64_t deviation;
-        do
+        uint64_t deviation = std::numeric_limits<uint64_t>::max();
+        for( int i=0; i<MaxTries && deviation > m_deviation; i++ )
         {
-            m_vkGetCalibratedTimestampsEXT( device, 2, spec, ts, &deviation );
+            uint64_t sample[2];
+            uint64_t sampleDeviation;
+            if( m_vkGetCalibratedTimestampsEXT( device, 2, spec, sample, &sampleDeviation ) != VK_SUCCESS ) continue;
+            if( sampleDeviation < deviation )
+            {
+                ts[0] = sample[0];
+                ts[1] = sample[1];
+                deviation = sampleDeviation;
+            }
+        }
+        if( deviation > m_deviation )
+        {
+            m_deviation += m_deviation / 8 + 1;
+            return false;
         }
-        while( deviation > m_deviation );
+        const uint64_t target = deviation * 3 / 2;
+        if( target < m_deviation ) m_deviation -= ( m_deviation - target + 7 ) / 8;
 
 #if defined _WIN32
         tGpu = ts[0];
@@ -376,6 +386,7 @@ private:
 #else
         assert( false );
 #endif
+        return true;
     }
 
     tracy_force_inline void CreateQueryPool()
@@ -479,6 +490,10 @@ private:
         LoadVkDeviceExtensionSymbols( VK_LOAD_DEVICE_SYMBOL )
         LoadVkInstanceExtensionSymbols( VK_LOAD_INSTANCE_SYMBOL )
         LoadVkInstanceCoreSymbols( VK_LOAD_INSTANCE_SYMBOL )
+
+        // Drivers may only expose VK_KHR_calibrated_timestamps, whose functions are the same.
+        if( !m_symbols.vkGetCalibratedTimestampsEXT ) m_symbols.vkGetCalibratedTimestampsEXT = (PFN_vkGetCalibratedTimestampsEXT)deviceProcAddr( m_device, "vkGetCalibratedTimestampsKHR" );
+        if( !m_symbols.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT ) m_symbols.vkGetPhysicalDeviceCalibrateableTimeDomainsEXT = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)instanceProcAddr( instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsKHR" );
 #undef VK_GET_DEVICE_SYMBOL
 #undef VK_LOAD_DEVICE_SYMBOL
 #undef VK_GET_INSTANCE_SYMBOL
@@ -501,7 +516,6 @@ private:
 
     std::atomic<uint64_t> m_head;
     uint64_t m_tail;
-    unsigned int m_oldCnt;
     unsigned int m_queryCount;
 
     int64_t* m_res;
@@ -0,0 +1,202 @@
+//! Overhead of the instrumentation on the threads being profiled.
+//!
+//! By default the benchmarks run with no profiler connected, in which case the client keeps all
+//! the data around until one connects. Set `TRACY_FLIGHT_RECORDER=1` to bound the memory that
+//! takes up over a long run. With `TRACY_BENCH_CONNECTED=1`, a sink connects to the client first,
+//! on the port from `TRACY_PORT` (8086 by default), and discards everything it is sent, so that the
+//! profiler thread is busy compressing and sending the data while the benchmarks run.
+//!
+//! The names of the benchmarks start with `connected/` or `disconnected/`, so results of both
+//! modes can be kept side by side. Compare commits with
+//! `cargo bench --bench overhead -- --save-baseline <name>` on one and
+//! `cargo bench --bench overhead -- --baseline <name>` on the other.
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::io::Read;
+use std::sync::{Barrier, OnceLock};
+use std::time::{Duration, Instant};
+use tracy_client::{frame_name, plot_name, span, sys, Client, ProfiledAllocator};
+
+const CALLSTACK_DEPTHS: [u16; 4] = [0, 8, 32, 62];
+const LENGTHS: [usize; 4] = [8, 64, 512, 4096];
+const THREADS: [usize; 7] = [1, 2, 4, 8, 16, 32, 64];
+
+static ALLOCATOR: ProfiledAllocator<System> = ProfiledAllocator::new(System, 0);
+static ALLOCATOR_CALLSTACK: ProfiledAllocator<System> = ProfiledAllocator::new(System, 16);
+
+/// Starts the client, and connects the sink to it if asked to. Returns the mode, which prefixes
+/// the name of every group.
+fn setup() -> &'static str {
+    static MODE: OnceLock<&'static str> = OnceLock::new();
+    MODE.get_or_init(|| {
+        let _client = Client::start();
+        if std::env::var_os("TRACY_BENCH_CONNECTED").map_or(true, |v| v != "1") {
+            return "disconnected";
+        }
+        let mut stream = sys::protocol::connect();
+        std::thread::spawn(move || {
+            let mut buf = vec![0u8; 1 << 20];
+            while matches!(stream.read(&mut buf), Ok(n) if n > 0) {}
+        });
+        "connected"
+    })
+}
+
+fn zones(c: &mut Criterion) {
+    let mode = setup();
+    let mut group = c.benchmark_group(format!("{mode}/zone"));
+    for depth in CALLSTACK_DEPTHS {
+        group.bench_with_input(BenchmarkId::from_parameter(depth), &depth, |b, &depth| {
+            b.iter(|| span!("zone", depth));
+        });
+    }
+    group.finish();
+}
+
+fn zones_alloc(c: &mut Criterion) {
+    let mode = setup();
+    let client = Client::start();
+    let mut group = c.benchmark_group(format!("{mode}/span_alloc"));
+    for len in LENGTHS {
+        let name = "n".repeat(len);
+        group.bench_with_input(BenchmarkId::from_parameter(len), &name, |b, name| {
+            b.iter(|| {
+                client
+                    .clone()
+                    .span_alloc(Some(name), "function", "file", 42, 0)
+            });
+        });
+    }
+    group.finish();
+}
+
+fn plots(c: &mut Criterion) {
+    let mode = setup();
+    let client = Client::start();
+    let mut value = 0.0;
+    c.bench_function(&format!("{mode}/plot"), |b| {
+        b.iter(|| {
+            value += 1.0;
+            client.plot(plot_name!("bench"), value);
+        });
+    });
+}
+
+fn messages(c: &mut Criterion) {
+    let mode = setup();
+    let client = Client::start();
+    let mut group = c.benchmark_group(format!("{mode}/message"));
+    for len in LENGTHS {
+        let message = "m".repeat(len);
+        group.throughput(Throughput::Bytes(len as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(len), &message, |b, message| {
+            b.iter(|| client.message(message, 0));
+        });
+    }
+    group.finish();
+}
+
+fn frame_marks(c: &mut Criterion) {
+    let mode = setup();
+    let client = Client::start();
+    c.bench_function(&format!("{mode}/frame_mark"), |b| {
+        b.iter(|| client.frame_mark());
+    });
+    c.bench_function(&format!("{mode}/secondary_frame_mark"), |b| {
+        b.iter(|| client.secondary_frame_mark(frame_name!("bench")));
+    });
+}
+
+/// Allocates and frees a block, which records two memory events.
+fn alloc_free(allocator: &ProfiledAllocator<System>, layout: Layout) {
+    unsafe {
+        let ptr = allocator.alloc(layout);
+        allocator.dealloc(black_box(ptr), layout);
+    }
+}
+
+fn allocator(c: &mut Criterion) {
+    let mode = setup();
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    let mut group = c.benchmark_group(format!("{mode}/allocator"));
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("system", |b| {
+        b.iter(|| unsafe {
+            let ptr = System.alloc(layout);
+            System.dealloc(black_box(ptr), layout);
+        });
+    });
+    group.bench_function("profiled/0", |b| b.iter(|| alloc_free(&ALLOCATOR, layout)));
+    group.bench_function("profiled/16", |b| {
+        b.iter(|| alloc_free(&ALLOCATOR_CALLSTACK, layout))
+    });
+    group.finish();
+}
+
+/// Runs `op` `iters` times on each of `threads` threads at once and returns the wall time. Every
+/// thread does `op` once before the measurement, so that setting up the thread for the profiler
+/// isn't measured.
+fn contended(threads: usize, iters: u64, op: impl Fn() + Sync) -> Duration {
+    let barrier = Barrier::new(threads + 1);
+    std::thread::scope(|s| {
+        let handles: Vec<_> = (0..threads)
+            .map(|_| {
+                s.spawn(|| {
+                    op();
+                    barrier.wait();
+                    for _ in 0..iters {
+                        op();
+                    }
+                })
+            })
+            .collect();
+        barrier.wait();
+        let start = Instant::now();
+        for handle in handles {
+            handle.join().unwrap();
+        }
+        start.elapsed()
+    })
+}
+
+fn contention(c: &mut Criterion) {
+    let mode = setup();
+    let layout = Layout::from_size_align(64, 8).unwrap();
+    let mut group = c.benchmark_group(format!("{mode}/contention"));
+    group.sample_size(20);
+    for threads in THREADS {
+        // One element is one operation on every thread.
+        group.throughput(Throughput::Elements(threads as u64));
+        group.bench_with_input(
+            BenchmarkId::new("zone", threads),
+            &threads,
+            |b, &threads| {
+                b.iter_custom(|iters| {
+                    contended(threads, iters, || {
+                        let _ = span!("contended zone");
+                    })
+                });
+            },
+        );
+        group.bench_with_input(
+            BenchmarkId::new("allocator", threads),
+            &threads,
+            |b, &threads| {
+                b.iter_custom(|iters| contended(threads, iters, || alloc_free(&ALLOCATOR, layout)));
+            },
+        );
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    zones,
+    zones_alloc,
+    plots,
+    messages,
+    frame_marks,
+    allocator,
+    contention
+);
+criterion_main!(benches);
@@ -0,0 +1,84 @@
+use crate::Client;
+
+/// A name of a fiber.
+///
+/// Tracy identifies fibers by the address of their name, so a fiber has to keep its name for
+/// the whole run.
+///
+/// Create with the [`fiber_name!`](crate::fiber_name) macro or with [`FiberName::new_leak`].
+#[derive(Copy, Clone, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct FiberName(pub(crate) &'static str);
+
+impl FiberName {
+    /// Construct a `FiberName` dynamically, leaking the provided String.
+    ///
+    /// You should call this function once for a given name, and store the returned `FiberName`
+    /// for continued use, to avoid rapid memory use growth. Whenever possible, prefer the
+    /// [`fiber_name!`](crate::fiber_name) macro, which takes a literal name and doesn't leak
+    /// memory.
+    #[must_use]
+    pub fn new_leak(name: String) -> Self {
+        #[cfg(feature = "enable")]
+        {
+            // Ensure the name is null-terminated.
+            let mut name = name;
+            name.push('\0');
+            // Drop excess capacity by converting into a boxed str, then leak.
+            let name = Box::leak(name.into_boxed_str());
+            Self(name)
+        }
+        #[cfg(not(feature = "enable"))]
+        {
+            drop(name);
+            Self("\0")
+        }
+    }
+}
+
+/// Instrumentation for fibers, coroutines and other units of execution which move between
+/// threads.
+impl Client {
+    /// Switch the current thread to the fiber `name`.
+    ///
+    /// Zones started on the thread from now on belong to the fiber and show up on its own
+    /// timeline. A zone has to end in the same fiber it was started in, but it may end on a
+    /// different thread. The same fiber must not be entered by two threads at once.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use tracy_client::{fiber_name, span};
+    /// # let client = tracy_client::Client::start();
+    /// client.fiber_enter(fiber_name!("job"));
+    /// {
+    ///     let _span = span!("step");
+    /// }
+    /// client.fiber_leave();
+    /// ```
+    pub fn fiber_enter(&self, name: FiberName) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: The name is null-terminated and lives for the rest of the program.
+            let () = sys::___tracy_fiber_enter(name.0.as_ptr().cast());
+        }
+    }
+
+    /// Switch the current thread back from the fiber it entered with [`Client::fiber_enter`].
+    pub fn fiber_leave(&self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_fiber_leave();
+        }
+    }
+}
+
+/// Construct a [`FiberName`].
+///
+/// The resulting value may be used as an argument for the [`Client::fiber_enter`] method. The
+/// macro can be used in a `const` context.
+#[macro_export]
+macro_rules! fiber_name {
+    ($name: literal) => {{
+        unsafe { $crate::internal::create_fiber_name(concat!($name, "\0")) }
+    }};
+}
@@ -138,6 +138,41 @@ impl Client {
             let () = sys::___tracy_emit_frame_image(ptr.cast(), width, height, offset, flip as i32);
         }
     }
+
+    /// Emits an image of a frame which is already compressed to DXT1 (BC1).
+    ///
+    /// This is like [`frame_image`](Client::frame_image), but the image is made of 8 byte blocks
+    /// of 4x4 pixels, in rows of blocks from the top, as produced by a GPU compression pass. It is
+    /// sent as it is, skipping the compression done by the profiler.
+    ///
+    /// # Panics
+    ///
+    /// - If the width or height is not divisible by four.
+    /// - If `image` is shorter than `width * height / 2` bytes.
+    pub fn frame_image_compressed(
+        &self,
+        image: &[u8],
+        width: u16,
+        height: u16,
+        offset: u8,
+        flip: bool,
+    ) {
+        assert!(width % 4 == 0 && height % 4 == 0);
+        assert!(image.len() >= usize::from(width) * usize::from(height) / 2);
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: Tracy copies the data before returning, and we checked its length.
+            let ptr = image.as_ptr();
+
+            let () = sys::___tracy_emit_frame_image_compressed(
+                ptr.cast(),
+                width,
+                height,
+                offset,
+                flip as i32,
+            );
+        }
+    }
 }
 
 /// Construct a [`FrameName`].
@@ -181,6 +216,13 @@ pub fn frame_image(image: &[u8], width: u16, height: u16, offset: u8, flip: bool
         .frame_image(image, width, height, offset, flip);
 }
 
+/// Convenience shortcut for [`Client::frame_image_compressed`] on the current client.
+pub fn frame_image_compressed(image: &[u8], width: u16, height: u16, offset: u8, flip: bool) {
+    Client::running()
+        .expect("frame_image_compressed without a running Client")
+        .frame_image_compressed(image, width, height, offset, flip);
+}
+
 /// Convenience macro for [`Client::secondary_frame_mark`] on the current client.
 ///
 /// # Panics
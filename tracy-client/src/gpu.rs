@@ -1,5 +1,6 @@
 use std::{
     convert::TryInto,
+    sync::atomic::{AtomicU32, AtomicU64, Ordering},
     sync::{Arc, Mutex},
 };
 
@@ -69,6 +70,11 @@ pub enum GpuContextType {
 /// span.upload_timestamp_start(starting_timestamp);
 /// span.upload_timestamp_end(ending_timestamp);
 /// ```
+///
+/// A program submitting work to several queues of a device, such as graphics, async compute and
+/// transfer queues, should create a context for each of them, so that each queue gets a timeline
+/// of its own. The contexts may share a [`GpuQueryPool`], see
+/// [`Client::new_gpu_context_with_query_pool`].
 #[derive(Clone)]
 pub struct GpuContext {
     #[cfg(feature = "enable")]
@@ -76,12 +82,129 @@ pub struct GpuContext {
     #[cfg(feature = "enable")]
     value: u8,
     #[cfg(feature = "enable")]
-    span_freelist: Arc<Mutex<Vec<u16>>>,
+    query_pool: GpuQueryPool,
     _private: (),
 }
 #[cfg(feature = "enable")]
 static GPU_CONTEXT_INDEX: Mutex<u8> = Mutex::new(0);
 
+/// The query ids of gpu spans, which may be shared by the contexts of the queues of a device.
+///
+/// Every span takes two ids, one for each of its timestamps, which are handed out and taken back
+/// without locking, so that spans may be recorded from many threads at once. Ids are unique among
+/// all the contexts sharing a pool, which lets a program keep a single timestamp query pool on the
+/// device with a query for each of the 65536 ids, rather than one per queue. The ids of a
+/// [`GpuSpan`] can be mapped to the queries of such a pool with [`GpuSpan::query_ids`].
+///
+/// The ids of manually tracked spans, see [`GpuContext::begin_span`], may be taken from the same
+/// pool with [`GpuQueryPool::allocate`].
+#[derive(Clone)]
+pub struct GpuQueryPool {
+    #[cfg(feature = "enable")]
+    freelist: Arc<QueryFreelist>,
+    _private: (),
+}
+
+/// A lock-free stack of the free query ids.
+#[cfg(feature = "enable")]
+struct QueryFreelist {
+    /// One more than the first free id in the low 32 bits, zero if there is none. The high 32
+    /// bits count the changes, so that a compare-exchange fails if the first id was taken and put
+    /// back in between.
+    head: AtomicU64,
+    /// One more than the free id following each free id, zero for the last one.
+    next: Box<[AtomicU32]>,
+}
+
+#[cfg(feature = "enable")]
+impl QueryFreelist {
+    const IDS: u32 = 1 << 16;
+    const INDEX: u64 = 0xFFFF_FFFF;
+    const TAG: u64 = 1 << 32;
+
+    fn new() -> Self {
+        Self {
+            head: AtomicU64::new(1),
+            next: (1..=Self::IDS)
+                .map(|i| AtomicU32::new(if i == Self::IDS { 0 } else { i + 1 }))
+                .collect(),
+        }
+    }
+
+    fn pop(&self) -> Option<u16> {
+        let mut head = self.head.load(Ordering::Acquire);
+        loop {
+            let first = (head & Self::INDEX) as u32;
+            if first == 0 {
+                return None;
+            }
+            let next = self.next[first as usize - 1].load(Ordering::Relaxed);
+            let new = (head & !Self::INDEX).wrapping_add(Self::TAG) | u64::from(next);
+            match self
+                .head
+                .compare_exchange_weak(head, new, Ordering::Acquire, Ordering::Acquire)
+            {
+                Ok(_) => return Some((first - 1) as u16),
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    fn push(&self, id: u16) {
+        let mut head = self.head.load(Ordering::Relaxed);
+        loop {
+            self.next[usize::from(id)].store((head & Self::INDEX) as u32, Ordering::Relaxed);
+            let new = (head & !Self::INDEX).wrapping_add(Self::TAG) | (u64::from(id) + 1);
+            match self
+                .head
+                .compare_exchange_weak(head, new, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+}
+
+impl GpuQueryPool {
+    /// Creates a pool with all of the 65536 query ids free.
+    #[must_use]
+    pub fn new() -> Self {
+        Self {
+            #[cfg(feature = "enable")]
+            freelist: Arc::new(QueryFreelist::new()),
+            _private: (),
+        }
+    }
+
+    /// Takes a free query id, if there is one left.
+    ///
+    /// The id has to be given back with [`GpuQueryPool::release`] once its timestamp has been
+    /// uploaded.
+    #[must_use]
+    pub fn allocate(&self) -> Option<u16> {
+        #[cfg(feature = "enable")]
+        return self.freelist.pop();
+        #[cfg(not(feature = "enable"))]
+        Some(0)
+    }
+
+    /// Gives back a query id taken with [`GpuQueryPool::allocate`].
+    ///
+    /// Releasing an id which isn't taken at the moment mixes up the timestamps of the spans using
+    /// it.
+    pub fn release(&self, query_id: u16) {
+        #[cfg(feature = "enable")]
+        self.freelist.push(query_id);
+    }
+}
+
+impl Default for GpuQueryPool {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
 /// Errors that can occur when creating a gpu context.
 #[derive(Debug)]
 pub enum GpuContextCreationError {
@@ -168,6 +291,26 @@ impl Client {
         ty: GpuContextType,
         gpu_timestamp: i64,
         period: f32,
+    ) -> Result<GpuContext, GpuContextCreationError> {
+        self.new_gpu_context_with_query_pool(name, ty, gpu_timestamp, period, &GpuQueryPool::new())
+    }
+
+    /// Creates a new GPU context, which takes the query ids of its spans from `query_pool`.
+    ///
+    /// Create the contexts of all the queues of a device with the same pool to keep the ids of
+    /// their spans apart, see [`GpuQueryPool`]. The other arguments are the same as for
+    /// [`Client::new_gpu_context`].
+    ///
+    /// # Errors
+    ///
+    /// - If more than 255 contexts were made during the lifetime of the application.
+    pub fn new_gpu_context_with_query_pool(
+        self,
+        name: Option<&str>,
+        ty: GpuContextType,
+        gpu_timestamp: i64,
+        period: f32,
+        query_pool: &GpuQueryPool,
     ) -> Result<GpuContext, GpuContextCreationError> {
         #[cfg(feature = "enable")]
         {
@@ -212,7 +355,7 @@ impl Client {
             Ok(GpuContext {
                 _client: self,
                 value: context,
-                span_freelist: Arc::new(Mutex::new((0..=u16::MAX).collect())),
+                query_pool: query_pool.clone(),
                 _private: (),
             })
         }
@@ -224,16 +367,29 @@ impl Client {
 impl GpuContext {
     #[cfg(feature = "enable")]
     fn alloc_span_ids(&self) -> Result<(u16, u16), GpuSpanCreationError> {
-        let mut freelist = self.span_freelist.lock().unwrap();
-        if freelist.len() < 2 {
+        let freelist = &self.query_pool.freelist;
+        let start = freelist
+            .pop()
+            .ok_or(GpuSpanCreationError::TooManyPendingSpans)?;
+        let Some(end) = freelist.pop() else {
+            freelist.push(start);
             return Err(GpuSpanCreationError::TooManyPendingSpans);
-        }
-        // These unwraps are unreachable.
-        let start = freelist.pop().unwrap();
-        let end = freelist.pop().unwrap();
+        };
         Ok((start, end))
     }
 
+    /// The pool the query ids of the spans of this context are taken from.
+    #[must_use]
+    pub fn query_pool(&self) -> &GpuQueryPool {
+        #[cfg(feature = "enable")]
+        return &self.query_pool;
+        #[cfg(not(feature = "enable"))]
+        {
+            static POOL: GpuQueryPool = GpuQueryPool { _private: () };
+            &POOL
+        }
+    }
+
     /// Creates a new gpu span with the given source location.
     ///
     /// This should be called right next to where you record the corresponding gpu timestamp. This
@@ -444,6 +600,19 @@ impl GpuContext {
 }
 
 impl GpuSpan {
+    /// The query ids of the start and of the end timestamps of this span.
+    ///
+    /// These are unique among the pending spans of all the contexts sharing the query pool of the
+    /// context of this span, so they may be used as the indices of the timestamp queries on the
+    /// device.
+    #[must_use]
+    pub fn query_ids(&self) -> (u16, u16) {
+        #[cfg(feature = "enable")]
+        return (self.start_query_id, self.end_query_id);
+        #[cfg(not(feature = "enable"))]
+        (0, 1)
+    }
+
     /// Marks the end of the given gpu span. This should be called right next to where you record
     /// the corresponding gpu timestamp for the end of the span. This allows tracy to correctly
     /// associate the cpu time with the gpu timestamp.
@@ -517,10 +686,9 @@ impl Drop for GpuSpan {
             }
 
             // Put the ids back into the freelist.
-            let mut freelist = self.context.span_freelist.lock().unwrap();
+            let freelist = &self.context.query_pool.freelist;
             freelist.push(self.start_query_id);
             freelist.push(self.end_query_id);
-            drop(freelist);
         }
     }
 }
@@ -27,21 +27,32 @@
 //!
 #![doc = include_str!("../FEATURES.mkd")]
 
-pub use crate::frame::{frame_image, frame_mark, Frame, FrameName};
+#[cfg(feature = "fibers")]
+pub use crate::fiber::FiberName;
+pub use crate::frame::{frame_image, frame_image_compressed, frame_mark, Frame, FrameName};
 pub use crate::gpu::{
-    GpuContext, GpuContextCreationError, GpuContextType, GpuSpan, GpuSpanCreationError,
+    GpuContext, GpuContextCreationError, GpuContextType, GpuQueryPool, GpuSpan,
+    GpuSpanCreationError,
 };
-pub use crate::plot::{PlotConfiguration, PlotFormat, PlotLineStyle, PlotName};
-pub use crate::span::{Span, SpanLocation};
+pub use crate::lock::{LockCtx, Mutex, MutexGuard, RwLock, RwLockReadGuard, RwLockWriteGuard};
+pub use crate::plot::{PlotAggregate, PlotConfiguration, PlotFormat, PlotLineStyle, PlotName};
+pub use crate::span::{Span, SpanBatch, SpanLocation};
+pub use crate::stats::ClientStats;
+pub use crate::thread_policy::ThreadSched;
 use std::alloc;
 use std::ffi::CString;
 pub use sys;
 
+#[cfg(feature = "fibers")]
+mod fiber;
 mod frame;
 mod gpu;
+mod lock;
 mod plot;
 mod span;
 mod state;
+mod stats;
+mod thread_policy;
 
 #[cfg(feature = "demangle")]
 pub mod demangle;
@@ -78,8 +89,12 @@ pub mod internal {
                     file: file.cast(),
                     line,
                     color: 0,
+                    #[cfg(feature = "zone-categories")]
+                    category: 0,
                 },
                 _function_name: function_name,
+                _name: None,
+                _file: None,
             }
         }
         #[cfg(not(feature = "enable"))]
@@ -92,6 +107,13 @@ pub mod internal {
         crate::frame::FrameName(name)
     }
 
+    #[cfg(feature = "fibers")]
+    #[inline(always)]
+    #[must_use]
+    pub const unsafe fn create_fiber_name(name: &'static str) -> crate::fiber::FiberName {
+        crate::fiber::FiberName(name)
+    }
+
     #[inline(always)]
     #[must_use]
     pub const unsafe fn create_plot(name: &'static str) -> crate::plot::PlotName {
@@ -236,6 +258,14 @@ impl<T> ProfiledAllocator<T> {
     /// message. The number provided will limit the number of call frames collected. Note that
     /// enabling callstack collection introduces a non-trivial amount of overhead to each
     /// allocation and deallocation.
+    ///
+    /// Setting the `TRACY_MEMORY_SAMPLE_INTERVAL` environment variable to a number of bytes
+    /// limits that overhead by collecting callstacks only for a random sample of allocations,
+    /// about one every that many bytes allocated on each thread. All other allocations, and all
+    /// deallocations, are still recorded without a callstack.
+    ///
+    /// With the `memory-batching` feature, the events recorded without a callstack are buffered
+    /// on each thread without taking a lock, and are collected in bulk by the profiler.
     pub const fn new(inner_allocator: T, callstack_depth: u16) -> Self {
         Self(inner_allocator, adjust_stack_depth(callstack_depth))
     }
@@ -0,0 +1,676 @@
+use crate::{Client, SpanLocation};
+use std::mem::ManuallyDrop;
+use std::ops::{Deref, DerefMut};
+use std::sync::{LockResult, PoisonError, TryLockError, TryLockResult};
+
+#[cfg(all(feature = "enable", feature = "lock-contention-only"))]
+use crate::PlotName;
+#[cfg(all(feature = "enable", feature = "lock-contention-only"))]
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Instrumentation of a single lock.
+///
+/// A `LockCtx` announces a lock to Tracy and reports the individual steps of acquiring and
+/// releasing it. It is a building block for instrumenting lock implementations which are not
+/// covered by the [`Mutex`] and [`RwLock`] wrappers provided by this crate, such as those of
+/// the `parking_lot` crate.
+///
+/// Construct with [`Client::new_lock_ctx`] or [`Client::new_shared_lock_ctx`].
+pub struct LockCtx {
+    #[cfg(feature = "enable")]
+    _client: Client,
+    #[cfg(feature = "enable")]
+    ctx: *mut sys::__tracy_lockable_context_data,
+    #[cfg(all(feature = "enable", feature = "lock-contention-only"))]
+    contention: Contention,
+    #[cfg(not(feature = "enable"))]
+    _private: (),
+}
+
+// SAFE: The lockable context API of Tracy may be used from any thread.
+unsafe impl Send for LockCtx {}
+unsafe impl Sync for LockCtx {}
+
+/// Counts of the acquisitions which didn't have to wait for the lock, reported as the
+/// `<lock> uncontended` plot.
+#[cfg(all(feature = "enable", feature = "lock-contention-only"))]
+struct Contention {
+    location: &'static SpanLocation,
+    plot: once_cell::sync::OnceCell<PlotName>,
+    uncontended: AtomicU64,
+    reported: AtomicU64,
+}
+
+/// Instrumentation for locks.
+impl Client {
+    /// Announce a new exclusive lock to Tracy.
+    ///
+    /// The lock is shown in the profiler with the name given to the `span_location!` macro, or
+    /// with the name of the function containing it if no name was given.
+    ///
+    /// # Example
+    ///
+    /// ```rust
+    /// # let client = tracy_client::Client::start();
+    /// let ctx = client.new_lock_ctx(tracy_client::span_location!("queue lock"));
+    /// let run_after = ctx.before_lock();
+    /// // Acquire the lock here.
+    /// if run_after {
+    ///     ctx.after_lock();
+    /// }
+    /// // Release the lock here.
+    /// ctx.after_unlock();
+    /// ```
+    #[must_use]
+    pub fn new_lock_ctx(self, loc: &'static SpanLocation) -> LockCtx {
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: `SpanLocation` is static, so it outlives the lock.
+            let ctx = sys::___tracy_announce_lockable_ctx(&loc.data);
+            LockCtx::new(self, ctx, loc)
+        }
+        #[cfg(not(feature = "enable"))]
+        LockCtx { _private: () }
+    }
+
+    /// Announce a new lock which may also be acquired in shared mode, such as a reader-writer
+    /// lock.
+    ///
+    /// See [`Client::new_lock_ctx`] for details.
+    #[must_use]
+    pub fn new_shared_lock_ctx(self, loc: &'static SpanLocation) -> LockCtx {
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: `SpanLocation` is static, so it outlives the lock.
+            let ctx = sys::___tracy_announce_shared_lockable_ctx(&loc.data);
+            LockCtx::new(self, ctx, loc)
+        }
+        #[cfg(not(feature = "enable"))]
+        LockCtx { _private: () }
+    }
+}
+
+impl LockCtx {
+    #[cfg(feature = "enable")]
+    fn new(
+        client: Client,
+        ctx: *mut sys::__tracy_lockable_context_data,
+        loc: &'static SpanLocation,
+    ) -> Self {
+        if !loc.data.name.is_null() {
+            // SAFE: The name of a `SpanLocation` is a null-terminated string.
+            let name = unsafe { std::ffi::CStr::from_ptr(loc.data.name) }.to_bytes();
+            unsafe {
+                sys::___tracy_custom_name_lockable_ctx(ctx, name.as_ptr().cast(), name.len())
+            };
+        }
+        Self {
+            _client: client,
+            ctx,
+            #[cfg(feature = "lock-contention-only")]
+            contention: Contention {
+                location: loc,
+                plot: once_cell::sync::OnceCell::new(),
+                uncontended: AtomicU64::new(0),
+                reported: AtomicU64::new(0),
+            },
+        }
+    }
+
+    /// Report that the lock is about to be acquired.
+    ///
+    /// Returns whether [`LockCtx::after_lock`] should be called once the lock is acquired.
+    #[inline]
+    #[must_use]
+    pub fn before_lock(&self) -> bool {
+        #[cfg(feature = "enable")]
+        unsafe {
+            sys::___tracy_before_lock_lockable_ctx(self.ctx) != 0
+        }
+        #[cfg(not(feature = "enable"))]
+        false
+    }
+
+    /// Report that the lock has been acquired.
+    #[inline]
+    pub fn after_lock(&self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_lock_lockable_ctx(self.ctx);
+        }
+    }
+
+    /// Report that the lock has been released.
+    #[inline]
+    pub fn after_unlock(&self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_unlock_lockable_ctx(self.ctx);
+        }
+    }
+
+    /// Report an attempt to acquire the lock without waiting.
+    #[inline]
+    pub fn after_try_lock(&self, acquired: bool) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_try_lock_lockable_ctx(self.ctx, acquired.into());
+        }
+    }
+
+    /// Report that the lock is about to be acquired in shared mode.
+    ///
+    /// Returns whether [`LockCtx::after_lock_shared`] should be called once the lock is acquired.
+    /// Must only be used with contexts created by [`Client::new_shared_lock_ctx`].
+    #[inline]
+    #[must_use]
+    pub fn before_lock_shared(&self) -> bool {
+        #[cfg(feature = "enable")]
+        unsafe {
+            sys::___tracy_before_lock_shared_lockable_ctx(self.ctx) != 0
+        }
+        #[cfg(not(feature = "enable"))]
+        false
+    }
+
+    /// Report that the lock has been acquired in shared mode.
+    #[inline]
+    pub fn after_lock_shared(&self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_lock_shared_lockable_ctx(self.ctx);
+        }
+    }
+
+    /// Report that a shared acquisition of the lock has been released.
+    #[inline]
+    pub fn after_unlock_shared(&self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_unlock_shared_lockable_ctx(self.ctx);
+        }
+    }
+
+    /// Report an attempt to acquire the lock in shared mode without waiting.
+    #[inline]
+    pub fn after_try_lock_shared(&self, acquired: bool) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_after_try_lock_shared_lockable_ctx(self.ctx, acquired.into());
+        }
+    }
+
+    /// Mark the location at which the current holder of the lock is.
+    #[inline]
+    pub fn mark(&self, loc: &'static SpanLocation) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            let () = sys::___tracy_mark_lockable_ctx(self.ctx, &loc.data);
+        }
+    }
+
+    /// Assign a name to the lock, replacing the one from its location.
+    pub fn set_name(&self, name: &str) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: The name is copied, so the pointer does not need to last.
+            let () =
+                sys::___tracy_custom_name_lockable_ctx(self.ctx, name.as_ptr().cast(), name.len());
+        }
+    }
+
+    /// Count an acquisition which didn't have to wait for the lock.
+    #[cfg(feature = "lock-contention-only")]
+    #[inline]
+    fn count_uncontended(&self) {
+        #[cfg(feature = "enable")]
+        self.contention.uncontended.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Report the acquisitions counted since the last report.
+    #[cfg(feature = "lock-contention-only")]
+    fn report_uncontended(&self) {
+        #[cfg(feature = "enable")]
+        {
+            let contention = &self.contention;
+            let uncontended = contention.uncontended.load(Ordering::Relaxed);
+            if contention.reported.swap(uncontended, Ordering::Relaxed) == uncontended {
+                return;
+            }
+            let plot = contention.plot.get_or_init(|| {
+                let data = &contention.location.data;
+                let name = if data.name.is_null() {
+                    data.function
+                } else {
+                    data.name
+                };
+                // SAFE: Both names of a `SpanLocation` are null-terminated strings.
+                let name = unsafe { std::ffi::CStr::from_ptr(name) }.to_string_lossy();
+                PlotName::new_leak(format!("{name} uncontended"))
+            });
+            #[allow(clippy::cast_precision_loss)]
+            self._client.plot(*plot, uncontended as f64);
+        }
+    }
+}
+
+impl Drop for LockCtx {
+    fn drop(&mut self) {
+        #[cfg(feature = "lock-contention-only")]
+        self.report_uncontended();
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: The context was announced on construction and is terminated only once.
+            let () = sys::___tracy_terminate_lockable_ctx(self.ctx);
+        }
+    }
+}
+
+/// A mutual exclusion primitive, instrumented for Tracy.
+///
+/// This is a wrapper over [`std::sync::Mutex`] with the same interface, which reports the lock
+/// to Tracy. The lock is not instrumented if it was created while no `Client` was running.
+///
+/// With the `lock-contention-only` feature, only the acquisitions which have to wait for the lock
+/// are recorded.
+///
+/// # Example
+///
+/// ```rust
+/// # let client = tracy_client::Client::start();
+/// let counter = tracy_client::Mutex::new(tracy_client::span_location!("counter"), 0);
+/// *counter.lock().unwrap() += 1;
+/// ```
+pub struct Mutex<T: ?Sized> {
+    ctx: Option<LockCtx>,
+    inner: std::sync::Mutex<T>,
+}
+
+/// A guard of a locked [`Mutex`], which releases the lock when dropped.
+pub struct MutexGuard<'a, T: ?Sized> {
+    ctx: Option<&'a LockCtx>,
+    inner: ManuallyDrop<std::sync::MutexGuard<'a, T>>,
+}
+
+/// A reader-writer lock, instrumented for Tracy.
+///
+/// This is a wrapper over [`std::sync::RwLock`] with the same interface, which reports the lock
+/// to Tracy. The lock is not instrumented if it was created while no `Client` was running.
+///
+/// With the `lock-contention-only` feature, only the acquisitions which have to wait for the lock
+/// are recorded.
+pub struct RwLock<T: ?Sized> {
+    ctx: Option<LockCtx>,
+    inner: std::sync::RwLock<T>,
+}
+
+/// A guard of a [`RwLock`] locked for reading, which releases the lock when dropped.
+pub struct RwLockReadGuard<'a, T: ?Sized> {
+    ctx: Option<&'a LockCtx>,
+    inner: ManuallyDrop<std::sync::RwLockReadGuard<'a, T>>,
+}
+
+/// A guard of a [`RwLock`] locked for writing, which releases the lock when dropped.
+pub struct RwLockWriteGuard<'a, T: ?Sized> {
+    ctx: Option<&'a LockCtx>,
+    inner: ManuallyDrop<std::sync::RwLockWriteGuard<'a, T>>,
+}
+
+/// Map the guard of a lock result, keeping the poison flag.
+fn map_result<G, H>(result: LockResult<G>, f: impl FnOnce(G) -> H) -> LockResult<H> {
+    match result {
+        Ok(guard) => Ok(f(guard)),
+        Err(e) => Err(PoisonError::new(f(e.into_inner()))),
+    }
+}
+
+fn map_try_result<G, H>(result: TryLockResult<G>, f: impl FnOnce(G) -> H) -> TryLockResult<H> {
+    match result {
+        Ok(guard) => Ok(f(guard)),
+        Err(TryLockError::Poisoned(e)) => {
+            Err(TryLockError::Poisoned(PoisonError::new(f(e.into_inner()))))
+        }
+        Err(TryLockError::WouldBlock) => Err(TryLockError::WouldBlock),
+    }
+}
+
+/// Acquire a lock through `try_lock` or `lock`, reporting it to `ctx`.
+///
+/// Returns the result and whether the release of the lock has to be reported. With the
+/// `lock-contention-only` feature an acquisition is attempted without waiting first, and only
+/// reported if that fails.
+#[inline]
+fn acquire<G>(
+    ctx: Option<&LockCtx>,
+    shared: bool,
+    try_lock: impl FnOnce() -> TryLockResult<G>,
+    lock: impl FnOnce() -> LockResult<G>,
+) -> (LockResult<G>, bool) {
+    let Some(ctx) = ctx else {
+        return (lock(), false);
+    };
+    #[cfg(feature = "lock-contention-only")]
+    match try_lock() {
+        Ok(guard) => {
+            ctx.count_uncontended();
+            return (Ok(guard), false);
+        }
+        Err(TryLockError::Poisoned(e)) => {
+            ctx.count_uncontended();
+            return (Err(e), false);
+        }
+        Err(TryLockError::WouldBlock) => {}
+    }
+    #[cfg(not(feature = "lock-contention-only"))]
+    let _ = try_lock;
+    let run_after = if shared {
+        ctx.before_lock_shared()
+    } else {
+        ctx.before_lock()
+    };
+    let result = lock();
+    if run_after {
+        if shared {
+            ctx.after_lock_shared();
+        } else {
+            ctx.after_lock();
+        }
+    }
+    #[cfg(feature = "lock-contention-only")]
+    ctx.report_uncontended();
+    (result, true)
+}
+
+/// Report an attempt to acquire a lock without waiting to `ctx`.
+///
+/// Returns whether the release of the lock has to be reported.
+#[inline]
+fn try_acquire<G>(ctx: Option<&LockCtx>, shared: bool, result: &TryLockResult<G>) -> bool {
+    let Some(ctx) = ctx else {
+        return false;
+    };
+    let acquired = !matches!(result, Err(TryLockError::WouldBlock));
+    #[cfg(feature = "lock-contention-only")]
+    {
+        let _ = shared;
+        if acquired {
+            ctx.count_uncontended();
+        }
+        false
+    }
+    #[cfg(not(feature = "lock-contention-only"))]
+    {
+        if shared {
+            ctx.after_try_lock_shared(acquired);
+        } else {
+            ctx.after_try_lock(acquired);
+        }
+        acquired
+    }
+}
+
+impl<T> Mutex<T> {
+    /// Create a new mutex in an unlocked state, announced to Tracy with the given location.
+    pub fn new(loc: &'static SpanLocation, value: T) -> Self {
+        Self {
+            ctx: Client::running().map(|client| client.new_lock_ctx(loc)),
+            inner: std::sync::Mutex::new(value),
+        }
+    }
+
+    /// Consume this mutex, returning the underlying data.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this mutex panicked while holding it.
+    pub fn into_inner(self) -> LockResult<T> {
+        self.inner.into_inner()
+    }
+}
+
+impl<T: ?Sized> Mutex<T> {
+    /// Acquire the mutex, blocking the current thread until it is able to do so.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this mutex panicked while holding it.
+    pub fn lock(&self) -> LockResult<MutexGuard<'_, T>> {
+        let ctx = self.ctx.as_ref();
+        let (result, report) = acquire(ctx, false, || self.inner.try_lock(), || self.inner.lock());
+        let ctx = if report { ctx } else { None };
+        map_result(result, |g| MutexGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Attempt to acquire the mutex without blocking.
+    ///
+    /// # Errors
+    ///
+    /// If the mutex is locked, or if another user of this mutex panicked while holding it.
+    pub fn try_lock(&self) -> TryLockResult<MutexGuard<'_, T>> {
+        let result = self.inner.try_lock();
+        let ctx = if try_acquire(self.ctx.as_ref(), false, &result) {
+            self.ctx.as_ref()
+        } else {
+            None
+        };
+        map_try_result(result, |g| MutexGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Determine whether the mutex is poisoned.
+    pub fn is_poisoned(&self) -> bool {
+        self.inner.is_poisoned()
+    }
+
+    /// Return a mutable reference to the underlying data.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this mutex panicked while holding it.
+    pub fn get_mut(&mut self) -> LockResult<&mut T> {
+        self.inner.get_mut()
+    }
+
+    /// The instrumentation of this mutex, if it was created while a `Client` was running.
+    pub fn lock_ctx(&self) -> Option<&LockCtx> {
+        self.ctx.as_ref()
+    }
+}
+
+impl<T: ?Sized> MutexGuard<'_, T> {
+    /// Mark the location at which the holder of the lock is.
+    ///
+    /// With the `lock-contention-only` feature, only acquisitions which had to wait are marked.
+    pub fn mark(&self, loc: &'static SpanLocation) {
+        if let Some(ctx) = self.ctx {
+            ctx.mark(loc);
+        }
+    }
+}
+
+impl<T: ?Sized> Deref for MutexGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        &self.inner
+    }
+}
+
+impl<T: ?Sized> DerefMut for MutexGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        &mut self.inner
+    }
+}
+
+impl<T: ?Sized> Drop for MutexGuard<'_, T> {
+    fn drop(&mut self) {
+        // SAFE: The guard is not used past this point.
+        unsafe { ManuallyDrop::drop(&mut self.inner) };
+        if let Some(ctx) = self.ctx {
+            ctx.after_unlock();
+        }
+    }
+}
+
+impl<T> RwLock<T> {
+    /// Create a new unlocked reader-writer lock, announced to Tracy with the given location.
+    pub fn new(loc: &'static SpanLocation, value: T) -> Self {
+        Self {
+            ctx: Client::running().map(|client| client.new_shared_lock_ctx(loc)),
+            inner: std::sync::RwLock::new(value),
+        }
+    }
+
+    /// Consume this lock, returning the underlying data.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this lock panicked while holding it for writing.
+    pub fn into_inner(self) -> LockResult<T> {
+        self.inner.into_inner()
+    }
+}
+
+impl<T: ?Sized> RwLock<T> {
+    /// Lock for shared reading, blocking the current thread until it is able to do so.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this lock panicked while holding it for writing.
+    pub fn read(&self) -> LockResult<RwLockReadGuard<'_, T>> {
+        let ctx = self.ctx.as_ref();
+        let (result, report) = acquire(ctx, true, || self.inner.try_read(), || self.inner.read());
+        let ctx = if report { ctx } else { None };
+        map_result(result, |g| RwLockReadGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Attempt to lock for shared reading without blocking.
+    ///
+    /// # Errors
+    ///
+    /// If the lock is held for writing, or if another user of this lock panicked while holding it
+    /// for writing.
+    pub fn try_read(&self) -> TryLockResult<RwLockReadGuard<'_, T>> {
+        let result = self.inner.try_read();
+        let ctx = if try_acquire(self.ctx.as_ref(), true, &result) {
+            self.ctx.as_ref()
+        } else {
+            None
+        };
+        map_try_result(result, |g| RwLockReadGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Lock for exclusive writing, blocking the current thread until it is able to do so.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this lock panicked while holding it for writing.
+    pub fn write(&self) -> LockResult<RwLockWriteGuard<'_, T>> {
+        let ctx = self.ctx.as_ref();
+        let (result, report) =
+            acquire(ctx, false, || self.inner.try_write(), || self.inner.write());
+        let ctx = if report { ctx } else { None };
+        map_result(result, |g| RwLockWriteGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Attempt to lock for exclusive writing without blocking.
+    ///
+    /// # Errors
+    ///
+    /// If the lock is held, or if another user of this lock panicked while holding it for writing.
+    pub fn try_write(&self) -> TryLockResult<RwLockWriteGuard<'_, T>> {
+        let result = self.inner.try_write();
+        let ctx = if try_acquire(self.ctx.as_ref(), false, &result) {
+            self.ctx.as_ref()
+        } else {
+            None
+        };
+        map_try_result(result, |g| RwLockWriteGuard {
+            ctx,
+            inner: ManuallyDrop::new(g),
+        })
+    }
+
+    /// Determine whether the lock is poisoned.
+    pub fn is_poisoned(&self) -> bool {
+        self.inner.is_poisoned()
+    }
+
+    /// Return a mutable reference to the underlying data.
+    ///
+    /// # Errors
+    ///
+    /// If another user of this lock panicked while holding it for writing.
+    pub fn get_mut(&mut self) -> LockResult<&mut T> {
+        self.inner.get_mut()
+    }
+
+    /// The instrumentation of this lock, if it was created while a `Client` was running.
+    pub fn lock_ctx(&self) -> Option<&LockCtx> {
+        self.ctx.as_ref()
+    }
+}
+
+impl<T: ?Sized> RwLockWriteGuard<'_, T> {
+    /// Mark the location at which the holder of the lock is.
+    ///
+    /// With the `lock-contention-only` feature, only acquisitions which had to wait are marked.
+    pub fn mark(&self, loc: &'static SpanLocation) {
+        if let Some(ctx) = self.ctx {
+            ctx.mark(loc);
+        }
+    }
+}
+
+impl<T: ?Sized> Deref for RwLockReadGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        &self.inner
+    }
+}
+
+impl<T: ?Sized> Drop for RwLockReadGuard<'_, T> {
+    fn drop(&mut self) {
+        // SAFE: The guard is not used past this point.
+        unsafe { ManuallyDrop::drop(&mut self.inner) };
+        if let Some(ctx) = self.ctx {
+            ctx.after_unlock_shared();
+        }
+    }
+}
+
+impl<T: ?Sized> Deref for RwLockWriteGuard<'_, T> {
+    type Target = T;
+    fn deref(&self) -> &T {
+        &self.inner
+    }
+}
+
+impl<T: ?Sized> DerefMut for RwLockWriteGuard<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        &mut self.inner
+    }
+}
+
+impl<T: ?Sized> Drop for RwLockWriteGuard<'_, T> {
+    fn drop(&mut self) {
+        // SAFE: The guard is not used past this point.
+        unsafe { ManuallyDrop::drop(&mut self.inner) };
+        if let Some(ctx) = self.ctx {
+            ctx.after_unlock();
+        }
+    }
+}
@@ -1,4 +1,5 @@
 use crate::Client;
+use std::time::Duration;
 
 /// Name of a plot.
 ///
@@ -36,6 +37,29 @@ pub enum PlotLineStyle {
     Smooth,
 }
 
+/// How the values of a downsampled plot are combined into a single value per window.
+///
+/// See [`PlotConfiguration::downsample`].
+#[derive(Debug, Hash, Copy, Clone, PartialEq, Eq, PartialOrd, Ord, Default)]
+#[non_exhaustive]
+pub enum PlotAggregate {
+    /// The last value of the window. This is the default.
+    #[default]
+    Last,
+
+    /// The smallest value of the window.
+    Min,
+
+    /// The largest value of the window.
+    Max,
+
+    /// The average of the values of the window.
+    Mean,
+
+    /// The sum of the values of the window.
+    Sum,
+}
+
 /// Configuration for how a plot appears in the Tracy profiling UI.
 ///
 /// # Examples
@@ -58,6 +82,9 @@ pub struct PlotConfiguration {
 
     /// A custom color of this plot. None means a default color will be generated by Tracy.
     color: Option<u32>,
+
+    /// The window over which values are combined on each thread, and how.
+    downsample: Option<(Duration, PlotAggregate)>,
 }
 
 impl PlotConfiguration {
@@ -96,6 +123,28 @@ impl PlotConfiguration {
         self.color = color;
         self
     }
+
+    /// Combines the values plotted on each thread over windows of the given duration, sending a
+    /// single value per window and thread instead of every value.
+    ///
+    /// This makes plotting from hot loops cheap: values within a window are only accumulated in
+    /// per-thread state. A window is sent when the first value after its end is plotted, or by
+    /// the profiler thread shortly after its end if no value follows, and is shown at the time of
+    /// its last value. A zero duration turns downsampling off again.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// # use std::time::Duration;
+    /// # use tracy_client::{PlotAggregate, PlotConfiguration};
+    /// // Plot the deepest queue seen in every millisecond.
+    /// let configuration = PlotConfiguration::default()
+    ///     .downsample(Duration::from_millis(1), PlotAggregate::Max);
+    /// ```
+    pub fn downsample(mut self, window: Duration, aggregate: PlotAggregate) -> Self {
+        self.downsample = Some((window, aggregate));
+        self
+    }
 }
 
 impl Default for PlotConfiguration {
@@ -105,6 +154,7 @@ impl Default for PlotConfiguration {
             line_style: Default::default(),
             fill: true,
             color: None,
+            downsample: None,
         }
     }
 }
@@ -190,6 +240,24 @@ impl Client {
                     color,
                 );
             }
+            if let Some((window, aggregate)) = configuration.downsample {
+                let aggregate = match aggregate {
+                    PlotAggregate::Last => sys::TracyPlotAggregateEnum_TracyPlotAggregateLast,
+                    PlotAggregate::Min => sys::TracyPlotAggregateEnum_TracyPlotAggregateMin,
+                    PlotAggregate::Max => sys::TracyPlotAggregateEnum_TracyPlotAggregateMax,
+                    PlotAggregate::Mean => sys::TracyPlotAggregateEnum_TracyPlotAggregateMean,
+                    PlotAggregate::Sum => sys::TracyPlotAggregateEnum_TracyPlotAggregateSum,
+                } as std::os::raw::c_int;
+                let window = i64::try_from(window.as_nanos()).unwrap_or(i64::MAX);
+                unsafe {
+                    // SAFE: We made sure the `plot` refers to a null-terminated string.
+                    let () = sys::___tracy_emit_plot_downsample(
+                        plot_name.0.as_ptr().cast(),
+                        window,
+                        aggregate,
+                    );
+                }
+            }
         }
     }
 }
@@ -15,13 +15,39 @@ pub struct Span {
     _no_send_sync: std::marker::PhantomData<*mut ()>,
 }
 
+/// The context of a zone which wasn't started, as the C API returns for inactive zones.
+#[cfg(feature = "enable")]
+const INACTIVE_ZONE: sys::___tracy_c_zone_context =
+    sys::___tracy_c_zone_context { id: 0, active: 0 };
+
+/// A batch of spans with timestamps known up front.
+///
+/// Events are collected in memory and handed over to Tracy all at once when the batch is committed
+/// or dropped, which is considerably cheaper than emitting every span separately. This is useful
+/// for replaying already recorded timelines, such as the journal of a job system.
+///
+/// Construct with [`Client::span_batch`].
+pub struct SpanBatch {
+    #[cfg(feature = "enable")]
+    client: Client,
+    #[cfg(feature = "enable")]
+    events: Vec<sys::___tracy_zone_batch_event>,
+    /// The spans belong to the thread the batch was created on, in both configurations.
+    _no_send_sync: std::marker::PhantomData<*mut ()>,
+}
+
 /// A statically allocated location information for a span.
 ///
-/// Construct with the [`span_location!`](crate::span_location) macro.
+/// Construct with the [`span_location!`](crate::span_location) macro, or with
+/// [`SpanLocation::new`] for locations only known at run time.
 pub struct SpanLocation {
     #[cfg(feature = "enable")]
     pub(crate) _function_name: CString,
     #[cfg(feature = "enable")]
+    pub(crate) _name: Option<CString>,
+    #[cfg(feature = "enable")]
+    pub(crate) _file: Option<CString>,
+    #[cfg(feature = "enable")]
     pub(crate) data: sys::___tracy_source_location_data,
     #[cfg(not(feature = "enable"))]
     pub(crate) _internal: (),
@@ -30,6 +56,51 @@ pub struct SpanLocation {
 unsafe impl Send for SpanLocation {}
 unsafe impl Sync for SpanLocation {}
 
+impl SpanLocation {
+    /// Create the location information for a span from strings only known at run time.
+    ///
+    /// Spans started with [`Client::span`] need a `&'static SpanLocation`, so the location is
+    /// usually leaked, e.g. with [`Box::leak`], and reused for every span with the same location.
+    /// Unlike [`Client::span_alloc`], this copies the strings only once, and the profiler sends
+    /// them to the server only once.
+    ///
+    /// # Errors
+    ///
+    /// Fails if any of the strings contains a nul byte.
+    pub fn new(
+        name: Option<&str>,
+        function: &str,
+        file: &str,
+        line: u32,
+    ) -> Result<Self, std::ffi::NulError> {
+        #[cfg(feature = "enable")]
+        {
+            let name = name.map(CString::new).transpose()?;
+            let function_name = CString::new(function)?;
+            let file = CString::new(file)?;
+            Ok(Self {
+                data: sys::___tracy_source_location_data {
+                    name: name.as_ref().map_or(std::ptr::null(), |n| n.as_ptr()),
+                    function: function_name.as_ptr(),
+                    file: file.as_ptr(),
+                    line,
+                    color: 0,
+                    #[cfg(feature = "zone-categories")]
+                    category: 0,
+                },
+                _function_name: function_name,
+                _name: name,
+                _file: Some(file),
+            })
+        }
+        #[cfg(not(feature = "enable"))]
+        {
+            let _ = (name, function, file, line);
+            Ok(Self { _internal: () })
+        }
+    }
+}
+
 /// Instrumentation for timed regions, spans or zones of execution.
 impl Client {
     /// Start a new Tracy span/zone.
@@ -62,7 +133,9 @@ impl Client {
     pub fn span(self, loc: &'static SpanLocation, callstack_depth: u16) -> Span {
         #[cfg(feature = "enable")]
         unsafe {
-            let zone = if callstack_depth == 0 {
+            let zone = if crate::state::zones_dropped() {
+                INACTIVE_ZONE
+            } else if callstack_depth == 0 {
                 sys::___tracy_emit_zone_begin(&loc.data, 1)
             } else {
                 let stack_depth = adjust_stack_depth(callstack_depth).into();
@@ -116,6 +189,13 @@ impl Client {
     ) -> Span {
         #[cfg(feature = "enable")]
         unsafe {
+            if crate::state::zones_dropped() {
+                return Span {
+                    client: self,
+                    zone: INACTIVE_ZONE,
+                    _no_send_sync: std::marker::PhantomData,
+                };
+            }
             let loc = sys::___tracy_alloc_srcloc_name(
                 line,
                 file.as_ptr().cast(),
@@ -145,6 +225,130 @@ impl Client {
     }
 }
 
+/// Instrumentation for spans with explicitly specified timestamps.
+impl Client {
+    /// Current time, suitable for the timestamps of a [`SpanBatch`].
+    ///
+    /// The value is in profiler specific units and is only meaningful when compared to other
+    /// values returned by this function.
+    #[inline]
+    #[must_use]
+    pub fn now(&self) -> i64 {
+        #[cfg(feature = "enable")]
+        unsafe {
+            sys::___tracy_get_time()
+        }
+        #[cfg(not(feature = "enable"))]
+        0
+    }
+
+    /// Start a new batch of spans.
+    ///
+    /// # Example
+    ///
+    /// ```rust
+    /// use tracy_client::{Client, span_location};
+    /// let client = Client::start();
+    /// let start = client.now();
+    /// let mut batch = client.span_batch();
+    /// for i in 0..4 {
+    ///     batch.begin(span_location!("job"), start + i * 10);
+    ///     batch.value(i as u64);
+    ///     batch.end(start + i * 10 + 5);
+    /// }
+    /// batch.commit();
+    /// ```
+    #[inline]
+    #[must_use]
+    pub fn span_batch(self) -> SpanBatch {
+        #[cfg(feature = "enable")]
+        {
+            SpanBatch {
+                client: self,
+                events: Vec::new(),
+                _no_send_sync: std::marker::PhantomData,
+            }
+        }
+        #[cfg(not(feature = "enable"))]
+        SpanBatch {
+            _no_send_sync: std::marker::PhantomData,
+        }
+    }
+}
+
+impl SpanBatch {
+    #[cfg(feature = "enable")]
+    fn push(
+        &mut self,
+        type_: u32,
+        srcloc: *const sys::___tracy_source_location_data,
+        time: i64,
+        value: u64,
+    ) {
+        self.events.push(sys::___tracy_zone_batch_event {
+            srcloc,
+            time,
+            value,
+            type_: type_ as u8,
+        });
+    }
+
+    /// Begin a span at `time`, as obtained from [`Client::now`].
+    ///
+    /// Within a batch time must not decrease, nor may it precede any span that was emitted on the
+    /// committing thread before.
+    pub fn begin(&mut self, loc: &'static SpanLocation, time: i64) {
+        #[cfg(feature = "enable")]
+        self.push(
+            sys::TracyZoneBatchType_TracyZoneBatchBegin,
+            &loc.data,
+            time,
+            0,
+        );
+    }
+
+    /// End the innermost span begun in this batch at `time`.
+    pub fn end(&mut self, time: i64) {
+        #[cfg(feature = "enable")]
+        self.push(
+            sys::TracyZoneBatchType_TracyZoneBatchEnd,
+            std::ptr::null(),
+            time,
+            0,
+        );
+    }
+
+    /// Emit a numeric value associated with the innermost span begun in this batch.
+    pub fn value(&mut self, value: u64) {
+        #[cfg(feature = "enable")]
+        self.push(
+            sys::TracyZoneBatchType_TracyZoneBatchValue,
+            std::ptr::null(),
+            0,
+            value,
+        );
+    }
+
+    /// Emit the collected spans on the current thread.
+    ///
+    /// The batch may be reused afterwards.
+    pub fn commit(&mut self) {
+        #[cfg(feature = "enable")]
+        unsafe {
+            // SAFE: all events refer to `'static` span locations.
+            let () = sys::___tracy_emit_zone_batch(self.events.as_ptr(), self.events.len());
+            self.events.clear();
+            std::convert::identity(&self.client);
+        }
+    }
+}
+
+impl Drop for SpanBatch {
+    fn drop(&mut self) {
+        self.commit();
+    }
+}
+
 impl Span {
     /// Emit a numeric value associated with this span.
     pub fn emit_value(&self, value: u64) {
@@ -184,7 +388,9 @@ impl Drop for Span {
         unsafe {
             // SAFE: The only way to construct `Span` is by creating a valid tracy zone context. We
             // also still have an owned Client handle.
-            let () = sys::___tracy_emit_zone_end(self.zone);
+            if self.zone.active != 0 {
+                let () = sys::___tracy_emit_zone_end(self.zone);
+            }
             std::convert::identity(&self.client);
         }
     }
@@ -64,6 +64,33 @@ impl Client {
     }
 }
 
+/// Whether zones started now are dropped anyway, because the `ondemand` client has no profiler
+/// connected.
+///
+/// The C API checks the same in every zone begin, but reading the flag here saves two FFI calls
+/// (and the source location allocation of [`Client::span_alloc`]) for each span started while
+/// nothing is connected. With `manual-lifetime` the profiler may move, so the flag is not cached.
+#[cfg(feature = "enable")]
+#[inline(always)]
+pub(crate) fn zones_dropped() -> bool {
+    #[cfg(all(feature = "ondemand", not(feature = "manual-lifetime")))]
+    {
+        use std::sync::atomic::{AtomicBool, AtomicPtr, Ordering};
+        static CONNECTED: AtomicPtr<AtomicBool> = AtomicPtr::new(std::ptr::null_mut());
+        let mut flag = CONNECTED.load(Ordering::Relaxed);
+        if flag.is_null() {
+            // SAFE: The flag lives as long as the profiler, which is never shut down without
+            // `manual-lifetime`. Racing threads store the same pointer.
+            flag = unsafe { sys::___tracy_connected_flag() } as *mut AtomicBool;
+            CONNECTED.store(flag, Ordering::Relaxed);
+        }
+        // SAFE: `std::atomic<bool>` has the layout of `AtomicBool`.
+        !unsafe { &*flag }.load(Ordering::Acquire)
+    }
+    #[cfg(not(all(feature = "ondemand", not(feature = "manual-lifetime"))))]
+    false
+}
+
 impl Clone for Client {
     /// A cheaper alternative to [`Client::start`] or [`Client::running`]  when there is already a
     /// handle handy.
@@ -0,0 +1,92 @@
+use crate::Client;
+use std::time::Duration;
+
+/// Statistics the client keeps about itself, see [`Client::stats`].
+///
+/// The depths are sampled by the profiler thread of the client every 100 ms while a profiler is
+/// connected. Everything else is a total since the client was started.
+///
+/// Setting the `TRACY_CLIENT_STATS=1` environment variable additionally has the client send the
+/// statistics as plots, with names starting with `Tracy`, every 100 ms.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+#[non_exhaustive]
+pub struct ClientStats {
+    /// Events waiting to be processed by the profiler thread.
+    pub queue_depth: u64,
+    /// The most events, such as memory, lock and GPU events, which the profiler thread took from
+    /// the queues of the events kept in order across threads at once over the last 100 ms.
+    pub serial_depth: u64,
+    /// Call stack frames and symbols waiting to be resolved.
+    pub symbol_queue_depth: u64,
+    /// Bytes of frame images waiting to be compressed.
+    pub frame_image_backlog: u64,
+    /// Time the profiler thread spent processing events while a profiler was connected.
+    pub worker_busy: Duration,
+    /// Time the profiler thread spent waiting for events while a profiler was connected.
+    pub worker_idle: Duration,
+    /// Bytes of data handed to compression.
+    pub raw_bytes: u64,
+    /// Bytes of data sent to the profiler, after compression.
+    pub compressed_bytes: u64,
+    /// Time spent sending data to the profiler, which includes the time spent blocked on a slow
+    /// connection.
+    pub send_time: Duration,
+    /// Call stack frames and symbols resolved.
+    pub symbols_resolved: u64,
+    /// Call stack and hardware samples the kernel dropped because the client didn't keep up.
+    pub samples_lost: u64,
+    /// Frame images dropped because too many were waiting to be compressed.
+    pub frame_images_dropped: u64,
+}
+
+impl ClientStats {
+    /// The part of the time the profiler thread was busy, between 0 and 1.
+    ///
+    /// A value close to 1 means that it barely keeps up with the events the program produces.
+    #[must_use]
+    pub fn worker_load(&self) -> f64 {
+        let total = self.worker_busy + self.worker_idle;
+        if total.is_zero() {
+            return 0.0;
+        }
+        self.worker_busy.as_secs_f64() / total.as_secs_f64()
+    }
+}
+
+impl Client {
+    /// Obtain the statistics the client keeps about itself.
+    ///
+    /// These help telling whether the client is the bottleneck of the profiling: a growing queue
+    /// depth or a high [`ClientStats::worker_load`] mean that the profiler thread doesn't keep up,
+    /// a large part of the time spent in [`ClientStats::send_time`] that the connection doesn't.
+    ///
+    /// All the statistics are zero if the `enable` feature is not enabled.
+    #[must_use]
+    pub fn stats(&self) -> ClientStats {
+        #[cfg(feature = "enable")]
+        {
+            let mut stats = std::mem::MaybeUninit::uninit();
+            // SAFE: `___tracy_get_client_stats` initializes all of the fields.
+            let stats = unsafe {
+                sys::___tracy_get_client_stats(stats.as_mut_ptr());
+                stats.assume_init()
+            };
+            ClientStats {
+                queue_depth: stats.queueDepth,
+                serial_depth: stats.serialDepth,
+                symbol_queue_depth: stats.symbolQueueDepth,
+                frame_image_backlog: stats.frameImageBacklog,
+                worker_busy: Duration::from_nanos(stats.workerBusyNs),
+                worker_idle: Duration::from_nanos(stats.workerIdleNs),
+                raw_bytes: stats.rawBytes,
+                compressed_bytes: stats.compressedBytes,
+                send_time: Duration::from_nanos(stats.sendNs),
+                symbols_resolved: stats.symbolsResolved,
+                samples_lost: stats.samplesLost,
+                frame_images_dropped: stats.frameImagesDropped,
+            }
+        }
+        #[cfg(not(feature = "enable"))]
+        ClientStats::default()
+    }
+}
@@ -0,0 +1,70 @@
+use crate::Client;
+
+/// Scheduling class of the threads the client starts, see [`Client::set_thread_priority`].
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Hash)]
+#[non_exhaustive]
+pub enum ThreadSched {
+    /// The default time sharing class.
+    #[default]
+    Normal,
+    /// Time sharing for threads which are not interactive, with longer time slices and a small
+    /// penalty when waking up.
+    Batch,
+    /// Run only when nothing else wants the CPU.
+    Idle,
+}
+
+impl Client {
+    /// Restrict the threads the client starts, like the profiler thread, the symbol resolution
+    /// thread or the system tracing threads, to the given CPUs.
+    ///
+    /// The CPUs are given as a list such as `"0-1,6"`. An empty list lets the threads run on the
+    /// CPUs they started with again. This applies to the running threads as well as the ones
+    /// started later. The initial affinity can be set with the `TRACY_THREAD_AFFINITY`
+    /// environment variable, in the same format.
+    ///
+    /// Returns `false` if the list does not parse, if the affinity could not be applied to some of
+    /// the threads, or if this is not supported, which is everywhere but on Linux.
+    pub fn set_thread_affinity(&self, cpus: &str) -> bool {
+        #[cfg(feature = "enable")]
+        {
+            let Ok(cpus) = std::ffi::CString::new(cpus) else {
+                return false;
+            };
+            // SAFE: `cpus` is a valid null-terminated string.
+            unsafe { sys::___tracy_set_thread_affinity(cpus.as_ptr()) != 0 }
+        }
+        #[cfg(not(feature = "enable"))]
+        {
+            let _ = cpus;
+            false
+        }
+    }
+
+    /// Set the nice value and the scheduling class of the threads the client starts.
+    ///
+    /// Like [`Client::set_thread_affinity`] this applies to the running threads as well as the
+    /// ones started later. The initial values can be set with the `TRACY_THREAD_NICE` and
+    /// `TRACY_THREAD_SCHED` environment variables, that last one being `normal`, `batch` or
+    /// `idle`. Lowering the nice value usually requires privileges.
+    ///
+    /// Returns `false` if the priority could not be applied to some of the threads, or if this is
+    /// not supported, which is everywhere but on Linux.
+    pub fn set_thread_priority(&self, nice: i32, sched: ThreadSched) -> bool {
+        #[cfg(feature = "enable")]
+        {
+            let sched = match sched {
+                ThreadSched::Normal => 0,
+                ThreadSched::Batch => 1,
+                ThreadSched::Idle => 2,
+            };
+            // SAFE: all arguments are valid.
+            unsafe { sys::___tracy_set_thread_priority(nice, sched) != 0 }
+        }
+        #[cfg(not(feature = "enable"))]
+        {
+            let _ = (nice, sched);
+            false
+        }
+    }
+}
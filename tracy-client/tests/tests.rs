@@ -1,3 +1,4 @@
+use std::sync::Arc;
 use std::time::Duration;
 
 use tracy_client::*;
@@ -24,6 +25,20 @@ fn alloc_zone() {
     span.emit_text("some text");
 }
 
+fn batched_zones() {
+    let client = Client::start();
+    let start = client.now();
+    let mut batch = client.span_batch();
+    for i in 0..3000 {
+        batch.begin(span_location!("batched_zone"), start + i * 20);
+        batch.value(i as u64);
+        batch.begin(span_location!("batched_inner_zone"), start + i * 20 + 5);
+        batch.end(start + i * 20 + 10);
+        batch.end(start + i * 20 + 15);
+    }
+    batch.commit();
+}
+
 fn finish_frameset() {
     let client = Client::start();
     for _ in 0..10 {
@@ -47,6 +62,15 @@ fn non_continuous_frameset() {
     let _ = non_continuous_frame!("non continuous macro");
 }
 
+fn frame_images() {
+    let client = Client::start();
+    client.frame_mark();
+    client.frame_image(&[0x80; 16 * 8 * 4], 16, 8, 0, false);
+    // BC1 blocks of 4x4 pixels, 8 bytes each.
+    client.frame_image_compressed(&[0; 16 * 8 / 2], 16, 8, 0, true);
+    frame_image_compressed(&[0; 16 * 8 / 2], 16, 8, 1, false);
+}
+
 fn plot_something() {
     static TEMPERATURE: PlotName = plot_name!("temperature");
     let client = Client::start();
@@ -57,6 +81,49 @@ fn plot_something() {
     plot!("temperature", 42.0);
 }
 
+fn plot_downsampled() {
+    static DEPTH: PlotName = plot_name!("queue depth");
+    let client = Client::start();
+    client.plot_config(
+        DEPTH,
+        PlotConfiguration::default().downsample(Duration::from_micros(100), PlotAggregate::Max),
+    );
+    for i in 0..100_000 {
+        client.plot(DEPTH, f64::from(i % 64));
+    }
+}
+
+fn locks() {
+    let _client = Client::start();
+    let counter = Arc::new(Mutex::new(span_location!("counter"), 0_u64));
+    let table = Arc::new(RwLock::new(span_location!("table"), vec![0_u64; 16]));
+    let threads: Vec<_> = (0..4)
+        .map(|i| {
+            let counter = Arc::clone(&counter);
+            let table = Arc::clone(&table);
+            std::thread::spawn(move || {
+                for j in 0..10_000 {
+                    *counter.lock().unwrap() += 1;
+                    if j % 100 == 0 {
+                        table.write().unwrap()[i] += 1;
+                    } else {
+                        assert!(table.read().unwrap().len() == 16);
+                    }
+                }
+            })
+        })
+        .collect();
+    for thread in threads {
+        thread.join().unwrap();
+    }
+    assert_eq!(*counter.lock().unwrap(), 40_000);
+    assert!(counter.try_lock().is_ok());
+    assert!(table.try_read().is_ok());
+    let write = table.try_write().unwrap();
+    assert!(table.try_read().is_err());
+    drop(write);
+}
+
 fn allocations() {
     let mut strings = Vec::new();
     for i in 0..100 {
@@ -132,15 +199,93 @@ fn gpu() {
     span2.upload_timestamp_end(130_000);
 }
 
+fn gpu_queues() {
+    let pool = GpuQueryPool::new();
+    let contexts: Vec<_> = ["Graphics", "Compute", "Transfer"]
+        .into_iter()
+        .map(|name| {
+            Client::start()
+                .new_gpu_context_with_query_pool(
+                    Some(name),
+                    GpuContextType::Vulkan,
+                    1_000,
+                    1.0,
+                    &pool,
+                )
+                .unwrap()
+        })
+        .collect();
+
+    // The spans are kept until all of them have been checked, so that no ids are given back.
+    let ids = std::sync::Mutex::new(std::collections::HashSet::new());
+    let barrier = std::sync::Barrier::new(6);
+    std::thread::scope(|s| {
+        for (thread, context) in contexts.iter().cycle().take(6).enumerate() {
+            let (ids, barrier) = (&ids, &barrier);
+            s.spawn(move || {
+                let spans: Vec<_> = (0..100)
+                    .map(|_| {
+                        let mut span = context.span(span_location!("queue span")).unwrap();
+                        span.end_zone();
+                        span
+                    })
+                    .collect();
+                let mut ids = ids.lock().unwrap();
+                for span in &spans {
+                    let (start, end) = span.query_ids();
+                    assert!(ids.insert(start));
+                    assert!(ids.insert(end));
+                }
+                drop(ids);
+                barrier.wait();
+                for (i, span) in spans.into_iter().enumerate() {
+                    let time = (thread * 1000 + i) as i64 * 10;
+                    span.upload_timestamp_start(time);
+                    span.upload_timestamp_end(time + 5);
+                }
+            });
+        }
+    });
+    assert_eq!(ids.into_inner().unwrap().len(), 1200);
+
+    let id = pool.allocate().unwrap();
+    pool.release(id);
+}
+
+fn client_stats() {
+    let client = Client::start();
+    let before = client.stats();
+    client.message("stats", 0);
+    let after = client.stats();
+    assert!(after.raw_bytes >= before.raw_bytes);
+    assert!(after.compressed_bytes >= before.compressed_bytes);
+    assert!(after.worker_busy >= before.worker_busy);
+    assert!((0.0..=1.0).contains(&after.worker_load()));
+}
+
+fn thread_policy() {
+    let client = Client::start();
+    assert!(!client.set_thread_affinity("not a cpu list"));
+    if cfg!(target_os = "linux") {
+        assert!(client.set_thread_affinity("0-4095"));
+        assert!(client.set_thread_priority(1, ThreadSched::Batch));
+        assert!(client.set_thread_affinity(""));
+    }
+}
+
 fn main() {
     #[cfg(not(loom))]
     {
         basic_zone();
         alloc_zone();
+        batched_zones();
         finish_frameset();
         finish_secondary_frameset();
         non_continuous_frameset();
+        frame_images();
         plot_something();
+        plot_downsampled();
+        locks();
         message();
         allocations();
         tls_confusion();
@@ -152,6 +297,9 @@ fn main() {
         thread.join().unwrap();
         set_thread_name();
         gpu();
+        gpu_queues();
+        client_stats();
+        thread_policy();
         // Sleep to give time to the client to send the data to the profiler.
         std::thread::sleep(Duration::from_secs(5));
     }